@@ -0,0 +1,237 @@
+#pragma once
+
+/*
+ *  CPU reference of RTRTprojects/Playground/shaders/RayScheduler.hlsl.
+ *
+ *  The GPU runs the scheduler gridSize + 1 times per frame, each pass followed
+ *  by a DispatchRays that traces every pixel marked AS_CAST. Schedule() is one
+ *  of those compute dispatches, Run() is the whole loop with a user supplied
+ *  tracer in place of DispatchRays.
+ *
+ *  With SchedulerMode::Quadtree it is the reference of QuadtreeScheduler.hlsl
+ *  instead, which refines a coarse ray lattice cell by cell in a fixed number
+ *  of passes.
+ *
+ *  Unlike the compute shader, which reads neighbours while other threads of the
+ *  same dispatch are writing them, every pass here decides against the sample
+ *  state as it was at the start of the pass. The result is deterministic and
+ *  independent of the tile order and thread count.
+ */
+
+#include "RayBuffer.h"
+#include "RayCompaction.h"
+#include "VectorMath.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace cpulib
+{
+
+class ThreadPool;
+
+enum class SchedulerMode
+{
+    // RayScheduler.hlsl, gridSize + 1 passes.
+    Iterative,
+    // QuadtreeScheduler.hlsl, at most quadtreePasses passes for any gridSize.
+    Quadtree,
+};
+
+/**
+ * The adaptive sampling part of DenoiserFilterData.
+ */
+struct AdaptiveSamplerSettings
+{
+    int gridSize = 0;
+
+    SchedulerMode mode = SchedulerMode::Iterative;
+    // Scheduler + trace passes of the quadtree mode, at least 2.
+    int quadtreePasses = 3;
+
+    float posDiffLimit   = 1;
+    float normalDotLimit = 0.98f;
+    float depthDiffLimit = 1;
+    float colourLimit    = 0.1f;
+
+    // Variance guided scheduling, driven by the SVGF moment history.
+    bool varianceGuided = false;
+    // Relative standard deviation of the luminance above which a pixel is unconverged.
+    float varianceLimit = 0.1f;
+    // Pixels with a shorter history are unconverged.
+    int minHistoryLength = 4;
+    // Colour and position limits of converged pixels are scaled by this, and
+    // their normal limit is widened by the same amount.
+    float convergedLimitScale = 2;
+};
+
+struct AdaptiveSamplerStats
+{
+    // Rays marked AS_CAST and pixels interpolated, per scheduler pass.
+    std::vector<uint32_t> castPerPass;
+    std::vector<uint32_t> interpolatedPerPass;
+
+    uint64_t totalCast         = 0;
+    uint64_t totalInterpolated = 0;
+    uint64_t pixelCount        = 0;
+
+    // RMSE of the colour against the reference, only set when run against one.
+    double colourError = 0;
+};
+
+class AdaptiveSampler
+{
+public:
+    struct Triangle
+    {
+        int2 one;
+        int2 two;
+        int2 three;
+
+        float3 barycentrics;
+    };
+
+    struct Square
+    {
+        int2 one;
+        int2 two;
+        int2 three;
+        int2 four;
+
+        float4 barycentrics;
+    };
+
+    /**
+     * Trace every pixel whose colour.w is AS_CAST and mark it AS_CASTED.
+     * @param iteration The scheduler pass that preceded this trace.
+     */
+    using TraceFunction = std::function<void( RayBuffer& buffer, int iteration )>;
+
+    explicit AdaptiveSampler( ThreadPool& pool );
+
+    void SetSettings( const AdaptiveSamplerSettings& settings )
+    {
+        m_Settings = settings;
+    }
+
+    const AdaptiveSamplerSettings& GetSettings() const
+    {
+        return m_Settings;
+    }
+
+    /**
+     * Number of scheduler + trace passes per frame.
+     */
+    int GetPassCount() const
+    {
+        if ( m_Settings.mode == SchedulerMode::Quadtree && m_Settings.gridSize > 0 )
+            return std::clamp( m_Settings.quadtreePasses, 2, m_Settings.gridSize + 1 );
+
+        return m_Settings.gridSize + 1;
+    }
+
+    /**
+     * Moments of the previous frame, laid out like the SVGF moment history:
+     * mean luminance, mean squared luminance and history length in x, y and z.
+     * Used when varianceGuided is set, nullptr turns the guidance off.
+     */
+    void SetMomentHistory( const ImageF4* moments )
+    {
+        m_Moments = moments;
+    }
+
+    /**
+     * Reset the colour target the way OnRender clears it before the first
+     * pass: everything AS_EMPTY, or AS_CAST when adaptive sampling is off.
+     */
+    void Clear( RayBuffer& buffer ) const;
+
+    /**
+     * One RayScheduler dispatch.
+     * @param castCount Optional, receives the number of pixels marked AS_CAST.
+     * @param interpolatedCount Optional, receives the number of pixels interpolated.
+     */
+    void Schedule( RayBuffer& buffer, int iteration, uint32_t* castCount = nullptr,
+                   uint32_t* interpolatedCount = nullptr );
+
+    /**
+     * Clear followed by every scheduler pass and trace.
+     */
+    AdaptiveSamplerStats Run( RayBuffer& buffer, const TraceFunction& trace );
+
+    /**
+     * Replay the schedule against a fully traced reference frame, the
+     * reference stands in for DispatchRays. The returned stats carry the
+     * colour error of the interpolated pixels.
+     */
+    AdaptiveSamplerStats Run( RayBuffer& buffer, const RayBuffer& reference );
+
+    /**
+     * Copy every AS_CAST pixel from reference into buffer and mark it AS_CASTED.
+     * Only the compacted work list is visited, not the whole frame.
+     */
+    void TraceFromReference( RayBuffer& buffer, const RayBuffer& reference );
+
+    /**
+     * Work list of the last TraceFromReference.
+     */
+    const RayCompaction& GetCompaction() const
+    {
+        return m_Compaction;
+    }
+
+    /**
+     * Unconverged pixels are cast in the first pass, converged ones get
+     * relaxed interpolation limits. Schedule evaluates the same test four
+     * pixels at a time.
+     * @returns 1 for an unconverged pixel, -1 for a converged one, 0 without guidance.
+     */
+    int GetConvergence( int2 p ) const;
+
+    /* Direct ports of the shader helpers. */
+    static bool     ShootNextRay( int2 pos, int tileSize );
+    static int      CalcWidth( int widthIndex );
+    static int      CalcAdjustedSide( int side, int itr );
+    static float3   CalcBaryCentrics( const Triangle& tri, int2 p );
+    static Triangle BuildTriangle( int2 pos, int side );
+
+    /**
+     * Spacing of the ray lattice the quadtree mode casts in a pass. The first
+     * pass seeds every 2^gridSize pixels, the last one casts what is left
+     * and the levels in between are spread evenly over the other passes.
+     */
+    static int CalcLatticeSpacing( int gridSize, int passCount, int pass );
+
+private:
+    bool TryInterpolateFromSquare( RayBuffer& buffer, int2 pos, const Square& quad, float limitScale ) const;
+    bool TryInterpolateFromTriangle( RayBuffer& buffer, int2 pos, const Triangle& tri, float limitScale ) const;
+    bool TryInterpolateFromCell( RayBuffer& buffer, int2 pos, int2 upperLeft, int2 lowerRight,
+                                 float limitScale ) const;
+
+    void ScheduleIterative( RayBuffer& buffer, int iteration, uint32_t& castCount, uint32_t& interpolatedCount );
+    void ScheduleQuadtree( RayBuffer& buffer, int iteration, uint32_t& castCount, uint32_t& interpolatedCount );
+
+    uint8_t GetState( int2 p ) const;
+
+    // GetConvergence of the pixels of row y, m_StateWidth of them.
+    void GetConvergenceRow( uint32_t y, int8_t* convergence ) const;
+
+    ThreadPool& m_Pool;
+
+    AdaptiveSamplerSettings m_Settings;
+
+    RayCompaction m_Compaction;
+
+    const ImageF4* m_Moments = nullptr;
+
+    // colour.w of every pixel, captured at the start of a pass.
+    std::vector<uint8_t> m_State;
+    // GetConvergence of every pixel, evaluated with the state.
+    std::vector<int8_t> m_Convergence;
+    uint32_t             m_StateWidth  = 0;
+    uint32_t             m_StateHeight = 0;
+};
+
+}  // namespace cpulib
@@ -0,0 +1,139 @@
+#pragma once
+
+/*
+ *  Memory aliasing planner for transient render targets.
+ *
+ *  Every resource has a size, an alignment and a lifetime: a set of
+ *  intervals on a timeline of passes. Resources that are never alive at the
+ *  same time can share memory. Plan places all of them in one heap, the
+ *  biggest first, each at the lowest aligned offset that does not collide
+ *  with an already placed resource it shares a pass with.
+ *
+ *  That is the layout of placed resources in a D3D12 heap, but nothing in
+ *  here knows about D3D12: sizes are bytes and times are pass indices.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cpulib
+{
+
+class ResourceRotation;
+
+class AliasingPlanner
+{
+public:
+    // D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT.
+    static const uint64_t DEFAULT_ALIGNMENT = 64 * 1024;
+
+    /**
+     * @param alignment A power of two, the placement alignment of the resource.
+     * @returns The resource index.
+     */
+    uint32_t AddResource( const std::string& name, uint64_t size, uint64_t alignment = DEFAULT_ALIGNMENT );
+
+    /**
+     * The resource holds data from pass begin up to and including pass end.
+     * A resource without any lifetime is never used and shares with anything.
+     */
+    void AddLifetime( uint32_t resource, uint32_t begin, uint32_t end );
+
+    /**
+     * Whether the two resources are alive in a common pass.
+     */
+    bool Overlaps( uint32_t a, uint32_t b ) const;
+
+    /**
+     * Assign the offsets.
+     */
+    void Plan();
+
+    /**
+     * Whether the planned resources have a byte in common. Placed like that,
+     * the one taking over needs an aliasing barrier.
+     */
+    bool SharesMemory( uint32_t a, uint32_t b ) const;
+
+    /**
+     * Check the placement against the lifetimes: alignment, and no two
+     * resources alive together share a byte.
+     */
+    bool Validate( std::string* error = nullptr ) const;
+
+    uint32_t GetResourceCount() const
+    {
+        return static_cast<uint32_t>( m_Resources.size() );
+    }
+
+    const std::string& GetResourceName( uint32_t resource ) const
+    {
+        return m_Resources[resource].name;
+    }
+
+    uint64_t GetSize( uint32_t resource ) const
+    {
+        return m_Resources[resource].size;
+    }
+
+    uint64_t GetOffset( uint32_t resource ) const
+    {
+        return m_Resources[resource].offset;
+    }
+
+    /**
+     * Size of the heap the resources are placed in.
+     */
+    uint64_t GetHeapSize() const
+    {
+        return m_HeapSize;
+    }
+
+    /**
+     * What the resources take as committed resources, each size rounded up to
+     * its alignment.
+     */
+    uint64_t GetCommittedSize() const;
+
+    uint64_t GetSavedBytes() const
+    {
+        return GetCommittedSize() - m_HeapSize;
+    }
+
+    /**
+     * One line per resource, for logs.
+     */
+    std::string Describe() const;
+
+private:
+    struct Interval
+    {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    struct Resource
+    {
+        std::string           name;
+        uint64_t              size      = 0;
+        uint64_t              alignment = DEFAULT_ALIGNMENT;
+        uint64_t              offset    = 0;
+        std::vector<Interval> lifetime;
+    };
+
+    std::vector<Resource> m_Resources;
+    uint64_t              m_HeapSize = 0;
+};
+
+/**
+ * Add one resource of bufferSize bytes per buffer of a planned rotation, in
+ * buffer order, with the lifetimes of the values the rotation keeps in it.
+ * The timeline is the stages of the frames before the cycle followed by the
+ * stages of one cycle. A value that is read in the next cycle, the history,
+ * wraps around to the start of the cycle.
+ */
+void AddRotationLifetimes( AliasingPlanner& planner, const ResourceRotation& rotation, uint64_t bufferSize,
+                           uint64_t alignment = AliasingPlanner::DEFAULT_ALIGNMENT );
+
+}  // namespace cpulib
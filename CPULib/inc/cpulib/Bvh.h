@@ -0,0 +1,215 @@
+#pragma once
+
+/*
+ *  A bounding volume hierarchy over the triangles of a scene, built on the
+ *  CPU, so the quality and the size of what the driver builds for the BLAS
+ *  can be compared against, and rays traced without DXR.
+ *
+ *  The triangles are those of the meshes as imported (see MeshGeometry in
+ *  MeshDedup.h), in the space of their vertices, as the BLAS holds them.
+ *
+ *  The build is binned SAH: every node sorts the centroids of its triangles
+ *  into binCount bins along each axis and splits where the surface area
+ *  heuristic is lowest, or becomes a leaf when that is cheaper than any
+ *  split. The top of the tree is split one level at a time, binning the
+ *  large nodes in parallel and the nodes of a wide level side by side, until
+ *  the nodes are small enough to build their whole subtrees as separate
+ *  tasks. The result doesn't depend on the number of threads.
+ *
+ *  Animated geometry is updated in place: Update refits the bounds bottom
+ *  up to the moved triangles and compares the SAH cost of every subtree,
+ *  over the area of its root, with what it was when the subtree was built.
+ *  Subtrees that degraded past a threshold are rebuilt, or the whole tree
+ *  when they hold most of the triangles, the way a BLAS is updated with
+ *  ALLOW_UPDATE and rebuilt once it has become too slow to trace.
+ */
+
+#include "MeshDedup.h"
+#include "VectorMath.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cpulib
+{
+
+class ThreadPool;
+
+/**
+ * A binary node, 32 bytes. The two children of an inner node are next to
+ * each other.
+ */
+struct BvhNode
+{
+    float3 lower;
+    // The first child of an inner node, the first triangle of a leaf.
+    uint32_t first;
+    float3   upper;
+    // The triangles of a leaf, 0 for an inner node.
+    uint32_t count;
+
+    bool IsLeaf() const
+    {
+        return count > 0;
+    }
+};
+
+struct BvhTriangle
+{
+    float3 v0, v1, v2;
+};
+
+/**
+ * Where a triangle came from: GeometryIndex() and PrimitiveIndex() of a hit.
+ */
+struct BvhPrimitive
+{
+    uint32_t mesh;
+    uint32_t triangle;
+};
+
+struct BvhBuildOptions
+{
+    // Per axis and node.
+    uint32_t binCount = 16;
+    // Larger nodes are split even when the SAH would make them a leaf.
+    uint32_t maxLeafSize = 4;
+
+    // The SAH cost of stepping through a node and of testing a triangle.
+    float traversalCost    = 1.0f;
+    float intersectionCost = 1.0f;
+
+    // Nodes with fewer triangles are built as a task of their own, 0 to pick
+    // it from the triangle count. The tree depends on it, not on the thread
+    // count.
+    uint32_t taskSize = 0;
+};
+
+struct BvhBuildStats
+{
+    uint32_t triangles = 0;
+    uint32_t nodes     = 0;
+    uint32_t leaves    = 0;
+    uint32_t maxDepth  = 0;
+    uint32_t tasks     = 0;
+
+    // The expected cost of a random ray through the tree, over the root surface area.
+    float sahCost = 0;
+
+    double seconds = 0;
+    // Of which the top levels, up to where the subtree tasks take over.
+    double topSeconds = 0;
+
+    uint64_t memoryBytes = 0;
+};
+
+struct BvhUpdateOptions
+{
+    // Rebuild the subtrees whose SAH cost over the area of their root grew by
+    // more than this factor since they were built, 0 to only refit.
+    float rebuildThreshold = 1.5f;
+    // Rebuild the whole tree when the subtrees to rebuild hold more than this
+    // fraction of the triangles.
+    float fullRebuildFraction = 0.5f;
+};
+
+struct BvhUpdateStats
+{
+    uint32_t triangles        = 0;
+    uint32_t rebuiltSubtrees  = 0;
+    uint32_t rebuiltTriangles = 0;
+    bool     fullRebuild      = false;
+
+    // The SAH cost after the refit, after the rebuilds and of the last full build.
+    float refitSahCost = 0;
+    float sahCost      = 0;
+    float builtSahCost = 0;
+
+    double seconds = 0;
+    // Of which the refit and the rebuilds.
+    double refitSeconds   = 0;
+    double rebuildSeconds = 0;
+};
+
+class Bvh
+{
+public:
+    /**
+     * Build over every triangle of meshes.
+     */
+    BvhBuildStats Build( ThreadPool& pool, const std::vector<MeshGeometry>& meshes,
+                         const BvhBuildOptions& options = BvhBuildOptions() );
+
+    /**
+     * Build over the given triangles, primitives holds where each came from.
+     */
+    BvhBuildStats Build( ThreadPool& pool, const std::vector<BvhTriangle>& triangles,
+                         const std::vector<BvhPrimitive>& primitives,
+                         const BvhBuildOptions&           options = BvhBuildOptions() );
+
+    /**
+     * Move the triangles to triangles, given in the order the tree was built
+     * from and with the same count, refit and rebuild what degraded. The tree
+     * is rebuilt with the options of the last Build.
+     */
+    BvhUpdateStats Update( ThreadPool& pool, const std::vector<BvhTriangle>& triangles,
+                           const BvhUpdateOptions& options = BvhUpdateOptions() );
+
+    void Clear();
+
+    /**
+     * Node 0 is the root, none without triangles.
+     */
+    const std::vector<BvhNode>& GetNodes() const
+    {
+        return m_Nodes;
+    }
+
+    /**
+     * In the order the leaves point into.
+     */
+    const std::vector<BvhTriangle>& GetTriangles() const
+    {
+        return m_Triangles;
+    }
+    const std::vector<BvhPrimitive>& GetPrimitives() const
+    {
+        return m_Primitives;
+    }
+
+    /**
+     * The SAH cost of the tree as it is, see BvhBuildStats::sahCost.
+     */
+    float ComputeSahCost( float traversalCost = 1.0f, float intersectionCost = 1.0f ) const;
+
+    /**
+     * Check that every node bounds its children or triangles and that every
+     * triangle is in exactly one leaf.
+     */
+    bool Validate( std::string* error = nullptr ) const;
+
+private:
+    // Rebuild the subtrees below roots in place, in parallel.
+    void RebuildSubtrees( ThreadPool& pool, const std::vector<uint32_t>& roots );
+
+    std::vector<BvhNode>      m_Nodes;
+    std::vector<BvhTriangle>  m_Triangles;
+    std::vector<BvhPrimitive> m_Primitives;
+
+    // Where each of m_Triangles was in the triangles built from.
+    std::vector<uint32_t> m_Order;
+    // The SAH cost over the root area of the subtree of each node when it was built.
+    std::vector<float> m_BuiltCosts;
+
+    BvhBuildOptions m_Options;
+    float           m_BuiltSahCost = 0;
+};
+
+/**
+ * The triangles of meshes, with where each came from.
+ */
+void GatherTriangles( const std::vector<MeshGeometry>& meshes, std::vector<BvhTriangle>& triangles,
+                      std::vector<BvhPrimitive>& primitives );
+
+}  // namespace cpulib
@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+ *  A recorded camera flight, one pose per frame, so that a benchmark renders
+ *  the same frames on every run.
+ *
+ *  The camera is the one of the Playground: a position and a point it looks
+ *  at, with -y as up and a focal length of 1, the way FrameData::UpdateCamera
+ *  builds camPixelToWorld and DenoiserFilterData the view matrices.
+ */
+
+#include "VectorMath.h"
+
+#include <string>
+#include <vector>
+
+namespace cpulib
+{
+
+struct CameraPose
+{
+    // Seconds since the recording started.
+    double time = 0;
+    float3 position = float3( 0.0f );
+    float3 lookAt   = float3( 0.0f, 0.0f, 1.0f );
+};
+
+/**
+ * The pose at time, linear between the poses around it and the first or
+ * last pose outside of the recording. path must not be empty.
+ */
+CameraPose SampleCameraPath( const std::vector<CameraPose>& path, double time );
+
+/**
+ * PerFrameData::cameraPixelToWorld, the inverse of XMMatrixLookToLH.
+ */
+float3x4 GetCameraPixelToWorld( const CameraPose& pose );
+
+/**
+ * The view matrix BuildOldAndNewDenoiser stores in DenoiserFilterData.
+ */
+float3x4 GetCameraWorldToView( const CameraPose& pose );
+
+/**
+ * Read a recorded camera path. One pose per line as
+ * time,posX,posY,posZ,lookAtX,lookAtY,lookAtZ; empty lines, comments
+ * starting with '#' and a non numeric header line are skipped.
+ *
+ * @returns false if the file could not be opened or a line is malformed.
+ */
+bool ReadCameraPath( const std::string& fileName, std::vector<CameraPose>& path );
+bool WriteCameraPath( const std::string& fileName, const std::vector<CameraPose>& path );
+
+}  // namespace cpulib
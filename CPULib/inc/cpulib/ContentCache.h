@@ -0,0 +1,187 @@
+#pragma once
+
+/*
+ *  A cache of values keyed by the hash of the content they were made from
+ *  (see ContentHash.h), so the same content under two names is made once.
+ *
+ *  Every Acquire or Insert holds a reference on the entry until the matching
+ *  Release. An entry without references stays cached, but once the cached
+ *  bytes are over the budget the ones released the longest ago are evicted.
+ *  Entries still referenced are never evicted, the cache can go over its
+ *  budget when they alone fill it.
+ *
+ *  Not thread safe, the owner locks around it. T is copied out on Acquire,
+ *  a handle type such as a smart pointer.
+ */
+
+#include <cassert>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+namespace cpulib
+{
+
+struct ContentCacheStats
+{
+    // Acquires that found the content, and the bytes they didn't have to make.
+    uint64_t hits       = 0;
+    uint64_t bytesSaved = 0;
+    // Inserts: the content had to be made.
+    uint64_t misses     = 0;
+    uint64_t evictions  = 0;
+
+    uint32_t entries       = 0;
+    uint32_t referenced    = 0;
+    uint64_t residentBytes = 0;
+};
+
+template<typename T>
+class ContentCache
+{
+public:
+    explicit ContentCache( uint64_t budget = UINT64_MAX )
+    : m_Budget( budget )
+    {}
+
+    /**
+     * The most bytes to keep cached, evicts down to it right away as far as
+     * the entries without references go.
+     */
+    void SetBudget( uint64_t budget )
+    {
+        m_Budget = budget;
+        Trim();
+    }
+
+    uint64_t GetBudget() const
+    {
+        return m_Budget;
+    }
+
+    bool Contains( uint64_t key ) const
+    {
+        return m_Entries.find( key ) != m_Entries.end();
+    }
+
+    /**
+     * Copy the value cached for key into value and add a reference to it.
+     *
+     * @returns false, and counts nothing, if the key isn't cached. The miss
+     * is counted by the Insert that follows.
+     */
+    bool Acquire( uint64_t key, T& value )
+    {
+        auto iter = m_Entries.find( key );
+        if ( iter == m_Entries.end() )
+        {
+            return false;
+        }
+
+        Entry& entry = iter->second;
+        if ( entry.references++ == 0 )
+        {
+            m_Unreferenced.erase( entry.unreferenced );
+        }
+
+        ++m_Stats.hits;
+        m_Stats.bytesSaved += entry.bytes;
+
+        value = entry.value;
+        return true;
+    }
+
+    /**
+     * Cache value for key, with one reference. The key must not be cached.
+     */
+    void Insert( uint64_t key, T value, uint64_t bytes )
+    {
+        Entry entry;
+        entry.value      = std::move( value );
+        entry.bytes      = bytes;
+        entry.references = 1;
+
+        bool inserted = m_Entries.emplace( key, std::move( entry ) ).second;
+        assert( inserted );
+        (void)inserted;
+
+        ++m_Stats.misses;
+        m_Stats.residentBytes += bytes;
+        Trim();
+    }
+
+    /**
+     * Drop a reference added by Acquire or Insert. Without references left
+     * the entry becomes the most recent eviction candidate.
+     */
+    void Release( uint64_t key )
+    {
+        auto iter = m_Entries.find( key );
+        assert( iter != m_Entries.end() && iter->second.references > 0 );
+
+        Entry& entry = iter->second;
+        if ( --entry.references == 0 )
+        {
+            entry.unreferenced = m_Unreferenced.insert( m_Unreferenced.end(), key );
+            Trim();
+        }
+    }
+
+    /**
+     * Evict every entry without references, whatever the budget.
+     */
+    void EvictUnreferenced()
+    {
+        while ( !m_Unreferenced.empty() )
+        {
+            Evict();
+        }
+    }
+
+    ContentCacheStats GetStats() const
+    {
+        ContentCacheStats stats = m_Stats;
+        stats.entries           = static_cast<uint32_t>( m_Entries.size() );
+        stats.referenced        = static_cast<uint32_t>( m_Entries.size() - m_Unreferenced.size() );
+        return stats;
+    }
+
+private:
+    struct Entry
+    {
+        T        value;
+        uint64_t bytes      = 0;
+        uint32_t references = 0;
+        // Its place in m_Unreferenced, only while references is 0.
+        std::list<uint64_t>::iterator unreferenced;
+    };
+
+    void Trim()
+    {
+        while ( m_Stats.residentBytes > m_Budget && !m_Unreferenced.empty() )
+        {
+            Evict();
+        }
+    }
+
+    // Evict the entry released the longest ago.
+    void Evict()
+    {
+        auto iter = m_Entries.find( m_Unreferenced.front() );
+        m_Unreferenced.pop_front();
+
+        m_Stats.residentBytes -= iter->second.bytes;
+        ++m_Stats.evictions;
+        m_Entries.erase( iter );
+    }
+
+    std::unordered_map<uint64_t, Entry> m_Entries;
+    // The keys of the entries without references, least recently released first.
+    std::list<uint64_t> m_Unreferenced;
+
+    uint64_t          m_Budget;
+    ContentCacheStats m_Stats;
+};
+
+}  // namespace cpulib
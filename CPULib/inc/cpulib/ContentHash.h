@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+ *  Fast 64 bit hashes of file contents, for caches keyed by what a file
+ *  holds rather than where it is. The hash is XXH64: the same value as the
+ *  reference xxHash for the same bytes and seed, at several GB/s, so hashing
+ *  a texture costs a small fraction of decoding it.
+ *
+ *  Not a cryptographic hash, only good against accidental collisions.
+ */
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace cpulib
+{
+
+uint64_t HashBytes( const void* data, size_t size, uint64_t seed = 0 );
+
+/**
+ * Map the file and hash its contents.
+ *
+ * @returns false, and why in error, if the file can't be read.
+ */
+bool HashFile( const std::filesystem::path& fileName, uint64_t& hash, uint64_t seed = 0,
+               std::string* error = nullptr );
+
+/**
+ * 16 lower case hexadecimal digits, for file names.
+ */
+std::string FormatHash( uint64_t hash );
+
+}  // namespace cpulib
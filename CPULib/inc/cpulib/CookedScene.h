@@ -0,0 +1,304 @@
+#pragma once
+
+/*
+ *  Cooked scene files: everything a scene import produces, laid out so a
+ *  loader can map the file and hand the vertex and index blobs straight to
+ *  the upload buffers.
+ *
+ *      CookedSceneHeader
+ *      CookedMesh[meshCount]
+ *      CookedMaterial[materialCount]
+ *      CookedNode[nodeCount]           parents before children, node 0 is the root
+ *      uint32_t[nodeMeshCount]         mesh indices the nodes point into
+ *      char[stringSize]                NUL terminated UTF-8 strings
+ *      data                            vertex and index blobs
+ *
+ *  Every section and blob starts at a multiple of COOKED_SCENE_ALIGNMENT.
+ *  The tables only hold offsets, relative to the start of the file (blobs,
+ *  sections) or of the string table (strings). The reader turns them into
+ *  pointers. All values are little endian.
+ *
+ *  Vertices and indices are stored in the layout the renderer uploads, the
+ *  header records the vertex stride so a loader can refuse a file cooked for
+ *  another layout. Every mesh has its own index size, 2 for the meshes 16
+ *  bit indices can address, see MeshSplit.h.
+ */
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cpulib
+{
+
+// "RTCS"
+static const uint32_t COOKED_SCENE_MAGIC   = 0x53435452u;
+// 2: the meshes are in vertex cache order, see MeshOptimizer.h.
+// 3: the index size moved from the header to the meshes, the header has flags instead.
+static const uint32_t COOKED_SCENE_VERSION = 3;
+
+// CookedSceneHeader::flags: the meshes too large for 16 bit indices were split into several.
+static const uint32_t COOKED_SCENE_SPLIT_MESHES = 1u << 0;
+
+// D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, enough for any upload.
+static const uint32_t COOKED_SCENE_ALIGNMENT = 256;
+
+// A string offset that does not point at a string.
+static const uint32_t COOKED_NO_STRING = ~0u;
+static const uint32_t COOKED_NO_PARENT = ~0u;
+
+// One per dx12lib::Material::TextureType.
+static const uint32_t COOKED_TEXTURE_SLOTS = 8;
+
+struct CookedSceneHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t fileSize;
+
+    // Whatever the cooker uses to tell if the source changed, the last write time for example.
+    uint64_t sourceStamp;
+
+    uint32_t vertexStride;
+    // COOKED_SCENE_ flags of how the scene was imported.
+    uint32_t flags;
+
+    uint32_t meshCount;
+    uint32_t materialCount;
+    uint32_t nodeCount;
+    uint32_t nodeMeshCount;
+
+    uint64_t meshOffset;
+    uint64_t materialOffset;
+    uint64_t nodeOffset;
+    uint64_t nodeMeshOffset;
+    uint64_t stringOffset;
+    uint64_t stringSize;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+};
+
+struct CookedMesh
+{
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t material;
+    // 2 or 4 bytes.
+    uint32_t indexSize;
+    float    aabbMin[3];
+    float    aabbMax[3];
+};
+
+struct CookedMaterial
+{
+    float    ambient[4];
+    float    emissive[4];
+    float    diffuse[3];
+    uint32_t type;
+    float    specular[4];
+    float    specularPower;
+    float    opacity;
+    float    indexOfRefraction;
+    float    bumpIntensity;
+
+    // Texture paths relative to the scene file, COOKED_NO_STRING for none.
+    uint32_t textures[COOKED_TEXTURE_SLOTS];
+};
+
+struct CookedNode
+{
+    // Row major, as aiMatrix4x4.
+    float    transform[16];
+    uint32_t parent;
+    uint32_t name;
+    uint32_t firstMesh;
+    uint32_t meshCount;
+};
+
+static_assert( sizeof( CookedSceneHeader ) == 112, "CookedSceneHeader is part of the file format" );
+static_assert( sizeof( CookedMesh ) == 56, "CookedMesh is part of the file format" );
+static_assert( sizeof( CookedMaterial ) == 112, "CookedMaterial is part of the file format" );
+static_assert( sizeof( CookedNode ) == 80, "CookedNode is part of the file format" );
+
+/**
+ * Builds a cooked scene in memory and writes it out.
+ */
+class CookedSceneWriter
+{
+public:
+    explicit CookedSceneWriter( uint32_t vertexStride );
+
+    void SetSourceStamp( uint64_t stamp )
+    {
+        m_SourceStamp = stamp;
+    }
+
+    void SetFlags( uint32_t flags )
+    {
+        m_Flags = flags;
+    }
+
+    /**
+     * @returns The offset of the string, COOKED_NO_STRING for an empty one.
+     * Equal strings are stored once.
+     */
+    uint32_t AddString( const std::string& string );
+
+    uint32_t AddMaterial( const CookedMaterial& material );
+
+    /**
+     * Copies vertexCount * vertexStride bytes of vertices and indexCount *
+     * indexSize bytes of indices, indexSize is 2 or 4.
+     */
+    uint32_t AddMesh( const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexCount,
+                      uint32_t indexSize, uint32_t material, const float aabbMin[3], const float aabbMax[3] );
+
+    /**
+     * Nodes have to be added parents first, the first one is the root.
+     */
+    uint32_t AddNode( uint32_t parent, const std::string& name, const float transform[16], const uint32_t* meshes,
+                      uint32_t meshCount );
+
+    uint32_t GetMeshCount() const
+    {
+        return static_cast<uint32_t>( m_Meshes.size() );
+    }
+
+    /**
+     * The complete file.
+     */
+    std::vector<uint8_t> Serialize() const;
+
+    /**
+     * Write to a temporary next to fileName and rename it over fileName, so a
+     * reader never sees half a file.
+     */
+    bool Write( const std::filesystem::path& fileName, std::string* error = nullptr ) const;
+
+private:
+    // Hands the file to write piece by piece, the blobs are not copied again.
+    void Emit( const std::function<void( const void*, uint64_t )>& write ) const;
+
+    uint32_t m_VertexStride;
+    uint32_t m_Flags       = 0;
+    uint64_t m_SourceStamp = 0;
+
+    std::vector<CookedMesh>     m_Meshes;
+    std::vector<CookedMaterial> m_Materials;
+    std::vector<CookedNode>     m_Nodes;
+    std::vector<uint32_t>       m_NodeMeshes;
+    std::string                 m_Strings;
+    std::vector<uint8_t>        m_Data;
+
+    std::unordered_map<std::string, uint32_t> m_StringOffsets;
+};
+
+/**
+ * Check a cooked scene in memory: the header, that every table, string and
+ * blob lies in the file and is aligned, and that all indices between the
+ * tables are in range. With checkIndices the index buffers are read too and
+ * every vertex index is checked against its mesh, that is the only check
+ * that touches the blobs.
+ */
+bool ValidateCookedScene( const void* data, uint64_t size, bool checkIndices, std::string* error = nullptr );
+
+/**
+ * A cooked scene file mapped into memory.
+ */
+class CookedScene
+{
+public:
+    /**
+     * Map the file and validate it, without checkIndices.
+     */
+    bool Open( const std::filesystem::path& fileName, std::string* error = nullptr );
+
+    void Close();
+
+    const CookedSceneHeader& GetHeader() const
+    {
+        return *m_Header;
+    }
+
+    const uint8_t* GetData() const
+    {
+        return m_File.GetData();
+    }
+
+    uint64_t GetSize() const
+    {
+        return m_File.GetSize();
+    }
+
+    uint32_t GetMeshCount() const
+    {
+        return m_Header->meshCount;
+    }
+
+    const CookedMesh& GetMesh( uint32_t mesh ) const
+    {
+        return m_Meshes[mesh];
+    }
+
+    const void* GetVertices( const CookedMesh& mesh ) const
+    {
+        return m_File.GetData() + mesh.vertexOffset;
+    }
+
+    const void* GetIndices( const CookedMesh& mesh ) const
+    {
+        return m_File.GetData() + mesh.indexOffset;
+    }
+
+    uint32_t GetMaterialCount() const
+    {
+        return m_Header->materialCount;
+    }
+
+    const CookedMaterial& GetMaterial( uint32_t material ) const
+    {
+        return m_Materials[material];
+    }
+
+    uint32_t GetNodeCount() const
+    {
+        return m_Header->nodeCount;
+    }
+
+    const CookedNode& GetNode( uint32_t node ) const
+    {
+        return m_Nodes[node];
+    }
+
+    const uint32_t* GetNodeMeshes( const CookedNode& node ) const
+    {
+        return m_NodeMeshes + node.firstMesh;
+    }
+
+    /**
+     * nullptr for COOKED_NO_STRING.
+     */
+    const char* GetString( uint32_t offset ) const
+    {
+        return offset == COOKED_NO_STRING ? nullptr : m_Strings + offset;
+    }
+
+private:
+    MappedFile m_File;
+
+    const CookedSceneHeader* m_Header     = nullptr;
+    const CookedMesh*        m_Meshes     = nullptr;
+    const CookedMaterial*    m_Materials  = nullptr;
+    const CookedNode*        m_Nodes      = nullptr;
+    const uint32_t*          m_NodeMeshes = nullptr;
+    const char*              m_Strings    = nullptr;
+};
+
+}  // namespace cpulib
@@ -0,0 +1,84 @@
+#pragma once
+
+/*
+ *  CPU side of GBufferEncoding.h: converts a RayBuffer to the compact layout
+ *  and back, and measures what the round trip loses, on captured frames or
+ *  on directions spread over the sphere.
+ */
+
+#include "GBufferEncoding.h"
+#include "RayBuffer.h"
+#include "VectorMath.h"
+
+#include <cstdint>
+
+namespace cpulib
+{
+
+struct CompactRayBuffer
+{
+    ImageF4         colour;
+    Image<uint32_t> normals;
+    ImageF          depth;
+    Image<uint32_t> objectMask;
+
+    static const uint32_t BYTES_PER_PIXEL = sizeof( float4 ) + 3 * sizeof( uint32_t );
+};
+
+/**
+ * The primary rays of rayGen.
+ */
+struct GBufferCamera
+{
+    // FrameData::cameraPixelToWorld.
+    float3x4 pixelToWorld;
+    // T_HIT_MAX of RayTracer.hlsl, depth is the hit distance over this.
+    float tHitMax = 10000;
+};
+
+float3 GetCameraOrigin( const GBufferCamera& camera );
+
+/**
+ * Unit direction of the centre ray of pixel x, y.
+ */
+float3 GetCameraRay( const GBufferCamera& camera, uint32_t x, uint32_t y, uint32_t width, uint32_t height );
+
+/**
+ * The object ids are numbered in the order their GenColour first shows up,
+ * the passes only ever compare them for equality.
+ */
+void EncodeRayBuffer( const RayBuffer& frame, CompactRayBuffer& compact );
+
+/**
+ * Back to the full layout, with objectMask xyz = id instead of GenColour( id )
+ * and w = 0 or 1.
+ */
+void DecodeRayBuffer( const CompactRayBuffer& compact, const GBufferCamera& camera, RayBuffer& frame );
+
+struct GBufferError
+{
+    uint64_t samples = 0;
+
+    float maxNormalDegrees  = 0;
+    float meanNormalDegrees = 0;
+
+    // Over the distance to the camera.
+    float maxPositionError  = 0;
+    float meanPositionError = 0;
+
+    // Pixels and right/down neighbour pairs whose mask or same-object test changed.
+    uint64_t objectMismatches = 0;
+};
+
+/**
+ * Encode and decode frame, the positions are compared for pixels with a
+ * depth in (0, 1), hits on the centre ray.
+ */
+GBufferError MeasureRoundTrip( const RayBuffer& frame, const GBufferCamera& camera );
+
+/**
+ * Normal error alone, over count directions evenly spread over the sphere.
+ */
+GBufferError MeasureNormalEncoding( uint32_t count );
+
+}  // namespace cpulib
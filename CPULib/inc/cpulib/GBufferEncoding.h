@@ -0,0 +1,132 @@
+#pragma once
+
+/*
+ *  Compact encoding of the rayBuffer[] G-buffer channels, shared by CPULib
+ *  and the HLSL passes. The code below is the common subset of C++ and
+ *  HLSL; shaders include it with CPULib/inc on the include path.
+ *
+ *      slot            full (RayBuffer.h)              compact
+ *      normals         float4 xyz = n * 0.5 + 0.5      R32_UINT   octahedral n, 2 x 16 bit snorm
+ *      posDepth        float4 xyz = world, w = depth   R32_FLOAT  depth, the position is rebuilt
+ *      objectMask      float4 xyz = GenColour( id )    R32_UINT   id in bits 0..30, mask in bit 31
+ *
+ *  48 of the 64 bytes per pixel become 12, colour stays float4. Every slot
+ *  converts on its own, so the passes can switch one at a time.
+ *
+ *  Depth is rayGen's: the distance from the camera to the hit over
+ *  T_HIT_MAX. The position is rebuilt on the centre ray of the pixel, with
+ *  several samples per pixel the stored hit can come from a jittered ray
+ *  and is off by up to half a pixel footprint.
+ *
+ *  The mask only keeps mask != 0, which is all the passes test for.
+ */
+
+#ifdef __cplusplus
+    #include "VectorMath.h"
+
+    #include <cstdint>
+
+    #define GBUFFER_FUNC inline
+
+namespace cpulib
+{
+#else
+    #define GBUFFER_FUNC
+
+typedef uint uint32_t;
+#endif
+
+static const uint32_t GBUFFER_OBJECT_MASK_BIT = 0x80000000u;
+static const uint32_t GBUFFER_OBJECT_ID_MASK  = 0x7FFFFFFFu;
+
+GBUFFER_FUNC float GBufferAbs( float v )
+{
+    return v < 0.0f ? -v : v;
+}
+
+GBUFFER_FUNC float GBufferSignNotZero( float v )
+{
+    return v < 0.0f ? -1.0f : 1.0f;
+}
+
+// [-1, 1] to a 16 bit snorm, rounded to nearest.
+GBUFFER_FUNC uint32_t GBufferEncodeSnorm16( float v )
+{
+    float s = v < -1.0f ? -1.0f : ( v > 1.0f ? 1.0f : v );
+    s *= 32767.0f;
+    return (uint32_t)(int)( s + ( s < 0.0f ? -0.5f : 0.5f ) ) & 0xFFFFu;
+}
+
+GBUFFER_FUNC float GBufferDecodeSnorm16( uint32_t bits )
+{
+    float v = (float)(int)( bits & 0xFFFFu );
+    v       = v >= 32768.0f ? v - 65536.0f : v;
+    v /= 32767.0f;
+    return v < -1.0f ? -1.0f : v;
+}
+
+/**
+ * Octahedral encoding of a unit normal, x in the low 16 bits.
+ */
+GBUFFER_FUNC uint32_t GBufferEncodeNormal( float3 n )
+{
+    float invL1 = 1.0f / ( GBufferAbs( n.x ) + GBufferAbs( n.y ) + GBufferAbs( n.z ) );
+    float x     = n.x * invL1;
+    float y     = n.y * invL1;
+
+    // The lower hemisphere folds over the diagonals.
+    if ( n.z < 0.0f )
+    {
+        float foldedX = ( 1.0f - GBufferAbs( y ) ) * GBufferSignNotZero( x );
+        float foldedY = ( 1.0f - GBufferAbs( x ) ) * GBufferSignNotZero( y );
+        x             = foldedX;
+        y             = foldedY;
+    }
+
+    return GBufferEncodeSnorm16( x ) | ( GBufferEncodeSnorm16( y ) << 16 );
+}
+
+GBUFFER_FUNC float3 GBufferDecodeNormal( uint32_t bits )
+{
+    float x = GBufferDecodeSnorm16( bits );
+    float y = GBufferDecodeSnorm16( bits >> 16 );
+    float z = 1.0f - GBufferAbs( x ) - GBufferAbs( y );
+
+    if ( z < 0.0f )
+    {
+        float unfoldedX = ( 1.0f - GBufferAbs( y ) ) * GBufferSignNotZero( x );
+        float unfoldedY = ( 1.0f - GBufferAbs( x ) ) * GBufferSignNotZero( y );
+        x               = unfoldedX;
+        y               = unfoldedY;
+    }
+
+    return normalize( float3( x, y, z ) );
+}
+
+/**
+ * World position of the hit on the ray from cameraOrigin along the unit
+ * rayDirection, depth as written by rayGen.
+ */
+GBUFFER_FUNC float3 GBufferDecodePosition( float3 cameraOrigin, float3 rayDirection, float depth, float tHitMax )
+{
+    return cameraOrigin + rayDirection * ( depth * tHitMax );
+}
+
+GBUFFER_FUNC uint32_t GBufferEncodeObject( uint32_t id, bool mask )
+{
+    return ( id & GBUFFER_OBJECT_ID_MASK ) | ( mask ? GBUFFER_OBJECT_MASK_BIT : 0u );
+}
+
+GBUFFER_FUNC uint32_t GBufferDecodeObjectId( uint32_t bits )
+{
+    return bits & GBUFFER_OBJECT_ID_MASK;
+}
+
+GBUFFER_FUNC bool GBufferDecodeObjectMask( uint32_t bits )
+{
+    return ( bits & GBUFFER_OBJECT_MASK_BIT ) != 0u;
+}
+
+#ifdef __cplusplus
+}  // namespace cpulib
+#endif
@@ -0,0 +1,133 @@
+#pragma once
+
+/*
+ *  Simple 2D image container used as the CPU stand-in for a RWTexture2D.
+ */
+
+#include "VectorMath.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cpulib
+{
+
+template<typename T>
+class Image
+{
+public:
+    Image() = default;
+    Image( uint32_t width, uint32_t height, const T& value = T() )
+    {
+        Resize( width, height, value );
+    }
+
+    void Resize( uint32_t width, uint32_t height, const T& value = T() )
+    {
+        m_Width  = width;
+        m_Height = height;
+        m_Data.assign( static_cast<size_t>( width ) * height, value );
+    }
+
+    void Fill( const T& value )
+    {
+        std::fill( m_Data.begin(), m_Data.end(), value );
+    }
+
+    uint32_t GetWidth() const
+    {
+        return m_Width;
+    }
+
+    uint32_t GetHeight() const
+    {
+        return m_Height;
+    }
+
+    size_t GetPixelCount() const
+    {
+        return m_Data.size();
+    }
+
+    bool Contains( int2 p ) const
+    {
+        return p.x >= 0 && p.y >= 0 && static_cast<uint32_t>( p.x ) < m_Width &&
+               static_cast<uint32_t>( p.y ) < m_Height;
+    }
+
+    T& operator()( uint32_t x, uint32_t y )
+    {
+        return m_Data[static_cast<size_t>( y ) * m_Width + x];
+    }
+
+    const T& operator()( uint32_t x, uint32_t y ) const
+    {
+        return m_Data[static_cast<size_t>( y ) * m_Width + x];
+    }
+
+    T& operator[]( int2 p )
+    {
+        return ( *this )( p.x, p.y );
+    }
+
+    const T& operator[]( int2 p ) const
+    {
+        return ( *this )( p.x, p.y );
+    }
+
+    /**
+     * Read a texel the way an out of bounds UAV read behaves on the GPU,
+     * returning zero outside of the image.
+     */
+    T Fetch( int2 p ) const
+    {
+        return Contains( p ) ? ( *this )[p] : T( 0 );
+    }
+
+    T* GetRow( uint32_t y )
+    {
+        return m_Data.data() + static_cast<size_t>( y ) * m_Width;
+    }
+
+    const T* GetRow( uint32_t y ) const
+    {
+        return m_Data.data() + static_cast<size_t>( y ) * m_Width;
+    }
+
+    T* GetData()
+    {
+        return m_Data.data();
+    }
+
+    const T* GetData() const
+    {
+        return m_Data.data();
+    }
+
+private:
+    uint32_t       m_Width  = 0;
+    uint32_t       m_Height = 0;
+    std::vector<T> m_Data;
+};
+
+using ImageF  = Image<float>;
+using ImageF4 = Image<float4>;
+
+/**
+ * Root mean square error of the rgb channels, the images must be the same size.
+ */
+double ColourRMSE( const ImageF4& image, const ImageF4& reference );
+
+/**
+ * Read/write a float4 image as a raw dump: a "RGBA32F" text line with the
+ * width and height followed by width * height * 16 bytes of little endian
+ * texels, top row first. This is the format GPU readbacks are captured in.
+ *
+ * @returns false if the file could not be opened or is malformed.
+ */
+bool ReadImage( const std::string& fileName, ImageF4& image );
+bool WriteImage( const std::string& fileName, const ImageF4& image );
+
+}  // namespace cpulib
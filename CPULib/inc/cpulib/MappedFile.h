@@ -0,0 +1,58 @@
+#pragma once
+
+/*
+ *  Read-only memory mapping of a whole file, MapViewOfFile on Windows and
+ *  mmap everywhere else. The mapping lives as long as the object.
+ */
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace cpulib
+{
+
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator=( const MappedFile& ) = delete;
+
+    /**
+     * Map fileName, closing whatever was mapped before. An empty file opens
+     * with a null data pointer.
+     */
+    bool Open( const std::filesystem::path& fileName, std::string* error = nullptr );
+
+    void Close();
+
+    bool IsOpen() const
+    {
+        return m_IsOpen;
+    }
+
+    const uint8_t* GetData() const
+    {
+        return m_Data;
+    }
+
+    uint64_t GetSize() const
+    {
+        return m_Size;
+    }
+
+private:
+    const uint8_t* m_Data   = nullptr;
+    uint64_t       m_Size   = 0;
+    bool           m_IsOpen = false;
+
+#ifdef _WIN32
+    void* m_File    = nullptr;
+    void* m_Mapping = nullptr;
+#endif
+};
+
+}  // namespace cpulib
@@ -0,0 +1,133 @@
+#pragma once
+
+/*
+ *  Finds the meshes of a scene that are copies of each other and plans the
+ *  acceleration structures to share them.
+ *
+ *  The OBJ scenes come with every copy of a prop baked where it stands, so
+ *  two meshes are copies when they have the same indices and their vertices
+ *  only differ by a translation, within the tolerances of MeshDedupOptions.
+ *  The candidates are found by a hash of the indices, then compared vertex
+ *  by vertex.
+ *
+ *  The plan reorders the meshes into slots. The meshes without copies come
+ *  first and stay together in one BLAS, as the scene was built before. Then
+ *  every set of copies: its first mesh, which keeps its vertices and indices
+ *  and is the only geometry of its own BLAS, followed by the others, which
+ *  share them. Every copy is an instance of that BLAS, offset to where it
+ *  was, so the meshes of an instance are always the slots from its
+ *  firstMesh on, in the order of the geometry of its BLAS.
+ */
+
+#include "VectorMath.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace cpulib
+{
+
+/**
+ * A mesh as imported, the vertices in one of the layouts of VertexCodec.h.
+ */
+struct MeshGeometry
+{
+    const void* vertices    = nullptr;
+    uint32_t    vertexCount = 0;
+    // PackedVertex instead of FullVertex.
+    bool packed = false;
+
+    const void* indices    = nullptr;
+    uint32_t    indexCount = 0;
+    // 2 or 4 bytes.
+    uint32_t indexSize = 4;
+};
+
+struct MeshDedupOptions
+{
+    // Per component, over the largest extent of the mesh.
+    float positionTolerance = 1e-5f;
+    // Per component of the normal, tangent and bitangent. The importer builds
+    // them from the positions, a translated copy gets them a few bits off.
+    float directionTolerance = 1e-3f;
+    // Per component, over max( |uv|, 1 ).
+    float texCoordTolerance = 1e-5f;
+    // Copies of smaller meshes stay in the shared BLAS, an instance costs
+    // more to trace through than their few triangles save.
+    uint32_t minInstanceTriangles = 64;
+};
+
+/**
+ * The meshes firstMesh up to firstMesh + meshCount, one geometry each.
+ */
+struct MeshBlas
+{
+    uint32_t firstMesh = 0;
+    uint32_t meshCount = 0;
+};
+
+struct MeshInstance
+{
+    uint32_t blas = 0;
+    // The slot of the first mesh of the instance, the InstanceID.
+    uint32_t firstMesh = 0;
+    // From where the geometry of the BLAS is to where the instance goes.
+    float3 offset = float3( 0.0f );
+};
+
+struct MeshDedupStats
+{
+    uint32_t meshes = 0;
+    // Meshes with vertices and indices of their own.
+    uint32_t uniqueMeshes = 0;
+    // Meshes that are an instance of their own, copies and the ones they copy.
+    uint32_t instancedMeshes = 0;
+
+    // Over all meshes, and what the copies no longer store.
+    uint64_t vertexBytes       = 0;
+    uint64_t sharedVertexBytes = 0;
+    uint64_t indexBytes        = 0;
+    uint64_t sharedIndexBytes  = 0;
+    // And the triangles the acceleration structures no longer hold.
+    uint64_t triangles       = 0;
+    uint64_t sharedTriangles = 0;
+};
+
+struct MeshInstancePlan
+{
+    // The mesh in every slot.
+    std::vector<uint32_t> order;
+    // The slot of every mesh, the inverse of order.
+    std::vector<uint32_t> slots;
+    // The slot whose vertices and indices every slot uses, itself if it keeps its own.
+    std::vector<uint32_t> sources;
+    // Per slot, from the vertices of its source to where the mesh was.
+    std::vector<float3> offsets;
+
+    std::vector<MeshBlas>     blases;
+    std::vector<MeshInstance> instances;
+
+    MeshDedupStats stats;
+};
+
+/**
+ * Every mesh in its own slot, the order they came in, all in one BLAS and
+ * one instance: the plan without deduplication.
+ */
+MeshInstancePlan PlanSingleBlas( uint32_t meshCount );
+
+/**
+ * Find the copies among meshes and plan the slots, BLASes and instances
+ * that share them. Without copies this is PlanSingleBlas.
+ */
+MeshInstancePlan PlanMeshInstances( const std::vector<MeshGeometry>& meshes,
+                                    const MeshDedupOptions&          options = MeshDedupOptions() );
+
+/**
+ * Add the meshes of other after those of plan, as Scene::MergeScene does.
+ * They keep their BLASes and instances, unless both plans are a single
+ * BLAS, which stays one.
+ */
+void AppendMeshInstances( MeshInstancePlan& plan, const MeshInstancePlan& other );
+
+}  // namespace cpulib
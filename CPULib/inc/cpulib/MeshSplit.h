@@ -0,0 +1,67 @@
+#pragma once
+
+/*
+ *  16 bit index buffers for the imported meshes.
+ *
+ *  A mesh of at most INDEX16_MAX_VERTICES vertices narrows its indices to 16
+ *  bits as they are. A larger one can be split into clusters that each fit:
+ *  SplitMesh walks the triangles in order, after OptimizeMesh that is vertex
+ *  cache order, and starts a new cluster when the next triangle would take
+ *  the current one past maxVertices. Every cluster gets its own vertices,
+ *  those on the seams are copied into both sides, and indices local to them.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace cpulib
+{
+
+// The vertices a 16 bit index can address.
+static const uint32_t INDEX16_MAX_VERTICES = 65536;
+
+inline bool FitsIndex16( uint32_t vertexCount )
+{
+    return vertexCount <= INDEX16_MAX_VERTICES;
+}
+
+/**
+ * destination[i] = indices[i], every index must be below INDEX16_MAX_VERTICES.
+ */
+void NarrowIndices( uint16_t* destination, const uint32_t* indices, size_t indexCount );
+
+struct MeshCluster
+{
+    // The triangles of the cluster, in the indices SplitMesh writes.
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+
+    // Cluster vertex i is vertex vertices[i] of the mesh.
+    std::vector<uint32_t> vertices;
+};
+
+/**
+ * Split the triangle list into clusters of at most maxVertices vertices,
+ * keeping the triangle order. localIndices receives the indices of every
+ * cluster, local to its vertices, one cluster after the other.
+ *
+ * @param maxVertices At least 3 and at most INDEX16_MAX_VERTICES.
+ */
+std::vector<MeshCluster> SplitMesh( const uint32_t* indices, size_t indexCount, uint32_t vertexCount,
+                                    std::vector<uint16_t>& localIndices,
+                                    uint32_t               maxVertices = INDEX16_MAX_VERTICES );
+
+/**
+ * destination[i] = vertices[cluster.vertices[i]], for the cluster's vertices.
+ */
+template <typename Vertex>
+void GatherVertices( Vertex* destination, const Vertex* vertices, const MeshCluster& cluster )
+{
+    for ( size_t i = 0; i < cluster.vertices.size(); ++i )
+    {
+        std::memcpy( &destination[i], &vertices[cluster.vertices[i]], sizeof( Vertex ) );
+    }
+}
+
+}  // namespace cpulib
@@ -0,0 +1,223 @@
+#pragma once
+
+/*
+ *  CPU reference of RTRTprojects/Playground/shaders/RayTracer.hlsl: rayGen,
+ *  TraceFullPath, standardChs, standardMiss, sampleBRDF and the weighted
+ *  SampleLightDirection, traced through a WideBvh instead of TraceRay.
+ *
+ *  Render writes the four rayBuffer[] slots exactly as rayGen does and only
+ *  traces the pixels marked AS_CAST, so it drops in as the TraceFunction of
+ *  AdaptiveSampler and its output goes straight into SvgfDenoiser.
+ *
+ *  The shader's quirks are kept, they are what the GPU renders: the light
+ *  ray is traced like any other ray, the medium IoR is a bool, GenColour
+ *  takes the cube root with 1 / 3 in integers and a single light is read
+ *  from lightPositions[1]. Where the shader reads a variable before setting
+ *  it there is no answer to mirror, see the comments at those places.
+ *
+ *  Differences: there are no mip maps, textures are sampled at level 0, and
+ *  no skybox, a miss is always the atmosphere.
+ */
+
+#include "Bvh.h"
+#include "CookedScene.h"
+#include "Image.h"
+#include "MeshDedup.h"
+#include "RayBuffer.h"
+#include "TransformHierarchy.h"
+#include "VectorMath.h"
+#include "WideBvh.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace cpulib
+{
+
+class ThreadPool;
+
+// Material types, as in the shaders and Material.h.
+enum PathMaterialType : uint32_t
+{
+    PATH_DIFFUSE      = 0,
+    PATH_SPECULAR     = 1,
+    PATH_TRANSMISSIVE = 2
+};
+
+// RayMaterialProp::flags, as MATERIAL_NORMAL_XY in the shaders: the normal map only stores X and Y.
+static const uint32_t PATH_MATERIAL_NORMAL_XY = 1;
+
+// As T_HIT_MIN and T_HIT_MAX in RayTracer.hlsl.
+static const float PATH_T_HIT_MIN = 0.0001f;
+static const float PATH_T_HIT_MAX = 10000.0f;
+
+// The size of ConstantData::lightPositions.
+static const uint32_t PATH_MAX_LIGHTS = 10;
+
+/**
+ * dx12lib::RayMaterialProp, the GeometryMaterialMap entry of a mesh. Same
+ * 64 byte layout, so the buffer ShaderTable fills can be copied in as is.
+ */
+struct alignas( 16 ) RayMaterialProp
+{
+    float3   diffuse = float3( 1.0f );
+    uint32_t type    = PATH_DIFFUSE;
+
+    // Into the texture lists of PathTracerScene, -1 for none.
+    int32_t diffuseTextureIdx  = -1;
+    int32_t normalTextureIdx   = -1;
+    int32_t specularTextureIdx = -1;
+    int32_t maskTextureIdx     = -1;
+
+    float  reflectivity = 0.0f;
+    float3 emittance    = float3( 0.0f );
+
+    float    indexOfRefraction = 1.0f;
+    float    roughness         = 1.0f;
+    uint32_t indexSize         = 4;
+    uint32_t flags             = 0;
+};
+
+static_assert( sizeof( RayMaterialProp ) == 64, "RayMaterialProp is the layout of the GeometryMaterialMap" );
+
+/**
+ * A TLAS instance: the meshes firstMesh up to firstMesh + meshCount, placed
+ * by objectToWorld. firstMesh is the InstanceID.
+ */
+struct PathTracerInstance
+{
+    float3x4 objectToWorld = IdentityTransform();
+    uint32_t firstMesh     = 0;
+    uint32_t meshCount     = 0;
+};
+
+/**
+ * What the hit shaders read. The geometry and textures are referenced, not
+ * copied, and have to outlive the PathTracer they are set on.
+ */
+struct PathTracerScene
+{
+    std::vector<MeshGeometry> meshes;
+    // One per mesh.
+    std::vector<RayMaterialProp>    materials;
+    std::vector<PathTracerInstance> instances;
+
+    // diffuseTex[], normalsTex[], specularTex[] and maskTex[].
+    std::vector<ImageF4> diffuseTextures;
+    std::vector<ImageF4> normalTextures;
+    std::vector<ImageF4> specularTextures;
+    std::vector<ImageF4> maskTextures;
+};
+
+/**
+ * PerFrameData.
+ */
+struct PathTracerFrame
+{
+    // rgb and intensity of the sky.
+    float4   atmosphere         = float4( 0.0f );
+    float3x4 cameraPixelToWorld = IdentityTransform();
+    float    ambientFactor      = 0.0f;
+
+    uint32_t exponentSamplesPerPixel = 0;
+    uint32_t nbrBouncesPerPath       = 1;
+    uint32_t cpuGeneratedSeed        = 0;
+};
+
+/**
+ * ConstantData and the InstanceTransforms the lights and shading frames go
+ * through.
+ */
+struct PathTracerConstants
+{
+    uint32_t nbrActiveLights = 0;
+    // xyz position in model space, w the weight of the light in SampleLightDirection.
+    float4 lightPositions[PATH_MAX_LIGHTS] = {};
+
+    float3x4 modelToWorld       = IdentityTransform();
+    float3x4 normalModelToWorld = IdentityTransform();
+
+    /**
+     * Append a light, false if there are PATH_MAX_LIGHTS already. The first
+     * one is written to lightPositions[1] as well, where SampleLightDirection
+     * reads a single light.
+     */
+    bool AddLight( const float4& light );
+
+    /**
+     * The scene transform of InstanceTransforms[0]: modelToWorld and the
+     * inverse transpose of it.
+     */
+    void SetSceneTransform( const float3x4& transform );
+};
+
+struct PathTracerStats
+{
+    // AS_CAST pixels traced.
+    uint64_t pixels = 0;
+    // One per sample of a pixel.
+    uint64_t primaryRays = 0;
+    // The rays of the following bounces and of the light samples.
+    uint64_t bounceRays = 0;
+    uint64_t lightRays  = 0;
+
+    double seconds = 0;
+
+    uint64_t GetRayCount() const
+    {
+        return primaryRays + bounceRays + lightRays;
+    }
+};
+
+class PathTracer
+{
+public:
+    explicit PathTracer( ThreadPool& pool );
+
+    /**
+     * Build the acceleration structure over the instances of scene, which is
+     * kept by reference.
+     */
+    BvhBuildStats SetScene( const PathTracerScene& scene, const BvhBuildOptions& options = BvhBuildOptions() );
+
+    /**
+     * Follow the vertices and the instance transforms of the scene after they
+     * moved, the instances and meshes staying the same: the acceleration
+     * structure is refit and what degraded rebuilt, see Bvh::Update.
+     */
+    BvhUpdateStats UpdateScene( const BvhUpdateOptions& options = BvhUpdateOptions() );
+
+    const WideBvh& GetBvh() const
+    {
+        return m_Bvh;
+    }
+
+    /**
+     * One DispatchRays over buffer: every AS_CAST pixel is traced and marked
+     * AS_CASTED, the others are left alone.
+     */
+    PathTracerStats Render( RayBuffer& buffer, const PathTracerFrame& frame, const PathTracerConstants& constants );
+
+    static uint32_t GetNewSeed( uint32_t param1, uint32_t param2, uint32_t numPermutation );
+    static float3   GenColour( int id );
+
+private:
+    ThreadPool&            m_Pool;
+    const PathTracerScene* m_Scene = nullptr;
+    // The binary tree m_Bvh is collapsed from, kept to be updated.
+    Bvh     m_BinaryBvh;
+    WideBvh m_Bvh;
+};
+
+/**
+ * The scene as the GPU gets it from a cooked file: every mesh in one
+ * instance placed by sceneTransform, the scene scale the Playground puts on
+ * node 0, each with the RayMaterialProp ShaderTable builds from its
+ * material. The same transform goes into PathTracerConstants with
+ * SetSceneTransform. Textures are left out, the texture indices are -1. The
+ * geometry points into cooked, which has to stay open.
+ */
+void LoadPathTracerScene( const CookedScene& cooked, PathTracerScene& scene,
+                          const float3x4& sceneTransform = IdentityTransform() );
+
+}  // namespace cpulib
@@ -0,0 +1,148 @@
+#pragma once
+
+/*
+ *  Closed loop controller for the adaptive sampler thresholds.
+ *
+ *  Feeds on the cast ray count or the frame time of the previous frame,
+ *  whichever the budget is in, and steers gridSize and the as_* limits of
+ *  DenoiserFilterData towards a rays per frame or milliseconds budget.
+ *
+ *  The limits are driven by a single looseness value in [0, 1], 0 being the
+ *  tight end of every range (cast as much as possible) and 1 the loose end
+ *  (interpolate as much as possible). Once looseness saturates the grid size
+ *  is stepped instead. Two bands give the hysteresis: the controller only
+ *  starts correcting when the load leaves the dead band and keeps going until
+ *  it is back inside the narrower settle band, and grid size changes are held
+ *  off for a number of frames after each step.
+ */
+
+#include "AdaptiveSampler.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cpulib
+{
+
+enum class BudgetMode
+{
+    Rays,          // Target is rays cast per frame.
+    Milliseconds,  // Target is the frame time in ms.
+};
+
+struct RayBudgetSettings
+{
+    BudgetMode mode   = BudgetMode::Rays;
+    float      target = 1000000.0f;
+
+    // Relative error needed before the controller starts correcting.
+    float deadBand = 0.1f;
+    // Relative error at which the controller stops correcting again.
+    float settleBand = 0.03f;
+
+    // Looseness change per unit of log( load ).
+    float gain = 0.25f;
+    // Weight of the newest frame in the smoothed load.
+    float smoothing = 0.3f;
+
+    int minGridSize = 0;
+    int maxGridSize = 4;
+    // Frames to wait after a grid size change before the next one.
+    int gridSizeCooldown = 8;
+
+    // Tight and loose end of every limit.
+    float colourLimitTight    = 0.01f;
+    float colourLimitLoose    = 0.5f;
+    float normalDotLimitTight = 0.995f;
+    float normalDotLimitLoose = 0.8f;
+    float posDiffLimitTight   = 0.1f;
+    float posDiffLimitLoose   = 10.0f;
+    float depthDiffLimitTight = 0.1f;
+    float depthDiffLimitLoose = 10.0f;
+};
+
+/**
+ * What the previous frame cost. Update reads castRays or frameMs, depending
+ * on the budget mode; interpolated and pixelCount are only recorded in the
+ * counter traces.
+ */
+struct FrameCounters
+{
+    uint64_t castRays     = 0;
+    uint64_t interpolated = 0;
+    uint64_t pixelCount   = 0;
+    float    frameMs      = 0;
+};
+
+class RayBudgetController
+{
+public:
+    explicit RayBudgetController( const RayBudgetSettings& settings = RayBudgetSettings() );
+
+    void SetSettings( const RayBudgetSettings& settings );
+
+    const RayBudgetSettings& GetSettings() const
+    {
+        return m_Settings;
+    }
+
+    /**
+     * Start over from the given sampler settings, keeping their grid size.
+     */
+    void Reset( const AdaptiveSamplerSettings& initial );
+
+    /**
+     * Account for the last frame and return the settings to use for the next.
+     */
+    const AdaptiveSamplerSettings& Update( const FrameCounters& counters );
+
+    const AdaptiveSamplerSettings& GetSamplerSettings() const
+    {
+        return m_Sampler;
+    }
+
+    /**
+     * Smoothed measurement divided by the target, 1 is on budget.
+     */
+    float GetLoad() const
+    {
+        return m_Load;
+    }
+
+    float GetLooseness() const
+    {
+        return m_Looseness;
+    }
+
+    bool IsCorrecting() const
+    {
+        return m_Correcting;
+    }
+
+private:
+    void ApplyLooseness();
+
+    RayBudgetSettings       m_Settings;
+    AdaptiveSamplerSettings m_Sampler;
+
+    float m_Load      = 0;
+    float m_Looseness = 0.5f;
+
+    bool m_Correcting            = false;
+    bool m_HasHistory            = false;
+    int  m_FramesSinceGridChange = 0;
+};
+
+/**
+ * Read a recorded counter trace. One frame per line as
+ * "castRays,interpolated,pixelCount,frameMs". Empty lines, lines starting
+ * with # and a non numeric first line, the column names, are skipped.
+ *
+ * @returns false if the file could not be opened or any other line is
+ * malformed.
+ */
+bool ReadCounterTrace( const std::string& fileName, std::vector<FrameCounters>& trace );
+bool WriteCounterTrace( const std::string& fileName, const std::vector<FrameCounters>& trace );
+
+}  // namespace cpulib
@@ -0,0 +1,100 @@
+#pragma once
+
+/*
+ *  CPU mirror of the rayBuffer[] UAV array written by rayGen and read by the
+ *  RayScheduler and SVGF passes.
+ *
+ *      colour      rgb = radiance,         w = adaptive sampling state
+ *      normals     xyz = normal * 0.5+0.5, w = 1
+ *      posDepth    xyz = world position,   w = depth
+ *      objectMask  xyz = GenColour( id ),  w = mask
+ */
+
+#include "Image.h"
+
+#include <string>
+
+namespace cpulib
+{
+
+// Matches SLOT_* in the Playground shaders.
+enum RaySlot
+{
+    SLOT_COLOUR         = 0,
+    SLOT_NORMALS        = 1,
+    SLOT_POS_DEPTH      = 2,
+    SLOT_OBJECT_ID_MASK = 3,
+    SLOT_COUNT          = 4
+};
+
+// Matches AS_* in RayScheduler.hlsl, stored in colour.w.
+enum AdaptiveState
+{
+    AS_EMPTY        = 0,
+    AS_CAST         = 1,
+    AS_CASTED       = 2,
+    AS_INTERPOLATED = 3
+};
+
+struct RayBuffer
+{
+    ImageF4 slots[SLOT_COUNT];
+
+    void Resize( uint32_t width, uint32_t height )
+    {
+        for ( ImageF4& img: slots )
+            img.Resize( width, height, float4( 0.0f ) );
+    }
+
+    uint32_t GetWidth() const
+    {
+        return slots[SLOT_COLOUR].GetWidth();
+    }
+
+    uint32_t GetHeight() const
+    {
+        return slots[SLOT_COLOUR].GetHeight();
+    }
+
+    ImageF4& Colour()
+    {
+        return slots[SLOT_COLOUR];
+    }
+    const ImageF4& Colour() const
+    {
+        return slots[SLOT_COLOUR];
+    }
+    ImageF4& Normals()
+    {
+        return slots[SLOT_NORMALS];
+    }
+    const ImageF4& Normals() const
+    {
+        return slots[SLOT_NORMALS];
+    }
+    ImageF4& PosDepth()
+    {
+        return slots[SLOT_POS_DEPTH];
+    }
+    const ImageF4& PosDepth() const
+    {
+        return slots[SLOT_POS_DEPTH];
+    }
+    ImageF4& ObjectMask()
+    {
+        return slots[SLOT_OBJECT_ID_MASK];
+    }
+    const ImageF4& ObjectMask() const
+    {
+        return slots[SLOT_OBJECT_ID_MASK];
+    }
+};
+
+/**
+ * Load a captured frame stored as <prefix>_colour.rgba, <prefix>_normals.rgba,
+ * <prefix>_posDepth.rgba and <prefix>_objectMask.rgba (see ReadImage).
+ */
+bool ReadRayBuffer( const std::string& prefix, RayBuffer& buffer );
+bool WriteRayBuffer( const std::string& prefix, const RayBuffer& buffer );
+
+}  // namespace cpulib
@@ -0,0 +1,103 @@
+#pragma once
+
+/*
+ *  CPU reference of RTRTprojects/Playground/shaders/RayCompaction.hlsl.
+ *
+ *  Turns the AS_CAST marks left by a scheduler pass into a dense list of
+ *  pixels plus the dimensions of the DispatchRays that traces them, so the
+ *  trace cost follows the number of rays cast instead of the screen area.
+ *
+ *  The list is built with a per-row count, an exclusive prefix sum over the
+ *  row counts and a scatter, which keeps the pixels in row-major order. The
+ *  GPU version hands out its offsets with an atomic so only the set of pixels,
+ *  not their order, is guaranteed to match.
+ */
+
+#include "RayBuffer.h"
+#include "VectorMath.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cpulib
+{
+
+class ThreadPool;
+
+/**
+ * Launch dimensions, laid out like the Width/Height/Depth tail of
+ * D3D12_DISPATCH_RAYS_DESC.
+ */
+struct DispatchSize
+{
+    uint32_t width  = 0;
+    uint32_t height = 0;
+    uint32_t depth  = 0;
+};
+
+/**
+ * out[i] = in[0] + ... + in[i - 1], in and out may alias.
+ * @returns The sum of all elements.
+ */
+uint64_t ExclusiveScan( ThreadPool& pool, const uint32_t* in, uint32_t* out, size_t count );
+
+class RayCompaction
+{
+public:
+    // Widest launch emitted, longer lists wrap onto further rows.
+    static const uint32_t MAX_DISPATCH_WIDTH = 1024;
+
+    explicit RayCompaction( ThreadPool& pool );
+
+    /**
+     * Collect every pixel whose colour.w is AS_CAST.
+     * @returns The number of rays to trace.
+     */
+    uint32_t Compact( const RayBuffer& buffer );
+
+    uint32_t GetRayCount() const
+    {
+        return m_RayCount;
+    }
+
+    /**
+     * Packed pixel coordinates, see PackPixel. Only the first GetRayCount()
+     * entries are valid.
+     */
+    const std::vector<uint32_t>& GetPixelList() const
+    {
+        return m_PixelList;
+    }
+
+    DispatchSize GetDispatchSize() const
+    {
+        return CalcDispatchSize( m_RayCount );
+    }
+
+    /**
+     * Smallest width x height launch covering count threads. Threads past
+     * count have to early out.
+     */
+    static DispatchSize CalcDispatchSize( uint32_t count, uint32_t maxWidth = MAX_DISPATCH_WIDTH );
+
+    /* 16 bits per axis, the same packing the shaders use. */
+    static uint32_t PackPixel( int2 p )
+    {
+        return ( static_cast<uint32_t>( p.y ) << 16 ) | ( static_cast<uint32_t>( p.x ) & 0xFFFF );
+    }
+
+    static int2 UnpackPixel( uint32_t packed )
+    {
+        return int2( static_cast<int>( packed & 0xFFFF ), static_cast<int>( packed >> 16 ) );
+    }
+
+private:
+    ThreadPool& m_Pool;
+
+    std::vector<uint32_t> m_RowOffsets;
+    std::vector<uint32_t> m_PixelList;
+    uint32_t              m_RayCount = 0;
+};
+
+}  // namespace cpulib
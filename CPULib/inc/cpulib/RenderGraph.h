@@ -0,0 +1,341 @@
+#pragma once
+
+/*
+ *  Render graph for the compute and copy passes of a frame.
+ *
+ *  Passes declare which resources they read and write and in which state,
+ *  the graph then places the barriers: a transition when the state changes,
+ *  a UAV barrier only between a write and a later access of the same
+ *  resource (or a read and a later write), nothing between two reads. Passes
+ *  whose results nobody reads and that do not write an output are culled.
+ *
+ *  A pass that needs UAV barriers on several resources gets a single UAV
+ *  barrier on all resources instead, see SetMergeUAVBarriers. The passes of
+ *  a chain depend on each other anyway, so this waits for nothing more.
+ *
+ *  Resources placed in the same memory are declared as aliases. Only one of
+ *  them holds its data at a time, the graph places an aliasing barrier
+ *  before the first pass using another one and the backend initialises the
+ *  memory for it.
+ *
+ *  The graph itself knows nothing about D3D12. A RenderGraphBackend turns the
+ *  schedule into commands, dx12lib::CommandListGraphBackend records them into
+ *  a command list, RecordingGraphBackend below only writes them down so the
+ *  schedule can be checked with Validate on any platform.
+ *
+ *  Resources are imported once and keep their state from one Execute to the
+ *  next, passes are added again every frame after Reset.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace cpulib
+{
+
+enum class GraphResourceState
+{
+    Common,
+    UnorderedAccess,
+    RenderTarget,
+    CopySource,
+    CopyDest,
+};
+
+enum class GraphAccess
+{
+    Read,
+    Write,
+    // Read and write, or a write that does not cover the whole resource.
+    ReadWrite,
+};
+
+struct GraphBarrier
+{
+    // Resource of a UAV barrier that orders the UAV accesses of every resource.
+    static const uint32_t ALL_RESOURCES = ~0u;
+
+    enum class Type
+    {
+        UAV,
+        Transition,
+        // The resource takes over the memory of its aliases, after is the state of the pass asking for it. What the
+        // memory held is lost, the backend discards it.
+        Aliasing,
+    };
+
+    Type               type     = Type::UAV;
+    uint32_t           resource = 0;
+    GraphResourceState before   = GraphResourceState::Common;
+    GraphResourceState after    = GraphResourceState::Common;
+};
+
+class RenderGraphBackend
+{
+public:
+    virtual ~RenderGraphBackend() = default;
+
+    virtual void Barrier( const GraphBarrier& barrier ) = 0;
+
+    /**
+     * Submit the barriers given since the last flush, called once before a
+     * pass that needs any.
+     */
+    virtual void FlushBarriers() = 0;
+
+    /**
+     * Called before the execute function of the pass, or before Copy for a
+     * copy pass.
+     */
+    virtual void BeginPass( uint32_t pass, const std::string& name ) = 0;
+
+    virtual void Copy( uint32_t dst, uint32_t src ) = 0;
+};
+
+struct GraphCommand
+{
+    enum class Type
+    {
+        Barrier,
+        FlushBarriers,
+        BeginPass,
+        Copy,
+    };
+
+    Type         type = Type::BeginPass;
+    GraphBarrier barrier;
+    uint32_t     pass = 0;
+    uint32_t     dst  = 0;
+    uint32_t     src  = 0;
+    std::string  name;
+};
+
+/**
+ * Null backend, keeps the commands instead of recording them anywhere.
+ */
+class RecordingGraphBackend : public RenderGraphBackend
+{
+public:
+    void Barrier( const GraphBarrier& barrier ) override;
+    void FlushBarriers() override;
+    void BeginPass( uint32_t pass, const std::string& name ) override;
+    void Copy( uint32_t dst, uint32_t src ) override;
+
+    const std::vector<GraphCommand>& GetCommands() const
+    {
+        return m_Commands;
+    }
+
+    void Clear()
+    {
+        m_Commands.clear();
+    }
+
+    /**
+     * One line per command.
+     */
+    std::string Describe() const;
+
+private:
+    std::vector<GraphCommand> m_Commands;
+};
+
+struct RenderGraphStats
+{
+    uint32_t passes       = 0;
+    uint32_t culledPasses = 0;
+    uint32_t uavBarriers  = 0;
+    uint32_t transitions  = 0;
+    uint32_t aliasing     = 0;
+    // Declared accesses of the executed passes, a barrier per access is what a pass-by-pass scheme pays.
+    uint32_t accesses = 0;
+};
+
+class RenderGraph
+{
+public:
+    using ExecuteFunction = std::function<void()>;
+
+    /**
+     * @returns The resource handle, the index the backend gets to see.
+     */
+    uint32_t ImportResource( const std::string& name, GraphResourceState state = GraphResourceState::Common );
+
+    /**
+     * The resource was used or replaced outside the graph, e.g. the back
+     * buffer of another frame.
+     */
+    void SetState( uint32_t resource, GraphResourceState state );
+
+    GraphResourceState GetState( uint32_t resource ) const
+    {
+        return m_Resources[resource].state;
+    }
+
+    /**
+     * The two resources share memory. Until a pass uses one of them, the
+     * other keeps it.
+     */
+    void AddAlias( uint32_t a, uint32_t b );
+
+    void ClearAliases();
+
+    /**
+     * Whether the resource holds its memory. A resource that does not, e.g.
+     * a placed resource that was just created, gets an aliasing barrier
+     * before the first pass using it.
+     */
+    void SetResident( uint32_t resource, bool resident );
+
+    bool IsResident( uint32_t resource ) const
+    {
+        return m_Resources[resource].resident;
+    }
+
+    /**
+     * Keep the resource's last value, the passes writing it are never culled.
+     */
+    void MarkOutput( uint32_t resource );
+
+    /**
+     * Replace two or more UAV barriers before a pass by one on all resources,
+     * on by default.
+     */
+    void SetMergeUAVBarriers( bool merge )
+    {
+        m_MergeUAVBarriers = merge;
+        m_Compiled         = false;
+    }
+
+    /**
+     * Drop the passes and the outputs, the resources and their states stay.
+     */
+    void Reset();
+
+    uint32_t AddPass( const std::string& name, ExecuteFunction execute = ExecuteFunction() );
+
+    void Access( uint32_t pass, uint32_t resource, GraphAccess access,
+                 GraphResourceState state = GraphResourceState::UnorderedAccess );
+
+    void Read( uint32_t pass, uint32_t resource, GraphResourceState state = GraphResourceState::UnorderedAccess )
+    {
+        Access( pass, resource, GraphAccess::Read, state );
+    }
+
+    void Write( uint32_t pass, uint32_t resource, GraphResourceState state = GraphResourceState::UnorderedAccess )
+    {
+        Access( pass, resource, GraphAccess::Write, state );
+    }
+
+    void ReadWrite( uint32_t pass, uint32_t resource, GraphResourceState state = GraphResourceState::UnorderedAccess )
+    {
+        Access( pass, resource, GraphAccess::ReadWrite, state );
+    }
+
+    /**
+     * A pass that copies all of src to dst.
+     */
+    uint32_t AddCopyPass( const std::string& name, uint32_t dst, uint32_t src );
+
+    /**
+     * Cull the passes and place the barriers.
+     */
+    void Compile();
+
+    /**
+     * Run the compiled passes, the resource states are left as the last
+     * pass needed them.
+     */
+    void Execute( RenderGraphBackend& backend );
+
+    /**
+     * Check a recorded Execute against the declared accesses: every pass
+     * finds its resources in the state it asked for and separated by a
+     * barrier from any conflicting earlier access, and holds its memory and
+     * the value it reads. It only trusts the commands, not the bookkeeping
+     * of Compile.
+     */
+    bool Validate( const std::vector<GraphCommand>& commands, std::string* error = nullptr ) const;
+
+    bool IsCulled( uint32_t pass ) const
+    {
+        return m_Passes[pass].culled;
+    }
+
+    const std::vector<GraphBarrier>& GetBarriers( uint32_t pass ) const
+    {
+        return m_Passes[pass].barriers;
+    }
+
+    const RenderGraphStats& GetStats() const
+    {
+        return m_Stats;
+    }
+
+    uint32_t GetResourceCount() const
+    {
+        return static_cast<uint32_t>( m_Resources.size() );
+    }
+
+    uint32_t GetPassCount() const
+    {
+        return static_cast<uint32_t>( m_Passes.size() );
+    }
+
+    const std::string& GetResourceName( uint32_t resource ) const
+    {
+        return m_Resources[resource].name;
+    }
+
+    const std::string& GetPassName( uint32_t pass ) const
+    {
+        return m_Passes[pass].name;
+    }
+
+private:
+    struct Resource
+    {
+        std::string        name;
+        GraphResourceState    state    = GraphResourceState::Common;
+        bool                  output   = false;
+        bool                  resident = true;
+        std::vector<uint32_t> aliases;
+    };
+
+    struct PassAccess
+    {
+        uint32_t           resource;
+        GraphAccess        access;
+        GraphResourceState state;
+    };
+
+    struct Pass
+    {
+        std::string             name;
+        ExecuteFunction         execute;
+        std::vector<PassAccess> accesses;
+
+        bool     copy    = false;
+        uint32_t copyDst = 0;
+        uint32_t copySrc = 0;
+
+        bool                      culled = false;
+        std::vector<GraphBarrier> barriers;
+    };
+
+    std::vector<Resource> m_Resources;
+    std::vector<Pass>     m_Passes;
+
+    // Resource states and residency Compile started from, what Validate replays against.
+    std::vector<GraphResourceState> m_CompileStates;
+    std::vector<bool>               m_CompileResident;
+    bool                            m_Compiled         = false;
+    bool                            m_MergeUAVBarriers = true;
+    RenderGraphStats                m_Stats;
+};
+
+const char* ToString( GraphResourceState state );
+
+}  // namespace cpulib
@@ -0,0 +1,225 @@
+#pragma once
+
+/*
+ *  Ping-pong planner for passes that hand their output to the next pass.
+ *
+ *  Instead of copying a pass's target into the next pass's source, every
+ *  logical resource (the filtered colour, the moments, ...) owns a small pool
+ *  of physical buffers and the planner decides, per stage, which buffer each
+ *  slot of the binding layout points at. A write goes to a buffer nobody still
+ *  needs, the following reads are pointed at it. A write can also be kept as
+ *  the history the next frame reads, which pins its buffer until that read.
+ *
+ *  Because the history moves between the buffers, the bindings of a frame
+ *  depend on the frame number. They settle into a cycle of GetFramePeriod()
+ *  frames after GetFirstPeriodicFrame() frames; the distinct per-stage
+ *  bindings are the binding sets, which the renderer creates once (one
+ *  descriptor table each) and only selects between at run time.
+ *
+ *  Nothing in here knows about D3D12, a buffer is an index.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cpulib
+{
+
+enum class SlotAccess
+{
+    // The value the last stage of this frame wrote.
+    Read,
+    // The value kept by WriteHistory in the previous frame.
+    ReadHistory,
+    // A new value.
+    Write,
+    // A new value that is also the next frame's history.
+    WriteHistory,
+};
+
+class ResourceRotation
+{
+public:
+    static constexpr uint32_t INVALID = ~0u;
+
+    struct StageAccess
+    {
+        uint32_t   slot;
+        SlotAccess access;
+    };
+
+    /**
+     * A logical resource backed by bufferCount physical buffers.
+     * @returns The resource index.
+     */
+    uint32_t AddResource( const std::string& name, uint32_t bufferCount );
+
+    /**
+     * Append a slot to the binding layout. A stage that does not access the
+     * slot still binds something there, the history when history is set,
+     * otherwise the current value.
+     * @returns The slot index, the position in every binding set.
+     */
+    uint32_t AddSlot( const std::string& name, uint32_t resource, bool history = false );
+
+    /**
+     * Append a stage, stages run in the order they are added.
+     */
+    uint32_t AddStage( const std::string& name );
+
+    void Access( uint32_t stage, uint32_t slot, SlotAccess access );
+
+    /**
+     * Assign the buffers.
+     * @returns false, with the reason in error, if the accesses cannot be
+     * satisfied, e.g. a pool is too small or a value is read before it is
+     * written.
+     */
+    bool Plan( std::string* error = nullptr );
+
+    /**
+     * Replay the plan over a couple of periods and check that every read
+     * sees the value it asked for and that no stage reads a buffer it writes.
+     * This does not trust the bookkeeping of Plan, it tracks buffer contents.
+     */
+    bool Validate( std::string* error = nullptr ) const;
+
+    uint32_t GetResourceCount() const
+    {
+        return static_cast<uint32_t>( m_Resources.size() );
+    }
+
+    uint32_t GetSlotCount() const
+    {
+        return static_cast<uint32_t>( m_Slots.size() );
+    }
+
+    uint32_t GetStageCount() const
+    {
+        return static_cast<uint32_t>( m_Stages.size() );
+    }
+
+    const std::string& GetResourceName( uint32_t resource ) const
+    {
+        return m_Resources[resource].name;
+    }
+
+    const std::string& GetSlotName( uint32_t slot ) const
+    {
+        return m_Slots[slot].name;
+    }
+
+    const std::string& GetStageName( uint32_t stage ) const
+    {
+        return m_Stages[stage].name;
+    }
+
+    /**
+     * The accesses of stage in the order they were declared.
+     */
+    const std::vector<StageAccess>& GetStageAccesses( uint32_t stage ) const
+    {
+        return m_Stages[stage].accesses;
+    }
+
+    /**
+     * The buffers of resource r are GetFirstBuffer( r ) .. GetFirstBuffer( r ) + bufferCount - 1.
+     */
+    uint32_t GetBufferCount() const
+    {
+        return m_BufferCount;
+    }
+
+    uint32_t GetFirstBuffer( uint32_t resource ) const
+    {
+        return m_Resources[resource].firstBuffer;
+    }
+
+    uint32_t GetFirstPeriodicFrame() const
+    {
+        return m_FirstPeriodicFrame;
+    }
+
+    uint32_t GetFramePeriod() const
+    {
+        return static_cast<uint32_t>( m_Frames.size() ) - m_FirstPeriodicFrame;
+    }
+
+    uint32_t GetBindingSetCount() const
+    {
+        return static_cast<uint32_t>( m_BindingSets.size() );
+    }
+
+    /**
+     * The buffer of every slot, in slot order.
+     */
+    const std::vector<uint32_t>& GetBindingSet( uint32_t bindingSet ) const
+    {
+        return m_BindingSets[bindingSet];
+    }
+
+    /**
+     * The binding set of stage in the given frame, frame 0 being the first
+     * frame after Plan or after the history was dropped.
+     */
+    uint32_t GetBindingSet( uint64_t frame, uint32_t stage ) const;
+
+    uint32_t GetBuffer( uint64_t frame, uint32_t stage, uint32_t slot ) const
+    {
+        return m_BindingSets[GetBindingSet( frame, stage )][slot];
+    }
+
+    /**
+     * Buffers that hold the history at the end of the given frame, all other
+     * buffers are free until the next frame writes them.
+     */
+    std::vector<uint32_t> GetHistoryBuffers( uint64_t frame ) const;
+
+    /**
+     * One line per stage and frame of the cycle, for logs.
+     */
+    std::string Describe() const;
+
+private:
+    struct Resource
+    {
+        std::string name;
+        uint32_t    bufferCount = 0;
+        uint32_t    firstBuffer = 0;
+    };
+
+    struct Slot
+    {
+        std::string name;
+        uint32_t    resource = 0;
+        bool        history  = false;
+    };
+
+    struct Stage
+    {
+        std::string              name;
+        std::vector<StageAccess> accesses;
+    };
+
+    struct Frame
+    {
+        std::vector<uint32_t> bindingSets;     // per stage
+        std::vector<uint32_t> historyBuffers;  // per resource at the end of the frame, INVALID without history
+    };
+
+    const Frame& GetFrame( uint64_t frame ) const;
+    bool         PlanFrame( std::vector<uint32_t>& history, Frame& frame, std::string* error );
+    uint32_t     AddBindingSet( const std::vector<uint32_t>& bindings );
+
+    std::vector<Resource> m_Resources;
+    std::vector<Slot>     m_Slots;
+    std::vector<Stage>    m_Stages;
+    uint32_t              m_BufferCount = 0;
+
+    std::vector<Frame>                 m_Frames;
+    uint32_t                           m_FirstPeriodicFrame = 0;
+    std::vector<std::vector<uint32_t>> m_BindingSets;
+};
+
+}  // namespace cpulib
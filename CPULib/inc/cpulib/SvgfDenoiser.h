@@ -0,0 +1,191 @@
+#pragma once
+
+/*
+ *  CPU reference of the Playground SVGF chain: SVGF_reprojection.hlsl,
+ *  SVGF_moments.hlsl and the SVGF_atrous.hlsl iterations, including the
+ *  history bookkeeping between the dispatches, see SvgfRotation.h.
+ *
+ *  Every channel lives in its own float plane (structure of arrays) so the
+ *  a-trous taps, which is where nearly all of the time goes, load eight
+ *  neighbouring pixels with one unaligned load. The copies between the
+ *  passes are plane swaps.
+ *
+ *  Two modes:
+ *      Exact   scalar kernels with the libm exp/pow, the shaders' formulas in
+ *              their order of operations. The output is bit identical for any
+ *              thread count and tile order.
+ *      Fast    polynomial exp/log and whole powers by squaring, 8 pixels at
+ *              a time with AVX2 when the CPU and the build support it. The
+ *              scalar fallback runs the same sequence of IEEE operations, so
+ *              Fast is bit identical with and without AVX2 and for any thread
+ *              count, and within about 1e-6 relative of Exact.
+ *
+ *  Deliberately kept shader quirks, see DenoiserSettings:
+ *      - SVGF_moments.hlsl reads the neighbour moments from rayBuffer[1], the
+ *        packed normals, instead of the filter moment source.
+ *      - The a-trous step size is the iteration index (0, 1, 2, ...), not
+ *        2^i, so the first iteration only ever taps the centre pixel.
+ *      - BilienarTapFilter loops over i <= 4 of a 4 element array, the CPU
+ *        version takes the 4 real taps.
+ */
+
+#include "RayBuffer.h"
+#include "VectorMath.h"
+
+#include <cstdint>
+
+namespace cpulib
+{
+
+class ThreadPool;
+
+enum class DenoiserMode
+{
+    Exact,
+    Fast,
+};
+
+/**
+ * The SVGF part of DenoiserFilterData.
+ */
+struct DenoiserSettings
+{
+    DenoiserMode mode = DenoiserMode::Exact;
+
+    // Use the AVX2 kernels in Fast mode when available, the result is the same either way.
+    bool simd = true;
+
+    float alpha               = 0.1f;
+    float reprojectErrorLimit = 1;
+
+    float sigmaDepth     = 1;
+    float sigmaNormal    = 128;
+    float sigmaLuminance = 4;
+
+    int atrousIterations = 5;
+    // Step 2^i of the SVGF paper instead of the shader's i, see the commented out line in SVGF_atrous.hlsl.
+    bool dyadicSteps = false;
+
+    // Reproduce SVGF_moments.hlsl reading rayBuffer[FILTER_SLOT_MOMENT_SOURCE] (the normals).
+    bool momentsFromNormals = true;
+};
+
+/**
+ * Camera part of DenoiserFilterData, see DenoiserFilterData::BuildOldAndNewDenoiser.
+ */
+struct DenoiserCamera
+{
+    float3x4 oldCameraWorldToClip;
+    float3x4 newCameraWorldToClip;
+    float2   cameraWindowSize = float2( 1, 1 );
+};
+
+struct DenoiserStats
+{
+    double reprojectionMs = 0;
+    double momentsMs      = 0;
+    double atrousMs       = 0;
+    double totalMs        = 0;
+
+    // Pixels that blended in their reprojected history.
+    uint64_t reusedPixels = 0;
+    // Pixels with a history shorter than 4 frames, which get the 7x7 spatial variance estimate.
+    uint64_t spatialVariancePixels = 0;
+
+    bool usedAVX2 = false;
+};
+
+class SvgfDenoiser
+{
+public:
+    explicit SvgfDenoiser( ThreadPool& pool, const DenoiserSettings& settings = DenoiserSettings() );
+
+    void SetSettings( const DenoiserSettings& settings )
+    {
+        m_Settings = settings;
+    }
+
+    const DenoiserSettings& GetSettings() const
+    {
+        return m_Settings;
+    }
+
+    /**
+     * Drop the history, the next frame starts over like the first one.
+     */
+    void Reset();
+
+    /**
+     * Denoise one traced frame. The history is kept across calls, a change of
+     * resolution resets it.
+     */
+    DenoiserStats Denoise( const RayBuffer& frame, const DenoiserCamera& camera );
+
+    /**
+     * FILTER_SLOT_SDR_TARGET of the last frame: clamped sRGB, w = 1.
+     */
+    void GetOutput( ImageF4& sdr ) const;
+
+    /**
+     * Filtered linear colour of the last frame, w = variance.
+     */
+    void GetColour( ImageF4& colour ) const;
+
+    /**
+     * historyBuffer[SLOT_MOMENT_HISTORY], what AdaptiveSampler::SetMomentHistory expects.
+     */
+    void GetMomentHistory( ImageF4& moments ) const;
+
+    uint32_t GetWidth() const
+    {
+        return m_Width;
+    }
+
+    uint32_t GetHeight() const
+    {
+        return m_Height;
+    }
+
+    /**
+     * Whether this build and CPU can run the AVX2 kernels.
+     */
+    static bool IsAVX2Supported();
+
+private:
+    void Resize( uint32_t width, uint32_t height );
+    void LoadFrame( const RayBuffer& frame );
+    // Reads the planes LoadFrame unpacked.
+    uint64_t Reproject( const DenoiserCamera& camera );
+    uint64_t Moments( const RayBuffer& frame );
+    bool Atrous( int step );
+
+    ThreadPool&      m_Pool;
+    DenoiserSettings m_Settings;
+
+    uint32_t m_Width      = 0;
+    uint32_t m_Height     = 0;
+    bool     m_HasHistory = false;
+
+    // Current frame, normals unpacked to [-1, 1] and normalized.
+    ImageF m_Colour[3];
+    ImageF m_Normal[3];
+    ImageF m_Pos[3];
+    ImageF m_Depth;
+    ImageF m_Object[4];
+
+    // historyBuffer[], the previous frame's planes are swapped in at the end of Denoise.
+    ImageF m_HistColour[3];
+    ImageF m_HistNormal[3];
+    ImageF m_HistPos[3];
+    ImageF m_HistObject[4];
+    ImageF m_HistMoments[4];
+
+    // filterBuffer[], source and target are swapped instead of copied.
+    ImageF m_ColourSource[4];
+    ImageF m_ColourTarget[4];
+    ImageF m_MomentSource[4];
+    ImageF m_MomentTarget[4];
+    ImageF m_Sdr[3];
+};
+
+}  // namespace cpulib
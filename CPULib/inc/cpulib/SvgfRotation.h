@@ -0,0 +1,105 @@
+#pragma once
+
+/*
+ *  The Playground SVGF chain as a ResourceRotation: the ray trace, the
+ *  reprojection, the moments and the a-trous passes, with the slots laid out
+ *  like rayBuffer[] (space0), historyBuffer[] (space1) and filterBuffer[]
+ *  (space2) of the SVGF shaders. A binding set is one contiguous descriptor
+ *  table of those 14 UAVs.
+ *
+ *  The pools reuse the render targets the copies used to go between: two
+ *  buffers for every G-buffer channel (this frame's and the history), three
+ *  for the filtered colour and the moments (source, target and the pinned
+ *  history), one for the ray colour and the SDR output.
+ */
+
+#include "ResourceRotation.h"
+
+#include <cstdint>
+
+namespace cpulib
+{
+
+class RenderGraph;
+
+enum SvgfSlot : uint32_t
+{
+    // rayBuffer[], SLOT_*
+    SVGF_SLOT_RAY_COLOUR,
+    SVGF_SLOT_RAY_NORMALS,
+    SVGF_SLOT_RAY_POS_DEPTH,
+    SVGF_SLOT_RAY_OBJECT_ID_MASK,
+
+    // historyBuffer[], SLOT_*
+    SVGF_SLOT_HISTORY_COLOUR,
+    SVGF_SLOT_HISTORY_NORMALS,
+    SVGF_SLOT_HISTORY_POS_DEPTH,
+    SVGF_SLOT_HISTORY_OBJECT_ID_MASK,
+    SVGF_SLOT_HISTORY_MOMENTS,
+
+    // filterBuffer[], FILTER_SLOT_*
+    SVGF_SLOT_COLOUR_SOURCE,
+    SVGF_SLOT_MOMENT_SOURCE,
+    SVGF_SLOT_SDR_TARGET,
+    SVGF_SLOT_COLOUR_TARGET,
+    SVGF_SLOT_MOMENT_TARGET,
+
+    SVGF_SLOT_COUNT
+};
+
+enum SvgfResource : uint32_t
+{
+    SVGF_RESOURCE_RAY_COLOUR,
+    SVGF_RESOURCE_NORMALS,
+    SVGF_RESOURCE_POS_DEPTH,
+    SVGF_RESOURCE_OBJECT_ID_MASK,
+    SVGF_RESOURCE_COLOUR,
+    SVGF_RESOURCE_MOMENTS,
+    SVGF_RESOURCE_SDR,
+
+    SVGF_RESOURCE_COUNT
+};
+
+struct SvgfStages
+{
+    // Scheduler passes and DispatchRays, they write the ray buffers and read the moment history.
+    uint32_t trace        = 0;
+    uint32_t reprojection = 0;
+    uint32_t moments      = 0;
+    // atrous + i for the i-th iteration, the first one keeps the colour history.
+    uint32_t atrous       = 0;
+    // Copy of the SDR target to the back buffer.
+    uint32_t present      = 0;
+};
+
+/**
+ * Describe the chain with atrousIterations a-trous passes. Call Plan on the
+ * result.
+ */
+SvgfStages BuildSvgfRotation( ResourceRotation& rotation, int atrousIterations );
+
+struct SvgfMemory
+{
+    uint64_t committedBytes = 0;
+    // All buffers placed in one heap, see AliasingPlanner.h.
+    uint64_t aliasedBytes = 0;
+};
+
+/**
+ * Memory the buffers of a planned SVGF rotation take as float4 textures of
+ * width x height. This leaves out the padding a device may add to a texture.
+ * The Playground places the buffers with the device sizes, see
+ * DummyGame::PlaceSvgfBuffers.
+ */
+SvgfMemory PlanSvgfMemory( const ResourceRotation& rotation, uint32_t width, uint32_t height );
+
+/**
+ * Declare the accesses of an SVGF stage in the given frame to a render graph
+ * pass, every buffer of the rotation being the graph resource of the same
+ * index. With accumulate the writes also read, for passes that run more than
+ * once.
+ */
+void DeclareSvgfAccesses( RenderGraph& graph, uint32_t pass, const ResourceRotation& rotation, uint64_t frame,
+                          uint32_t stage, bool accumulate );
+
+}  // namespace cpulib
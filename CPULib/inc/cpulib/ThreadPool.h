@@ -0,0 +1,81 @@
+#pragma once
+
+/*
+ *  Fixed size worker pool used to spread the CPU passes over all cores.
+ *  Work is handed out as tiles/indices from an atomic counter so the calling
+ *  thread takes part too, and nested calls made from inside a worker simply
+ *  run inline instead of dead locking.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cpulib
+{
+
+struct Tile
+{
+    uint32_t x0, y0;  // inclusive
+    uint32_t x1, y1;  // exclusive
+};
+
+class ThreadPool
+{
+public:
+    /**
+     * @param numThreads Total number of threads taking part in a dispatch,
+     * including the caller. 0 uses std::thread::hardware_concurrency.
+     */
+    explicit ThreadPool( uint32_t numThreads = 0 );
+    ~ThreadPool();
+
+    ThreadPool( const ThreadPool& ) = delete;
+    ThreadPool& operator=( const ThreadPool& ) = delete;
+
+    uint32_t GetThreadCount() const
+    {
+        return static_cast<uint32_t>( m_Workers.size() ) + 1;
+    }
+
+    /**
+     * Invoke func( i ) for every i in [0, count) and wait for all to finish.
+     */
+    void ParallelFor( uint32_t count, const std::function<void( uint32_t )>& func );
+
+    /**
+     * Split a width x height image into tileSize x tileSize tiles and invoke
+     * func once per tile.
+     */
+    void ParallelForTiles( uint32_t width, uint32_t height, uint32_t tileSize,
+                           const std::function<void( const Tile& )>& func );
+
+    /**
+     * Process wide pool, created on first use.
+     */
+    static ThreadPool& Get();
+
+private:
+    void WorkerThread();
+    void RunJob();
+
+    std::vector<std::thread> m_Workers;
+
+    std::mutex              m_Mutex;
+    std::condition_variable m_WakeCondition;
+    std::condition_variable m_DoneCondition;
+    std::mutex              m_DispatchMutex;
+
+    const std::function<void( uint32_t )>* m_Job = nullptr;
+    uint32_t                               m_JobCount = 0;
+    std::atomic<uint32_t>                  m_NextIndex { 0 };
+    uint32_t                               m_ActiveWorkers = 0;
+    uint64_t                               m_Generation    = 0;
+    bool                                   m_Quit          = false;
+};
+
+}  // namespace cpulib
@@ -0,0 +1,157 @@
+#pragma once
+
+/*
+ *  Bookkeeping for the instance descs of a top level acceleration structure:
+ *  which instances changed since the last build, which ranges of the desc
+ *  buffer that means writing, and whether the TLAS needs nothing, an update
+ *  (refit) or a full rebuild.
+ *
+ *  A refit keeps the tree of the last rebuild and only grows its boxes, so
+ *  it gets worse the further the instances move from where they were built.
+ *  The driver's tree can't be inspected, so the tracker estimates that from
+ *  the world bounds of the instances: the surface area of the bounds at the
+ *  last rebuild joined with the bounds now, over that of the bounds now. An
+ *  instance that stays put adds nothing, one moved by its own size about
+ *  doubles its share. Once the sum of the extra area over the sum of the
+ *  area passes refitDegradation the next build is a rebuild.
+ *
+ *  The dirty instances are kept as a list, so a frame that moves a few of
+ *  thousands of instances costs as much as the few.
+ */
+
+#include "VectorMath.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace cpulib
+{
+
+enum class TlasUpdate
+{
+    None,     // Nothing changed, keep the TLAS as it is.
+    Refit,    // Update the TLAS built last in place.
+    Rebuild,  // Build it from scratch.
+};
+
+struct TlasTrackerSettings
+{
+    // Extra surface area of the instance bounds since the last rebuild, over their surface area, that triggers a
+    // rebuild.
+    float refitDegradation = 1.0f;
+    // Refits in a row before a rebuild regardless, 0 for no limit.
+    uint32_t maxRefits = 0;
+    // Clean instances between two dirty ones that are written along rather than starting another range.
+    uint32_t mergeGap = 4;
+};
+
+/**
+ * Instances first up to first + count.
+ */
+struct TlasInstanceRange
+{
+    uint32_t first = 0;
+    uint32_t count = 0;
+};
+
+struct TlasBounds
+{
+    float3 lower = float3( 0.0f );
+    float3 upper = float3( 0.0f );
+};
+
+/**
+ * The world bounds of local bounds under transform, as float3x4 in
+ * TransformHierarchy.h.
+ */
+TlasBounds TransformBounds( const float3x4& transform, const TlasBounds& bounds );
+
+class TlasInstanceTracker
+{
+public:
+    explicit TlasInstanceTracker( const TlasTrackerSettings& settings = TlasTrackerSettings() );
+
+    void SetSettings( const TlasTrackerSettings& settings );
+
+    const TlasTrackerSettings& GetSettings() const
+    {
+        return m_Settings;
+    }
+
+    /**
+     * Start over with an instance at each of the world bounds, all
+     * dirty, and a rebuild for the first build.
+     */
+    void Reset( const std::vector<TlasBounds>& bounds );
+
+    uint32_t GetInstanceCount() const
+    {
+        return static_cast<uint32_t>( m_Bounds.size() );
+    }
+
+    /**
+     * The instance moved to bounds, its desc has to be written again.
+     */
+    void SetBounds( uint32_t instance, const TlasBounds& bounds );
+
+    /**
+     * Something of the desc other than its transform changed, such as its
+     * mask or flags.
+     */
+    void MarkDirty( uint32_t instance );
+
+    bool IsDirty() const
+    {
+        return !m_Dirty.empty() || m_NeedsRebuild;
+    }
+
+    /**
+     * The descs to write, the dirty instances sorted and joined over gaps of
+     * up to mergeGap clean ones.
+     */
+    std::vector<TlasInstanceRange> GetDirtyRanges() const;
+
+    /**
+     * What the next build has to be.
+     */
+    TlasUpdate GetUpdate() const;
+
+    /**
+     * The dirty descs were written and the TLAS built as update says: clear
+     * the dirty instances and, for a rebuild, start measuring from the bounds
+     * now.
+     */
+    void Commit( TlasUpdate update );
+
+    /**
+     * The estimate of how much worse a refit is than a rebuild, compared to
+     * refitDegradation.
+     */
+    float GetDegradation() const;
+
+    uint32_t GetRefitCount() const
+    {
+        return m_Refits;
+    }
+
+private:
+    void Account( uint32_t instance, float sign );
+
+    TlasTrackerSettings m_Settings;
+
+    // Now and at the last rebuild.
+    std::vector<TlasBounds> m_Bounds;
+    std::vector<TlasBounds> m_BuildBounds;
+
+    std::vector<uint32_t> m_Dirty;
+    std::vector<uint8_t>  m_IsDirty;
+
+    // The surface area of the bounds now, and of the bounds joined with those at the last rebuild.
+    double m_Area       = 0.0;
+    double m_JoinedArea = 0.0;
+
+    uint32_t m_Refits       = 0;
+    bool     m_NeedsRebuild = true;
+};
+
+}  // namespace cpulib
@@ -0,0 +1,142 @@
+#pragma once
+
+/*
+ *  The transforms of a node hierarchy, flattened into arrays in parent before
+ *  child order, so the world transforms of all nodes are one forward sweep
+ *  instead of a walk up the parents per query.
+ *
+ *  Every attribute is an array of its own: the local transforms a frame
+ *  writes and the world, inverse and normal matrices it reads stay dense,
+ *  whichever of them a pass touches. SetLocal only marks the node dirty,
+ *  Update recomputes the dirty nodes and everything below them, each matrix
+ *  product and inverse a handful of SSE operations.
+ *
+ *  The matrices are float3x4, the layout of DirectX::XMFLOAT3X4 and of the
+ *  Transform of D3D12_RAYTRACING_INSTANCE_DESC: rows, translation in the
+ *  last column, transforming column vectors. WriteWorlds copies them
+ *  straight into the instance descs.
+ */
+
+#include "VectorMath.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cpulib
+{
+
+static const uint32_t TRANSFORM_NO_PARENT = ~0u;
+
+/**
+ * The identity, as float3x4.
+ */
+float3x4 IdentityTransform();
+
+/**
+ * a * b: b first, then a.
+ */
+float3x4 MulTransforms( const float3x4& a, const float3x4& b );
+
+/**
+ * The inverse of an affine transform, and the inverse transpose of its 3x3
+ * part with no translation, which takes normals. Both are zero if the
+ * transform is singular.
+ */
+void InvertTransform( const float3x4& transform, float3x4& inverse, float3x4& normal );
+
+class TransformHierarchy
+{
+public:
+    void Reserve( uint32_t nodeCount );
+    void Clear();
+
+    /**
+     * Add a node under parent, which must be a node added before it, or
+     * TRANSFORM_NO_PARENT for a root.
+     *
+     * @returns the index of the node, in the order they were added.
+     */
+    uint32_t AddNode( uint32_t parent, const float3x4& local );
+
+    uint32_t GetNodeCount() const
+    {
+        return static_cast<uint32_t>( m_Parents.size() );
+    }
+
+    uint32_t GetParent( uint32_t node ) const
+    {
+        return m_Parents[node];
+    }
+
+    void            SetLocal( uint32_t node, const float3x4& local );
+    const float3x4& GetLocal( uint32_t node ) const
+    {
+        return m_Local[node];
+    }
+
+    /**
+     * Whether a SetLocal or AddNode hasn't been through Update yet.
+     */
+    bool IsDirty() const
+    {
+        return m_FirstDirty != TRANSFORM_NO_PARENT;
+    }
+
+    /**
+     * Recompute the world, inverse and normal matrices of the dirty nodes and
+     * of everything below them.
+     *
+     * @returns the number of nodes recomputed, 0 if nothing was dirty.
+     */
+    uint32_t Update();
+
+    /**
+     * Whether the last Update recomputed node.
+     */
+    bool IsUpdated( uint32_t node ) const
+    {
+        return ( m_Flags[node] & UPDATED ) != 0;
+    }
+
+    // As of the last Update.
+    const float3x4& GetWorld( uint32_t node ) const
+    {
+        return m_World[node];
+    }
+    const float3x4& GetInverseWorld( uint32_t node ) const
+    {
+        return m_InverseWorld[node];
+    }
+    const float3x4& GetNormal( uint32_t node ) const
+    {
+        return m_Normal[node];
+    }
+
+    /**
+     * Copy the world transforms of count nodes from firstNode to dest, one
+     * every stride bytes, such as the Transform of an array of instance descs.
+     */
+    void WriteWorlds( uint32_t firstNode, uint32_t count, void* dest, size_t stride ) const;
+
+private:
+    enum Flags : uint8_t
+    {
+        DIRTY   = 1,
+        UPDATED = 2,
+    };
+
+    std::vector<float3x4> m_Local;
+    std::vector<float3x4> m_World;
+    std::vector<float3x4> m_InverseWorld;
+    std::vector<float3x4> m_Normal;
+    std::vector<uint32_t> m_Parents;
+    std::vector<uint8_t>  m_Flags;
+
+    // The sweep starts here, every node before it is clean.
+    uint32_t m_FirstDirty = TRANSFORM_NO_PARENT;
+    // Whether the last Update set any UPDATED flag, to clear them on the next.
+    bool m_AnyUpdated = false;
+};
+
+}  // namespace cpulib
@@ -0,0 +1,366 @@
+#pragma once
+
+/*
+ *  Small HLSL-like vector types used by the CPU reference passes.
+ *  float4 is backed by SSE when the target supports it so that per pixel
+ *  arithmetic on RGBA texels maps to a single register, everything else is
+ *  plain scalar code the compiler is free to vectorize.
+ */
+
+#include <cmath>
+#include <cstdint>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+    #define CPULIB_SSE 1
+    #include <emmintrin.h>
+#else
+    #define CPULIB_SSE 0
+#endif
+
+namespace cpulib
+{
+
+constexpr float PI      = 3.1415926538f;
+constexpr float PI2     = 6.283185307f;
+constexpr float PI_2    = 1.570796327f;
+constexpr float PI_4    = 0.7853981635f;
+constexpr float InvPi   = 0.318309886f;
+constexpr float EPSILON = 0.00001f;
+
+struct int2
+{
+    int x, y;
+
+    int2() = default;
+    constexpr int2( int x_, int y_ )
+    : x( x_ )
+    , y( y_ )
+    {}
+};
+
+inline int2 operator+( int2 a, int2 b )
+{
+    return int2( a.x + b.x, a.y + b.y );
+}
+inline int2 operator-( int2 a, int2 b )
+{
+    return int2( a.x - b.x, a.y - b.y );
+}
+inline int2 operator*( int2 a, int b )
+{
+    return int2( a.x * b, a.y * b );
+}
+inline int2 operator*( int2 a, int2 b )
+{
+    return int2( a.x * b.x, a.y * b.y );
+}
+inline bool operator==( int2 a, int2 b )
+{
+    return a.x == b.x && a.y == b.y;
+}
+
+struct float2
+{
+    float x, y;
+
+    float2() = default;
+    constexpr float2( float x_, float y_ )
+    : x( x_ )
+    , y( y_ )
+    {}
+    explicit float2( int2 v )
+    : x( static_cast<float>( v.x ) )
+    , y( static_cast<float>( v.y ) )
+    {}
+};
+
+inline float2 operator+( float2 a, float2 b )
+{
+    return float2( a.x + b.x, a.y + b.y );
+}
+inline float2 operator-( float2 a, float2 b )
+{
+    return float2( a.x - b.x, a.y - b.y );
+}
+inline float2 operator-( float2 a )
+{
+    return float2( -a.x, -a.y );
+}
+inline float2 operator*( float2 a, float s )
+{
+    return float2( a.x * s, a.y * s );
+}
+inline float dot( float2 a, float2 b )
+{
+    return a.x * b.x + a.y * b.y;
+}
+inline float length( float2 a )
+{
+    return std::sqrt( dot( a, a ) );
+}
+inline float2 normalize( float2 a )
+{
+    float invLen = 1.0f / length( a );
+    return a * invLen;
+}
+// HLSL reflect( i, n ) = i - 2 * dot( n, i ) * n
+inline float2 reflect( float2 i, float2 n )
+{
+    return i - n * ( 2.0f * dot( n, i ) );
+}
+
+struct float3
+{
+    float x, y, z;
+
+    float3() = default;
+    constexpr float3( float x_, float y_, float z_ )
+    : x( x_ )
+    , y( y_ )
+    , z( z_ )
+    {}
+    constexpr explicit float3( float s )
+    : x( s )
+    , y( s )
+    , z( s )
+    {}
+
+    float  operator[]( int i ) const { return ( &x )[i]; }
+    float& operator[]( int i ) { return ( &x )[i]; }
+};
+
+inline float3 operator+( float3 a, float3 b )
+{
+    return float3( a.x + b.x, a.y + b.y, a.z + b.z );
+}
+inline float3 operator-( float3 a, float3 b )
+{
+    return float3( a.x - b.x, a.y - b.y, a.z - b.z );
+}
+inline float3 operator-( float3 a )
+{
+    return float3( -a.x, -a.y, -a.z );
+}
+inline float3 operator*( float3 a, float3 b )
+{
+    return float3( a.x * b.x, a.y * b.y, a.z * b.z );
+}
+inline float3 operator*( float3 a, float s )
+{
+    return float3( a.x * s, a.y * s, a.z * s );
+}
+inline float3 operator*( float s, float3 a )
+{
+    return a * s;
+}
+inline float3 operator/( float3 a, float s )
+{
+    return a * ( 1.0f / s );
+}
+inline float3& operator+=( float3& a, float3 b )
+{
+    a = a + b;
+    return a;
+}
+inline float dot( float3 a, float3 b )
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+inline float3 cross( float3 a, float3 b )
+{
+    return float3( a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x );
+}
+inline float length( float3 a )
+{
+    return std::sqrt( dot( a, a ) );
+}
+inline float3 normalize( float3 a )
+{
+    return a * ( 1.0f / length( a ) );
+}
+// HLSL reflect( i, n ) = i - 2 * dot( n, i ) * n
+inline float3 reflect( float3 i, float3 n )
+{
+    return i - n * ( 2.0f * dot( n, i ) );
+}
+// HLSL refract( i, n, eta ), zero on total internal reflection.
+inline float3 refract( float3 i, float3 n, float eta )
+{
+    const float cosI = dot( n, i );
+    const float k    = 1.0f - eta * eta * ( 1.0f - cosI * cosI );
+    return k < 0.0f ? float3( 0.0f ) : i * eta - n * ( eta * cosI + std::sqrt( k ) );
+}
+inline float3 min( float3 a, float3 b )
+{
+    return float3( a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z );
+}
+inline float3 max( float3 a, float3 b )
+{
+    return float3( a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z );
+}
+
+/**
+ * RGBA texel. Matches the float4 layout of the DXGI_FORMAT_R32G32B32A32_FLOAT
+ * render targets, so captured GPU buffers can be copied in directly.
+ */
+struct alignas( 16 ) float4
+{
+    float x, y, z, w;
+
+    float4() = default;
+    constexpr float4( float x_, float y_, float z_, float w_ )
+    : x( x_ )
+    , y( y_ )
+    , z( z_ )
+    , w( w_ )
+    {}
+    constexpr float4( float3 v, float w_ )
+    : x( v.x )
+    , y( v.y )
+    , z( v.z )
+    , w( w_ )
+    {}
+    constexpr explicit float4( float s )
+    : x( s )
+    , y( s )
+    , z( s )
+    , w( s )
+    {}
+
+    float3 xyz() const { return float3( x, y, z ); }
+
+#if CPULIB_SSE
+    explicit float4( __m128 v )
+    {
+        _mm_store_ps( &x, v );
+    }
+    __m128 Load() const { return _mm_load_ps( &x ); }
+#endif
+};
+
+#if CPULIB_SSE
+inline float4 operator+( const float4& a, const float4& b )
+{
+    return float4( _mm_add_ps( a.Load(), b.Load() ) );
+}
+inline float4 operator-( const float4& a, const float4& b )
+{
+    return float4( _mm_sub_ps( a.Load(), b.Load() ) );
+}
+inline float4 operator*( const float4& a, float s )
+{
+    return float4( _mm_mul_ps( a.Load(), _mm_set1_ps( s ) ) );
+}
+inline float4 operator*( const float4& a, const float4& b )
+{
+    return float4( _mm_mul_ps( a.Load(), b.Load() ) );
+}
+
+// Sum of the products of the first three lanes.
+inline float dot3( const float4& a, const float4& b )
+{
+    __m128 m = _mm_mul_ps( a.Load(), b.Load() );
+    __m128 y = _mm_shuffle_ps( m, m, _MM_SHUFFLE( 1, 1, 1, 1 ) );
+    __m128 z = _mm_shuffle_ps( m, m, _MM_SHUFFLE( 2, 2, 2, 2 ) );
+    return _mm_cvtss_f32( _mm_add_ss( _mm_add_ss( m, y ), z ) );
+}
+
+inline float dot4( const float4& a, const float4& b )
+{
+    __m128 m  = _mm_mul_ps( a.Load(), b.Load() );
+    __m128 hi = _mm_movehl_ps( m, m );
+    __m128 s  = _mm_add_ps( m, hi );
+    return _mm_cvtss_f32( _mm_add_ss( s, _mm_shuffle_ps( s, s, _MM_SHUFFLE( 1, 1, 1, 1 ) ) ) );
+}
+
+// Fused a * wa + b * wb + c * wc, the barycentric blend used by the scheduler.
+inline float4 blend( const float4& a, float wa, const float4& b, float wb, const float4& c, float wc )
+{
+    __m128 r = _mm_mul_ps( a.Load(), _mm_set1_ps( wa ) );
+    r        = _mm_add_ps( r, _mm_mul_ps( b.Load(), _mm_set1_ps( wb ) ) );
+    r        = _mm_add_ps( r, _mm_mul_ps( c.Load(), _mm_set1_ps( wc ) ) );
+    return float4( r );
+}
+#else
+inline float4 operator+( const float4& a, const float4& b )
+{
+    return float4( a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w );
+}
+inline float4 operator-( const float4& a, const float4& b )
+{
+    return float4( a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w );
+}
+inline float4 operator*( const float4& a, float s )
+{
+    return float4( a.x * s, a.y * s, a.z * s, a.w * s );
+}
+inline float4 operator*( const float4& a, const float4& b )
+{
+    return float4( a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w );
+}
+inline float dot3( const float4& a, const float4& b )
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+inline float dot4( const float4& a, const float4& b )
+{
+    return ( a.x * b.x + a.z * b.z ) + ( a.y * b.y + a.w * b.w );
+}
+inline float4 blend( const float4& a, float wa, const float4& b, float wb, const float4& c, float wc )
+{
+    return a * wa + b * wb + c * wc;
+}
+#endif
+
+inline float4& operator+=( float4& a, const float4& b )
+{
+    a = a + b;
+    return a;
+}
+
+// length( v.xyz )
+inline float length3( const float4& a )
+{
+    return std::sqrt( dot3( a, a ) );
+}
+
+// length( v ), all four lanes
+inline float length4( const float4& a )
+{
+    return std::sqrt( dot4( a, a ) );
+}
+
+// normalize( v.xyz ), w is left as is.
+inline float4 normalize3( const float4& a )
+{
+    float  invLen = 1.0f / length3( a );
+    float4 r      = a * invLen;
+    r.w           = a.w;
+    return r;
+}
+
+/**
+ * row_major float3x4 as used in DenoiserFilterData, same memory layout as
+ * DirectX::XMFLOAT3X4 so the constant buffer data can be copied in as is.
+ */
+struct float3x4
+{
+    float m[3][4];
+};
+
+// HLSL mul( float3x4, float4 ), one dot product per row.
+inline float3 mul( const float3x4& a, float x, float y, float z, float w )
+{
+    float3 r;
+    for ( int i = 0; i < 3; ++i )
+        r[i] = a.m[i][0] * x + a.m[i][1] * y + a.m[i][2] * z + a.m[i][3] * w;
+    return r;
+}
+
+template<typename T>
+inline T clamp( T v, T lo, T hi )
+{
+    return v < lo ? lo : ( v > hi ? hi : v );
+}
+
+}  // namespace cpulib
@@ -0,0 +1,104 @@
+#pragma once
+
+/*
+ *  CPU side of VertexEncoding.h: packs the full vertices the importer
+ *  produces and unpacks them again, and measures what the packing loses
+ *  against the bounds the hit shaders can live with.
+ */
+
+#include "VertexEncoding.h"
+#include "VectorMath.h"
+
+#include <cstdint>
+#include <string>
+
+namespace cpulib
+{
+
+/**
+ * The layout of dx12lib::VertexPositionNormalTangentBitangentTexture.
+ */
+struct FullVertex
+{
+    float3 position;
+    float3 normal;
+    float3 tangent;
+    float3 bitangent;
+    float3 texCoord;
+};
+
+/**
+ * The layout of dx12lib::VertexPositionPackedNormalTangentTexture.
+ */
+struct PackedVertex
+{
+    float3   position;
+    uint32_t normal;
+    uint32_t tangent;
+    uint32_t texCoord;
+};
+
+static_assert( sizeof( FullVertex ) == 60, "FullVertex is the imported vertex layout" );
+static_assert( sizeof( PackedVertex ) == PACKED_VERTEX_STRIDE, "PackedVertex is the layout of VertexEncoding.h" );
+
+PackedVertex PackVertex( const FullVertex& vertex );
+
+/**
+ * Normal and tangent come back unit length, the bitangent is rebuilt from
+ * them and texCoord.z is 0.
+ */
+FullVertex UnpackVertex( const PackedVertex& vertex );
+
+void PackVertices( const FullVertex* vertices, uint32_t count, PackedVertex* packed );
+
+/**
+ * What the packing may lose and still pass CheckVertexPacking. The angles
+ * are a little above the worst case of the snorm grids, 0.0037 degrees for
+ * the 16 bit normal and 0.0073 for the 15 bit tangent. The texture
+ * coordinate error is that of a half: 2^-11 of the coordinate, and of 1 for
+ * coordinates below 1.
+ */
+static const float VERTEX_PACKING_MAX_NORMAL_DEGREES    = 0.005f;
+static const float VERTEX_PACKING_MAX_TANGENT_DEGREES   = 0.01f;
+static const float VERTEX_PACKING_MAX_TEXCOORD_RELATIVE = 1.0f / 2048.0f;
+
+struct VertexPackingError
+{
+    uint64_t samples = 0;
+
+    float maxNormalDegrees   = 0;
+    float meanNormalDegrees  = 0;
+    float maxTangentDegrees  = 0;
+    float meanTangentDegrees = 0;
+
+    // Between the rebuilt and the original bitangent, over the frames that are orthogonal to 1e-5.
+    float maxBitangentDegrees = 0;
+
+    // Texture coordinate error over max( |uv|, 1 ), per component. Infinite past the half range.
+    float maxTexCoordRelative = 0;
+
+    // Position must round trip exactly.
+    uint64_t positionMismatches = 0;
+    // Vertices whose rebuilt bitangent points the other way, on frames with a clear handedness.
+    uint64_t bitangentSignFlips = 0;
+};
+
+/**
+ * Pack and unpack count vertices and compare. Zero normals and tangents
+ * are skipped, they have no direction to keep.
+ */
+VertexPackingError MeasureVertexPacking( const FullVertex* vertices, uint32_t count );
+
+/**
+ * @returns false, and why in error, if e is outside the VERTEX_PACKING_ bounds.
+ */
+bool CheckVertexPacking( const VertexPackingError& e, std::string* error = nullptr );
+
+/**
+ * Vertices with normal and tangent frames and texture coordinates evenly
+ * spread over the sphere and [-range, range]^2, both bitangent signs, for
+ * MeasureVertexPacking when there is no scene at hand.
+ */
+void GenerateVertexFrames( uint32_t count, float texCoordRange, FullVertex* vertices );
+
+}  // namespace cpulib
@@ -0,0 +1,263 @@
+#pragma once
+
+/*
+ *  Packed vertex layout for ray traced geometry, shared by CPULib and the
+ *  HLSL hit shaders. As GBufferEncoding.h, the code below is the common
+ *  subset of C++ and HLSL; shaders include it with CPULib/inc on the include
+ *  path.
+ *
+ *      offset  bytes   full (60 bytes)         packed (24 bytes)
+ *      0       12      float3 position         float3 position, what the BLAS reads
+ *      12      4       float3 normal           octahedral normal, 2 x 16 bit snorm
+ *      16      4       float3 tangent          octahedral tangent, 2 x 15 bit snorm, bitangent sign in bit 31
+ *                      float3 bitangent        sign * cross( normal, tangent )
+ *      20      4       float3 texCoord         uv as 2 x half, x in the low 16 bits, w dropped
+ *
+ *  The bitangent is rebuilt from the normal and tangent, which only
+ *  reproduces it for frames that are orthogonal, as Assimp's tangent space
+ *  is up to its smoothing. A zero normal or tangent, a mesh without tangents
+ *  for example, comes back as +z.
+ */
+
+#ifdef __cplusplus
+    #include "VectorMath.h"
+
+    #include <cstdint>
+    #include <cstring>
+
+    #define VERTEX_FUNC inline
+
+namespace cpulib
+{
+#else
+    #define VERTEX_FUNC
+
+typedef uint uint32_t;
+#endif
+
+static const uint32_t PACKED_VERTEX_STRIDE          = 24;
+static const uint32_t PACKED_VERTEX_NORMAL_OFFSET   = 12;
+static const uint32_t PACKED_VERTEX_TANGENT_OFFSET  = 16;
+static const uint32_t PACKED_VERTEX_TEXCOORD_OFFSET = 20;
+static const uint32_t PACKED_VERTEX_BITANGENT_SIGN  = 0x80000000u;
+
+#ifdef __cplusplus
+// f32tof16 of HLSL: round to nearest even, overflow to infinity, NaN stays NaN.
+VERTEX_FUNC uint32_t VertexFloatToHalf( float v )
+{
+    uint32_t bits;
+    std::memcpy( &bits, &v, sizeof( bits ) );
+
+    const uint32_t sign     = ( bits >> 16 ) & 0x8000u;
+    const uint32_t exponent = ( bits >> 23 ) & 0xFFu;
+    uint32_t       mantissa = bits & 0x7FFFFFu;
+
+    if ( exponent == 0xFFu )
+    {
+        return sign | 0x7C00u | ( mantissa ? 0x200u : 0u );
+    }
+
+    int halfExponent = static_cast<int>( exponent ) - 127 + 15;
+    if ( halfExponent >= 31 )
+    {
+        return sign | 0x7C00u;
+    }
+
+    uint32_t shift;
+    if ( halfExponent <= 0 )
+    {
+        // Denormal, or zero once shifted out.
+        if ( halfExponent < -10 )
+        {
+            return sign;
+        }
+        mantissa |= 0x800000u;
+        shift        = static_cast<uint32_t>( 14 - halfExponent );
+        halfExponent = 0;
+    }
+    else
+    {
+        shift = 13;
+    }
+
+    uint32_t       half      = ( static_cast<uint32_t>( halfExponent ) << 10 ) | ( mantissa >> shift );
+    const uint32_t remainder = mantissa & ( ( 1u << shift ) - 1u );
+    const uint32_t halfway   = 1u << ( shift - 1u );
+
+    // A carry out of the mantissa moves into the exponent, which is the right result.
+    if ( remainder > halfway || ( remainder == halfway && ( half & 1u ) ) )
+    {
+        ++half;
+    }
+
+    return sign | half;
+}
+
+// f16tof32 of HLSL.
+VERTEX_FUNC float VertexHalfToFloat( uint32_t bits )
+{
+    const uint32_t sign     = ( bits & 0x8000u ) << 16;
+    uint32_t       exponent = ( bits >> 10 ) & 0x1Fu;
+    uint32_t       mantissa = bits & 0x3FFu;
+
+    uint32_t result;
+    if ( exponent == 0x1Fu )
+    {
+        result = sign | 0x7F800000u | ( mantissa << 13 );
+    }
+    else if ( exponent == 0 )
+    {
+        if ( mantissa == 0 )
+        {
+            result = sign;
+        }
+        else
+        {
+            // Normalise the denormal.
+            exponent = 127 - 15 + 1;
+            while ( ( mantissa & 0x400u ) == 0 )
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            result = sign | ( exponent << 23 ) | ( ( mantissa & 0x3FFu ) << 13 );
+        }
+    }
+    else
+    {
+        result = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( mantissa << 13 );
+    }
+
+    float v;
+    std::memcpy( &v, &result, sizeof( v ) );
+    return v;
+}
+#else
+VERTEX_FUNC uint32_t VertexFloatToHalf( float v )
+{
+    return f32tof16( v );
+}
+
+VERTEX_FUNC float VertexHalfToFloat( uint32_t bits )
+{
+    return f16tof32( bits );
+}
+#endif
+
+VERTEX_FUNC float VertexAbs( float v )
+{
+    return v < 0.0f ? -v : v;
+}
+
+VERTEX_FUNC float VertexSignNotZero( float v )
+{
+    return v < 0.0f ? -1.0f : 1.0f;
+}
+
+// [-1, 1] to a snorm of the bits under mask, rounded to nearest. scale is the largest value, mask / 2.
+VERTEX_FUNC uint32_t VertexEncodeSnorm( float v, float scale, uint32_t mask )
+{
+    float s = v < -1.0f ? -1.0f : ( v > 1.0f ? 1.0f : v );
+    s *= scale;
+    return (uint32_t)(int)( s + ( s < 0.0f ? -0.5f : 0.5f ) ) & mask;
+}
+
+VERTEX_FUNC float VertexDecodeSnorm( uint32_t bits, float scale, uint32_t mask )
+{
+    float v = (float)(int)( bits & mask );
+    v       = v > scale ? v - ( (float)mask + 1.0f ) : v;
+    v /= scale;
+    return v < -1.0f ? -1.0f : v;
+}
+
+/**
+ * A direction to the octahedron, unfolded to [-1, 1]^2. A zero vector ends
+ * up at the origin, the +z pole.
+ */
+VERTEX_FUNC float2 VertexOctEncode( float3 n )
+{
+    float l1 = VertexAbs( n.x ) + VertexAbs( n.y ) + VertexAbs( n.z );
+    if ( l1 == 0.0f )
+    {
+        return float2( 0.0f, 0.0f );
+    }
+
+    float x = n.x / l1;
+    float y = n.y / l1;
+
+    // The lower hemisphere folds over the diagonals.
+    if ( n.z < 0.0f )
+    {
+        float foldedX = ( 1.0f - VertexAbs( y ) ) * VertexSignNotZero( x );
+        float foldedY = ( 1.0f - VertexAbs( x ) ) * VertexSignNotZero( y );
+        x             = foldedX;
+        y             = foldedY;
+    }
+
+    return float2( x, y );
+}
+
+VERTEX_FUNC float3 VertexOctDecode( float x, float y )
+{
+    float z = 1.0f - VertexAbs( x ) - VertexAbs( y );
+
+    if ( z < 0.0f )
+    {
+        float unfoldedX = ( 1.0f - VertexAbs( y ) ) * VertexSignNotZero( x );
+        float unfoldedY = ( 1.0f - VertexAbs( x ) ) * VertexSignNotZero( y );
+        x               = unfoldedX;
+        y               = unfoldedY;
+    }
+
+    return normalize( float3( x, y, z ) );
+}
+
+VERTEX_FUNC uint32_t VertexEncodeNormal( float3 n )
+{
+    float2 e = VertexOctEncode( n );
+    return VertexEncodeSnorm( e.x, 32767.0f, 0xFFFFu ) | ( VertexEncodeSnorm( e.y, 32767.0f, 0xFFFFu ) << 16 );
+}
+
+VERTEX_FUNC float3 VertexDecodeNormal( uint32_t bits )
+{
+    return VertexOctDecode( VertexDecodeSnorm( bits, 32767.0f, 0xFFFFu ),
+                            VertexDecodeSnorm( bits >> 16, 32767.0f, 0xFFFFu ) );
+}
+
+/**
+ * The bitangent sign is negative when bitangent points away from
+ * cross( normal, tangent ).
+ */
+VERTEX_FUNC uint32_t VertexEncodeTangent( float3 normal, float3 tangent, float3 bitangent )
+{
+    float2   e    = VertexOctEncode( tangent );
+    uint32_t sign = dot( cross( normal, tangent ), bitangent ) < 0.0f ? PACKED_VERTEX_BITANGENT_SIGN : 0u;
+    return VertexEncodeSnorm( e.x, 16383.0f, 0x7FFFu ) | ( VertexEncodeSnorm( e.y, 16383.0f, 0x7FFFu ) << 15 ) |
+           sign;
+}
+
+VERTEX_FUNC float3 VertexDecodeTangent( uint32_t bits )
+{
+    return VertexOctDecode( VertexDecodeSnorm( bits, 16383.0f, 0x7FFFu ),
+                            VertexDecodeSnorm( bits >> 15, 16383.0f, 0x7FFFu ) );
+}
+
+VERTEX_FUNC float3 VertexDecodeBitangent( float3 normal, float3 tangent, uint32_t tangentBits )
+{
+    float sign = ( tangentBits & PACKED_VERTEX_BITANGENT_SIGN ) != 0u ? -1.0f : 1.0f;
+    return cross( normal, tangent ) * sign;
+}
+
+VERTEX_FUNC uint32_t VertexEncodeTexCoord( float u, float v )
+{
+    return VertexFloatToHalf( u ) | ( VertexFloatToHalf( v ) << 16 );
+}
+
+VERTEX_FUNC float2 VertexDecodeTexCoord( uint32_t bits )
+{
+    return float2( VertexHalfToFloat( bits & 0xFFFFu ), VertexHalfToFloat( bits >> 16 ) );
+}
+
+#ifdef __cplusplus
+}  // namespace cpulib
+#endif
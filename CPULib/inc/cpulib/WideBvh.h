@@ -0,0 +1,150 @@
+#pragma once
+
+/*
+ *  Ray queries against a Bvh, for tracing on the CPU what TraceRay traces on
+ *  the GPU, such as on a machine without DXR.
+ *
+ *  The binary tree is collapsed into nodes of four children, each opening
+ *  the inner child of largest surface area until it has four, so one node
+ *  test with SSE slabs does the work of about two levels of the binary tree.
+ *  The triangles of each leaf are stored four to a pack, in the layout of
+ *  Möller-Trumbore with the edges ready, and a pack is tested in one go.
+ *  Without SSE the same kernels run as loops over the four lanes.
+ *
+ *  Intersect is the closest hit of TraceRay, Occluded the any-hit query of a
+ *  shadow ray traced with RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH. Both are
+ *  const and take no locks, any number of threads can trace at once.
+ */
+
+#include "Bvh.h"
+#include "VectorMath.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace cpulib
+{
+
+const uint32_t BVH_NO_HIT = ~0u;
+
+/**
+ * As RayDesc in HLSL. Hits with t in [tMin, tMax] count.
+ */
+struct RayDesc
+{
+    float3 origin;
+    float  tMin = 0.0f;
+    float3 direction;
+    float  tMax = std::numeric_limits<float>::max();
+};
+
+struct RayHit
+{
+    float t = std::numeric_limits<float>::max();
+    // Of the second and third vertex, as BuiltInTriangleIntersectionAttributes.
+    float2 barycentrics = float2( 0.0f, 0.0f );
+    // The triangle hit, see WideBvh::GetPrimitive, BVH_NO_HIT for a miss.
+    uint32_t triangle = BVH_NO_HIT;
+
+    bool IsHit() const
+    {
+        return triangle != BVH_NO_HIT;
+    }
+};
+
+/**
+ * Four children as structure of arrays, 128 bytes. An empty slot has
+ * bounds that no ray hits.
+ */
+struct alignas( 64 ) WideBvhNode
+{
+    // Lower x, upper x, lower y, upper y, lower z, upper z of each child.
+    float bounds[6][4];
+    // The node of an inner child, the first pack of a leaf.
+    uint32_t child[4];
+    // The packs of a leaf, 0 for an inner child.
+    uint32_t packCount[4];
+};
+
+/**
+ * Four triangles as vertex 0 and the edges to vertex 1 and 2, 16 byte
+ * aligned rows of x, y and z. The unused lanes of the last pack of a leaf
+ * have zero edges, which no ray hits.
+ */
+struct alignas( 16 ) TrianglePack
+{
+    float v0[3][4];
+    float e1[3][4];
+    float e2[3][4];
+};
+
+class WideBvh
+{
+public:
+    /**
+     * Collapse bvh, which can be cleared afterwards.
+     */
+    void Build( const Bvh& bvh );
+
+    void Clear();
+
+    /**
+     * The closest hit, true if there is one.
+     */
+    bool Intersect( const RayDesc& ray, RayHit& hit ) const;
+
+    /**
+     * Whether anything is hit at all.
+     */
+    bool Occluded( const RayDesc& ray ) const;
+
+    /**
+     * Node 0 is the root, none without triangles.
+     */
+    const std::vector<WideBvhNode>& GetNodes() const
+    {
+        return m_Nodes;
+    }
+
+    const std::vector<TrianglePack>& GetPacks() const
+    {
+        return m_Packs;
+    }
+
+    /**
+     * Where RayHit::triangle came from.
+     */
+    const BvhPrimitive& GetPrimitive( uint32_t triangle ) const
+    {
+        return m_Primitives[triangle];
+    }
+
+    /**
+     * The vertices of RayHit::triangle.
+     */
+    BvhTriangle GetTriangle( uint32_t triangle ) const;
+
+    /**
+     * The deepest path from the root, in wide nodes.
+     */
+    uint32_t GetDepth() const
+    {
+        return m_Depth;
+    }
+
+    uint64_t GetMemoryBytes() const;
+
+private:
+    template<bool AnyHit>
+    bool Traverse( const RayDesc& ray, RayHit& hit ) const;
+
+    std::vector<WideBvhNode>  m_Nodes;
+    std::vector<TrianglePack> m_Packs;
+    // Four per pack, the unused lanes BVH_NO_HIT.
+    std::vector<BvhPrimitive> m_Primitives;
+
+    uint32_t m_Depth = 0;
+};
+
+}  // namespace cpulib
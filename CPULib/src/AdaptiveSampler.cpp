@@ -0,0 +1,791 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/AdaptiveSampler.h>
+
+#include <cpulib/ThreadPool.h>
+
+using namespace cpulib;
+
+// Pixels per tile handed to a worker.
+static const uint32_t TILE_SIZE = 64;
+
+AdaptiveSampler::AdaptiveSampler( ThreadPool& pool )
+: m_Pool( pool )
+, m_Compaction( pool )
+{}
+
+bool AdaptiveSampler::ShootNextRay( int2 pos, int tileSize )
+{
+    // check if corner or centre of tileSize grid sytem.
+    return ( ( pos.x % tileSize ) == 0 && ( pos.y % tileSize ) == 0 ) ||
+           ( pos.x % tileSize == ( tileSize >> 1 ) && pos.y % tileSize == ( tileSize >> 1 ) );
+}
+
+// itr := { 1, 2, 3, 4 }
+// out := { 3, 5, 9, 17 }
+int AdaptiveSampler::CalcWidth( int widthIndex )
+{
+    int result = 3;
+    for ( int i = 1; i < widthIndex; ++i )
+        result += ( 1 << i );
+    return result;
+}
+
+// for side = 17
+// itr := {0, 1, 2, 3, 4}
+// adj := {17, 17, 9, 5, 3 }
+int AdaptiveSampler::CalcAdjustedSide( int side, int itr )
+{
+    int result = side;
+    for ( int i = 1; i < itr; ++i )
+        result = static_cast<int>( std::ceil( result / 2.0 ) );
+    return result;
+}
+
+float3 AdaptiveSampler::CalcBaryCentrics( const Triangle& tri, int2 p )
+{
+    float2 v0 = float2( tri.two - tri.one );
+    float2 v1 = float2( tri.three - tri.one );
+    float2 v2 = float2( p - tri.one );
+
+    float d00   = dot( v0, v0 );
+    float d01   = dot( v0, v1 );
+    float d11   = dot( v1, v1 );
+    float d20   = dot( v2, v0 );
+    float d21   = dot( v2, v1 );
+    float denom = d00 * d11 - d01 * d01;
+    float v     = ( d11 * d20 - d01 * d21 ) / denom;
+    float w     = ( d00 * d21 - d01 * d20 ) / denom;
+    float u     = 1.0f - v - w;
+
+    return float3( u, v, w );
+}
+
+int AdaptiveSampler::CalcLatticeSpacing( int gridSize, int passCount, int pass )
+{
+    if ( gridSize <= 0 || pass >= passCount - 1 )
+        return 1;
+
+    // Levels refined so far, rounded to the nearest.
+    int level = gridSize - ( pass * gridSize + ( passCount - 1 ) / 2 ) / ( passCount - 1 );
+    return 1 << level;
+}
+
+AdaptiveSampler::Triangle AdaptiveSampler::BuildTriangle( int2 pos, int side )
+{
+    Triangle result;
+    int2     upperLeft  = int2( pos.x / ( side - 1 ), pos.y / ( side - 1 ) ) * ( side - 1 );
+    int2     lowerRight = upperLeft + int2( side - 1, side - 1 );
+    int2     centre     = int2( ( upperLeft.x + lowerRight.x ) / 2, ( upperLeft.y + lowerRight.y ) / 2 );
+
+    float2 dirCentrePos = normalize( float2( pos - centre ) );  // end - start
+    int2   quadrant     = int2( dirCentrePos.x >= 0 ? 1 : -1, dirCentrePos.y > 0 ? 1 : -1 );
+
+    // corner A.
+    int2 corner = centre + quadrant * ( side >> 1 );
+
+    // [-PI, PI]
+    float theta = std::atan2( dirCentrePos.y, dirCentrePos.x );
+
+    float2 reflNorm;
+    if ( std::abs( theta ) <= PI_4 )
+        reflNorm = float2( 1, 0 );
+    else if ( theta > -3 * PI_4 && theta < PI_4 )
+        reflNorm = float2( 0, -1 );
+    else if ( theta < 3 * PI_4 && theta > PI_4 )
+        reflNorm = float2( 0, 1 );
+    else
+        reflNorm = float2( -1, 0 );
+
+    float2 dirCentreReflPos = reflect( -dirCentrePos, reflNorm );
+    int2   reflQuadrant     = int2( dirCentreReflPos.x > 0 ? 1 : -1, dirCentreReflPos.y >= 0 ? 1 : -1 );
+    int2   cornerRefl       = centre + reflQuadrant * ( side >> 1 );
+
+    result.one   = corner;
+    result.two   = centre;
+    result.three = cornerRefl;
+
+    result.barycentrics = CalcBaryCentrics( result, pos );
+    return result;
+}
+
+uint8_t AdaptiveSampler::GetState( int2 p ) const
+{
+    // Out of bounds reads return 0 on the GPU, i.e. AS_EMPTY.
+    if ( p.x < 0 || p.y < 0 || static_cast<uint32_t>( p.x ) >= m_StateWidth ||
+         static_cast<uint32_t>( p.y ) >= m_StateHeight )
+        return AS_EMPTY;
+
+    return m_State[static_cast<size_t>( p.y ) * m_StateWidth + p.x];
+}
+
+// Scale the angle tolerance of a dot product limit, exact for scale 1.
+static inline float WidenDotLimit( float limit, float scale )
+{
+    return scale == 1.0f ? limit : 1.0f - ( 1.0f - limit ) * scale;
+}
+
+static inline float4 UnpackNormal( const float4& n )
+{
+    // from [0,1] to [-1,1]
+    return normalize3( n * 2.0f - float4( 1.0f ) );
+}
+
+static inline float4 PackNormal( const float4& n )
+{
+    // [-1,1] to [0,1]
+    float4 r = n * 0.5f + float4( 0.5f );
+    r.w      = 1;
+    return r;
+}
+
+// The interpolation checks compare up to four corners at once. Each lane is computed in the same order as length3,
+// dot3 and length4 compute it, so the decisions are the same with and without SSE.
+#if CPULIB_SSE
+static inline void Transpose( const float4& a, const float4& b, const float4& c, const float4& d, __m128& x,
+                              __m128& y, __m128& z, __m128& w )
+{
+    x = a.Load();
+    y = b.Load();
+    z = c.Load();
+    w = d.Load();
+    _MM_TRANSPOSE4_PS( x, y, z, w );
+}
+#endif
+
+// length3 of a, b, c and d.
+static inline float4 Length3x4( const float4& a, const float4& b, const float4& c, const float4& d )
+{
+#if CPULIB_SSE
+    __m128 x, y, z, w;
+    Transpose( a, b, c, d, x, y, z, w );
+    const __m128 xy = _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( y, y ) );
+    return float4( _mm_sqrt_ps( _mm_add_ps( xy, _mm_mul_ps( z, z ) ) ) );
+#else
+    return float4( length3( a ), length3( b ), length3( c ), length3( d ) );
+#endif
+}
+
+// length4 of a, b, c and d.
+static inline float4 Length4x4( const float4& a, const float4& b, const float4& c, const float4& d )
+{
+#if CPULIB_SSE
+    __m128 x, y, z, w;
+    Transpose( a, b, c, d, x, y, z, w );
+    const __m128 xz = _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( z, z ) );
+    const __m128 yw = _mm_add_ps( _mm_mul_ps( y, y ), _mm_mul_ps( w, w ) );
+    return float4( _mm_sqrt_ps( _mm_add_ps( xz, yw ) ) );
+#else
+    return float4( length4( a ), length4( b ), length4( c ), length4( d ) );
+#endif
+}
+
+// dot3 of the pairs a0 b0 up to a3 b3.
+static inline float4 Dot3x4( const float4& a0, const float4& b0, const float4& a1, const float4& b1, const float4& a2,
+                             const float4& b2, const float4& a3, const float4& b3 )
+{
+#if CPULIB_SSE
+    __m128 ax, ay, az, aw, bx, by, bz, bw;
+    Transpose( a0, a1, a2, a3, ax, ay, az, aw );
+    Transpose( b0, b1, b2, b3, bx, by, bz, bw );
+    return float4( _mm_add_ps( _mm_add_ps( _mm_mul_ps( ax, bx ), _mm_mul_ps( ay, by ) ), _mm_mul_ps( az, bz ) ) );
+#else
+    return float4( dot3( a0, b0 ), dot3( a1, b1 ), dot3( a2, b2 ), dot3( a3, b3 ) );
+#endif
+}
+
+// a < b in every lane.
+static inline bool AllLess( const float4& a, const float4& b )
+{
+#if CPULIB_SSE
+    return _mm_movemask_ps( _mm_cmplt_ps( a.Load(), b.Load() ) ) == 0xF;
+#else
+    return a.x < b.x && a.y < b.y && a.z < b.z && a.w < b.w;
+#endif
+}
+
+// Every lane 0.
+static inline bool AllZero( const float4& a )
+{
+#if CPULIB_SSE
+    return _mm_movemask_ps( _mm_cmpeq_ps( a.Load(), _mm_setzero_ps() ) ) == 0xF;
+#else
+    return a.x == 0 && a.y == 0 && a.z == 0 && a.w == 0;
+#endif
+}
+
+int AdaptiveSampler::GetConvergence( int2 p ) const
+{
+    if ( !m_Settings.varianceGuided || !m_Moments || !m_Moments->Contains( p ) )
+        return 0;
+
+    const float4& moments = ( *m_Moments )[p];
+    if ( moments.z < static_cast<float>( m_Settings.minHistoryLength ) )
+        return 1;
+
+    float variance = std::max( 0.0f, moments.y - moments.x * moments.x );
+    float mean     = std::max( moments.x, EPSILON );
+
+    return std::sqrt( variance ) > m_Settings.varianceLimit * mean ? 1 : -1;
+}
+
+void AdaptiveSampler::GetConvergenceRow( uint32_t y, int8_t* convergence ) const
+{
+    const uint32_t width = m_StateWidth;
+    if ( !m_Settings.varianceGuided || !m_Moments || y >= m_Moments->GetHeight() )
+    {
+        std::fill( convergence, convergence + width, int8_t( 0 ) );
+        return;
+    }
+
+    const uint32_t covered = std::min( width, m_Moments->GetWidth() );
+    const float4*  moments = m_Moments->GetRow( y );
+
+    uint32_t x = 0;
+#if CPULIB_SSE
+    // Four pixels at a time, lane by lane what GetConvergence does. The operands of max are in the order that gives
+    // the same answer as std::max for a NaN.
+    const __m128 minHistory = _mm_set1_ps( static_cast<float>( m_Settings.minHistoryLength ) );
+    const __m128 limit      = _mm_set1_ps( m_Settings.varianceLimit );
+    const __m128 epsilon    = _mm_set1_ps( EPSILON );
+
+    for ( ; x + 4 <= covered; x += 4 )
+    {
+        __m128 mean, meanSquared, history, unused;
+        Transpose( moments[x], moments[x + 1], moments[x + 2], moments[x + 3], mean, meanSquared, history, unused );
+
+        const __m128 variance    = _mm_max_ps( _mm_sub_ps( meanSquared, _mm_mul_ps( mean, mean ) ), _mm_setzero_ps() );
+        const __m128 noiseLimit  = _mm_mul_ps( limit, _mm_max_ps( epsilon, mean ) );
+        const __m128 noisy       = _mm_cmpgt_ps( _mm_sqrt_ps( variance ), noiseLimit );
+        const int    unconverged = _mm_movemask_ps( _mm_or_ps( _mm_cmplt_ps( history, minHistory ), noisy ) );
+
+        for ( int lane = 0; lane < 4; ++lane )
+            convergence[x + lane] = ( unconverged >> lane ) & 1 ? 1 : -1;
+    }
+#endif
+
+    for ( ; x < covered; ++x )
+        convergence[x] = static_cast<int8_t>( GetConvergence( int2( static_cast<int>( x ), static_cast<int>( y ) ) ) );
+
+    std::fill( convergence + covered, convergence + width, int8_t( 0 ) );
+}
+
+bool AdaptiveSampler::TryInterpolateFromSquare( RayBuffer& buffer, int2 pos, const Square& quad,
+                                                float limitScale ) const
+{
+    const int2 pUp    = quad.one;
+    const int2 pDown  = quad.two;
+    const int2 pLeft  = quad.three;
+    const int2 pRight = quad.four;
+
+    // Check if all are sampled.
+    if ( !( GetState( pUp ) > AS_CAST && GetState( pDown ) > AS_CAST && GetState( pLeft ) > AS_CAST &&
+            GetState( pRight ) > AS_CAST ) )
+        return false;
+
+    const float4& bary = quad.barycentrics;
+
+    const ImageF4& colour = buffer.Colour();
+    float4         up     = colour[pUp];
+    float4         down   = colour[pDown];
+    float4         left   = colour[pLeft];
+    float4         right  = colour[pRight];
+
+    float4 intColour = blend( up, bary.x, down, bary.y, left, bary.z ) + right * bary.w;
+
+    // check if colour is ok
+    const float colourLimit = m_Settings.colourLimit * limitScale;
+    if ( !AllLess( Length3x4( intColour - up, intColour - down, intColour - left, intColour - right ),
+                   float4( colourLimit ) ) )
+        return false;
+
+    // check if same object (with mask)
+    const ImageF4& objectMask = buffer.ObjectMask();
+    up                        = objectMask[pUp];
+    down                      = objectMask[pDown];
+    left                      = objectMask[pLeft];
+    right                     = objectMask[pRight];
+
+    if ( !AllZero( Length4x4( up - down, left - right, up - left, up - left ) ) )
+        return false;
+
+    float4 intObj = up;
+
+    const ImageF4& normals = buffer.Normals();
+    up                     = UnpackNormal( normals[pUp] );
+    down                   = UnpackNormal( normals[pDown] );
+    left                   = UnpackNormal( normals[pLeft] );
+    right                  = UnpackNormal( normals[pRight] );
+
+    // check normals pointing in somewhat same direction
+    const float normalDotLimit = WidenDotLimit( m_Settings.normalDotLimit, limitScale );
+    if ( !AllLess( float4( normalDotLimit ), Dot3x4( up, down, left, right, up, left, up, left ) ) )
+        return false;
+
+    float4 intNorm = normalize3( blend( up, bary.x, down, bary.y, left, bary.z ) + right * bary.w );
+
+    const ImageF4& posDepth = buffer.PosDepth();
+    up                      = posDepth[pUp];
+    down                    = posDepth[pDown];
+    left                    = posDepth[pLeft];
+    right                   = posDepth[pRight];
+
+    // check world position is within limit
+    const float posLimit = 2 * m_Settings.posDiffLimit * limitScale;
+    if ( !AllLess( Length3x4( up - down, left - right, up - left, up - left ), float4( posLimit ) ) )
+        return false;
+
+    float4 intPosition = blend( up, bary.x, down, bary.y, left, bary.z ) + right * bary.w;
+
+    // Write interpolated value and mark this pixel as interpolated and not traced.
+    intColour.w                = AS_INTERPOLATED;
+    buffer.Colour()[pos]       = intColour;
+    buffer.Normals()[pos]      = PackNormal( intNorm );
+    buffer.PosDepth()[pos]     = intPosition;
+    buffer.ObjectMask()[pos]   = intObj;
+
+    return true;
+}
+
+bool AdaptiveSampler::TryInterpolateFromTriangle( RayBuffer& buffer, int2 pos, const Triangle& tri,
+                                                  float limitScale ) const
+{
+    if ( !( GetState( tri.one ) > AS_CAST && GetState( tri.two ) > AS_CAST && GetState( tri.three ) > AS_CAST ) )
+        return false;
+
+    const float3& bary = tri.barycentrics;
+
+    const ImageF4& colour = buffer.Colour();
+    float4         one    = colour[tri.one];
+    float4         two    = colour[tri.two];
+    float4         three  = colour[tri.three];
+
+    float4 inteColour = blend( one, bary.x, two, bary.y, three, bary.z );
+
+    // check if colour is ok, the fourth lane repeats the first
+    const float colourLimit = m_Settings.colourLimit * limitScale;
+    if ( !AllLess( Length3x4( inteColour - one, inteColour - two, inteColour - three, inteColour - one ),
+                   float4( colourLimit ) ) )
+        return false;
+
+    // check if same object (with mask)
+    const ImageF4& objectMask = buffer.ObjectMask();
+    one                       = objectMask[tri.one];
+    two                       = objectMask[tri.two];
+    three                     = objectMask[tri.three];
+
+    if ( !AllZero( Length4x4( one - two, one - three, one - two, one - three ) ) )
+        return false;
+
+    float4 intObjMask = one;
+
+    const ImageF4& normals = buffer.Normals();
+    one                    = UnpackNormal( normals[tri.one] );
+    two                    = UnpackNormal( normals[tri.two] );
+    three                  = UnpackNormal( normals[tri.three] );
+
+    // check normals pointing in somewhat same direction (the shader tests one/two twice)
+    const float normalDotLimit = WidenDotLimit( m_Settings.normalDotLimit, limitScale );
+    if ( !AllLess( float4( normalDotLimit ), Dot3x4( one, two, one, three, one, two, one, three ) ) )
+        return false;
+
+    float4 intNorm = normalize3( blend( one, bary.x, two, bary.y, three, bary.z ) );
+
+    // positions
+    const ImageF4& posDepth = buffer.PosDepth();
+    one                     = posDepth[tri.one];
+    two                     = posDepth[tri.two];
+    three                   = posDepth[tri.three];
+
+    // check world position is within limit
+    const float  posLimit = m_Settings.posDiffLimit * limitScale;
+    const float4 limits( length( float2( tri.one - pos ) ) * posLimit, length( float2( tri.two - pos ) ) * posLimit,
+                         length( float2( tri.three - pos ) ) * posLimit, length( float2( tri.one - pos ) ) * posLimit );
+    if ( !AllLess( Length3x4( one - two, one - three, two - three, one - two ), limits ) )
+        return false;
+
+    float4 intPosition = blend( one, bary.x, two, bary.y, three, bary.z );
+
+    // Write interpolated value and mark this pixel as interpolated and not traced.
+    inteColour.w             = AS_INTERPOLATED;
+    buffer.Colour()[pos]     = inteColour;
+    buffer.Normals()[pos]    = PackNormal( intNorm );
+    buffer.PosDepth()[pos]   = intPosition;
+    buffer.ObjectMask()[pos] = intObjMask;
+
+    return true;
+}
+
+bool AdaptiveSampler::TryInterpolateFromCell( RayBuffer& buffer, int2 pos, int2 upperLeft, int2 lowerRight,
+                                              float limitScale ) const
+{
+    const int2 c00 = upperLeft;
+    const int2 c10( lowerRight.x, upperLeft.y );
+    const int2 c01( upperLeft.x, lowerRight.y );
+    const int2 c11 = lowerRight;
+
+    if ( !( GetState( c00 ) > AS_CAST && GetState( c10 ) > AS_CAST && GetState( c01 ) > AS_CAST &&
+            GetState( c11 ) > AS_CAST ) )
+        return false;
+
+    // Bilinear weights, a cell squashed against the image border has zero width.
+    float tx = lowerRight.x > upperLeft.x ? float( pos.x - upperLeft.x ) / float( lowerRight.x - upperLeft.x ) : 0.0f;
+    float ty = lowerRight.y > upperLeft.y ? float( pos.y - upperLeft.y ) / float( lowerRight.y - upperLeft.y ) : 0.0f;
+
+    const float4 bary( ( 1 - tx ) * ( 1 - ty ), tx * ( 1 - ty ), ( 1 - tx ) * ty, tx * ty );
+
+    const ImageF4& colour = buffer.Colour();
+    float4         one    = colour[c00];
+    float4         two    = colour[c10];
+    float4         three  = colour[c01];
+    float4         four   = colour[c11];
+
+    float4 intColour = blend( one, bary.x, two, bary.y, three, bary.z ) + four * bary.w;
+
+    // check if colour is ok
+    const float colourLimit = m_Settings.colourLimit * limitScale;
+    if ( !AllLess( Length3x4( intColour - one, intColour - two, intColour - three, intColour - four ),
+                   float4( colourLimit ) ) )
+        return false;
+
+    // check if same object (with mask)
+    const ImageF4& objectMask = buffer.ObjectMask();
+    one                       = objectMask[c00];
+    two                       = objectMask[c10];
+    three                     = objectMask[c01];
+    four                      = objectMask[c11];
+
+    if ( !AllZero( Length4x4( one - two, one - three, one - four, one - four ) ) )
+        return false;
+
+    float4 intObj = one;
+
+    const ImageF4& normals = buffer.Normals();
+    one                    = UnpackNormal( normals[c00] );
+    two                    = UnpackNormal( normals[c10] );
+    three                  = UnpackNormal( normals[c01] );
+    four                   = UnpackNormal( normals[c11] );
+
+    // check normals pointing in somewhat same direction
+    const float normalDotLimit = WidenDotLimit( m_Settings.normalDotLimit, limitScale );
+    if ( !AllLess( float4( normalDotLimit ), Dot3x4( one, two, one, three, one, four, one, four ) ) )
+        return false;
+
+    float4 intNorm = normalize3( blend( one, bary.x, two, bary.y, three, bary.z ) + four * bary.w );
+
+    const ImageF4& posDepth = buffer.PosDepth();
+    one                     = posDepth[c00];
+    two                     = posDepth[c10];
+    three                   = posDepth[c01];
+    four                    = posDepth[c11];
+
+    // check world position is within limit, scaled by the pixel distance of the corners
+    const float  posLimit = m_Settings.posDiffLimit * limitScale;
+    const float  diagonal = std::max( 1.0f, length( float2( c11 - c00 ) ) ) * posLimit;
+    const float4 limits( std::max( 1.0f, length( float2( c10 - c00 ) ) ) * posLimit,
+                         std::max( 1.0f, length( float2( c01 - c00 ) ) ) * posLimit, diagonal, diagonal );
+    if ( !AllLess( Length3x4( one - two, one - three, one - four, one - four ), limits ) )
+        return false;
+
+    float4 intPosition = blend( one, bary.x, two, bary.y, three, bary.z ) + four * bary.w;
+
+    // Write interpolated value and mark this pixel as interpolated and not traced.
+    intColour.w              = AS_INTERPOLATED;
+    buffer.Colour()[pos]     = intColour;
+    buffer.Normals()[pos]    = PackNormal( intNorm );
+    buffer.PosDepth()[pos]   = intPosition;
+    buffer.ObjectMask()[pos] = intObj;
+
+    return true;
+}
+
+void AdaptiveSampler::Clear( RayBuffer& buffer ) const
+{
+    const float4   clearColour( 0.0f, 0.0f, 0.0f, m_Settings.gridSize > 0 ? AS_EMPTY : AS_CAST );
+    ImageF4&       colour = buffer.Colour();
+    const uint32_t width  = colour.GetWidth();
+
+    m_Pool.ParallelFor( colour.GetHeight(), [&]( uint32_t y ) {
+        float4* row = colour.GetRow( y );
+        for ( uint32_t x = 0; x < width; ++x )
+            row[x] = clearColour;
+    } );
+}
+
+void AdaptiveSampler::Schedule( RayBuffer& buffer, int iteration, uint32_t* castCount,
+                                uint32_t* interpolatedCount )
+{
+    const uint32_t width  = buffer.GetWidth();
+    const uint32_t height = buffer.GetHeight();
+
+    // Capture the state of every pixel before any of them are touched.
+    m_StateWidth  = width;
+    m_StateHeight = height;
+    m_State.resize( static_cast<size_t>( width ) * height );
+    m_Convergence.resize( m_State.size() );
+
+    m_Pool.ParallelFor( height, [&]( uint32_t y ) {
+        GetConvergenceRow( y, m_Convergence.data() + static_cast<size_t>( y ) * width );
+
+        const float4* row   = buffer.Colour().GetRow( y );
+        uint8_t*      state = m_State.data() + static_cast<size_t>( y ) * width;
+        for ( uint32_t x = 0; x < width; ++x )
+        {
+            float w  = row[x].w;
+            state[x] = static_cast<uint8_t>(
+                w == AS_EMPTY ? AS_EMPTY
+                              : ( w > AS_CAST ? ( w >= AS_INTERPOLATED ? AS_INTERPOLATED : AS_CASTED ) : AS_CAST ) );
+        }
+    } );
+
+    uint32_t cast = 0, interpolated = 0;
+    if ( m_Settings.mode == SchedulerMode::Quadtree )
+        ScheduleQuadtree( buffer, iteration, cast, interpolated );
+    else
+        ScheduleIterative( buffer, iteration, cast, interpolated );
+
+    if ( castCount )
+        *castCount = cast;
+    if ( interpolatedCount )
+        *interpolatedCount = interpolated;
+}
+
+void AdaptiveSampler::ScheduleIterative( RayBuffer& buffer, int iteration, uint32_t& castCount,
+                                         uint32_t& interpolatedCount )
+{
+    const uint32_t width  = buffer.GetWidth();
+    const uint32_t height = buffer.GetHeight();
+
+    const int maxStep  = m_Settings.gridSize;
+    const int gridSize = CalcWidth( m_Settings.gridSize );
+    const int tileSize = gridSize - 1;
+    const int itr      = iteration;
+
+    // Outside of the tile grid everything is traced.
+    const int2 upperTileLimit( tileSize * ( ( static_cast<int>( width ) - 1 ) / tileSize ),
+                               tileSize * ( ( static_cast<int>( height ) - 1 ) / tileSize ) );
+
+    // Side of the triangles and of the next ray grid for this pass.
+    const int adjustedGridSize = CalcAdjustedSide( gridSize, itr );
+    const int nextTileSize     = CalcAdjustedSide( gridSize, itr + 1 ) - 1;
+
+    std::atomic<uint32_t> totalCast { 0 };
+    std::atomic<uint32_t> totalInterpolated { 0 };
+
+    m_Pool.ParallelForTiles( width, height, TILE_SIZE, [&]( const Tile& tile ) {
+        uint32_t cast         = 0;
+        uint32_t interpolated = 0;
+
+        ImageF4& colour = buffer.Colour();
+
+        for ( uint32_t y = tile.y0; y < tile.y1; ++y )
+        {
+            const uint8_t* state       = m_State.data() + static_cast<size_t>( y ) * width;
+            const int8_t*  convergence = m_Convergence.data() + static_cast<size_t>( y ) * width;
+
+            for ( uint32_t x = tile.x0; x < tile.x1; ++x )
+            {
+                // cleans out those that have already been traced.
+                if ( state[x] != AS_EMPTY )
+                    continue;
+
+                const int2 launchIndex( static_cast<int>( x ), static_cast<int>( y ) );
+
+                const int   pixelConvergence = convergence[x];
+                const float limitScale       = pixelConvergence < 0 ? m_Settings.convergedLimitScale : 1.0f;
+
+                if ( itr == 0 )
+                {
+                    // I outside of tiles, or inside tiles and shoot ray, or still noisy
+                    if ( launchIndex.x <= 0 || launchIndex.x >= upperTileLimit.x || launchIndex.y <= 0 ||
+                         launchIndex.y >= upperTileLimit.y || ShootNextRay( launchIndex, tileSize ) ||
+                         pixelConvergence > 0 )
+                    {
+                        colour[launchIndex].w = AS_CAST;
+                        ++cast;
+                    }
+                }
+                else if ( itr == maxStep )  // final step.
+                {
+                    // Try interpolate, if we cant, send all rays
+                    Square neighbour;
+                    neighbour.barycentrics = float4( 0.25f );
+                    neighbour.one          = launchIndex + int2( 0, 1 );
+                    neighbour.two          = launchIndex + int2( 0, -1 );
+                    neighbour.three        = launchIndex + int2( 1, 0 );
+                    neighbour.four         = launchIndex + int2( -1, 0 );
+
+                    if ( TryInterpolateFromSquare( buffer, launchIndex, neighbour, limitScale ) )
+                    {
+                        ++interpolated;
+                    }
+                    else
+                    {
+                        colour[launchIndex].w = AS_CAST;
+                        ++cast;
+                    }
+                }
+                else  // smart cast between pixels.
+                {
+                    // Build Geometry and see if we can interpolate
+                    Triangle tri = BuildTriangle( launchIndex, adjustedGridSize );
+
+                    if ( TryInterpolateFromTriangle( buffer, launchIndex, tri, limitScale ) )
+                    {
+                        ++interpolated;
+                    }
+                    // if we cant interpolate, check if we should send the next one.
+                    else if ( ShootNextRay( launchIndex, nextTileSize ) )
+                    {
+                        colour[launchIndex].w = AS_CAST;
+                        ++cast;
+                    }
+                }
+            }
+        }
+
+        totalCast += cast;
+        totalInterpolated += interpolated;
+    } );
+
+    castCount         = totalCast;
+    interpolatedCount = totalInterpolated;
+}
+
+void AdaptiveSampler::ScheduleQuadtree( RayBuffer& buffer, int iteration, uint32_t& castCount,
+                                        uint32_t& interpolatedCount )
+{
+    const uint32_t width  = buffer.GetWidth();
+    const uint32_t height = buffer.GetHeight();
+
+    const int  passCount = GetPassCount();
+    const bool lastPass  = iteration >= passCount - 1;
+
+    // Cells of the lattice traced last pass, and the lattice to cast this pass.
+    const int cellSize = iteration > 0 ? CalcLatticeSpacing( m_Settings.gridSize, passCount, iteration - 1 ) : 0;
+    const int spacing  = CalcLatticeSpacing( m_Settings.gridSize, passCount, iteration );
+
+    const int2 lastPixel( static_cast<int>( width ) - 1, static_cast<int>( height ) - 1 );
+
+    std::atomic<uint32_t> totalCast { 0 };
+    std::atomic<uint32_t> totalInterpolated { 0 };
+
+    m_Pool.ParallelForTiles( width, height, TILE_SIZE, [&]( const Tile& tile ) {
+        uint32_t cast         = 0;
+        uint32_t interpolated = 0;
+
+        ImageF4& colour = buffer.Colour();
+
+        for ( uint32_t y = tile.y0; y < tile.y1; ++y )
+        {
+            const uint8_t* state       = m_State.data() + static_cast<size_t>( y ) * width;
+            const int8_t*  convergence = m_Convergence.data() + static_cast<size_t>( y ) * width;
+
+            for ( uint32_t x = tile.x0; x < tile.x1; ++x )
+            {
+                // cleans out those that have already been traced.
+                if ( state[x] != AS_EMPTY )
+                    continue;
+
+                const int2 launchIndex( static_cast<int>( x ), static_cast<int>( y ) );
+
+                if ( iteration > 0 )
+                {
+                    // All four corners of the enclosing cell are resolved by now.
+                    int2 upperLeft  = int2( launchIndex.x / cellSize, launchIndex.y / cellSize ) * cellSize;
+                    int2 lowerRight = int2( std::min( upperLeft.x + cellSize, lastPixel.x ),
+                                            std::min( upperLeft.y + cellSize, lastPixel.y ) );
+
+                    // Unconverged pixels were all cast in the first pass.
+                    const float limitScale = convergence[x] < 0 ? m_Settings.convergedLimitScale : 1.0f;
+
+                    if ( TryInterpolateFromCell( buffer, launchIndex, upperLeft, lowerRight, limitScale ) )
+                    {
+                        ++interpolated;
+                        continue;
+                    }
+                }
+
+                // The image border is part of every lattice.
+                bool onLattice = lastPass || ( ( launchIndex.x % spacing == 0 || launchIndex.x == lastPixel.x ) &&
+                                               ( launchIndex.y % spacing == 0 || launchIndex.y == lastPixel.y ) );
+                if ( onLattice || ( iteration == 0 && convergence[x] > 0 ) )
+                {
+                    colour[launchIndex].w = AS_CAST;
+                    ++cast;
+                }
+            }
+        }
+
+        totalCast += cast;
+        totalInterpolated += interpolated;
+    } );
+
+    castCount         = totalCast;
+    interpolatedCount = totalInterpolated;
+}
+
+void AdaptiveSampler::TraceFromReference( RayBuffer& buffer, const RayBuffer& reference )
+{
+    assert( reference.GetWidth() == buffer.GetWidth() && reference.GetHeight() == buffer.GetHeight() );
+
+    const uint32_t  rayCount = m_Compaction.Compact( buffer );
+    const uint32_t* rays     = m_Compaction.GetPixelList().data();
+
+    // Same launch shape as the indirect DispatchRays, one row per job.
+    DispatchSize dispatch = m_Compaction.GetDispatchSize();
+
+    m_Pool.ParallelFor( dispatch.height, [&]( uint32_t row ) {
+        uint32_t begin = row * dispatch.width;
+        uint32_t end   = std::min( rayCount, begin + dispatch.width );
+        for ( uint32_t i = begin; i < end; ++i )
+        {
+            int2 p = RayCompaction::UnpackPixel( rays[i] );
+
+            for ( int slot = 0; slot < SLOT_COUNT; ++slot )
+                buffer.slots[slot][p] = reference.slots[slot][p];
+
+            buffer.Colour()[p].w = AS_CASTED;
+        }
+    } );
+}
+
+AdaptiveSamplerStats AdaptiveSampler::Run( RayBuffer& buffer, const TraceFunction& trace )
+{
+    AdaptiveSamplerStats stats;
+    stats.pixelCount = static_cast<uint64_t>( buffer.GetWidth() ) * buffer.GetHeight();
+
+    Clear( buffer );
+
+    for ( int i = 0; i < GetPassCount(); ++i )
+    {
+        uint32_t cast = 0, interpolated = 0;
+        Schedule( buffer, i, &cast, &interpolated );
+
+        // With adaptive sampling off the clear already marked every pixel.
+        if ( i == 0 && m_Settings.gridSize <= 0 )
+            cast += static_cast<uint32_t>( stats.pixelCount );
+
+        stats.castPerPass.push_back( cast );
+        stats.interpolatedPerPass.push_back( interpolated );
+        stats.totalCast += cast;
+        stats.totalInterpolated += interpolated;
+
+        trace( buffer, i );
+    }
+
+    return stats;
+}
+
+AdaptiveSamplerStats AdaptiveSampler::Run( RayBuffer& buffer, const RayBuffer& reference )
+{
+    if ( buffer.GetWidth() != reference.GetWidth() || buffer.GetHeight() != reference.GetHeight() )
+        buffer.Resize( reference.GetWidth(), reference.GetHeight() );
+
+    AdaptiveSamplerStats stats =
+        Run( buffer, [&]( RayBuffer& b, int ) { TraceFromReference( b, reference ); } );
+
+    stats.colourError = ColourRMSE( buffer.Colour(), reference.Colour() );
+
+    return stats;
+}
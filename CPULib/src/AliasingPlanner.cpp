@@ -0,0 +1,260 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/AliasingPlanner.h>
+#include <cpulib/ResourceRotation.h>
+
+using namespace cpulib;
+
+static uint64_t AlignUp( uint64_t value, uint64_t alignment )
+{
+    return ( value + alignment - 1 ) & ~( alignment - 1 );
+}
+
+static bool Fail( std::string* error, const std::string& message )
+{
+    if ( error )
+        *error = message;
+    return false;
+}
+
+static std::string Megabytes( uint64_t bytes )
+{
+    std::ostringstream out;
+    out.precision( 1 );
+    out << std::fixed << bytes / ( 1024.0 * 1024.0 ) << " MB";
+    return out.str();
+}
+
+uint32_t AliasingPlanner::AddResource( const std::string& name, uint64_t size, uint64_t alignment )
+{
+    assert( alignment > 0 && ( alignment & ( alignment - 1 ) ) == 0 );
+
+    Resource resource;
+    resource.name      = name;
+    resource.size      = size;
+    resource.alignment = alignment;
+
+    m_Resources.push_back( resource );
+    return static_cast<uint32_t>( m_Resources.size() - 1 );
+}
+
+void AliasingPlanner::AddLifetime( uint32_t resource, uint32_t begin, uint32_t end )
+{
+    assert( resource < m_Resources.size() && begin <= end );
+
+    m_Resources[resource].lifetime.push_back( { begin, end } );
+}
+
+bool AliasingPlanner::Overlaps( uint32_t a, uint32_t b ) const
+{
+    for ( const Interval& i: m_Resources[a].lifetime )
+    {
+        for ( const Interval& j: m_Resources[b].lifetime )
+        {
+            if ( i.begin <= j.end && j.begin <= i.end )
+                return true;
+        }
+    }
+    return false;
+}
+
+void AliasingPlanner::Plan()
+{
+    // Big ones first, they leave the gaps the small ones fill. Ties go by the start of the lifetime.
+    auto firstUse = [this]( uint32_t r ) {
+        uint32_t begin = ~0u;
+        for ( const Interval& interval: m_Resources[r].lifetime )
+            begin = std::min( begin, interval.begin );
+        return begin;
+    };
+
+    std::vector<uint32_t> order( m_Resources.size() );
+    std::iota( order.begin(), order.end(), 0 );
+    std::stable_sort( order.begin(), order.end(), [&]( uint32_t a, uint32_t b ) {
+        if ( m_Resources[a].size != m_Resources[b].size )
+            return m_Resources[a].size > m_Resources[b].size;
+        return firstUse( a ) < firstUse( b );
+    } );
+
+    struct Range
+    {
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    m_HeapSize = 0;
+    std::vector<uint32_t> placed;
+    std::vector<Range>    taken;
+    for ( uint32_t r: order )
+    {
+        Resource& resource = m_Resources[r];
+
+        taken.clear();
+        for ( uint32_t other: placed )
+        {
+            if ( Overlaps( r, other ) )
+                taken.push_back( { m_Resources[other].offset, m_Resources[other].offset + m_Resources[other].size } );
+        }
+        std::sort( taken.begin(), taken.end(), []( const Range& a, const Range& b ) { return a.begin < b.begin; } );
+
+        // Lowest gap that fits.
+        uint64_t offset = 0;
+        for ( const Range& range: taken )
+        {
+            if ( AlignUp( offset, resource.alignment ) + resource.size <= range.begin )
+                break;
+            offset = std::max( offset, range.end );
+        }
+
+        resource.offset = AlignUp( offset, resource.alignment );
+        m_HeapSize      = std::max( m_HeapSize, resource.offset + resource.size );
+        placed.push_back( r );
+    }
+}
+
+bool AliasingPlanner::SharesMemory( uint32_t a, uint32_t b ) const
+{
+    const Resource& first  = m_Resources[a];
+    const Resource& second = m_Resources[b];
+    return a != b && first.size > 0 && second.size > 0 && first.offset < second.offset + second.size &&
+           second.offset < first.offset + first.size;
+}
+
+bool AliasingPlanner::Validate( std::string* error ) const
+{
+    for ( uint32_t a = 0; a < m_Resources.size(); ++a )
+    {
+        const Resource& resource = m_Resources[a];
+        if ( resource.offset % resource.alignment != 0 )
+            return Fail( error, resource.name + " is not aligned" );
+        if ( resource.offset + resource.size > m_HeapSize )
+            return Fail( error, resource.name + " does not fit in the heap" );
+
+        for ( uint32_t b = a + 1; b < m_Resources.size(); ++b )
+        {
+            if ( SharesMemory( a, b ) && Overlaps( a, b ) )
+                return Fail( error, resource.name + " and " + m_Resources[b].name +
+                                        " are alive together in the same memory" );
+        }
+    }
+
+    return true;
+}
+
+uint64_t AliasingPlanner::GetCommittedSize() const
+{
+    uint64_t size = 0;
+    for ( const Resource& resource: m_Resources )
+        size += AlignUp( resource.size, resource.alignment );
+    return size;
+}
+
+std::string AliasingPlanner::Describe() const
+{
+    std::ostringstream out;
+    out << "heap " << Megabytes( m_HeapSize ) << ", committed " << Megabytes( GetCommittedSize() ) << ", saved "
+        << Megabytes( GetSavedBytes() ) << "\n";
+
+    for ( const Resource& resource: m_Resources )
+    {
+        out << resource.name << " at " << resource.offset << ", " << resource.size << " bytes, alive";
+        for ( const Interval& interval: resource.lifetime )
+            out << " " << interval.begin << ".." << interval.end;
+        out << "\n";
+    }
+
+    return out.str();
+}
+
+void cpulib::AddRotationLifetimes( AliasingPlanner& planner, const ResourceRotation& rotation, uint64_t bufferSize,
+                                   uint64_t alignment )
+{
+    assert( rotation.GetFramePeriod() > 0 );
+
+    const uint32_t firstResource = planner.GetResourceCount();
+    for ( uint32_t r = 0; r < rotation.GetResourceCount(); ++r )
+    {
+        const uint32_t endBuffer =
+            r + 1 < rotation.GetResourceCount() ? rotation.GetFirstBuffer( r + 1 ) : rotation.GetBufferCount();
+
+        for ( uint32_t buffer = rotation.GetFirstBuffer( r ); buffer < endBuffer; ++buffer )
+        {
+            planner.AddResource( rotation.GetResourceName( r ) + "#" +
+                                     std::to_string( buffer - rotation.GetFirstBuffer( r ) ),
+                                 bufferSize, alignment );
+        }
+    }
+
+    const uint32_t stageCount = rotation.GetStageCount();
+    const uint32_t cycleBegin = rotation.GetFirstPeriodicFrame() * stageCount;
+    const uint32_t cycleSteps = rotation.GetFramePeriod() * stageCount;
+
+    // A value lives from the stage writing it to the last stage reading it. The values written in the cycle are
+    // followed into the next one, where their reads come back as the history.
+    struct Value
+    {
+        uint32_t buffer;
+        uint32_t write;
+        uint32_t lastUse;
+    };
+
+    std::vector<Value> values;
+    std::vector<int>   contents( rotation.GetBufferCount(), -1 );
+
+    const uint32_t numFrames = rotation.GetFirstPeriodicFrame() + 2 * rotation.GetFramePeriod();
+    for ( uint32_t f = 0; f < numFrames; ++f )
+    {
+        const bool record = f < rotation.GetFirstPeriodicFrame() + rotation.GetFramePeriod();
+
+        for ( uint32_t s = 0; s < stageCount; ++s )
+        {
+            const uint32_t step = f * stageCount + s;
+
+            for ( const ResourceRotation::StageAccess& access: rotation.GetStageAccesses( s ) )
+            {
+                const uint32_t buffer = rotation.GetBuffer( f, s, access.slot );
+                const bool     read   = access.access == SlotAccess::Read || access.access == SlotAccess::ReadHistory;
+
+                if ( read && contents[buffer] >= 0 )
+                    values[contents[buffer]].lastUse = step;
+            }
+
+            for ( const ResourceRotation::StageAccess& access: rotation.GetStageAccesses( s ) )
+            {
+                if ( access.access != SlotAccess::Write && access.access != SlotAccess::WriteHistory )
+                    continue;
+
+                const uint32_t buffer = rotation.GetBuffer( f, s, access.slot );
+                if ( record )
+                {
+                    contents[buffer] = static_cast<int>( values.size() );
+                    values.push_back( { buffer, step, step } );
+                }
+                else
+                {
+                    // The next cycle only repeats what is recorded already.
+                    contents[buffer] = -1;
+                }
+            }
+        }
+    }
+
+    for ( const Value& value: values )
+    {
+        const uint32_t resource = firstResource + value.buffer;
+        if ( value.lastUse < cycleBegin + cycleSteps )
+        {
+            planner.AddLifetime( resource, value.write, value.lastUse );
+        }
+        else if ( value.lastUse - cycleSteps >= value.write )
+        {
+            // Alive for a whole cycle.
+            planner.AddLifetime( resource, cycleBegin, cycleBegin + cycleSteps - 1 );
+        }
+        else
+        {
+            planner.AddLifetime( resource, value.write, cycleBegin + cycleSteps - 1 );
+            planner.AddLifetime( resource, cycleBegin, value.lastUse - cycleSteps );
+        }
+    }
+}
@@ -0,0 +1,1039 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/Bvh.h>
+
+#include <cpulib/ThreadPool.h>
+#include <cpulib/VertexCodec.h>
+
+using namespace cpulib;
+
+namespace
+{
+
+const uint32_t MAX_BINS = 64;
+// Ranges at least this long are bounded and binned in parallel chunks of this size.
+const uint32_t PARALLEL_CHUNK = 16 * 1024;
+
+struct Bounds
+{
+    float3 lower = float3( std::numeric_limits<float>::max() );
+    float3 upper = float3( -std::numeric_limits<float>::max() );
+
+    void Grow( float3 p )
+    {
+        lower = min( lower, p );
+        upper = max( upper, p );
+    }
+
+    void Grow( const Bounds& b )
+    {
+        lower = min( lower, b.lower );
+        upper = max( upper, b.upper );
+    }
+
+    float Area() const
+    {
+        if ( upper.x < lower.x )
+        {
+            return 0.0f;
+        }
+        const float3 size = upper - lower;
+        return 2.0f * ( size.x * size.y + size.y * size.z + size.z * size.x );
+    }
+};
+
+struct Bin
+{
+    Bounds   bounds;
+    uint32_t count;
+};
+
+struct Binning
+{
+    // Only the first binCount of each axis are used, and cleared.
+    Bin bins[3][MAX_BINS];
+
+    explicit Binning( uint32_t binCount )
+    {
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            for ( uint32_t b = 0; b < binCount; ++b )
+            {
+                bins[axis][b] = Bin { Bounds(), 0 };
+            }
+        }
+    }
+
+    void Merge( const Binning& other, uint32_t binCount )
+    {
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            for ( uint32_t b = 0; b < binCount; ++b )
+            {
+                bins[axis][b].bounds.Grow( other.bins[axis][b].bounds );
+                bins[axis][b].count += other.bins[axis][b].count;
+            }
+        }
+    }
+};
+
+// A range of refs still to be split, with the bounds of its triangles and of their centers.
+struct Work
+{
+    uint32_t node;
+    uint32_t begin;
+    uint32_t end;
+    Bounds   bounds;
+    Bounds   centroids;
+};
+
+// The bounds of a triangle with its index, kept together so the passes over a node read them in order.
+struct PrimRef
+{
+    Bounds   bounds;
+    uint32_t triangle;
+
+    // Twice the centroid, the same bins either way.
+    float3 Center() const
+    {
+        return bounds.lower + bounds.upper;
+    }
+};
+
+struct Context
+{
+    const BvhBuildOptions& options;
+    uint32_t               binCount;
+
+    std::vector<PrimRef> refs;
+};
+
+// Maps centroids to bins, the same for binning and partitioning.
+struct BinMapping
+{
+    float3 origin;
+    float3 scale;
+
+    BinMapping( const Bounds& centroids, uint32_t binCount )
+    : origin( centroids.lower )
+    {
+        const float3 extent = centroids.upper - centroids.lower;
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            scale[axis] = extent[axis] > 0.0f ? binCount * 0.99999f / extent[axis] : 0.0f;
+        }
+    }
+
+    uint32_t Get( float3 centroid, int axis, uint32_t binCount ) const
+    {
+        const float bin = ( centroid[axis] - origin[axis] ) * scale[axis];
+        return std::min( static_cast<uint32_t>( std::max( bin, 0.0f ) ), binCount - 1 );
+    }
+};
+
+void BoundRange( const Context& context, uint32_t begin, uint32_t end, Bounds& bounds, Bounds& centroids )
+{
+    for ( uint32_t i = begin; i < end; ++i )
+    {
+        const PrimRef& ref = context.refs[i];
+        bounds.Grow( ref.bounds );
+        centroids.Grow( ref.Center() );
+    }
+}
+
+void BinRange( const Context& context, const BinMapping& mapping, uint32_t begin, uint32_t end, Binning& binning )
+{
+    for ( uint32_t i = begin; i < end; ++i )
+    {
+        const PrimRef& ref    = context.refs[i];
+        const float3   center = ref.Center();
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            Bin& bin = binning.bins[axis][mapping.Get( center, axis, context.binCount )];
+            bin.bounds.Grow( ref.bounds );
+            ++bin.count;
+        }
+    }
+}
+
+// Split [begin, end) into chunks, run func on each, in parallel if pool is given, and return the chunk count.
+template<typename Func>
+uint32_t ForChunks( ThreadPool* pool, uint32_t begin, uint32_t end, Func func )
+{
+    const uint32_t chunks = pool ? ( end - begin + PARALLEL_CHUNK - 1 ) / PARALLEL_CHUNK : 1;
+    if ( chunks <= 1 )
+    {
+        func( 0, begin, end );
+        return 1;
+    }
+
+    pool->ParallelFor( chunks, [&]( uint32_t chunk ) {
+        const uint32_t chunkBegin = begin + chunk * PARALLEL_CHUNK;
+        func( chunk, chunkBegin, std::min( chunkBegin + PARALLEL_CHUNK, end ) );
+    } );
+    return chunks;
+}
+
+void BoundWork( const Context& context, ThreadPool* pool, Work& work )
+{
+    work.bounds    = Bounds();
+    work.centroids = Bounds();
+    if ( !pool || work.end - work.begin <= PARALLEL_CHUNK )
+    {
+        BoundRange( context, work.begin, work.end, work.bounds, work.centroids );
+        return;
+    }
+
+    std::vector<Bounds> bounds( ( work.end - work.begin ) / PARALLEL_CHUNK + 1 );
+    std::vector<Bounds> centroids( bounds.size() );
+
+    const uint32_t chunks = ForChunks( pool, work.begin, work.end, [&]( uint32_t chunk, uint32_t begin, uint32_t end ) {
+        BoundRange( context, begin, end, bounds[chunk], centroids[chunk] );
+    } );
+
+    for ( uint32_t chunk = 0; chunk < chunks; ++chunk )
+    {
+        work.bounds.Grow( bounds[chunk] );
+        work.centroids.Grow( centroids[chunk] );
+    }
+}
+
+// Bin into binning, which starts out empty.
+void BinWork( const Context& context, ThreadPool* pool, const Work& work, const BinMapping& mapping,
+              Binning& binning )
+{
+    if ( !pool || work.end - work.begin <= PARALLEL_CHUNK )
+    {
+        BinRange( context, mapping, work.begin, work.end, binning );
+        return;
+    }
+
+    std::vector<Binning> chunkBinnings( ( work.end - work.begin ) / PARALLEL_CHUNK + 1, Binning( context.binCount ) );
+
+    const uint32_t chunks = ForChunks( pool, work.begin, work.end, [&]( uint32_t chunk, uint32_t begin, uint32_t end ) {
+        BinRange( context, mapping, begin, end, chunkBinnings[chunk] );
+    } );
+
+    for ( uint32_t chunk = 0; chunk < chunks; ++chunk )
+    {
+        binning.Merge( chunkBinnings[chunk], context.binCount );
+    }
+}
+
+// How a node was split: at mid, with the two halves ready to split further. Leaf if mid is 0.
+struct Split
+{
+    uint32_t mid = 0;
+    Work     left;
+    Work     right;
+};
+
+// Split work where the SAH is lowest, or leave it a leaf. With a pool the large ranges are binned in parallel.
+Split SplitWork( Context& context, ThreadPool* pool, const Work& work )
+{
+    const BvhBuildOptions& options = context.options;
+    const uint32_t         count   = work.end - work.begin;
+
+    Split split;
+    if ( count <= 1 )
+    {
+        return split;
+    }
+
+    const float3 extent = work.centroids.upper - work.centroids.lower;
+    if ( extent.x <= 0.0f && extent.y <= 0.0f && extent.z <= 0.0f )
+    {
+        // Every centroid in one point, no plane separates them: halve the range if it is too large for a leaf.
+        if ( count <= options.maxLeafSize )
+        {
+            return split;
+        }
+        split.mid = work.begin + count / 2;
+    }
+    else
+    {
+        const BinMapping mapping( work.centroids, context.binCount );
+
+        Binning binning( context.binCount );
+        BinWork( context, pool, work, mapping, binning );
+
+        // The left side takes the bins up to and including bestBin.
+        float    bestCost = std::numeric_limits<float>::max();
+        int      bestAxis = -1;
+        uint32_t bestBin  = 0;
+
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            if ( extent[axis] <= 0.0f )
+            {
+                continue;
+            }
+
+            const Bin* bins = binning.bins[axis];
+
+            float rightCost[MAX_BINS];
+            Bounds   right;
+            uint32_t rightCount = 0;
+            for ( uint32_t b = context.binCount - 1; b > 0; --b )
+            {
+                right.Grow( bins[b].bounds );
+                rightCount += bins[b].count;
+                rightCost[b - 1] = right.Area() * rightCount;
+            }
+
+            Bounds   left;
+            uint32_t leftCount = 0;
+            for ( uint32_t b = 0; b + 1 < context.binCount; ++b )
+            {
+                left.Grow( bins[b].bounds );
+                leftCount += bins[b].count;
+
+                if ( leftCount == 0 || leftCount == count )
+                {
+                    continue;
+                }
+
+                const float cost = left.Area() * leftCount + rightCost[b];
+                if ( cost < bestCost )
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin  = b;
+                }
+            }
+        }
+
+        const float area      = work.bounds.Area();
+        const float leafCost  = options.intersectionCost * count;
+        const float splitCost = bestAxis < 0 ? std::numeric_limits<float>::max()
+                                             : options.traversalCost +
+                                                   options.intersectionCost * bestCost / std::max( area, 1e-30f );
+
+        if ( count <= options.maxLeafSize && leafCost <= splitCost )
+        {
+            return split;
+        }
+
+        if ( bestAxis < 0 )
+        {
+            split.mid = work.begin + count / 2;
+        }
+        else
+        {
+            auto iter = std::partition( context.refs.begin() + work.begin, context.refs.begin() + work.end,
+                                        [&]( const PrimRef& ref ) {
+                                            return mapping.Get( ref.Center(), bestAxis, context.binCount ) <= bestBin;
+                                        } );
+            split.mid = static_cast<uint32_t>( iter - context.refs.begin() );
+        }
+    }
+
+    split.left.begin  = work.begin;
+    split.left.end    = split.mid;
+    split.right.begin = split.mid;
+    split.right.end   = work.end;
+    BoundWork( context, pool, split.left );
+    BoundWork( context, pool, split.right );
+    return split;
+}
+
+// Build the whole subtree of work on this thread. nodes[0] is its root, the children indices are into nodes.
+void BuildSubtree( Context& context, const Work& root, std::vector<BvhNode>& nodes )
+{
+    nodes.clear();
+    nodes.push_back( BvhNode() );
+
+    std::vector<Work> stack;
+    stack.push_back( root );
+    stack.back().node = 0;
+
+    while ( !stack.empty() )
+    {
+        const Work work = stack.back();
+        stack.pop_back();
+
+        const Split split = SplitWork( context, nullptr, work );
+
+        BvhNode& node = nodes[work.node];
+        node.lower    = work.bounds.lower;
+        node.upper    = work.bounds.upper;
+
+        if ( split.mid == 0 )
+        {
+            node.first = work.begin;
+            node.count = work.end - work.begin;
+            continue;
+        }
+
+        const uint32_t left = static_cast<uint32_t>( nodes.size() );
+        node.first          = left;
+        node.count          = 0;
+        nodes.resize( nodes.size() + 2 );
+
+        // Left on top, so its subtree follows it in nodes.
+        stack.push_back( split.right );
+        stack.back().node = left + 1;
+        stack.push_back( split.left );
+        stack.back().node = left;
+    }
+}
+
+double Seconds( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+}
+
+float NodeArea( const BvhNode& node )
+{
+    Bounds bounds;
+    bounds.lower = node.lower;
+    bounds.upper = node.upper;
+    return bounds.Area();
+}
+
+// The SAH cost of the subtree of every node over the area of the node, bottom up as children follow their parent.
+void ComputeSubtreeCosts( const std::vector<BvhNode>& nodes, const BvhBuildOptions& options,
+                          std::vector<float>& costs )
+{
+    std::vector<double> subtreeCosts( nodes.size() );
+    costs.resize( nodes.size() );
+
+    for ( size_t i = nodes.size(); i-- > 0; )
+    {
+        const BvhNode& node = nodes[i];
+        const double   area = NodeArea( node );
+
+        subtreeCosts[i] = node.IsLeaf() ? area * options.intersectionCost * node.count
+                                        : area * options.traversalCost + subtreeCosts[node.first] +
+                                              subtreeCosts[node.first + 1];
+        costs[i] = static_cast<float>( subtreeCosts[i] / std::max( area, 1e-30 ) );
+    }
+}
+
+// The triangles below a node, which are in one range: the left child's are ahead of the right child's.
+void GetSubtreeRange( const std::vector<BvhNode>& nodes, uint32_t index, uint32_t& begin, uint32_t& end )
+{
+    uint32_t first = index;
+    while ( !nodes[first].IsLeaf() )
+    {
+        first = nodes[first].first;
+    }
+
+    uint32_t last = index;
+    while ( !nodes[last].IsLeaf() )
+    {
+        last = nodes[last].first + 1;
+    }
+
+    begin = nodes[first].first;
+    end   = nodes[last].first + nodes[last].count;
+}
+
+}  // namespace
+
+void cpulib::GatherTriangles( const std::vector<MeshGeometry>& meshes, std::vector<BvhTriangle>& triangles,
+                              std::vector<BvhPrimitive>& primitives )
+{
+    triangles.clear();
+    primitives.clear();
+
+    for ( uint32_t m = 0; m < meshes.size(); ++m )
+    {
+        const MeshGeometry& mesh   = meshes[m];
+        const size_t        stride = mesh.packed ? sizeof( PackedVertex ) : sizeof( FullVertex );
+        const uint8_t*      base   = static_cast<const uint8_t*>( mesh.vertices );
+
+        // Both vertex layouts start with the position.
+        auto position = [&]( uint32_t index ) {
+            const uint32_t vertex = mesh.indexSize == sizeof( uint16_t )
+                                        ? static_cast<const uint16_t*>( mesh.indices )[index]
+                                        : static_cast<const uint32_t*>( mesh.indices )[index];
+            float3 p;
+            std::memcpy( &p, base + vertex * stride, sizeof( float3 ) );
+            return p;
+        };
+
+        for ( uint32_t t = 0; t < mesh.indexCount / 3; ++t )
+        {
+            triangles.push_back( { position( 3 * t ), position( 3 * t + 1 ), position( 3 * t + 2 ) } );
+            primitives.push_back( { m, t } );
+        }
+    }
+}
+
+BvhBuildStats Bvh::Build( ThreadPool& pool, const std::vector<MeshGeometry>& meshes, const BvhBuildOptions& options )
+{
+    std::vector<BvhTriangle>  triangles;
+    std::vector<BvhPrimitive> primitives;
+    GatherTriangles( meshes, triangles, primitives );
+
+    return Build( pool, triangles, primitives, options );
+}
+
+BvhBuildStats Bvh::Build( ThreadPool& pool, const std::vector<BvhTriangle>& triangles,
+                          const std::vector<BvhPrimitive>& primitives, const BvhBuildOptions& options )
+{
+    assert( triangles.size() == primitives.size() );
+
+    const auto start = std::chrono::steady_clock::now();
+
+    Clear();
+    m_Options = options;
+
+    BvhBuildStats  stats;
+    const uint32_t count = static_cast<uint32_t>( triangles.size() );
+    stats.triangles      = count;
+    if ( count == 0 )
+    {
+        return stats;
+    }
+
+    Context context { options, std::min( std::max( options.binCount, 2u ), MAX_BINS ), {} };
+    context.refs.resize( count );
+
+    ForChunks( &pool, 0, count, [&]( uint32_t, uint32_t begin, uint32_t end ) {
+        for ( uint32_t i = begin; i < end; ++i )
+        {
+            PrimRef& ref = context.refs[i];
+            ref.bounds   = Bounds();
+            ref.bounds.Grow( triangles[i].v0 );
+            ref.bounds.Grow( triangles[i].v1 );
+            ref.bounds.Grow( triangles[i].v2 );
+            ref.triangle = i;
+        }
+    } );
+
+    // Not from the thread count, so the tree comes out the same on any machine. A few hundred tasks keep every
+    // thread busy to the end.
+    const uint32_t threads  = pool.GetThreadCount();
+    const uint32_t taskSize = std::max( options.taskSize > 0 ? options.taskSize : count / 256,
+                                        std::max( options.maxLeafSize + 1, 1024u ) );
+
+    // The top levels, a level at a time. A level of fewer nodes than threads splits them one by one and bins each in
+    // parallel, a wider one splits them side by side. Nodes small enough become tasks.
+    Work root;
+    root.node  = 0;
+    root.begin = 0;
+    root.end   = count;
+    BoundWork( context, &pool, root );
+
+    m_Nodes.push_back( BvhNode() );
+
+    std::vector<Work> level = { root };
+    std::vector<Work> tasks;
+
+    while ( !level.empty() )
+    {
+        // Decided before the splits, the bits of a vector<bool> share words and can't be written from several threads.
+        std::vector<Split> splits( level.size() );
+        std::vector<bool>  isTask( level.size() );
+        for ( uint32_t i = 0; i < level.size(); ++i )
+        {
+            isTask[i] = level[i].end - level[i].begin <= taskSize;
+        }
+
+        auto split = [&]( uint32_t i, ThreadPool* binPool ) {
+            if ( !isTask[i] )
+            {
+                splits[i] = SplitWork( context, binPool, level[i] );
+            }
+        };
+
+        if ( level.size() < threads )
+        {
+            for ( uint32_t i = 0; i < level.size(); ++i )
+            {
+                split( i, &pool );
+            }
+        }
+        else
+        {
+            pool.ParallelFor( static_cast<uint32_t>( level.size() ), [&]( uint32_t i ) { split( i, nullptr ); } );
+        }
+
+        std::vector<Work> next;
+        for ( uint32_t i = 0; i < level.size(); ++i )
+        {
+            const Work& work = level[i];
+            if ( isTask[i] )
+            {
+                tasks.push_back( work );
+                continue;
+            }
+
+            BvhNode& node = m_Nodes[work.node];
+            node.lower    = work.bounds.lower;
+            node.upper    = work.bounds.upper;
+
+            if ( splits[i].mid == 0 )
+            {
+                node.first = work.begin;
+                node.count = work.end - work.begin;
+                continue;
+            }
+
+            const uint32_t left = static_cast<uint32_t>( m_Nodes.size() );
+            m_Nodes[work.node].first = left;
+            m_Nodes[work.node].count = 0;
+            m_Nodes.resize( m_Nodes.size() + 2 );
+
+            next.push_back( splits[i].left );
+            next.back().node = left;
+            next.push_back( splits[i].right );
+            next.back().node = left + 1;
+        }
+        level.swap( next );
+    }
+
+    stats.topSeconds = Seconds( start );
+    stats.tasks      = static_cast<uint32_t>( tasks.size() );
+
+    // The largest subtrees first, so the last ones to finish are small.
+    std::vector<uint32_t> order( tasks.size() );
+    std::iota( order.begin(), order.end(), 0u );
+    std::stable_sort( order.begin(), order.end(), [&]( uint32_t a, uint32_t b ) {
+        return tasks[a].end - tasks[a].begin > tasks[b].end - tasks[b].begin;
+    } );
+
+    std::vector<std::vector<BvhNode>> subtrees( tasks.size() );
+    pool.ParallelFor( static_cast<uint32_t>( tasks.size() ),
+                      [&]( uint32_t i ) { BuildSubtree( context, tasks[order[i]], subtrees[order[i]] ); } );
+
+    // Every subtree after the top levels, in the order of the tasks, its root in the place of the task's node.
+    for ( size_t t = 0; t < tasks.size(); ++t )
+    {
+        const std::vector<BvhNode>& subtree = subtrees[t];
+        const uint32_t              offset  = static_cast<uint32_t>( m_Nodes.size() ) - 1;
+
+        for ( size_t i = 0; i < subtree.size(); ++i )
+        {
+            BvhNode node = subtree[i];
+            if ( !node.IsLeaf() )
+            {
+                node.first += offset;
+            }
+
+            if ( i == 0 )
+            {
+                m_Nodes[tasks[t].node] = node;
+            }
+            else
+            {
+                m_Nodes.push_back( node );
+            }
+        }
+    }
+
+    // The triangles in the order of the leaves.
+    m_Triangles.resize( count );
+    m_Primitives.resize( count );
+    m_Order.resize( count );
+    ForChunks( &pool, 0, count, [&]( uint32_t, uint32_t begin, uint32_t end ) {
+        for ( uint32_t i = begin; i < end; ++i )
+        {
+            m_Triangles[i]  = triangles[context.refs[i].triangle];
+            m_Primitives[i] = primitives[context.refs[i].triangle];
+            m_Order[i]      = context.refs[i].triangle;
+        }
+    } );
+
+    stats.seconds = Seconds( start );
+
+    // Walk the tree for the rest.
+    std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 1 } };
+    while ( !stack.empty() )
+    {
+        const auto [index, depth] = stack.back();
+        stack.pop_back();
+
+        const BvhNode& node = m_Nodes[index];
+        stats.maxDepth      = std::max( stats.maxDepth, depth );
+        if ( node.IsLeaf() )
+        {
+            ++stats.leaves;
+            continue;
+        }
+        stack.push_back( { node.first, depth + 1 } );
+        stack.push_back( { node.first + 1, depth + 1 } );
+    }
+
+    // What Update measures the degradation of the subtrees against.
+    ComputeSubtreeCosts( m_Nodes, options, m_BuiltCosts );
+    m_BuiltSahCost = m_BuiltCosts[0];
+
+    stats.nodes       = static_cast<uint32_t>( m_Nodes.size() );
+    stats.sahCost     = m_BuiltSahCost;
+    stats.memoryBytes = m_Nodes.size() * ( sizeof( BvhNode ) + sizeof( float ) ) +
+                        m_Triangles.size() * ( sizeof( BvhTriangle ) + sizeof( BvhPrimitive ) + sizeof( uint32_t ) );
+    return stats;
+}
+
+BvhUpdateStats Bvh::Update( ThreadPool& pool, const std::vector<BvhTriangle>& triangles,
+                            const BvhUpdateOptions& options )
+{
+    assert( triangles.size() == m_Triangles.size() );
+
+    const auto start = std::chrono::steady_clock::now();
+
+    BvhUpdateStats stats;
+    const uint32_t count = static_cast<uint32_t>( m_Triangles.size() );
+    stats.triangles      = count;
+    if ( count == 0 )
+    {
+        return stats;
+    }
+
+    // The triangles and the leaves in parallel, then the inner nodes bottom up.
+    ForChunks( &pool, 0, count, [&]( uint32_t, uint32_t begin, uint32_t end ) {
+        for ( uint32_t i = begin; i < end; ++i )
+        {
+            m_Triangles[i] = triangles[m_Order[i]];
+        }
+    } );
+
+    const uint32_t nodeCount = static_cast<uint32_t>( m_Nodes.size() );
+    ForChunks( &pool, 0, nodeCount, [&]( uint32_t, uint32_t begin, uint32_t end ) {
+        for ( uint32_t i = begin; i < end; ++i )
+        {
+            BvhNode& node = m_Nodes[i];
+            if ( !node.IsLeaf() )
+            {
+                continue;
+            }
+
+            Bounds bounds;
+            for ( uint32_t t = node.first; t < node.first + node.count; ++t )
+            {
+                bounds.Grow( m_Triangles[t].v0 );
+                bounds.Grow( m_Triangles[t].v1 );
+                bounds.Grow( m_Triangles[t].v2 );
+            }
+            node.lower = bounds.lower;
+            node.upper = bounds.upper;
+        }
+    } );
+
+    for ( uint32_t i = nodeCount; i-- > 0; )
+    {
+        BvhNode& node = m_Nodes[i];
+        if ( !node.IsLeaf() )
+        {
+            node.lower = min( m_Nodes[node.first].lower, m_Nodes[node.first + 1].lower );
+            node.upper = max( m_Nodes[node.first].upper, m_Nodes[node.first + 1].upper );
+        }
+    }
+
+    stats.refitSeconds = Seconds( start );
+
+    std::vector<float> costs;
+    ComputeSubtreeCosts( m_Nodes, m_Options, costs );
+    stats.refitSahCost = costs[0];
+    stats.sahCost      = costs[0];
+
+    // The topmost degraded nodes. A node with one degraded child degraded because of it, that child is rebuilt
+    // instead. With both or neither, the split of the node itself went bad and the node is rebuilt.
+    std::vector<uint32_t> roots;
+    uint32_t              rebuiltTriangles = 0;
+    if ( options.rebuildThreshold > 0.0f )
+    {
+        auto degraded = [&]( uint32_t i ) { return costs[i] > m_BuiltCosts[i] * options.rebuildThreshold; };
+
+        std::vector<uint32_t> stack = { 0 };
+        while ( !stack.empty() )
+        {
+            const uint32_t index = stack.back();
+            stack.pop_back();
+
+            const BvhNode& node = m_Nodes[index];
+            if ( node.IsLeaf() )
+            {
+                continue;
+            }
+
+            if ( degraded( index ) && degraded( node.first ) == degraded( node.first + 1 ) )
+            {
+                uint32_t begin, end;
+                GetSubtreeRange( m_Nodes, index, begin, end );
+                roots.push_back( index );
+                rebuiltTriangles += end - begin;
+                continue;
+            }
+            stack.push_back( node.first + 1 );
+            stack.push_back( node.first );
+        }
+    }
+
+    if ( !roots.empty() )
+    {
+        const auto rebuildStart = std::chrono::steady_clock::now();
+
+        if ( rebuiltTriangles > options.fullRebuildFraction * count )
+        {
+            // From the triangles in the order they were given, so the tree is the one Build makes of them.
+            std::vector<BvhPrimitive> primitives( count );
+            for ( uint32_t i = 0; i < count; ++i )
+            {
+                primitives[m_Order[i]] = m_Primitives[i];
+            }
+
+            const BvhBuildOptions buildOptions = m_Options;
+            Build( pool, triangles, primitives, buildOptions );
+
+            stats.fullRebuild      = true;
+            stats.rebuiltSubtrees  = 1;
+            stats.rebuiltTriangles = count;
+        }
+        else
+        {
+            RebuildSubtrees( pool, roots );
+
+            stats.rebuiltSubtrees  = static_cast<uint32_t>( roots.size() );
+            stats.rebuiltTriangles = rebuiltTriangles;
+        }
+
+        stats.rebuildSeconds = Seconds( rebuildStart );
+        stats.sahCost        = ComputeSahCost( m_Options.traversalCost, m_Options.intersectionCost );
+    }
+
+    stats.builtSahCost = m_BuiltSahCost;
+    stats.seconds      = Seconds( start );
+    return stats;
+}
+
+void Bvh::RebuildSubtrees( ThreadPool& pool, const std::vector<uint32_t>& roots )
+{
+    const uint32_t binCount = std::min( std::max( m_Options.binCount, 2u ), MAX_BINS );
+
+    std::vector<std::pair<uint32_t, uint32_t>> ranges( roots.size() );
+    for ( size_t r = 0; r < roots.size(); ++r )
+    {
+        GetSubtreeRange( m_Nodes, roots[r], ranges[r].first, ranges[r].second );
+    }
+
+    // The largest subtrees first, as in Build.
+    std::vector<uint32_t> order( roots.size() );
+    std::iota( order.begin(), order.end(), 0u );
+    std::stable_sort( order.begin(), order.end(), [&]( uint32_t a, uint32_t b ) {
+        return ranges[a].second - ranges[a].first > ranges[b].second - ranges[b].first;
+    } );
+
+    // Every subtree over its own range of the triangles, the ranges don't overlap.
+    std::vector<std::vector<BvhNode>> subtrees( roots.size() );
+    pool.ParallelFor( static_cast<uint32_t>( roots.size() ), [&]( uint32_t i ) {
+        const uint32_t r     = order[i];
+        const uint32_t begin = ranges[r].first;
+        const uint32_t count = ranges[r].second - begin;
+
+        Context context { m_Options, binCount, {} };
+        context.refs.resize( count );
+        for ( uint32_t k = 0; k < count; ++k )
+        {
+            const BvhTriangle& triangle = m_Triangles[begin + k];
+
+            PrimRef& ref = context.refs[k];
+            ref.bounds   = Bounds();
+            ref.bounds.Grow( triangle.v0 );
+            ref.bounds.Grow( triangle.v1 );
+            ref.bounds.Grow( triangle.v2 );
+            ref.triangle = begin + k;
+        }
+
+        Work work;
+        work.node  = 0;
+        work.begin = 0;
+        work.end   = count;
+        BoundWork( context, nullptr, work );
+        BuildSubtree( context, work, subtrees[r] );
+
+        for ( BvhNode& node: subtrees[r] )
+        {
+            if ( node.IsLeaf() )
+            {
+                node.first += begin;
+            }
+        }
+
+        // The range in the order of the new leaves.
+        std::vector<BvhTriangle>  triangles( count );
+        std::vector<BvhPrimitive> primitives( count );
+        std::vector<uint32_t>     inputOrder( count );
+        for ( uint32_t k = 0; k < count; ++k )
+        {
+            const uint32_t source = context.refs[k].triangle;
+            triangles[k]          = m_Triangles[source];
+            primitives[k]         = m_Primitives[source];
+            inputOrder[k]         = m_Order[source];
+        }
+        std::copy( triangles.begin(), triangles.end(), m_Triangles.begin() + begin );
+        std::copy( primitives.begin(), primitives.end(), m_Primitives.begin() + begin );
+        std::copy( inputOrder.begin(), inputOrder.end(), m_Order.begin() + begin );
+    } );
+
+    // The tree again depth first, with the new subtrees in place of the old ones, so the children stay next to each
+    // other and behind their parent. The nodes of the new subtrees get the cost they were built with once complete.
+    std::vector<int32_t> subtreeOf( m_Nodes.size(), -1 );
+    for ( size_t r = 0; r < roots.size(); ++r )
+    {
+        subtreeOf[roots[r]] = static_cast<int32_t>( r );
+    }
+
+    struct Item
+    {
+        // Into m_Nodes, or into subtrees[subtree].
+        uint32_t source;
+        int32_t  subtree;
+        uint32_t target;
+    };
+
+    std::vector<BvhNode> nodes( 1 );
+    std::vector<float>   builtCosts( 1 );
+    nodes.reserve( m_Nodes.size() );
+    builtCosts.reserve( m_Nodes.size() );
+
+    std::vector<Item> stack = { { 0, -1, 0 } };
+    while ( !stack.empty() )
+    {
+        Item item = stack.back();
+        stack.pop_back();
+
+        if ( item.subtree < 0 && subtreeOf[item.source] >= 0 )
+        {
+            item.subtree = subtreeOf[item.source];
+            item.source  = 0;
+        }
+
+        BvhNode node            = item.subtree < 0 ? m_Nodes[item.source] : subtrees[item.subtree][item.source];
+        builtCosts[item.target] = item.subtree < 0 ? m_BuiltCosts[item.source] : -1.0f;
+
+        if ( !node.IsLeaf() )
+        {
+            const uint32_t left = static_cast<uint32_t>( nodes.size() );
+            nodes.resize( nodes.size() + 2 );
+            builtCosts.resize( builtCosts.size() + 2 );
+
+            // Left on top, so its subtree follows it.
+            stack.push_back( { node.first + 1, item.subtree, left + 1 } );
+            stack.push_back( { node.first, item.subtree, left } );
+            node.first = left;
+        }
+        nodes[item.target] = node;
+    }
+
+    std::vector<float> costs;
+    ComputeSubtreeCosts( nodes, m_Options, costs );
+    for ( size_t i = 0; i < nodes.size(); ++i )
+    {
+        if ( builtCosts[i] < 0.0f )
+        {
+            builtCosts[i] = costs[i];
+        }
+    }
+
+    m_Nodes.swap( nodes );
+    m_BuiltCosts.swap( builtCosts );
+}
+
+void Bvh::Clear()
+{
+    m_Nodes.clear();
+    m_Triangles.clear();
+    m_Primitives.clear();
+    m_Order.clear();
+    m_BuiltCosts.clear();
+    m_BuiltSahCost = 0;
+}
+
+float Bvh::ComputeSahCost( float traversalCost, float intersectionCost ) const
+{
+    if ( m_Nodes.empty() )
+    {
+        return 0.0f;
+    }
+
+    double cost = 0.0;
+    for ( const BvhNode& node: m_Nodes )
+    {
+        cost += static_cast<double>( NodeArea( node ) ) * ( node.IsLeaf() ? intersectionCost * node.count
+                                                                           : traversalCost );
+    }
+
+    return static_cast<float>( cost / std::max( static_cast<double>( NodeArea( m_Nodes[0] ) ), 1e-30 ) );
+}
+
+bool Bvh::Validate( std::string* error ) const
+{
+    auto fail = [&]( const std::string& message ) {
+        if ( error )
+        {
+            *error = message;
+        }
+        return false;
+    };
+
+    auto contains = []( const BvhNode& node, float3 p ) {
+        return p.x >= node.lower.x && p.y >= node.lower.y && p.z >= node.lower.z && p.x <= node.upper.x &&
+               p.y <= node.upper.y && p.z <= node.upper.z;
+    };
+
+    if ( m_Nodes.empty() )
+    {
+        return m_Triangles.empty() || fail( std::to_string( m_Triangles.size() ) + " triangles without nodes" );
+    }
+
+    std::vector<uint8_t>  covered( m_Triangles.size(), 0 );
+    std::vector<uint32_t> stack   = { 0 };
+    uint32_t              visited = 0;
+
+    while ( !stack.empty() )
+    {
+        const uint32_t index = stack.back();
+        stack.pop_back();
+
+        if ( ++visited > m_Nodes.size() )
+        {
+            return fail( "the nodes form a cycle" );
+        }
+
+        const BvhNode& node = m_Nodes[index];
+        if ( node.IsLeaf() )
+        {
+            if ( node.first + static_cast<uint64_t>( node.count ) > m_Triangles.size() )
+            {
+                return fail( "leaf " + std::to_string( index ) + " is out of range" );
+            }
+            for ( uint32_t t = node.first; t < node.first + node.count; ++t )
+            {
+                const BvhTriangle& triangle = m_Triangles[t];
+                if ( covered[t]++ )
+                {
+                    return fail( "triangle " + std::to_string( t ) + " is in two leaves" );
+                }
+                if ( !contains( node, triangle.v0 ) || !contains( node, triangle.v1 ) ||
+                     !contains( node, triangle.v2 ) )
+                {
+                    return fail( "leaf " + std::to_string( index ) + " doesn't bound its triangles" );
+                }
+            }
+            continue;
+        }
+
+        if ( node.first <= index || node.first + 1 >= m_Nodes.size() )
+        {
+            return fail( "node " + std::to_string( index ) + " has its children out of range" );
+        }
+        for ( uint32_t child = node.first; child < node.first + 2; ++child )
+        {
+            if ( !contains( node, m_Nodes[child].lower ) || !contains( node, m_Nodes[child].upper ) )
+            {
+                return fail( "node " + std::to_string( index ) + " doesn't bound its children" );
+            }
+            stack.push_back( child );
+        }
+    }
+
+    if ( std::find( covered.begin(), covered.end(), 0 ) != covered.end() )
+    {
+        return fail( "a triangle is in no leaf" );
+    }
+    return true;
+}
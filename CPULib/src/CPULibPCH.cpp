@@ -0,0 +1 @@
+#include "CPULibPCH.h"
@@ -0,0 +1,32 @@
+#pragma once
+
+/*
+ *  Precompiled header for the platform neutral CPU library. Keep this free of
+ *  any Windows/DirectX headers, CPULib has to build on the Linux farm too.
+ */
+
+// STL Headers
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+#include <cpulib/VectorMath.h>
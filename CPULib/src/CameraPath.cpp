@@ -0,0 +1,129 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/CameraPath.h>
+
+using namespace cpulib;
+
+namespace
+{
+
+// The axes of XMMatrixLookToLH with the Playground's up of -y.
+void GetCameraAxes( const CameraPose& pose, float3& x, float3& y, float3& z )
+{
+    const float3 up( 0.0f, -1.0f, 0.0f );
+
+    z = normalize( pose.lookAt - pose.position );
+    x = normalize( cross( up, z ) );
+    y = cross( z, x );
+}
+
+}  // namespace
+
+CameraPose cpulib::SampleCameraPath( const std::vector<CameraPose>& path, double time )
+{
+    assert( !path.empty() );
+
+    auto next = std::upper_bound( path.begin(), path.end(), time,
+                                  []( double t, const CameraPose& pose ) { return t < pose.time; } );
+    if ( next == path.begin() )
+        return path.front();
+    if ( next == path.end() )
+        return path.back();
+
+    const CameraPose& a    = *( next - 1 );
+    const CameraPose& b    = *next;
+    const float       span = static_cast<float>( b.time - a.time );
+    const float       t    = span > 0.0f ? static_cast<float>( time - a.time ) / span : 0.0f;
+
+    CameraPose pose;
+    pose.time     = time;
+    pose.position = a.position + ( b.position - a.position ) * t;
+    pose.lookAt   = a.lookAt + ( b.lookAt - a.lookAt ) * t;
+    return pose;
+}
+
+float3x4 cpulib::GetCameraPixelToWorld( const CameraPose& pose )
+{
+    float3 x, y, z;
+    GetCameraAxes( pose, x, y, z );
+
+    // The axes and the position as columns, as XMStoreFloat3x4 stores the inverse view.
+    float3x4 m;
+    for ( int i = 0; i < 3; ++i )
+    {
+        m.m[i][0] = x[i];
+        m.m[i][1] = y[i];
+        m.m[i][2] = z[i];
+        m.m[i][3] = pose.position[i];
+    }
+    return m;
+}
+
+float3x4 cpulib::GetCameraWorldToView( const CameraPose& pose )
+{
+    float3 x, y, z;
+    GetCameraAxes( pose, x, y, z );
+
+    const float3 axes[3] = { x, y, z };
+
+    float3x4 m;
+    for ( int i = 0; i < 3; ++i )
+    {
+        m.m[i][0] = axes[i].x;
+        m.m[i][1] = axes[i].y;
+        m.m[i][2] = axes[i].z;
+        m.m[i][3] = -dot( axes[i], pose.position );
+    }
+    return m;
+}
+
+bool cpulib::ReadCameraPath( const std::string& fileName, std::vector<CameraPose>& path )
+{
+    std::ifstream file( fileName );
+    if ( !file.is_open() )
+        return false;
+
+    path.clear();
+
+    std::string line;
+    while ( std::getline( file, line ) )
+    {
+        if ( line.empty() || line[0] == '#' || line[0] == '\r' )
+            continue;
+
+        std::replace( line.begin(), line.end(), ',', ' ' );
+        std::istringstream stream( line );
+
+        CameraPose pose;
+        stream >> pose.time >> pose.position.x >> pose.position.y >> pose.position.z >> pose.lookAt.x >>
+            pose.lookAt.y >> pose.lookAt.z;
+        if ( !stream )
+        {
+            // Column names ahead of the first pose.
+            if ( path.empty() )
+                continue;
+            return false;
+        }
+
+        path.push_back( pose );
+    }
+
+    return true;
+}
+
+bool cpulib::WriteCameraPath( const std::string& fileName, const std::vector<CameraPose>& path )
+{
+    std::ofstream file( fileName );
+    if ( !file.is_open() )
+        return false;
+
+    file << "time,posX,posY,posZ,lookAtX,lookAtY,lookAtZ\n";
+    file.precision( 9 );
+    for ( const CameraPose& pose: path )
+    {
+        file << pose.time << ',' << pose.position.x << ',' << pose.position.y << ',' << pose.position.z << ','
+             << pose.lookAt.x << ',' << pose.lookAt.y << ',' << pose.lookAt.z << '\n';
+    }
+
+    return static_cast<bool>( file );
+}
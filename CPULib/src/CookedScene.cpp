@@ -0,0 +1,364 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/CookedScene.h>
+
+using namespace cpulib;
+
+static uint64_t AlignUp( uint64_t value, uint64_t alignment )
+{
+    return ( value + alignment - 1 ) & ~( alignment - 1 );
+}
+
+static bool Fail( std::string* error, const std::string& message )
+{
+    if ( error )
+        *error = message;
+    return false;
+}
+
+CookedSceneWriter::CookedSceneWriter( uint32_t vertexStride )
+: m_VertexStride( vertexStride )
+{}
+
+uint32_t CookedSceneWriter::AddString( const std::string& string )
+{
+    if ( string.empty() )
+        return COOKED_NO_STRING;
+
+    auto inserted = m_StringOffsets.emplace( string, static_cast<uint32_t>( m_Strings.size() ) );
+    if ( inserted.second )
+    {
+        m_Strings += string;
+        m_Strings += '\0';
+    }
+
+    return inserted.first->second;
+}
+
+uint32_t CookedSceneWriter::AddMaterial( const CookedMaterial& material )
+{
+    m_Materials.push_back( material );
+    return static_cast<uint32_t>( m_Materials.size() - 1 );
+}
+
+uint32_t CookedSceneWriter::AddMesh( const void* vertices, uint32_t vertexCount, const void* indices,
+                                     uint32_t indexCount, uint32_t indexSize, uint32_t material,
+                                     const float aabbMin[3], const float aabbMax[3] )
+{
+    assert( indexSize == 2 || indexSize == 4 );
+
+    CookedMesh mesh = {};
+    mesh.vertexCount = vertexCount;
+    mesh.indexCount  = indexCount;
+    mesh.material    = material;
+    mesh.indexSize   = indexSize;
+    std::memcpy( mesh.aabbMin, aabbMin, sizeof( mesh.aabbMin ) );
+    std::memcpy( mesh.aabbMax, aabbMax, sizeof( mesh.aabbMax ) );
+
+    // Offsets into the data section for now, the header decides where that goes.
+    auto append = [this]( const void* blob, uint64_t size ) {
+        m_Data.resize( AlignUp( m_Data.size(), COOKED_SCENE_ALIGNMENT ) );
+        const uint64_t offset = m_Data.size();
+        m_Data.insert( m_Data.end(), static_cast<const uint8_t*>( blob ), static_cast<const uint8_t*>( blob ) + size );
+        return offset;
+    };
+
+    mesh.vertexOffset = append( vertices, static_cast<uint64_t>( vertexCount ) * m_VertexStride );
+    mesh.indexOffset  = append( indices, static_cast<uint64_t>( indexCount ) * indexSize );
+
+    m_Meshes.push_back( mesh );
+    return static_cast<uint32_t>( m_Meshes.size() - 1 );
+}
+
+uint32_t CookedSceneWriter::AddNode( uint32_t parent, const std::string& name, const float transform[16],
+                                     const uint32_t* meshes, uint32_t meshCount )
+{
+    assert( ( parent == COOKED_NO_PARENT ) == m_Nodes.empty() );
+    assert( parent == COOKED_NO_PARENT || parent < m_Nodes.size() );
+
+    CookedNode node = {};
+    std::memcpy( node.transform, transform, sizeof( node.transform ) );
+    node.parent    = parent;
+    node.name      = AddString( name );
+    node.firstMesh = static_cast<uint32_t>( m_NodeMeshes.size() );
+    node.meshCount = meshCount;
+
+    m_NodeMeshes.insert( m_NodeMeshes.end(), meshes, meshes + meshCount );
+    m_Nodes.push_back( node );
+    return static_cast<uint32_t>( m_Nodes.size() - 1 );
+}
+
+void CookedSceneWriter::Emit( const std::function<void( const void*, uint64_t )>& write ) const
+{
+    CookedSceneHeader header = {};
+    header.magic         = COOKED_SCENE_MAGIC;
+    header.version       = COOKED_SCENE_VERSION;
+    header.sourceStamp   = m_SourceStamp;
+    header.vertexStride  = m_VertexStride;
+    header.flags         = m_Flags;
+    header.meshCount     = static_cast<uint32_t>( m_Meshes.size() );
+    header.materialCount = static_cast<uint32_t>( m_Materials.size() );
+    header.nodeCount     = static_cast<uint32_t>( m_Nodes.size() );
+    header.nodeMeshCount = static_cast<uint32_t>( m_NodeMeshes.size() );
+
+    // Lay the sections out first, the mesh table needs the final data offset.
+    uint64_t offset = AlignUp( sizeof( header ), COOKED_SCENE_ALIGNMENT );
+    auto     place  = [&offset]( uint64_t size ) {
+        const uint64_t begin = offset;
+        offset               = AlignUp( offset + size, COOKED_SCENE_ALIGNMENT );
+        return begin;
+    };
+
+    header.meshOffset     = place( m_Meshes.size() * sizeof( CookedMesh ) );
+    header.materialOffset = place( m_Materials.size() * sizeof( CookedMaterial ) );
+    header.nodeOffset     = place( m_Nodes.size() * sizeof( CookedNode ) );
+    header.nodeMeshOffset = place( m_NodeMeshes.size() * sizeof( uint32_t ) );
+    header.stringSize     = m_Strings.size();
+    header.stringOffset   = place( m_Strings.size() );
+    header.dataSize       = m_Data.size();
+    header.dataOffset     = place( m_Data.size() );
+    header.fileSize       = header.dataOffset + header.dataSize;
+
+    std::vector<CookedMesh> meshes = m_Meshes;
+    for ( CookedMesh& mesh: meshes )
+    {
+        mesh.vertexOffset += header.dataOffset;
+        mesh.indexOffset += header.dataOffset;
+    }
+
+    static const uint8_t zeros[COOKED_SCENE_ALIGNMENT] = {};
+
+    uint64_t written = 0;
+    auto     section = [&]( const void* data, uint64_t size ) {
+        const uint64_t padding = AlignUp( written, COOKED_SCENE_ALIGNMENT ) - written;
+        if ( padding > 0 )
+            write( zeros, padding );
+        if ( size > 0 )
+            write( data, size );
+        written += padding + size;
+    };
+
+    section( &header, sizeof( header ) );
+    section( meshes.data(), meshes.size() * sizeof( CookedMesh ) );
+    section( m_Materials.data(), m_Materials.size() * sizeof( CookedMaterial ) );
+    section( m_Nodes.data(), m_Nodes.size() * sizeof( CookedNode ) );
+    section( m_NodeMeshes.data(), m_NodeMeshes.size() * sizeof( uint32_t ) );
+    section( m_Strings.data(), m_Strings.size() );
+    section( m_Data.data(), m_Data.size() );
+
+    assert( written == header.fileSize );
+}
+
+std::vector<uint8_t> CookedSceneWriter::Serialize() const
+{
+    std::vector<uint8_t> out;
+    Emit( [&out]( const void* data, uint64_t size ) {
+        out.insert( out.end(), static_cast<const uint8_t*>( data ), static_cast<const uint8_t*>( data ) + size );
+    } );
+    return out;
+}
+
+bool CookedSceneWriter::Write( const std::filesystem::path& fileName, std::string* error ) const
+{
+    std::filesystem::path temporary = fileName;
+    temporary += ".tmp";
+
+    {
+        std::ofstream file( temporary, std::ios::binary | std::ios::trunc );
+        if ( !file )
+            return Fail( error, "can't create " + temporary.string() );
+
+        Emit( [&file]( const void* data, uint64_t size ) {
+            file.write( static_cast<const char*>( data ), static_cast<std::streamsize>( size ) );
+        } );
+        if ( !file )
+            return Fail( error, "can't write " + temporary.string() );
+    }
+
+    std::error_code errorCode;
+    std::filesystem::rename( temporary, fileName, errorCode );
+    if ( errorCode )
+    {
+        std::filesystem::remove( temporary, errorCode );
+        return Fail( error, "can't replace " + fileName.string() );
+    }
+
+    return true;
+}
+
+// A table of count elements of elementSize at offset, inside the file and aligned.
+static bool CheckSection( const char* name, uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t size,
+                          std::string* error )
+{
+    if ( offset % COOKED_SCENE_ALIGNMENT != 0 )
+        return Fail( error, std::string( name ) + " is not aligned" );
+    if ( offset > size || count > ( size - offset ) / elementSize )
+        return Fail( error, std::string( name ) + " runs past the end of the file" );
+    return true;
+}
+
+bool cpulib::ValidateCookedScene( const void* data, uint64_t size, bool checkIndices, std::string* error )
+{
+    if ( size < sizeof( CookedSceneHeader ) )
+        return Fail( error, "too small for the header" );
+
+    const uint8_t*           bytes  = static_cast<const uint8_t*>( data );
+    const CookedSceneHeader& header = *static_cast<const CookedSceneHeader*>( data );
+
+    if ( header.magic != COOKED_SCENE_MAGIC )
+        return Fail( error, "not a cooked scene" );
+    if ( header.version != COOKED_SCENE_VERSION )
+        return Fail( error, "version " + std::to_string( header.version ) + ", expected " +
+                                std::to_string( COOKED_SCENE_VERSION ) );
+    if ( header.fileSize != size )
+        return Fail( error, "the header says " + std::to_string( header.fileSize ) + " bytes, the file has " +
+                                std::to_string( size ) );
+    if ( header.vertexStride == 0 )
+        return Fail( error, "bad vertex stride" );
+
+    if ( !CheckSection( "the mesh table", header.meshOffset, header.meshCount, sizeof( CookedMesh ), size, error ) ||
+         !CheckSection( "the material table", header.materialOffset, header.materialCount, sizeof( CookedMaterial ),
+                        size, error ) ||
+         !CheckSection( "the node table", header.nodeOffset, header.nodeCount, sizeof( CookedNode ), size, error ) ||
+         !CheckSection( "the node mesh table", header.nodeMeshOffset, header.nodeMeshCount, sizeof( uint32_t ), size,
+                        error ) ||
+         !CheckSection( "the string table", header.stringOffset, header.stringSize, 1, size, error ) ||
+         !CheckSection( "the data section", header.dataOffset, header.dataSize, 1, size, error ) )
+        return false;
+
+    const char* strings     = reinterpret_cast<const char*>( bytes + header.stringOffset );
+    auto        checkString = [&]( uint32_t offset ) {
+        if ( offset == COOKED_NO_STRING )
+            return true;
+        return offset < header.stringSize &&
+               std::memchr( strings + offset, '\0', header.stringSize - offset ) != nullptr;
+    };
+
+    // Blobs live in the data section.
+    const uint64_t dataEnd   = header.dataOffset + header.dataSize;
+    auto           checkBlob = [&]( uint64_t offset, uint64_t count, uint64_t elementSize ) {
+        return offset % COOKED_SCENE_ALIGNMENT == 0 && offset >= header.dataOffset && offset <= dataEnd &&
+               count <= ( dataEnd - offset ) / elementSize;
+    };
+
+    const CookedMesh* meshes = reinterpret_cast<const CookedMesh*>( bytes + header.meshOffset );
+    for ( uint32_t m = 0; m < header.meshCount; ++m )
+    {
+        const CookedMesh& mesh = meshes[m];
+        const std::string what = "mesh " + std::to_string( m );
+
+        if ( !checkBlob( mesh.vertexOffset, mesh.vertexCount, header.vertexStride ) )
+            return Fail( error, what + " has its vertices outside the data" );
+        if ( mesh.indexSize != 2 && mesh.indexSize != 4 )
+            return Fail( error, what + " has indices of " + std::to_string( mesh.indexSize ) + " bytes" );
+        if ( !checkBlob( mesh.indexOffset, mesh.indexCount, mesh.indexSize ) )
+            return Fail( error, what + " has its indices outside the data" );
+        if ( mesh.indexCount % 3 != 0 )
+            return Fail( error, what + " has " + std::to_string( mesh.indexCount ) + " indices, not triangles" );
+        if ( mesh.material >= header.materialCount )
+            return Fail( error, what + " uses material " + std::to_string( mesh.material ) );
+
+        for ( int i = 0; i < 3; ++i )
+        {
+            if ( !std::isfinite( mesh.aabbMin[i] ) || !std::isfinite( mesh.aabbMax[i] ) ||
+                 mesh.aabbMin[i] > mesh.aabbMax[i] )
+                return Fail( error, what + " has a bad bounding box" );
+        }
+
+        if ( checkIndices )
+        {
+            const uint8_t* indices = bytes + mesh.indexOffset;
+            for ( uint32_t i = 0; i < mesh.indexCount; ++i )
+            {
+                uint32_t index;
+                if ( mesh.indexSize == 4 )
+                {
+                    std::memcpy( &index, indices + i * 4, 4 );
+                }
+                else
+                {
+                    uint16_t index16;
+                    std::memcpy( &index16, indices + i * 2, 2 );
+                    index = index16;
+                }
+
+                if ( index >= mesh.vertexCount )
+                    return Fail( error, what + " index " + std::to_string( i ) + " is " + std::to_string( index ) +
+                                            " with " + std::to_string( mesh.vertexCount ) + " vertices" );
+            }
+        }
+    }
+
+    const CookedMaterial* materials = reinterpret_cast<const CookedMaterial*>( bytes + header.materialOffset );
+    for ( uint32_t m = 0; m < header.materialCount; ++m )
+    {
+        for ( uint32_t texture: materials[m].textures )
+        {
+            if ( !checkString( texture ) )
+                return Fail( error, "material " + std::to_string( m ) + " has a bad texture path" );
+        }
+    }
+
+    if ( header.meshCount > 0 && header.nodeCount == 0 )
+        return Fail( error, "meshes without nodes" );
+
+    const CookedNode* nodes      = reinterpret_cast<const CookedNode*>( bytes + header.nodeOffset );
+    const uint32_t*   nodeMeshes = reinterpret_cast<const uint32_t*>( bytes + header.nodeMeshOffset );
+    for ( uint32_t n = 0; n < header.nodeCount; ++n )
+    {
+        const CookedNode& node = nodes[n];
+        const std::string what = "node " + std::to_string( n );
+
+        if ( n == 0 ? node.parent != COOKED_NO_PARENT : node.parent >= n )
+            return Fail( error, what + " comes before its parent" );
+        if ( !checkString( node.name ) )
+            return Fail( error, what + " has a bad name" );
+        if ( node.firstMesh > header.nodeMeshCount || node.meshCount > header.nodeMeshCount - node.firstMesh )
+            return Fail( error, what + " has its meshes outside the node meshes" );
+
+        for ( uint32_t i = 0; i < node.meshCount; ++i )
+        {
+            if ( nodeMeshes[node.firstMesh + i] >= header.meshCount )
+                return Fail( error, what + " uses mesh " + std::to_string( nodeMeshes[node.firstMesh + i] ) );
+        }
+    }
+
+    return true;
+}
+
+bool CookedScene::Open( const std::filesystem::path& fileName, std::string* error )
+{
+    Close();
+
+    if ( !m_File.Open( fileName, error ) )
+        return false;
+
+    if ( !ValidateCookedScene( m_File.GetData(), m_File.GetSize(), false, error ) )
+    {
+        Close();
+        return false;
+    }
+
+    // The pointer fix-ups, everything else is used in place.
+    const uint8_t* data = m_File.GetData();
+    m_Header            = reinterpret_cast<const CookedSceneHeader*>( data );
+    m_Meshes            = reinterpret_cast<const CookedMesh*>( data + m_Header->meshOffset );
+    m_Materials         = reinterpret_cast<const CookedMaterial*>( data + m_Header->materialOffset );
+    m_Nodes             = reinterpret_cast<const CookedNode*>( data + m_Header->nodeOffset );
+    m_NodeMeshes        = reinterpret_cast<const uint32_t*>( data + m_Header->nodeMeshOffset );
+    m_Strings           = reinterpret_cast<const char*>( data + m_Header->stringOffset );
+
+    return true;
+}
+
+void CookedScene::Close()
+{
+    m_File.Close();
+
+    m_Header     = nullptr;
+    m_Meshes     = nullptr;
+    m_Materials  = nullptr;
+    m_Nodes      = nullptr;
+    m_NodeMeshes = nullptr;
+    m_Strings    = nullptr;
+}
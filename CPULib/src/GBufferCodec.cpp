@@ -0,0 +1,180 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/GBufferCodec.h>
+
+#include <map>
+
+using namespace cpulib;
+
+static float AngleDegrees( float3 a, float3 b )
+{
+    // Not acos of the dot product, it is off by hundredths of a degree for the nearly equal normals measured here.
+    a = normalize( a );
+    b = normalize( b );
+    return std::atan2( length( cross( a, b ) ), dot( a, b ) ) * ( 180.0f / PI );
+}
+
+static float3 UnpackNormal( const float4& packed )
+{
+    return normalize( packed.xyz() * 2.0f - float3( 1.0f ) );
+}
+
+float3 cpulib::GetCameraOrigin( const GBufferCamera& camera )
+{
+    return mul( camera.pixelToWorld, 0, 0, 0, 1 );
+}
+
+float3 cpulib::GetCameraRay( const GBufferCamera& camera, uint32_t x, uint32_t y, uint32_t width, uint32_t height )
+{
+    // As in rayGen: [0, 1] to [-1, 1], x scaled by the aspect ratio.
+    float dx = ( static_cast<float>( x ) / width ) * 2.0f - 1.0f;
+    float dy = ( static_cast<float>( y ) / height ) * 2.0f - 1.0f;
+    dx *= static_cast<float>( width ) / height;
+
+    return normalize( mul( camera.pixelToWorld, dx, dy, 1, 0 ) );
+}
+
+void cpulib::EncodeRayBuffer( const RayBuffer& frame, CompactRayBuffer& compact )
+{
+    const uint32_t width  = frame.GetWidth();
+    const uint32_t height = frame.GetHeight();
+
+    compact.colour = frame.Colour();
+    compact.normals.Resize( width, height );
+    compact.depth.Resize( width, height );
+    compact.objectMask.Resize( width, height );
+
+    // GenColour bit patterns to ids.
+    std::map<std::array<uint32_t, 3>, uint32_t> ids;
+
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        for ( uint32_t x = 0; x < width; ++x )
+        {
+            compact.normals( x, y ) = GBufferEncodeNormal( UnpackNormal( frame.Normals()( x, y ) ) );
+            compact.depth( x, y )   = frame.PosDepth()( x, y ).w;
+
+            const float4&           object = frame.ObjectMask()( x, y );
+            std::array<uint32_t, 3> key;
+            std::memcpy( key.data(), &object.x, sizeof( key ) );
+
+            auto id = ids.emplace( key, static_cast<uint32_t>( ids.size() ) ).first->second;
+            compact.objectMask( x, y ) = GBufferEncodeObject( id, object.w != 0 );
+        }
+    }
+}
+
+void cpulib::DecodeRayBuffer( const CompactRayBuffer& compact, const GBufferCamera& camera, RayBuffer& frame )
+{
+    const uint32_t width  = compact.colour.GetWidth();
+    const uint32_t height = compact.colour.GetHeight();
+    const float3   origin = GetCameraOrigin( camera );
+
+    frame.Resize( width, height );
+    frame.Colour() = compact.colour;
+
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        for ( uint32_t x = 0; x < width; ++x )
+        {
+            const float3 n = GBufferDecodeNormal( compact.normals( x, y ) );
+            frame.Normals()( x, y ) = float4( n.x * 0.5f + 0.5f, n.y * 0.5f + 0.5f, n.z * 0.5f + 0.5f, 1 );
+
+            const float  depth = compact.depth( x, y );
+            const float3 p =
+                GBufferDecodePosition( origin, GetCameraRay( camera, x, y, width, height ), depth, camera.tHitMax );
+            frame.PosDepth()( x, y ) = float4( p.x, p.y, p.z, depth );
+
+            const uint32_t object      = compact.objectMask( x, y );
+            frame.ObjectMask()( x, y ) = float4( static_cast<float>( GBufferDecodeObjectId( object ) ), 0, 0,
+                                                 GBufferDecodeObjectMask( object ) ? 1.0f : 0.0f );
+        }
+    }
+}
+
+GBufferError cpulib::MeasureRoundTrip( const RayBuffer& frame, const GBufferCamera& camera )
+{
+    CompactRayBuffer compact;
+    RayBuffer        decoded;
+    EncodeRayBuffer( frame, compact );
+    DecodeRayBuffer( compact, camera, decoded );
+
+    const uint32_t width  = frame.GetWidth();
+    const uint32_t height = frame.GetHeight();
+    const float3   origin = GetCameraOrigin( camera );
+
+    auto sameObject = []( const float4& a, const float4& b ) {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    };
+
+    GBufferError error;
+    double       normalSum   = 0;
+    double       positionSum = 0;
+    uint64_t     positions   = 0;
+
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        for ( uint32_t x = 0; x < width; ++x )
+        {
+            const float normal = AngleDegrees( UnpackNormal( frame.Normals()( x, y ) ),
+                                               UnpackNormal( decoded.Normals()( x, y ) ) );
+            error.maxNormalDegrees = std::max( error.maxNormalDegrees, normal );
+            normalSum += normal;
+
+            const float4& posDepth = frame.PosDepth()( x, y );
+            if ( posDepth.w > 0 && posDepth.w < 1 )
+            {
+                const float3 p        = posDepth.xyz();
+                const float  distance = std::max( length( p - origin ), EPSILON );
+                const float  relative = length( decoded.PosDepth()( x, y ).xyz() - p ) / distance;
+
+                error.maxPositionError = std::max( error.maxPositionError, relative );
+                positionSum += relative;
+                ++positions;
+            }
+
+            const float4& object        = frame.ObjectMask()( x, y );
+            const float4& decodedObject = decoded.ObjectMask()( x, y );
+            if ( ( object.w != 0 ) != ( decodedObject.w != 0 ) )
+                ++error.objectMismatches;
+
+            const uint32_t neighbours[2][2] = { { x + 1, y }, { x, y + 1 } };
+            for ( const auto& q: neighbours )
+            {
+                if ( q[0] < width && q[1] < height &&
+                     sameObject( object, frame.ObjectMask()( q[0], q[1] ) ) !=
+                         sameObject( decodedObject, decoded.ObjectMask()( q[0], q[1] ) ) )
+                    ++error.objectMismatches;
+            }
+        }
+    }
+
+    error.samples           = static_cast<uint64_t>( width ) * height;
+    error.meanNormalDegrees = error.samples ? static_cast<float>( normalSum / error.samples ) : 0;
+    error.meanPositionError = positions ? static_cast<float>( positionSum / positions ) : 0;
+    return error;
+}
+
+GBufferError cpulib::MeasureNormalEncoding( uint32_t count )
+{
+    GBufferError error;
+    double       sum = 0;
+
+    // Fibonacci sphere.
+    const float goldenAngle = PI * ( 3.0f - std::sqrt( 5.0f ) );
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        const float  z = 1.0f - 2.0f * ( i + 0.5f ) / count;
+        const float  r = std::sqrt( std::max( 0.0f, 1.0f - z * z ) );
+        const float  a = goldenAngle * i;
+        const float3 n( r * std::cos( a ), r * std::sin( a ), z );
+
+        const float angle      = AngleDegrees( n, GBufferDecodeNormal( GBufferEncodeNormal( n ) ) );
+        error.maxNormalDegrees = std::max( error.maxNormalDegrees, angle );
+        sum += angle;
+    }
+
+    error.samples           = count;
+    error.meanNormalDegrees = count ? static_cast<float>( sum / count ) : 0;
+    return error;
+}
@@ -0,0 +1,93 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/Image.h>
+#include <cpulib/RayBuffer.h>
+
+using namespace cpulib;
+
+static const char* s_ImageMagic = "RGBA32F";
+
+double cpulib::ColourRMSE( const ImageF4& image, const ImageF4& reference )
+{
+    assert( image.GetWidth() == reference.GetWidth() && image.GetHeight() == reference.GetHeight() );
+
+    const size_t count = image.GetPixelCount();
+    if ( count == 0 )
+        return 0;
+
+    const float4* a   = image.GetData();
+    const float4* b   = reference.GetData();
+    double        sum = 0;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        float4 d = a[i] - b[i];
+        sum += dot3( d, d );
+    }
+
+    return std::sqrt( sum / ( 3.0 * count ) );
+}
+
+bool cpulib::ReadImage( const std::string& fileName, ImageF4& image )
+{
+    std::ifstream file( fileName, std::ios::binary );
+    if ( !file.is_open() )
+        return false;
+
+    std::string magic;
+    uint32_t    width = 0, height = 0;
+    file >> magic >> width >> height;
+    if ( !file || magic != s_ImageMagic || width == 0 || height == 0 )
+        return false;
+
+    // Skip the single separator after the header.
+    file.get();
+
+    image.Resize( width, height );
+    file.read( reinterpret_cast<char*>( image.GetData() ),
+               static_cast<std::streamsize>( image.GetPixelCount() * sizeof( float4 ) ) );
+
+    return static_cast<bool>( file );
+}
+
+bool cpulib::WriteImage( const std::string& fileName, const ImageF4& image )
+{
+    std::ofstream file( fileName, std::ios::binary );
+    if ( !file.is_open() )
+        return false;
+
+    file << s_ImageMagic << ' ' << image.GetWidth() << ' ' << image.GetHeight() << '\n';
+    file.write( reinterpret_cast<const char*>( image.GetData() ),
+                static_cast<std::streamsize>( image.GetPixelCount() * sizeof( float4 ) ) );
+
+    return static_cast<bool>( file );
+}
+
+static const char* s_SlotNames[SLOT_COUNT] = { "_colour.rgba", "_normals.rgba", "_posDepth.rgba",
+                                               "_objectMask.rgba" };
+
+bool cpulib::ReadRayBuffer( const std::string& prefix, RayBuffer& buffer )
+{
+    for ( int i = 0; i < SLOT_COUNT; ++i )
+    {
+        if ( !ReadImage( prefix + s_SlotNames[i], buffer.slots[i] ) )
+            return false;
+    }
+
+    for ( int i = 1; i < SLOT_COUNT; ++i )
+    {
+        if ( buffer.slots[i].GetWidth() != buffer.GetWidth() || buffer.slots[i].GetHeight() != buffer.GetHeight() )
+            return false;
+    }
+
+    return true;
+}
+
+bool cpulib::WriteRayBuffer( const std::string& prefix, const RayBuffer& buffer )
+{
+    for ( int i = 0; i < SLOT_COUNT; ++i )
+    {
+        if ( !WriteImage( prefix + s_SlotNames[i], buffer.slots[i] ) )
+            return false;
+    }
+    return true;
+}
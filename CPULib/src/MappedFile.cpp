@@ -0,0 +1,131 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/MappedFile.h>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <Windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace cpulib;
+
+static bool Fail( std::string* error, const std::string& message )
+{
+    if ( error )
+        *error = message;
+    return false;
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open( const std::filesystem::path& fileName, std::string* error )
+{
+    Close();
+
+    HANDLE file = CreateFileW( fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+    if ( file == INVALID_HANDLE_VALUE )
+        return Fail( error, "can't open " + fileName.string() );
+
+    LARGE_INTEGER size;
+    if ( !GetFileSizeEx( file, &size ) )
+    {
+        CloseHandle( file );
+        return Fail( error, "can't get the size of " + fileName.string() );
+    }
+
+    m_File   = file;
+    m_Size   = static_cast<uint64_t>( size.QuadPart );
+    m_IsOpen = true;
+
+    // Mapping an empty file fails, there is nothing to map anyway.
+    if ( m_Size == 0 )
+        return true;
+
+    m_Mapping = CreateFileMappingW( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+    if ( m_Mapping )
+        m_Data = static_cast<const uint8_t*>( MapViewOfFile( m_Mapping, FILE_MAP_READ, 0, 0, 0 ) );
+
+    if ( !m_Data )
+    {
+        Close();
+        return Fail( error, "can't map " + fileName.string() );
+    }
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if ( m_Data )
+        UnmapViewOfFile( m_Data );
+    if ( m_Mapping )
+        CloseHandle( m_Mapping );
+    if ( m_File )
+        CloseHandle( m_File );
+
+    m_Data    = nullptr;
+    m_Mapping = nullptr;
+    m_File    = nullptr;
+    m_Size    = 0;
+    m_IsOpen  = false;
+}
+
+#else
+
+bool MappedFile::Open( const std::filesystem::path& fileName, std::string* error )
+{
+    Close();
+
+    int file = open( fileName.c_str(), O_RDONLY );
+    if ( file < 0 )
+        return Fail( error, "can't open " + fileName.string() );
+
+    struct stat status;
+    if ( fstat( file, &status ) != 0 )
+    {
+        close( file );
+        return Fail( error, "can't get the size of " + fileName.string() );
+    }
+
+    m_Size   = static_cast<uint64_t>( status.st_size );
+    m_IsOpen = true;
+
+    if ( m_Size > 0 )
+    {
+        void* data = mmap( nullptr, m_Size, PROT_READ, MAP_PRIVATE, file, 0 );
+        if ( data == MAP_FAILED )
+        {
+            close( file );
+            Close();
+            return Fail( error, "can't map " + fileName.string() );
+        }
+        m_Data = static_cast<const uint8_t*>( data );
+    }
+
+    // The mapping keeps the file alive.
+    close( file );
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if ( m_Data )
+        munmap( const_cast<uint8_t*>( m_Data ), m_Size );
+
+    m_Data   = nullptr;
+    m_Size   = 0;
+    m_IsOpen = false;
+}
+
+#endif
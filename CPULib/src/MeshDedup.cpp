@@ -0,0 +1,346 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/MeshDedup.h>
+
+#include <cpulib/ContentHash.h>
+#include <cpulib/VertexCodec.h>
+
+#include <unordered_map>
+
+using namespace cpulib;
+
+namespace
+{
+
+// Both vertex layouts start with the position.
+float3 GetPosition( const MeshGeometry& mesh, uint32_t i )
+{
+    const size_t stride = mesh.packed ? sizeof( PackedVertex ) : sizeof( FullVertex );
+
+    float3 position;
+    std::memcpy( &position, static_cast<const uint8_t*>( mesh.vertices ) + i * stride, sizeof( float3 ) );
+    return position;
+}
+
+FullVertex GetVertex( const MeshGeometry& mesh, uint32_t i )
+{
+    if ( mesh.packed )
+    {
+        PackedVertex packed;
+        std::memcpy( &packed, static_cast<const PackedVertex*>( mesh.vertices ) + i, sizeof( PackedVertex ) );
+        return UnpackVertex( packed );
+    }
+
+    FullVertex vertex;
+    std::memcpy( &vertex, static_cast<const FullVertex*>( mesh.vertices ) + i, sizeof( FullVertex ) );
+    return vertex;
+}
+
+uint32_t GetIndex( const MeshGeometry& mesh, uint32_t i )
+{
+    return mesh.indexSize == sizeof( uint16_t ) ? static_cast<const uint16_t*>( mesh.indices )[i]
+                                                : static_cast<const uint32_t*>( mesh.indices )[i];
+}
+
+uint64_t GetVertexBytes( const MeshGeometry& mesh )
+{
+    return static_cast<uint64_t>( mesh.vertexCount ) * ( mesh.packed ? sizeof( PackedVertex ) : sizeof( FullVertex ) );
+}
+
+float MaxAbs( float3 v )
+{
+    return std::max( std::abs( v.x ), std::max( std::abs( v.y ), std::abs( v.z ) ) );
+}
+
+bool Near( float3 a, float3 b, float tolerance )
+{
+    return std::abs( a.x - b.x ) <= tolerance && std::abs( a.y - b.y ) <= tolerance &&
+           std::abs( a.z - b.z ) <= tolerance;
+}
+
+// The mesh a set of copies is compared against, with its bounds.
+struct Original
+{
+    uint32_t mesh;
+    float    extent;
+    float    magnitude;
+
+    std::vector<uint32_t> copies;
+    std::vector<float3>   offsets;
+};
+
+Original MakeOriginal( const std::vector<MeshGeometry>& meshes, uint32_t mesh )
+{
+    float3 lower( std::numeric_limits<float>::max() );
+    float3 upper( -std::numeric_limits<float>::max() );
+    for ( uint32_t i = 0; i < meshes[mesh].vertexCount; ++i )
+    {
+        const float3 position = GetPosition( meshes[mesh], i );
+        lower                 = min( lower, position );
+        upper                 = max( upper, position );
+    }
+
+    Original original;
+    original.mesh      = mesh;
+    original.extent    = MaxAbs( upper - lower );
+    original.magnitude = std::max( MaxAbs( lower ), MaxAbs( upper ) );
+    original.copies.push_back( mesh );
+    original.offsets.push_back( float3( 0.0f ) );
+    return original;
+}
+
+// Whether b is a copy of the original a moved by offset. The indices are compared first, they are exact.
+bool IsCopy( const MeshGeometry& a, const Original& original, const MeshGeometry& b, const MeshDedupOptions& options,
+             float3& offset )
+{
+    if ( a.vertexCount != b.vertexCount || a.indexCount != b.indexCount )
+    {
+        return false;
+    }
+    for ( uint32_t i = 0; i < a.indexCount; ++i )
+    {
+        if ( GetIndex( a, i ) != GetIndex( b, i ) )
+        {
+            return false;
+        }
+    }
+
+    offset = GetPosition( b, 0 ) - GetPosition( a, 0 );
+
+    // Plus the rounding of the coordinates themselves, a copy far from the origin has fewer bits to spare.
+    const float positionTolerance = options.positionTolerance * original.extent +
+                                    8.0f * std::numeric_limits<float>::epsilon() *
+                                        ( original.magnitude + MaxAbs( offset ) );
+
+    for ( uint32_t i = 0; i < a.vertexCount; ++i )
+    {
+        const FullVertex u = GetVertex( a, i );
+        const FullVertex v = GetVertex( b, i );
+
+        if ( !Near( u.position + offset, v.position, positionTolerance ) ||
+             !Near( u.normal, v.normal, options.directionTolerance ) ||
+             !Near( u.tangent, v.tangent, options.directionTolerance ) ||
+             !Near( u.bitangent, v.bitangent, options.directionTolerance ) )
+        {
+            return false;
+        }
+
+        for ( int k = 0; k < 2; ++k )
+        {
+            const float scale = std::max( std::abs( u.texCoord[k] ), 1.0f );
+            if ( std::abs( u.texCoord[k] - v.texCoord[k] ) > options.texCoordTolerance * scale )
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+}  // namespace
+
+MeshInstancePlan cpulib::PlanSingleBlas( uint32_t meshCount )
+{
+    MeshInstancePlan plan;
+    plan.order.resize( meshCount );
+    std::iota( plan.order.begin(), plan.order.end(), 0u );
+    plan.slots   = plan.order;
+    plan.sources = plan.order;
+    plan.offsets.assign( meshCount, float3( 0.0f ) );
+
+    if ( meshCount > 0 )
+    {
+        plan.blases.push_back( { 0, meshCount } );
+        plan.instances.push_back( MeshInstance() );
+    }
+
+    plan.stats.meshes       = meshCount;
+    plan.stats.uniqueMeshes = meshCount;
+    return plan;
+}
+
+MeshInstancePlan cpulib::PlanMeshInstances( const std::vector<MeshGeometry>& meshes, const MeshDedupOptions& options )
+{
+    const uint32_t meshCount = static_cast<uint32_t>( meshes.size() );
+
+    // The candidates share the hash of their indices and counts, every bucket holds the originals found so far.
+    std::vector<Original>                               originals;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+    std::vector<uint32_t>                               originalOf( meshCount, ~0u );
+
+    for ( uint32_t m = 0; m < meshCount; ++m )
+    {
+        const MeshGeometry& mesh = meshes[m];
+        if ( mesh.vertexCount == 0 || mesh.indexCount / 3 < std::max( options.minInstanceTriangles, 1u ) )
+        {
+            continue;
+        }
+
+        const uint64_t seed = ( static_cast<uint64_t>( mesh.vertexCount ) << 32 ) | mesh.indexCount;
+        const uint64_t key  = HashBytes( mesh.indices, static_cast<size_t>( mesh.indexCount ) * mesh.indexSize, seed );
+
+        std::vector<uint32_t>& bucket = buckets[key];
+        for ( uint32_t o: bucket )
+        {
+            float3 offset;
+            if ( IsCopy( meshes[originals[o].mesh], originals[o], mesh, options, offset ) )
+            {
+                originals[o].copies.push_back( m );
+                originals[o].offsets.push_back( offset );
+                originalOf[m] = o;
+                break;
+            }
+        }
+
+        if ( originalOf[m] == ~0u )
+        {
+            originalOf[m] = static_cast<uint32_t>( originals.size() );
+            bucket.push_back( originalOf[m] );
+            originals.push_back( MakeOriginal( meshes, m ) );
+        }
+    }
+
+    // A mesh without copies is no original.
+    originals.erase( std::remove_if( originals.begin(), originals.end(),
+                                     []( const Original& original ) { return original.copies.size() < 2; } ),
+                     originals.end() );
+    if ( originals.empty() )
+    {
+        MeshInstancePlan plan = PlanSingleBlas( meshCount );
+        for ( const MeshGeometry& mesh: meshes )
+        {
+            plan.stats.vertexBytes += GetVertexBytes( mesh );
+            plan.stats.indexBytes += static_cast<uint64_t>( mesh.indexCount ) * mesh.indexSize;
+            plan.stats.triangles += mesh.indexCount / 3;
+        }
+        return plan;
+    }
+
+    MeshInstancePlan plan;
+    plan.slots.assign( meshCount, ~0u );
+    plan.sources.resize( meshCount );
+    plan.offsets.assign( meshCount, float3( 0.0f ) );
+
+    auto addSlot = [&]( uint32_t mesh, uint32_t source, float3 offset ) {
+        const uint32_t slot = static_cast<uint32_t>( plan.order.size() );
+        plan.order.push_back( mesh );
+        plan.slots[mesh]   = slot;
+        plan.sources[slot] = source == ~0u ? slot : source;
+        plan.offsets[slot] = offset;
+        return slot;
+    };
+
+    // The meshes without copies first, all in one BLAS.
+    std::vector<bool> instanced( meshCount, false );
+    for ( const Original& original: originals )
+    {
+        for ( uint32_t copy: original.copies )
+        {
+            instanced[copy] = true;
+        }
+    }
+    for ( uint32_t m = 0; m < meshCount; ++m )
+    {
+        if ( !instanced[m] )
+        {
+            addSlot( m, ~0u, float3( 0.0f ) );
+        }
+    }
+    if ( !plan.order.empty() )
+    {
+        plan.blases.push_back( { 0, static_cast<uint32_t>( plan.order.size() ) } );
+        plan.instances.push_back( MeshInstance() );
+    }
+
+    // Then every original with its copies, a BLAS for the original and an instance for each.
+    for ( const Original& original: originals )
+    {
+        const uint32_t blas   = static_cast<uint32_t>( plan.blases.size() );
+        const uint32_t source = addSlot( original.mesh, ~0u, float3( 0.0f ) );
+        plan.blases.push_back( { source, 1 } );
+
+        for ( size_t c = 0; c < original.copies.size(); ++c )
+        {
+            const uint32_t slot = c == 0 ? source : addSlot( original.copies[c], source, original.offsets[c] );
+
+            MeshInstance instance;
+            instance.blas      = blas;
+            instance.firstMesh = slot;
+            instance.offset    = original.offsets[c];
+            plan.instances.push_back( instance );
+        }
+    }
+
+    MeshDedupStats& stats = plan.stats;
+    stats.meshes          = meshCount;
+    for ( uint32_t slot = 0; slot < meshCount; ++slot )
+    {
+        const MeshGeometry& mesh        = meshes[plan.order[slot]];
+        const uint64_t      vertexBytes = GetVertexBytes( mesh );
+        const uint64_t      indexBytes  = static_cast<uint64_t>( mesh.indexCount ) * mesh.indexSize;
+
+        stats.vertexBytes += vertexBytes;
+        stats.indexBytes += indexBytes;
+        stats.triangles += mesh.indexCount / 3;
+
+        if ( plan.sources[slot] == slot )
+        {
+            ++stats.uniqueMeshes;
+        }
+        else
+        {
+            stats.sharedVertexBytes += vertexBytes;
+            stats.sharedIndexBytes += indexBytes;
+            stats.sharedTriangles += mesh.indexCount / 3;
+        }
+        stats.instancedMeshes += instanced[plan.order[slot]] ? 1 : 0;
+    }
+
+    return plan;
+}
+
+void cpulib::AppendMeshInstances( MeshInstancePlan& plan, const MeshInstancePlan& other )
+{
+    const uint32_t meshCount = static_cast<uint32_t>( plan.order.size() );
+    const uint32_t blasCount = static_cast<uint32_t>( plan.blases.size() );
+
+    for ( size_t i = 0; i < other.order.size(); ++i )
+    {
+        plan.order.push_back( meshCount + other.order[i] );
+        plan.slots.push_back( meshCount + other.slots[i] );
+        plan.sources.push_back( meshCount + other.sources[i] );
+        plan.offsets.push_back( other.offsets[i] );
+    }
+
+    if ( plan.blases.size() == 1 && plan.instances.size() == 1 && other.blases.size() == 1 &&
+         other.instances.size() == 1 )
+    {
+        plan.blases[0].meshCount += other.blases[0].meshCount;
+    }
+    else
+    {
+        for ( const MeshBlas& blas: other.blases )
+        {
+            plan.blases.push_back( { meshCount + blas.firstMesh, blas.meshCount } );
+        }
+        for ( MeshInstance instance: other.instances )
+        {
+            instance.blas += blasCount;
+            instance.firstMesh += meshCount;
+            plan.instances.push_back( instance );
+        }
+    }
+
+    MeshDedupStats&       stats = plan.stats;
+    const MeshDedupStats& added = other.stats;
+    stats.meshes += added.meshes;
+    stats.uniqueMeshes += added.uniqueMeshes;
+    stats.instancedMeshes += added.instancedMeshes;
+    stats.vertexBytes += added.vertexBytes;
+    stats.sharedVertexBytes += added.sharedVertexBytes;
+    stats.indexBytes += added.indexBytes;
+    stats.sharedIndexBytes += added.sharedIndexBytes;
+    stats.triangles += added.triangles;
+    stats.sharedTriangles += added.sharedTriangles;
+}
@@ -0,0 +1,260 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/MeshOptimizer.h>
+
+using namespace cpulib;
+
+// The LRU cache OptimizeVertexCache keeps the scores on, and the constants of Forsyth's paper.
+static const uint32_t CACHE_SIZE          = 32;
+static const float    CACHE_DECAY_POWER   = 1.5f;
+static const float    LAST_TRIANGLE_SCORE = 0.75f;
+static const float    VALENCE_BOOST_SCALE = 2.0f;
+static const float    VALENCE_BOOST_POWER = 0.5f;
+static const uint32_t MAX_VALENCE_SCORED  = 64;
+
+struct ScoreTables
+{
+    float cache[CACHE_SIZE + 1];
+    float valence[MAX_VALENCE_SCORED];
+
+    ScoreTables()
+    {
+        for ( uint32_t i = 0; i < CACHE_SIZE; ++i )
+        {
+            // The three vertices of the last triangle score the same, whichever order they went in.
+            cache[i] = i < 3 ? LAST_TRIANGLE_SCORE
+                             : std::pow( 1.0f - float( i - 3 ) / ( CACHE_SIZE - 3 ), CACHE_DECAY_POWER );
+        }
+        // Not in the cache.
+        cache[CACHE_SIZE] = 0;
+
+        valence[0] = 0;
+        for ( uint32_t i = 1; i < MAX_VALENCE_SCORED; ++i )
+        {
+            valence[i] = VALENCE_BOOST_SCALE * std::pow( float( i ), -VALENCE_BOOST_POWER );
+        }
+    }
+
+    float Score( uint32_t cachePosition, uint32_t liveTriangles ) const
+    {
+        // A vertex no triangle needs any more is of no use.
+        if ( liveTriangles == 0 )
+        {
+            return -1.0f;
+        }
+        return cache[cachePosition] + valence[std::min( liveTriangles, MAX_VALENCE_SCORED - 1 )];
+    }
+};
+
+VertexCacheStats cpulib::MeasureVertexCache( const uint32_t* indices, size_t indexCount, uint32_t vertexCount,
+                                             uint32_t cacheSize )
+{
+    VertexCacheStats stats;
+    if ( indexCount < 3 || vertexCount == 0 )
+    {
+        return stats;
+    }
+
+    // The time each vertex went into the FIFO, it is still in while fewer than cacheSize went in after it.
+    std::vector<uint64_t> insertedAt( vertexCount, 0 );
+    uint64_t              transformed = 0;
+
+    for ( size_t i = 0; i < indexCount; ++i )
+    {
+        const uint32_t v = indices[i];
+        if ( insertedAt[v] == 0 || transformed - insertedAt[v] >= cacheSize )
+        {
+            ++transformed;
+            insertedAt[v] = transformed;
+        }
+    }
+
+    stats.acmr = static_cast<float>( double( transformed ) / double( indexCount / 3 ) );
+    stats.atvr = static_cast<float>( double( transformed ) / double( vertexCount ) );
+    return stats;
+}
+
+void cpulib::OptimizeVertexCache( uint32_t* destination, const uint32_t* indices, size_t indexCount,
+                                  uint32_t vertexCount )
+{
+    static const ScoreTables scores;
+
+    const size_t triangleCount = indexCount / 3;
+    if ( triangleCount == 0 )
+    {
+        return;
+    }
+
+    // destination may be indices, work on a copy.
+    std::vector<uint32_t> source( indices, indices + triangleCount * 3 );
+
+    // The triangles of every vertex, as offsets into one array.
+    std::vector<uint32_t> liveTriangles( vertexCount, 0 );
+    for ( uint32_t v: source )
+    {
+        ++liveTriangles[v];
+    }
+
+    std::vector<uint32_t> firstTriangle( vertexCount + 1, 0 );
+    for ( uint32_t v = 0; v < vertexCount; ++v )
+    {
+        firstTriangle[v + 1] = firstTriangle[v] + liveTriangles[v];
+    }
+
+    std::vector<uint32_t> vertexTriangles( source.size() );
+    std::vector<uint32_t> filled( firstTriangle.begin(), firstTriangle.end() - 1 );
+    for ( size_t t = 0; t < triangleCount; ++t )
+    {
+        for ( int k = 0; k < 3; ++k )
+        {
+            const uint32_t v             = source[t * 3 + k];
+            vertexTriangles[filled[v]++] = static_cast<uint32_t>( t );
+        }
+    }
+
+    std::vector<uint32_t> cachePosition( vertexCount, CACHE_SIZE );
+    std::vector<float>    vertexScore( vertexCount );
+    for ( uint32_t v = 0; v < vertexCount; ++v )
+    {
+        vertexScore[v] = scores.Score( CACHE_SIZE, liveTriangles[v] );
+    }
+
+    std::vector<float> triangleScore( triangleCount );
+    std::vector<bool>  emitted( triangleCount, false );
+    for ( size_t t = 0; t < triangleCount; ++t )
+    {
+        triangleScore[t] =
+            vertexScore[source[t * 3]] + vertexScore[source[t * 3 + 1]] + vertexScore[source[t * 3 + 2]];
+    }
+
+    // Three spare entries for the vertices of the new triangle pushing the others out.
+    uint32_t cache[CACHE_SIZE + 3];
+    uint32_t cacheCount = 0;
+
+    size_t nextCandidate = 0;
+    size_t output        = 0;
+
+    int64_t bestTriangle = 0;
+    for ( size_t t = 1; t < triangleCount; ++t )
+    {
+        if ( triangleScore[t] > triangleScore[bestTriangle] )
+        {
+            bestTriangle = static_cast<int64_t>( t );
+        }
+    }
+
+    while ( bestTriangle >= 0 )
+    {
+        const uint32_t* triangle = &source[bestTriangle * 3];
+        destination[output++]    = triangle[0];
+        destination[output++]    = triangle[1];
+        destination[output++]    = triangle[2];
+        emitted[bestTriangle]    = true;
+
+        // Move the triangle's vertices to the front of the cache, the rest shift back.
+        uint32_t newCache[CACHE_SIZE + 3];
+        uint32_t newCount = 0;
+        for ( int k = 0; k < 3; ++k )
+        {
+            const uint32_t v = triangle[k];
+            if ( std::find( newCache, newCache + newCount, v ) == newCache + newCount )
+            {
+                newCache[newCount++] = v;
+            }
+
+            // The triangle is gone from the vertex' list.
+            uint32_t* begin = &vertexTriangles[firstTriangle[v]];
+            uint32_t* end   = begin + liveTriangles[v];
+            uint32_t* it    = std::find( begin, end, static_cast<uint32_t>( bestTriangle ) );
+            std::swap( *it, *( end - 1 ) );
+            --liveTriangles[v];
+        }
+        for ( uint32_t i = 0; i < cacheCount; ++i )
+        {
+            const uint32_t v = cache[i];
+            if ( v != triangle[0] && v != triangle[1] && v != triangle[2] )
+            {
+                newCache[newCount++] = v;
+            }
+        }
+
+        // Rescore what is in the cache, and what just fell out of it.
+        for ( uint32_t i = 0; i < newCount; ++i )
+        {
+            const uint32_t v = newCache[i];
+            cachePosition[v] = i < CACHE_SIZE ? i : CACHE_SIZE;
+
+            const float score = scores.Score( cachePosition[v], liveTriangles[v] );
+            const float delta = score - vertexScore[v];
+            vertexScore[v]    = score;
+
+            for ( uint32_t j = 0; j < liveTriangles[v]; ++j )
+            {
+                triangleScore[vertexTriangles[firstTriangle[v] + j]] += delta;
+            }
+        }
+
+        cacheCount = std::min( newCount, CACHE_SIZE );
+        std::copy( newCache, newCache + cacheCount, cache );
+
+        // The next triangle is the best one among those of the cached vertices.
+        bestTriangle    = -1;
+        float bestScore = -1.0f;
+        for ( uint32_t i = 0; i < cacheCount; ++i )
+        {
+            const uint32_t v = cache[i];
+            for ( uint32_t j = 0; j < liveTriangles[v]; ++j )
+            {
+                const uint32_t t = vertexTriangles[firstTriangle[v] + j];
+                if ( triangleScore[t] > bestScore )
+                {
+                    bestScore    = triangleScore[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        // Nothing left around the cache, start over at the next triangle in the input.
+        if ( bestTriangle < 0 )
+        {
+            while ( nextCandidate < triangleCount && emitted[nextCandidate] )
+            {
+                ++nextCandidate;
+            }
+            if ( nextCandidate < triangleCount )
+            {
+                bestTriangle = static_cast<int64_t>( nextCandidate );
+            }
+        }
+    }
+
+    assert( output == triangleCount * 3 );
+}
+
+uint32_t cpulib::OptimizeVertexFetch( uint32_t* remap, uint32_t* indices, size_t indexCount, uint32_t vertexCount )
+{
+    const uint32_t unassigned = ~0u;
+    std::fill( remap, remap + vertexCount, unassigned );
+
+    uint32_t next = 0;
+    for ( size_t i = 0; i < indexCount; ++i )
+    {
+        uint32_t& v = indices[i];
+        if ( remap[v] == unassigned )
+        {
+            remap[v] = next++;
+        }
+        v = remap[v];
+    }
+
+    const uint32_t used = next;
+    for ( uint32_t v = 0; v < vertexCount; ++v )
+    {
+        if ( remap[v] == unassigned )
+        {
+            remap[v] = next++;
+        }
+    }
+
+    return used;
+}
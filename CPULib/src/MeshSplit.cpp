@@ -0,0 +1,75 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/MeshSplit.h>
+
+using namespace cpulib;
+
+void cpulib::NarrowIndices( uint16_t* destination, const uint32_t* indices, size_t indexCount )
+{
+    for ( size_t i = 0; i < indexCount; ++i )
+    {
+        assert( indices[i] < INDEX16_MAX_VERTICES );
+        destination[i] = static_cast<uint16_t>( indices[i] );
+    }
+}
+
+std::vector<MeshCluster> cpulib::SplitMesh( const uint32_t* indices, size_t indexCount, uint32_t vertexCount,
+                                            std::vector<uint16_t>& localIndices, uint32_t maxVertices )
+{
+    assert( maxVertices >= 3 && maxVertices <= INDEX16_MAX_VERTICES );
+
+    std::vector<MeshCluster> clusters;
+    localIndices.clear();
+    localIndices.reserve( indexCount );
+
+    // The cluster every vertex was last added to, and its index there.
+    const uint32_t        none = ~0u;
+    std::vector<uint32_t> clusterOf( vertexCount, none );
+    std::vector<uint32_t> localIndex( vertexCount );
+
+    const size_t triangleCount = indexCount / 3;
+    for ( size_t t = 0; t < triangleCount; ++t )
+    {
+        const uint32_t* triangle = &indices[t * 3];
+
+        // Vertices the triangle adds, a degenerate triangle names one twice.
+        uint32_t added = 0;
+        if ( !clusters.empty() )
+        {
+            const uint32_t current = static_cast<uint32_t>( clusters.size() - 1 );
+            for ( int k = 0; k < 3; ++k )
+            {
+                const uint32_t v        = triangle[k];
+                const bool     repeated = ( k > 0 && v == triangle[0] ) || ( k > 1 && v == triangle[1] );
+                if ( clusterOf[v] != current && !repeated )
+                {
+                    ++added;
+                }
+            }
+        }
+
+        if ( clusters.empty() || clusters.back().vertices.size() + added > maxVertices )
+        {
+            MeshCluster cluster;
+            cluster.firstIndex = static_cast<uint32_t>( localIndices.size() );
+            clusters.push_back( std::move( cluster ) );
+        }
+
+        const uint32_t current = static_cast<uint32_t>( clusters.size() - 1 );
+        MeshCluster&   cluster = clusters.back();
+        for ( int k = 0; k < 3; ++k )
+        {
+            const uint32_t v = triangle[k];
+            if ( clusterOf[v] != current )
+            {
+                clusterOf[v]  = current;
+                localIndex[v] = static_cast<uint32_t>( cluster.vertices.size() );
+                cluster.vertices.push_back( v );
+            }
+            localIndices.push_back( static_cast<uint16_t>( localIndex[v] ) );
+        }
+        cluster.indexCount += 3;
+    }
+
+    return clusters;
+}
@@ -0,0 +1,1038 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/PathTracer.h>
+
+#include <cpulib/ThreadPool.h>
+#include <cpulib/VertexCodec.h>
+
+using namespace cpulib;
+
+// Pixels per tile handed to a worker, small since a pixel is a whole path.
+static const uint32_t TILE_SIZE = 16;
+
+namespace
+{
+
+enum RayMode : uint32_t
+{
+    RAY_PRIMARY   = 0,
+    RAY_SECONDARY = 1
+};
+
+/**
+ * As RayPayload, zero initialized where the shader leaves it undefined.
+ */
+struct RayPayload
+{
+    // Future Ray Specific
+    float3 reflectDir;
+    float3 lightDir;
+
+    // Current Mat Direction Specific
+    float3 colourReflect;
+    float3 colourLight;
+
+    // Current Mat Specific
+    float3 radiance;
+    float3 position;
+    float3 normal;
+
+    // For denoising
+    int   object;
+    float mask;
+
+    // Ray Properties
+    uint32_t depth;
+    uint32_t rayMode;
+    uint32_t seed;
+    // A bool in the shader too, assigned IoRs that turn it into true.
+    bool mediumIoR;
+};
+
+struct VertexAttributes
+{
+    float3 position;
+    float3 normal;
+    float3 tangent;
+    float3 bitangent;
+    float2 texCoord;
+};
+
+struct MaterialInfoBRDF
+{
+    float3 view;
+    float3 normal;
+    float3 pos;
+
+    uint32_t type;
+
+    float3 colour;
+    float  reflectivity;
+    float  roughness;
+    float  ior;
+};
+
+float rnd( uint32_t& seed )
+{
+    seed = 1664525u * seed + 1013904223u;
+    return static_cast<float>( seed & 0x00FFFFFF ) / static_cast<float>( 0x01000000 );
+}
+
+// HLSL saturate, which like the GPU's min and max takes a NaN to 0.
+float Saturate( float v )
+{
+    return std::min( std::max( 0.0f, v ), 1.0f );
+}
+
+float3 applyRotationMappingZToN( float3 N, float3 v )
+{
+    const float s = N.z >= 0.0f ? 1.0f : -1.0f;
+    v.z *= s;
+
+    const float3 h( N.x, N.y, N.z + s );
+    const float  k = dot( v, h ) / ( 1.0f + std::abs( N.z ) );
+
+    return h * k - v;
+}
+
+float3 sample_hemisphere_TrowbridgeReitzCos( float alpha2, uint32_t& seed )
+{
+    const float u = rnd( seed );
+    const float v = rnd( seed );
+
+    const float tan2theta = alpha2 * ( u / ( 1 - u ) );
+    const float cos2theta = 1 / ( 1 + tan2theta );
+    const float sinTheta  = std::sqrt( 1 - cos2theta );
+    const float phi       = PI2 * v;
+
+    return float3( sinTheta * std::cos( phi ), sinTheta * std::sin( phi ), std::sqrt( cos2theta ) );
+}
+
+float _TrowbridgeReitz( float cos2, float alpha2 )
+{
+    cos2          = std::max( cos2, EPSILON );
+    const float x = alpha2 + ( 1 - cos2 ) / cos2;
+    return alpha2 / ( PI * cos2 * cos2 * x * x );
+}
+
+float _Smith_TrowbridgeReitz( float3 wi, float3 wo, float3 wm, float3 wn, float alpha2 )
+{
+    if ( dot( wo, wm ) < 0 || dot( wi, wm ) < 0 )
+        return 0.0f;
+
+    float cos2 = std::max( dot( wn, wo ), EPSILON );
+    cos2 *= cos2;
+    const float lambda1 = 0.5f * ( -1 + std::sqrt( 1 + alpha2 * ( 1 - cos2 ) / cos2 ) );
+    cos2                = std::max( dot( wn, wi ), EPSILON );
+    cos2 *= cos2;
+    const float lambda2 = 0.5f * ( -1 + std::sqrt( 1 + alpha2 * ( 1 - cos2 ) / cos2 ) );
+    return 1 / ( 1 + lambda1 + lambda2 );
+}
+
+void _getPattern( int index, int p[3] )
+{
+    // 1 / 3 is an integer division in the shader as well, so n is always 1.
+    const int n = static_cast<int>( std::pow( static_cast<float>( index ), 1 / 3 ) );
+    index -= n * n * n;
+    p[0] = p[1] = p[2] = n;
+    if ( index != 0 )
+    {
+        index--;
+        int v = index % 3;
+        index = index / 3;
+        if ( index < n )
+        {
+            p[v] = index % n;
+        }
+        else
+        {
+            index -= n;
+            p[v]       = index / n;
+            p[++v % 3] = index % n;
+        }
+    }
+}
+
+int _getElement( int index )
+{
+    int value = index - 1;
+    int v     = 0;
+    for ( int i = 0; i < 8; i++ )
+    {
+        v = v | ( value & 1 );
+        v <<= 1;
+        value >>= 1;
+    }
+    v >>= 1;
+    return v & 0xFF;
+}
+
+uint32_t LoadIndex( const MeshGeometry& mesh, uint32_t index )
+{
+    return mesh.indexSize == sizeof( uint16_t ) ? static_cast<const uint16_t*>( mesh.indices )[index]
+                                                : static_cast<const uint32_t*>( mesh.indices )[index];
+}
+
+FullVertex LoadVertex( const MeshGeometry& mesh, uint32_t index )
+{
+    if ( mesh.packed )
+    {
+        PackedVertex packed;
+        std::memcpy( &packed, static_cast<const PackedVertex*>( mesh.vertices ) + index, sizeof( PackedVertex ) );
+        return UnpackVertex( packed );
+    }
+
+    FullVertex vertex;
+    std::memcpy( &vertex, static_cast<const FullVertex*>( mesh.vertices ) + index, sizeof( FullVertex ) );
+    vertex.normal    = normalize( vertex.normal );
+    vertex.tangent   = normalize( vertex.tangent );
+    vertex.bitangent = normalize( vertex.bitangent );
+    return vertex;
+}
+
+const ImageF4* GetTexture( const std::vector<ImageF4>& textures, int32_t index )
+{
+    return index >= 0 && static_cast<size_t>( index ) < textures.size() && textures[index].GetWidth() > 0
+               ? &textures[index]
+               : nullptr;
+}
+
+// Wrap addressing, point or bilinear at level 0.
+float4 SampleTexture( const ImageF4& texture, float2 uv, bool linear )
+{
+    const int width  = static_cast<int>( texture.GetWidth() );
+    const int height = static_cast<int>( texture.GetHeight() );
+
+    auto fetch = [&]( int x, int y ) {
+        x = ( x % width + width ) % width;
+        y = ( y % height + height ) % height;
+        return texture( static_cast<uint32_t>( x ), static_cast<uint32_t>( y ) );
+    };
+
+    if ( !linear )
+    {
+        return fetch( static_cast<int>( std::floor( uv.x * width ) ), static_cast<int>( std::floor( uv.y * height ) ) );
+    }
+
+    const float x  = uv.x * width - 0.5f;
+    const float y  = uv.y * height - 0.5f;
+    const float x0 = std::floor( x );
+    const float y0 = std::floor( y );
+    const float fx = x - x0;
+    const float fy = y - y0;
+    const int   ix = static_cast<int>( x0 );
+    const int   iy = static_cast<int>( y0 );
+
+    return ( fetch( ix, iy ) * ( 1 - fx ) + fetch( ix + 1, iy ) * fx ) * ( 1 - fy ) +
+           ( fetch( ix, iy + 1 ) * ( 1 - fx ) + fetch( ix + 1, iy + 1 ) * fx ) * fy;
+}
+
+/**
+ * The shaders of one DispatchRays, the counters are of the thread running it.
+ */
+class PathKernel
+{
+public:
+    PathKernel( const PathTracerScene& scene, const WideBvh& bvh, const PathTracerFrame& frame,
+                const PathTracerConstants& constants )
+    : m_Scene( scene )
+    , m_Bvh( bvh )
+    , m_Frame( frame )
+    , m_Constants( constants )
+    {}
+
+    void RayGen( RayBuffer& buffer, uint32_t x, uint32_t y );
+
+    PathTracerStats stats;
+
+private:
+    void       TraceRay( const RayDesc& ray, RayPayload& payload ) const;
+    void       ClosestHit( const RayDesc& ray, const RayHit& hit, RayPayload& payload ) const;
+    void       Miss( const RayDesc& ray, RayPayload& payload ) const;
+    RayPayload TraceFullPath( float3 origin, float3 direction, uint32_t seed );
+
+    VertexAttributes GetVertexAttributes( const RayHit& hit, float3 barycentrics, float3& faceNormal ) const;
+    float3           SampleLightDirection( float3 pos, float3 normal, uint32_t& seed ) const;
+    void             sampleBRDF( float3& reflectDir, float3& lightDir, float3& brdfCosReflect, float3& brdfCosLight,
+                                 const MaterialInfoBRDF& mat, uint32_t& seed ) const;
+
+    float3 modelToWorldPosition( float3 pos ) const
+    {
+        return mul( m_Constants.modelToWorld, pos.x, pos.y, pos.z, 1 );
+    }
+
+    const PathTracerScene&     m_Scene;
+    const WideBvh&             m_Bvh;
+    const PathTracerFrame&     m_Frame;
+    const PathTracerConstants& m_Constants;
+};
+
+// _sampleWeightedLightDirection, the Sponza choice of SampleLightDirection.
+float3 PathKernel::SampleLightDirection( float3 pos, float3 normal, uint32_t& seed ) const
+{
+    const int     lightCount = static_cast<int>( std::min( m_Constants.nbrActiveLights, PATH_MAX_LIGHTS ) );
+    const float4* lights     = m_Constants.lightPositions;
+
+    if ( lightCount == 0 )
+        return normal;
+
+    float weightSum = 0;
+    for ( int i = 0; i < lightCount; ++i )
+        weightSum += lights[i].w;
+
+    const float selectedWeightIninterval = rnd( seed ) * weightSum;
+    float       lower = 0, upper = lights[0].w;
+
+    // just one, from the index the loop above left i at.
+    if ( lightCount == 1 )
+        return normalize( modelToWorldPosition( lights[1].xyz() ) - pos );
+
+    // middle ground
+    for ( int i = 0; i < lightCount - 1; ++i )
+    {
+        const float3 dir = modelToWorldPosition( lights[i].xyz() ) - pos;
+
+        if ( selectedWeightIninterval >= lower && selectedWeightIninterval < upper )
+            return normalize( dir );
+
+        lower += lights[i].w;
+        upper += lights[i + 1].w;
+    }
+    // last item
+    if ( selectedWeightIninterval > lower )
+        return normalize( modelToWorldPosition( lights[lightCount - 1].xyz() ) - pos );
+
+    return normal;
+}
+
+VertexAttributes PathKernel::GetVertexAttributes( const RayHit& hit, float3 barycentrics, float3& faceNormal ) const
+{
+    const BvhPrimitive& primitive = m_Bvh.GetPrimitive( hit.triangle );
+    const MeshGeometry& mesh      = m_Scene.meshes[primitive.mesh];
+
+    VertexAttributes v;
+    v.normal    = float3( 0.0f );
+    v.tangent   = float3( 0.0f );
+    v.bitangent = float3( 0.0f );
+    v.texCoord  = float2( 0.0f, 0.0f );
+
+    for ( uint32_t i = 0; i < 3; ++i )
+    {
+        const FullVertex vertex = LoadVertex( mesh, LoadIndex( mesh, 3 * primitive.triangle + i ) );
+        const float      b      = barycentrics[i];
+
+        v.normal += vertex.normal * b;
+        v.tangent += vertex.tangent * b;
+        v.bitangent += vertex.bitangent * b;
+        v.texCoord = v.texCoord + float2( vertex.texCoord.x, vertex.texCoord.y ) * b;
+    }
+
+    // The BVH holds the triangles in world space already, after their instance.
+    const BvhTriangle vertPos = m_Bvh.GetTriangle( hit.triangle );
+    v.position = vertPos.v0 * barycentrics[0] + vertPos.v1 * barycentrics[1] + vertPos.v2 * barycentrics[2];
+
+    faceNormal = cross( normalize( vertPos.v0 - vertPos.v1 ), normalize( vertPos.v0 - vertPos.v2 ) );
+
+    // normalize direction vectors
+    const float3x4& model  = m_Constants.modelToWorld;
+    const float3x4& normal = m_Constants.normalModelToWorld;
+    v.normal               = normalize( mul( normal, v.normal.x, v.normal.y, v.normal.z, 0 ) );
+    v.tangent              = normalize( mul( model, -v.tangent.x, -v.tangent.y, -v.tangent.z, 0 ) );
+    v.bitangent            = normalize( mul( model, v.bitangent.x, v.bitangent.y, v.bitangent.z, 0 ) );
+
+    return v;
+}
+
+// Cook Torrance BRDF
+void PathKernel::sampleBRDF( float3& reflectDir, float3& lightDir, float3& brdfCosReflect, float3& brdfCosLight,
+                             const MaterialInfoBRDF& mat, uint32_t& seed ) const
+{
+    float3 brdfEvalReflect, brdfEvalLight;
+    float  sampleProbReflect, sampleProbLight;
+
+    // Reflection dir, view vector, normal, half-vector
+    float3 R, V = mat.view, N = mat.normal, H;
+
+    float cosNH = 0, cosVH = 0, cosNR = 0, cosNV = 0, cosNL = 0;
+
+    const float alpha2 = mat.roughness * mat.roughness;
+
+    // Light Sample Ray scatter cone
+    float3 L = float3( 0.0f );
+
+    sampleProbLight = 1;
+    brdfEvalLight   = float3( 0.0f );
+
+    // The shader sets sampleProbLight to cosNR before cosNR has a value. The
+    // light direction is sampled about as the cosine, so cosNL stands in and
+    // the light ray is weighed by the colour.
+    auto sampleLight = [&]() {
+        L                                  = SampleLightDirection( mat.pos, mat.normal, seed );
+        cosNL                              = dot( N, L );
+        const float3 lightRandomScatterDir = sample_hemisphere_TrowbridgeReitzCos( 0.01f, seed );
+        L                                  = normalize( applyRotationMappingZToN( L, lightRandomScatterDir ) );
+
+        // Can't sample in negative hemisphere
+        if ( cosNL <= 0 )
+        {
+            L = N;
+        }
+        else
+        {
+            sampleProbLight = cosNL;
+            brdfEvalLight   = mat.colour;
+        }
+    };
+
+    if ( mat.type == PATH_DIFFUSE )
+    {
+        sampleLight();
+
+        R = sample_hemisphere_TrowbridgeReitzCos( alpha2, seed );
+        R = normalize( applyRotationMappingZToN( N, R ) );
+
+        H = normalize( R + V );
+
+        cosNH = dot( N, H );
+        cosNV = dot( N, V );
+        cosVH = dot( V, H );
+        cosNR = dot( N, R );
+
+        const float D = _TrowbridgeReitz( cosNH * cosNH, alpha2 );
+
+        if ( cosNR < 0 )  // Can't sample in negative hemisphere
+        {
+            sampleProbReflect = 1;
+            brdfEvalReflect   = float3( 0.0f );
+        }
+        else
+        {
+            const float  G       = _Smith_TrowbridgeReitz( R, V, H, N, alpha2 );
+            const float  fresnel = std::pow( std::max( 0.0f, 1 - cosVH ), 5.0f );
+            const float3 F       = mat.colour + ( float3( 1.0f ) - mat.colour ) * fresnel;
+
+            const float denomBRDF = 4 * cosNV * cosNR;
+            const float denomProb = 4 * cosNV;
+
+            sampleProbReflect = D * cosNR / denomProb;
+            brdfEvalReflect   = F * ( D * G / denomBRDF );
+        }
+    }
+    else if ( mat.type == PATH_SPECULAR )
+    {
+        const float r          = mat.reflectivity;
+        const bool  reflectRay = rnd( seed ) < r;
+        if ( reflectRay )
+        {
+            R = reflect( -V, N );
+        }
+        else
+        {
+            sampleLight();
+
+            R = normalize( applyRotationMappingZToN( N, sample_hemisphere_TrowbridgeReitzCos( alpha2, seed ) ) );
+        }
+
+        H = normalize( R + V );
+
+        cosNH = dot( N, H );
+        cosNV = dot( N, V );
+        cosVH = dot( V, H );
+        cosNR = dot( N, R );
+
+        if ( cosNR < 0 )
+        {
+            brdfEvalReflect   = float3( 0.0f );
+            sampleProbReflect = 1;
+        }
+        else
+        {
+            const float denomBRDF = std::max( 4 * cosNV * cosNR, EPSILON );
+            const float denomProb = std::max( 4 * cosNV, EPSILON );
+
+            const float D    = _TrowbridgeReitz( cosNH * cosNH, alpha2 );
+            const float G    = _Smith_TrowbridgeReitz( R, V, H, N, alpha2 );
+            const float spec = ( D * G ) / denomBRDF;
+
+            brdfEvalReflect   = float3( r * spec ) + mat.colour * ( ( 1 - r ) * InvPi );
+            sampleProbReflect = r * ( D * cosNH / denomProb ) + ( 1 - r ) * ( InvPi * cosNR );
+        }
+    }
+    else if ( mat.type == PATH_TRANSMISSIVE )
+    {
+        const float3 tmpNormal = dot( V, N ) < 0 ? -N : N;
+
+        R = refract( V, tmpNormal, mat.ior );
+
+        if ( length( R ) == 0 )
+        {
+            sampleLight();
+
+            R = reflect( -V, tmpNormal );
+        }
+        else if ( mat.ior == 1 )
+        {
+            sampleLight();
+        }
+
+        R = normalize( R );
+
+        cosNR = dot( tmpNormal, R );
+
+        sampleProbReflect = cosNR;
+        brdfEvalReflect   = float3( 1.0f ) - mat.colour;
+    }
+    else
+    {
+        // NOT SUPPOSE TO HAPPEN
+        R                 = N;
+        brdfEvalReflect   = float3( 0.0f );
+        sampleProbReflect = 1;
+        cosNR             = 0;
+    }
+
+    reflectDir = R;
+    lightDir   = L;
+
+    brdfCosReflect = brdfEvalReflect * ( cosNR / sampleProbReflect );
+    brdfCosLight   = brdfEvalLight * ( cosNL / sampleProbLight );
+}
+
+void PathKernel::TraceRay( const RayDesc& ray, RayPayload& payload ) const
+{
+    RayHit hit;
+    if ( m_Bvh.Intersect( ray, hit ) )
+    {
+        ClosestHit( ray, hit, payload );
+    }
+    else
+    {
+        Miss( ray, payload );
+    }
+}
+
+// standardChs
+void PathKernel::ClosestHit( const RayDesc& ray, const RayHit& hit, RayPayload& payload ) const
+{
+    const float3 rayDirW = ray.direction;
+    const float3 posW    = ray.origin + rayDirW * hit.t;
+
+    // (w,u,v)
+    const float3 barycentrics( 1.0f - hit.barycentrics.x - hit.barycentrics.y, hit.barycentrics.x,
+                               hit.barycentrics.y );
+
+    // InstanceID() + GeometryIndex(), the BVH keeps it per triangle.
+    const uint32_t mesh = m_Bvh.GetPrimitive( hit.triangle ).mesh;
+
+    float3           faceNormal;
+    RayMaterialProp  mat = m_Scene.materials[mesh];
+    VertexAttributes v   = GetVertexAttributes( hit, barycentrics, faceNormal );
+
+    // Alpha can be set by either mask or diffuse texture
+    float4 tex_rgba( mat.diffuse, 1 );
+
+    if ( const ImageF4* mask = GetTexture( m_Scene.maskTextures, mat.maskTextureIdx ) )
+    {
+        tex_rgba.w *= SampleTexture( *mask, v.texCoord, false ).x;
+    }
+
+    if ( const ImageF4* diffuse = GetTexture( m_Scene.diffuseTextures, mat.diffuseTextureIdx ) )
+    {
+        tex_rgba.w *= SampleTexture( *diffuse, v.texCoord, false ).w;
+
+        const float4 texel = SampleTexture( *diffuse, v.texCoord, true );
+        tex_rgba.x *= texel.x;
+        tex_rgba.y *= texel.y;
+        tex_rgba.z *= texel.z;
+    }
+
+    // transparent pixel hit!
+    if ( tex_rgba.w == 0 )
+    {
+        payload.reflectDir    = rayDirW;
+        payload.position      = posW;
+        payload.colourReflect = float3( 1.0f );
+        payload.radiance      = float3( 0.0f );
+
+        payload.lightDir    = float3( 0.0f );
+        payload.colourLight = float3( 0.0f );
+        return;
+    }
+
+    // Iterate depths
+    ++payload.depth;
+
+    const float3 albedo = tex_rgba.xyz();
+
+    // View Vector
+    const float3 V = -rayDirW;
+
+    // Build normal
+    float3 normalMap = v.normal;
+
+    if ( const ImageF4* normals = GetTexture( m_Scene.normalTextures, mat.normalTextureIdx ) )
+    {
+        // from [0,1] to [-1, 1]
+        const float4 texel = SampleTexture( *normals, v.texCoord, true );
+        const float  nx    = texel.x * 2 - 1;
+        const float  ny    = texel.y * 2 - 1;
+
+        // Cooked normal maps (BC5) only store X and Y, Z is rebuilt from those
+        const float nz = ( mat.flags & PATH_MATERIAL_NORMAL_XY ) ? std::sqrt( Saturate( 1 - nx * nx - ny * ny ) )
+                                                                 : texel.z * 2 - 1;
+        normalMap          = v.tangent * nx + v.bitangent * ny + v.normal * nz;
+    }
+
+    normalMap = normalize( normalMap );
+
+    const bool isLight = length( mat.emittance ) != 0;
+
+    // If the primary ray is hiting an object that is in the wrong direction, or hitting the light.
+    if ( ( mat.type != PATH_TRANSMISSIVE && dot( faceNormal, V ) < 0 ) || isLight )
+    {
+        payload.position      = posW;
+        payload.colourReflect = isLight ? mat.emittance : float3( 0.0f );
+        payload.reflectDir    = float3( 0.0f );
+
+        payload.radiance = mat.emittance;
+
+        payload.colourLight = float3( isLight ? 1.0f : 0.0f );
+        payload.lightDir    = float3( 0.0f );
+
+        payload.normal  = dot( faceNormal, V ) < 0 ? -faceNormal : faceNormal;
+        payload.object  = static_cast<int>( mesh );
+        payload.mask    = static_cast<float>( mat.type );
+        payload.rayMode = RAY_SECONDARY;
+        return;
+    }
+
+    float specVal = mat.reflectivity;
+    if ( const ImageF4* specular = GetTexture( m_Scene.specularTextures, mat.specularTextureIdx ) )
+    {
+        specVal = SampleTexture( *specular, v.texCoord, true ).x;
+    }
+
+    // in X, and hit X again, assume try enter air. UGLY hack
+    if ( static_cast<float>( payload.mediumIoR ) == mat.indexOfRefraction )
+        mat.indexOfRefraction = 1.0f;
+
+    const float divIoR = static_cast<float>( payload.mediumIoR ) / mat.indexOfRefraction;
+
+    const MaterialInfoBRDF matBRDF { V, normalMap, posW, mat.type, albedo, specVal, mat.roughness, divIoR };
+
+    sampleBRDF( payload.reflectDir, payload.lightDir, payload.colourReflect, payload.colourLight, matBRDF,
+                payload.seed );
+
+    // If we are in transmissive type, and we see that the view vector and reflection vector
+    // are opposites. Then change the medium IoR
+    if ( mat.type == PATH_TRANSMISSIVE && dot( V, payload.reflectDir ) < 0 )
+        payload.mediumIoR = mat.indexOfRefraction != 0;
+
+    payload.position = posW;
+    payload.radiance = float3( 0.0f );
+
+    if ( payload.rayMode == RAY_PRIMARY )
+    {
+        payload.normal  = normalMap;
+        payload.object  = static_cast<int>( mesh );
+        payload.mask    = static_cast<float>( mat.type );
+        payload.rayMode = RAY_SECONDARY;
+    }
+}
+
+// standardMiss, as without a skybox.
+void PathKernel::Miss( const RayDesc& ray, RayPayload& payload ) const
+{
+    const float3 atmosphere = m_Frame.atmosphere.xyz();
+
+    // sky normal, depth, and colour
+    payload.radiance      = atmosphere * m_Frame.atmosphere.w;
+    payload.colourReflect = atmosphere;
+    payload.colourLight   = float3( 0.0f );
+
+    payload.lightDir   = float3( 0.0f );
+    payload.reflectDir = float3( 0.0f );
+
+    payload.normal   = -ray.direction;
+    payload.position = ray.origin + ray.direction * 100000.0f;
+
+    payload.mask   = 0;
+    payload.object = -1;
+
+    payload.rayMode = RAY_SECONDARY;
+}
+
+RayPayload PathKernel::TraceFullPath( float3 origin, float3 direction, uint32_t seed )
+{
+    RayPayload result {};
+
+    RayDesc ray;
+    ray.origin    = origin;
+    ray.direction = direction;
+    ray.tMin      = 0.0f;
+    ray.tMax      = PATH_T_HIT_MAX;
+
+    RayDesc rayLightDesc;
+    rayLightDesc.tMin = PATH_T_HIT_MIN;
+    rayLightDesc.tMax = PATH_T_HIT_MAX;
+
+    float3     radiance( 0.0f );
+    float3     colour( 1.0f );
+    RayPayload currRay {};
+    RayPayload lightRay {};
+    currRay.seed      = seed;
+    currRay.rayMode   = RAY_PRIMARY;
+    currRay.depth     = 0;
+    currRay.mediumIoR = true;
+
+    lightRay.rayMode = RAY_SECONDARY;
+
+    bool first = true;
+    while ( currRay.depth < m_Frame.nbrBouncesPerPath )
+    {
+        currRay.radiance = lightRay.radiance = float3( 0.0f );
+        currRay.colourReflect = lightRay.colourReflect = float3( 0.0f );
+        const uint32_t prevType                        = currRay.rayMode;
+        const float3   prevPos                         = currRay.position;
+
+        TraceRay( ray, currRay );
+        ++( first ? stats.primaryRays : stats.bounceRays );
+        first = false;
+
+        const float3 dist       = prevPos - currRay.position;
+        float        distNewPos = std::max( length( dist ), 1.0f );
+
+        // Sampling from the skybox doesn't invovle distance.
+        if ( currRay.object == -1 || length( dist ) == 0 )
+            distNewPos = 1;
+
+        // Trace light if given a direction
+        rayLightDesc.origin    = currRay.position;
+        rayLightDesc.direction = currRay.lightDir;
+        lightRay.radiance      = float3( 0.0f );
+        const float wantedMaxRadiance = 10;
+
+        float distLightRay = 1;
+        // If we organize a new light direction, sample the light:
+        if ( length( currRay.lightDir ) != 0 )
+        {
+            TraceRay( rayLightDesc, lightRay );
+            ++stats.lightRays;
+            const float lightRadiance = length( lightRay.radiance );
+
+            // adjust radiance for light ray
+            lightRay.radiance = lightRay.radiance * ( lightRadiance > 0 ? wantedMaxRadiance / lightRadiance : 0 );
+
+            distLightRay = std::max( length( currRay.position - lightRay.position ), 1.0f );
+
+            // Sampling from the skybox doesn't invovle distance.
+            if ( lightRay.object == -1 )
+                distLightRay = 1;
+        }
+
+        // Adjust rnd light hit
+        const float rndRadiance = length( currRay.radiance );
+        currRay.radiance = currRay.radiance * ( rndRadiance > 0 ? 0.1f * wantedMaxRadiance / rndRadiance : 0 );
+
+        // Blend light ray and reflection ray 50/50
+        const float shadowRayBounceAlpha = 0.5f;
+        if ( length( currRay.lightDir ) != 0 )
+        {
+            radiance += colour * currRay.radiance * ( shadowRayBounceAlpha / distNewPos ) +
+                        colour * currRay.colourLight * lightRay.radiance *
+                            ( ( 1 - shadowRayBounceAlpha ) / distLightRay );
+        }
+        else
+        {
+            radiance += colour * currRay.radiance;
+        }
+
+        colour = colour * currRay.colourReflect;
+
+        // Store the first Primary Ray normal/specular/object/position
+        if ( currRay.rayMode == RAY_SECONDARY && prevType == RAY_PRIMARY )
+        {
+            result.normal   = currRay.normal;
+            result.mask     = currRay.mask;
+            result.object   = currRay.object;
+            result.position = currRay.position;
+
+            radiance += colour * m_Frame.ambientFactor;
+
+            // if we sample directly from skybox, sample the colour and not radiance.
+            if ( length( currRay.radiance ) > 0 )
+                radiance = currRay.object == -1 ? currRay.colourReflect : currRay.radiance;
+        }
+
+        ray.origin    = currRay.position;
+        ray.direction = currRay.reflectDir;
+
+        // If currRay is now emissive, or the reflect dir doesnt lead to anywhere, break:
+        if ( length( currRay.reflectDir ) == 0 || length( currRay.radiance ) > 0 )
+            break;
+        // If it is a normal bounce with a normal new dir but the light is now too low:
+        if ( length( colour ) < 0.01f )
+            break;
+
+        // Only shoot from 0 on camera.
+        ray.tMin = PATH_T_HIT_MIN;
+    }
+
+    // Final sampled colour
+    result.colourReflect = radiance;
+    result.seed          = currRay.seed;
+
+    return result;
+}
+
+void PathKernel::RayGen( RayBuffer& buffer, uint32_t x, uint32_t y )
+{
+    const uint32_t width  = buffer.GetWidth();
+    const uint32_t height = buffer.GetHeight();
+
+    const uint32_t bufferOffset = width * y + x;
+    const uint32_t seed         = PathTracer::GetNewSeed( bufferOffset, m_Frame.cpuGeneratedSeed, 8 );
+
+    const float2 dims( static_cast<float>( width ), static_cast<float>( height ) );
+
+    // converts [0, 1] to [-1, 1]
+    float2 d( ( x / dims.x ) * 2.0f - 1.0f, ( y / dims.y ) * 2.0f - 1.0f );
+
+    const float aspectRatio = dims.x / dims.y;
+    d.x *= aspectRatio;
+
+    const float3x4& pixelToWorld = m_Frame.cameraPixelToWorld;
+    const float3    camOrigin    = mul( pixelToWorld, 0, 0, 0, 1 );
+
+    float3 newRadiance( 0.0f );
+
+    RayPayload payload {};
+    payload.seed = seed;
+
+    const int nbrSamples = 1 << m_Frame.exponentSamplesPerPixel;
+
+    for ( int i = 0; i < nbrSamples; ++i )
+    {
+        // Add random seed there
+        const float dx = rnd( payload.seed ) - 0.5f;
+        const float dy = rnd( payload.seed ) - 0.5f;
+
+        // Opting for no random in initial pixel to not confuse
+        const float  jitter    = i > 0 ? 1.0f : 0.0f;
+        const float3 direction = normalize(
+            mul( pixelToWorld, d.x + jitter * dx / dims.x, d.y + jitter * dy / dims.y, 1, 0 ) );
+
+        payload = TraceFullPath( camOrigin, direction, payload.seed );
+
+        newRadiance += payload.colourReflect;
+    }
+
+    newRadiance = newRadiance / static_cast<float>( nbrSamples );
+
+    const float depth = length( camOrigin - payload.position ) / PATH_T_HIT_MAX;
+
+    const float3 object = PathTracer::GenColour( payload.object + 2 );
+
+    buffer.Colour()( x, y ) = float4( Saturate( newRadiance.x ), Saturate( newRadiance.y ), Saturate( newRadiance.z ),
+                                      static_cast<float>( AS_CASTED ) );
+    buffer.Normals()( x, y )    = float4( ( payload.normal + float3( 1.0f ) ) * 0.5f, 1 );
+    buffer.PosDepth()( x, y )   = float4( payload.position, depth );
+    buffer.ObjectMask()( x, y ) = float4( object, payload.mask );
+}
+
+// Every instance's meshes in world space, tagged with the slot of the mesh. Always in the same order for the same
+// instances, which Bvh::Update relies on.
+void GatherInstanceTriangles( const PathTracerScene& scene, std::vector<BvhTriangle>& triangles,
+                              std::vector<BvhPrimitive>* primitives )
+{
+    triangles.clear();
+    if ( primitives )
+    {
+        primitives->clear();
+    }
+
+    for ( const PathTracerInstance& instance: scene.instances )
+    {
+        const float3x4& m = instance.objectToWorld;
+        auto toWorld      = [&]( float3 p ) {
+            return mul( m, p.x, p.y, p.z, 1 );
+        };
+
+        for ( uint32_t slot = instance.firstMesh; slot < instance.firstMesh + instance.meshCount; ++slot )
+        {
+            const MeshGeometry& mesh = scene.meshes[slot];
+            for ( uint32_t t = 0; t < mesh.indexCount / 3; ++t )
+            {
+                const float3 v0 = LoadVertex( mesh, LoadIndex( mesh, 3 * t ) ).position;
+                const float3 v1 = LoadVertex( mesh, LoadIndex( mesh, 3 * t + 1 ) ).position;
+                const float3 v2 = LoadVertex( mesh, LoadIndex( mesh, 3 * t + 2 ) ).position;
+                triangles.push_back( { toWorld( v0 ), toWorld( v1 ), toWorld( v2 ) } );
+                if ( primitives )
+                {
+                    primitives->push_back( { slot, t } );
+                }
+            }
+        }
+    }
+}
+
+}  // namespace
+
+PathTracer::PathTracer( ThreadPool& pool )
+: m_Pool( pool )
+{}
+
+uint32_t PathTracer::GetNewSeed( uint32_t param1, uint32_t param2, uint32_t numPermutation )
+{
+    uint32_t s0 = 0;
+    uint32_t v0 = param1;
+    uint32_t v1 = param2;
+
+    for ( uint32_t perm = 0; perm < numPermutation; perm++ )
+    {
+        s0 += 0x9e3779b9;
+        v0 += ( ( v1 << 4 ) + 0xa341316c ) ^ ( v1 + s0 ) ^ ( ( v1 >> 5 ) + 0xc8013ea4 );
+        v1 += ( ( v0 << 4 ) + 0xad90777d ) ^ ( v0 + s0 ) ^ ( ( v0 >> 5 ) + 0x7e95761e );
+    }
+
+    return v0;
+}
+
+float3 PathTracer::GenColour( int id )
+{
+    int pattern[3];
+    _getPattern( id, pattern );
+
+    // Convert from integer [0,255] to float [0,1].
+    return float3( static_cast<float>( _getElement( pattern[0] ) ) / 255,
+                   static_cast<float>( _getElement( pattern[1] ) ) / 255,
+                   static_cast<float>( _getElement( pattern[2] ) ) / 255 );
+}
+
+BvhBuildStats PathTracer::SetScene( const PathTracerScene& scene, const BvhBuildOptions& options )
+{
+    assert( scene.materials.size() == scene.meshes.size() );
+
+    m_Scene = &scene;
+
+    std::vector<BvhTriangle>  triangles;
+    std::vector<BvhPrimitive> primitives;
+    GatherInstanceTriangles( scene, triangles, &primitives );
+
+    const BvhBuildStats stats = m_BinaryBvh.Build( m_Pool, triangles, primitives, options );
+    m_Bvh.Build( m_BinaryBvh );
+    return stats;
+}
+
+BvhUpdateStats PathTracer::UpdateScene( const BvhUpdateOptions& options )
+{
+    assert( m_Scene );
+
+    std::vector<BvhTriangle> triangles;
+    GatherInstanceTriangles( *m_Scene, triangles, nullptr );
+
+    const BvhUpdateStats stats = m_BinaryBvh.Update( m_Pool, triangles, options );
+    m_Bvh.Build( m_BinaryBvh );
+    return stats;
+}
+
+PathTracerStats PathTracer::Render( RayBuffer& buffer, const PathTracerFrame& frame,
+                                    const PathTracerConstants& constants )
+{
+    assert( m_Scene );
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::atomic<uint64_t> pixels { 0 };
+    std::atomic<uint64_t> primaryRays { 0 };
+    std::atomic<uint64_t> bounceRays { 0 };
+    std::atomic<uint64_t> lightRays { 0 };
+
+    m_Pool.ParallelForTiles( buffer.GetWidth(), buffer.GetHeight(), TILE_SIZE, [&]( const Tile& tile ) {
+        PathKernel kernel( *m_Scene, m_Bvh, frame, constants );
+
+        for ( uint32_t y = tile.y0; y < tile.y1; ++y )
+        {
+            for ( uint32_t x = tile.x0; x < tile.x1; ++x )
+            {
+                // ignore those that are unselected
+                if ( buffer.Colour()( x, y ).w != AS_CAST )
+                    continue;
+
+                kernel.RayGen( buffer, x, y );
+                ++kernel.stats.pixels;
+            }
+        }
+
+        pixels += kernel.stats.pixels;
+        primaryRays += kernel.stats.primaryRays;
+        bounceRays += kernel.stats.bounceRays;
+        lightRays += kernel.stats.lightRays;
+    } );
+
+    PathTracerStats stats;
+    stats.pixels      = pixels;
+    stats.primaryRays = primaryRays;
+    stats.bounceRays  = bounceRays;
+    stats.lightRays   = lightRays;
+    stats.seconds     = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    return stats;
+}
+
+bool PathTracerConstants::AddLight( const float4& light )
+{
+    if ( nbrActiveLights >= PATH_MAX_LIGHTS )
+        return false;
+
+    lightPositions[nbrActiveLights++] = light;
+
+    // SampleLightDirection reads a single light from slot 1, as the shader does. A second light overwrites it.
+    if ( nbrActiveLights == 1 )
+        lightPositions[1] = light;
+    return true;
+}
+
+void PathTracerConstants::SetSceneTransform( const float3x4& transform )
+{
+    float3x4 inverse;
+    modelToWorld = transform;
+    InvertTransform( transform, inverse, normalModelToWorld );
+}
+
+void cpulib::LoadPathTracerScene( const CookedScene& cooked, PathTracerScene& scene, const float3x4& sceneTransform )
+{
+    scene = PathTracerScene();
+
+    const bool     packed    = cooked.GetHeader().vertexStride == sizeof( PackedVertex );
+    const uint32_t meshCount = cooked.GetMeshCount();
+
+    scene.meshes.resize( meshCount );
+    scene.materials.resize( meshCount );
+    for ( uint32_t m = 0; m < meshCount; ++m )
+    {
+        const CookedMesh& mesh = cooked.GetMesh( m );
+
+        scene.meshes[m].vertices    = cooked.GetVertices( mesh );
+        scene.meshes[m].vertexCount = mesh.vertexCount;
+        scene.meshes[m].packed      = packed;
+        scene.meshes[m].indices     = cooked.GetIndices( mesh );
+        scene.meshes[m].indexCount  = mesh.indexCount;
+        scene.meshes[m].indexSize   = mesh.indexSize;
+
+        // As ShaderTable fills the GeometryMaterialMap.
+        const CookedMaterial& material = cooked.GetMaterial( mesh.material );
+        RayMaterialProp&      prop     = scene.materials[m];
+
+        prop.diffuse           = float3( material.diffuse[0], material.diffuse[1], material.diffuse[2] );
+        prop.type              = material.type;
+        prop.emittance         = float3( material.emissive[0], material.emissive[1], material.emissive[2] );
+        prop.reflectivity      = ( 1 / 3.0f ) * ( material.specular[0] + material.specular[1] + material.specular[2] );
+        prop.indexOfRefraction = material.indexOfRefraction;
+        prop.indexSize         = mesh.indexSize;
+    }
+
+    PathTracerInstance instance;
+    instance.objectToWorld = sceneTransform;
+    instance.meshCount     = meshCount;
+    scene.instances.push_back( instance );
+}
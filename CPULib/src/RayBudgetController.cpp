@@ -0,0 +1,157 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/RayBudgetController.h>
+
+#include <cctype>
+
+using namespace cpulib;
+
+// Interpolate in log space, the limits span a few orders of magnitude.
+static float GeometricLerp( float a, float b, float t )
+{
+    if ( a <= 0.0f || b <= 0.0f )
+        return a + ( b - a ) * t;
+
+    return a * std::pow( b / a, t );
+}
+
+RayBudgetController::RayBudgetController( const RayBudgetSettings& settings )
+: m_Settings( settings )
+{
+    ApplyLooseness();
+}
+
+void RayBudgetController::SetSettings( const RayBudgetSettings& settings )
+{
+    m_Settings = settings;
+
+    m_Sampler.gridSize = std::clamp( m_Sampler.gridSize, m_Settings.minGridSize, m_Settings.maxGridSize );
+    ApplyLooseness();
+}
+
+void RayBudgetController::Reset( const AdaptiveSamplerSettings& initial )
+{
+    m_Sampler          = initial;
+    m_Sampler.gridSize = std::clamp( m_Sampler.gridSize, m_Settings.minGridSize, m_Settings.maxGridSize );
+
+    m_Load                  = 0;
+    m_Looseness             = 0.5f;
+    m_Correcting            = false;
+    m_HasHistory            = false;
+    m_FramesSinceGridChange = 0;
+
+    ApplyLooseness();
+}
+
+const AdaptiveSamplerSettings& RayBudgetController::Update( const FrameCounters& counters )
+{
+    float measured = m_Settings.mode == BudgetMode::Rays ? static_cast<float>( counters.castRays ) : counters.frameMs;
+    float ratio    = measured / std::max( m_Settings.target, EPSILON );
+
+    if ( m_HasHistory )
+        m_Load += ( ratio - m_Load ) * std::clamp( m_Settings.smoothing, 0.0f, 1.0f );
+    else
+        m_Load = ratio;
+
+    m_HasHistory = true;
+    ++m_FramesSinceGridChange;
+
+    // Hysteresis, start outside the dead band and stop inside the settle band.
+    float error = m_Load - 1.0f;
+    if ( !m_Correcting && std::abs( error ) > m_Settings.deadBand )
+        m_Correcting = true;
+    else if ( m_Correcting && std::abs( error ) <= m_Settings.settleBand )
+        m_Correcting = false;
+
+    if ( !m_Correcting )
+        return m_Sampler;
+
+    // The limits do nothing without adaptive sampling.
+    if ( m_Sampler.gridSize > 0 )
+    {
+        float step  = m_Settings.gain * std::log( std::max( m_Load, 0.001f ) );
+        m_Looseness = std::clamp( m_Looseness + step, 0.0f, 1.0f );
+    }
+
+    bool canStepGrid = m_FramesSinceGridChange >= m_Settings.gridSizeCooldown;
+    bool saturated   = m_Sampler.gridSize == 0 || m_Looseness >= 1.0f;
+
+    if ( error > 0 && saturated && canStepGrid && m_Sampler.gridSize < m_Settings.maxGridSize )
+    {
+        // Looseness is kept, the limits then only have to fine tune the new grid.
+        ++m_Sampler.gridSize;
+        m_FramesSinceGridChange = 0;
+        m_HasHistory            = false;
+    }
+    else if ( error < 0 && m_Looseness <= 0.0f && canStepGrid && m_Sampler.gridSize > m_Settings.minGridSize )
+    {
+        --m_Sampler.gridSize;
+        m_FramesSinceGridChange = 0;
+        m_HasHistory            = false;
+    }
+
+    ApplyLooseness();
+
+    return m_Sampler;
+}
+
+void RayBudgetController::ApplyLooseness()
+{
+    const RayBudgetSettings& s = m_Settings;
+    float                    t = m_Looseness;
+
+    m_Sampler.colourLimit    = GeometricLerp( s.colourLimitTight, s.colourLimitLoose, t );
+    m_Sampler.posDiffLimit   = GeometricLerp( s.posDiffLimitTight, s.posDiffLimitLoose, t );
+    m_Sampler.depthDiffLimit = GeometricLerp( s.depthDiffLimitTight, s.depthDiffLimitLoose, t );
+    m_Sampler.normalDotLimit = s.normalDotLimitTight + ( s.normalDotLimitLoose - s.normalDotLimitTight ) * t;
+}
+
+bool cpulib::ReadCounterTrace( const std::string& fileName, std::vector<FrameCounters>& trace )
+{
+    std::ifstream file( fileName );
+    if ( !file.is_open() )
+        return false;
+
+    trace.clear();
+
+    std::string line;
+    for ( uint32_t lineNumber = 1; std::getline( file, line ); ++lineNumber )
+    {
+        if ( line.empty() || line[0] == '#' || line[0] == '\r' )
+            continue;
+
+        std::replace( line.begin(), line.end(), ',', ' ' );
+        std::istringstream stream( line );
+
+        FrameCounters counters;
+        stream >> counters.castRays >> counters.interpolated >> counters.pixelCount >> counters.frameMs;
+        const bool parsed = static_cast<bool>( stream ) && ( stream >> std::ws ).eof();
+        if ( !parsed )
+        {
+            // Column names on the first line.
+            if ( lineNumber == 1 && !std::isdigit( static_cast<unsigned char>( line[0] ) ) )
+                continue;
+            return false;
+        }
+
+        trace.push_back( counters );
+    }
+
+    return true;
+}
+
+bool cpulib::WriteCounterTrace( const std::string& fileName, const std::vector<FrameCounters>& trace )
+{
+    std::ofstream file( fileName );
+    if ( !file.is_open() )
+        return false;
+
+    file << "castRays,interpolated,pixelCount,frameMs\n";
+    for ( const FrameCounters& counters: trace )
+    {
+        file << counters.castRays << ',' << counters.interpolated << ',' << counters.pixelCount << ','
+             << counters.frameMs << '\n';
+    }
+
+    return static_cast<bool>( file );
+}
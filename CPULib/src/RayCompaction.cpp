@@ -0,0 +1,102 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/RayCompaction.h>
+
+#include <cpulib/ThreadPool.h>
+
+using namespace cpulib;
+
+// Elements per block of the parallel scan.
+static const size_t SCAN_BLOCK_SIZE = 4096;
+
+uint64_t cpulib::ExclusiveScan( ThreadPool& pool, const uint32_t* in, uint32_t* out, size_t count )
+{
+    const uint32_t numBlocks = static_cast<uint32_t>( ( count + SCAN_BLOCK_SIZE - 1 ) / SCAN_BLOCK_SIZE );
+
+    // Sum of every block, turned into the offset of every block.
+    std::vector<uint64_t> blockSums( numBlocks );
+    pool.ParallelFor( numBlocks, [&]( uint32_t block ) {
+        size_t begin = block * SCAN_BLOCK_SIZE;
+        size_t end   = std::min( count, begin + SCAN_BLOCK_SIZE );
+
+        uint64_t sum = 0;
+        for ( size_t i = begin; i < end; ++i )
+            sum += in[i];
+        blockSums[block] = sum;
+    } );
+
+    uint64_t total = 0;
+    for ( uint64_t& sum: blockSums )
+    {
+        uint64_t blockSum = sum;
+        sum               = total;
+        total += blockSum;
+    }
+
+    pool.ParallelFor( numBlocks, [&]( uint32_t block ) {
+        size_t begin = block * SCAN_BLOCK_SIZE;
+        size_t end   = std::min( count, begin + SCAN_BLOCK_SIZE );
+
+        uint64_t sum = blockSums[block];
+        for ( size_t i = begin; i < end; ++i )
+        {
+            uint32_t value = in[i];
+            out[i]         = static_cast<uint32_t>( sum );
+            sum += value;
+        }
+    } );
+
+    return total;
+}
+
+RayCompaction::RayCompaction( ThreadPool& pool )
+: m_Pool( pool )
+{}
+
+uint32_t RayCompaction::Compact( const RayBuffer& buffer )
+{
+    const uint32_t width  = buffer.GetWidth();
+    const uint32_t height = buffer.GetHeight();
+    const ImageF4& colour = buffer.Colour();
+
+    m_RowOffsets.resize( height );
+    m_Pool.ParallelFor( height, [&]( uint32_t y ) {
+        const float4* row   = colour.GetRow( y );
+        uint32_t      count = 0;
+        for ( uint32_t x = 0; x < width; ++x )
+            count += row[x].w == AS_CAST ? 1 : 0;
+        m_RowOffsets[y] = count;
+    } );
+
+    m_RayCount = static_cast<uint32_t>( ExclusiveScan( m_Pool, m_RowOffsets.data(), m_RowOffsets.data(), height ) );
+
+    // Only ever grows, the list is reused between passes.
+    if ( m_PixelList.size() < m_RayCount )
+        m_PixelList.resize( m_RayCount );
+
+    m_Pool.ParallelFor( height, [&]( uint32_t y ) {
+        const float4* row = colour.GetRow( y );
+        uint32_t*     dst = m_PixelList.data() + m_RowOffsets[y];
+        for ( uint32_t x = 0; x < width; ++x )
+        {
+            if ( row[x].w == AS_CAST )
+                *dst++ = PackPixel( int2( static_cast<int>( x ), static_cast<int>( y ) ) );
+        }
+    } );
+
+    return m_RayCount;
+}
+
+DispatchSize RayCompaction::CalcDispatchSize( uint32_t count, uint32_t maxWidth )
+{
+    DispatchSize size;
+    if ( count == 0 )
+        return size;
+
+    maxWidth    = std::max( 1u, maxWidth );
+    size.width  = std::min( count, maxWidth );
+    size.height = ( count + size.width - 1 ) / size.width;
+    size.depth  = 1;
+
+    return size;
+}
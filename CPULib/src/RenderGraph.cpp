@@ -0,0 +1,587 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/RenderGraph.h>
+
+using namespace cpulib;
+
+static bool IsRead( GraphAccess access )
+{
+    return access != GraphAccess::Write;
+}
+
+static bool IsWrite( GraphAccess access )
+{
+    return access != GraphAccess::Read;
+}
+
+static bool Fail( std::string* error, const std::string& message )
+{
+    if ( error )
+        *error = message;
+    return false;
+}
+
+const char* cpulib::ToString( GraphResourceState state )
+{
+    switch ( state )
+    {
+    case GraphResourceState::Common:
+        return "Common";
+    case GraphResourceState::UnorderedAccess:
+        return "UnorderedAccess";
+    case GraphResourceState::RenderTarget:
+        return "RenderTarget";
+    case GraphResourceState::CopySource:
+        return "CopySource";
+    case GraphResourceState::CopyDest:
+        return "CopyDest";
+    }
+    return "?";
+}
+
+void RecordingGraphBackend::Barrier( const GraphBarrier& barrier )
+{
+    GraphCommand command;
+    command.type    = GraphCommand::Type::Barrier;
+    command.barrier = barrier;
+    m_Commands.push_back( command );
+}
+
+void RecordingGraphBackend::FlushBarriers()
+{
+    GraphCommand command;
+    command.type = GraphCommand::Type::FlushBarriers;
+    m_Commands.push_back( command );
+}
+
+void RecordingGraphBackend::BeginPass( uint32_t pass, const std::string& name )
+{
+    GraphCommand command;
+    command.type = GraphCommand::Type::BeginPass;
+    command.pass = pass;
+    command.name = name;
+    m_Commands.push_back( command );
+}
+
+void RecordingGraphBackend::Copy( uint32_t dst, uint32_t src )
+{
+    GraphCommand command;
+    command.type = GraphCommand::Type::Copy;
+    command.dst  = dst;
+    command.src  = src;
+    m_Commands.push_back( command );
+}
+
+std::string RecordingGraphBackend::Describe() const
+{
+    std::ostringstream out;
+    for ( const GraphCommand& command: m_Commands )
+    {
+        switch ( command.type )
+        {
+        case GraphCommand::Type::Barrier:
+            if ( command.barrier.type == GraphBarrier::Type::UAV &&
+                 command.barrier.resource == GraphBarrier::ALL_RESOURCES )
+                out << "  uav all\n";
+            else if ( command.barrier.type == GraphBarrier::Type::UAV )
+                out << "  uav " << command.barrier.resource << "\n";
+            else if ( command.barrier.type == GraphBarrier::Type::Aliasing )
+                out << "  alias " << command.barrier.resource << " for " << ToString( command.barrier.after ) << "\n";
+            else
+                out << "  transition " << command.barrier.resource << " " << ToString( command.barrier.before )
+                    << " -> " << ToString( command.barrier.after ) << "\n";
+            break;
+        case GraphCommand::Type::FlushBarriers:
+            out << "  flush\n";
+            break;
+        case GraphCommand::Type::BeginPass:
+            out << "pass " << command.pass << " " << command.name << "\n";
+            break;
+        case GraphCommand::Type::Copy:
+            out << "  copy " << command.src << " -> " << command.dst << "\n";
+            break;
+        }
+    }
+    return out.str();
+}
+
+uint32_t RenderGraph::ImportResource( const std::string& name, GraphResourceState state )
+{
+    Resource resource;
+    resource.name  = name;
+    resource.state = state;
+
+    m_Resources.push_back( resource );
+    return static_cast<uint32_t>( m_Resources.size() - 1 );
+}
+
+void RenderGraph::SetState( uint32_t resource, GraphResourceState state )
+{
+    assert( resource < m_Resources.size() );
+
+    m_Resources[resource].state = state;
+}
+
+void RenderGraph::AddAlias( uint32_t a, uint32_t b )
+{
+    assert( a < m_Resources.size() && b < m_Resources.size() && a != b );
+
+    m_Resources[a].aliases.push_back( b );
+    m_Resources[b].aliases.push_back( a );
+    m_Compiled = false;
+}
+
+void RenderGraph::ClearAliases()
+{
+    for ( Resource& resource: m_Resources )
+        resource.aliases.clear();
+    m_Compiled = false;
+}
+
+void RenderGraph::SetResident( uint32_t resource, bool resident )
+{
+    assert( resource < m_Resources.size() );
+
+    m_Resources[resource].resident = resident;
+    m_Compiled                     = false;
+}
+
+void RenderGraph::MarkOutput( uint32_t resource )
+{
+    assert( resource < m_Resources.size() );
+
+    m_Resources[resource].output = true;
+    m_Compiled                   = false;
+}
+
+void RenderGraph::Reset()
+{
+    for ( Resource& resource: m_Resources )
+        resource.output = false;
+
+    m_Passes.clear();
+    m_CompileStates.clear();
+    m_CompileResident.clear();
+    m_Compiled = false;
+    m_Stats    = RenderGraphStats();
+}
+
+uint32_t RenderGraph::AddPass( const std::string& name, ExecuteFunction execute )
+{
+    Pass pass;
+    pass.name    = name;
+    pass.execute = std::move( execute );
+
+    m_Passes.push_back( std::move( pass ) );
+    m_Compiled = false;
+    return static_cast<uint32_t>( m_Passes.size() - 1 );
+}
+
+void RenderGraph::Access( uint32_t pass, uint32_t resource, GraphAccess access, GraphResourceState state )
+{
+    assert( pass < m_Passes.size() && resource < m_Resources.size() );
+
+    // A second access of the same resource is merged, a pass sees a resource in one state only.
+    for ( PassAccess& existing: m_Passes[pass].accesses )
+    {
+        if ( existing.resource == resource )
+        {
+            assert( existing.state == state );
+            if ( existing.access != access )
+                existing.access = GraphAccess::ReadWrite;
+            return;
+        }
+    }
+
+    m_Passes[pass].accesses.push_back( { resource, access, state } );
+    m_Compiled = false;
+}
+
+uint32_t RenderGraph::AddCopyPass( const std::string& name, uint32_t dst, uint32_t src )
+{
+    assert( dst != src );
+
+    const uint32_t pass = AddPass( name );
+    m_Passes[pass].copy    = true;
+    m_Passes[pass].copyDst = dst;
+    m_Passes[pass].copySrc = src;
+
+    Write( pass, dst, GraphResourceState::CopyDest );
+    Read( pass, src, GraphResourceState::CopySource );
+    return pass;
+}
+
+void RenderGraph::Compile()
+{
+    m_Stats        = RenderGraphStats();
+    m_Stats.passes = static_cast<uint32_t>( m_Passes.size() );
+
+    // Walk back from the outputs: a pass is needed when a later needed pass or
+    // the output reads what it writes. Passes that write nothing are kept, the
+    // graph cannot tell what else they do.
+    std::vector<bool> needed( m_Resources.size(), false );
+    for ( uint32_t r = 0; r < m_Resources.size(); ++r )
+        needed[r] = m_Resources[r].output;
+
+    for ( uint32_t p = static_cast<uint32_t>( m_Passes.size() ); p-- > 0; )
+    {
+        Pass& pass = m_Passes[p];
+
+        bool writes = false;
+        bool useful = false;
+        for ( const PassAccess& access: pass.accesses )
+        {
+            if ( IsWrite( access.access ) )
+            {
+                writes = true;
+                useful = useful || needed[access.resource];
+            }
+        }
+
+        pass.culled = writes && !useful;
+        if ( pass.culled )
+        {
+            ++m_Stats.culledPasses;
+            continue;
+        }
+
+        // A full write ends the interest in older values, then the reads start one.
+        for ( const PassAccess& access: pass.accesses )
+        {
+            if ( access.access == GraphAccess::Write )
+                needed[access.resource] = false;
+        }
+        for ( const PassAccess& access: pass.accesses )
+        {
+            if ( IsRead( access.access ) )
+                needed[access.resource] = true;
+        }
+    }
+
+    // Then forward, tracking per resource the state and whether it was read
+    // or written since its last barrier.
+    m_CompileStates.resize( m_Resources.size() );
+    m_CompileResident.resize( m_Resources.size() );
+    for ( uint32_t r = 0; r < m_Resources.size(); ++r )
+    {
+        m_CompileStates[r]   = m_Resources[r].state;
+        m_CompileResident[r] = m_Resources[r].resident;
+    }
+
+    std::vector<GraphResourceState> states   = m_CompileStates;
+    std::vector<bool>               resident = m_CompileResident;
+    std::vector<bool>               pendingRead( m_Resources.size(), false );
+    std::vector<bool>               pendingWrite( m_Resources.size(), false );
+
+    for ( Pass& pass: m_Passes )
+    {
+        pass.barriers.clear();
+        if ( pass.culled )
+            continue;
+
+        m_Stats.accesses += static_cast<uint32_t>( pass.accesses.size() );
+
+        for ( const PassAccess& access: pass.accesses )
+        {
+            const uint32_t r = access.resource;
+
+            if ( !resident[r] )
+            {
+                // Ahead of the transition, it is in no state until it has the memory.
+                GraphBarrier aliasing;
+                aliasing.type     = GraphBarrier::Type::Aliasing;
+                aliasing.resource = r;
+                aliasing.before   = states[r];
+                aliasing.after    = access.state;
+                pass.barriers.push_back( aliasing );
+                ++m_Stats.aliasing;
+
+                resident[r] = true;
+                for ( uint32_t alias: m_Resources[r].aliases )
+                    resident[alias] = false;
+
+                // What it held is gone, there is nothing to order against.
+                pendingRead[r]  = false;
+                pendingWrite[r] = false;
+            }
+
+            GraphBarrier barrier;
+            barrier.resource = r;
+
+            if ( states[r] != access.state )
+            {
+                // A transition also orders the accesses before and after it.
+                barrier.type   = GraphBarrier::Type::Transition;
+                barrier.before = states[r];
+                barrier.after  = access.state;
+                ++m_Stats.transitions;
+            }
+            else if ( access.state == GraphResourceState::UnorderedAccess &&
+                      ( pendingWrite[r] || ( IsWrite( access.access ) && pendingRead[r] ) ) )
+            {
+                barrier.type   = GraphBarrier::Type::UAV;
+                barrier.before = barrier.after = access.state;
+                ++m_Stats.uavBarriers;
+            }
+            else
+            {
+                continue;
+            }
+
+            pass.barriers.push_back( barrier );
+            states[r]       = access.state;
+            pendingRead[r]  = false;
+            pendingWrite[r] = false;
+        }
+
+        const auto isUAV = []( const GraphBarrier& barrier ) { return barrier.type == GraphBarrier::Type::UAV; };
+        const auto uavBarriers =
+            static_cast<uint32_t>( std::count_if( pass.barriers.begin(), pass.barriers.end(), isUAV ) );
+
+        if ( m_MergeUAVBarriers && uavBarriers > 1 )
+        {
+            pass.barriers.erase( std::remove_if( pass.barriers.begin(), pass.barriers.end(), isUAV ),
+                                 pass.barriers.end() );
+
+            GraphBarrier barrier;
+            barrier.type     = GraphBarrier::Type::UAV;
+            barrier.resource = GraphBarrier::ALL_RESOURCES;
+            barrier.before = barrier.after = GraphResourceState::UnorderedAccess;
+            pass.barriers.push_back( barrier );
+
+            // It also orders the resources nobody asked for.
+            for ( uint32_t r = 0; r < m_Resources.size(); ++r )
+            {
+                if ( states[r] == GraphResourceState::UnorderedAccess )
+                    pendingRead[r] = pendingWrite[r] = false;
+            }
+            m_Stats.uavBarriers -= uavBarriers - 1;
+        }
+
+        for ( const PassAccess& access: pass.accesses )
+        {
+            pendingRead[access.resource]  = pendingRead[access.resource] || IsRead( access.access );
+            pendingWrite[access.resource] = pendingWrite[access.resource] || IsWrite( access.access );
+        }
+    }
+
+    m_Compiled = true;
+}
+
+void RenderGraph::Execute( RenderGraphBackend& backend )
+{
+    if ( !m_Compiled )
+        Compile();
+
+    for ( uint32_t p = 0; p < m_Passes.size(); ++p )
+    {
+        const Pass& pass = m_Passes[p];
+        if ( pass.culled )
+            continue;
+
+        for ( const GraphBarrier& barrier: pass.barriers )
+        {
+            backend.Barrier( barrier );
+            if ( barrier.type == GraphBarrier::Type::Aliasing )
+            {
+                m_Resources[barrier.resource].resident = true;
+                for ( uint32_t alias: m_Resources[barrier.resource].aliases )
+                    m_Resources[alias].resident = false;
+            }
+            else if ( barrier.resource != GraphBarrier::ALL_RESOURCES )
+            {
+                m_Resources[barrier.resource].state = barrier.after;
+            }
+        }
+        if ( !pass.barriers.empty() )
+            backend.FlushBarriers();
+
+        backend.BeginPass( p, pass.name );
+        if ( pass.copy )
+            backend.Copy( pass.copyDst, pass.copySrc );
+        else if ( pass.execute )
+            pass.execute();
+    }
+
+    // The passes are spent, a second Execute needs a new Compile from the new states.
+    m_Compiled = false;
+}
+
+bool RenderGraph::Validate( const std::vector<GraphCommand>& commands, std::string* error ) const
+{
+    if ( m_CompileStates.size() != m_Resources.size() )
+        return Fail( error, "the graph was not compiled" );
+
+    auto resourceName = [this]( uint32_t r ) { return r < m_Resources.size() ? m_Resources[r].name : "?"; };
+
+    // The barriers take effect when they are flushed.
+    std::vector<GraphResourceState> states = m_CompileStates;
+    std::vector<bool>               pendingRead( m_Resources.size(), false );
+    std::vector<bool>               pendingWrite( m_Resources.size(), false );
+    std::vector<GraphBarrier>       unflushed;
+
+    // Whether the resource holds its memory, and whether an alias took its value. One that was not resident when
+    // Compile started was never written, or gave its memory away in an earlier Execute that kept the outputs.
+    std::vector<bool> resident = m_CompileResident;
+    std::vector<bool> lost( m_Resources.size(), false );
+
+    // Whether the last pass writing the resource, culled or not, was culled.
+    std::vector<bool> culledValue( m_Resources.size(), false );
+
+    uint32_t nextPass    = 0;
+    int      currentPass = -1;
+    bool     copied      = false;
+
+    auto finishPass = [&]() {
+        if ( currentPass >= 0 && m_Passes[currentPass].copy && !copied )
+            return Fail( error, "copy pass " + m_Passes[currentPass].name + " did not copy" );
+        return true;
+    };
+
+    for ( const GraphCommand& command: commands )
+    {
+        switch ( command.type )
+        {
+        case GraphCommand::Type::Barrier:
+        {
+            const GraphBarrier& barrier = command.barrier;
+            if ( barrier.type != GraphBarrier::Type::UAV && barrier.resource == GraphBarrier::ALL_RESOURCES )
+                return Fail( error, "transition or aliasing of all resources" );
+            if ( barrier.resource >= m_Resources.size() && barrier.resource != GraphBarrier::ALL_RESOURCES )
+                return Fail( error, "barrier on unknown resource " + std::to_string( barrier.resource ) );
+            unflushed.push_back( barrier );
+            break;
+        }
+
+        case GraphCommand::Type::FlushBarriers:
+            for ( const GraphBarrier& barrier: unflushed )
+            {
+                const uint32_t r = barrier.resource;
+                if ( r == GraphBarrier::ALL_RESOURCES )
+                {
+                    for ( uint32_t i = 0; i < m_Resources.size(); ++i )
+                    {
+                        if ( states[i] == GraphResourceState::UnorderedAccess )
+                            pendingRead[i] = pendingWrite[i] = false;
+                    }
+                    continue;
+                }
+
+                if ( barrier.type == GraphBarrier::Type::Aliasing )
+                {
+                    resident[r] = true;
+                    for ( uint32_t alias: m_Resources[r].aliases )
+                    {
+                        resident[alias] = false;
+                        lost[alias]     = true;
+                    }
+                }
+                else if ( barrier.type == GraphBarrier::Type::Transition )
+                {
+                    if ( barrier.before != states[r] )
+                        return Fail( error, "transition of " + resourceName( r ) + " from " +
+                                                ToString( barrier.before ) + " but it is " + ToString( states[r] ) );
+                    states[r] = barrier.after;
+                }
+                else if ( states[r] != GraphResourceState::UnorderedAccess )
+                {
+                    return Fail( error, "UAV barrier on " + resourceName( r ) + " in " + ToString( states[r] ) );
+                }
+                pendingRead[r]  = false;
+                pendingWrite[r] = false;
+            }
+            unflushed.clear();
+            break;
+
+        case GraphCommand::Type::BeginPass:
+        {
+            if ( !finishPass() )
+                return false;
+            if ( !unflushed.empty() )
+                return Fail( error, "barriers before pass " + command.name + " were not flushed" );
+
+            // Passes run in order, the skipped ones must be culled.
+            for ( ; nextPass < m_Passes.size() && nextPass != command.pass; ++nextPass )
+            {
+                if ( !m_Passes[nextPass].culled )
+                    return Fail( error, "pass " + m_Passes[nextPass].name + " was skipped" );
+                for ( const PassAccess& access: m_Passes[nextPass].accesses )
+                {
+                    if ( IsWrite( access.access ) )
+                        culledValue[access.resource] = true;
+                }
+            }
+            if ( nextPass >= m_Passes.size() )
+                return Fail( error, "pass " + std::to_string( command.pass ) + " out of order" );
+
+            const Pass& pass = m_Passes[nextPass];
+            for ( const PassAccess& access: pass.accesses )
+            {
+                const uint32_t r = access.resource;
+                if ( !resident[r] )
+                    return Fail( error, pass.name + " uses " + resourceName( r ) + " while an alias has its memory" );
+                // A read write may be a partial write, it starts a new value.
+                if ( access.access == GraphAccess::Read && lost[r] )
+                    return Fail( error, pass.name + " reads " + resourceName( r ) + " after it lost its memory" );
+                if ( states[r] != access.state )
+                    return Fail( error, pass.name + " uses " + resourceName( r ) + " as " + ToString( access.state ) +
+                                            " but it is " + ToString( states[r] ) );
+                if ( IsRead( access.access ) && culledValue[r] )
+                    return Fail( error, pass.name + " reads " + resourceName( r ) + " from a culled pass" );
+                if ( access.state == GraphResourceState::UnorderedAccess &&
+                     ( pendingWrite[r] || ( IsWrite( access.access ) && pendingRead[r] ) ) )
+                    return Fail( error, pass.name + " accesses " + resourceName( r ) + " without a UAV barrier" );
+            }
+            for ( const PassAccess& access: pass.accesses )
+            {
+                const uint32_t r = access.resource;
+                pendingRead[r]   = pendingRead[r] || IsRead( access.access );
+                pendingWrite[r]  = pendingWrite[r] || IsWrite( access.access );
+                if ( IsWrite( access.access ) )
+                {
+                    culledValue[r] = false;
+                    lost[r]        = false;
+                }
+            }
+
+            currentPass = static_cast<int>( nextPass++ );
+            copied      = false;
+            break;
+        }
+
+        case GraphCommand::Type::Copy:
+            if ( currentPass < 0 || !m_Passes[currentPass].copy || copied )
+                return Fail( error, "copy outside of a copy pass" );
+            if ( command.dst != m_Passes[currentPass].copyDst || command.src != m_Passes[currentPass].copySrc )
+                return Fail( error, "copy pass " + m_Passes[currentPass].name + " copied the wrong resources" );
+            copied = true;
+            break;
+        }
+    }
+
+    if ( !finishPass() )
+        return false;
+    if ( !unflushed.empty() )
+        return Fail( error, "barriers after the last pass" );
+
+    for ( ; nextPass < m_Passes.size(); ++nextPass )
+    {
+        if ( !m_Passes[nextPass].culled )
+            return Fail( error, "pass " + m_Passes[nextPass].name + " was not run" );
+        for ( const PassAccess& access: m_Passes[nextPass].accesses )
+        {
+            if ( IsWrite( access.access ) )
+                culledValue[access.resource] = true;
+        }
+    }
+
+    for ( uint32_t r = 0; r < m_Resources.size(); ++r )
+    {
+        if ( m_Resources[r].output && culledValue[r] )
+            return Fail( error, "output " + m_Resources[r].name + " comes from a culled pass" );
+        if ( m_Resources[r].output && lost[r] )
+            return Fail( error, "output " + m_Resources[r].name + " lost its memory" );
+    }
+
+    return true;
+}
@@ -0,0 +1,415 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/ResourceRotation.h>
+
+using namespace cpulib;
+
+// Give up looking for the cycle after this many frames, it is at most the product of the pool sizes.
+static const uint32_t MAX_PLANNED_FRAMES = 1024;
+
+static bool IsWrite( SlotAccess access )
+{
+    return access == SlotAccess::Write || access == SlotAccess::WriteHistory;
+}
+
+static bool Fail( std::string* error, const std::string& message )
+{
+    if ( error )
+        *error = message;
+    return false;
+}
+
+uint32_t ResourceRotation::AddResource( const std::string& name, uint32_t bufferCount )
+{
+    assert( bufferCount > 0 );
+
+    Resource resource;
+    resource.name        = name;
+    resource.bufferCount = bufferCount;
+    resource.firstBuffer = m_BufferCount;
+    m_BufferCount += bufferCount;
+
+    m_Resources.push_back( resource );
+    return static_cast<uint32_t>( m_Resources.size() - 1 );
+}
+
+uint32_t ResourceRotation::AddSlot( const std::string& name, uint32_t resource, bool history )
+{
+    assert( resource < m_Resources.size() );
+
+    Slot slot;
+    slot.name     = name;
+    slot.resource = resource;
+    slot.history  = history;
+
+    m_Slots.push_back( slot );
+    return static_cast<uint32_t>( m_Slots.size() - 1 );
+}
+
+uint32_t ResourceRotation::AddStage( const std::string& name )
+{
+    Stage stage;
+    stage.name = name;
+
+    m_Stages.push_back( stage );
+    return static_cast<uint32_t>( m_Stages.size() - 1 );
+}
+
+void ResourceRotation::Access( uint32_t stage, uint32_t slot, SlotAccess access )
+{
+    assert( stage < m_Stages.size() && slot < m_Slots.size() );
+
+    m_Stages[stage].accesses.push_back( { slot, access } );
+}
+
+bool ResourceRotation::Plan( std::string* error )
+{
+    m_Frames.clear();
+    m_BindingSets.clear();
+    m_FirstPeriodicFrame = 0;
+
+    // Checks that do not depend on the buffer assignment.
+    std::vector<uint32_t> historyWrites( m_Resources.size(), 0 );
+    std::vector<bool>     written( m_Resources.size(), false );
+    for ( const Stage& stage: m_Stages )
+    {
+        std::vector<bool> slotSeen( m_Slots.size(), false );
+        std::vector<bool> resourceWritten( m_Resources.size(), false );
+
+        for ( const StageAccess& access: stage.accesses )
+        {
+            const uint32_t    r    = m_Slots[access.slot].resource;
+            const std::string name = stage.name + "/" + m_Slots[access.slot].name;
+
+            if ( slotSeen[access.slot] )
+                return Fail( error, name + " is accessed twice" );
+            slotSeen[access.slot] = true;
+
+            if ( access.access == SlotAccess::Read && !written[r] )
+                return Fail( error, name + " reads " + m_Resources[r].name + " before any stage writes it" );
+
+            if ( IsWrite( access.access ) )
+            {
+                if ( resourceWritten[r] )
+                    return Fail( error, stage.name + " writes " + m_Resources[r].name + " twice" );
+                resourceWritten[r] = true;
+
+                if ( access.access == SlotAccess::WriteHistory )
+                    ++historyWrites[r];
+            }
+        }
+
+        for ( size_t r = 0; r < m_Resources.size(); ++r )
+            written[r] = written[r] || resourceWritten[r];
+    }
+
+    for ( size_t r = 0; r < m_Resources.size(); ++r )
+    {
+        if ( historyWrites[r] > 1 )
+            return Fail( error, m_Resources[r].name + " keeps more than one history per frame" );
+    }
+
+    for ( const Stage& stage: m_Stages )
+    {
+        for ( const StageAccess& access: stage.accesses )
+        {
+            const uint32_t r = m_Slots[access.slot].resource;
+            if ( access.access == SlotAccess::ReadHistory && historyWrites[r] == 0 )
+                return Fail( error, stage.name + "/" + m_Slots[access.slot].name + " reads the history of " +
+                                        m_Resources[r].name + " which no stage keeps" );
+        }
+    }
+
+    // The first frame finds its history in the first buffer of every pool.
+    std::vector<uint32_t> history( m_Resources.size(), ResourceRotation::INVALID );
+    for ( size_t r = 0; r < m_Resources.size(); ++r )
+    {
+        if ( historyWrites[r] )
+            history[r] = 0;
+    }
+
+    // Plan frames until the history lands where it was at the start of an earlier frame.
+    std::vector<std::vector<uint32_t>> frameStarts;
+    while ( true )
+    {
+        auto seen = std::find( frameStarts.begin(), frameStarts.end(), history );
+        if ( seen != frameStarts.end() )
+        {
+            m_FirstPeriodicFrame = static_cast<uint32_t>( seen - frameStarts.begin() );
+            break;
+        }
+
+        if ( frameStarts.size() == MAX_PLANNED_FRAMES )
+            return Fail( error, "the buffer assignment does not repeat" );
+
+        frameStarts.push_back( history );
+
+        Frame frame;
+        if ( !PlanFrame( history, frame, error ) )
+        {
+            m_Frames.clear();
+            m_BindingSets.clear();
+            return false;
+        }
+        m_Frames.push_back( frame );
+    }
+
+    return true;
+}
+
+bool ResourceRotation::PlanFrame( std::vector<uint32_t>& history, Frame& frame, std::string* error )
+{
+    const uint32_t numResources = static_cast<uint32_t>( m_Resources.size() );
+    const uint32_t numStages    = static_cast<uint32_t>( m_Stages.size() );
+
+    // The history buffer of a resource is free after its last ReadHistory.
+    std::vector<int> lastHistoryRead( numResources, -1 );
+    for ( uint32_t s = 0; s < numStages; ++s )
+    {
+        for ( const StageAccess& access: m_Stages[s].accesses )
+        {
+            if ( access.access == SlotAccess::ReadHistory )
+                lastHistoryRead[m_Slots[access.slot].resource] = static_cast<int>( s );
+        }
+    }
+
+    // Buffers are local to the pool in here.
+    std::vector<uint32_t> current( numResources, ResourceRotation::INVALID );
+    std::vector<uint32_t> kept( numResources, ResourceRotation::INVALID );
+
+    for ( uint32_t s = 0; s < numStages; ++s )
+    {
+        const Stage& stage = m_Stages[s];
+
+        std::vector<bool> reads( numResources, false );
+        for ( const StageAccess& access: stage.accesses )
+        {
+            if ( access.access == SlotAccess::Read )
+                reads[m_Slots[access.slot].resource] = true;
+        }
+
+        // Slots the stage does not access see the current value, or the history.
+        std::vector<uint32_t> bindings( m_Slots.size() );
+        for ( size_t i = 0; i < m_Slots.size(); ++i )
+        {
+            const uint32_t r      = m_Slots[i].resource;
+            uint32_t       buffer = m_Slots[i].history ? history[r] : current[r];
+            if ( buffer == ResourceRotation::INVALID )
+                buffer = history[r] != ResourceRotation::INVALID ? history[r] : 0;
+            bindings[i] = m_Resources[r].firstBuffer + buffer;
+        }
+
+        std::vector<uint32_t> next = current;
+        for ( const StageAccess& access: stage.accesses )
+        {
+            const uint32_t  r        = m_Slots[access.slot].resource;
+            const Resource& resource = m_Resources[r];
+
+            if ( access.access == SlotAccess::ReadHistory )
+            {
+                bindings[access.slot] = resource.firstBuffer + history[r];
+                continue;
+            }
+
+            if ( access.access == SlotAccess::Read )
+            {
+                bindings[access.slot] = resource.firstBuffer + current[r];
+                continue;
+            }
+
+            // Write to the lowest buffer that holds nothing still needed.
+            uint32_t target = ResourceRotation::INVALID;
+            for ( uint32_t b = 0; b < resource.bufferCount && target == ResourceRotation::INVALID; ++b )
+            {
+                bool live = ( b == history[r] && lastHistoryRead[r] >= static_cast<int>( s ) ) ||
+                            ( b == current[r] && reads[r] ) || b == kept[r];
+                if ( !live )
+                    target = b;
+            }
+
+            if ( target == ResourceRotation::INVALID )
+                return Fail( error, stage.name + " needs more than " + std::to_string( resource.bufferCount ) +
+                                        " buffers of " + resource.name );
+
+            bindings[access.slot] = resource.firstBuffer + target;
+            next[r]               = target;
+            if ( access.access == SlotAccess::WriteHistory )
+                kept[r] = target;
+        }
+        current = next;
+
+        frame.bindingSets.push_back( AddBindingSet( bindings ) );
+    }
+
+    frame.historyBuffers.assign( numResources, ResourceRotation::INVALID );
+    for ( uint32_t r = 0; r < numResources; ++r )
+    {
+        if ( kept[r] == ResourceRotation::INVALID )
+            continue;
+
+        history[r]              = kept[r];
+        frame.historyBuffers[r] = m_Resources[r].firstBuffer + kept[r];
+    }
+
+    return true;
+}
+
+uint32_t ResourceRotation::AddBindingSet( const std::vector<uint32_t>& bindings )
+{
+    auto found = std::find( m_BindingSets.begin(), m_BindingSets.end(), bindings );
+    if ( found != m_BindingSets.end() )
+        return static_cast<uint32_t>( found - m_BindingSets.begin() );
+
+    m_BindingSets.push_back( bindings );
+    return static_cast<uint32_t>( m_BindingSets.size() - 1 );
+}
+
+const ResourceRotation::Frame& ResourceRotation::GetFrame( uint64_t frame ) const
+{
+    assert( !m_Frames.empty() );
+
+    if ( frame >= m_Frames.size() )
+        frame = m_FirstPeriodicFrame + ( frame - m_FirstPeriodicFrame ) % GetFramePeriod();
+
+    return m_Frames[frame];
+}
+
+uint32_t ResourceRotation::GetBindingSet( uint64_t frame, uint32_t stage ) const
+{
+    return GetFrame( frame ).bindingSets[stage];
+}
+
+std::vector<uint32_t> ResourceRotation::GetHistoryBuffers( uint64_t frame ) const
+{
+    std::vector<uint32_t> buffers;
+    for ( uint32_t buffer: GetFrame( frame ).historyBuffers )
+    {
+        if ( buffer != ResourceRotation::INVALID )
+            buffers.push_back( buffer );
+    }
+    return buffers;
+}
+
+bool ResourceRotation::Validate( std::string* error ) const
+{
+    if ( m_Frames.empty() )
+        return Fail( error, "nothing planned" );
+
+    // Every write gets a new tag, a buffer holds the tag of the last write to it, 0 is undefined.
+    std::vector<uint64_t> contents( m_BufferCount, 0 );
+    std::vector<uint64_t> history( m_Resources.size(), 0 );
+    uint64_t              tag = 0;
+
+    // The transient frames and the cycle twice, so the history is handed over the wrap around as well.
+    const uint64_t numFrames = m_FirstPeriodicFrame + 2 * static_cast<uint64_t>( GetFramePeriod() ) + 1;
+
+    for ( uint64_t f = 0; f < numFrames; ++f )
+    {
+        std::vector<uint64_t> latest( m_Resources.size(), 0 );
+        std::vector<uint64_t> nextHistory = history;
+
+        for ( uint32_t s = 0; s < m_Stages.size(); ++s )
+        {
+            const Stage&                 stage    = m_Stages[s];
+            const std::vector<uint32_t>& bindings = m_BindingSets[GetBindingSet( f, s )];
+            const std::string            where    = "frame " + std::to_string( f ) + " " + stage.name;
+
+            if ( bindings.size() != m_Slots.size() )
+                return Fail( error, where + " binds " + std::to_string( bindings.size() ) + " slots" );
+
+            for ( size_t i = 0; i < m_Slots.size(); ++i )
+            {
+                const Resource& resource = m_Resources[m_Slots[i].resource];
+                if ( bindings[i] < resource.firstBuffer || bindings[i] >= resource.firstBuffer + resource.bufferCount )
+                    return Fail( error, where + "/" + m_Slots[i].name + " is bound to a buffer of another resource" );
+            }
+
+            std::vector<uint32_t> readBuffers;
+            std::vector<uint32_t> writeBuffers;
+            for ( const StageAccess& access: stage.accesses )
+            {
+                const uint32_t    r      = m_Slots[access.slot].resource;
+                const uint32_t    buffer = bindings[access.slot];
+                const std::string name   = where + "/" + m_Slots[access.slot].name;
+
+                switch ( access.access )
+                {
+                case SlotAccess::Read:
+                    if ( latest[r] == 0 || contents[buffer] != latest[r] )
+                        return Fail( error, name + " does not see the current " + m_Resources[r].name );
+                    readBuffers.push_back( buffer );
+                    break;
+                case SlotAccess::ReadHistory:
+                    // The first frame has no history to compare with.
+                    if ( f > 0 && contents[buffer] != history[r] )
+                        return Fail( error, name + " does not see the history of " + m_Resources[r].name );
+                    readBuffers.push_back( buffer );
+                    break;
+                case SlotAccess::Write:
+                case SlotAccess::WriteHistory:
+                    writeBuffers.push_back( buffer );
+                    break;
+                }
+            }
+
+            for ( size_t i = 0; i < writeBuffers.size(); ++i )
+            {
+                if ( std::find( readBuffers.begin(), readBuffers.end(), writeBuffers[i] ) != readBuffers.end() )
+                    return Fail( error, where + " reads buffer " + std::to_string( writeBuffers[i] ) +
+                                            " while writing it" );
+
+                if ( std::find( writeBuffers.begin() + i + 1, writeBuffers.end(), writeBuffers[i] ) !=
+                     writeBuffers.end() )
+                    return Fail( error, where + " writes buffer " + std::to_string( writeBuffers[i] ) + " twice" );
+            }
+
+            for ( const StageAccess& access: stage.accesses )
+            {
+                if ( !IsWrite( access.access ) )
+                    continue;
+
+                const uint32_t r = m_Slots[access.slot].resource;
+
+                contents[bindings[access.slot]] = ++tag;
+                latest[r]                       = tag;
+                if ( access.access == SlotAccess::WriteHistory )
+                    nextHistory[r] = tag;
+            }
+        }
+
+        history = nextHistory;
+    }
+
+    return true;
+}
+
+std::string ResourceRotation::Describe() const
+{
+    auto bufferName = [this]( uint32_t slot, uint32_t buffer ) {
+        const Resource& resource = m_Resources[m_Slots[slot].resource];
+        return resource.name + "#" + std::to_string( buffer - resource.firstBuffer );
+    };
+
+    std::ostringstream out;
+    out << m_BindingSets.size() << " binding sets, cycle of " << GetFramePeriod() << " frames from frame "
+        << m_FirstPeriodicFrame << "\n";
+
+    for ( uint32_t f = 0; f < m_Frames.size(); ++f )
+    {
+        for ( uint32_t s = 0; s < m_Stages.size(); ++s )
+        {
+            const uint32_t               set      = m_Frames[f].bindingSets[s];
+            const std::vector<uint32_t>& bindings = m_BindingSets[set];
+
+            out << "frame " << f << " " << m_Stages[s].name << " [set " << set << "]";
+            for ( const StageAccess& access: m_Stages[s].accesses )
+            {
+                out << " " << m_Slots[access.slot].name << ( IsWrite( access.access ) ? "<-" : "->" )
+                    << bufferName( access.slot, bindings[access.slot] );
+            }
+            out << "\n";
+        }
+    }
+
+    return out.str();
+}
@@ -0,0 +1,592 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/SvgfDenoiser.h>
+
+#include <cpulib/ThreadPool.h>
+
+#include "SvgfKernels.h"
+
+#if defined( CPULIB_AVX2 ) && defined( _MSC_VER )
+    #include <intrin.h>
+#endif
+
+using namespace cpulib;
+
+// Tile size of every pass, a-trous rows inside a tile are walked 8 pixels at a time.
+static const uint32_t TILE_SIZE = 64;
+
+float cpulib::ScalarLanes::ExpExact( float x )
+{
+    return std::exp( x );
+}
+
+float cpulib::ScalarLanes::PowExact( float x, float y )
+{
+    return std::pow( x, y );
+}
+
+static double MsSince( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static void CopyPlane( ThreadPool& pool, const ImageF& src, ImageF& dst )
+{
+    const uint32_t width = src.GetWidth();
+    pool.ParallelFor( src.GetHeight(), [&]( uint32_t y ) {
+        std::memcpy( dst.GetRow( y ), src.GetRow( y ), width * sizeof( float ) );
+    } );
+}
+
+bool SvgfDenoiser::IsAVX2Supported()
+{
+#if defined( CPULIB_AVX2 )
+    #if defined( _MSC_VER )
+    int info[4];
+    __cpuid( info, 1 );
+    // The OS has to save the ymm registers as well.
+    bool osxsave = ( info[2] & ( 1 << 27 ) ) != 0;
+    if ( !osxsave || ( _xgetbv( 0 ) & 6 ) != 6 )
+        return false;
+
+    __cpuidex( info, 7, 0 );
+    return ( info[1] & ( 1 << 5 ) ) != 0;
+    #else
+    return __builtin_cpu_supports( "avx2" );
+    #endif
+#else
+    return false;
+#endif
+}
+
+SvgfDenoiser::SvgfDenoiser( ThreadPool& pool, const DenoiserSettings& settings )
+: m_Pool( pool )
+, m_Settings( settings )
+{}
+
+void SvgfDenoiser::Reset()
+{
+    m_HasHistory = false;
+}
+
+void SvgfDenoiser::Resize( uint32_t width, uint32_t height )
+{
+    m_Width      = width;
+    m_Height     = height;
+    m_HasHistory = false;
+
+    auto resize = [&]( ImageF* planes, int count ) {
+        for ( int i = 0; i < count; ++i )
+            planes[i].Resize( width, height, 0.0f );
+    };
+
+    resize( m_Colour, 3 );
+    resize( m_Normal, 3 );
+    resize( m_Pos, 3 );
+    resize( &m_Depth, 1 );
+    resize( m_Object, 4 );
+
+    resize( m_HistColour, 3 );
+    resize( m_HistNormal, 3 );
+    resize( m_HistPos, 3 );
+    resize( m_HistObject, 4 );
+    resize( m_HistMoments, 4 );
+
+    resize( m_ColourSource, 4 );
+    resize( m_ColourTarget, 4 );
+    resize( m_MomentSource, 4 );
+    resize( m_MomentTarget, 4 );
+    resize( m_Sdr, 3 );
+}
+
+void SvgfDenoiser::LoadFrame( const RayBuffer& frame )
+{
+    m_Pool.ParallelFor( m_Height, [&]( uint32_t y ) {
+        const float4* colour   = frame.Colour().GetRow( y );
+        const float4* normals  = frame.Normals().GetRow( y );
+        const float4* posDepth = frame.PosDepth().GetRow( y );
+        const float4* object   = frame.ObjectMask().GetRow( y );
+
+        for ( uint32_t x = 0; x < m_Width; ++x )
+        {
+            m_Colour[0]( x, y ) = colour[x].x;
+            m_Colour[1]( x, y ) = colour[x].y;
+            m_Colour[2]( x, y ) = colour[x].z;
+
+            float3 n = normalize( normals[x].xyz() * 2.0f - float3( 1.0f ) );
+            for ( int i = 0; i < 3; ++i )
+                m_Normal[i]( x, y ) = n[i];
+
+            m_Pos[0]( x, y ) = posDepth[x].x;
+            m_Pos[1]( x, y ) = posDepth[x].y;
+            m_Pos[2]( x, y ) = posDepth[x].z;
+            m_Depth( x, y )  = posDepth[x].w;
+
+            m_Object[0]( x, y ) = object[x].x;
+            m_Object[1]( x, y ) = object[x].y;
+            m_Object[2]( x, y ) = object[x].z;
+            m_Object[3]( x, y ) = object[x].w;
+        }
+    } );
+}
+
+DenoiserStats SvgfDenoiser::Denoise( const RayBuffer& frame, const DenoiserCamera& camera )
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if ( frame.GetWidth() != m_Width || frame.GetHeight() != m_Height )
+        Resize( frame.GetWidth(), frame.GetHeight() );
+
+    DenoiserStats stats;
+    if ( m_Width == 0 || m_Height == 0 )
+        return stats;
+
+    LoadFrame( frame );
+
+    auto passStart       = std::chrono::steady_clock::now();
+    stats.reusedPixels   = Reproject( camera );
+    stats.reprojectionMs = MsSince( passStart );
+
+    for ( int i = 0; i < 4; ++i )
+    {
+        std::swap( m_ColourSource[i], m_ColourTarget[i] );
+        std::swap( m_MomentSource[i], m_MomentTarget[i] );
+    }
+
+    passStart                   = std::chrono::steady_clock::now();
+    stats.spatialVariancePixels = Moments( frame );
+    stats.momentsMs             = MsSince( passStart );
+
+    for ( int i = 0; i < 4; ++i )
+    {
+        std::swap( m_ColourSource[i], m_ColourTarget[i] );
+        // The a-trous passes only need the step size, which is the same for every pixel.
+        std::swap( m_HistMoments[i], m_MomentTarget[i] );
+    }
+
+    passStart            = std::chrono::steady_clock::now();
+    const int iterations = std::max( 1, m_Settings.atrousIterations );
+    for ( int i = 0; i < iterations; ++i )
+    {
+        stats.usedAVX2 = Atrous( m_Settings.dyadicSteps ? 1 << i : i );
+
+        for ( int c = 0; c < 4; ++c )
+            std::swap( m_ColourSource[c], m_ColourTarget[c] );
+
+        // The integrated colour history is the output of the first iteration.
+        if ( i == 0 )
+        {
+            for ( int c = 0; c < 3; ++c )
+                CopyPlane( m_Pool, m_ColourSource[c], m_HistColour[c] );
+        }
+    }
+    stats.atrousMs = MsSince( passStart );
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        std::swap( m_HistNormal[i], m_Normal[i] );
+        std::swap( m_HistPos[i], m_Pos[i] );
+    }
+    for ( int i = 0; i < 4; ++i )
+        std::swap( m_HistObject[i], m_Object[i] );
+
+    m_HasHistory  = true;
+    stats.totalMs = MsSince( start );
+
+    return stats;
+}
+
+uint64_t SvgfDenoiser::Reproject( const DenoiserCamera& camera )
+{
+    const float2 resolution( static_cast<float>( m_Width ), static_cast<float>( m_Height ) );
+    const float  aspectRatio = camera.cameraWindowSize.x / camera.cameraWindowSize.y;
+    const float  alpha       = m_Settings.alpha;
+    const float  errorLimit  = m_Settings.reprojectErrorLimit;
+    const bool   history     = m_HasHistory;
+
+    auto inside = [&]( int2 q ) {
+        return q.x >= 0 && q.y >= 0 && q.x < static_cast<int>( m_Width ) && q.y < static_cast<int>( m_Height );
+    };
+
+    // Previous frame's clip space position in [0, 1].
+    auto project = [&]( const float3x4& worldToClip, float3 pos ) {
+        float3 clip = mul( worldToClip, pos.x, pos.y, pos.z, 1.0f );
+        float2 uv( clip.x / aspectRatio / clip.z, clip.y / clip.z );
+        return float2( uv.x * 0.5f + 0.5f, uv.y * 0.5f + 0.5f );
+    };
+
+    /*
+        BilienarTapFilter of SVGF_reprojection.hlsl. The shader runs i <= 4 over
+        the 4 taps, the fifth read is out of bounds of the array and skipped here.
+    */
+    auto bilinearTap = [&]( float2 oldUv, float2 newUv, float3 normal, float3 worldPos, float3 obj, float mask,
+                            float3& oldIntegratedColour, float& histLength ) {
+        float2 st( oldUv.x * resolution.x, oldUv.y * resolution.y );
+        float2 ab( st.x - 0.5f - std::floor( st.x - 0.5f ), st.y - 0.5f - std::floor( st.y - 0.5f ) );
+        int2   uv00( static_cast<int>( std::nearbyint( st.x - ab.x ) ),
+                   static_cast<int>( std::nearbyint( st.y - ab.y ) ) );
+
+        ab = float2( 1.0f - ab.x, 1.0f - ab.y );
+
+        const float alphaBeta[4] = { ab.x * ab.y, ab.x * ( 1 - ab.y ), ( 1 - ab.x ) * ( 1 - ab.y ),
+                                     ( 1 - ab.x ) * ab.y };
+        const int2  samples[4]   = { uv00, uv00 + int2( 0, 1 ), uv00 + int2( 1, 1 ), uv00 + int2( 1, 0 ) };
+
+        float3 integrated( 0.0f );
+        float  weightSum   = 0;
+        float  lowest      = std::numeric_limits<float>::infinity();
+        int    sampleCount = 0;
+
+        for ( int i = 0; i < 4; ++i )
+        {
+            int2 q = samples[i];
+            if ( !inside( q ) )
+                continue;
+
+            float3 histObj( m_HistObject[0][q], m_HistObject[1][q], m_HistObject[2][q] );
+            if ( dot( histObj - obj, histObj - obj ) != 0 )
+                continue;
+
+            float3 histNormal( m_HistNormal[0][q], m_HistNormal[1][q], m_HistNormal[2][q] );
+            if ( dot( histNormal, normal ) <= 0.98f )
+                continue;
+
+            float3 histPos( m_HistPos[0][q], m_HistPos[1][q], m_HistPos[2][q] );
+            if ( length( histPos - worldPos ) > errorLimit )
+                continue;
+
+            // Transparent materials only reuse an unmoved pixel.
+            if ( ( mask != 0 || m_HistObject[3][q] != 0 ) && length( oldUv - newUv ) != 0 )
+                continue;
+
+            integrated += float3( m_HistColour[0][q], m_HistColour[1][q], m_HistColour[2][q] ) * alphaBeta[i];
+            weightSum += alphaBeta[i];
+            lowest = std::fmax( std::fmin( lowest, m_HistMoments[2][q] ), 0.0f );
+            ++sampleCount;
+        }
+
+        histLength = lowest;
+        if ( sampleCount == 0 )
+        {
+            oldIntegratedColour = float3( 0.0f );
+            return false;
+        }
+
+        oldIntegratedColour = integrated / std::max( weightSum, SVGF_EPSILON );
+        return true;
+    };
+
+    std::atomic<uint64_t> reused { 0 };
+
+    m_Pool.ParallelForTiles( m_Width, m_Height, TILE_SIZE, [&]( const Tile& tile ) {
+        uint64_t tileReused = 0;
+
+        for ( uint32_t y = tile.y0; y < tile.y1; ++y )
+        {
+            for ( uint32_t x = tile.x0; x < tile.x1; ++x )
+            {
+                float3 worldPos( m_Pos[0]( x, y ), m_Pos[1]( x, y ), m_Pos[2]( x, y ) );
+
+                float2 oldPos = project( camera.oldCameraWorldToClip, worldPos );
+                float2 newPos = project( camera.newCameraWorldToClip, worldPos );
+
+                // Can land one past the last pixel, reading zero like the UAV would.
+                int2 newRayPixelPos(
+                    static_cast<int>( std::nearbyint( Saturate<ScalarLanes>( newPos.x ) * resolution.x ) ),
+                    static_cast<int>( std::nearbyint( Saturate<ScalarLanes>( newPos.y ) * resolution.y ) ) );
+
+                float3 newRadiance( 0.0f );
+                float3 newNormal = normalize( float3( -1.0f ) );
+                float4 newObjMask( 0.0f );
+                if ( inside( newRayPixelPos ) )
+                {
+                    int2 q      = newRayPixelPos;
+                    newRadiance = float3( m_Colour[0][q], m_Colour[1][q], m_Colour[2][q] );
+                    newNormal   = float3( m_Normal[0][q], m_Normal[1][q], m_Normal[2][q] );
+                    newObjMask  = float4( m_Object[0][q], m_Object[1][q], m_Object[2][q], m_Object[3][q] );
+                }
+
+                float3 oldIntegratedColour( 0.0f );
+                float  oldHistLength = 0;
+                bool   reuseSample   = false;
+
+                if ( history && oldPos.x >= 0 && oldPos.x < 1 && oldPos.y >= 0 && oldPos.y < 1 )
+                {
+                    reuseSample = bilinearTap( oldPos, newPos, newNormal, worldPos, newObjMask.xyz(), newObjMask.w,
+                                               oldIntegratedColour, oldHistLength );
+                }
+
+                float3 colour;
+                float  histLength;
+                if ( reuseSample )
+                {
+                    histLength = std::floor( oldHistLength ) + 1;
+                    colour     = newRadiance * alpha + oldIntegratedColour * ( 1 - alpha );
+                    ++tileReused;
+                }
+                else
+                {
+                    histLength = 1;
+                    colour     = float3( Saturate<ScalarLanes>( newRadiance.x ), Saturate<ScalarLanes>( newRadiance.y ),
+                                     Saturate<ScalarLanes>( newRadiance.z ) );
+                }
+
+                float lum = Luminance<ScalarLanes>( colour.x, colour.y, colour.z );
+
+                m_ColourTarget[0]( x, y ) = colour.x;
+                m_ColourTarget[1]( x, y ) = colour.y;
+                m_ColourTarget[2]( x, y ) = colour.z;
+                m_ColourTarget[3]( x, y ) = 0;
+
+                m_MomentTarget[0]( x, y ) = lum;
+                m_MomentTarget[1]( x, y ) = lum * lum;
+                m_MomentTarget[2]( x, y ) = histLength;
+                m_MomentTarget[3]( x, y ) = 0;
+            }
+        }
+
+        reused += tileReused;
+    } );
+
+    return reused;
+}
+
+/*
+    One SVGF_moments.hlsl thread. Pixels with less than 4 frames of history
+    estimate their variance from a 7x7 neighbourhood instead.
+*/
+template<bool Exact>
+static void MomentsPixel( const RayBuffer& frame, const DenoiserSettings& settings, const ImageF* colourSource,
+                          const ImageF* momentSource, const ImageF* normal, const ImageF& depth,
+                          ImageF* colourTarget, ImageF* momentTarget, int x, int y, uint64_t& spatialPixels )
+{
+    using L = ScalarLanes;
+
+    const int width  = static_cast<int>( depth.GetWidth() );
+    const int height = static_cast<int>( depth.GetHeight() );
+
+    auto inside = [&]( int qx, int qy ) {
+        return qx >= 0 && qx < width && qy >= 0 && qy < height;
+    };
+
+    float moments[4] = { momentSource[0]( x, y ), momentSource[1]( x, y ), momentSource[2]( x, y ),
+                         momentSource[3]( x, y ) };
+    uint32_t histLength = static_cast<uint32_t>( moments[2] );
+
+    float centreColour[4] = { colourSource[0]( x, y ), colourSource[1]( x, y ), colourSource[2]( x, y ),
+                              colourSource[3]( x, y ) };
+
+    if ( histLength < 4 )
+    {
+        float3 centreNormal( normal[0]( x, y ), normal[1]( x, y ), normal[2]( x, y ) );
+        float  centreDepth = depth( x, y );
+
+        auto fetchDepth = [&]( int qx, int qy ) {
+            return inside( qx, qy ) ? depth( qx, qy ) : centreDepth;
+        };
+        float maxVert = std::max( std::abs( centreDepth - fetchDepth( x - 1, y ) ),
+                                  std::abs( centreDepth - fetchDepth( x + 1, y ) ) );
+        float maxHori = std::max( std::abs( centreDepth - fetchDepth( x, y - 1 ) ),
+                                  std::abs( centreDepth - fetchDepth( x, y + 1 ) ) );
+        float gradient = std::max( maxVert, maxHori );
+
+        float sumWeight    = 1.0f;
+        float sumColour[4] = { centreColour[0], centreColour[1], centreColour[2], centreColour[3] };
+        float sumMoment[2] = { moments[0], moments[1] };
+
+        for ( int yOffset = -3; yOffset <= 3; ++yOffset )
+        {
+            for ( int xOffset = -3; xOffset <= 3; ++xOffset )
+            {
+                int qx = x + xOffset;
+                int qy = y + yOffset;
+                if ( ( xOffset == 0 && yOffset == 0 ) || !inside( qx, qy ) )
+                    continue;
+
+                float2 currentMoment;
+                if ( settings.momentsFromNormals )
+                {
+                    const float4& packed = frame.Normals()( qx, qy );
+                    currentMoment        = float2( packed.x, packed.y );
+                }
+                else
+                {
+                    currentMoment = float2( momentSource[0]( qx, qy ), momentSource[1]( qx, qy ) );
+                }
+
+                float3 currNormal( normal[0]( qx, qy ), normal[1]( qx, qy ), normal[2]( qx, qy ) );
+                float  weightNormal = Pow<L, Exact>( L::Max( dot( centreNormal, currNormal ), 0.0f ), 30.0f );
+
+                float weightDepth = std::abs( centreDepth - depth( qx, qy ) ) /
+                                    ( length( float2( gradient * xOffset, gradient * yOffset ) ) * settings.sigmaDepth +
+                                      SVGF_EPSILON );
+
+                float w = Exp<L, Exact>( 0.0f - L::Max( weightDepth, 0.0f ) ) * weightNormal;
+                if ( std::isnan( w ) )
+                    w = 0;
+
+                sumMoment[0] += currentMoment.x * w;
+                sumMoment[1] += currentMoment.y * w;
+                for ( int c = 0; c < 4; ++c )
+                    sumColour[c] += w * colourSource[c]( qx, qy );
+                sumWeight += w;
+            }
+        }
+
+        for ( int c = 0; c < 4; ++c )
+            sumColour[c] /= sumWeight;
+        sumMoment[0] /= sumWeight;
+        sumMoment[1] /= sumWeight;
+
+        float variance = std::max( 0.0f, sumMoment[1] - sumMoment[0] * sumMoment[0] );
+
+        // give the variance a boost for the first frames
+        variance *= 4.0f / std::max( 1.0f, static_cast<float>( histLength ) );
+
+        colourTarget[0]( x, y ) = sumColour[0];
+        colourTarget[1]( x, y ) = sumColour[1];
+        colourTarget[2]( x, y ) = sumColour[2];
+        colourTarget[3]( x, y ) = variance;
+
+        moments[0] = sumMoment[0];
+        moments[1] = sumMoment[1];
+
+        ++spatialPixels;
+    }
+    else
+    {
+        for ( int c = 0; c < 4; ++c )
+            colourTarget[c]( x, y ) = centreColour[c];
+    }
+
+    // initial step size
+    moments[3] = 0;
+
+    for ( int c = 0; c < 4; ++c )
+        momentTarget[c]( x, y ) = moments[c];
+}
+
+uint64_t SvgfDenoiser::Moments( const RayBuffer& frame )
+{
+    const bool exact = m_Settings.mode == DenoiserMode::Exact;
+
+    std::atomic<uint64_t> spatial { 0 };
+
+    m_Pool.ParallelForTiles( m_Width, m_Height, TILE_SIZE, [&]( const Tile& tile ) {
+        uint64_t tileSpatial = 0;
+
+        for ( uint32_t y = tile.y0; y < tile.y1; ++y )
+        {
+            for ( uint32_t x = tile.x0; x < tile.x1; ++x )
+            {
+                if ( exact )
+                    MomentsPixel<true>( frame, m_Settings, m_ColourSource, m_MomentSource, m_Normal, m_Depth,
+                                        m_ColourTarget, m_MomentTarget, x, y, tileSpatial );
+                else
+                    MomentsPixel<false>( frame, m_Settings, m_ColourSource, m_MomentSource, m_Normal, m_Depth,
+                                         m_ColourTarget, m_MomentTarget, x, y, tileSpatial );
+            }
+        }
+
+        spatial += tileSpatial;
+    } );
+
+    return spatial;
+}
+
+bool SvgfDenoiser::Atrous( int step )
+{
+    SvgfAtrousArgs args;
+    for ( int c = 0; c < 4; ++c )
+    {
+        args.colour[c]    = m_ColourSource[c].GetData();
+        args.outColour[c] = m_ColourTarget[c].GetData();
+    }
+    for ( int c = 0; c < 3; ++c )
+    {
+        args.normal[c] = m_Normal[c].GetData();
+        args.object[c] = m_Object[c].GetData();
+        args.outSdr[c] = m_Sdr[c].GetData();
+    }
+    args.depth          = m_Depth.GetData();
+    args.width          = static_cast<int>( m_Width );
+    args.height         = static_cast<int>( m_Height );
+    args.step           = step;
+    args.sigmaDepth     = m_Settings.sigmaDepth;
+    args.sigmaNormal    = m_Settings.sigmaNormal;
+    args.sigmaLuminance = m_Settings.sigmaLuminance;
+
+    const bool exact = m_Settings.mode == DenoiserMode::Exact;
+    const bool avx2  = !exact && m_Settings.simd && IsAVX2Supported();
+
+#if defined( CPULIB_AVX2 )
+    // The 8 wide kernel needs the gradient neighbours and every tap of its pixels inside the row.
+    const int simdBegin = std::max( 1, 2 * std::abs( step ) );
+    const int simdEnd   = args.width - simdBegin;
+#endif
+
+    m_Pool.ParallelForTiles( m_Width, m_Height, TILE_SIZE, [&]( const Tile& tile ) {
+        for ( int y = static_cast<int>( tile.y0 ); y < static_cast<int>( tile.y1 ); ++y )
+        {
+            int x = static_cast<int>( tile.x0 );
+            while ( x < static_cast<int>( tile.x1 ) )
+            {
+#if defined( CPULIB_AVX2 )
+                if ( avx2 && x >= simdBegin )
+                {
+                    int blocks = ( std::min( static_cast<int>( tile.x1 ), simdEnd ) - x ) / 8;
+                    if ( blocks > 0 )
+                    {
+                        SvgfAtrousBlocksAVX2( args, x, y, blocks );
+                        x += blocks * 8;
+                        continue;
+                    }
+                }
+#endif
+                if ( exact )
+                    AtrousPixels<ScalarLanes, true, true>( args, x, y );
+                else
+                    AtrousPixels<ScalarLanes, false, true>( args, x, y );
+                ++x;
+            }
+        }
+    } );
+
+    return avx2;
+}
+
+void SvgfDenoiser::GetOutput( ImageF4& sdr ) const
+{
+    sdr.Resize( m_Width, m_Height );
+    m_Pool.ParallelFor( m_Height, [&]( uint32_t y ) {
+        float4* row = sdr.GetRow( y );
+        for ( uint32_t x = 0; x < m_Width; ++x )
+            row[x] = float4( m_Sdr[0]( x, y ), m_Sdr[1]( x, y ), m_Sdr[2]( x, y ), 1.0f );
+    } );
+}
+
+void SvgfDenoiser::GetColour( ImageF4& colour ) const
+{
+    colour.Resize( m_Width, m_Height );
+    m_Pool.ParallelFor( m_Height, [&]( uint32_t y ) {
+        float4* row = colour.GetRow( y );
+        for ( uint32_t x = 0; x < m_Width; ++x )
+        {
+            row[x] = float4( m_ColourSource[0]( x, y ), m_ColourSource[1]( x, y ), m_ColourSource[2]( x, y ),
+                             m_ColourSource[3]( x, y ) );
+        }
+    } );
+}
+
+void SvgfDenoiser::GetMomentHistory( ImageF4& moments ) const
+{
+    moments.Resize( m_Width, m_Height );
+    m_Pool.ParallelFor( m_Height, [&]( uint32_t y ) {
+        float4* row = moments.GetRow( y );
+        for ( uint32_t x = 0; x < m_Width; ++x )
+        {
+            row[x] = float4( m_HistMoments[0]( x, y ), m_HistMoments[1]( x, y ), m_HistMoments[2]( x, y ),
+                             m_HistMoments[3]( x, y ) );
+        }
+    } );
+}
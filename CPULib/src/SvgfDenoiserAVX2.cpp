@@ -0,0 +1,125 @@
+/*
+ *  8 wide a-trous kernel of SvgfDenoiser. This unit alone is compiled with
+ *  AVX2 enabled (see CPULIB_AVX2 in CMakeLists.txt) and is only called after
+ *  SvgfDenoiser::IsAVX2Supported() said yes. It does not use the precompiled
+ *  header, which is built without AVX2.
+ */
+
+#include "SvgfKernels.h"
+
+#if defined( CPULIB_AVX2 )
+
+#include <immintrin.h>
+
+namespace cpulib
+{
+namespace
+{
+
+struct Avx2Lanes
+{
+    using F = __m256;
+    using M = __m256;
+
+    static const int Width = 8;
+
+    static F Load( const float* p )
+    {
+        return _mm256_loadu_ps( p );
+    }
+    static void Store( float* p, F v )
+    {
+        _mm256_storeu_ps( p, v );
+    }
+    static F Set( float s )
+    {
+        return _mm256_set1_ps( s );
+    }
+
+    static F Add( F a, F b )
+    {
+        return _mm256_add_ps( a, b );
+    }
+    static F Sub( F a, F b )
+    {
+        return _mm256_sub_ps( a, b );
+    }
+    static F Mul( F a, F b )
+    {
+        return _mm256_mul_ps( a, b );
+    }
+    static F Div( F a, F b )
+    {
+        return _mm256_div_ps( a, b );
+    }
+    static F Min( F a, F b )
+    {
+        return _mm256_min_ps( a, b );
+    }
+    static F Max( F a, F b )
+    {
+        return _mm256_max_ps( a, b );
+    }
+    static F Abs( F a )
+    {
+        return _mm256_and_ps( a, _mm256_castsi256_ps( _mm256_set1_epi32( 0x7FFFFFFF ) ) );
+    }
+    static F Sqrt( F a )
+    {
+        return _mm256_sqrt_ps( a );
+    }
+    static F Floor( F a )
+    {
+        return _mm256_floor_ps( a );
+    }
+
+    static M Equal( F a, F b )
+    {
+        return _mm256_cmp_ps( a, b, _CMP_EQ_OQ );
+    }
+    static M Greater( F a, F b )
+    {
+        return _mm256_cmp_ps( a, b, _CMP_GT_OQ );
+    }
+    static M IsNan( F a )
+    {
+        return _mm256_cmp_ps( a, a, _CMP_UNORD_Q );
+    }
+    static F Select( M m, F a, F b )
+    {
+        return _mm256_blendv_ps( b, a, m );
+    }
+    static bool Any( M m )
+    {
+        return _mm256_movemask_ps( m ) != 0;
+    }
+
+    static F Pow2( F n )
+    {
+        __m256i i = _mm256_cvttps_epi32( n );
+        i         = _mm256_slli_epi32( _mm256_add_epi32( i, _mm256_set1_epi32( 127 ) ), 23 );
+        return _mm256_castsi256_ps( i );
+    }
+
+    static F Frexp( F x, F& e )
+    {
+        __m256i bits     = _mm256_castps_si256( x );
+        __m256i exponent = _mm256_sub_epi32( _mm256_srli_epi32( bits, 23 ), _mm256_set1_epi32( 127 ) );
+        e                = _mm256_cvtepi32_ps( exponent );
+        bits             = _mm256_and_si256( bits, _mm256_set1_epi32( ~0x7F800000 ) );
+        bits             = _mm256_or_si256( bits, _mm256_set1_epi32( 0x3F000000 ) );
+        return _mm256_castsi256_ps( bits );
+    }
+};
+
+}  // namespace
+
+void SvgfAtrousBlocksAVX2( const SvgfAtrousArgs& args, int x, int y, int blocks )
+{
+    for ( int i = 0; i < blocks; ++i, x += Avx2Lanes::Width )
+        AtrousPixels<Avx2Lanes, false, false>( args, x, y );
+}
+
+}  // namespace cpulib
+
+#endif
@@ -0,0 +1,487 @@
+#pragma once
+
+/*
+ *  The a-trous kernel of SvgfDenoiser, shared by SvgfDenoiser.cpp and
+ *  SvgfDenoiserAVX2.cpp.
+ *
+ *  It is written once against a lane type L (ScalarLanes here, Avx2Lanes in
+ *  the AVX2 unit) so the 1 wide and the 8 wide version run the very same
+ *  sequence of IEEE operations and produce the same bits. Min/Max/Select
+ *  follow the SSE semantics (second operand on NaN) in both.
+ *
+ *  Only include this from the two .cpp files: everything is in an anonymous
+ *  namespace so no instantiation compiled with -mavx2 can be picked by the
+ *  linker for the scalar unit. For the same reason nothing from VectorMath.h
+ *  or the STL is used by the 8 wide path.
+ */
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace cpulib
+{
+
+struct SvgfAtrousArgs
+{
+    // filterBuffer colour source, rgb + variance.
+    const float* colour[4];
+    // Unpacked normals, depth and object id of the current frame.
+    const float* normal[3];
+    const float* depth;
+    const float* object[3];
+
+    float* outColour[4];
+    float* outSdr[3];
+
+    int width;
+    int height;
+    int step;
+
+    float sigmaDepth;
+    float sigmaNormal;
+    float sigmaLuminance;
+};
+
+/**
+ * Run the a-trous kernel 8 pixels at a time over [x, x + 8 * blocks) of row y,
+ * every pixel has to be an interior one (see AtrousPixels). Only defined when
+ * CPULIB_AVX2 is, in SvgfDenoiserAVX2.cpp.
+ */
+void SvgfAtrousBlocksAVX2( const SvgfAtrousArgs& args, int x, int y, int blocks );
+
+namespace
+{
+
+const float SVGF_EPSILON = 0.00001f;
+
+// Cephes single precision exp/log, split into the same steps as the AVX2 versions.
+const float EXP_HI     = 88.3762626647949f;
+const float EXP_LO     = -88.3762626647949f;
+const float LOG2EF     = 1.44269504088896341f;
+const float EXP_C1     = 0.693359375f;
+const float EXP_C2     = -2.12194440e-4f;
+const float EXP_P[6]   = { 1.9875691500E-4f, 1.3981999507E-3f, 8.3334519073E-3f,
+                           4.1665795894E-2f, 1.6666665459E-1f, 5.0000001201E-1f };
+const float LOG_MIN    = 1.17549435e-38f;
+const float LOG_SQRTHF = 0.707106781186547524f;
+const float LOG_P[9]   = { 7.0376836292E-2f,  -1.1514610310E-1f, 1.1676998740E-1f,
+                           -1.2420140846E-1f, 1.4249322787E-1f,  -1.6668057665E-1f,
+                           2.0000714765E-1f,  -2.4999993993E-1f, 3.3333331174E-1f };
+
+struct ScalarLanes
+{
+    using F = float;
+    using M = bool;
+
+    static const int Width = 1;
+
+    static F Load( const float* p )
+    {
+        return *p;
+    }
+    static void Store( float* p, F v )
+    {
+        *p = v;
+    }
+    static F Set( float s )
+    {
+        return s;
+    }
+
+    static F Add( F a, F b )
+    {
+        return a + b;
+    }
+    static F Sub( F a, F b )
+    {
+        return a - b;
+    }
+    static F Mul( F a, F b )
+    {
+        return a * b;
+    }
+    static F Div( F a, F b )
+    {
+        return a / b;
+    }
+    static F Min( F a, F b )
+    {
+        return a < b ? a : b;
+    }
+    static F Max( F a, F b )
+    {
+        return a > b ? a : b;
+    }
+    static F Abs( F a )
+    {
+        uint32_t bits;
+        std::memcpy( &bits, &a, 4 );
+        bits &= 0x7FFFFFFFu;
+        std::memcpy( &a, &bits, 4 );
+        return a;
+    }
+    static F Sqrt( F a )
+    {
+        return std::sqrt( a );
+    }
+    static F Floor( F a )
+    {
+        return std::floor( a );
+    }
+
+    static M Equal( F a, F b )
+    {
+        return a == b;
+    }
+    static M Greater( F a, F b )
+    {
+        return a > b;
+    }
+    static M IsNan( F a )
+    {
+        return a != a;
+    }
+    static F Select( M m, F a, F b )
+    {
+        return m ? a : b;
+    }
+    static bool Any( M m )
+    {
+        return m;
+    }
+
+    // 2^n for n in [-127, 128].
+    static F Pow2( F n )
+    {
+        int32_t  i    = n == n ? static_cast<int32_t>( n ) : 0;
+        uint32_t bits = static_cast<uint32_t>( i + 127 ) << 23;
+        float    r;
+        std::memcpy( &r, &bits, 4 );
+        return r;
+    }
+
+    // Exponent and mantissa in [0.5, 1) of a positive normal float.
+    static F Frexp( F x, F& e )
+    {
+        uint32_t bits;
+        std::memcpy( &bits, &x, 4 );
+        e    = static_cast<float>( static_cast<int32_t>( bits >> 23 ) - 127 );
+        bits = ( bits & ~0x7F800000u ) | 0x3F000000u;
+        std::memcpy( &x, &bits, 4 );
+        return x;
+    }
+
+    static F ExpExact( F x );
+    static F PowExact( F x, F y );
+};
+
+template<typename L>
+inline typename L::F FastExp( typename L::F x )
+{
+    using F = typename L::F;
+
+    // NaN stays NaN, the shaders zero NaN weights.
+    x = L::Min( L::Set( EXP_HI ), x );
+    x = L::Max( L::Set( EXP_LO ), x );
+
+    F fx = L::Floor( L::Add( L::Mul( x, L::Set( LOG2EF ) ), L::Set( 0.5f ) ) );
+    x    = L::Sub( x, L::Mul( fx, L::Set( EXP_C1 ) ) );
+    x    = L::Sub( x, L::Mul( fx, L::Set( EXP_C2 ) ) );
+
+    F z = L::Mul( x, x );
+    F y = L::Set( EXP_P[0] );
+    for ( int i = 1; i < 6; ++i )
+        y = L::Add( L::Mul( y, x ), L::Set( EXP_P[i] ) );
+    y = L::Add( L::Mul( y, z ), x );
+    y = L::Add( y, L::Set( 1.0f ) );
+
+    return L::Mul( y, L::Pow2( fx ) );
+}
+
+// Only valid for x > 0, the callers select something else for the other lanes.
+template<typename L>
+inline typename L::F FastLog( typename L::F x )
+{
+    using F = typename L::F;
+
+    x = L::Max( x, L::Set( LOG_MIN ) );
+
+    F e;
+    x = L::Frexp( x, e );
+    e = L::Add( e, L::Set( 1.0f ) );
+
+    typename L::M small = L::Greater( L::Set( LOG_SQRTHF ), x );
+    F             tmp   = L::Select( small, x, L::Set( 0.0f ) );
+    x                   = L::Sub( x, L::Set( 1.0f ) );
+    e                   = L::Sub( e, L::Select( small, L::Set( 1.0f ), L::Set( 0.0f ) ) );
+    x                   = L::Add( x, tmp );
+
+    F z = L::Mul( x, x );
+    F y = L::Set( LOG_P[0] );
+    for ( int i = 1; i < 9; ++i )
+        y = L::Add( L::Mul( y, x ), L::Set( LOG_P[i] ) );
+    y = L::Mul( y, x );
+    y = L::Mul( y, z );
+
+    y = L::Add( y, L::Mul( e, L::Set( EXP_C2 ) ) );
+    y = L::Sub( y, L::Mul( z, L::Set( 0.5f ) ) );
+    x = L::Add( x, y );
+    x = L::Add( x, L::Mul( e, L::Set( EXP_C1 ) ) );
+
+    return x;
+}
+
+template<typename L, bool Exact>
+inline typename L::F Exp( typename L::F x )
+{
+    if constexpr ( Exact )
+        return L::ExpExact( x );
+    else
+        return FastExp<L>( x );
+}
+
+/*
+    pow( x, y ) for x >= 0, HLSL pow( 0, y ) is 0 for y > 0. Fast raises to
+    whole exponents, like the default sigmaNormal of 128 and the 30 of the
+    moments pass, by repeated squaring.
+*/
+template<typename L, bool Exact>
+inline typename L::F Pow( typename L::F x, float y )
+{
+    if constexpr ( Exact )
+        return L::PowExact( x, y );
+    else
+    {
+        if ( y >= 0 && y <= 1024 && static_cast<float>( static_cast<int>( y ) ) == y )
+        {
+            typename L::F result = L::Set( 1.0f );
+            for ( int n = static_cast<int>( y ); n > 0; n >>= 1 )
+            {
+                if ( n & 1 )
+                    result = L::Mul( result, x );
+                if ( n > 1 )
+                    x = L::Mul( x, x );
+            }
+            return result;
+        }
+
+        typename L::F zero = L::Set( y == 0 ? 1.0f : 0.0f );
+        typename L::M pos  = L::Greater( x, L::Set( 0.0f ) );
+        if ( !L::Any( pos ) )
+            return zero;
+        return L::Select( pos, FastExp<L>( L::Mul( L::Set( y ), FastLog<L>( x ) ) ), zero );
+    }
+}
+
+// Luminance equation from International Telecommunication Union, BT.601.
+template<typename L>
+inline typename L::F Luminance( typename L::F r, typename L::F g, typename L::F b )
+{
+    return L::Add( L::Add( L::Mul( L::Set( 0.299f ), r ), L::Mul( L::Set( 0.587f ), g ) ),
+                   L::Mul( L::Set( 0.114f ), b ) );
+}
+
+// HLSL clamp( x, 0, 1 ) = min( max( x, 0 ), 1 )
+template<typename L>
+inline typename L::F Saturate( typename L::F x )
+{
+    return L::Min( L::Max( x, L::Set( 0.0f ) ), L::Set( 1.0f ) );
+}
+
+// Based on http://chilliant.blogspot.com/2012/08/srgb-approximations-for-hlsl.html
+template<typename L>
+inline typename L::F LinearToSrgb( typename L::F c )
+{
+    typename L::F sq1 = L::Sqrt( c );
+    typename L::F sq2 = L::Sqrt( sq1 );
+    typename L::F sq3 = L::Sqrt( sq2 );
+
+    typename L::F srgb = L::Add( L::Mul( L::Set( 0.662002687f ), sq1 ), L::Mul( L::Set( 0.684122060f ), sq2 ) );
+    srgb               = L::Sub( srgb, L::Mul( L::Set( 0.323583601f ), sq3 ) );
+    return L::Sub( srgb, L::Mul( L::Set( 0.0225411470f ), c ) );
+}
+
+/**
+ * One SVGF_atrous.hlsl thread for L::Width pixels starting at ( x, y ).
+ * Without Border every pixel, its gradient neighbours and all of its taps
+ * must be inside the image horizontally, rows are always checked.
+ */
+template<typename L, bool Exact, bool Border>
+inline void AtrousPixels( const SvgfAtrousArgs& a, int x, int y )
+{
+    using F = typename L::F;
+    using M = typename L::M;
+
+    const float kernel[3] = { 1.0f, 2.0f / 3.0f, 1.0f / 6.0f };
+    const float gauss[2][2] = { { 1.0f / 4.0f, 1.0f / 8.0f }, { 1.0f / 8.0f, 1.0f / 16.0f } };
+
+    const F zero = L::Set( 0.0f );
+    const F eps  = L::Set( SVGF_EPSILON );
+
+    auto inside = [&]( int qx, int qy ) {
+        return qx >= 0 && qx < a.width && qy >= 0 && qy < a.height;
+    };
+    auto index = [&]( int qx, int qy ) {
+        return static_cast<size_t>( qy ) * a.width + qx;
+    };
+    // texelFetch, the default outside of the image.
+    auto fetch = [&]( const float* plane, int qx, int qy, F fallback ) {
+        if ( Border && !inside( qx, qy ) )
+            return fallback;
+        if ( !Border && ( qy < 0 || qy >= a.height ) )
+            return fallback;
+        return L::Load( plane + index( qx, qy ) );
+    };
+
+    const size_t p = index( x, y );
+
+    F cr = L::Load( a.colour[0] + p );
+    F cg = L::Load( a.colour[1] + p );
+    F cb = L::Load( a.colour[2] + p );
+    F cv = L::Load( a.colour[3] + p );
+
+    F lumP = Luminance<L>( Saturate<L>( cr ), Saturate<L>( cg ), Saturate<L>( cb ) );
+
+    F cnx = L::Load( a.normal[0] + p );
+    F cny = L::Load( a.normal[1] + p );
+    F cnz = L::Load( a.normal[2] + p );
+    F cox = L::Load( a.object[0] + p );
+    F coy = L::Load( a.object[1] + p );
+    F coz = L::Load( a.object[2] + p );
+    F cd  = L::Load( a.depth + p );
+
+    // CalcDepthGradient
+    F left     = fetch( a.depth, x - 1, y, cd );
+    F right    = fetch( a.depth, x + 1, y, cd );
+    F up       = fetch( a.depth, x, y - 1, cd );
+    F down     = fetch( a.depth, x, y + 1, cd );
+    F maxVert  = L::Max( L::Abs( L::Sub( cd, left ) ), L::Abs( L::Sub( cd, right ) ) );
+    F maxHori  = L::Max( L::Abs( L::Sub( cd, up ) ), L::Abs( L::Sub( cd, down ) ) );
+    F gradient = L::Max( maxVert, maxHori );
+
+    // computeVarianceCenter, out of bounds UAV reads are zero.
+    F varGauss = zero;
+    for ( int yy = -1; yy <= 1; ++yy )
+    {
+        for ( int xx = -1; xx <= 1; ++xx )
+        {
+            F k      = L::Set( gauss[xx < 0 ? -xx : xx][yy < 0 ? -yy : yy] );
+            varGauss = L::Add( varGauss, L::Mul( fetch( a.colour[3], x + xx, y + yy, zero ), k ) );
+        }
+    }
+    F lumDenominator = L::Mul( L::Set( a.sigmaLuminance ), L::Sqrt( L::Max( L::Add( eps, varGauss ), zero ) ) );
+
+    F    tapWeight         = zero;
+    bool centreWeightValid = false;
+
+    F sumWeight = L::Set( 1.0f );
+    F sumR      = cr;
+    F sumG      = cg;
+    F sumB      = cb;
+    F sumV      = cv;
+
+    for ( int yOffset = -2; yOffset <= 2; ++yOffset )
+    {
+        int qy = y + a.step * yOffset;
+        if ( qy < 0 || qy >= a.height )
+            continue;
+
+        for ( int xOffset = -2; xOffset <= 2; ++xOffset )
+        {
+            int qx = x + a.step * xOffset;
+            if ( ( xOffset == 0 && yOffset == 0 ) || ( Border && !inside( qx, qy ) ) )
+                continue;
+
+            const size_t q = index( qx, qy );
+
+            F qox = L::Load( a.object[0] + q );
+            F qoy = L::Load( a.object[1] + q );
+            F qoz = L::Load( a.object[2] + q );
+
+            // length( currObj - centreObj ) != 0 skips the tap.
+            F dx      = L::Sub( qox, cox );
+            F dy      = L::Sub( qoy, coy );
+            F dz      = L::Sub( qoz, coz );
+            M sameObj = L::Equal( L::Add( L::Add( L::Mul( dx, dx ), L::Mul( dy, dy ) ), L::Mul( dz, dz ) ), zero );
+            if ( !L::Any( sameObj ) )
+            {
+                // Fast adds the same zeros as a partially skipped 8 wide tap would.
+                if constexpr ( !Exact )
+                {
+                    sumR      = L::Add( sumR, zero );
+                    sumG      = L::Add( sumG, zero );
+                    sumB      = L::Add( sumB, zero );
+                    sumV      = L::Add( sumV, zero );
+                    sumWeight = L::Add( sumWeight, zero );
+                }
+                continue;
+            }
+
+            F qr = L::Load( a.colour[0] + q );
+            F qg = L::Load( a.colour[1] + q );
+            F qb = L::Load( a.colour[2] + q );
+            F qv = L::Load( a.colour[3] + q );
+
+            F lumQ = Luminance<L>( Saturate<L>( qr ), Saturate<L>( qg ), Saturate<L>( qb ) );
+
+            int ax           = xOffset < 0 ? -xOffset : xOffset;
+            int ay           = yOffset < 0 ? -yOffset : yOffset;
+            F   kernelWeight = L::Set( kernel[ax] * kernel[ay] );
+
+            // With step 0 every tap is the centre pixel and only the kernel weight changes.
+            if ( !centreWeightValid )
+            {
+                F tapLength = L::Sqrt( L::Set( static_cast<float>( xOffset * xOffset + yOffset * yOffset ) ) );
+
+                // w_l
+                F objLength       = L::Add( L::Add( L::Mul( qox, qox ), L::Mul( qoy, qoy ) ), L::Mul( qoz, qoz ) );
+                F weightLuminance = L::Div( L::Abs( L::Sub( lumP, lumQ ) ),
+                                            L::Select( L::Equal( objLength, zero ), eps, lumDenominator ) );
+
+                // w_n
+                F normalDot    = L::Add( L::Add( L::Mul( cnx, L::Load( a.normal[0] + q ) ),
+                                                 L::Mul( cny, L::Load( a.normal[1] + q ) ) ),
+                                         L::Mul( cnz, L::Load( a.normal[2] + q ) ) );
+                F weightNormal = Pow<L, Exact>( L::Max( normalDot, zero ), a.sigmaNormal );
+
+                // w_z
+                F weightDepth =
+                    L::Div( L::Abs( L::Sub( cd, L::Load( a.depth + q ) ) ),
+                            L::Add( L::Mul( L::Abs( L::Mul( gradient, tapLength ) ), L::Set( a.sigmaDepth ) ), eps ) );
+
+                F exponent = L::Sub( L::Sub( zero, L::Max( weightDepth, zero ) ), L::Max( weightLuminance, zero ) );
+                tapWeight  = L::Mul( Exp<L, Exact>( exponent ), weightNormal );
+
+                centreWeightValid = a.step == 0;
+            }
+
+            F w = L::Mul( tapWeight, kernelWeight );
+            w   = L::Select( L::IsNan( w ), zero, w );
+
+            sumR      = L::Add( sumR, L::Select( sameObj, L::Mul( w, qr ), zero ) );
+            sumG      = L::Add( sumG, L::Select( sameObj, L::Mul( w, qg ), zero ) );
+            sumB      = L::Add( sumB, L::Select( sameObj, L::Mul( w, qb ), zero ) );
+            sumV      = L::Add( sumV, L::Select( sameObj, L::Mul( L::Mul( w, w ), qv ), zero ) );
+            sumWeight = L::Add( sumWeight, L::Select( sameObj, w, zero ) );
+        }
+    }
+
+    F outR = L::Div( sumR, sumWeight );
+    F outG = L::Div( sumG, sumWeight );
+    F outB = L::Div( sumB, sumWeight );
+    F outV = L::Div( sumV, L::Mul( sumWeight, sumWeight ) );
+
+    L::Store( a.outColour[0] + p, outR );
+    L::Store( a.outColour[1] + p, outG );
+    L::Store( a.outColour[2] + p, outB );
+    L::Store( a.outColour[3] + p, outV );
+
+    L::Store( a.outSdr[0] + p, Saturate<L>( LinearToSrgb<L>( outR ) ) );
+    L::Store( a.outSdr[1] + p, Saturate<L>( LinearToSrgb<L>( outG ) ) );
+    L::Store( a.outSdr[2] + p, Saturate<L>( LinearToSrgb<L>( outB ) ) );
+}
+
+}  // namespace
+}  // namespace cpulib
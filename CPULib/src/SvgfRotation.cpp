@@ -0,0 +1,125 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/SvgfRotation.h>
+
+#include <cpulib/AliasingPlanner.h>
+#include <cpulib/RenderGraph.h>
+
+using namespace cpulib;
+
+SvgfStages cpulib::BuildSvgfRotation( ResourceRotation& rotation, int atrousIterations )
+{
+    assert( rotation.GetResourceCount() == 0 && rotation.GetSlotCount() == 0 && atrousIterations > 0 );
+
+    // In SvgfResource order.
+    rotation.AddResource( "rayColour", 1 );
+    rotation.AddResource( "normals", 2 );
+    rotation.AddResource( "posDepth", 2 );
+    rotation.AddResource( "objectMask", 2 );
+    rotation.AddResource( "colour", 3 );
+    rotation.AddResource( "moments", 3 );
+    rotation.AddResource( "sdr", 1 );
+
+    // In SvgfSlot order.
+    rotation.AddSlot( "rayColour", SVGF_RESOURCE_RAY_COLOUR );
+    rotation.AddSlot( "rayNormals", SVGF_RESOURCE_NORMALS );
+    rotation.AddSlot( "rayPosDepth", SVGF_RESOURCE_POS_DEPTH );
+    rotation.AddSlot( "rayObjectMask", SVGF_RESOURCE_OBJECT_ID_MASK );
+
+    rotation.AddSlot( "historyColour", SVGF_RESOURCE_COLOUR, true );
+    rotation.AddSlot( "historyNormals", SVGF_RESOURCE_NORMALS, true );
+    rotation.AddSlot( "historyPosDepth", SVGF_RESOURCE_POS_DEPTH, true );
+    rotation.AddSlot( "historyObjectMask", SVGF_RESOURCE_OBJECT_ID_MASK, true );
+    rotation.AddSlot( "historyMoments", SVGF_RESOURCE_MOMENTS, true );
+
+    rotation.AddSlot( "colourSource", SVGF_RESOURCE_COLOUR );
+    rotation.AddSlot( "momentSource", SVGF_RESOURCE_MOMENTS );
+    rotation.AddSlot( "sdrTarget", SVGF_RESOURCE_SDR );
+    rotation.AddSlot( "colourTarget", SVGF_RESOURCE_COLOUR );
+    rotation.AddSlot( "momentTarget", SVGF_RESOURCE_MOMENTS );
+
+    SvgfStages stages;
+
+    // The schedulers update rayColour in place, between passes, which is not a hazard this can describe.
+    stages.trace = rotation.AddStage( "trace" );
+    rotation.Access( stages.trace, SVGF_SLOT_RAY_COLOUR, SlotAccess::Write );
+    rotation.Access( stages.trace, SVGF_SLOT_RAY_NORMALS, SlotAccess::WriteHistory );
+    rotation.Access( stages.trace, SVGF_SLOT_RAY_POS_DEPTH, SlotAccess::WriteHistory );
+    rotation.Access( stages.trace, SVGF_SLOT_RAY_OBJECT_ID_MASK, SlotAccess::WriteHistory );
+    rotation.Access( stages.trace, SVGF_SLOT_HISTORY_MOMENTS, SlotAccess::ReadHistory );
+
+    // SVGF_reprojection.hlsl
+    stages.reprojection = rotation.AddStage( "reprojection" );
+    rotation.Access( stages.reprojection, SVGF_SLOT_RAY_COLOUR, SlotAccess::Read );
+    rotation.Access( stages.reprojection, SVGF_SLOT_RAY_NORMALS, SlotAccess::Read );
+    rotation.Access( stages.reprojection, SVGF_SLOT_RAY_POS_DEPTH, SlotAccess::Read );
+    rotation.Access( stages.reprojection, SVGF_SLOT_RAY_OBJECT_ID_MASK, SlotAccess::Read );
+    rotation.Access( stages.reprojection, SVGF_SLOT_HISTORY_COLOUR, SlotAccess::ReadHistory );
+    rotation.Access( stages.reprojection, SVGF_SLOT_HISTORY_NORMALS, SlotAccess::ReadHistory );
+    rotation.Access( stages.reprojection, SVGF_SLOT_HISTORY_POS_DEPTH, SlotAccess::ReadHistory );
+    rotation.Access( stages.reprojection, SVGF_SLOT_HISTORY_OBJECT_ID_MASK, SlotAccess::ReadHistory );
+    rotation.Access( stages.reprojection, SVGF_SLOT_HISTORY_MOMENTS, SlotAccess::ReadHistory );
+    rotation.Access( stages.reprojection, SVGF_SLOT_COLOUR_TARGET, SlotAccess::Write );
+    rotation.Access( stages.reprojection, SVGF_SLOT_MOMENT_TARGET, SlotAccess::Write );
+
+    // SVGF_moments.hlsl, its moments are the next frame's history.
+    stages.moments = rotation.AddStage( "moments" );
+    rotation.Access( stages.moments, SVGF_SLOT_RAY_NORMALS, SlotAccess::Read );
+    rotation.Access( stages.moments, SVGF_SLOT_RAY_POS_DEPTH, SlotAccess::Read );
+    rotation.Access( stages.moments, SVGF_SLOT_RAY_OBJECT_ID_MASK, SlotAccess::Read );
+    rotation.Access( stages.moments, SVGF_SLOT_COLOUR_SOURCE, SlotAccess::Read );
+    rotation.Access( stages.moments, SVGF_SLOT_MOMENT_SOURCE, SlotAccess::Read );
+    rotation.Access( stages.moments, SVGF_SLOT_COLOUR_TARGET, SlotAccess::Write );
+    rotation.Access( stages.moments, SVGF_SLOT_MOMENT_TARGET, SlotAccess::WriteHistory );
+
+    // SVGF_atrous.hlsl, the output of the first iteration is the next frame's colour history.
+    for ( int i = 0; i < atrousIterations; ++i )
+    {
+        uint32_t stage = rotation.AddStage( "atrous" + std::to_string( i ) );
+        if ( i == 0 )
+            stages.atrous = stage;
+
+        rotation.Access( stage, SVGF_SLOT_RAY_NORMALS, SlotAccess::Read );
+        rotation.Access( stage, SVGF_SLOT_RAY_POS_DEPTH, SlotAccess::Read );
+        rotation.Access( stage, SVGF_SLOT_RAY_OBJECT_ID_MASK, SlotAccess::Read );
+        rotation.Access( stage, SVGF_SLOT_COLOUR_SOURCE, SlotAccess::Read );
+        rotation.Access( stage, SVGF_SLOT_MOMENT_SOURCE, SlotAccess::Read );
+        rotation.Access( stage, SVGF_SLOT_SDR_TARGET, SlotAccess::Write );
+        rotation.Access( stage, SVGF_SLOT_COLOUR_TARGET, i == 0 ? SlotAccess::WriteHistory : SlotAccess::Write );
+        rotation.Access( stage, SVGF_SLOT_MOMENT_TARGET, SlotAccess::Write );
+    }
+
+    stages.present = rotation.AddStage( "present" );
+    rotation.Access( stages.present, SVGF_SLOT_SDR_TARGET, SlotAccess::Read );
+
+    return stages;
+}
+
+SvgfMemory cpulib::PlanSvgfMemory( const ResourceRotation& rotation, uint32_t width, uint32_t height )
+{
+    AliasingPlanner planner;
+    AddRotationLifetimes( planner, rotation, uint64_t( width ) * height * sizeof( float4 ) );
+    planner.Plan();
+    assert( planner.Validate() );
+
+    SvgfMemory memory;
+    memory.committedBytes = planner.GetCommittedSize();
+    memory.aliasedBytes   = planner.GetHeapSize();
+    return memory;
+}
+
+void cpulib::DeclareSvgfAccesses( RenderGraph& graph, uint32_t pass, const ResourceRotation& rotation, uint64_t frame,
+                                  uint32_t stage, bool accumulate )
+{
+    for ( const auto& access: rotation.GetStageAccesses( stage ) )
+    {
+        const uint32_t buffer = rotation.GetBuffer( frame, stage, access.slot );
+
+        if ( access.access == SlotAccess::Read || access.access == SlotAccess::ReadHistory )
+            graph.Read( pass, buffer );
+        else if ( accumulate )
+            graph.ReadWrite( pass, buffer );
+        else
+            graph.Write( pass, buffer );
+    }
+}
@@ -0,0 +1,133 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/ThreadPool.h>
+
+using namespace cpulib;
+
+// Set for pool workers and for the dispatching thread while it helps out, so
+// nested dispatches run inline.
+static thread_local bool t_InsideDispatch = false;
+
+ThreadPool::ThreadPool( uint32_t numThreads )
+{
+    if ( numThreads == 0 )
+    {
+        numThreads = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+
+    m_Workers.reserve( numThreads - 1 );
+    for ( uint32_t i = 1; i < numThreads; ++i )
+    {
+        m_Workers.emplace_back( &ThreadPool::WorkerThread, this );
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock( m_Mutex );
+        m_Quit = true;
+    }
+    m_WakeCondition.notify_all();
+
+    for ( std::thread& worker: m_Workers )
+    {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::Get()
+{
+    static ThreadPool s_Pool;
+    return s_Pool;
+}
+
+void ThreadPool::ParallelFor( uint32_t count, const std::function<void( uint32_t )>& func )
+{
+    if ( count == 0 )
+        return;
+
+    if ( t_InsideDispatch || m_Workers.empty() || count == 1 )
+    {
+        for ( uint32_t i = 0; i < count; ++i )
+            func( i );
+        return;
+    }
+
+    // Only one dispatch can own the workers at a time.
+    std::lock_guard<std::mutex> dispatchLock( m_DispatchMutex );
+    {
+        std::lock_guard<std::mutex> lock( m_Mutex );
+        m_Job           = &func;
+        m_JobCount      = count;
+        m_ActiveWorkers = static_cast<uint32_t>( m_Workers.size() );
+        m_NextIndex.store( 0 );
+        ++m_Generation;
+    }
+    m_WakeCondition.notify_all();
+
+    t_InsideDispatch = true;
+    RunJob();
+    t_InsideDispatch = false;
+
+    std::unique_lock<std::mutex> lock( m_Mutex );
+    m_DoneCondition.wait( lock, [this] { return m_ActiveWorkers == 0; } );
+    m_Job = nullptr;
+}
+
+void ThreadPool::ParallelForTiles( uint32_t width, uint32_t height, uint32_t tileSize,
+                                   const std::function<void( const Tile& )>& func )
+{
+    if ( width == 0 || height == 0 )
+        return;
+
+    tileSize             = std::max( 1u, tileSize );
+    uint32_t tilesWide   = ( width + tileSize - 1 ) / tileSize;
+    uint32_t tilesHigh   = ( height + tileSize - 1 ) / tileSize;
+
+    ParallelFor( tilesWide * tilesHigh, [&]( uint32_t idx ) {
+        Tile tile;
+        tile.x0 = ( idx % tilesWide ) * tileSize;
+        tile.y0 = ( idx / tilesWide ) * tileSize;
+        tile.x1 = std::min( width, tile.x0 + tileSize );
+        tile.y1 = std::min( height, tile.y0 + tileSize );
+        func( tile );
+    } );
+}
+
+void ThreadPool::RunJob()
+{
+    for ( ;; )
+    {
+        uint32_t i = m_NextIndex.fetch_add( 1 );
+        if ( i >= m_JobCount )
+            break;
+
+        ( *m_Job )( i );
+    }
+}
+
+void ThreadPool::WorkerThread()
+{
+    t_InsideDispatch = true;
+
+    uint64_t generation = 0;
+    for ( ;; )
+    {
+        {
+            std::unique_lock<std::mutex> lock( m_Mutex );
+            m_WakeCondition.wait( lock, [&] { return m_Quit || m_Generation != generation; } );
+            if ( m_Quit )
+                return;
+            generation = m_Generation;
+        }
+
+        RunJob();
+
+        {
+            std::lock_guard<std::mutex> lock( m_Mutex );
+            if ( --m_ActiveWorkers == 0 )
+                m_DoneCondition.notify_one();
+        }
+    }
+}
@@ -0,0 +1,175 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/TlasInstanceTracker.h>
+
+using namespace cpulib;
+
+namespace
+{
+
+double SurfaceArea( const TlasBounds& bounds )
+{
+    const float3 size = max( bounds.upper - bounds.lower, float3( 0.0f ) );
+    return 2.0 * ( static_cast<double>( size.x ) * size.y + static_cast<double>( size.y ) * size.z +
+                   static_cast<double>( size.z ) * size.x );
+}
+
+TlasBounds Join( const TlasBounds& a, const TlasBounds& b )
+{
+    TlasBounds joined;
+    joined.lower = min( a.lower, b.lower );
+    joined.upper = max( a.upper, b.upper );
+    return joined;
+}
+
+}  // namespace
+
+TlasBounds cpulib::TransformBounds( const float3x4& transform, const TlasBounds& bounds )
+{
+    // Every row of the transform takes the smaller or the larger end of each axis, whichever gives less or more.
+    TlasBounds world;
+    for ( int i = 0; i < 3; ++i )
+    {
+        world.lower[i] = transform.m[i][3];
+        world.upper[i] = transform.m[i][3];
+
+        for ( int j = 0; j < 3; ++j )
+        {
+            const float a = transform.m[i][j] * bounds.lower[j];
+            const float b = transform.m[i][j] * bounds.upper[j];
+            world.lower[i] += std::min( a, b );
+            world.upper[i] += std::max( a, b );
+        }
+    }
+    return world;
+}
+
+TlasInstanceTracker::TlasInstanceTracker( const TlasTrackerSettings& settings )
+: m_Settings( settings )
+{}
+
+void TlasInstanceTracker::SetSettings( const TlasTrackerSettings& settings )
+{
+    m_Settings = settings;
+}
+
+void TlasInstanceTracker::Reset( const std::vector<TlasBounds>& bounds )
+{
+    m_Bounds      = bounds;
+    m_BuildBounds = bounds;
+
+    m_Dirty.resize( bounds.size() );
+    std::iota( m_Dirty.begin(), m_Dirty.end(), 0u );
+    m_IsDirty.assign( bounds.size(), 1 );
+
+    m_Area = 0.0;
+    for ( const TlasBounds& b: bounds )
+    {
+        m_Area += SurfaceArea( b );
+    }
+    m_JoinedArea = m_Area;
+
+    m_Refits       = 0;
+    m_NeedsRebuild = true;
+}
+
+void TlasInstanceTracker::SetBounds( uint32_t instance, const TlasBounds& bounds )
+{
+    Account( instance, -1.0f );
+    m_Bounds[instance] = bounds;
+    Account( instance, 1.0f );
+
+    MarkDirty( instance );
+}
+
+void TlasInstanceTracker::MarkDirty( uint32_t instance )
+{
+    assert( instance < GetInstanceCount() );
+
+    if ( !m_IsDirty[instance] )
+    {
+        m_IsDirty[instance] = 1;
+        m_Dirty.push_back( instance );
+    }
+}
+
+std::vector<TlasInstanceRange> TlasInstanceTracker::GetDirtyRanges() const
+{
+    std::vector<uint32_t> dirty = m_Dirty;
+    std::sort( dirty.begin(), dirty.end() );
+
+    std::vector<TlasInstanceRange> ranges;
+    for ( uint32_t instance: dirty )
+    {
+        if ( !ranges.empty() && instance - ( ranges.back().first + ranges.back().count ) <= m_Settings.mergeGap )
+        {
+            ranges.back().count = instance + 1 - ranges.back().first;
+        }
+        else
+        {
+            ranges.push_back( { instance, 1 } );
+        }
+    }
+    return ranges;
+}
+
+TlasUpdate TlasInstanceTracker::GetUpdate() const
+{
+    if ( m_NeedsRebuild )
+    {
+        return TlasUpdate::Rebuild;
+    }
+    if ( m_Dirty.empty() )
+    {
+        return TlasUpdate::None;
+    }
+    if ( ( m_Settings.maxRefits > 0 && m_Refits >= m_Settings.maxRefits ) ||
+         GetDegradation() > m_Settings.refitDegradation )
+    {
+        return TlasUpdate::Rebuild;
+    }
+    return TlasUpdate::Refit;
+}
+
+void TlasInstanceTracker::Commit( TlasUpdate update )
+{
+    for ( uint32_t instance: m_Dirty )
+    {
+        m_IsDirty[instance] = 0;
+    }
+    m_Dirty.clear();
+
+    if ( update == TlasUpdate::Rebuild )
+    {
+        // Summed again rather than kept, so what SetBounds added and took away doesn't drift.
+        m_BuildBounds = m_Bounds;
+        m_Area        = 0.0;
+        for ( const TlasBounds& bounds: m_Bounds )
+        {
+            m_Area += SurfaceArea( bounds );
+        }
+        m_JoinedArea = m_Area;
+
+        m_Refits       = 0;
+        m_NeedsRebuild = false;
+    }
+    else if ( update == TlasUpdate::Refit )
+    {
+        ++m_Refits;
+    }
+}
+
+float TlasInstanceTracker::GetDegradation() const
+{
+    if ( m_Area <= 0.0 )
+    {
+        return 0.0f;
+    }
+    return static_cast<float>( std::max( m_JoinedArea - m_Area, 0.0 ) / m_Area );
+}
+
+void TlasInstanceTracker::Account( uint32_t instance, float sign )
+{
+    m_Area += sign * SurfaceArea( m_Bounds[instance] );
+    m_JoinedArea += sign * SurfaceArea( Join( m_Bounds[instance], m_BuildBounds[instance] ) );
+}
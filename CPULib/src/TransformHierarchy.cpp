@@ -0,0 +1,265 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/TransformHierarchy.h>
+
+using namespace cpulib;
+
+namespace
+{
+
+#if CPULIB_SSE
+
+// The last row of an affine transform.
+inline __m128 LastRow()
+{
+    return _mm_set_ps( 1.0f, 0.0f, 0.0f, 0.0f );
+}
+
+inline __m128 WithoutW( __m128 v )
+{
+    return _mm_and_ps( v, _mm_castsi128_ps( _mm_set_epi32( 0, -1, -1, -1 ) ) );
+}
+
+inline __m128 Cross( __m128 a, __m128 b )
+{
+    const __m128 aYZX = _mm_shuffle_ps( a, a, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+    const __m128 aZXY = _mm_shuffle_ps( a, a, _MM_SHUFFLE( 3, 1, 0, 2 ) );
+    const __m128 bYZX = _mm_shuffle_ps( b, b, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+    const __m128 bZXY = _mm_shuffle_ps( b, b, _MM_SHUFFLE( 3, 1, 0, 2 ) );
+    return _mm_sub_ps( _mm_mul_ps( aYZX, bZXY ), _mm_mul_ps( aZXY, bYZX ) );
+}
+
+// The dot product in every lane.
+inline __m128 Dot( __m128 a, __m128 b )
+{
+    __m128 p = _mm_mul_ps( a, b );
+    p        = _mm_add_ps( p, _mm_shuffle_ps( p, p, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+    return _mm_add_ps( p, _mm_shuffle_ps( p, p, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+}
+
+#endif
+
+}  // namespace
+
+float3x4 cpulib::IdentityTransform()
+{
+    float3x4 identity = {};
+    identity.m[0][0]  = 1.0f;
+    identity.m[1][1]  = 1.0f;
+    identity.m[2][2]  = 1.0f;
+    return identity;
+}
+
+float3x4 cpulib::MulTransforms( const float3x4& a, const float3x4& b )
+{
+    float3x4 r;
+
+#if CPULIB_SSE
+    const __m128 b0 = _mm_loadu_ps( b.m[0] );
+    const __m128 b1 = _mm_loadu_ps( b.m[1] );
+    const __m128 b2 = _mm_loadu_ps( b.m[2] );
+    const __m128 b3 = LastRow();
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        __m128 row = _mm_mul_ps( _mm_set1_ps( a.m[i][0] ), b0 );
+        row        = _mm_add_ps( row, _mm_mul_ps( _mm_set1_ps( a.m[i][1] ), b1 ) );
+        row        = _mm_add_ps( row, _mm_mul_ps( _mm_set1_ps( a.m[i][2] ), b2 ) );
+        row        = _mm_add_ps( row, _mm_mul_ps( _mm_set1_ps( a.m[i][3] ), b3 ) );
+        _mm_storeu_ps( r.m[i], row );
+    }
+#else
+    for ( int i = 0; i < 3; ++i )
+    {
+        for ( int j = 0; j < 4; ++j )
+        {
+            r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j];
+        }
+        r.m[i][3] += a.m[i][3];
+    }
+#endif
+
+    return r;
+}
+
+void cpulib::InvertTransform( const float3x4& transform, float3x4& inverse, float3x4& normal )
+{
+    // The inverse transpose of the 3x3 part is its cofactors over the determinant, the rows of
+    // which are the cross products of the other two rows. The inverse is its transpose, and takes
+    // the translation back.
+#if CPULIB_SSE
+    const __m128 r0 = _mm_loadu_ps( transform.m[0] );
+    const __m128 r1 = _mm_loadu_ps( transform.m[1] );
+    const __m128 r2 = _mm_loadu_ps( transform.m[2] );
+
+    __m128 n0 = Cross( r1, r2 );
+    __m128 n1 = Cross( r2, r0 );
+    __m128 n2 = Cross( r0, r1 );
+
+    const __m128 det = Dot( WithoutW( r0 ), n0 );
+    if ( _mm_cvtss_f32( det ) == 0.0f )
+    {
+        inverse = {};
+        normal  = {};
+        return;
+    }
+
+    const __m128 invDet = _mm_div_ps( _mm_set1_ps( 1.0f ), det );
+    n0                  = WithoutW( _mm_mul_ps( n0, invDet ) );
+    n1                  = WithoutW( _mm_mul_ps( n1, invDet ) );
+    n2                  = WithoutW( _mm_mul_ps( n2, invDet ) );
+
+    _mm_storeu_ps( normal.m[0], n0 );
+    _mm_storeu_ps( normal.m[1], n1 );
+    _mm_storeu_ps( normal.m[2], n2 );
+
+    __m128 t = _mm_mul_ps( n0, _mm_shuffle_ps( r0, r0, _MM_SHUFFLE( 3, 3, 3, 3 ) ) );
+    t        = _mm_add_ps( t, _mm_mul_ps( n1, _mm_shuffle_ps( r1, r1, _MM_SHUFFLE( 3, 3, 3, 3 ) ) ) );
+    t        = _mm_add_ps( t, _mm_mul_ps( n2, _mm_shuffle_ps( r2, r2, _MM_SHUFFLE( 3, 3, 3, 3 ) ) ) );
+    t        = _mm_sub_ps( _mm_setzero_ps(), t );
+
+    // The columns of n, with the translation as the last one.
+    _MM_TRANSPOSE4_PS( n0, n1, n2, t );
+    _mm_storeu_ps( inverse.m[0], n0 );
+    _mm_storeu_ps( inverse.m[1], n1 );
+    _mm_storeu_ps( inverse.m[2], n2 );
+#else
+    float3 r[3];
+    float3 translation;
+    for ( int i = 0; i < 3; ++i )
+    {
+        r[i]           = float3( transform.m[i][0], transform.m[i][1], transform.m[i][2] );
+        translation[i] = transform.m[i][3];
+    }
+
+    float3 n[3] = { cross( r[1], r[2] ), cross( r[2], r[0] ), cross( r[0], r[1] ) };
+
+    const float det = dot( r[0], n[0] );
+    if ( det == 0.0f )
+    {
+        inverse = {};
+        normal  = {};
+        return;
+    }
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        n[i] = n[i] * ( 1.0f / det );
+    }
+
+    const float3 t = -( n[0] * translation.x + n[1] * translation.y + n[2] * translation.z );
+    for ( int i = 0; i < 3; ++i )
+    {
+        for ( int j = 0; j < 3; ++j )
+        {
+            normal.m[i][j]  = n[i][j];
+            inverse.m[i][j] = n[j][i];
+        }
+        normal.m[i][3]  = 0.0f;
+        inverse.m[i][3] = t[i];
+    }
+#endif
+}
+
+void TransformHierarchy::Reserve( uint32_t nodeCount )
+{
+    m_Local.reserve( nodeCount );
+    m_World.reserve( nodeCount );
+    m_InverseWorld.reserve( nodeCount );
+    m_Normal.reserve( nodeCount );
+    m_Parents.reserve( nodeCount );
+    m_Flags.reserve( nodeCount );
+}
+
+void TransformHierarchy::Clear()
+{
+    m_Local.clear();
+    m_World.clear();
+    m_InverseWorld.clear();
+    m_Normal.clear();
+    m_Parents.clear();
+    m_Flags.clear();
+
+    m_FirstDirty = TRANSFORM_NO_PARENT;
+    m_AnyUpdated = false;
+}
+
+uint32_t TransformHierarchy::AddNode( uint32_t parent, const float3x4& local )
+{
+    const uint32_t node = GetNodeCount();
+    assert( parent == TRANSFORM_NO_PARENT || parent < node );
+
+    m_Local.push_back( local );
+    m_World.push_back( IdentityTransform() );
+    m_InverseWorld.push_back( IdentityTransform() );
+    m_Normal.push_back( IdentityTransform() );
+    m_Parents.push_back( parent );
+    m_Flags.push_back( DIRTY );
+
+    m_FirstDirty = std::min( m_FirstDirty, node );
+    return node;
+}
+
+void TransformHierarchy::SetLocal( uint32_t node, const float3x4& local )
+{
+    m_Local[node] = local;
+    m_Flags[node] |= DIRTY;
+    m_FirstDirty = std::min( m_FirstDirty, node );
+}
+
+uint32_t TransformHierarchy::Update()
+{
+    const uint32_t nodeCount = GetNodeCount();
+
+    // The flags of the last Update before the first dirty node, the sweep resets those after it.
+    if ( m_AnyUpdated )
+    {
+        const uint32_t end = std::min( m_FirstDirty, nodeCount );
+        for ( uint32_t i = 0; i < end; ++i )
+        {
+            m_Flags[i] &= ~UPDATED;
+        }
+        m_AnyUpdated = false;
+    }
+
+    if ( !IsDirty() )
+    {
+        return 0;
+    }
+
+    // A node is recomputed when it is dirty or its parent was. Parents come first, so one pass does it.
+    uint32_t updated = 0;
+    for ( uint32_t i = m_FirstDirty; i < nodeCount; ++i )
+    {
+        const uint32_t parent = m_Parents[i];
+
+        const bool recompute = ( m_Flags[i] & DIRTY ) != 0 ||
+                               ( parent != TRANSFORM_NO_PARENT && ( m_Flags[parent] & UPDATED ) != 0 );
+        if ( !recompute )
+        {
+            m_Flags[i] = 0;
+            continue;
+        }
+
+        m_World[i] = parent == TRANSFORM_NO_PARENT ? m_Local[i] : MulTransforms( m_World[parent], m_Local[i] );
+        InvertTransform( m_World[i], m_InverseWorld[i], m_Normal[i] );
+
+        m_Flags[i] = UPDATED;
+        ++updated;
+    }
+
+    m_FirstDirty = TRANSFORM_NO_PARENT;
+    m_AnyUpdated = true;
+    return updated;
+}
+
+void TransformHierarchy::WriteWorlds( uint32_t firstNode, uint32_t count, void* dest, size_t stride ) const
+{
+    assert( firstNode + count <= GetNodeCount() );
+
+    uint8_t* out = static_cast<uint8_t*>( dest );
+    for ( uint32_t i = 0; i < count; ++i, out += stride )
+    {
+        std::memcpy( out, &m_World[firstNode + i], sizeof( float3x4 ) );
+    }
+}
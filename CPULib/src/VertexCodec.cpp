@@ -0,0 +1,167 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/VertexCodec.h>
+
+using namespace cpulib;
+
+// atan2 rather than acos of the dot, which can't resolve less than about 0.03 degrees in float.
+static float AngleDegrees( float3 a, float3 b )
+{
+    return std::atan2( length( cross( a, b ) ), dot( a, b ) ) * ( 180.0f / PI );
+}
+
+static bool IsZero( float3 v )
+{
+    return v.x == 0 && v.y == 0 && v.z == 0;
+}
+
+PackedVertex cpulib::PackVertex( const FullVertex& vertex )
+{
+    PackedVertex packed;
+    packed.position = vertex.position;
+    packed.normal   = VertexEncodeNormal( vertex.normal );
+    packed.tangent  = VertexEncodeTangent( vertex.normal, vertex.tangent, vertex.bitangent );
+    packed.texCoord = VertexEncodeTexCoord( vertex.texCoord.x, vertex.texCoord.y );
+    return packed;
+}
+
+FullVertex cpulib::UnpackVertex( const PackedVertex& packed )
+{
+    const float2 texCoord = VertexDecodeTexCoord( packed.texCoord );
+
+    FullVertex vertex;
+    vertex.position  = packed.position;
+    vertex.normal    = VertexDecodeNormal( packed.normal );
+    vertex.tangent   = VertexDecodeTangent( packed.tangent );
+    vertex.bitangent = VertexDecodeBitangent( vertex.normal, vertex.tangent, packed.tangent );
+    vertex.texCoord  = float3( texCoord.x, texCoord.y, 0 );
+    return vertex;
+}
+
+void cpulib::PackVertices( const FullVertex* vertices, uint32_t count, PackedVertex* packed )
+{
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        packed[i] = PackVertex( vertices[i] );
+    }
+}
+
+VertexPackingError cpulib::MeasureVertexPacking( const FullVertex* vertices, uint32_t count )
+{
+    VertexPackingError error;
+    double             normalSum  = 0;
+    double             tangentSum = 0;
+    uint64_t           normals    = 0;
+    uint64_t           tangents   = 0;
+
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        const FullVertex& v = vertices[i];
+        const FullVertex  u = UnpackVertex( PackVertex( v ) );
+
+        if ( std::memcmp( &u.position, &v.position, sizeof( float3 ) ) != 0 )
+            ++error.positionMismatches;
+
+        if ( !IsZero( v.normal ) )
+        {
+            const float angle      = AngleDegrees( v.normal, u.normal );
+            error.maxNormalDegrees = std::max( error.maxNormalDegrees, angle );
+            normalSum += angle;
+            ++normals;
+        }
+
+        if ( !IsZero( v.tangent ) )
+        {
+            const float angle       = AngleDegrees( v.tangent, u.tangent );
+            error.maxTangentDegrees = std::max( error.maxTangentDegrees, angle );
+            tangentSum += angle;
+            ++tangents;
+        }
+
+        if ( !IsZero( v.normal ) && !IsZero( v.tangent ) && !IsZero( v.bitangent ) )
+        {
+            const float3 n = normalize( v.normal );
+            const float3 t = normalize( v.tangent );
+            const float3 b = normalize( v.bitangent );
+
+            // The handedness has to survive whenever the frame has one.
+            if ( std::abs( dot( cross( n, t ), b ) ) > 0.1f && dot( u.bitangent, b ) < 0 )
+                ++error.bitangentSignFlips;
+
+            // The direction only on an orthonormal frame, 1e-5 keeps the skew well below the bounds.
+            if ( std::abs( dot( n, t ) ) < 1e-5f && std::abs( dot( n, b ) ) < 1e-5f && std::abs( dot( t, b ) ) < 1e-5f )
+                error.maxBitangentDegrees = std::max( error.maxBitangentDegrees, AngleDegrees( b, u.bitangent ) );
+        }
+
+        for ( int c = 0; c < 2; ++c )
+        {
+            const float relative =
+                std::abs( u.texCoord[c] - v.texCoord[c] ) / std::max( std::abs( v.texCoord[c] ), 1.0f );
+
+            // NaN, from a coordinate past the half range, counts as out of bounds.
+            error.maxTexCoordRelative = relative == relative ? std::max( error.maxTexCoordRelative, relative )
+                                                             : std::numeric_limits<float>::infinity();
+        }
+    }
+
+    error.samples            = count;
+    error.meanNormalDegrees  = normals ? static_cast<float>( normalSum / normals ) : 0;
+    error.meanTangentDegrees = tangents ? static_cast<float>( tangentSum / tangents ) : 0;
+    return error;
+}
+
+static bool Fail( std::string* error, const std::string& message )
+{
+    if ( error )
+    {
+        *error = message;
+    }
+    return false;
+}
+
+bool cpulib::CheckVertexPacking( const VertexPackingError& e, std::string* error )
+{
+    if ( e.positionMismatches > 0 )
+        return Fail( error, std::to_string( e.positionMismatches ) + " positions changed" );
+    if ( e.maxNormalDegrees > VERTEX_PACKING_MAX_NORMAL_DEGREES )
+        return Fail( error, "normal error of " + std::to_string( e.maxNormalDegrees ) + " degrees" );
+    if ( e.maxTangentDegrees > VERTEX_PACKING_MAX_TANGENT_DEGREES )
+        return Fail( error, "tangent error of " + std::to_string( e.maxTangentDegrees ) + " degrees" );
+    if ( e.maxBitangentDegrees > VERTEX_PACKING_MAX_NORMAL_DEGREES + VERTEX_PACKING_MAX_TANGENT_DEGREES )
+        return Fail( error, "bitangent error of " + std::to_string( e.maxBitangentDegrees ) + " degrees" );
+    if ( e.bitangentSignFlips > 0 )
+        return Fail( error, std::to_string( e.bitangentSignFlips ) + " bitangents flipped" );
+    if ( !( e.maxTexCoordRelative <= VERTEX_PACKING_MAX_TEXCOORD_RELATIVE ) )
+        return Fail( error, "texture coordinate error of " + std::to_string( e.maxTexCoordRelative ) );
+
+    return true;
+}
+
+void cpulib::GenerateVertexFrames( uint32_t count, float texCoordRange, FullVertex* vertices )
+{
+    // Fibonacci sphere for the normals, the tangent turns around each one.
+    const float goldenAngle = PI * ( 3.0f - std::sqrt( 5.0f ) );
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        const float  z = 1.0f - 2.0f * ( i + 0.5f ) / count;
+        const float  r = std::sqrt( std::max( 0.0f, 1.0f - z * z ) );
+        const float  a = goldenAngle * i;
+        const float3 n( r * std::cos( a ), r * std::sin( a ), z );
+
+        const float3 helper = std::abs( n.z ) < 0.9f ? float3( 0, 0, 1 ) : float3( 1, 0, 0 );
+        const float3 u      = normalize( cross( helper, n ) );
+        const float3 w      = cross( n, u );
+        const float  spin   = 2.0f * PI * ( ( i * 0.618034f ) - std::floor( i * 0.618034f ) );
+        const float3 t      = u * std::cos( spin ) + w * std::sin( spin );
+        const float  sign   = ( i & 1 ) ? -1.0f : 1.0f;
+
+        const float s = ( ( i * 0.754878f ) - std::floor( i * 0.754878f ) ) * 2.0f - 1.0f;
+        const float q = ( ( i * 0.569840f ) - std::floor( i * 0.569840f ) ) * 2.0f - 1.0f;
+
+        vertices[i].position  = n * 10.0f + float3( static_cast<float>( i ) );
+        vertices[i].normal    = n;
+        vertices[i].tangent   = t;
+        vertices[i].bitangent = cross( n, t ) * sign;
+        vertices[i].texCoord  = float3( s * texCoordRange, q * texCoordRange, 0 );
+    }
+}
@@ -0,0 +1,459 @@
+#include "CPULibPCH.h"
+
+#include <cpulib/WideBvh.h>
+
+using namespace cpulib;
+
+namespace
+{
+
+// Traversal stacks up to this size live on the stack, deeper trees get one on the heap.
+const uint32_t LOCAL_STACK_SIZE = 256;
+
+float Area( const BvhNode& node )
+{
+    const float3 size = node.upper - node.lower;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+// The ray ready for the slab tests: a direction of 0 along an axis would give 0 * inf, so it is nudged off 0.
+struct PreparedRay
+{
+    float3 origin;
+    float3 direction;
+    float3 invDirection;
+    float  tMin;
+    // The rows of WideBvhNode::bounds where the ray enters and leaves each axis.
+    int near[3];
+    int far[3];
+
+#if CPULIB_SSE
+    __m128 sseOrigin[3];
+    __m128 sseDirection[3];
+    __m128 sseInvDirection[3];
+    __m128 sseTMin;
+#endif
+
+    explicit PreparedRay( const RayDesc& ray )
+    : origin( ray.origin )
+    , direction( ray.direction )
+    , tMin( ray.tMin )
+    {
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            const float d = std::abs( direction[axis] ) > 1e-30f ? direction[axis]
+                                                                  : std::copysign( 1e-30f, direction[axis] );
+            invDirection[axis] = 1.0f / d;
+            near[axis]         = 2 * axis + ( d < 0.0f ? 1 : 0 );
+            far[axis]          = 2 * axis + ( d < 0.0f ? 0 : 1 );
+
+#if CPULIB_SSE
+            sseOrigin[axis]       = _mm_set1_ps( origin[axis] );
+            sseDirection[axis]    = _mm_set1_ps( direction[axis] );
+            sseInvDirection[axis] = _mm_set1_ps( invDirection[axis] );
+#endif
+        }
+
+#if CPULIB_SSE
+        sseTMin = _mm_set1_ps( tMin );
+#endif
+    }
+};
+
+#if CPULIB_SSE
+
+__m128 Dot( __m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz )
+{
+    return _mm_add_ps( _mm_add_ps( _mm_mul_ps( ax, bx ), _mm_mul_ps( ay, by ) ), _mm_mul_ps( az, bz ) );
+}
+
+// The children hit within [tMin, tMax] as a bit mask, with where the ray enters each.
+int IntersectNode( const WideBvhNode& node, const PreparedRay& ray, float tMax, float dist[4] )
+{
+    __m128 tNear = ray.sseTMin;
+    __m128 tFar  = _mm_set1_ps( tMax );
+    for ( int axis = 0; axis < 3; ++axis )
+    {
+        const __m128 nearPlane = _mm_load_ps( node.bounds[ray.near[axis]] );
+        const __m128 farPlane  = _mm_load_ps( node.bounds[ray.far[axis]] );
+        const __m128 o         = ray.sseOrigin[axis];
+        const __m128 invD      = ray.sseInvDirection[axis];
+
+        tNear = _mm_max_ps( tNear, _mm_mul_ps( _mm_sub_ps( nearPlane, o ), invD ) );
+        tFar  = _mm_min_ps( tFar, _mm_mul_ps( _mm_sub_ps( farPlane, o ), invD ) );
+    }
+
+    _mm_storeu_ps( dist, tNear );
+    return _mm_movemask_ps( _mm_cmple_ps( tNear, tFar ) );
+}
+
+// Möller-Trumbore on the four triangles of pack, the lanes hit within [tMin, tMax] as a bit mask.
+int IntersectPack( const TrianglePack& pack, const PreparedRay& ray, float tMax, float t[4], float u[4], float v[4] )
+{
+    const __m128* d = ray.sseDirection;
+
+    const __m128 e1x = _mm_load_ps( pack.e1[0] );
+    const __m128 e1y = _mm_load_ps( pack.e1[1] );
+    const __m128 e1z = _mm_load_ps( pack.e1[2] );
+    const __m128 e2x = _mm_load_ps( pack.e2[0] );
+    const __m128 e2y = _mm_load_ps( pack.e2[1] );
+    const __m128 e2z = _mm_load_ps( pack.e2[2] );
+
+    // p = cross( direction, e2 )
+    const __m128 px = _mm_sub_ps( _mm_mul_ps( d[1], e2z ), _mm_mul_ps( d[2], e2y ) );
+    const __m128 py = _mm_sub_ps( _mm_mul_ps( d[2], e2x ), _mm_mul_ps( d[0], e2z ) );
+    const __m128 pz = _mm_sub_ps( _mm_mul_ps( d[0], e2y ), _mm_mul_ps( d[1], e2x ) );
+
+    const __m128 det    = Dot( e1x, e1y, e1z, px, py, pz );
+    const __m128 invDet = _mm_div_ps( _mm_set1_ps( 1.0f ), det );
+
+    const __m128 sx = _mm_sub_ps( ray.sseOrigin[0], _mm_load_ps( pack.v0[0] ) );
+    const __m128 sy = _mm_sub_ps( ray.sseOrigin[1], _mm_load_ps( pack.v0[1] ) );
+    const __m128 sz = _mm_sub_ps( ray.sseOrigin[2], _mm_load_ps( pack.v0[2] ) );
+
+    const __m128 bu = _mm_mul_ps( Dot( sx, sy, sz, px, py, pz ), invDet );
+
+    // q = cross( s, e1 )
+    const __m128 qx = _mm_sub_ps( _mm_mul_ps( sy, e1z ), _mm_mul_ps( sz, e1y ) );
+    const __m128 qy = _mm_sub_ps( _mm_mul_ps( sz, e1x ), _mm_mul_ps( sx, e1z ) );
+    const __m128 qz = _mm_sub_ps( _mm_mul_ps( sx, e1y ), _mm_mul_ps( sy, e1x ) );
+
+    const __m128 bv = _mm_mul_ps( Dot( d[0], d[1], d[2], qx, qy, qz ), invDet );
+    const __m128 bt = _mm_mul_ps( Dot( e2x, e2y, e2z, qx, qy, qz ), invDet );
+
+    const __m128 zero = _mm_setzero_ps();
+    __m128       hit  = _mm_cmpneq_ps( det, zero );
+    hit               = _mm_and_ps( hit, _mm_cmpge_ps( bu, zero ) );
+    hit               = _mm_and_ps( hit, _mm_cmpge_ps( bv, zero ) );
+    hit               = _mm_and_ps( hit, _mm_cmple_ps( _mm_add_ps( bu, bv ), _mm_set1_ps( 1.0f ) ) );
+    hit               = _mm_and_ps( hit, _mm_cmpge_ps( bt, ray.sseTMin ) );
+    hit               = _mm_and_ps( hit, _mm_cmple_ps( bt, _mm_set1_ps( tMax ) ) );
+
+    _mm_storeu_ps( t, bt );
+    _mm_storeu_ps( u, bu );
+    _mm_storeu_ps( v, bv );
+    return _mm_movemask_ps( hit );
+}
+
+#else
+
+int IntersectNode( const WideBvhNode& node, const PreparedRay& ray, float tMax, float dist[4] )
+{
+    int mask = 0;
+    for ( int lane = 0; lane < 4; ++lane )
+    {
+        float tNear = ray.tMin;
+        float tFar  = tMax;
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            const float nearPlane = node.bounds[ray.near[axis]][lane];
+            const float farPlane  = node.bounds[ray.far[axis]][lane];
+
+            tNear = std::max( tNear, ( nearPlane - ray.origin[axis] ) * ray.invDirection[axis] );
+            tFar  = std::min( tFar, ( farPlane - ray.origin[axis] ) * ray.invDirection[axis] );
+        }
+
+        dist[lane] = tNear;
+        mask |= tNear <= tFar ? 1 << lane : 0;
+    }
+    return mask;
+}
+
+int IntersectPack( const TrianglePack& pack, const PreparedRay& ray, float tMax, float t[4], float u[4], float v[4] )
+{
+    int mask = 0;
+    for ( int lane = 0; lane < 4; ++lane )
+    {
+        const float3 v0( pack.v0[0][lane], pack.v0[1][lane], pack.v0[2][lane] );
+        const float3 e1( pack.e1[0][lane], pack.e1[1][lane], pack.e1[2][lane] );
+        const float3 e2( pack.e2[0][lane], pack.e2[1][lane], pack.e2[2][lane] );
+
+        const float3 p   = cross( ray.direction, e2 );
+        const float  det = dot( e1, p );
+        if ( det == 0.0f )
+        {
+            continue;
+        }
+
+        const float  invDet = 1.0f / det;
+        const float3 s      = ray.origin - v0;
+        const float3 q      = cross( s, e1 );
+
+        u[lane] = dot( s, p ) * invDet;
+        v[lane] = dot( ray.direction, q ) * invDet;
+        t[lane] = dot( e2, q ) * invDet;
+
+        if ( u[lane] >= 0.0f && v[lane] >= 0.0f && u[lane] + v[lane] <= 1.0f && t[lane] >= ray.tMin &&
+             t[lane] <= tMax )
+        {
+            mask |= 1 << lane;
+        }
+    }
+    return mask;
+}
+
+#endif
+
+}  // namespace
+
+void WideBvh::Build( const Bvh& bvh )
+{
+    Clear();
+
+    const std::vector<BvhNode>&      nodes      = bvh.GetNodes();
+    const std::vector<BvhTriangle>&  triangles  = bvh.GetTriangles();
+    const std::vector<BvhPrimitive>& primitives = bvh.GetPrimitives();
+    if ( nodes.empty() )
+    {
+        return;
+    }
+
+    // The triangles of a binary leaf into packs, returns how many.
+    auto addPacks = [&]( const BvhNode& leaf ) {
+        const uint32_t packCount = ( leaf.count + 3 ) / 4;
+        for ( uint32_t p = 0; p < packCount; ++p )
+        {
+            TrianglePack pack = {};
+            for ( uint32_t lane = 0; lane < 4; ++lane )
+            {
+                const uint32_t index = leaf.first + p * 4 + lane;
+                if ( index >= leaf.first + leaf.count )
+                {
+                    m_Primitives.push_back( { BVH_NO_HIT, BVH_NO_HIT } );
+                    continue;
+                }
+
+                const BvhTriangle& triangle = triangles[index];
+                const float3       e1       = triangle.v1 - triangle.v0;
+                const float3       e2       = triangle.v2 - triangle.v0;
+                for ( int axis = 0; axis < 3; ++axis )
+                {
+                    pack.v0[axis][lane] = triangle.v0[axis];
+                    pack.e1[axis][lane] = e1[axis];
+                    pack.e2[axis][lane] = e2[axis];
+                }
+                m_Primitives.push_back( primitives[index] );
+            }
+            m_Packs.push_back( pack );
+        }
+        return packCount;
+    };
+
+    struct Work
+    {
+        uint32_t binary;
+        uint32_t wide;
+        uint32_t depth;
+    };
+
+    m_Nodes.emplace_back();
+    std::vector<Work> stack = { { 0, 0, 1 } };
+
+    while ( !stack.empty() )
+    {
+        const Work work = stack.back();
+        stack.pop_back();
+        m_Depth = std::max( m_Depth, work.depth );
+
+        // Open the inner child of largest surface area until there are four.
+        uint32_t children[4] = { work.binary };
+        uint32_t childCount  = 1;
+        if ( !nodes[work.binary].IsLeaf() )
+        {
+            children[0] = nodes[work.binary].first;
+            children[1] = nodes[work.binary].first + 1;
+            childCount  = 2;
+
+            while ( childCount < 4 )
+            {
+                int   largest     = -1;
+                float largestArea = -1.0f;
+                for ( uint32_t c = 0; c < childCount; ++c )
+                {
+                    if ( !nodes[children[c]].IsLeaf() && Area( nodes[children[c]] ) > largestArea )
+                    {
+                        largest     = static_cast<int>( c );
+                        largestArea = Area( nodes[children[c]] );
+                    }
+                }
+                if ( largest < 0 )
+                {
+                    break;
+                }
+
+                const uint32_t first    = nodes[children[largest]].first;
+                children[largest]      = first;
+                children[childCount++] = first + 1;
+            }
+        }
+
+        WideBvhNode node = {};
+        for ( uint32_t c = 0; c < 4; ++c )
+        {
+            for ( int axis = 0; axis < 3; ++axis )
+            {
+                node.bounds[2 * axis][c]     = std::numeric_limits<float>::infinity();
+                node.bounds[2 * axis + 1][c] = -std::numeric_limits<float>::infinity();
+            }
+        }
+
+        for ( uint32_t c = 0; c < childCount; ++c )
+        {
+            const BvhNode& child = nodes[children[c]];
+            for ( int axis = 0; axis < 3; ++axis )
+            {
+                node.bounds[2 * axis][c]     = child.lower[axis];
+                node.bounds[2 * axis + 1][c] = child.upper[axis];
+            }
+
+            if ( child.IsLeaf() )
+            {
+                node.child[c]     = static_cast<uint32_t>( m_Packs.size() );
+                node.packCount[c] = addPacks( child );
+            }
+            else
+            {
+                node.child[c] = static_cast<uint32_t>( m_Nodes.size() );
+                m_Nodes.emplace_back();
+                stack.push_back( { children[c], node.child[c], work.depth + 1 } );
+            }
+        }
+
+        m_Nodes[work.wide] = node;
+    }
+}
+
+void WideBvh::Clear()
+{
+    m_Nodes.clear();
+    m_Packs.clear();
+    m_Primitives.clear();
+    m_Depth = 0;
+}
+
+bool WideBvh::Intersect( const RayDesc& ray, RayHit& hit ) const
+{
+    hit = RayHit();
+    return Traverse<false>( ray, hit );
+}
+
+bool WideBvh::Occluded( const RayDesc& ray ) const
+{
+    RayHit hit;
+    return Traverse<true>( ray, hit );
+}
+
+BvhTriangle WideBvh::GetTriangle( uint32_t triangle ) const
+{
+    const TrianglePack& pack = m_Packs[triangle / 4];
+    const uint32_t      lane = triangle % 4;
+
+    const float3 v0( pack.v0[0][lane], pack.v0[1][lane], pack.v0[2][lane] );
+    const float3 e1( pack.e1[0][lane], pack.e1[1][lane], pack.e1[2][lane] );
+    const float3 e2( pack.e2[0][lane], pack.e2[1][lane], pack.e2[2][lane] );
+    return { v0, v0 + e1, v0 + e2 };
+}
+
+uint64_t WideBvh::GetMemoryBytes() const
+{
+    return m_Nodes.size() * sizeof( WideBvhNode ) + m_Packs.size() * sizeof( TrianglePack ) +
+           m_Primitives.size() * sizeof( BvhPrimitive );
+}
+
+template<bool AnyHit>
+bool WideBvh::Traverse( const RayDesc& ray, RayHit& hit ) const
+{
+    if ( m_Nodes.empty() )
+    {
+        return false;
+    }
+
+    struct Entry
+    {
+        uint32_t child;
+        uint32_t packCount;
+        float    dist;
+    };
+
+    // Every node popped pushes at most four, three more than it takes.
+    const uint32_t     stackSize = 3 * m_Depth + 2;
+    Entry              localStack[LOCAL_STACK_SIZE];
+    std::vector<Entry> heapStack;
+    Entry*             stack = localStack;
+    if ( stackSize > LOCAL_STACK_SIZE )
+    {
+        heapStack.resize( stackSize );
+        stack = heapStack.data();
+    }
+
+    const PreparedRay prepared( ray );
+    float             tMax = ray.tMax;
+
+    uint32_t size = 0;
+    stack[size++] = { 0, 0, ray.tMin };
+
+    while ( size > 0 )
+    {
+        const Entry entry = stack[--size];
+        if ( entry.dist > tMax )
+        {
+            continue;
+        }
+
+        if ( entry.packCount > 0 )
+        {
+            for ( uint32_t p = entry.child; p < entry.child + entry.packCount; ++p )
+            {
+                alignas( 16 ) float t[4], u[4], v[4];
+                const int mask = IntersectPack( m_Packs[p], prepared, tMax, t, u, v );
+                if ( AnyHit && mask )
+                {
+                    return true;
+                }
+
+                for ( int lane = 0; lane < 4; ++lane )
+                {
+                    if ( ( mask & ( 1 << lane ) ) && t[lane] <= tMax )
+                    {
+                        tMax             = t[lane];
+                        hit.t            = t[lane];
+                        hit.barycentrics = float2( u[lane], v[lane] );
+                        hit.triangle     = p * 4 + lane;
+                    }
+                }
+            }
+            continue;
+        }
+
+        const WideBvhNode& node = m_Nodes[entry.child];
+
+        alignas( 16 ) float dist[4];
+        const int mask = IntersectNode( node, prepared, tMax, dist );
+
+        // Nearest on top of the stack, for the closest hit to shrink tMax early.
+        Entry    hits[4];
+        uint32_t hitCount = 0;
+        for ( int lane = 0; lane < 4; ++lane )
+        {
+            if ( !( mask & ( 1 << lane ) ) )
+            {
+                continue;
+            }
+            const Entry next = { node.child[lane], node.packCount[lane], dist[lane] };
+
+            uint32_t i = hitCount++;
+            for ( ; i > 0 && hits[i - 1].dist < next.dist; --i )
+            {
+                hits[i] = hits[i - 1];
+            }
+            hits[i] = next;
+        }
+
+        for ( uint32_t i = 0; i < hitCount; ++i )
+        {
+            stack[size++] = hits[i];
+        }
+    }
+
+    return hit.IsHit();
+}
@@ -0,0 +1,292 @@
+/*
+ *  AdaptiveSampler against small made up reference frames: the pixels each
+ *  scheduler cast and interpolated, no pixel left AS_EMPTY, the same frame
+ *  on any number of threads, and the variance guidance moving the masks.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/AdaptiveSampler.h>
+#include <cpulib/ThreadPool.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+// A flat surface facing the camera, object 1 left of edgeX and object 2 from there on. The colour grows by gradient
+// per pixel to the right.
+RayBuffer MakeReference( uint32_t width, uint32_t height, uint32_t edgeX, float gradient = 0 )
+{
+    RayBuffer reference;
+    reference.Resize( width, height );
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        for ( uint32_t x = 0; x < width; ++x )
+        {
+            const float value = 0.2f + gradient * x;
+            reference.Colour()( x, y )     = float4( value, value, value, AS_CASTED );
+            reference.Normals()( x, y )    = float4( 0.5f, 0.5f, 1.0f, 1.0f );
+            reference.PosDepth()( x, y )   = float4( x * 0.01f, y * 0.01f, 1.0f, 0.1f );
+            reference.ObjectMask()( x, y ) = float4( x < edgeX ? 1.0f : 2.0f, 0, 0, 1 );
+        }
+    }
+    return reference;
+}
+
+// One character per pixel: C cast, I interpolated, . anything else.
+std::vector<std::string> GetMask( const RayBuffer& buffer )
+{
+    std::vector<std::string> mask;
+    for ( uint32_t y = 0; y < buffer.GetHeight(); ++y )
+    {
+        std::string row;
+        for ( uint32_t x = 0; x < buffer.GetWidth(); ++x )
+        {
+            const float state = buffer.Colour()( x, y ).w;
+            row += state == AS_CASTED ? 'C' : state == AS_INTERPOLATED ? 'I' : '.';
+        }
+        mask.push_back( row );
+    }
+    return mask;
+}
+
+bool SameMask( const std::vector<std::string>& mask, const std::vector<std::string>& expected, uint32_t line )
+{
+    if ( mask == expected )
+        return true;
+
+    std::string message = "mask differs, got";
+    for ( const std::string& row: mask )
+        message += "\n    " + row;
+    test::ReportFailure( __FILE__, line, message );
+    return false;
+}
+
+bool SameBuffer( const RayBuffer& a, const RayBuffer& b )
+{
+    for ( uint32_t slot = 0; slot < SLOT_COUNT; ++slot )
+    {
+        if ( std::memcmp( a.slots[slot].GetData(), b.slots[slot].GetData(),
+                          a.GetWidth() * a.GetHeight() * sizeof( float4 ) ) != 0 )
+            return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+TEST( AdaptiveSampler, IterativeMask )
+{
+    ThreadPool              pool( 2 );
+    AdaptiveSampler         sampler( pool );
+    AdaptiveSamplerSettings settings;
+    RayBuffer               buffer;
+
+    // Tiles of 2: the border and every other pixel cast first, the rest interpolated from the four around them,
+    // except next to the edge between the objects at x = 6.
+    settings.gridSize = 1;
+    sampler.SetSettings( settings );
+
+    AdaptiveSamplerStats stats = sampler.Run( buffer, MakeReference( 11, 7, 6 ) );
+    CHECK( SameMask( GetMask( buffer ),
+                     { "CCCCCCCCCCC",
+                       "CCICICCCICC",
+                       "CICICCCICIC",
+                       "CCICICCCICC",
+                       "CICICCCICIC",
+                       "CCICICCCICC",
+                       "CCCCCCCCCCC" },
+                     __LINE__ ) );
+    CHECK( stats.castPerPass == std::vector<uint32_t>( { 55, 5 } ) );
+    CHECK( stats.interpolatedPerPass == std::vector<uint32_t>( { 0, 17 } ) );
+    CHECK( stats.colourError == 0 );
+
+    // Tiles of 4: corners and centres first, the triangles between them, then the four around what is left.
+    settings.gridSize = 2;
+    sampler.SetSettings( settings );
+
+    stats = sampler.Run( buffer, MakeReference( 13, 9, 7 ) );
+    CHECK( SameMask( GetMask( buffer ),
+                     { "CCCCCCCCCCCCC",
+                       "CIIIIICCIIIIC",
+                       "CICIIICCIICIC",
+                       "CIIIIICCIIIIC",
+                       "CIIICICCCIIIC",
+                       "CIIIIICCIIIIC",
+                       "CICIIICCIICIC",
+                       "CIIIIICCIIIIC",
+                       "CCCCCCCCCCCCC" },
+                     __LINE__ ) );
+    CHECK( stats.castPerPass == std::vector<uint32_t>( { 48, 5, 7 } ) );
+    CHECK( stats.interpolatedPerPass == std::vector<uint32_t>( { 0, 56, 1 } ) );
+}
+
+TEST( AdaptiveSampler, QuadtreeMask )
+{
+    ThreadPool              pool( 2 );
+    AdaptiveSampler         sampler( pool );
+    AdaptiveSamplerSettings settings;
+    settings.gridSize = 2;
+    settings.mode     = SchedulerMode::Quadtree;
+    sampler.SetSettings( settings );
+    CHECK( sampler.GetPassCount() == 3 );
+
+    // A lattice of 4 and the image border, then of 2, then the rest. Cells whose corners are all on one object are
+    // interpolated, the ones across the edge at x = 6 refined.
+    RayBuffer                  buffer;
+    const AdaptiveSamplerStats stats = sampler.Run( buffer, MakeReference( 11, 9, 6 ) );
+    CHECK( SameMask( GetMask( buffer ),
+                     { "CIIICCCICIC",
+                       "IIIICCIIIII",
+                       "IIIICCCIIII",
+                       "IIIICCIIIII",
+                       "CIIICCCICIC",
+                       "IIIICCIIIII",
+                       "IIIICCCIIII",
+                       "IIIICCIIIII",
+                       "CIIICCCICIC" },
+                     __LINE__ ) );
+    CHECK( stats.castPerPass == std::vector<uint32_t>( { 12, 7, 13 } ) );
+    CHECK( stats.interpolatedPerPass == std::vector<uint32_t>( { 0, 54, 13 } ) );
+}
+
+TEST( AdaptiveSampler, NothingLeftEmpty )
+{
+    ThreadPool      pool( 3 );
+    AdaptiveSampler sampler( pool );
+    RayBuffer       buffer;
+
+    // Odd sizes, sizes smaller than a tile, and a colour ramp steep enough to fail some of the interpolations.
+    const RayBuffer references[] = { MakeReference( 1, 1, 1 ), MakeReference( 2, 3, 1 ),
+                                     MakeReference( 37, 23, 20, 0.004f ), MakeReference( 70, 41, 9, 0.02f ) };
+
+    for ( SchedulerMode mode: { SchedulerMode::Iterative, SchedulerMode::Quadtree } )
+    {
+        for ( int gridSize = 0; gridSize <= 4; ++gridSize )
+        {
+            AdaptiveSamplerSettings settings;
+            settings.mode           = mode;
+            settings.gridSize       = gridSize;
+            settings.quadtreePasses = 2 + gridSize % 3;
+            sampler.SetSettings( settings );
+
+            for ( const RayBuffer& reference: references )
+            {
+                const AdaptiveSamplerStats stats = sampler.Run( buffer, reference );
+                CHECK( stats.totalCast + stats.totalInterpolated == stats.pixelCount );
+                CHECK( stats.castPerPass.size() == static_cast<size_t>( sampler.GetPassCount() ) );
+
+                uint32_t left = 0;
+                for ( const std::string& row: GetMask( buffer ) )
+                    left += static_cast<uint32_t>( std::count( row.begin(), row.end(), '.' ) );
+                CHECK( left == 0 );
+            }
+        }
+    }
+}
+
+TEST( AdaptiveSampler, SameOnAnyThreadCount )
+{
+    // Several tiles in both directions.
+    const RayBuffer reference = MakeReference( 150, 90, 77, 0.005f );
+
+    // Unconverged on the left, converged on the right.
+    ImageF4 moments;
+    moments.Resize( 150, 90, float4( 0.2f, 0.04f, 10, 0 ) );
+    for ( uint32_t y = 0; y < 90; ++y )
+        for ( uint32_t x = 0; x < 40; ++x )
+            moments( x, y ).z = 0;
+
+    for ( SchedulerMode mode: { SchedulerMode::Iterative, SchedulerMode::Quadtree } )
+    {
+        AdaptiveSamplerSettings settings;
+        settings.mode           = mode;
+        settings.gridSize       = 3;
+        settings.varianceGuided = true;
+
+        ThreadPool      single( 1 );
+        AdaptiveSampler sampler( single );
+        sampler.SetSettings( settings );
+        sampler.SetMomentHistory( &moments );
+
+        RayBuffer                  expected;
+        const AdaptiveSamplerStats expectedStats = sampler.Run( expected, reference );
+
+        for ( uint32_t threads: { 2u, 5u, 8u } )
+        {
+            ThreadPool      pool( threads );
+            AdaptiveSampler threaded( pool );
+            threaded.SetSettings( settings );
+            threaded.SetMomentHistory( &moments );
+
+            RayBuffer                  buffer;
+            const AdaptiveSamplerStats stats = threaded.Run( buffer, reference );
+            CHECK( SameBuffer( buffer, expected ) );
+            CHECK( stats.castPerPass == expectedStats.castPerPass );
+            CHECK( stats.interpolatedPerPass == expectedStats.interpolatedPerPass );
+        }
+    }
+}
+
+TEST( AdaptiveSampler, VarianceGuidance )
+{
+    // A ramp that is just too steep for the colour limit, one object.
+    const uint32_t  width = 41, height = 25;
+    const RayBuffer reference = MakeReference( width, height, width, 0.03f );
+
+    ThreadPool              pool( 2 );
+    AdaptiveSampler         sampler( pool );
+    AdaptiveSamplerSettings settings;
+    settings.gridSize = 2;
+
+    for ( SchedulerMode mode: { SchedulerMode::Iterative, SchedulerMode::Quadtree } )
+    {
+        settings.mode           = mode;
+        settings.varianceGuided = false;
+        sampler.SetSettings( settings );
+
+        RayBuffer                  unguided;
+        const AdaptiveSamplerStats unguidedStats = sampler.Run( unguided, reference );
+
+        // Converged everywhere: the wider limits interpolate more.
+        ImageF4 moments;
+        moments.Resize( width, height, float4( 0.2f, 0.04f, 10, 0 ) );
+
+        settings.varianceGuided = true;
+        sampler.SetSettings( settings );
+        sampler.SetMomentHistory( &moments );
+
+        RayBuffer                  converged;
+        const AdaptiveSamplerStats convergedStats = sampler.Run( converged, reference );
+        CHECK( convergedStats.totalInterpolated > unguidedStats.totalInterpolated );
+
+        // Noisy on the left, a standard deviation of 0.1 over a mean of 0.2: all of it is cast in the first pass.
+        for ( uint32_t y = 0; y < height; ++y )
+            for ( uint32_t x = 0; x < 10; ++x )
+                moments( x, y ).y = 0.05f;
+
+        RayBuffer                  noisy;
+        const AdaptiveSamplerStats noisyStats = sampler.Run( noisy, reference );
+        CHECK( noisyStats.castPerPass[0] > convergedStats.castPerPass[0] );
+
+        const std::vector<std::string> mask = GetMask( noisy );
+        for ( const std::string& row: mask )
+            CHECK( row.substr( 0, 10 ) == std::string( 10, 'C' ) );
+        CHECK( mask != GetMask( converged ) );
+
+        // So is a short history.
+        moments.Fill( float4( 0.2f, 0.04f, 1, 0 ) );
+        CHECK( sampler.Run( noisy, reference ).castPerPass[0] == width * height );
+
+        // Without a history there is no guidance.
+        sampler.SetMomentHistory( nullptr );
+        sampler.Run( noisy, reference );
+        CHECK( SameBuffer( noisy, unguided ) );
+    }
+}
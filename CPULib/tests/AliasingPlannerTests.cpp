@@ -0,0 +1,194 @@
+/*
+ *  AliasingPlanner placements on hand-made lifetimes, random ones checked
+ *  against the bytes alive at every pass, and the SVGF rotation.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/AliasingPlanner.h>
+#include <cpulib/SvgfRotation.h>
+#include <cpulib/VectorMath.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+const uint64_t ALIGNMENT = AliasingPlanner::DEFAULT_ALIGNMENT;
+
+bool PlanAndValidate( AliasingPlanner& planner )
+{
+    planner.Plan();
+
+    std::string error;
+    const bool  valid = planner.Validate( &error );
+    if ( !valid )
+        test::ReportFailure( __FILE__, __LINE__, error + "\n" + planner.Describe() );
+    return valid;
+}
+
+}  // namespace
+
+TEST( AliasingPlanner, DisjointLifetimesShareMemory )
+{
+    AliasingPlanner planner;
+    const uint32_t  a = planner.AddResource( "a", 4 * ALIGNMENT );
+    const uint32_t  b = planner.AddResource( "b", 4 * ALIGNMENT );
+    planner.AddLifetime( a, 0, 1 );
+    planner.AddLifetime( b, 2, 3 );
+    REQUIRE( PlanAndValidate( planner ) );
+
+    CHECK( !planner.Overlaps( a, b ) );
+    CHECK( planner.GetOffset( a ) == 0 );
+    CHECK( planner.GetOffset( b ) == 0 );
+    CHECK( planner.GetHeapSize() == 4 * ALIGNMENT );
+    CHECK( planner.GetSavedBytes() == 4 * ALIGNMENT );
+}
+
+TEST( AliasingPlanner, OverlappingLifetimesDoNot )
+{
+    // The end of a lifetime is inclusive, a pass that reads a and writes b needs both.
+    AliasingPlanner planner;
+    const uint32_t  a = planner.AddResource( "a", 4 * ALIGNMENT );
+    const uint32_t  b = planner.AddResource( "b", 4 * ALIGNMENT );
+    planner.AddLifetime( a, 0, 2 );
+    planner.AddLifetime( b, 2, 3 );
+    REQUIRE( PlanAndValidate( planner ) );
+
+    CHECK( planner.Overlaps( a, b ) );
+    CHECK( planner.GetOffset( a ) != planner.GetOffset( b ) );
+    CHECK( planner.GetHeapSize() == 8 * ALIGNMENT );
+    CHECK( planner.GetSavedBytes() == 0 );
+}
+
+TEST( AliasingPlanner, SmallResourcesFillTheGaps )
+{
+    // big is placed first, small alive with it goes above it, late reuses the memory of big.
+    AliasingPlanner planner;
+    const uint32_t  small = planner.AddResource( "small", ALIGNMENT );
+    const uint32_t  late  = planner.AddResource( "late", ALIGNMENT );
+    const uint32_t  big   = planner.AddResource( "big", 2 * ALIGNMENT );
+    planner.AddLifetime( big, 0, 1 );
+    planner.AddLifetime( small, 0, 3 );
+    planner.AddLifetime( late, 2, 3 );
+    REQUIRE( PlanAndValidate( planner ) );
+
+    CHECK( planner.GetOffset( big ) == 0 );
+    CHECK( planner.GetOffset( small ) == 2 * ALIGNMENT );
+    CHECK( planner.GetOffset( late ) == 0 );
+    CHECK( planner.GetHeapSize() == 3 * ALIGNMENT );
+    CHECK( planner.GetCommittedSize() == 4 * ALIGNMENT );
+}
+
+TEST( AliasingPlanner, SeveralIntervals )
+{
+    // history is alive at the start and at the end of the frame, the middle is free for temp.
+    AliasingPlanner planner;
+    const uint32_t  history = planner.AddResource( "history", ALIGNMENT );
+    const uint32_t  temp    = planner.AddResource( "temp", ALIGNMENT );
+    const uint32_t  across  = planner.AddResource( "across", ALIGNMENT );
+    planner.AddLifetime( history, 0, 1 );
+    planner.AddLifetime( history, 6, 7 );
+    planner.AddLifetime( temp, 2, 5 );
+    planner.AddLifetime( across, 1, 2 );
+    REQUIRE( PlanAndValidate( planner ) );
+
+    CHECK( !planner.Overlaps( history, temp ) );
+    CHECK( planner.Overlaps( history, across ) );
+    CHECK( planner.Overlaps( temp, across ) );
+    CHECK( planner.GetOffset( history ) == planner.GetOffset( temp ) );
+    CHECK( planner.GetHeapSize() == 2 * ALIGNMENT );
+}
+
+TEST( AliasingPlanner, Alignment )
+{
+    AliasingPlanner planner;
+    const uint32_t  a = planner.AddResource( "a", 300, 256 );
+    const uint32_t  b = planner.AddResource( "b", 100, 256 );
+    planner.AddLifetime( a, 0, 0 );
+    planner.AddLifetime( b, 0, 0 );
+    REQUIRE( PlanAndValidate( planner ) );
+
+    CHECK( planner.GetOffset( a ) == 0 );
+    CHECK( planner.GetOffset( b ) == 512 );
+    CHECK( planner.GetHeapSize() == 612 );
+    CHECK( planner.GetCommittedSize() == 768 );
+}
+
+TEST( AliasingPlanner, UnusedResourceSharesWithAnything )
+{
+    AliasingPlanner planner;
+    const uint32_t  used   = planner.AddResource( "used", ALIGNMENT );
+    const uint32_t  unused = planner.AddResource( "unused", ALIGNMENT );
+    planner.AddLifetime( used, 0, 9 );
+    REQUIRE( PlanAndValidate( planner ) );
+
+    CHECK( !planner.Overlaps( used, unused ) );
+    CHECK( planner.GetOffset( unused ) == 0 );
+    CHECK( planner.GetHeapSize() == ALIGNMENT );
+}
+
+TEST( AliasingPlanner, RandomLifetimes )
+{
+    std::mt19937 random( 7 );
+
+    const uint32_t passCount = 32;
+    for ( int round = 0; round < 50; ++round )
+    {
+        AliasingPlanner planner;
+
+        // What a perfect packing would still need: the bytes alive in the busiest pass.
+        std::vector<uint64_t> aliveBytes( passCount, 0 );
+        uint64_t              biggest = 0;
+
+        const uint32_t resourceCount = 1 + random() % 24;
+        for ( uint32_t r = 0; r < resourceCount; ++r )
+        {
+            const uint64_t size = ( 1 + random() % 8 ) * ALIGNMENT;
+            planner.AddResource( "r" + std::to_string( r ), size );
+            biggest = std::max( biggest, size );
+
+            // Up to three intervals that do not overlap each other, so no pass is counted twice.
+            uint32_t pass = random() % 8;
+            for ( uint32_t i = random() % 3 + 1; i > 0 && pass < passCount; --i )
+            {
+                const uint32_t end = std::min<uint32_t>( pass + random() % 8, passCount - 1 );
+                planner.AddLifetime( r, pass, end );
+                for ( uint32_t p = pass; p <= end; ++p )
+                    aliveBytes[p] += size;
+                pass = end + 2 + random() % 4;
+            }
+        }
+        REQUIRE( PlanAndValidate( planner ) );
+
+        const uint64_t lowerBound = std::max( biggest, *std::max_element( aliveBytes.begin(), aliveBytes.end() ) );
+        CHECK( planner.GetHeapSize() >= lowerBound );
+        CHECK( planner.GetHeapSize() <= planner.GetCommittedSize() );
+    }
+}
+
+TEST( AliasingPlanner, SvgfRotation )
+{
+    ResourceRotation rotation;
+    BuildSvgfRotation( rotation, 5 );
+    REQUIRE( rotation.Plan() );
+
+    const uint64_t  bufferSize = uint64_t( 1920 ) * 1080 * sizeof( float4 );
+    AliasingPlanner planner;
+    AddRotationLifetimes( planner, rotation, bufferSize );
+    REQUIRE( planner.GetResourceCount() == rotation.GetBufferCount() );
+    REQUIRE( PlanAndValidate( planner ) );
+
+    // Something shares memory, and the histories are alive in every frame.
+    CHECK( planner.GetHeapSize() < planner.GetCommittedSize() );
+    CHECK( planner.GetHeapSize() >= rotation.GetHistoryBuffers( 0 ).size() * bufferSize );
+
+    const SvgfMemory memory = PlanSvgfMemory( rotation, 1920, 1080 );
+    CHECK( memory.committedBytes == planner.GetCommittedSize() );
+    CHECK( memory.aliasedBytes == planner.GetHeapSize() );
+}
@@ -0,0 +1,170 @@
+/*
+ *  The binned SAH BVH: a valid tree, the same tree on any number of threads,
+ *  and Update refitting and rebuilding moved triangles.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/Bvh.h>
+#include <cpulib/ThreadPool.h>
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+struct Soup
+{
+    std::vector<BvhTriangle>  triangles;
+    std::vector<BvhPrimitive> primitives;
+};
+
+// Small triangles in a few clusters of different density, so the splits aren't all alike.
+Soup MakeSoup( uint32_t count, uint32_t seed )
+{
+    std::mt19937                          random( seed );
+    std::uniform_real_distribution<float> unit( -1.0f, 1.0f );
+
+    const float3 centres[] = { float3( 0, 0, 0 ), float3( 50, 0, 0 ), float3( 0, 20, -30 ), float3( 5, 5, 5 ) };
+    const float  radii[]   = { 10.0f, 2.0f, 25.0f, 0.5f };
+
+    Soup soup;
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        const uint32_t cluster = i % 4;
+        const float3   p = centres[cluster] + float3( unit( random ), unit( random ), unit( random ) ) * radii[cluster];
+        const float    size = 0.01f * radii[cluster];
+
+        BvhTriangle triangle;
+        triangle.v0 = p;
+        triangle.v1 = p + float3( unit( random ), unit( random ), unit( random ) ) * size;
+        triangle.v2 = p + float3( unit( random ), unit( random ), unit( random ) ) * size;
+        soup.triangles.push_back( triangle );
+        soup.primitives.push_back( { cluster, i } );
+    }
+    return soup;
+}
+
+bool ValidateBvh( const Bvh& bvh, uint32_t line )
+{
+    std::string error;
+    if ( bvh.Validate( &error ) )
+        return true;
+    test::ReportFailure( __FILE__, line, error );
+    return false;
+}
+
+bool SameTree( const Bvh& a, const Bvh& b )
+{
+    const std::vector<BvhNode>&      nodesA      = a.GetNodes();
+    const std::vector<BvhNode>&      nodesB      = b.GetNodes();
+    const std::vector<BvhPrimitive>& primitivesA = a.GetPrimitives();
+    const std::vector<BvhPrimitive>& primitivesB = b.GetPrimitives();
+    return nodesA.size() == nodesB.size() && primitivesA.size() == primitivesB.size() &&
+           std::memcmp( nodesA.data(), nodesB.data(), nodesA.size() * sizeof( BvhNode ) ) == 0 &&
+           std::memcmp( primitivesA.data(), primitivesB.data(), primitivesA.size() * sizeof( BvhPrimitive ) ) == 0;
+}
+
+}  // namespace
+
+TEST( Bvh, BuildIsValid )
+{
+    const Soup soup = MakeSoup( 8000, 1 );
+
+    ThreadPool    pool( 4 );
+    Bvh           bvh;
+    BvhBuildStats stats = bvh.Build( pool, soup.triangles, soup.primitives );
+    REQUIRE( ValidateBvh( bvh, __LINE__ ) );
+
+    CHECK( stats.triangles == 8000 );
+    CHECK( stats.nodes == bvh.GetNodes().size() );
+    CHECK( stats.leaves * 2 == stats.nodes + 1 );
+    CHECK_NEAR( stats.sahCost, bvh.ComputeSahCost(), stats.sahCost * 1e-4f );
+
+    // No leaf over maxLeafSize.
+    for ( const BvhNode& node: bvh.GetNodes() )
+        CHECK( node.count <= BvhBuildOptions().maxLeafSize );
+
+    // Nothing to build from nothing.
+    stats = bvh.Build( pool, std::vector<BvhTriangle>(), std::vector<BvhPrimitive>() );
+    CHECK( stats.nodes == 0 && bvh.GetNodes().empty() );
+}
+
+TEST( Bvh, SameTreeOnAnyThreadCount )
+{
+    const Soup soup = MakeSoup( 24000, 2 );
+
+    // Small tasks, so the top levels get wider than the pools and are split side by side.
+    BvhBuildOptions options;
+    options.taskSize = 1100;
+
+    ThreadPool single( 1 );
+    Bvh        reference;
+    reference.Build( single, soup.triangles, soup.primitives, options );
+    REQUIRE( ValidateBvh( reference, __LINE__ ) );
+
+    for ( uint32_t threads: { 2u, 3u, 8u, 16u } )
+    {
+        ThreadPool          pool( threads );
+        Bvh                 bvh;
+        const BvhBuildStats stats = bvh.Build( pool, soup.triangles, soup.primitives, options );
+        CHECK( stats.tasks > threads );
+        CHECK( SameTree( bvh, reference ) );
+
+        // Again on the same pool, nothing left over from the last build.
+        bvh.Build( pool, soup.triangles, soup.primitives, options );
+        CHECK( SameTree( bvh, reference ) );
+    }
+}
+
+TEST( Bvh, UpdateRefits )
+{
+    Soup       soup = MakeSoup( 6000, 3 );
+    ThreadPool pool( 4 );
+    Bvh        bvh;
+    bvh.Build( pool, soup.triangles, soup.primitives );
+    const std::vector<BvhNode> built = bvh.GetNodes();
+
+    // A small move: refit only, the tree keeps its shape.
+    for ( BvhTriangle& triangle: soup.triangles )
+    {
+        triangle.v0 = triangle.v0 + float3( 0.001f, 0, 0 );
+        triangle.v1 = triangle.v1 + float3( 0.001f, 0, 0 );
+        triangle.v2 = triangle.v2 + float3( 0.001f, 0, 0 );
+    }
+
+    BvhUpdateStats stats = bvh.Update( pool, soup.triangles );
+    REQUIRE( ValidateBvh( bvh, __LINE__ ) );
+    CHECK( stats.rebuiltSubtrees == 0 && !stats.fullRebuild );
+    REQUIRE( bvh.GetNodes().size() == built.size() );
+    for ( size_t i = 0; i < built.size(); ++i )
+        CHECK( bvh.GetNodes()[i].first == built[i].first && bvh.GetNodes()[i].count == built[i].count );
+
+    // The triangles of one cluster scattered over the others: what held them degrades and is rebuilt.
+    std::mt19937                          random( 4 );
+    std::uniform_real_distribution<float> unit( -40.0f, 40.0f );
+    for ( size_t i = 1; i < soup.triangles.size(); i += 4 )
+    {
+        const float3 move( unit( random ), unit( random ), unit( random ) );
+        soup.triangles[i].v0 = soup.triangles[i].v0 + move;
+        soup.triangles[i].v1 = soup.triangles[i].v1 + move;
+        soup.triangles[i].v2 = soup.triangles[i].v2 + move;
+    }
+
+    stats = bvh.Update( pool, soup.triangles );
+    REQUIRE( ValidateBvh( bvh, __LINE__ ) );
+    CHECK( stats.rebuiltSubtrees > 0 || stats.fullRebuild );
+    CHECK( stats.sahCost < stats.refitSahCost );
+
+    // And refit only, when asked to.
+    BvhUpdateOptions refitOnly;
+    refitOnly.rebuildThreshold = 0;
+    stats                      = bvh.Update( pool, soup.triangles, refitOnly );
+    REQUIRE( ValidateBvh( bvh, __LINE__ ) );
+    CHECK( stats.rebuiltSubtrees == 0 && !stats.fullRebuild );
+}
@@ -0,0 +1,172 @@
+/*
+ *  ContentCache: entries released the longest ago are evicted first, entries
+ *  still referenced never are, and the cache goes over its budget only when
+ *  they alone fill it.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/ContentCache.h>
+
+#include <memory>
+#include <string>
+
+using namespace cpulib;
+
+namespace
+{
+
+using StringCache = ContentCache<std::shared_ptr<std::string>>;
+
+std::shared_ptr<std::string> MakeValue( uint64_t key )
+{
+    return std::make_shared<std::string>( "value " + std::to_string( key ) );
+}
+
+// Insert keys first up to last, 100 bytes each, and release them in that order.
+void InsertReleased( StringCache& cache, uint64_t first, uint64_t last )
+{
+    for ( uint64_t key = first; key <= last; ++key )
+    {
+        cache.Insert( key, MakeValue( key ), 100 );
+        cache.Release( key );
+    }
+}
+
+}  // namespace
+
+TEST( ContentCache, AcquireAndInsert )
+{
+    StringCache                  cache;
+    std::shared_ptr<std::string> value;
+
+    // A miss counts nothing until the Insert.
+    CHECK( !cache.Acquire( 1, value ) );
+    CHECK( cache.GetStats().hits == 0 && cache.GetStats().misses == 0 );
+
+    cache.Insert( 1, MakeValue( 1 ), 100 );
+    REQUIRE( cache.Acquire( 1, value ) );
+    CHECK( *value == "value 1" );
+
+    const ContentCacheStats stats = cache.GetStats();
+    CHECK( stats.misses == 1 );
+    CHECK( stats.hits == 1 );
+    CHECK( stats.bytesSaved == 100 );
+    CHECK( stats.entries == 1 );
+    CHECK( stats.referenced == 1 );
+    CHECK( stats.residentBytes == 100 );
+
+    // Two references, both have to go before it is a candidate.
+    cache.Release( 1 );
+    CHECK( cache.GetStats().referenced == 1 );
+    cache.Release( 1 );
+    CHECK( cache.GetStats().referenced == 0 );
+    CHECK( cache.Contains( 1 ) );
+}
+
+TEST( ContentCache, EvictionOrder )
+{
+    StringCache cache( 300 );
+    InsertReleased( cache, 1, 3 );
+    CHECK( cache.GetStats().evictions == 0 );
+
+    // Acquiring 1 and releasing it again makes it the most recent, 2 is the oldest now.
+    std::shared_ptr<std::string> value;
+    REQUIRE( cache.Acquire( 1, value ) );
+    cache.Release( 1 );
+
+    InsertReleased( cache, 4, 4 );
+    CHECK( !cache.Contains( 2 ) );
+    CHECK( cache.Contains( 1 ) && cache.Contains( 3 ) && cache.Contains( 4 ) );
+
+    InsertReleased( cache, 5, 5 );
+    CHECK( !cache.Contains( 3 ) );
+    CHECK( cache.Contains( 1 ) );
+
+    InsertReleased( cache, 6, 6 );
+    CHECK( !cache.Contains( 1 ) );
+    CHECK( cache.Contains( 4 ) && cache.Contains( 5 ) && cache.Contains( 6 ) );
+
+    const ContentCacheStats stats = cache.GetStats();
+    CHECK( stats.evictions == 3 );
+    CHECK( stats.entries == 3 );
+    CHECK( stats.residentBytes == 300 );
+
+    // An evicted value lives on with those who still hold it.
+    CHECK( *value == "value 1" );
+}
+
+TEST( ContentCache, PinnedEntriesStay )
+{
+    StringCache cache( 200 );
+
+    // 1 stays referenced.
+    cache.Insert( 1, MakeValue( 1 ), 100 );
+    InsertReleased( cache, 2, 5 );
+
+    CHECK( cache.Contains( 1 ) );
+    CHECK( cache.Contains( 5 ) );
+    CHECK( !cache.Contains( 2 ) && !cache.Contains( 3 ) && !cache.Contains( 4 ) );
+    CHECK( cache.GetStats().residentBytes == 200 );
+
+    // Neither the budget nor EvictUnreferenced touch it.
+    cache.SetBudget( 0 );
+    CHECK( cache.Contains( 1 ) && !cache.Contains( 5 ) );
+    cache.EvictUnreferenced();
+    CHECK( cache.Contains( 1 ) );
+    CHECK( cache.GetStats().referenced == 1 );
+
+    // Once released it goes, it is over the budget.
+    cache.Release( 1 );
+    CHECK( !cache.Contains( 1 ) );
+    CHECK( cache.GetStats().entries == 0 && cache.GetStats().residentBytes == 0 );
+}
+
+TEST( ContentCache, BudgetOverflow )
+{
+    // The referenced entries alone are over the budget: the cache holds them all and evicts what it can.
+    StringCache cache( 250 );
+    InsertReleased( cache, 1, 1 );
+    for ( uint64_t key = 2; key <= 5; ++key )
+        cache.Insert( key, MakeValue( key ), 100 );
+
+    ContentCacheStats stats = cache.GetStats();
+    CHECK( !cache.Contains( 1 ) );
+    CHECK( stats.entries == 4 && stats.referenced == 4 );
+    CHECK( stats.residentBytes == 400 );
+    CHECK( stats.residentBytes > cache.GetBudget() );
+
+    // Released one by one, each is evicted as long as the rest are still over the budget.
+    cache.Release( 2 );
+    CHECK( !cache.Contains( 2 ) );
+    cache.Release( 3 );
+    CHECK( !cache.Contains( 3 ) );
+
+    // 200 bytes left, under the budget: what is released now stays.
+    cache.Release( 4 );
+    cache.Release( 5 );
+    CHECK( cache.Contains( 4 ) && cache.Contains( 5 ) );
+
+    stats = cache.GetStats();
+    CHECK( stats.residentBytes == 200 );
+    CHECK( stats.evictions == 3 );
+    CHECK( stats.referenced == 0 );
+
+    // A larger budget evicts nothing, a smaller one the oldest first.
+    cache.SetBudget( 1000 );
+    CHECK( cache.GetStats().entries == 2 );
+    cache.SetBudget( 150 );
+    CHECK( !cache.Contains( 4 ) && cache.Contains( 5 ) );
+}
+
+TEST( ContentCache, EntryLargerThanTheBudget )
+{
+    StringCache cache( 100 );
+    cache.Insert( 1, MakeValue( 1 ), 1000 );
+    CHECK( cache.Contains( 1 ) );
+
+    // Nobody holds it any more, it can't stay.
+    cache.Release( 1 );
+    CHECK( !cache.Contains( 1 ) );
+    CHECK( cache.GetStats().residentBytes == 0 );
+}
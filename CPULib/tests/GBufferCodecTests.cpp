@@ -0,0 +1,231 @@
+/*
+ *  The compact G-buffer encoding: snorm rounding, octahedral normals over the
+ *  sphere and on its poles and seams, depth and the rebuilt positions, the
+ *  object ids, and the round trip of a whole frame.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/CameraPath.h>
+#include <cpulib/GBufferCodec.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+// Half a snorm16 step in the octahedral square is a few thousandths of a degree on the sphere.
+const float MAX_NORMAL_DEGREES = 0.005f;
+
+// As accurate for small angles as for large ones.
+float AngleDegrees( float3 a, float3 b )
+{
+    a = normalize( a );
+    b = normalize( b );
+    return std::atan2( length( cross( a, b ) ), dot( a, b ) ) * ( 180.0f / PI );
+}
+
+float NormalRoundTripDegrees( float3 n )
+{
+    return AngleDegrees( n, GBufferDecodeNormal( GBufferEncodeNormal( normalize( n ) ) ) );
+}
+
+GBufferCamera MakeCamera()
+{
+    CameraPose pose;
+    pose.position = float3( 1.0f, -2.0f, -5.0f );
+    pose.lookAt   = float3( 0.0f, 0.0f, 0.0f );
+
+    GBufferCamera camera;
+    camera.pixelToWorld = GetCameraPixelToWorld( pose );
+    return camera;
+}
+
+// Hits on the centre rays, at depths from a tenth to the whole of T_HIT_MAX.
+RayBuffer MakeFrame( const GBufferCamera& camera, uint32_t width, uint32_t height )
+{
+    RayBuffer frame;
+    frame.Resize( width, height );
+
+    const float3 origin = GetCameraOrigin( camera );
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        for ( uint32_t x = 0; x < width; ++x )
+        {
+            const float  depth = 0.1f + 0.8999f * ( y * width + x ) / ( width * height );
+            const float3 p     = origin + GetCameraRay( camera, x, y, width, height ) * ( depth * camera.tHitMax );
+
+            const float  a = 0.37f * x + 0.11f * y;
+            const float3 n = normalize( float3( std::cos( a ), std::sin( a ), ( x % 3 ) - 1.0f ) );
+
+            // Four objects in blocks of 4 x 4 pixels, the first one without the mask.
+            const uint32_t object = ( x / 4 + y / 4 ) % 4;
+
+            frame.Colour()( x, y )     = float4( 0.25f * x, 0.5f * y, 1.0f, static_cast<float>( AS_CASTED ) );
+            frame.Normals()( x, y )    = float4( n.x * 0.5f + 0.5f, n.y * 0.5f + 0.5f, n.z * 0.5f + 0.5f, 1 );
+            frame.PosDepth()( x, y )   = float4( p.x, p.y, p.z, depth );
+            frame.ObjectMask()( x, y ) = float4( 0.1f * object, 0.7f, 0.3f * object, object != 0 ? 1.0f : 0.0f );
+        }
+    }
+    return frame;
+}
+
+}  // namespace
+
+TEST( GBufferCodec, Snorm16 )
+{
+    CHECK( GBufferDecodeSnorm16( GBufferEncodeSnorm16( -1.0f ) ) == -1.0f );
+    CHECK( GBufferDecodeSnorm16( GBufferEncodeSnorm16( 0.0f ) ) == 0.0f );
+    CHECK( GBufferDecodeSnorm16( GBufferEncodeSnorm16( 1.0f ) ) == 1.0f );
+
+    // Out of range clamps.
+    CHECK( GBufferDecodeSnorm16( GBufferEncodeSnorm16( -3.0f ) ) == -1.0f );
+    CHECK( GBufferDecodeSnorm16( GBufferEncodeSnorm16( 2.0f ) ) == 1.0f );
+
+    // Rounded to nearest: half a step at most.
+    for ( int i = -10000; i <= 10000; ++i )
+    {
+        const float v = i / 10000.0f;
+        CHECK_NEAR( GBufferDecodeSnorm16( GBufferEncodeSnorm16( v ) ), v, 0.5f / 32767.0f + 1e-7f );
+    }
+}
+
+TEST( GBufferCodec, NormalsOverTheSphere )
+{
+    const GBufferError error = MeasureNormalEncoding( 100000 );
+    CHECK( error.samples == 100000 );
+    CHECK( error.maxNormalDegrees < MAX_NORMAL_DEGREES );
+    CHECK( error.meanNormalDegrees <= error.maxNormalDegrees );
+}
+
+TEST( GBufferCodec, NormalsAtThePoles )
+{
+    // The poles and the axes sit on grid points of the octahedron, they come back exactly.
+    const float3 axes[] = { float3( 0, 0, 1 ),  float3( 0, 0, -1 ), float3( 1, 0, 0 ),
+                            float3( -1, 0, 0 ), float3( 0, 1, 0 ),  float3( 0, -1, 0 ) };
+    for ( const float3& axis: axes )
+    {
+        const float3 n = GBufferDecodeNormal( GBufferEncodeNormal( axis ) );
+        CHECK( n.x == axis.x && n.y == axis.y && n.z == axis.z );
+    }
+
+    // Around the south pole the four corners of the square meet.
+    for ( float angle = 0; angle < 2 * PI; angle += PI / 16 )
+    {
+        for ( float tilt: { 1e-6f, 1e-4f, 1e-2f } )
+        {
+            CHECK( NormalRoundTripDegrees( float3( tilt * std::cos( angle ), tilt * std::sin( angle ), -1 ) ) <
+                   MAX_NORMAL_DEGREES );
+            CHECK( NormalRoundTripDegrees( float3( tilt * std::cos( angle ), tilt * std::sin( angle ), 1 ) ) <
+                   MAX_NORMAL_DEGREES );
+        }
+    }
+}
+
+TEST( GBufferCodec, NormalsOnTheSeams )
+{
+    // The equator is the fold, the lower hemisphere is cut along x = 0 and y = 0.
+    for ( float angle = 0; angle < 2 * PI; angle += PI / 64 )
+    {
+        const float3 equator( std::cos( angle ), std::sin( angle ), 0 );
+        CHECK( NormalRoundTripDegrees( equator ) < MAX_NORMAL_DEGREES );
+        CHECK( NormalRoundTripDegrees( equator + float3( 0, 0, 1e-5f ) ) < MAX_NORMAL_DEGREES );
+        CHECK( NormalRoundTripDegrees( equator - float3( 0, 0, 1e-5f ) ) < MAX_NORMAL_DEGREES );
+    }
+
+    for ( float z = -0.99f; z < 0; z += 0.01f )
+    {
+        for ( float side: { -1e-6f, 0.0f, 1e-6f } )
+        {
+            CHECK( NormalRoundTripDegrees( float3( side, 1, z ) ) < MAX_NORMAL_DEGREES );
+            CHECK( NormalRoundTripDegrees( float3( side, -1, z ) ) < MAX_NORMAL_DEGREES );
+            CHECK( NormalRoundTripDegrees( float3( 1, side, z ) ) < MAX_NORMAL_DEGREES );
+            CHECK( NormalRoundTripDegrees( float3( -1, side, z ) ) < MAX_NORMAL_DEGREES );
+        }
+    }
+
+    // Both sides of a cut decode to neighbours.
+    const float3 left  = GBufferDecodeNormal( GBufferEncodeNormal( normalize( float3( -1e-6f, 1, -0.5f ) ) ) );
+    const float3 right = GBufferDecodeNormal( GBufferEncodeNormal( normalize( float3( 1e-6f, 1, -0.5f ) ) ) );
+    CHECK( AngleDegrees( left, right ) < 2 * MAX_NORMAL_DEGREES );
+}
+
+TEST( GBufferCodec, DepthAndPositions )
+{
+    const GBufferCamera camera = MakeCamera();
+    const RayBuffer     frame  = MakeFrame( camera, 64, 48 );
+
+    CompactRayBuffer compact;
+    EncodeRayBuffer( frame, compact );
+    REQUIRE( compact.depth.GetWidth() == 64 && compact.depth.GetHeight() == 48 );
+
+    // Depth is kept as the float it is.
+    for ( uint32_t y = 0; y < 48; ++y )
+    {
+        for ( uint32_t x = 0; x < 64; ++x )
+            CHECK( compact.depth( x, y ) == frame.PosDepth()( x, y ).w );
+    }
+
+    // The rebuilt positions are off by the float rounding of the hit, relative to its distance.
+    const GBufferError error = MeasureRoundTrip( frame, camera );
+    CHECK( error.maxPositionError < 1e-5f );
+    CHECK( error.meanPositionError <= error.maxPositionError );
+}
+
+TEST( GBufferCodec, ObjectIds )
+{
+    CHECK( GBufferDecodeObjectId( GBufferEncodeObject( 12345, true ) ) == 12345 );
+    CHECK( GBufferDecodeObjectMask( GBufferEncodeObject( 12345, true ) ) );
+    CHECK( !GBufferDecodeObjectMask( GBufferEncodeObject( 12345, false ) ) );
+
+    // The top bit is the mask's.
+    CHECK( GBufferDecodeObjectId( GBufferEncodeObject( 0xFFFFFFFFu, false ) ) == GBUFFER_OBJECT_ID_MASK );
+    CHECK( !GBufferDecodeObjectMask( GBufferEncodeObject( 0xFFFFFFFFu, false ) ) );
+
+    // Numbered in the order they show up.
+    const GBufferCamera camera = MakeCamera();
+    const RayBuffer     frame  = MakeFrame( camera, 16, 16 );
+
+    CompactRayBuffer compact;
+    EncodeRayBuffer( frame, compact );
+    CHECK( GBufferDecodeObjectId( compact.objectMask( 0, 0 ) ) == 0 );
+    CHECK( GBufferDecodeObjectId( compact.objectMask( 4, 0 ) ) == 1 );
+    CHECK( GBufferDecodeObjectId( compact.objectMask( 8, 0 ) ) == 2 );
+    CHECK( GBufferDecodeObjectId( compact.objectMask( 12, 0 ) ) == 3 );
+    CHECK( GBufferDecodeObjectId( compact.objectMask( 0, 4 ) ) == 1 );
+}
+
+TEST( GBufferCodec, FrameRoundTrip )
+{
+    const GBufferCamera camera = MakeCamera();
+    const RayBuffer     frame  = MakeFrame( camera, 64, 48 );
+
+    CompactRayBuffer compact;
+    RayBuffer        decoded;
+    EncodeRayBuffer( frame, compact );
+    DecodeRayBuffer( compact, camera, decoded );
+    REQUIRE( decoded.GetWidth() == 64 && decoded.GetHeight() == 48 );
+
+    for ( uint32_t y = 0; y < 48; ++y )
+    {
+        for ( uint32_t x = 0; x < 64; ++x )
+        {
+            const float4& colour        = frame.Colour()( x, y );
+            const float4& decodedColour = decoded.Colour()( x, y );
+            CHECK( colour.x == decodedColour.x && colour.y == decodedColour.y && colour.z == decodedColour.z &&
+                   colour.w == decodedColour.w );
+
+            CHECK( decoded.Normals()( x, y ).w == 1 );
+            CHECK( ( decoded.ObjectMask()( x, y ).w != 0 ) == ( frame.ObjectMask()( x, y ).w != 0 ) );
+        }
+    }
+
+    const GBufferError error = MeasureRoundTrip( frame, camera );
+    CHECK( error.samples == 64 * 48 );
+    CHECK( error.maxNormalDegrees < MAX_NORMAL_DEGREES );
+    CHECK( error.objectMismatches == 0 );
+}
@@ -0,0 +1,328 @@
+/*
+ *  PlanMeshInstances on translated copies and near misses, the single BLAS
+ *  the plan falls back to, and AppendMeshInstances as MergeScene uses it.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/MeshDedup.h>
+#include <cpulib/VertexCodec.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+struct TestMesh
+{
+    std::vector<FullVertex> vertices;
+    std::vector<uint32_t>   indices;
+};
+
+// size x size quads of two triangles on a bumpy patch, so no two vertices are alike.
+TestMesh MakeMesh( uint32_t size, float3 offset = float3( 0.0f ) )
+{
+    TestMesh mesh;
+    for ( uint32_t y = 0; y <= size; ++y )
+    {
+        for ( uint32_t x = 0; x <= size; ++x )
+        {
+            FullVertex v;
+            v.position  = float3( 0.5f * x, 0.5f * y, 0.1f * std::sin( 0.7f * x + 1.3f * y ) ) + offset;
+            v.normal    = float3( 0, 0, 1 );
+            v.tangent   = float3( 1, 0, 0 );
+            v.bitangent = float3( 0, 1, 0 );
+            v.texCoord  = float3( float( x ) / size, float( y ) / size, 0 );
+            mesh.vertices.push_back( v );
+        }
+    }
+
+    for ( uint32_t y = 0; y < size; ++y )
+    {
+        for ( uint32_t x = 0; x < size; ++x )
+        {
+            const uint32_t v = y * ( size + 1 ) + x;
+            mesh.indices.insert( mesh.indices.end(), { v, v + 1, v + size + 1 } );
+            mesh.indices.insert( mesh.indices.end(), { v + 1, v + size + 2, v + size + 1 } );
+        }
+    }
+    return mesh;
+}
+
+MeshGeometry GetGeometry( const TestMesh& mesh )
+{
+    MeshGeometry geometry;
+    geometry.vertices    = mesh.vertices.data();
+    geometry.vertexCount = static_cast<uint32_t>( mesh.vertices.size() );
+    geometry.indices     = mesh.indices.data();
+    geometry.indexCount  = static_cast<uint32_t>( mesh.indices.size() );
+    return geometry;
+}
+
+std::vector<MeshGeometry> GetGeometries( const std::vector<TestMesh>& meshes )
+{
+    std::vector<MeshGeometry> geometries;
+    for ( const TestMesh& mesh: meshes )
+        geometries.push_back( GetGeometry( mesh ) );
+    return geometries;
+}
+
+bool Near( float3 a, float3 b, float tolerance )
+{
+    return std::abs( a.x - b.x ) <= tolerance && std::abs( a.y - b.y ) <= tolerance &&
+           std::abs( a.z - b.z ) <= tolerance;
+}
+
+/**
+ * Check what every plan promises: slots and order invert each other, every
+ * slot is the mesh of exactly one instance, the meshes of an instance are
+ * the geometry of its BLAS in order, and a mesh is its source moved by its
+ * offset. meshes may be empty to skip the last.
+ */
+void CheckPlan( const MeshInstancePlan& plan, uint32_t meshCount, const std::vector<TestMesh>& meshes )
+{
+    REQUIRE( plan.order.size() == meshCount );
+    REQUIRE( plan.slots.size() == meshCount );
+    REQUIRE( plan.sources.size() == meshCount );
+    REQUIRE( plan.offsets.size() == meshCount );
+    CHECK( plan.stats.meshes == meshCount );
+
+    for ( uint32_t slot = 0; slot < meshCount; ++slot )
+    {
+        REQUIRE( plan.order[slot] < meshCount );
+        CHECK( plan.slots[plan.order[slot]] == slot );
+
+        // A source keeps its own vertices, and comes before the slots that share them.
+        const uint32_t source = plan.sources[slot];
+        REQUIRE( source <= slot );
+        CHECK( plan.sources[source] == source );
+    }
+
+    std::vector<uint32_t> covered( meshCount, 0 );
+    for ( const MeshInstance& instance: plan.instances )
+    {
+        REQUIRE( instance.blas < plan.blases.size() );
+        const MeshBlas& blas = plan.blases[instance.blas];
+        REQUIRE( instance.firstMesh + blas.meshCount <= meshCount );
+
+        for ( uint32_t k = 0; k < blas.meshCount; ++k )
+        {
+            const uint32_t slot = instance.firstMesh + k;
+            ++covered[slot];
+            CHECK( plan.sources[slot] == plan.sources[blas.firstMesh + k] );
+            CHECK( Near( plan.offsets[slot], instance.offset + plan.offsets[blas.firstMesh + k], 0 ) );
+        }
+    }
+    CHECK( static_cast<uint32_t>( std::count( covered.begin(), covered.end(), 1u ) ) == meshCount );
+
+    uint32_t unique = 0;
+    for ( uint32_t slot = 0; slot < meshCount && !meshes.empty(); ++slot )
+    {
+        const TestMesh& mesh   = meshes[plan.order[slot]];
+        const TestMesh& source = meshes[plan.order[plan.sources[slot]]];
+        unique += plan.sources[slot] == slot ? 1 : 0;
+
+        REQUIRE( mesh.vertices.size() == source.vertices.size() );
+        CHECK( mesh.indices == source.indices );
+        // Far from the origin the coordinates themselves round by more.
+        for ( size_t i = 0; i < mesh.vertices.size(); ++i )
+        {
+            const float3 position  = mesh.vertices[i].position;
+            const float  tolerance = 1e-3f + 1e-6f * length( position );
+            CHECK( Near( source.vertices[i].position + plan.offsets[slot], position, tolerance ) );
+        }
+    }
+    if ( !meshes.empty() )
+        CHECK( plan.stats.uniqueMeshes == unique );
+}
+
+}  // namespace
+
+TEST( MeshDedup, TranslatedCopies )
+{
+    // 0 and 2 are copies of 1 and 4 of 3, 5 has none. 8 x 8 quads is 128 triangles, enough to be instanced.
+    std::vector<TestMesh> meshes;
+    meshes.push_back( MakeMesh( 8, float3( 10, 0, 0 ) ) );
+    meshes.push_back( MakeMesh( 8 ) );
+    meshes.push_back( MakeMesh( 8, float3( -3.25f, 100, 7 ) ) );
+    meshes.push_back( MakeMesh( 10 ) );
+    meshes.push_back( MakeMesh( 10, float3( 0, 0, -50 ) ) );
+    meshes.push_back( MakeMesh( 9 ) );
+
+    const MeshInstancePlan plan = PlanMeshInstances( GetGeometries( meshes ) );
+    CheckPlan( plan, 6, meshes );
+
+    // The mesh without copies in the first BLAS, then one BLAS per set of copies, the first mesh of it as source.
+    REQUIRE( plan.blases.size() == 3 );
+    CHECK( plan.order[0] == 5 );
+    CHECK( plan.blases[0].firstMesh == 0 && plan.blases[0].meshCount == 1 );
+    CHECK( plan.order[plan.blases[1].firstMesh] == 0 );
+    CHECK( plan.order[plan.blases[2].firstMesh] == 3 );
+    CHECK( plan.blases[1].meshCount == 1 && plan.blases[2].meshCount == 1 );
+
+    // One instance for the shared BLAS, one per mesh of the copies.
+    CHECK( plan.instances.size() == 6 );
+    CHECK( Near( plan.offsets[plan.slots[1]], float3( -10, 0, 0 ), 1e-5f ) );
+    CHECK( Near( plan.offsets[plan.slots[2]], float3( -13.25f, 100, 7 ), 1e-5f ) );
+    CHECK( Near( plan.offsets[plan.slots[4]], float3( 0, 0, -50 ), 1e-5f ) );
+
+    const MeshDedupStats& stats = plan.stats;
+    CHECK( stats.uniqueMeshes == 3 );
+    CHECK( stats.instancedMeshes == 5 );
+    CHECK( stats.triangles == 3 * 128 + 2 * 200 + 162 );
+    CHECK( stats.sharedTriangles == 2 * 128 + 200 );
+    CHECK( stats.sharedVertexBytes == ( 2 * 81 + 121 ) * sizeof( FullVertex ) );
+    CHECK( stats.sharedIndexBytes == ( 2 * 128 + 200 ) * 3 * sizeof( uint32_t ) );
+}
+
+TEST( MeshDedup, CopyFarFromTheOrigin )
+{
+    // The rounding of the coordinates out there is larger than the tolerance of the mesh itself.
+    std::vector<TestMesh> meshes;
+    meshes.push_back( MakeMesh( 8 ) );
+    meshes.push_back( MakeMesh( 8, float3( 12345.678f, -5000, 20000 ) ) );
+
+    const MeshInstancePlan plan = PlanMeshInstances( GetGeometries( meshes ) );
+    CheckPlan( plan, 2, meshes );
+    CHECK( plan.stats.uniqueMeshes == 1 );
+    CHECK( plan.instances.size() == 2 );
+}
+
+TEST( MeshDedup, NearMissesAreRejected )
+{
+    const TestMesh original = MakeMesh( 8 );
+
+    // A vertex moved by a thousandth of the extent, a hundred times the tolerance.
+    TestMesh moved = MakeMesh( 8, float3( 5, 0, 0 ) );
+    moved.vertices[40].position.z += 0.004f;
+
+    // A normal turned, a texture coordinate shifted, a triangle wound the other way.
+    TestMesh turned = MakeMesh( 8, float3( 10, 0, 0 ) );
+    turned.vertices[3].normal = normalize( float3( 0.01f, 0, 1 ) );
+
+    TestMesh shifted = MakeMesh( 8, float3( 15, 0, 0 ) );
+    shifted.vertices[7].texCoord.x += 1e-3f;
+
+    TestMesh flipped = MakeMesh( 8, float3( 20, 0, 0 ) );
+    std::swap( flipped.indices[1], flipped.indices[2] );
+
+    for ( const TestMesh* miss: { &moved, &turned, &shifted, &flipped } )
+    {
+        const std::vector<TestMesh> meshes = { original, *miss };
+        const MeshInstancePlan      plan   = PlanMeshInstances( GetGeometries( meshes ) );
+        CheckPlan( plan, 2, {} );
+        CHECK( plan.blases.size() == 1 );
+        CHECK( plan.stats.uniqueMeshes == 2 );
+        CHECK( plan.stats.sharedTriangles == 0 );
+    }
+
+    // Within the tolerances it is still a copy.
+    TestMesh close = MakeMesh( 8, float3( 5, 0, 0 ) );
+    close.vertices[40].position.z += 1e-6f;
+    close.vertices[3].normal = normalize( float3( 1e-4f, 0, 1 ) );
+
+    const std::vector<TestMesh> meshes = { original, close };
+    const MeshInstancePlan      plan   = PlanMeshInstances( GetGeometries( meshes ) );
+    CheckPlan( plan, 2, meshes );
+    CHECK( plan.stats.uniqueMeshes == 1 );
+}
+
+TEST( MeshDedup, PackedVertices )
+{
+    std::vector<TestMesh>                  meshes = { MakeMesh( 8 ), MakeMesh( 8, float3( 0, 4, 0 ) ), MakeMesh( 9 ) };
+    std::vector<std::vector<PackedVertex>> packed( meshes.size() );
+    std::vector<MeshGeometry>              geometries = GetGeometries( meshes );
+    for ( size_t m = 0; m < meshes.size(); ++m )
+    {
+        for ( const FullVertex& v: meshes[m].vertices )
+            packed[m].push_back( PackVertex( v ) );
+        geometries[m].vertices = packed[m].data();
+        geometries[m].packed   = true;
+    }
+
+    const MeshInstancePlan plan = PlanMeshInstances( geometries );
+    CheckPlan( plan, 3, meshes );
+    CHECK( plan.stats.uniqueMeshes == 2 );
+    CHECK( plan.stats.vertexBytes == ( 2 * 81 + 100 ) * sizeof( PackedVertex ) );
+}
+
+TEST( MeshDedup, SingleBlasFallback )
+{
+    // No copies at all, and copies too small to be worth an instance, give the plan without deduplication.
+    std::vector<TestMesh> meshes = { MakeMesh( 8 ), MakeMesh( 9 ), MakeMesh( 4 ), MakeMesh( 4, float3( 3, 0, 0 ) ) };
+
+    const MeshInstancePlan plan = PlanMeshInstances( GetGeometries( meshes ) );
+    CheckPlan( plan, 4, meshes );
+
+    const MeshInstancePlan single = PlanSingleBlas( 4 );
+    CHECK( plan.order == single.order );
+    CHECK( plan.sources == single.sources );
+    REQUIRE( plan.blases.size() == 1 && plan.instances.size() == 1 );
+    CHECK( plan.blases[0].firstMesh == 0 && plan.blases[0].meshCount == 4 );
+    CHECK( plan.instances[0].blas == 0 && plan.instances[0].firstMesh == 0 );
+    CHECK( plan.stats.uniqueMeshes == 4 );
+    CHECK( plan.stats.triangles == 128 + 162 + 2 * 32 );
+    CHECK( plan.stats.sharedTriangles == 0 );
+
+    // The small copies are instanced once the threshold lets them.
+    MeshDedupOptions options;
+    options.minInstanceTriangles = 32;
+    const MeshInstancePlan lowered = PlanMeshInstances( GetGeometries( meshes ), options );
+    CheckPlan( lowered, 4, meshes );
+    CHECK( lowered.blases.size() == 2 );
+    CHECK( lowered.stats.uniqueMeshes == 3 );
+
+    // And no meshes at all: no BLAS to build.
+    const MeshInstancePlan empty = PlanMeshInstances( {} );
+    CHECK( empty.blases.empty() && empty.instances.empty() );
+}
+
+TEST( MeshDedup, AppendSingleBlases )
+{
+    // Two scenes without copies merge into one BLAS.
+    MeshInstancePlan plan = PlanSingleBlas( 3 );
+    AppendMeshInstances( plan, PlanSingleBlas( 2 ) );
+    CheckPlan( plan, 5, {} );
+
+    REQUIRE( plan.blases.size() == 1 && plan.instances.size() == 1 );
+    CHECK( plan.blases[0].meshCount == 5 );
+    CHECK( plan.stats.meshes == 5 && plan.stats.uniqueMeshes == 5 );
+}
+
+TEST( MeshDedup, AppendOffsets )
+{
+    std::vector<TestMesh> first = { MakeMesh( 9 ), MakeMesh( 8 ), MakeMesh( 8, float3( 1, 2, 3 ) ) };
+    std::vector<TestMesh> other = { MakeMesh( 10, float3( 0, 0, 5 ) ), MakeMesh( 9 ), MakeMesh( 10 ) };
+
+    MeshInstancePlan       plan      = PlanMeshInstances( GetGeometries( first ) );
+    const MeshInstancePlan otherPlan = PlanMeshInstances( GetGeometries( other ) );
+    AppendMeshInstances( plan, otherPlan );
+
+    // The meshes of other are numbered after those of the first scene, as MergeScene appends them.
+    std::vector<TestMesh> merged( first );
+    merged.insert( merged.end(), other.begin(), other.end() );
+    CheckPlan( plan, 6, merged );
+
+    REQUIRE( plan.blases.size() == 4 );
+    REQUIRE( plan.instances.size() == 6 );
+    for ( size_t b = 0; b < otherPlan.blases.size(); ++b )
+    {
+        CHECK( plan.blases[2 + b].firstMesh == 3 + otherPlan.blases[b].firstMesh );
+        CHECK( plan.blases[2 + b].meshCount == otherPlan.blases[b].meshCount );
+    }
+    for ( size_t i = 0; i < otherPlan.instances.size(); ++i )
+    {
+        const MeshInstance& instance = plan.instances[3 + i];
+        CHECK( instance.blas == 2 + otherPlan.instances[i].blas );
+        CHECK( instance.firstMesh == 3 + otherPlan.instances[i].firstMesh );
+        CHECK( Near( instance.offset, otherPlan.instances[i].offset, 0 ) );
+    }
+    CHECK( Near( plan.offsets[plan.slots[5]], float3( 0, 0, -5 ), 1e-5f ) );
+
+    CHECK( plan.stats.uniqueMeshes == 4 );
+    CHECK( plan.stats.sharedTriangles == 128 + 200 );
+}
@@ -0,0 +1,197 @@
+/*
+ *  The vertex cache and fetch optimisation on regular grids: the cache
+ *  misses go down, and the mesh is the same set of triangles afterwards.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/MeshOptimizer.h>
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <random>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+struct GridVertex
+{
+    uint32_t x;
+    uint32_t y;
+};
+
+using Triangle = std::array<uint32_t, 6>;
+
+struct Grid
+{
+    std::vector<GridVertex> vertices;
+    std::vector<uint32_t>   indices;
+};
+
+// size x size quads of two triangles, row by row.
+Grid MakeGrid( uint32_t size )
+{
+    Grid grid;
+    for ( uint32_t y = 0; y <= size; ++y )
+    {
+        for ( uint32_t x = 0; x <= size; ++x )
+            grid.vertices.push_back( { x, y } );
+    }
+
+    for ( uint32_t y = 0; y < size; ++y )
+    {
+        for ( uint32_t x = 0; x < size; ++x )
+        {
+            const uint32_t v = y * ( size + 1 ) + x;
+            grid.indices.insert( grid.indices.end(), { v, v + 1, v + size + 1 } );
+            grid.indices.insert( grid.indices.end(), { v + 1, v + size + 2, v + size + 1 } );
+        }
+    }
+    return grid;
+}
+
+void ShuffleTriangles( std::vector<uint32_t>& indices, uint32_t seed )
+{
+    std::vector<uint32_t> order( indices.size() / 3 );
+    std::iota( order.begin(), order.end(), 0 );
+    std::shuffle( order.begin(), order.end(), std::mt19937( seed ) );
+
+    std::vector<uint32_t> shuffled;
+    for ( uint32_t t: order )
+        shuffled.insert( shuffled.end(), indices.begin() + t * 3, indices.begin() + t * 3 + 3 );
+    indices.swap( shuffled );
+}
+
+/**
+ * The triangles by the positions of their corners, each started at its
+ * smallest corner so that only the winding matters, in sorted order.
+ */
+std::vector<Triangle> GetTriangles( const Grid& grid )
+{
+    std::vector<Triangle> triangles;
+    for ( size_t i = 0; i < grid.indices.size(); i += 3 )
+    {
+        std::array<uint64_t, 3> corners;
+        for ( int k = 0; k < 3; ++k )
+        {
+            const GridVertex& v = grid.vertices[grid.indices[i + k]];
+            corners[k]          = ( uint64_t( v.y ) << 32 ) | v.x;
+        }
+
+        const int first = static_cast<int>( std::min_element( corners.begin(), corners.end() ) - corners.begin() );
+
+        Triangle triangle;
+        for ( int k = 0; k < 3; ++k )
+        {
+            const uint64_t corner = corners[( first + k ) % 3];
+            triangle[k * 2]       = static_cast<uint32_t>( corner >> 32 );
+            triangle[k * 2 + 1]   = static_cast<uint32_t>( corner );
+        }
+        triangles.push_back( triangle );
+    }
+
+    std::sort( triangles.begin(), triangles.end() );
+    return triangles;
+}
+
+}  // namespace
+
+TEST( MeshOptimizer, MeasureVertexCache )
+{
+    // No vertex shared: three per triangle.
+    std::vector<uint32_t> soup( 30 );
+    std::iota( soup.begin(), soup.end(), 0 );
+    CHECK_NEAR( MeasureVertexCache( soup.data(), soup.size(), 30 ).acmr, 3.0, 1e-6 );
+    CHECK_NEAR( MeasureVertexCache( soup.data(), soup.size(), 30 ).atvr, 1.0, 1e-6 );
+
+    // The two triangles of a quad share two vertices.
+    const Grid quad = MakeGrid( 1 );
+    CHECK_NEAR( MeasureVertexCache( quad.indices.data(), quad.indices.size(), 4 ).acmr, 2.0, 1e-6 );
+
+    // The same triangle over and over.
+    const uint32_t same[] = { 0, 1, 2, 0, 1, 2, 0, 1, 2 };
+    CHECK_NEAR( MeasureVertexCache( same, 9, 3 ).acmr, 1.0, 1e-6 );
+
+    // Past the cache size, a vertex comes back as a miss.
+    std::vector<uint32_t> wide( soup );
+    wide.insert( wide.end(), soup.begin(), soup.end() );
+    CHECK_NEAR( MeasureVertexCache( wide.data(), wide.size(), 30 ).acmr, 3.0, 1e-6 );
+    CHECK_NEAR( MeasureVertexCache( wide.data(), wide.size(), 30, 30 ).acmr, 1.5, 1e-6 );
+}
+
+TEST( MeshOptimizer, GridAcmrGoesDown )
+{
+    for ( uint32_t size: { 8u, 32u, 100u } )
+    {
+        for ( bool shuffled: { false, true } )
+        {
+            Grid grid = MakeGrid( size );
+            if ( shuffled )
+                ShuffleTriangles( grid.indices, size );
+
+            const std::vector<Triangle> before = GetTriangles( grid );
+            const MeshOptimizeStats     stats  = OptimizeMesh( grid.vertices, grid.indices );
+
+            CHECK( stats.vertices == ( size + 1 ) * ( size + 1 ) );
+            CHECK( stats.triangles == 2 * size * size );
+            CHECK( stats.after.acmr < stats.before.acmr );
+            // A grid can get to 0.5 with an infinite cache, a FIFO of 16 stays well under 1.
+            CHECK( stats.after.acmr < 0.9f );
+
+            const VertexCacheStats measured =
+                MeasureVertexCache( grid.indices.data(), grid.indices.size(), stats.vertices );
+            CHECK_NEAR( measured.acmr, stats.after.acmr, 1e-6 );
+
+            // The same triangles with the same winding, just in another order.
+            CHECK( GetTriangles( grid ) == before );
+        }
+    }
+}
+
+TEST( MeshOptimizer, OptimizeInPlace )
+{
+    Grid grid = MakeGrid( 20 );
+    ShuffleTriangles( grid.indices, 1 );
+
+    std::vector<uint32_t> copied( grid.indices.size() );
+    OptimizeVertexCache( copied.data(), grid.indices.data(), grid.indices.size(), 21 * 21 );
+    OptimizeVertexCache( grid.indices.data(), grid.indices.data(), grid.indices.size(), 21 * 21 );
+    CHECK( copied == grid.indices );
+}
+
+TEST( MeshOptimizer, VertexFetchOrder )
+{
+    // The last vertex is not used by any triangle.
+    Grid grid = MakeGrid( 10 );
+    ShuffleTriangles( grid.indices, 2 );
+    grid.vertices.push_back( { 99, 99 } );
+
+    const uint32_t              vertexCount = static_cast<uint32_t>( grid.vertices.size() );
+    const std::vector<uint32_t> original    = grid.indices;
+
+    std::vector<uint32_t> remap( vertexCount );
+    const uint32_t used = OptimizeVertexFetch( remap.data(), grid.indices.data(), grid.indices.size(), vertexCount );
+    CHECK( used == vertexCount - 1 );
+
+    // remap is a permutation, the unused vertex last.
+    std::vector<uint32_t> sorted( remap );
+    std::sort( sorted.begin(), sorted.end() );
+    for ( uint32_t i = 0; i < vertexCount; ++i )
+        CHECK( sorted[i] == i );
+    CHECK( remap[vertexCount - 1] == vertexCount - 1 );
+
+    // The indices are rewritten through it, and every new vertex is the next one.
+    uint32_t next = 0;
+    for ( size_t i = 0; i < grid.indices.size(); ++i )
+    {
+        CHECK( grid.indices[i] == remap[original[i]] );
+        CHECK( grid.indices[i] <= next );
+        if ( grid.indices[i] == next )
+            ++next;
+    }
+    CHECK( next == used );
+}
@@ -0,0 +1,180 @@
+/*
+ *  SplitMesh on meshes past the 16 bit index range: every cluster fits, and
+ *  the clusters put back together are the original triangles in order.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/MeshOptimizer.h>
+#include <cpulib/MeshSplit.h>
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+struct GridVertex
+{
+    uint32_t x;
+    uint32_t y;
+};
+
+struct Grid
+{
+    std::vector<GridVertex> vertices;
+    std::vector<uint32_t>   indices;
+};
+
+// width x height quads of two triangles, row by row.
+Grid MakeGrid( uint32_t width, uint32_t height )
+{
+    Grid grid;
+    for ( uint32_t y = 0; y <= height; ++y )
+    {
+        for ( uint32_t x = 0; x <= width; ++x )
+            grid.vertices.push_back( { x, y } );
+    }
+
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        for ( uint32_t x = 0; x < width; ++x )
+        {
+            const uint32_t v = y * ( width + 1 ) + x;
+            grid.indices.insert( grid.indices.end(), { v, v + 1, v + width + 1 } );
+            grid.indices.insert( grid.indices.end(), { v + 1, v + width + 2, v + width + 1 } );
+        }
+    }
+    return grid;
+}
+
+/**
+ * Check the clusters against the mesh: contiguous, within maxVertices, no
+ * vertex twice in a cluster, and every local index naming the vertex the
+ * original index does.
+ */
+void CheckClusters( const Grid& grid, const std::vector<MeshCluster>& clusters,
+                    const std::vector<uint16_t>& localIndices, uint32_t maxVertices )
+{
+    REQUIRE( !clusters.empty() );
+    REQUIRE( localIndices.size() == grid.indices.size() );
+
+    uint32_t nextIndex = 0;
+    for ( const MeshCluster& cluster: clusters )
+    {
+        CHECK( cluster.firstIndex == nextIndex );
+        CHECK( cluster.indexCount > 0 && cluster.indexCount % 3 == 0 );
+        CHECK( cluster.vertices.size() <= maxVertices );
+        nextIndex += cluster.indexCount;
+
+        std::vector<uint32_t> sorted( cluster.vertices );
+        std::sort( sorted.begin(), sorted.end() );
+        CHECK( std::adjacent_find( sorted.begin(), sorted.end() ) == sorted.end() );
+
+        // The cluster's own vertex buffer, as the importer builds it.
+        std::vector<GridVertex> vertices( cluster.vertices.size() );
+        GatherVertices( vertices.data(), grid.vertices.data(), cluster );
+
+        std::vector<bool> used( cluster.vertices.size(), false );
+        for ( uint32_t i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; ++i )
+        {
+            const uint16_t local = localIndices[i];
+            REQUIRE( local < cluster.vertices.size() );
+            CHECK( cluster.vertices[local] == grid.indices[i] );
+
+            const GridVertex& original = grid.vertices[grid.indices[i]];
+            CHECK( vertices[local].x == original.x && vertices[local].y == original.y );
+            used[local] = true;
+        }
+
+        // No vertex the cluster does not use.
+        CHECK( std::count( used.begin(), used.end(), false ) == 0 );
+    }
+    CHECK( nextIndex == grid.indices.size() );
+}
+
+}  // namespace
+
+TEST( MeshSplit, FitsIndex16 )
+{
+    CHECK( FitsIndex16( 3 ) );
+    CHECK( FitsIndex16( 65535 ) );
+    CHECK( FitsIndex16( INDEX16_MAX_VERTICES ) );
+    CHECK( !FitsIndex16( INDEX16_MAX_VERTICES + 1 ) );
+
+    const uint32_t indices[] = { 0, 1, 65535, 65535, 1234, 0 };
+    uint16_t       narrowed[6];
+    NarrowIndices( narrowed, indices, 6 );
+    for ( int i = 0; i < 6; ++i )
+        CHECK( narrowed[i] == indices[i] );
+}
+
+TEST( MeshSplit, LargeMesh )
+{
+    // 301 x 301 = 90601 vertices, past what 16 bit indices address.
+    Grid grid = MakeGrid( 300, 300 );
+    REQUIRE( !FitsIndex16( static_cast<uint32_t>( grid.vertices.size() ) ) );
+
+    // As the importer does, the split follows the vertex cache order.
+    OptimizeMesh( grid.vertices, grid.indices );
+
+    std::vector<uint16_t>          localIndices;
+    const std::vector<MeshCluster> clusters = SplitMesh( grid.indices.data(), grid.indices.size(),
+                                                         static_cast<uint32_t>( grid.vertices.size() ), localIndices );
+    CHECK( clusters.size() >= 2 );
+    for ( const MeshCluster& cluster: clusters )
+        CHECK( FitsIndex16( static_cast<uint32_t>( cluster.vertices.size() ) ) );
+    CheckClusters( grid, clusters, localIndices, INDEX16_MAX_VERTICES );
+
+    // A cluster only ends when the next triangle does not fit, the seams copy a few vertices at most.
+    for ( size_t c = 0; c + 1 < clusters.size(); ++c )
+        CHECK( clusters[c].vertices.size() + 3 > INDEX16_MAX_VERTICES );
+
+    size_t clusterVertices = 0;
+    for ( const MeshCluster& cluster: clusters )
+        clusterVertices += cluster.vertices.size();
+    CHECK( clusterVertices < grid.vertices.size() * 11 / 10 );
+}
+
+TEST( MeshSplit, SmallClusters )
+{
+    // Triangles in no particular order, with degenerate ones, split into clusters of a few vertices.
+    Grid grid = MakeGrid( 40, 30 );
+    grid.indices.insert( grid.indices.end(), { 5, 5, 6, 7, 7, 7, 8, 9, 8 } );
+
+    std::vector<uint32_t> order( grid.indices.size() / 3 );
+    std::iota( order.begin(), order.end(), 0 );
+    std::shuffle( order.begin(), order.end(), std::mt19937( 3 ) );
+
+    std::vector<uint32_t> shuffled;
+    for ( uint32_t t: order )
+        shuffled.insert( shuffled.end(), grid.indices.begin() + t * 3, grid.indices.begin() + t * 3 + 3 );
+    grid.indices.swap( shuffled );
+
+    for ( uint32_t maxVertices: { 3u, 4u, 100u, 1000u } )
+    {
+        std::vector<uint16_t>          localIndices;
+        const std::vector<MeshCluster> clusters =
+            SplitMesh( grid.indices.data(), grid.indices.size(), static_cast<uint32_t>( grid.vertices.size() ),
+                       localIndices, maxVertices );
+        CheckClusters( grid, clusters, localIndices, maxVertices );
+    }
+}
+
+TEST( MeshSplit, MeshThatFits )
+{
+    // Exactly INDEX16_MAX_VERTICES vertices stay one cluster.
+    Grid grid = MakeGrid( 255, 255 );
+    REQUIRE( grid.vertices.size() == INDEX16_MAX_VERTICES );
+
+    std::vector<uint16_t>          localIndices;
+    const std::vector<MeshCluster> clusters = SplitMesh( grid.indices.data(), grid.indices.size(),
+                                                         static_cast<uint32_t>( grid.vertices.size() ), localIndices );
+    REQUIRE( clusters.size() == 1 );
+    CHECK( clusters[0].vertices.size() == INDEX16_MAX_VERTICES );
+    CheckClusters( grid, clusters, localIndices, INDEX16_MAX_VERTICES );
+}
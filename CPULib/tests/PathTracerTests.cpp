@@ -0,0 +1,377 @@
+/*
+ *  The CPU path tracer: WideBvh against a brute force closest hit, Render
+ *  giving the same image on every run and any number of threads, a single
+ *  light reaching the image, and LoadPathTracerScene placing the scene by
+ *  the scene transform.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/CameraPath.h>
+#include <cpulib/CookedScene.h>
+#include <cpulib/PathTracer.h>
+#include <cpulib/ThreadPool.h>
+#include <cpulib/VertexCodec.h>
+#include <cpulib/WideBvh.h>
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+// Möller-Trumbore, the t of a hit in [ray.tMin, ray.tMax] or a negative number.
+float IntersectTriangle( const RayDesc& ray, const BvhTriangle& triangle )
+{
+    const float3 e1 = triangle.v1 - triangle.v0;
+    const float3 e2 = triangle.v2 - triangle.v0;
+    const float3 p  = cross( ray.direction, e2 );
+    const float  det = dot( e1, p );
+    if ( std::fabs( det ) < 1e-12f )
+        return -1.0f;
+
+    const float  invDet = 1.0f / det;
+    const float3 s      = ray.origin - triangle.v0;
+    const float  u      = dot( s, p ) * invDet;
+    const float3 q      = cross( s, e1 );
+    const float  v      = dot( ray.direction, q ) * invDet;
+    const float  t      = dot( e2, q ) * invDet;
+    if ( u < 0 || v < 0 || u + v > 1 || t < ray.tMin || t > ray.tMax )
+        return -1.0f;
+    return t;
+}
+
+std::vector<BvhTriangle> MakeTriangles( uint32_t count, uint32_t seed )
+{
+    std::mt19937                          random( seed );
+    std::uniform_real_distribution<float> unit( -1.0f, 1.0f );
+
+    std::vector<BvhTriangle> triangles;
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        const float3 p = float3( unit( random ), unit( random ), unit( random ) ) * 10.0f;
+
+        BvhTriangle triangle;
+        triangle.v0 = p;
+        triangle.v1 = p + float3( unit( random ), unit( random ), unit( random ) );
+        triangle.v2 = p + float3( unit( random ), unit( random ), unit( random ) );
+        triangles.push_back( triangle );
+    }
+    return triangles;
+}
+
+FullVertex MakeVertex( float3 position, float3 normal )
+{
+    FullVertex vertex;
+    vertex.position  = position;
+    vertex.normal    = normal;
+    vertex.tangent   = float3( 1, 0, 0 );
+    vertex.bitangent = cross( normal, vertex.tangent );
+    vertex.texCoord  = float3( 0.0f );
+    if ( dot( vertex.bitangent, vertex.bitangent ) == 0 )
+    {
+        vertex.tangent   = float3( 0, 0, 1 );
+        vertex.bitangent = cross( normal, vertex.tangent );
+    }
+    return vertex;
+}
+
+// A floor of 10 x 10 at y = 0 and a unit cube standing on it in the middle, one mesh each.
+struct TestScene
+{
+    std::vector<FullVertex> floorVertices;
+    std::vector<uint32_t>   floorIndices;
+    std::vector<FullVertex> cubeVertices;
+    std::vector<uint32_t>   cubeIndices;
+
+    TestScene()
+    {
+        const float3 up( 0, 1, 0 );
+        for ( float3 p: { float3( -5, 0, -5 ), float3( 5, 0, -5 ), float3( 5, 0, 5 ), float3( -5, 0, 5 ) } )
+            floorVertices.push_back( MakeVertex( p, up ) );
+        floorIndices = { 0, 2, 1, 0, 3, 2 };
+
+        // Four vertices per face, so every face has its own normal.
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            for ( float side: { -1.0f, 1.0f } )
+            {
+                float3 normal( 0.0f );
+                normal[axis] = side;
+
+                float3 u( 0.0f ), v( 0.0f );
+                u[( axis + 1 ) % 3] = 0.5f;
+                v[( axis + 2 ) % 3] = 0.5f;
+
+                const float3   centre = float3( 0, 0.5f, 0 ) + normal * 0.5f;
+                const uint32_t first  = static_cast<uint32_t>( cubeVertices.size() );
+                cubeVertices.push_back( MakeVertex( centre - u - v, normal ) );
+                cubeVertices.push_back( MakeVertex( centre + u - v, normal ) );
+                cubeVertices.push_back( MakeVertex( centre + u + v, normal ) );
+                cubeVertices.push_back( MakeVertex( centre - u + v, normal ) );
+                for ( uint32_t index: { 0u, 1u, 2u, 0u, 2u, 3u } )
+                    cubeIndices.push_back( first + index );
+            }
+        }
+    }
+
+    void Fill( PathTracerScene& scene ) const
+    {
+        scene = PathTracerScene();
+        scene.meshes.resize( 2 );
+        scene.meshes[0].vertices    = floorVertices.data();
+        scene.meshes[0].vertexCount = static_cast<uint32_t>( floorVertices.size() );
+        scene.meshes[0].indices     = floorIndices.data();
+        scene.meshes[0].indexCount  = static_cast<uint32_t>( floorIndices.size() );
+        scene.meshes[1].vertices    = cubeVertices.data();
+        scene.meshes[1].vertexCount = static_cast<uint32_t>( cubeVertices.size() );
+        scene.meshes[1].indices     = cubeIndices.data();
+        scene.meshes[1].indexCount  = static_cast<uint32_t>( cubeIndices.size() );
+
+        scene.materials.resize( 2 );
+        scene.materials[1].diffuse = float3( 0.8f, 0.2f, 0.2f );
+
+        PathTracerInstance instance;
+        instance.meshCount = 2;
+        scene.instances.push_back( instance );
+    }
+};
+
+PathTracerFrame MakeFrame()
+{
+    CameraPose pose;
+    pose.position = float3( 0, 2, -2.5f );
+    pose.lookAt   = float3( 0, 0.5f, 0 );
+
+    PathTracerFrame frame;
+    frame.atmosphere         = float4( 0.5f, 0.6f, 0.8f, 1.0f );
+    frame.cameraPixelToWorld = GetCameraPixelToWorld( pose );
+    frame.nbrBouncesPerPath  = 2;
+    frame.cpuGeneratedSeed   = 7;
+    return frame;
+}
+
+// Every pixel AS_CAST, then rendered.
+RayBuffer RenderImage( ThreadPool& pool, const PathTracerScene& scene, const PathTracerFrame& frame,
+                       const PathTracerConstants& constants )
+{
+    RayBuffer buffer;
+    buffer.Resize( 48, 32 );
+    buffer.Colour().Fill( float4( 0, 0, 0, static_cast<float>( AS_CAST ) ) );
+
+    PathTracer tracer( pool );
+    tracer.SetScene( scene );
+    tracer.Render( buffer, frame, constants );
+    return buffer;
+}
+
+bool SameImage( const RayBuffer& a, const RayBuffer& b )
+{
+    for ( uint32_t slot = 0; slot < SLOT_COUNT; ++slot )
+    {
+        const ImageF4& imageA = a.slots[slot];
+        const ImageF4& imageB = b.slots[slot];
+        if ( imageA.GetWidth() != imageB.GetWidth() || imageA.GetHeight() != imageB.GetHeight() ||
+             std::memcmp( imageA.GetData(), imageB.GetData(),
+                          imageA.GetWidth() * imageA.GetHeight() * sizeof( float4 ) ) != 0 )
+            return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+TEST( PathTracer, WideBvhClosestHit )
+{
+    const std::vector<BvhTriangle> triangles = MakeTriangles( 2000, 1 );
+    std::vector<BvhPrimitive>      primitives;
+    for ( uint32_t i = 0; i < triangles.size(); ++i )
+        primitives.push_back( { 0, i } );
+
+    ThreadPool pool( 4 );
+    Bvh        bvh;
+    bvh.Build( pool, triangles, primitives );
+
+    WideBvh wide;
+    wide.Build( bvh );
+
+    std::mt19937                          random( 2 );
+    std::uniform_real_distribution<float> unit( -1.0f, 1.0f );
+
+    uint32_t hits = 0;
+    for ( uint32_t r = 0; r < 2000; ++r )
+    {
+        // From around the soup towards its inside, some with a shorter tMax.
+        RayDesc ray;
+        ray.origin    = float3( unit( random ), unit( random ), unit( random ) ) * 15.0f;
+        ray.direction = normalize( float3( unit( random ), unit( random ), unit( random ) ) * 5.0f - ray.origin );
+        ray.tMin      = 0.001f;
+        ray.tMax      = r % 4 == 0 ? 10.0f : 1000.0f;
+
+        float    closest  = -1.0f;
+        uint32_t triangle = BVH_NO_HIT;
+        for ( uint32_t i = 0; i < triangles.size(); ++i )
+        {
+            const float t = IntersectTriangle( ray, triangles[i] );
+            if ( t >= 0 && ( closest < 0 || t < closest ) )
+            {
+                closest  = t;
+                triangle = i;
+            }
+        }
+
+        RayHit     hit;
+        const bool isHit = wide.Intersect( ray, hit );
+        CHECK( isHit == ( triangle != BVH_NO_HIT ) );
+        CHECK( wide.Occluded( ray ) == isHit );
+        if ( !isHit || triangle == BVH_NO_HIT )
+            continue;
+
+        ++hits;
+        CHECK_NEAR( hit.t, closest, 1e-3f * closest );
+        CHECK( wide.GetPrimitive( hit.triangle ).triangle == triangle );
+    }
+
+    // Enough of both to mean something.
+    CHECK( hits > 200 && hits < 1800 );
+}
+
+TEST( PathTracer, RenderIsDeterministic )
+{
+    TestScene       testScene;
+    PathTracerScene scene;
+    testScene.Fill( scene );
+
+    const PathTracerFrame frame = MakeFrame();
+    PathTracerConstants   constants;
+    constants.AddLight( float4( 3, 6, -3, 1 ) );
+
+    ThreadPool      single( 1 );
+    const RayBuffer reference = RenderImage( single, scene, frame, constants );
+
+    // Something was rendered: every pixel traced, the cube and the floor in view.
+    uint32_t cube = 0, floor = 0;
+    for ( uint32_t y = 0; y < reference.GetHeight(); ++y )
+    {
+        for ( uint32_t x = 0; x < reference.GetWidth(); ++x )
+        {
+            CHECK( reference.Colour()( x, y ).w == static_cast<float>( AS_CASTED ) );
+            const float height = reference.PosDepth()( x, y ).y;
+            cube += height > 0.01f && height < 1.01f;
+            floor += std::fabs( height ) < 0.001f;
+        }
+    }
+    CHECK( cube > 20 && floor > 200 );
+
+    CHECK( SameImage( RenderImage( single, scene, frame, constants ), reference ) );
+    for ( uint32_t threads: { 2u, 5u } )
+    {
+        ThreadPool pool( threads );
+        CHECK( SameImage( RenderImage( pool, scene, frame, constants ), reference ) );
+    }
+
+    // Only the AS_CAST pixels are traced.
+    RayBuffer buffer = reference;
+    buffer.Colour()( 3, 4 ).w = static_cast<float>( AS_CAST );
+    buffer.Colour()( 9, 1 ).w = static_cast<float>( AS_CAST );
+
+    PathTracer tracer( single );
+    tracer.SetScene( scene );
+    CHECK( tracer.Render( buffer, frame, constants ).pixels == 2 );
+    CHECK( SameImage( buffer, reference ) );
+}
+
+TEST( PathTracer, SingleLight )
+{
+    TestScene       testScene;
+    PathTracerScene scene;
+    testScene.Fill( scene );
+
+    // Read from slot 1, AddLight puts it there too.
+    PathTracerConstants left;
+    CHECK( left.AddLight( float4( -4, 3, 0, 1 ) ) );
+    CHECK( left.nbrActiveLights == 1 );
+    CHECK( left.lightPositions[0].x == -4 && left.lightPositions[1].x == -4 );
+
+    PathTracerConstants right;
+    right.AddLight( float4( 4, 3, 0, 1 ) );
+
+    // Where the light is shows in the image.
+    ThreadPool            pool( 2 );
+    const PathTracerFrame frame = MakeFrame();
+    CHECK( !SameImage( RenderImage( pool, scene, frame, left ), RenderImage( pool, scene, frame, right ) ) );
+
+    // A second light takes slot 1, and there is room for PATH_MAX_LIGHTS.
+    CHECK( left.AddLight( float4( 1, 2, 3, 1 ) ) );
+    CHECK( left.lightPositions[0].x == -4 && left.lightPositions[1].x == 1 );
+    for ( uint32_t i = 2; i < PATH_MAX_LIGHTS; ++i )
+        CHECK( left.AddLight( float4( 0, 1, 0, 1 ) ) );
+    CHECK( !left.AddLight( float4( 0, 1, 0, 1 ) ) );
+    CHECK( left.nbrActiveLights == PATH_MAX_LIGHTS );
+}
+
+TEST( PathTracer, LoadSceneTransform )
+{
+    TestScene testScene;
+
+    CookedMaterial material = {};
+    material.diffuse[0] = material.diffuse[1] = material.diffuse[2] = 0.5f;
+    material.indexOfRefraction = 1.0f;
+
+    const float lower[3]     = { -0.5f, 0, -0.5f };
+    const float upper[3]     = { 0.5f, 1, 0.5f };
+    const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+    CookedSceneWriter writer( sizeof( FullVertex ) );
+    const uint32_t    mesh = writer.AddMesh(
+        testScene.cubeVertices.data(), static_cast<uint32_t>( testScene.cubeVertices.size() ),
+        testScene.cubeIndices.data(), static_cast<uint32_t>( testScene.cubeIndices.size() ), 4,
+        writer.AddMaterial( material ), lower, upper );
+    writer.AddNode( COOKED_NO_PARENT, "root", identity, &mesh, 1 );
+
+    const std::filesystem::path fileName = std::filesystem::temp_directory_path() / "cpulib_path_tracer.cooked";
+    std::string                 error;
+    REQUIRE( writer.Write( fileName, &error ) );
+
+    CookedScene cooked;
+    REQUIRE( cooked.Open( fileName, &error ) );
+
+    // The scene_scale of the Playground's Cornell boxes.
+    float3x4 transform = IdentityTransform();
+    for ( int axis = 0; axis < 3; ++axis )
+        transform.m[axis][axis] = 10.0f;
+
+    PathTracerScene scene;
+    LoadPathTracerScene( cooked, scene, transform );
+    REQUIRE( scene.instances.size() == 1 );
+    CHECK( scene.instances[0].meshCount == 1 );
+    CHECK( scene.instances[0].objectToWorld.m[1][1] == 10.0f );
+
+    ThreadPool pool( 2 );
+    PathTracer tracer( pool );
+    tracer.SetScene( scene );
+
+    // The top of the cube is at 10 in world space.
+    RayDesc ray;
+    ray.origin    = float3( 0, 20, 0 );
+    ray.direction = float3( 0, -1, 0 );
+
+    RayHit hit;
+    REQUIRE( tracer.GetBvh().Intersect( ray, hit ) );
+    CHECK_NEAR( hit.t, 10.0f, 1e-4f );
+
+    // The lights and normals go through the same transform.
+    PathTracerConstants constants;
+    constants.SetSceneTransform( transform );
+    CHECK( constants.modelToWorld.m[0][0] == 10.0f );
+    CHECK_NEAR( constants.normalModelToWorld.m[0][0], 0.1f, 1e-6f );
+
+    cooked.Close();
+    std::filesystem::remove( fileName );
+}
@@ -0,0 +1,215 @@
+/*
+ *  ReadCounterTrace on a recorded trace and on malformed files, the
+ *  controller replaying the recording, and the controller in a loop with a
+ *  made up sampler that settles on the budget.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/RayBudgetController.h>
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+// 40 frames at 1920x1080, the first 20 tracing every pixel and the rest with a grid.
+const std::string RECORDED_TRACE = std::string( CPULIB_TEST_DATA ) + "/counter_trace.csv";
+
+std::string WriteTempFile( const std::string& name, const std::string& contents )
+{
+    const std::string fileName = ( std::filesystem::temp_directory_path() / name ).string();
+
+    std::ofstream file( fileName, std::ios::binary );
+    file << contents;
+    return fileName;
+}
+
+bool ReadTrace( const std::string& contents, std::vector<FrameCounters>& trace )
+{
+    const std::string fileName = WriteTempFile( "cpulib_counter_trace.csv", contents );
+    const bool        read     = ReadCounterTrace( fileName, trace );
+    std::filesystem::remove( fileName );
+    return read;
+}
+
+// A frame of 1920x1080 under the given sampler settings. A coarser grid casts fewer rays and the looser limits, read
+// back from the colour limit, interpolate up to 60% of what is left, and scale makes the scene more expensive. The
+// time is a fixed cost plus the rays.
+FrameCounters RunPlant( const AdaptiveSamplerSettings& sampler, const RayBudgetSettings& settings, float scale = 1 )
+{
+    const float castPerGrid[] = { 1.0f, 0.55f, 0.3f, 0.18f, 0.12f };
+    const float looseness     = std::log( sampler.colourLimit / settings.colourLimitTight ) /
+                                std::log( settings.colourLimitLoose / settings.colourLimitTight );
+
+    FrameCounters counters;
+    counters.pixelCount   = 1920 * 1080;
+    counters.castRays     = static_cast<uint64_t>( counters.pixelCount * castPerGrid[sampler.gridSize] *
+                                                   ( 1 - 0.6f * looseness ) * scale );
+    counters.interpolated = counters.pixelCount - std::min( counters.castRays, counters.pixelCount );
+    counters.frameMs      = 4 + counters.castRays * 1e-5f;
+    return counters;
+}
+
+}  // namespace
+
+TEST( RayBudgetController, ReadRecordedTrace )
+{
+    std::vector<FrameCounters> trace;
+    REQUIRE( ReadCounterTrace( RECORDED_TRACE, trace ) );
+    REQUIRE( trace.size() == 40 );
+
+    CHECK( trace.front().castRays == 2026195 );
+    CHECK( trace.front().interpolated == 47405 );
+    CHECK_NEAR( trace.front().frameMs, 25.541, 1e-4 );
+    CHECK( trace.back().castRays == 822433 );
+    CHECK_NEAR( trace.back().frameMs, 12.557, 1e-4 );
+
+    for ( const FrameCounters& counters: trace )
+    {
+        CHECK( counters.pixelCount == 1920 * 1080 );
+        CHECK( counters.castRays + counters.interpolated == counters.pixelCount );
+    }
+}
+
+TEST( RayBudgetController, TraceRoundTrip )
+{
+    std::vector<FrameCounters> recorded;
+    REQUIRE( ReadCounterTrace( RECORDED_TRACE, recorded ) );
+
+    const std::string fileName =
+        ( std::filesystem::temp_directory_path() / "cpulib_counter_trace_copy.csv" ).string();
+    REQUIRE( WriteCounterTrace( fileName, recorded ) );
+
+    std::vector<FrameCounters> trace;
+    CHECK( ReadCounterTrace( fileName, trace ) );
+    std::filesystem::remove( fileName );
+
+    REQUIRE( trace.size() == recorded.size() );
+    for ( size_t i = 0; i < trace.size(); ++i )
+    {
+        CHECK( trace[i].castRays == recorded[i].castRays );
+        CHECK( trace[i].interpolated == recorded[i].interpolated );
+        CHECK( trace[i].pixelCount == recorded[i].pixelCount );
+        CHECK_NEAR( trace[i].frameMs, recorded[i].frameMs, 1e-3 );
+    }
+}
+
+TEST( RayBudgetController, SkipsCommentsAndEmptyLines )
+{
+    std::vector<FrameCounters> trace;
+    CHECK( ReadTrace( "castRays,interpolated,pixelCount,frameMs\r\n# warm up\r\n\r\n10,6,16,1.5\r\n", trace ) );
+    REQUIRE( trace.size() == 1 );
+    CHECK( trace[0].castRays == 10 );
+    CHECK_NEAR( trace[0].frameMs, 1.5, 1e-6 );
+
+    // No header at all.
+    CHECK( ReadTrace( "1,2,3,4\n5,6,7,8\n", trace ) );
+    CHECK( trace.size() == 2 );
+
+    CHECK( ReadTrace( "", trace ) );
+    CHECK( trace.empty() );
+}
+
+TEST( RayBudgetController, RejectsMalformedLines )
+{
+    std::vector<FrameCounters> trace;
+
+    // Only the first line may be the column names.
+    CHECK( !ReadTrace( "# recorded\ncastRays,interpolated,pixelCount,frameMs\n1,2,3,4\n", trace ) );
+    const std::string header = "castRays,interpolated,pixelCount,frameMs\n";
+    CHECK( !ReadTrace( header + header, trace ) );
+
+    // A numeric first line is a frame, not a header.
+    CHECK( !ReadTrace( "1,2,3\n4,5,6,7\n", trace ) );
+
+    CHECK( !ReadTrace( "1,2,3,4\n5,6\n", trace ) );
+    CHECK( !ReadTrace( "1,2,3,4\n5,x,7,8\n", trace ) );
+    CHECK( !ReadTrace( "1,2,3,4\n5,6,7,8,9\n", trace ) );
+    CHECK( !ReadTrace( "1,2,3,4\n5,6,7,8ms\n", trace ) );
+
+    CHECK( !ReadCounterTrace( "does/not/exist.csv", trace ) );
+}
+
+TEST( RayBudgetController, ReplayRecordedTrace )
+{
+    std::vector<FrameCounters> trace;
+    REQUIRE( ReadCounterTrace( RECORDED_TRACE, trace ) );
+
+    // The first half of the recording is over a 60 Hz budget, in time and in rays.
+    for ( BudgetMode mode: { BudgetMode::Milliseconds, BudgetMode::Rays } )
+    {
+        RayBudgetSettings settings;
+        settings.mode   = mode;
+        settings.target = mode == BudgetMode::Milliseconds ? 1000.0f / 60.0f : 1200000.0f;
+
+        RayBudgetController controller( settings );
+        AdaptiveSamplerSettings initial;
+        initial.gridSize = 0;
+        controller.Reset( initial );
+
+        for ( size_t frame = 0; frame < 20; ++frame )
+            controller.Update( trace[frame] );
+
+        CHECK( controller.GetLoad() > 1.0f );
+        CHECK( controller.GetSamplerSettings().gridSize > 0 );
+
+        // Under budget, the grid is not opened any further.
+        const int gridSize = controller.GetSamplerSettings().gridSize;
+        for ( size_t frame = 20; frame < trace.size(); ++frame )
+            controller.Update( trace[frame] );
+
+        CHECK( controller.GetLoad() < 1.0f );
+        CHECK( controller.GetSamplerSettings().gridSize <= gridSize );
+    }
+}
+
+TEST( RayBudgetController, ClosedLoopSettles )
+{
+    for ( BudgetMode mode: { BudgetMode::Rays, BudgetMode::Milliseconds } )
+    {
+        RayBudgetSettings settings;
+        settings.mode   = mode;
+        settings.target = mode == BudgetMode::Rays ? 1000000.0f : 14.0f;
+
+        RayBudgetController controller( settings );
+        controller.Reset( AdaptiveSamplerSettings() );
+
+        // The scene gets 2.5 times as expensive, more than the limits of the first grid can take, and then cheap
+        // again: the grid is stepped up and back down.
+        for ( float scale: { 1.0f, 2.5f, 1.0f } )
+        {
+            int   gridChanges = 0;
+            int   gridSize    = controller.GetSamplerSettings().gridSize;
+            float looseness   = controller.GetLooseness();
+            for ( int frame = 0; frame < 300; ++frame )
+            {
+                const AdaptiveSamplerSettings& sampler = controller.Update( RunPlant(
+                    controller.GetSamplerSettings(), settings, scale ) );
+                if ( sampler.gridSize != gridSize )
+                    ++gridChanges;
+
+                // Settled: no grid change, the limits held, and on budget, for the last third of the phase.
+                if ( frame >= 200 )
+                {
+                    CHECK( sampler.gridSize == gridSize );
+                    CHECK( controller.GetLooseness() == looseness );
+                    CHECK( !controller.IsCorrecting() );
+                    CHECK( std::abs( controller.GetLoad() - 1.0f ) <= settings.deadBand );
+                }
+
+                gridSize  = sampler.gridSize;
+                looseness = controller.GetLooseness();
+            }
+
+            // Straight to the grid that fits, no going back and forth on the way.
+            CHECK( gridChanges == 1 );
+        }
+    }
+}
@@ -0,0 +1,195 @@
+/*
+ *  RayCompaction and ExclusiveScan against serial references, on one and on
+ *  several threads.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/RayCompaction.h>
+#include <cpulib/ThreadPool.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+const uint32_t THREAD_COUNTS[] = { 1, 4 };
+
+std::vector<uint32_t> SerialExclusiveScan( const std::vector<uint32_t>& in, uint64_t& total )
+{
+    std::vector<uint32_t> out( in.size() );
+
+    total = 0;
+    for ( size_t i = 0; i < in.size(); ++i )
+    {
+        out[i] = static_cast<uint32_t>( total );
+        total += in[i];
+    }
+    return out;
+}
+
+std::vector<uint32_t> SerialCompact( const RayBuffer& buffer )
+{
+    std::vector<uint32_t> pixels;
+    for ( uint32_t y = 0; y < buffer.GetHeight(); ++y )
+    {
+        for ( uint32_t x = 0; x < buffer.GetWidth(); ++x )
+        {
+            if ( buffer.Colour().GetRow( y )[x].w == AS_CAST )
+                pixels.push_back( RayCompaction::PackPixel( int2( x, y ) ) );
+        }
+    }
+    return pixels;
+}
+
+// Marks every pixel for which mark( x, y ) holds AS_CAST, the others AS_CASTED.
+template<typename Mark>
+RayBuffer MakeRayBuffer( uint32_t width, uint32_t height, Mark mark )
+{
+    RayBuffer buffer;
+    buffer.Resize( width, height );
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        for ( uint32_t x = 0; x < width; ++x )
+            buffer.Colour().GetRow( y )[x].w = mark( x, y ) ? AS_CAST : AS_CASTED;
+    }
+    return buffer;
+}
+
+void CheckCompaction( const RayBuffer& buffer )
+{
+    const std::vector<uint32_t> expected = SerialCompact( buffer );
+
+    for ( uint32_t threads: THREAD_COUNTS )
+    {
+        ThreadPool    pool( threads );
+        RayCompaction compaction( pool );
+
+        // Twice, the pixel list is reused between passes.
+        for ( int pass = 0; pass < 2; ++pass )
+        {
+            REQUIRE( compaction.Compact( buffer ) == expected.size() );
+            REQUIRE( compaction.GetRayCount() == expected.size() );
+            REQUIRE( compaction.GetPixelList().size() >= expected.size() );
+
+            const std::vector<uint32_t>& pixels = compaction.GetPixelList();
+            CHECK( std::equal( expected.begin(), expected.end(), pixels.begin() ) );
+        }
+
+        const DispatchSize size = compaction.GetDispatchSize();
+        if ( expected.empty() )
+        {
+            CHECK( size.width == 0 && size.height == 0 && size.depth == 0 );
+        }
+        else
+        {
+            CHECK( size.depth == 1 );
+            CHECK( size.width <= RayCompaction::MAX_DISPATCH_WIDTH );
+            CHECK( uint64_t( size.width ) * size.height >= expected.size() );
+            CHECK( uint64_t( size.width ) * ( size.height - 1 ) < expected.size() );
+        }
+    }
+}
+
+}  // namespace
+
+TEST( RayCompaction, ScanEmpty )
+{
+    for ( uint32_t threads: THREAD_COUNTS )
+    {
+        ThreadPool pool( threads );
+        CHECK( ExclusiveScan( pool, nullptr, nullptr, 0 ) == 0 );
+    }
+}
+
+TEST( RayCompaction, ScanMatchesSerial )
+{
+    std::mt19937 random( 7 );
+
+    // Around and across the blocks of the parallel scan.
+    const size_t counts[] = { 1, 2, 4095, 4096, 4097, 3 * 4096 + 17, 100000 };
+    for ( size_t count: counts )
+    {
+        std::vector<uint32_t> in( count );
+        for ( uint32_t& value: in )
+            value = random() % 1000;
+
+        uint64_t                    expectedTotal;
+        const std::vector<uint32_t> expected = SerialExclusiveScan( in, expectedTotal );
+
+        for ( uint32_t threads: THREAD_COUNTS )
+        {
+            ThreadPool pool( threads );
+
+            std::vector<uint32_t> out( count, ~0u );
+            CHECK( ExclusiveScan( pool, in.data(), out.data(), count ) == expectedTotal );
+            CHECK( out == expected );
+
+            // In place, as Compact scans its row counts.
+            std::vector<uint32_t> inPlace = in;
+            CHECK( ExclusiveScan( pool, inPlace.data(), inPlace.data(), count ) == expectedTotal );
+            CHECK( inPlace == expected );
+        }
+    }
+}
+
+TEST( RayCompaction, ScanTotalAbove32Bits )
+{
+    std::vector<uint32_t> in( 5000, 0x80000000u );
+
+    ThreadPool pool( 4 );
+    std::vector<uint32_t> out( in.size() );
+    CHECK( ExclusiveScan( pool, in.data(), out.data(), in.size() ) == uint64_t( 0x80000000u ) * in.size() );
+}
+
+TEST( RayCompaction, EmptyMask )
+{
+    CheckCompaction( MakeRayBuffer( 67, 45, []( uint32_t, uint32_t ) { return false; } ) );
+}
+
+TEST( RayCompaction, FullMask )
+{
+    CheckCompaction( MakeRayBuffer( 67, 45, []( uint32_t, uint32_t ) { return true; } ) );
+}
+
+TEST( RayCompaction, RandomMask )
+{
+    std::mt19937 random( 11 );
+
+    const uint32_t densities[] = { 1, 10, 50, 90 };
+    for ( uint32_t density: densities )
+    {
+        CheckCompaction( MakeRayBuffer( 1283, 719, [&]( uint32_t, uint32_t ) {
+            return random() % 100 < density;
+        } ) );
+    }
+}
+
+TEST( RayCompaction, PackPixel )
+{
+    const int2 pixels[] = { int2( 0, 0 ), int2( 1919, 1079 ), int2( 65535, 65535 ), int2( 3, 40000 ) };
+    for ( const int2& pixel: pixels )
+    {
+        const int2 unpacked = RayCompaction::UnpackPixel( RayCompaction::PackPixel( pixel ) );
+        CHECK( unpacked.x == pixel.x && unpacked.y == pixel.y );
+    }
+}
+
+TEST( RayCompaction, DispatchSize )
+{
+    const DispatchSize none = RayCompaction::CalcDispatchSize( 0 );
+    CHECK( none.width == 0 && none.height == 0 && none.depth == 0 );
+
+    const DispatchSize row = RayCompaction::CalcDispatchSize( 1000 );
+    CHECK( row.width == 1000 && row.height == 1 && row.depth == 1 );
+
+    const DispatchSize wrapped = RayCompaction::CalcDispatchSize( 1025 );
+    CHECK( wrapped.width == 1024 && wrapped.height == 2 && wrapped.depth == 1 );
+
+    const DispatchSize narrow = RayCompaction::CalcDispatchSize( 10, 3 );
+    CHECK( narrow.width == 3 && narrow.height == 4 );
+}
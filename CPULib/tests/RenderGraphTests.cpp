@@ -0,0 +1,499 @@
+/*
+ *  The barriers RenderGraph places in the Playground frame: the passes are
+ *  declared like DummyGame::OnRender does, the SVGF stages through
+ *  DeclareSvgfAccesses, and checked against the hazards of those accesses,
+ *  also with the buffers sharing memory like the Playground places them.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/AliasingPlanner.h>
+#include <cpulib/RenderGraph.h>
+#include <cpulib/SvgfRotation.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+const int ATROUS_ITERATIONS = 5;
+
+// The scheduler passes of a grid of size 2.
+const uint32_t TRACE_PASSES = 3;
+
+struct FramePasses
+{
+    uint32_t              clear = 0;
+    std::vector<uint32_t> schedule;
+    std::vector<uint32_t> compact;
+    std::vector<uint32_t> trace;
+    // The reprojection, the moments and the a-trous passes.
+    std::vector<uint32_t> svgf;
+    uint32_t              present = 0;
+};
+
+// An access as the pass declared it.
+struct DeclaredAccess
+{
+    uint32_t           resource = 0;
+    bool               read     = false;
+    bool               write    = false;
+    GraphResourceState state    = GraphResourceState::UnorderedAccess;
+};
+
+class SvgfGraph
+{
+public:
+    SvgfGraph()
+    {
+        stages = BuildSvgfRotation( rotation, ATROUS_ITERATIONS );
+
+        std::string error;
+        planned = rotation.Plan( &error );
+
+        for ( uint32_t buffer = 0; buffer < rotation.GetBufferCount(); ++buffer )
+            graph.ImportResource( "buffer#" + std::to_string( buffer ) );
+        backBuffer = graph.ImportResource( "back buffer" );
+    }
+
+    uint32_t GetRayColour( uint64_t frame ) const
+    {
+        return rotation.GetBuffer( frame, stages.trace, SVGF_SLOT_RAY_COLOUR );
+    }
+
+    uint32_t GetSdrTarget( uint64_t frame ) const
+    {
+        return rotation.GetBuffer( frame, stages.present, SVGF_SLOT_SDR_TARGET );
+    }
+
+    // The passes of one frame, with the accesses of every pass in declared.
+    FramePasses Declare( uint64_t frame )
+    {
+        graph.Reset();
+        graph.SetState( backBuffer, GraphResourceState::Common );
+        declared.clear();
+
+        FramePasses passes;
+        passes.clear = AddPass( "clear" );
+        graph.Write( passes.clear, GetRayColour( frame ), GraphResourceState::RenderTarget );
+        declared.back().push_back( { GetRayColour( frame ), false, true, GraphResourceState::RenderTarget } );
+
+        for ( uint32_t i = 0; i < TRACE_PASSES; ++i )
+        {
+            passes.schedule.push_back( AddPass( "schedule" ) );
+            DeclareStage( passes.schedule.back(), frame, stages.trace, true );
+
+            passes.compact.push_back( AddPass( "compact" ) );
+            graph.Read( passes.compact.back(), GetRayColour( frame ) );
+            declared.back().push_back( { GetRayColour( frame ), true, false, GraphResourceState::UnorderedAccess } );
+
+            passes.trace.push_back( AddPass( "trace" ) );
+            DeclareStage( passes.trace.back(), frame, stages.trace, true );
+        }
+
+        passes.svgf.push_back( AddPass( "reprojection" ) );
+        DeclareStage( passes.svgf.back(), frame, stages.reprojection, false );
+        passes.svgf.push_back( AddPass( "moments" ) );
+        DeclareStage( passes.svgf.back(), frame, stages.moments, false );
+        for ( int i = 0; i < ATROUS_ITERATIONS; ++i )
+        {
+            passes.svgf.push_back( AddPass( "atrous" ) );
+            DeclareStage( passes.svgf.back(), frame, stages.atrous + i, false );
+        }
+
+        passes.present = graph.AddCopyPass( "present", backBuffer, GetSdrTarget( frame ) );
+        declared.emplace_back();
+        declared.back().push_back( { backBuffer, false, true, GraphResourceState::CopyDest } );
+        declared.back().push_back( { GetSdrTarget( frame ), true, false, GraphResourceState::CopySource } );
+
+        graph.MarkOutput( backBuffer );
+        for ( uint32_t buffer: rotation.GetHistoryBuffers( frame ) )
+            graph.MarkOutput( buffer );
+
+        return passes;
+    }
+
+    // The buffers placed in one heap like the Playground does, just created and without their memory. Returns the
+    // number of buffers that share memory with another.
+    uint32_t PlaceInHeap()
+    {
+        AliasingPlanner planner;
+        AddRotationLifetimes( planner, rotation, uint64_t( 1920 ) * 1080 * 16 );
+        planner.Plan();
+
+        uint32_t sharing = 0;
+        for ( uint32_t a = 0; a < rotation.GetBufferCount(); ++a )
+        {
+            bool shares = false;
+            for ( uint32_t b = 0; b < rotation.GetBufferCount(); ++b )
+            {
+                shares = shares || planner.SharesMemory( a, b );
+                if ( a < b && planner.SharesMemory( a, b ) )
+                    graph.AddAlias( a, b );
+            }
+            sharing += shares ? 1 : 0;
+            graph.SetResident( a, false );
+        }
+        return sharing;
+    }
+
+    // Compile, execute and validate the declared frame.
+    bool Run()
+    {
+        graph.Compile();
+
+        RecordingGraphBackend backend;
+        graph.Execute( backend );
+
+        std::string error;
+        const bool  valid = graph.Validate( backend.GetCommands(), &error );
+        if ( !valid )
+            test::ReportFailure( __FILE__, __LINE__, error + "\n" + backend.Describe() );
+        return valid;
+    }
+
+    ResourceRotation rotation;
+    SvgfStages       stages;
+    RenderGraph      graph;
+    uint32_t         backBuffer = 0;
+    bool             planned    = false;
+
+    // Per pass.
+    std::vector<std::vector<DeclaredAccess>> declared;
+
+private:
+    uint32_t AddPass( const std::string& name )
+    {
+        declared.emplace_back();
+        return graph.AddPass( name );
+    }
+
+    void DeclareStage( uint32_t pass, uint64_t frame, uint32_t stage, bool accumulate )
+    {
+        DeclareSvgfAccesses( graph, pass, rotation, frame, stage, accumulate );
+
+        for ( const auto& access: rotation.GetStageAccesses( stage ) )
+        {
+            DeclaredAccess declaredAccess;
+            declaredAccess.resource = rotation.GetBuffer( frame, stage, access.slot );
+            declaredAccess.read     = access.access == SlotAccess::Read || access.access == SlotAccess::ReadHistory;
+            declaredAccess.write    = !declaredAccess.read;
+            declaredAccess.read     = declaredAccess.read || accumulate;
+            declared[pass].push_back( declaredAccess );
+        }
+    }
+};
+
+bool operator==( const GraphBarrier& a, const GraphBarrier& b )
+{
+    return a.type == b.type && a.resource == b.resource && a.before == b.before && a.after == b.after;
+}
+
+GraphBarrier Transition( uint32_t resource, GraphResourceState before, GraphResourceState after )
+{
+    GraphBarrier barrier;
+    barrier.type     = GraphBarrier::Type::Transition;
+    barrier.resource = resource;
+    barrier.before   = before;
+    barrier.after    = after;
+    return barrier;
+}
+
+GraphBarrier UAVBarrier( uint32_t resource )
+{
+    GraphBarrier barrier;
+    barrier.type     = GraphBarrier::Type::UAV;
+    barrier.resource = resource;
+    barrier.before = barrier.after = GraphResourceState::UnorderedAccess;
+    return barrier;
+}
+
+bool HasBarrierOn( const std::vector<GraphBarrier>& barriers, uint32_t resource )
+{
+    for ( const GraphBarrier& barrier: barriers )
+    {
+        if ( barrier.resource == resource )
+            return true;
+    }
+    return false;
+}
+
+/**
+ * The barriers each pass needs on its own, without merging: a transition
+ * when the state changes, a UAV barrier when the pass reads or writes after
+ * an unordered write, or writes after an unordered read. Two reads need
+ * nothing.
+ */
+std::vector<std::vector<GraphBarrier>> GetHazardBarriers( const SvgfGraph& svgf,
+                                                          std::vector<GraphResourceState> states )
+{
+    std::vector<bool> read( states.size(), false );
+    std::vector<bool> written( states.size(), false );
+
+    std::vector<std::vector<GraphBarrier>> barriers( svgf.declared.size() );
+    for ( size_t pass = 0; pass < svgf.declared.size(); ++pass )
+    {
+        for ( const DeclaredAccess& access: svgf.declared[pass] )
+        {
+            const uint32_t r = access.resource;
+            if ( states[r] != access.state )
+                barriers[pass].push_back( Transition( r, states[r], access.state ) );
+            else if ( access.state == GraphResourceState::UnorderedAccess &&
+                      ( written[r] || ( access.write && read[r] ) ) )
+                barriers[pass].push_back( UAVBarrier( r ) );
+            else
+                continue;
+
+            states[r]  = access.state;
+            read[r]    = false;
+            written[r] = false;
+        }
+        for ( const DeclaredAccess& access: svgf.declared[pass] )
+        {
+            read[access.resource]    = read[access.resource] || access.read;
+            written[access.resource] = written[access.resource] || access.write;
+        }
+    }
+    return barriers;
+}
+
+std::vector<GraphResourceState> GetStates( const RenderGraph& graph, uint32_t resourceCount )
+{
+    std::vector<GraphResourceState> states;
+    for ( uint32_t r = 0; r < resourceCount; ++r )
+        states.push_back( graph.GetState( r ) );
+    return states;
+}
+
+}  // namespace
+
+TEST( RenderGraph, SvgfFramesAreValid )
+{
+    SvgfGraph svgf;
+    REQUIRE( svgf.planned );
+
+    const uint64_t frameCount = svgf.rotation.GetFirstPeriodicFrame() + 2 * svgf.rotation.GetFramePeriod() + 1;
+    for ( uint64_t frame = 0; frame < frameCount; ++frame )
+    {
+        const FramePasses passes = svgf.Declare( frame );
+        REQUIRE( svgf.Run() );
+
+        // Every pass leads to the back buffer or the history.
+        CHECK( svgf.graph.GetStats().culledPasses == 0 );
+        CHECK( svgf.graph.GetStats().passes == passes.present + 1 );
+    }
+}
+
+TEST( RenderGraph, SvgfFirstFrameTransitions )
+{
+    SvgfGraph svgf;
+    REQUIRE( svgf.planned );
+
+    const FramePasses passes    = svgf.Declare( 0 );
+    const uint32_t    rayColour = svgf.GetRayColour( 0 );
+    REQUIRE( svgf.Run() );
+
+    // The clear renders to the ray colour.
+    const std::vector<GraphBarrier>& clear = svgf.graph.GetBarriers( passes.clear );
+    REQUIRE( clear.size() == 1 );
+    CHECK( clear[0] == Transition( rayColour, GraphResourceState::Common, GraphResourceState::RenderTarget ) );
+
+    // The first scheduler pass moves everything the trace stage binds to unordered access, nothing to wait for yet.
+    const std::vector<GraphBarrier>& schedule = svgf.graph.GetBarriers( passes.schedule[0] );
+    CHECK( schedule.size() == svgf.rotation.GetStageAccesses( svgf.stages.trace ).size() );
+    for ( const GraphBarrier& barrier: schedule )
+    {
+        CHECK( barrier.type == GraphBarrier::Type::Transition );
+        CHECK( barrier.after == GraphResourceState::UnorderedAccess );
+        CHECK( barrier.before == ( barrier.resource == rayColour ? GraphResourceState::RenderTarget
+                                                                 : GraphResourceState::Common ) );
+    }
+
+    // The copy to the back buffer.
+    const std::vector<GraphBarrier>& present = svgf.graph.GetBarriers( passes.present );
+    REQUIRE( present.size() == 2 );
+    CHECK( present[0] ==
+           Transition( svgf.backBuffer, GraphResourceState::Common, GraphResourceState::CopyDest ) );
+    CHECK( present[1] == Transition( svgf.GetSdrTarget( 0 ), GraphResourceState::UnorderedAccess,
+                                     GraphResourceState::CopySource ) );
+}
+
+TEST( RenderGraph, SvgfTracePassesMergeUAVBarriers )
+{
+    SvgfGraph svgf;
+    REQUIRE( svgf.planned );
+
+    const FramePasses passes    = svgf.Declare( 0 );
+    const uint32_t    rayColour = svgf.GetRayColour( 0 );
+    REQUIRE( svgf.Run() );
+
+    for ( uint32_t i = 0; i < TRACE_PASSES; ++i )
+    {
+        // The compaction only waits for the scheduler's marks in the ray colour.
+        const std::vector<GraphBarrier>& compact = svgf.graph.GetBarriers( passes.compact[i] );
+        REQUIRE( compact.size() == 1 );
+        CHECK( compact[0] == UAVBarrier( rayColour ) );
+
+        // The trace and the next scheduler pass wait on all the ray buffers, one barrier does.
+        const std::vector<GraphBarrier>& trace = svgf.graph.GetBarriers( passes.trace[i] );
+        REQUIRE( trace.size() == 1 );
+        CHECK( trace[0] == UAVBarrier( GraphBarrier::ALL_RESOURCES ) );
+
+        if ( i > 0 )
+        {
+            const std::vector<GraphBarrier>& schedule = svgf.graph.GetBarriers( passes.schedule[i] );
+            REQUIRE( schedule.size() == 1 );
+            CHECK( schedule[0] == UAVBarrier( GraphBarrier::ALL_RESOURCES ) );
+        }
+    }
+}
+
+TEST( RenderGraph, SvgfBarriersMatchTheHazards )
+{
+    SvgfGraph svgf;
+    REQUIRE( svgf.planned );
+    svgf.graph.SetMergeUAVBarriers( false );
+
+    const uint32_t resourceCount = svgf.backBuffer + 1;
+    const uint64_t frameCount    = svgf.rotation.GetFirstPeriodicFrame() + svgf.rotation.GetFramePeriod() + 1;
+    for ( uint64_t frame = 0; frame < frameCount; ++frame )
+    {
+        const FramePasses passes = svgf.Declare( frame );
+
+        // The states the previous frame left.
+        const std::vector<std::vector<GraphBarrier>> expected =
+            GetHazardBarriers( svgf, GetStates( svgf.graph, resourceCount ) );
+        REQUIRE( svgf.Run() );
+
+        for ( uint32_t pass = 0; pass < expected.size(); ++pass )
+        {
+            const std::vector<GraphBarrier>& barriers = svgf.graph.GetBarriers( pass );
+            CHECK( barriers.size() == expected[pass].size() );
+            for ( size_t i = 0; i < std::min( barriers.size(), expected[pass].size() ); ++i )
+                CHECK( barriers[i] == expected[pass][i] );
+        }
+
+        // The SVGF passes all read the ray normals, only the first one waits for the trace to write them.
+        const uint32_t normals = svgf.rotation.GetBuffer( frame, svgf.stages.trace, SVGF_SLOT_RAY_NORMALS );
+        CHECK( HasBarrierOn( svgf.graph.GetBarriers( passes.svgf[0] ), normals ) );
+        for ( size_t i = 1; i < passes.svgf.size(); ++i )
+            CHECK( !HasBarrierOn( svgf.graph.GetBarriers( passes.svgf[i] ), normals ) );
+    }
+}
+
+TEST( RenderGraph, SvgfAliasedFramesAreValid )
+{
+    SvgfGraph svgf;
+    REQUIRE( svgf.planned );
+
+    const uint32_t sharing = svgf.PlaceInHeap();
+    REQUIRE( sharing > 0 );
+
+    // Validate also checks that every pass finds its buffers in memory, and that no value a later pass or the next
+    // frame reads was given to an alias.
+    const uint64_t frameCount = svgf.rotation.GetFirstPeriodicFrame() + 2 * svgf.rotation.GetFramePeriod() + 1;
+    for ( uint64_t frame = 0; frame < frameCount; ++frame )
+    {
+        svgf.Declare( frame );
+        REQUIRE( svgf.Run() );
+        CHECK( svgf.graph.GetStats().culledPasses == 0 );
+
+        // The first frame brings in every buffer, after that only the ones sharing memory change hands.
+        const uint32_t aliasing = svgf.graph.GetStats().aliasing;
+        if ( frame == 0 )
+            CHECK( aliasing == svgf.rotation.GetBufferCount() );
+        else
+            CHECK( aliasing > 0 && aliasing <= sharing );
+    }
+
+    // The aliasing barrier goes ahead of the transition.
+    const FramePasses passes = svgf.Declare( frameCount );
+    REQUIRE( svgf.Run() );
+    for ( uint32_t pass = 0; pass <= passes.present; ++pass )
+    {
+        const std::vector<GraphBarrier>& barriers = svgf.graph.GetBarriers( pass );
+        for ( size_t i = 0; i < barriers.size(); ++i )
+        {
+            if ( barriers[i].type != GraphBarrier::Type::Aliasing )
+                continue;
+            for ( size_t j = 0; j < i; ++j )
+                CHECK( barriers[j].resource != barriers[i].resource );
+        }
+    }
+}
+
+TEST( RenderGraph, AliasedValueIsLost )
+{
+    // a and b share memory: b written after a's value breaks a pass reading a, Validate catches it.
+    RenderGraph    graph;
+    const uint32_t a = graph.ImportResource( "a" );
+    const uint32_t b = graph.ImportResource( "b" );
+    graph.AddAlias( a, b );
+    graph.SetResident( b, false );
+
+    const uint32_t writeA = graph.AddPass( "write a" );
+    graph.Write( writeA, a );
+    const uint32_t writeB = graph.AddPass( "write b" );
+    graph.Write( writeB, b );
+    graph.MarkOutput( b );
+    graph.MarkOutput( a );
+    graph.Compile();
+
+    // Ahead of its transition out of Common.
+    const std::vector<GraphBarrier>& barriers = graph.GetBarriers( writeB );
+    REQUIRE( barriers.size() == 2 );
+    CHECK( barriers[0].type == GraphBarrier::Type::Aliasing && barriers[0].resource == b );
+    CHECK( barriers[0].after == GraphResourceState::UnorderedAccess );
+    CHECK( barriers[1].type == GraphBarrier::Type::Transition && barriers[1].resource == b );
+
+    RecordingGraphBackend backend;
+    graph.Execute( backend );
+    std::string error;
+    CHECK( !graph.Validate( backend.GetCommands(), &error ) );
+    CHECK( error == "output a lost its memory" );
+    CHECK( graph.IsResident( b ) && !graph.IsResident( a ) );
+
+    // Reading a again brings it back, but not what it held.
+    graph.Reset();
+    const uint32_t readA = graph.AddPass( "read a" );
+    graph.Read( readA, a );
+    graph.Compile();
+    REQUIRE( !graph.GetBarriers( readA ).empty() );
+    CHECK( graph.GetBarriers( readA )[0].type == GraphBarrier::Type::Aliasing );
+
+    backend.Clear();
+    graph.Execute( backend );
+    CHECK( graph.Validate( backend.GetCommands() ) );
+    CHECK( graph.IsResident( a ) && !graph.IsResident( b ) );
+}
+
+TEST( RenderGraph, SvgfStatesCarryToTheNextFrame )
+{
+    SvgfGraph svgf;
+    REQUIRE( svgf.planned );
+
+    svgf.Declare( 0 );
+    REQUIRE( svgf.Run() );
+
+    // The SVGF passes left the ray colour in unordered access, the copy the SDR target in copy source.
+    const FramePasses passes    = svgf.Declare( 1 );
+    const uint32_t    rayColour = svgf.GetRayColour( 1 );
+    CHECK( svgf.graph.GetState( rayColour ) == GraphResourceState::UnorderedAccess );
+    CHECK( svgf.graph.GetState( svgf.GetSdrTarget( 0 ) ) == GraphResourceState::CopySource );
+    REQUIRE( svgf.Run() );
+
+    const std::vector<GraphBarrier>& clear = svgf.graph.GetBarriers( passes.clear );
+    REQUIRE( clear.size() == 1 );
+    CHECK( clear[0] ==
+           Transition( rayColour, GraphResourceState::UnorderedAccess, GraphResourceState::RenderTarget ) );
+
+    // The present barrier starts from the state SetState gave the back buffer.
+    const std::vector<GraphBarrier>& present = svgf.graph.GetBarriers( passes.present );
+    REQUIRE( !present.empty() );
+    CHECK( present[0] ==
+           Transition( svgf.backBuffer, GraphResourceState::Common, GraphResourceState::CopyDest ) );
+}
@@ -0,0 +1,196 @@
+/*
+ *  SvgfDenoiser over a few made up frames of a moving camera: Exact gives
+ *  the same bits on any number of threads, Fast the same bits with and
+ *  without the AVX2 kernels, and Fast stays close to Exact.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/CameraPath.h>
+#include <cpulib/SvgfDenoiser.h>
+#include <cpulib/ThreadPool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace cpulib;
+
+namespace
+{
+
+// Not a multiple of the 8 pixels of the AVX2 kernels in either direction.
+const uint32_t WIDTH       = 61;
+const uint32_t HEIGHT      = 37;
+const uint32_t FRAME_COUNT = 3;
+
+float Noise( uint32_t x, uint32_t y, uint32_t frame )
+{
+    uint32_t h = x * 747796405u + y * 2891336453u + frame * 277803737u + 1u;
+    h          = ( ( h >> ( ( h >> 28u ) + 4u ) ) ^ h ) * 277803737u;
+    h          = ( h >> 22u ) ^ h;
+    return ( h >> 8 ) * ( 1.0f / 16777216.0f );
+}
+
+CameraPose GetPose( uint32_t frame )
+{
+    CameraPose pose;
+    pose.position = float3( 0.05f * frame, 0, -5 );
+    pose.lookAt   = pose.position + float3( 0, 0, 1 );
+    return pose;
+}
+
+// A wall at z = 0 on the left, a second one at z = 1 on the right, both noisy, as the camera at frame sees them.
+RayBuffer MakeFrame( uint32_t frame )
+{
+    const CameraPose pose         = GetPose( frame );
+    const float3x4   pixelToWorld = GetCameraPixelToWorld( pose );
+    const float      aspect       = static_cast<float>( WIDTH ) / HEIGHT;
+
+    RayBuffer buffer;
+    buffer.Resize( WIDTH, HEIGHT );
+    for ( uint32_t y = 0; y < HEIGHT; ++y )
+    {
+        for ( uint32_t x = 0; x < WIDTH; ++x )
+        {
+            const float2 d( ( x / static_cast<float>( WIDTH ) * 2 - 1 ) * aspect,
+                            y / static_cast<float>( HEIGHT ) * 2 - 1 );
+            const float3 direction = mul( pixelToWorld, d.x, d.y, 1, 0 );
+
+            // Which wall is decided in world space, so it stays put as the camera moves.
+            float        wall    = 0;
+            const float3 onFirst = pose.position + direction * ( ( 0 - pose.position.z ) / direction.z );
+            if ( onFirst.x > 0.5f )
+                wall = 1;
+            const float3 hit = pose.position + direction * ( ( wall - pose.position.z ) / direction.z );
+
+            const float base  = wall == 0 ? 0.3f : 0.6f;
+            const float noise = Noise( x, y, frame ) - 0.5f;
+
+            buffer.Colour()( x, y )     = float4( base + 0.2f * noise, base, base - 0.1f * noise, AS_CASTED );
+            buffer.Normals()( x, y )    = float4( 0.5f, 0.5f, 0.0f, 1.0f );
+            buffer.PosDepth()( x, y )   = float4( hit, length( hit - pose.position ) / 10000.0f );
+            buffer.ObjectMask()( x, y ) = float4( 1 + wall, 0, 0, 0 );
+        }
+    }
+    return buffer;
+}
+
+struct Result
+{
+    ImageF4       output;
+    ImageF4       colour;
+    ImageF4       moments;
+    DenoiserStats stats;
+};
+
+// Every frame of the sequence, what is left after the last one.
+Result Run( uint32_t threads, const DenoiserSettings& settings )
+{
+    ThreadPool   pool( threads );
+    SvgfDenoiser denoiser( pool, settings );
+
+    Result result;
+    for ( uint32_t frame = 0; frame < FRAME_COUNT; ++frame )
+    {
+        DenoiserCamera camera;
+        camera.oldCameraWorldToClip = GetCameraWorldToView( GetPose( frame > 0 ? frame - 1 : 0 ) );
+        camera.newCameraWorldToClip = GetCameraWorldToView( GetPose( frame ) );
+        camera.cameraWindowSize     = float2( static_cast<float>( WIDTH ) / HEIGHT, 1.0f );
+
+        result.stats = denoiser.Denoise( MakeFrame( frame ), camera );
+    }
+
+    denoiser.GetOutput( result.output );
+    denoiser.GetColour( result.colour );
+    denoiser.GetMomentHistory( result.moments );
+    return result;
+}
+
+bool SameImage( const ImageF4& a, const ImageF4& b )
+{
+    return a.GetWidth() == b.GetWidth() && a.GetHeight() == b.GetHeight() &&
+           std::memcmp( a.GetData(), b.GetData(), a.GetWidth() * a.GetHeight() * sizeof( float4 ) ) == 0;
+}
+
+bool SameResult( const Result& a, const Result& b )
+{
+    return SameImage( a.output, b.output ) && SameImage( a.colour, b.colour ) && SameImage( a.moments, b.moments ) &&
+           a.stats.reusedPixels == b.stats.reusedPixels &&
+           a.stats.spatialVariancePixels == b.stats.spatialVariancePixels;
+}
+
+}  // namespace
+
+TEST( SvgfDenoiser, ExactOnAnyThreadCount )
+{
+    DenoiserSettings settings;
+    settings.mode = DenoiserMode::Exact;
+
+    for ( bool dyadicSteps: { false, true } )
+    {
+        settings.dyadicSteps = dyadicSteps;
+
+        const Result expected = Run( 1, settings );
+        REQUIRE( expected.colour.GetWidth() == WIDTH && expected.colour.GetHeight() == HEIGHT );
+
+        // The history was picked up, most of the frame reprojects.
+        CHECK( expected.stats.reusedPixels > WIDTH * HEIGHT / 2 );
+        CHECK( !expected.stats.usedAVX2 );
+
+        for ( uint32_t threads: { 2u, 3u, 8u } )
+            CHECK( SameResult( Run( threads, settings ), expected ) );
+    }
+}
+
+TEST( SvgfDenoiser, FastWithAndWithoutAVX2 )
+{
+    DenoiserSettings settings;
+    settings.mode = DenoiserMode::Fast;
+
+    for ( bool dyadicSteps: { false, true } )
+    {
+        settings.dyadicSteps = dyadicSteps;
+
+        // Without AVX2 in the build or the CPU this compares the scalar kernels with themselves.
+        settings.simd         = false;
+        const Result expected = Run( 1, settings );
+        CHECK( !expected.stats.usedAVX2 );
+
+        settings.simd = true;
+        for ( uint32_t threads: { 1u, 3u } )
+        {
+            const Result result = Run( threads, settings );
+            CHECK( result.stats.usedAVX2 == SvgfDenoiser::IsAVX2Supported() );
+            CHECK( SameResult( result, expected ) );
+        }
+
+        settings.simd = false;
+        CHECK( SameResult( Run( 4, settings ), expected ) );
+    }
+}
+
+TEST( SvgfDenoiser, FastCloseToExact )
+{
+    DenoiserSettings settings;
+    settings.mode      = DenoiserMode::Exact;
+    const Result exact = Run( 2, settings );
+    settings.mode      = DenoiserMode::Fast;
+    const Result fast  = Run( 2, settings );
+
+    float worst = 0;
+    for ( uint32_t y = 0; y < HEIGHT; ++y )
+    {
+        for ( uint32_t x = 0; x < WIDTH; ++x )
+        {
+            const float4 a = exact.colour( x, y );
+            const float4 b = fast.colour( x, y );
+            for ( int i = 0; i < 3; ++i )
+            {
+                const float difference = std::fabs( ( &a.x )[i] - ( &b.x )[i] );
+                worst                  = std::max( worst, difference / std::max( std::fabs( ( &a.x )[i] ), 1e-3f ) );
+            }
+        }
+    }
+    CHECK( worst < 1e-4f );
+}
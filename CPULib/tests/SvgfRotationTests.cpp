@@ -0,0 +1,194 @@
+/*
+ *  The SVGF chain of the Playground walked over several frames of its
+ *  rotation, tracking what every buffer holds instead of trusting Plan.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/SvgfRotation.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+const int ATROUS_ITERATIONS = 5;
+
+// The resource BuildSvgfRotation puts behind every slot.
+const SvgfResource SLOT_RESOURCES[SVGF_SLOT_COUNT] = {
+    SVGF_RESOURCE_RAY_COLOUR, SVGF_RESOURCE_NORMALS,   SVGF_RESOURCE_POS_DEPTH, SVGF_RESOURCE_OBJECT_ID_MASK,
+    SVGF_RESOURCE_COLOUR,     SVGF_RESOURCE_NORMALS,   SVGF_RESOURCE_POS_DEPTH, SVGF_RESOURCE_OBJECT_ID_MASK,
+    SVGF_RESOURCE_MOMENTS,    SVGF_RESOURCE_COLOUR,    SVGF_RESOURCE_MOMENTS,   SVGF_RESOURCE_SDR,
+    SVGF_RESOURCE_COLOUR,     SVGF_RESOURCE_MOMENTS,
+};
+
+// What a buffer holds: the frame and stage that wrote it, stage -1 for nothing yet.
+struct Value
+{
+    uint64_t frame = 0;
+    int      stage = -1;
+
+    bool operator==( const Value& other ) const
+    {
+        return frame == other.frame && stage == other.stage;
+    }
+};
+
+uint32_t GetResourceOfBuffer( const ResourceRotation& rotation, uint32_t buffer )
+{
+    uint32_t resource = 0;
+    while ( resource + 1 < rotation.GetResourceCount() && rotation.GetFirstBuffer( resource + 1 ) <= buffer )
+        ++resource;
+    return resource;
+}
+
+bool IsWrite( SlotAccess access )
+{
+    return access == SlotAccess::Write || access == SlotAccess::WriteHistory;
+}
+
+void PlanRotation( ResourceRotation& rotation, SvgfStages& stages )
+{
+    stages = BuildSvgfRotation( rotation, ATROUS_ITERATIONS );
+
+    std::string error;
+    CHECK( rotation.Plan( &error ) );
+    CHECK( rotation.Validate( &error ) );
+    CHECK( error.empty() );
+}
+
+}  // namespace
+
+TEST( SvgfRotation, Layout )
+{
+    ResourceRotation rotation;
+    SvgfStages       stages;
+    PlanRotation( rotation, stages );
+
+    // One buffer per render target of the ray, history and filter targets.
+    CHECK( rotation.GetSlotCount() == SVGF_SLOT_COUNT );
+    CHECK( rotation.GetResourceCount() == SVGF_RESOURCE_COUNT );
+    CHECK( rotation.GetBufferCount() == 14 );
+    CHECK( rotation.GetStageCount() == 4u + ATROUS_ITERATIONS );
+
+    CHECK( stages.trace < stages.reprojection );
+    CHECK( stages.reprojection < stages.moments );
+    CHECK( stages.moments < stages.atrous );
+    CHECK( stages.atrous + ATROUS_ITERATIONS == stages.present );
+
+    CHECK( rotation.GetBindingSetCount() > 0 );
+    for ( uint32_t set = 0; set < rotation.GetBindingSetCount(); ++set )
+        CHECK( rotation.GetBindingSet( set ).size() == SVGF_SLOT_COUNT );
+}
+
+TEST( SvgfRotation, NoOverlapsWithinAPass )
+{
+    ResourceRotation rotation;
+    SvgfStages       stages;
+    PlanRotation( rotation, stages );
+
+    const uint64_t frameCount = rotation.GetFirstPeriodicFrame() + 4 * rotation.GetFramePeriod() + 3;
+    for ( uint64_t frame = 0; frame < frameCount; ++frame )
+    {
+        for ( uint32_t stage = 0; stage < rotation.GetStageCount(); ++stage )
+        {
+            std::vector<uint32_t> reads, writes;
+            for ( const auto& access: rotation.GetStageAccesses( stage ) )
+            {
+                const uint32_t buffer = rotation.GetBuffer( frame, stage, access.slot );
+                REQUIRE( buffer < rotation.GetBufferCount() );
+                CHECK( GetResourceOfBuffer( rotation, buffer ) == SLOT_RESOURCES[access.slot] );
+
+                ( IsWrite( access.access ) ? writes : reads ).push_back( buffer );
+            }
+
+            // Two writes to one buffer, or a read of a buffer the same pass writes.
+            std::sort( writes.begin(), writes.end() );
+            CHECK( std::adjacent_find( writes.begin(), writes.end() ) == writes.end() );
+            for ( uint32_t buffer: reads )
+                CHECK( !std::binary_search( writes.begin(), writes.end(), buffer ) );
+        }
+    }
+}
+
+TEST( SvgfRotation, ReadsSeeTheirValues )
+{
+    ResourceRotation rotation;
+    SvgfStages       stages;
+    PlanRotation( rotation, stages );
+
+    std::vector<Value> contents( rotation.GetBufferCount() );
+    std::vector<Value> history( SVGF_RESOURCE_COUNT );
+
+    const uint64_t frameCount = rotation.GetFirstPeriodicFrame() + 4 * rotation.GetFramePeriod() + 3;
+    for ( uint64_t frame = 0; frame < frameCount; ++frame )
+    {
+        std::vector<Value> current( SVGF_RESOURCE_COUNT );
+        std::vector<Value> nextHistory = history;
+
+        for ( uint32_t stage = 0; stage < rotation.GetStageCount(); ++stage )
+        {
+            for ( const auto& access: rotation.GetStageAccesses( stage ) )
+            {
+                const uint32_t buffer   = rotation.GetBuffer( frame, stage, access.slot );
+                const uint32_t resource = SLOT_RESOURCES[access.slot];
+
+                if ( access.access == SlotAccess::Read )
+                    CHECK( contents[buffer] == current[resource] );
+                else if ( access.access == SlotAccess::ReadHistory && frame > 0 )
+                    CHECK( contents[buffer] == history[resource] );
+            }
+
+            for ( const auto& access: rotation.GetStageAccesses( stage ) )
+            {
+                if ( !IsWrite( access.access ) )
+                    continue;
+
+                const uint32_t buffer   = rotation.GetBuffer( frame, stage, access.slot );
+                const uint32_t resource = SLOT_RESOURCES[access.slot];
+                const Value    value    = { frame, static_cast<int>( stage ) };
+
+                contents[buffer]  = value;
+                current[resource] = value;
+                if ( access.access == SlotAccess::WriteHistory )
+                    nextHistory[resource] = value;
+            }
+        }
+
+        // The history has to survive until the next frame reads it.
+        const std::vector<uint32_t> historyBuffers = rotation.GetHistoryBuffers( frame );
+        for ( uint32_t resource = 0; resource < SVGF_RESOURCE_COUNT; ++resource )
+        {
+            if ( nextHistory[resource].stage < 0 )
+                continue;
+
+            bool kept = false;
+            for ( uint32_t buffer: historyBuffers )
+                kept |= contents[buffer] == nextHistory[resource];
+            CHECK( kept );
+        }
+
+        history = nextHistory;
+    }
+}
+
+TEST( SvgfRotation, BindingsRepeatWithThePeriod )
+{
+    ResourceRotation rotation;
+    SvgfStages       stages;
+    PlanRotation( rotation, stages );
+
+    const uint64_t first  = rotation.GetFirstPeriodicFrame();
+    const uint64_t period = rotation.GetFramePeriod();
+    REQUIRE( period > 0 );
+
+    for ( uint64_t frame = first; frame < first + 3 * period; ++frame )
+    {
+        for ( uint32_t stage = 0; stage < rotation.GetStageCount(); ++stage )
+            CHECK( rotation.GetBindingSet( frame, stage ) == rotation.GetBindingSet( frame + period, stage ) );
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+ *  A small test harness for CPULib, extern/ has no test framework.
+ *
+ *  TEST( Suite, Name ) defines and registers a test. CHECK records a failure
+ *  and carries on, REQUIRE returns from the test as well. CPULibTests runs
+ *  every test, or those of one suite when it is given as the argument.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+namespace cpulib
+{
+namespace test
+{
+
+using TestFunction = void ( * )();
+
+struct Registrar
+{
+    Registrar( const char* suite, const char* name, TestFunction function );
+};
+
+// Marks the running test as failed.
+void ReportFailure( const char* file, int line, const std::string& message );
+
+}  // namespace test
+}  // namespace cpulib
+
+#define TEST( suite, name )                                                                             \
+    static void suite##_##name();                                                                       \
+    static const cpulib::test::Registrar suite##_##name##_registrar( #suite, #name, &suite##_##name ); \
+    static void suite##_##name()
+
+#define CHECK( expression )                                                      \
+    do                                                                           \
+    {                                                                            \
+        if ( !( expression ) )                                                   \
+            cpulib::test::ReportFailure( __FILE__, __LINE__, #expression );      \
+    } while ( false )
+
+#define CHECK_NEAR( a, b, tolerance )                                                                  \
+    do                                                                                                 \
+    {                                                                                                  \
+        const double checkA = static_cast<double>( a ), checkB = static_cast<double>( b );             \
+        if ( !( std::fabs( checkA - checkB ) <= static_cast<double>( tolerance ) ) )                   \
+            cpulib::test::ReportFailure( __FILE__, __LINE__,                                           \
+                                         std::string( #a " ~= " #b ", " ) + std::to_string( checkA ) + \
+                                             " vs " + std::to_string( checkB ) );                      \
+    } while ( false )
+
+#define REQUIRE( expression )                                                    \
+    do                                                                           \
+    {                                                                            \
+        if ( !( expression ) )                                                   \
+        {                                                                        \
+            cpulib::test::ReportFailure( __FILE__, __LINE__, #expression );      \
+            return;                                                              \
+        }                                                                        \
+    } while ( false )
@@ -0,0 +1,79 @@
+/*
+ *  Runs the tests registered with TEST( Suite, Name ).
+ *
+ *  CPULibTests [suite]
+ *
+ *  Every test runs, or only those of the given suite. The exit code is 1 if
+ *  any of them failed or no test matched.
+ */
+
+#include "TestHarness.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+struct TestCase
+{
+    const char*        suite;
+    const char*        name;
+    test::TestFunction function;
+};
+
+// A function local, the registrars of other units may run before this one's statics.
+std::vector<TestCase>& GetTests()
+{
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+uint32_t g_Failures = 0;
+
+}  // namespace
+
+test::Registrar::Registrar( const char* suite, const char* name, TestFunction function )
+{
+    GetTests().push_back( { suite, name, function } );
+}
+
+void test::ReportFailure( const char* file, int line, const std::string& message )
+{
+    std::printf( "  %s(%d): failed: %s\n", file, line, message.c_str() );
+    ++g_Failures;
+}
+
+int main( int argc, char** argv )
+{
+    const char* suite = argc > 1 ? argv[1] : nullptr;
+
+    uint32_t run    = 0;
+    uint32_t failed = 0;
+    for ( const TestCase& test: GetTests() )
+    {
+        if ( suite && std::strcmp( suite, test.suite ) != 0 )
+            continue;
+
+        const uint32_t failuresBefore = g_Failures;
+        test.function();
+        ++run;
+
+        const bool passed = g_Failures == failuresBefore;
+        failed += passed ? 0 : 1;
+        std::printf( "%s %s.%s\n", passed ? "[  OK  ]" : "[FAILED]", test.suite, test.name );
+    }
+
+    if ( run == 0 )
+    {
+        std::printf( "No tests in suite %s\n", suite ? suite : "(all)" );
+        return 1;
+    }
+
+    std::printf( "%u of %u tests passed\n", run - failed, run );
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,222 @@
+/*
+ *  TlasInstanceTracker: the dirty instances joined into ranges over gaps of
+ *  mergeGap, and the choice between nothing, a refit and a rebuild as the
+ *  instances move and the refits add up.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/TlasInstanceTracker.h>
+
+#include <cmath>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+// A unit cube at x along the x axis, 6 of surface area.
+TlasBounds MakeCube( float x )
+{
+    TlasBounds bounds;
+    bounds.lower = float3( x, 0, 0 );
+    bounds.upper = float3( x + 1, 1, 1 );
+    return bounds;
+}
+
+std::vector<TlasBounds> MakeCubes( uint32_t count )
+{
+    std::vector<TlasBounds> bounds;
+    for ( uint32_t i = 0; i < count; ++i )
+        bounds.push_back( MakeCube( 2.0f * i ) );
+    return bounds;
+}
+
+bool IsRange( const TlasInstanceRange& range, uint32_t first, uint32_t count )
+{
+    return range.first == first && range.count == count;
+}
+
+}  // namespace
+
+TEST( TlasInstanceTracker, TransformBounds )
+{
+    // A quarter turn about z, then moved: x goes to y, y to -x.
+    float3x4 transform = {};
+    transform.m[0][1] = -1;
+    transform.m[1][0] = 1;
+    transform.m[2][2] = 2;
+    transform.m[0][3] = 10;
+    transform.m[1][3] = 20;
+    transform.m[2][3] = 30;
+
+    TlasBounds local;
+    local.lower = float3( 1, 2, 3 );
+    local.upper = float3( 4, 6, 5 );
+
+    const TlasBounds world = TransformBounds( transform, local );
+    CHECK( world.lower.x == 4 && world.upper.x == 8 );
+    CHECK( world.lower.y == 21 && world.upper.y == 24 );
+    CHECK( world.lower.z == 36 && world.upper.z == 40 );
+}
+
+TEST( TlasInstanceTracker, ResetDirtiesEverything )
+{
+    TlasInstanceTracker tracker;
+    tracker.Reset( MakeCubes( 50 ) );
+    CHECK( tracker.GetInstanceCount() == 50 );
+    CHECK( tracker.IsDirty() );
+    CHECK( tracker.GetUpdate() == TlasUpdate::Rebuild );
+
+    const std::vector<TlasInstanceRange> ranges = tracker.GetDirtyRanges();
+    REQUIRE( ranges.size() == 1 );
+    CHECK( IsRange( ranges[0], 0, 50 ) );
+
+    tracker.Commit( TlasUpdate::Rebuild );
+    CHECK( !tracker.IsDirty() );
+    CHECK( tracker.GetDirtyRanges().empty() );
+    CHECK( tracker.GetUpdate() == TlasUpdate::None );
+
+    // Even without an instance, the first build is a rebuild.
+    TlasInstanceTracker empty;
+    empty.Reset( {} );
+    CHECK( empty.GetUpdate() == TlasUpdate::Rebuild );
+    CHECK( empty.GetDirtyRanges().empty() );
+}
+
+TEST( TlasInstanceTracker, DirtyRangesMerge )
+{
+    TlasInstanceTracker tracker;
+    tracker.Reset( MakeCubes( 100 ) );
+    tracker.Commit( TlasUpdate::Rebuild );
+
+    // Marked out of order and twice, with gaps of 1, 2, 4, 4, then 5 and more clean instances in between.
+    for ( uint32_t instance: { 31u, 12u, 10u, 20u, 15u, 10u, 25u, 80u, 99u } )
+        tracker.MarkDirty( instance );
+
+    std::vector<TlasInstanceRange> ranges = tracker.GetDirtyRanges();
+    REQUIRE( ranges.size() == 4 );
+    CHECK( IsRange( ranges[0], 10, 16 ) );
+    CHECK( IsRange( ranges[1], 31, 1 ) );
+    CHECK( IsRange( ranges[2], 80, 1 ) );
+    CHECK( IsRange( ranges[3], 99, 1 ) );
+
+    // Without a gap only neighbours join.
+    TlasTrackerSettings settings;
+    settings.mergeGap = 0;
+    tracker.SetSettings( settings );
+
+    ranges = tracker.GetDirtyRanges();
+    REQUIRE( ranges.size() == 8 );
+    CHECK( IsRange( ranges[0], 10, 1 ) );
+    CHECK( IsRange( ranges[1], 12, 1 ) );
+
+    tracker.MarkDirty( 11 );
+    tracker.MarkDirty( 13 );
+    ranges = tracker.GetDirtyRanges();
+    REQUIRE( ranges.size() == 7 );
+    CHECK( IsRange( ranges[0], 10, 4 ) );
+    CHECK( IsRange( ranges[1], 15, 1 ) );
+
+    // A large gap writes everything in one range.
+    settings.mergeGap = 100;
+    tracker.SetSettings( settings );
+    ranges = tracker.GetDirtyRanges();
+    REQUIRE( ranges.size() == 1 );
+    CHECK( IsRange( ranges[0], 10, 90 ) );
+
+    // Committed, nothing is left to write.
+    tracker.Commit( TlasUpdate::Refit );
+    CHECK( tracker.GetDirtyRanges().empty() );
+}
+
+TEST( TlasInstanceTracker, RefitUntilDegraded )
+{
+    // Ten cubes, 60 of area. A cube moved by its own size joins to 2 x 1 x 1, 4 more.
+    TlasTrackerSettings settings;
+    settings.refitDegradation = 0.15f;
+
+    TlasInstanceTracker tracker( settings );
+    tracker.Reset( MakeCubes( 10 ) );
+    tracker.Commit( TlasUpdate::Rebuild );
+    CHECK( tracker.GetDegradation() == 0 );
+
+    // A change that doesn't move anything is a refit.
+    tracker.MarkDirty( 3 );
+    CHECK( tracker.GetUpdate() == TlasUpdate::Refit );
+    tracker.Commit( TlasUpdate::Refit );
+    CHECK( tracker.GetRefitCount() == 1 );
+
+    tracker.SetBounds( 0, MakeCube( 1.0f ) );
+    CHECK_NEAR( tracker.GetDegradation(), 4.0f / 60, 1e-6f );
+    CHECK( tracker.GetUpdate() == TlasUpdate::Refit );
+    tracker.Commit( TlasUpdate::Refit );
+
+    // Measured from the last rebuild: the refit doesn't reset it, and moving on grows it.
+    CHECK_NEAR( tracker.GetDegradation(), 4.0f / 60, 1e-6f );
+    tracker.SetBounds( 0, MakeCube( 2.0f ) );
+    CHECK_NEAR( tracker.GetDegradation(), 8.0f / 60, 1e-6f );
+    CHECK( tracker.GetUpdate() == TlasUpdate::Refit );
+    tracker.Commit( TlasUpdate::Refit );
+
+    // A second cube pushes it past refitDegradation.
+    tracker.SetBounds( 5, MakeCube( 11.0f ) );
+    CHECK_NEAR( tracker.GetDegradation(), 12.0f / 60, 1e-6f );
+    CHECK( tracker.GetUpdate() == TlasUpdate::Rebuild );
+    tracker.Commit( TlasUpdate::Rebuild );
+
+    // The rebuild measures from where the cubes are now.
+    CHECK( tracker.GetRefitCount() == 0 );
+    CHECK( tracker.GetDegradation() == 0 );
+    CHECK( tracker.GetUpdate() == TlasUpdate::None );
+
+    // Back where they were at the rebuild, nothing is lost.
+    tracker.SetBounds( 5, MakeCube( 12.0f ) );
+    tracker.SetBounds( 5, MakeCube( 11.0f ) );
+    CHECK_NEAR( tracker.GetDegradation(), 0.0f, 1e-6f );
+    CHECK( tracker.GetUpdate() == TlasUpdate::Refit );
+}
+
+TEST( TlasInstanceTracker, MaxRefits )
+{
+    TlasTrackerSettings settings;
+    settings.maxRefits = 3;
+
+    TlasInstanceTracker tracker( settings );
+    tracker.Reset( MakeCubes( 4 ) );
+    tracker.Commit( TlasUpdate::Rebuild );
+
+    // Nothing degrades, but the fourth build in a row is a rebuild.
+    for ( uint32_t build = 0; build < 3; ++build )
+    {
+        tracker.MarkDirty( build );
+        CHECK( tracker.GetUpdate() == TlasUpdate::Refit );
+        tracker.Commit( TlasUpdate::Refit );
+        CHECK( tracker.GetRefitCount() == build + 1 );
+    }
+
+    // A frame without changes doesn't count.
+    CHECK( tracker.GetUpdate() == TlasUpdate::None );
+    tracker.Commit( TlasUpdate::None );
+    CHECK( tracker.GetRefitCount() == 3 );
+
+    tracker.MarkDirty( 0 );
+    CHECK( tracker.GetUpdate() == TlasUpdate::Rebuild );
+    tracker.Commit( TlasUpdate::Rebuild );
+    CHECK( tracker.GetRefitCount() == 0 );
+
+    tracker.MarkDirty( 0 );
+    CHECK( tracker.GetUpdate() == TlasUpdate::Refit );
+
+    // Without a limit it refits for as long as nothing degrades.
+    settings.maxRefits = 0;
+    tracker.SetSettings( settings );
+    for ( uint32_t build = 0; build < 100; ++build )
+    {
+        tracker.MarkDirty( build % 4 );
+        CHECK( tracker.GetUpdate() == TlasUpdate::Refit );
+        tracker.Commit( TlasUpdate::Refit );
+    }
+    CHECK( tracker.GetRefitCount() == 100 );
+}
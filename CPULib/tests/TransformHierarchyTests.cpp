@@ -0,0 +1,154 @@
+/*
+ *  TransformHierarchy: the world transforms of parents and children composed
+ *  in order, with their inverses, and SetLocal recomputing the dirty node and
+ *  everything below it but nothing else.
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/TransformHierarchy.h>
+
+#include <cmath>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+float3x4 MakeTranslation( float x, float y, float z )
+{
+    float3x4 transform = IdentityTransform();
+    transform.m[0][3]  = x;
+    transform.m[1][3]  = y;
+    transform.m[2][3]  = z;
+    return transform;
+}
+
+float3x4 MakeScaling( float scale )
+{
+    float3x4 transform = {};
+    transform.m[0][0]  = scale;
+    transform.m[1][1]  = scale;
+    transform.m[2][2]  = scale;
+    return transform;
+}
+
+// A quarter turn about z: x goes to y, y to -x.
+float3x4 MakeQuarterTurn()
+{
+    float3x4 transform = {};
+    transform.m[0][1]  = -1;
+    transform.m[1][0]  = 1;
+    transform.m[2][2]  = 1;
+    return transform;
+}
+
+bool IsNear( const float3& a, const float3& b )
+{
+    return std::fabs( a.x - b.x ) < 1e-5f && std::fabs( a.y - b.y ) < 1e-5f && std::fabs( a.z - b.z ) < 1e-5f;
+}
+
+// Where the world transform of node puts the point p.
+float3 ToWorld( const TransformHierarchy& hierarchy, uint32_t node, const float3& p )
+{
+    return mul( hierarchy.GetWorld( node ), p.x, p.y, p.z, 1 );
+}
+
+std::vector<uint32_t> GetUpdated( const TransformHierarchy& hierarchy )
+{
+    std::vector<uint32_t> updated;
+    for ( uint32_t node = 0; node < hierarchy.GetNodeCount(); ++node )
+    {
+        if ( hierarchy.IsUpdated( node ) )
+            updated.push_back( node );
+    }
+    return updated;
+}
+
+}  // namespace
+
+TEST( TransformHierarchy, ParentBeforeChild )
+{
+    // A root scaled by 2, a child turned and moved along x under it, and a grandchild moved along x under that.
+    const float3x4 turnedAndMoved = MulTransforms( MakeTranslation( 1, 0, 0 ), MakeQuarterTurn() );
+
+    TransformHierarchy hierarchy;
+    const uint32_t     root       = hierarchy.AddNode( TRANSFORM_NO_PARENT, MakeScaling( 2 ) );
+    const uint32_t     child      = hierarchy.AddNode( root, turnedAndMoved );
+    const uint32_t     grandchild = hierarchy.AddNode( child, MakeTranslation( 3, 0, 0 ) );
+    CHECK( hierarchy.GetParent( grandchild ) == child );
+    CHECK( hierarchy.IsDirty() );
+
+    CHECK( hierarchy.Update() == 3 );
+    CHECK( !hierarchy.IsDirty() );
+
+    // The grandchild origin: 3 along x, turned onto y, moved by 1 along x, then scaled by 2.
+    CHECK( IsNear( ToWorld( hierarchy, grandchild, float3( 0, 0, 0 ) ), float3( 2, 6, 0 ) ) );
+    CHECK( IsNear( ToWorld( hierarchy, grandchild, float3( 1, 0, 0 ) ), float3( 2, 8, 0 ) ) );
+    CHECK( IsNear( ToWorld( hierarchy, child, float3( 0, 1, 0 ) ), float3( 0, 0, 0 ) ) );
+
+    // The inverse takes the points back, the normal matrix undoes the scale of the root.
+    const float3 back = mul( hierarchy.GetInverseWorld( grandchild ), 2, 8, 0, 1 );
+    CHECK( IsNear( back, float3( 1, 0, 0 ) ) );
+    const float3 normal = mul( hierarchy.GetNormal( grandchild ), 1, 0, 0, 0 );
+    CHECK( IsNear( normal, float3( 0, 0.5f, 0 ) ) );
+
+    // WriteWorlds copies the same matrices, at any stride.
+    struct Instance
+    {
+        float3x4 transform;
+        uint32_t id;
+    };
+    Instance instances[2] = {};
+    hierarchy.WriteWorlds( child, 2, &instances[0].transform, sizeof( Instance ) );
+    CHECK( IsNear( mul( instances[1].transform, 0, 0, 0, 1 ), float3( 2, 6, 0 ) ) );
+    CHECK( instances[0].id == 0 && instances[1].id == 0 );
+}
+
+TEST( TransformHierarchy, DirtyGoesDown )
+{
+    // Two subtrees under a root: 1 with 2 and 3 below it, 4 with 5 below it.
+    TransformHierarchy hierarchy;
+    hierarchy.AddNode( TRANSFORM_NO_PARENT, IdentityTransform() );
+    hierarchy.AddNode( 0, MakeTranslation( 1, 0, 0 ) );
+    hierarchy.AddNode( 1, MakeTranslation( 0, 1, 0 ) );
+    hierarchy.AddNode( 2, MakeTranslation( 0, 0, 1 ) );
+    hierarchy.AddNode( 0, MakeTranslation( -1, 0, 0 ) );
+    hierarchy.AddNode( 4, MakeTranslation( 0, -1, 0 ) );
+    CHECK( hierarchy.Update() == 6 );
+    CHECK( GetUpdated( hierarchy ).size() == 6 );
+
+    // Nothing moved, nothing recomputed, and the last flags are cleared.
+    CHECK( hierarchy.Update() == 0 );
+    CHECK( GetUpdated( hierarchy ).empty() );
+
+    // Moving 1 moves 2 and 3 with it, the other subtree stays.
+    hierarchy.SetLocal( 1, MakeTranslation( 5, 0, 0 ) );
+    CHECK( hierarchy.IsDirty() );
+    CHECK( hierarchy.Update() == 3 );
+    CHECK( GetUpdated( hierarchy ) == std::vector<uint32_t>( { 1, 2, 3 } ) );
+    CHECK( IsNear( ToWorld( hierarchy, 3, float3( 0, 0, 0 ) ), float3( 5, 1, 1 ) ) );
+    CHECK( IsNear( ToWorld( hierarchy, 5, float3( 0, 0, 0 ) ), float3( -1, -1, 0 ) ) );
+
+    // Two dirty nodes in one subtree, the one below the other counts once.
+    hierarchy.SetLocal( 5, MakeTranslation( 0, -2, 0 ) );
+    hierarchy.SetLocal( 4, MakeTranslation( -3, 0, 0 ) );
+    CHECK( hierarchy.Update() == 2 );
+    CHECK( GetUpdated( hierarchy ) == std::vector<uint32_t>( { 4, 5 } ) );
+    CHECK( IsNear( ToWorld( hierarchy, 5, float3( 0, 0, 0 ) ), float3( -3, -2, 0 ) ) );
+
+    // The root moves everything.
+    hierarchy.SetLocal( 0, MakeTranslation( 0, 0, 10 ) );
+    CHECK( hierarchy.Update() == 6 );
+    CHECK( IsNear( ToWorld( hierarchy, 3, float3( 0, 0, 0 ) ), float3( 5, 1, 11 ) ) );
+
+    // A node added later is dirty on its own.
+    const uint32_t added = hierarchy.AddNode( 2, MakeTranslation( 1, 1, 1 ) );
+    CHECK( hierarchy.Update() == 1 );
+    CHECK( GetUpdated( hierarchy ) == std::vector<uint32_t>( { added } ) );
+    CHECK( IsNear( ToWorld( hierarchy, added, float3( 0, 0, 0 ) ), float3( 6, 2, 11 ) ) );
+
+    hierarchy.Clear();
+    CHECK( hierarchy.GetNodeCount() == 0 && !hierarchy.IsDirty() );
+}
@@ -0,0 +1,222 @@
+/*
+ *  PackVertex and UnpackVertex: the layout, the half conversion, and the
+ *  quantisation error on normals, tangents, bitangents and texture
+ *  coordinates, inside and outside [0, 1].
+ */
+
+#include "TestHarness.h"
+
+#include <cpulib/VertexCodec.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+float AngleDegrees( float3 a, float3 b )
+{
+    a = normalize( a );
+    b = normalize( b );
+    return std::atan2( length( cross( a, b ) ), dot( a, b ) ) * ( 180.0f / PI );
+}
+
+FullVertex MakeVertex( float3 normal, float3 tangent, float sign, float u, float v )
+{
+    FullVertex vertex;
+    vertex.position  = float3( 1.5f, -2.25f, 1e6f );
+    vertex.normal    = normalize( normal );
+    vertex.tangent   = normalize( tangent );
+    vertex.bitangent = cross( vertex.normal, vertex.tangent ) * sign;
+    vertex.texCoord  = float3( u, v, 7 );
+    return vertex;
+}
+
+}  // namespace
+
+TEST( VertexCodec, Layout )
+{
+    CHECK( offsetof( PackedVertex, normal ) == PACKED_VERTEX_NORMAL_OFFSET );
+    CHECK( offsetof( PackedVertex, tangent ) == PACKED_VERTEX_TANGENT_OFFSET );
+    CHECK( offsetof( PackedVertex, texCoord ) == PACKED_VERTEX_TEXCOORD_OFFSET );
+}
+
+TEST( VertexCodec, HalfConversion )
+{
+    // Every half comes back as itself, NaNs as a NaN.
+    for ( uint32_t bits = 0; bits < 0x10000u; ++bits )
+    {
+        const float    v    = VertexHalfToFloat( bits );
+        const uint32_t back = VertexFloatToHalf( v );
+        if ( v != v )
+            CHECK( ( back & 0x7C00u ) == 0x7C00u && ( back & 0x3FFu ) != 0 );
+        else
+            CHECK( back == bits );
+    }
+
+    CHECK( VertexFloatToHalf( 1.0f ) == 0x3C00u );
+    CHECK( VertexFloatToHalf( -2.0f ) == 0xC000u );
+    CHECK( VertexFloatToHalf( 65504.0f ) == 0x7BFFu );
+    // The smallest denormal, and half of it rounds to even, to zero.
+    CHECK( VertexFloatToHalf( std::ldexp( 1.0f, -24 ) ) == 0x0001u );
+    CHECK( VertexFloatToHalf( std::ldexp( 1.0f, -25 ) ) == 0x0000u );
+
+    // Ties go to the even mantissa: 1 + 2^-11 is halfway between 1 and the next half.
+    CHECK( VertexFloatToHalf( 1.0f + std::ldexp( 1.0f, -11 ) ) == 0x3C00u );
+    CHECK( VertexFloatToHalf( 1.0f + 3 * std::ldexp( 1.0f, -11 ) ) == 0x3C02u );
+
+    // Past the range is infinity.
+    CHECK( VertexFloatToHalf( 65520.0f ) == 0x7C00u );
+    CHECK( VertexFloatToHalf( -1e10f ) == 0xFC00u );
+    CHECK( VertexFloatToHalf( std::numeric_limits<float>::infinity() ) == 0x7C00u );
+}
+
+TEST( VertexCodec, GeneratedFrames )
+{
+    std::vector<FullVertex> vertices( 100000 );
+    GenerateVertexFrames( static_cast<uint32_t>( vertices.size() ), 1.0f, vertices.data() );
+
+    const VertexPackingError error = MeasureVertexPacking( vertices.data(), static_cast<uint32_t>( vertices.size() ) );
+    std::string              why;
+    CHECK( CheckVertexPacking( error, &why ) );
+    CHECK( error.samples == vertices.size() );
+    CHECK( error.positionMismatches == 0 );
+    CHECK( error.bitangentSignFlips == 0 );
+
+    // The quantisation is there, and well inside the bounds on average.
+    CHECK( error.maxNormalDegrees > 0 );
+    CHECK( error.meanNormalDegrees < VERTEX_PACKING_MAX_NORMAL_DEGREES / 2 );
+    CHECK( error.meanTangentDegrees < VERTEX_PACKING_MAX_TANGENT_DEGREES / 2 );
+    CHECK( error.maxBitangentDegrees <= VERTEX_PACKING_MAX_NORMAL_DEGREES + VERTEX_PACKING_MAX_TANGENT_DEGREES );
+}
+
+TEST( VertexCodec, NormalsAndTangents )
+{
+    // The axes are grid points of both octahedral grids.
+    const float3 axes[] = { float3( 0, 0, 1 ),  float3( 0, 0, -1 ), float3( 1, 0, 0 ),
+                            float3( -1, 0, 0 ), float3( 0, 1, 0 ),  float3( 0, -1, 0 ) };
+    for ( const float3& axis: axes )
+    {
+        const float3 n = VertexDecodeNormal( VertexEncodeNormal( axis ) );
+        const float3 t = VertexDecodeTangent( VertexEncodeTangent( float3( 0, 0, 1 ), axis, float3( 0, 1, 0 ) ) );
+        CHECK( n.x == axis.x && n.y == axis.y && n.z == axis.z );
+        CHECK( t.x == axis.x && t.y == axis.y && t.z == axis.z );
+    }
+
+    // Near the poles and the seams of the lower hemisphere, for both bitangent signs.
+    for ( float z = -1.0f; z <= 1.0f; z += 1.0f / 64 )
+    {
+        for ( float side: { -1e-6f, 0.0f, 1e-6f, 0.3f } )
+        {
+            const float3     normal  = normalize( float3( side, std::sqrt( std::max( 0.0f, 1.0f - z * z ) ), z ) );
+            const float3     tangent = float3( 1, 0, 0 ) - normal * normal.x;
+            const float      sign    = side < 0 ? -1.0f : 1.0f;
+            const FullVertex v       = MakeVertex( normal, tangent, sign, 0.5f, 0.25f );
+            const FullVertex u       = UnpackVertex( PackVertex( v ) );
+
+            CHECK( AngleDegrees( v.normal, u.normal ) <= VERTEX_PACKING_MAX_NORMAL_DEGREES );
+            CHECK( AngleDegrees( v.tangent, u.tangent ) <= VERTEX_PACKING_MAX_TANGENT_DEGREES );
+            CHECK( AngleDegrees( v.bitangent, u.bitangent ) <=
+                   VERTEX_PACKING_MAX_NORMAL_DEGREES + VERTEX_PACKING_MAX_TANGENT_DEGREES );
+            CHECK( std::abs( length( u.normal ) - 1 ) < 1e-6f );
+            CHECK( std::abs( length( u.tangent ) - 1 ) < 1e-6f );
+
+            // Position exactly, texCoord.z dropped.
+            CHECK( std::memcmp( &u.position, &v.position, sizeof( float3 ) ) == 0 );
+            CHECK( u.texCoord.z == 0 );
+        }
+    }
+}
+
+TEST( VertexCodec, MissingTangents )
+{
+    // A mesh without tangents: zero tangent and bitangent, which come back as +z and are not measured.
+    FullVertex v = MakeVertex( float3( 0, 1, 0 ), float3( 1, 0, 0 ), 1, 0, 0 );
+    v.tangent    = float3( 0.0f );
+    v.bitangent  = float3( 0.0f );
+
+    const FullVertex u = UnpackVertex( PackVertex( v ) );
+    CHECK( u.tangent.x == 0 && u.tangent.y == 0 && u.tangent.z == 1 );
+
+    const VertexPackingError error = MeasureVertexPacking( &v, 1 );
+    CHECK( error.maxTangentDegrees == 0 );
+    CHECK( CheckVertexPacking( error ) );
+}
+
+TEST( VertexCodec, TexCoordsInsideTheUnitSquare )
+{
+    // Below 1 the error is absolute, half a step of the half with exponent -1 at most.
+    for ( int i = 0; i <= 4096; ++i )
+    {
+        const float      uv = i / 4096.0f;
+        const FullVertex v  = MakeVertex( float3( 0, 0, 1 ), float3( 1, 0, 0 ), 1, uv, 1 - uv );
+        const FullVertex u  = UnpackVertex( PackVertex( v ) );
+        CHECK_NEAR( u.texCoord.x, uv, std::ldexp( 1.0f, -12 ) );
+        CHECK_NEAR( u.texCoord.y, 1 - uv, std::ldexp( 1.0f, -12 ) );
+    }
+
+    // Powers of two and their halves are exact.
+    for ( float uv: { 0.0f, 0.5f, 0.25f, 0.125f, 1.0f } )
+    {
+        const FullVertex v = MakeVertex( float3( 0, 0, 1 ), float3( 1, 0, 0 ), 1, uv, -uv );
+        const FullVertex u = UnpackVertex( PackVertex( v ) );
+        CHECK( u.texCoord.x == uv && u.texCoord.y == -uv );
+    }
+}
+
+TEST( VertexCodec, TexCoordsOutsideTheUnitSquare )
+{
+    // Tiling coordinates: the error grows with the coordinate, 2^-11 of it.
+    for ( float range: { 2.0f, 16.0f, 300.0f, 4096.0f, 60000.0f } )
+    {
+        std::vector<FullVertex> vertices( 4096 );
+        GenerateVertexFrames( static_cast<uint32_t>( vertices.size() ), range, vertices.data() );
+
+        const VertexPackingError error =
+            MeasureVertexPacking( vertices.data(), static_cast<uint32_t>( vertices.size() ) );
+        CHECK( error.maxTexCoordRelative <= VERTEX_PACKING_MAX_TEXCOORD_RELATIVE );
+        CHECK( CheckVertexPacking( error ) );
+
+        for ( const FullVertex& v: vertices )
+        {
+            const FullVertex u = UnpackVertex( PackVertex( v ) );
+            for ( int c = 0; c < 2; ++c )
+            {
+                CHECK( std::abs( u.texCoord[c] - v.texCoord[c] ) <=
+                       std::max( std::abs( v.texCoord[c] ), 1.0f ) * VERTEX_PACKING_MAX_TEXCOORD_RELATIVE );
+            }
+        }
+    }
+
+    // Past the half range the coordinate is lost, CheckVertexPacking says so.
+    const FullVertex far = MakeVertex( float3( 0, 0, 1 ), float3( 1, 0, 0 ), 1, 70000.0f, 0.5f );
+    const FullVertex u   = UnpackVertex( PackVertex( far ) );
+    CHECK( std::isinf( u.texCoord.x ) );
+
+    std::string why;
+    CHECK( !CheckVertexPacking( MeasureVertexPacking( &far, 1 ), &why ) );
+    CHECK( why.find( "texture coordinate" ) != std::string::npos );
+}
+
+TEST( VertexCodec, HandednessSurvives )
+{
+    std::vector<FullVertex> vertices( 1000 );
+    GenerateVertexFrames( static_cast<uint32_t>( vertices.size() ), 1.0f, vertices.data() );
+
+    for ( const FullVertex& v: vertices )
+    {
+        const PackedVertex packed = PackVertex( v );
+        const FullVertex   u      = UnpackVertex( packed );
+
+        const bool flipped = dot( cross( v.normal, v.tangent ), v.bitangent ) < 0;
+        CHECK( ( ( packed.tangent & PACKED_VERTEX_BITANGENT_SIGN ) != 0 ) == flipped );
+        CHECK( dot( u.bitangent, v.bitangent ) > 0.99f );
+    }
+}
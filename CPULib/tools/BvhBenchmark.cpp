@@ -0,0 +1,165 @@
+/*
+ *  Builds the CPU BVH over the meshes of cooked scenes and prints how long
+ *  that took and how good the tree is.
+ *
+ *  BvhBenchmark [-threads <count>] [-bins <count>] [-leaf <count>] [-runs <count>] <file.cooked>...
+ *
+ *  Every scene is built on one thread and on -threads threads, all of them by
+ *  default, each the fastest of -runs builds, 3 by default. The two trees are
+ *  checked to be valid and the same. The exit code is the number of files that
+ *  failed.
+ */
+
+#include <cpulib/Bvh.h>
+#include <cpulib/CookedScene.h>
+#include <cpulib/ThreadPool.h>
+#include <cpulib/VertexCodec.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+BvhBuildStats BuildFastest( ThreadPool& pool, const std::vector<MeshGeometry>& meshes, const BvhBuildOptions& options,
+                            uint32_t runs, Bvh& bvh )
+{
+    BvhBuildStats best;
+    for ( uint32_t run = 0; run < runs; ++run )
+    {
+        const BvhBuildStats stats = bvh.Build( pool, meshes, options );
+        if ( run == 0 || stats.seconds < best.seconds )
+        {
+            best = stats;
+        }
+    }
+    return best;
+}
+
+bool SameTree( const Bvh& a, const Bvh& b )
+{
+    const auto& nodesA = a.GetNodes();
+    const auto& nodesB = b.GetNodes();
+    return nodesA.size() == nodesB.size() &&
+           std::memcmp( nodesA.data(), nodesB.data(), nodesA.size() * sizeof( BvhNode ) ) == 0;
+}
+
+void Print( const char* name, const BvhBuildStats& stats )
+{
+    std::printf( "    %-9s %9.1f ms (%.1f ms top levels, %u tasks)\n", name, stats.seconds * 1000.0,
+                 stats.topSeconds * 1000.0, stats.tasks );
+}
+
+}  // namespace
+
+int main( int argc, char* argv[] )
+{
+    BvhBuildOptions options;
+    uint32_t        threadCount = 0;
+    uint32_t        runs        = 3;
+
+    std::vector<const char*> files;
+    for ( int i = 1; i < argc; ++i )
+    {
+        const bool hasValue = i + 1 < argc;
+        if ( std::strcmp( argv[i], "-threads" ) == 0 && hasValue )
+        {
+            threadCount = static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) );
+        }
+        else if ( std::strcmp( argv[i], "-bins" ) == 0 && hasValue )
+        {
+            options.binCount = static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) );
+        }
+        else if ( std::strcmp( argv[i], "-leaf" ) == 0 && hasValue )
+        {
+            options.maxLeafSize = std::max( static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) ), 1u );
+        }
+        else if ( std::strcmp( argv[i], "-runs" ) == 0 && hasValue )
+        {
+            runs = std::max( static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) ), 1u );
+        }
+        else if ( argv[i][0] == '-' )
+        {
+            files.clear();
+            break;
+        }
+        else
+        {
+            files.push_back( argv[i] );
+        }
+    }
+
+    if ( files.empty() )
+    {
+        std::printf( "usage: BvhBenchmark [-threads <count>] [-bins <count>] [-leaf <count>] [-runs <count>] "
+                     "<file.cooked>...\n" );
+        return 1;
+    }
+
+    ThreadPool single( 1 );
+    ThreadPool pool( threadCount );
+
+    int failures = 0;
+    for ( const char* fileName: files )
+    {
+        CookedScene scene;
+        std::string error;
+        if ( !scene.Open( fileName, &error ) )
+        {
+            std::printf( "%s: FAILED, %s\n", fileName, error.c_str() );
+            ++failures;
+            continue;
+        }
+
+        const bool packed = scene.GetHeader().vertexStride == sizeof( PackedVertex );
+
+        std::vector<MeshGeometry> meshes( scene.GetMeshCount() );
+        for ( uint32_t m = 0; m < scene.GetMeshCount(); ++m )
+        {
+            const CookedMesh& mesh = scene.GetMesh( m );
+
+            meshes[m].vertices    = scene.GetVertices( mesh );
+            meshes[m].vertexCount = mesh.vertexCount;
+            meshes[m].packed      = packed;
+            meshes[m].indices     = scene.GetIndices( mesh );
+            meshes[m].indexCount  = mesh.indexCount;
+            meshes[m].indexSize   = mesh.indexSize;
+        }
+
+        Bvh                 singleBvh;
+        Bvh                 parallelBvh;
+        const BvhBuildStats singleStats   = BuildFastest( single, meshes, options, runs, singleBvh );
+        const BvhBuildStats parallelStats = BuildFastest( pool, meshes, options, runs, parallelBvh );
+
+        const bool valid = singleBvh.Validate( &error ) && parallelBvh.Validate( &error );
+        const bool same  = SameTree( singleBvh, parallelBvh );
+
+        if ( !valid || !same )
+        {
+            std::printf( "%s: FAILED, %s\n", fileName, !valid ? error.c_str() : "the trees differ" );
+            ++failures;
+        }
+        else
+        {
+            std::printf( "%s: ok\n", fileName );
+        }
+        std::printf( "    %u meshes, %u triangles, %u bins, leaves of up to %u\n", scene.GetMeshCount(),
+                     parallelStats.triangles, options.binCount, options.maxLeafSize );
+        std::printf( "    %u nodes, %u leaves, depth %u, SAH cost %.2f, %.1f MB\n", parallelStats.nodes,
+                     parallelStats.leaves, parallelStats.maxDepth, parallelStats.sahCost,
+                     parallelStats.memoryBytes / ( 1024.0 * 1024.0 ) );
+        Print( "1 thread", singleStats );
+        Print( ( std::to_string( pool.GetThreadCount() ) + " threads" ).c_str(), parallelStats );
+        std::printf( "    %.1fx faster, %.1f M triangles/s\n",
+                     singleStats.seconds / std::max( parallelStats.seconds, 1e-9 ),
+                     parallelStats.triangles / std::max( parallelStats.seconds, 1e-9 ) * 1e-6 );
+    }
+
+    return failures;
+}
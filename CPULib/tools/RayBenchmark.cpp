@@ -0,0 +1,356 @@
+/*
+ *  Traces rays through the wide CPU BVH of cooked scenes and prints the
+ *  Mrays/s of the three kinds of ray TraceFullPath traces:
+ *
+ *      primary     closest hit, a pinhole camera at the center of the scene
+ *                  looking along its longest horizontal axis
+ *      shadow      any hit, from every primary hit towards a point light
+ *                  just under the top of the scene
+ *      diffuse     closest hit, from every primary hit in a cosine weighted
+ *                  direction about the normal
+ *
+ *  RayBenchmark [-threads <count>] [-width <pixels>] [-height <pixels>] [-verify <rays>] <file.cooked>...
+ *
+ *  Every kind is traced on one thread and on -threads threads, all of them
+ *  by default, 1280x720 primary rays by default. -verify checks that many
+ *  rays of each kind, 256 by default, against testing every triangle. The
+ *  exit code is the number of files that failed.
+ */
+
+#include <cpulib/Bvh.h>
+#include <cpulib/CookedScene.h>
+#include <cpulib/ThreadPool.h>
+#include <cpulib/VertexCodec.h>
+#include <cpulib/WideBvh.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+// Rays per ParallelFor task.
+const uint32_t BATCH_SIZE = 4096;
+
+struct RaySet
+{
+    const char*          name;
+    bool                 anyHit;
+    std::vector<RayDesc> rays;
+};
+
+double Seconds( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// A uniform float in [0, 1) from a ray index and a dimension.
+float Random( uint32_t index, uint32_t dimension )
+{
+    uint32_t h = index * 747796405u + dimension * 2891336453u + 1u;
+    h          = ( ( h >> ( ( h >> 28u ) + 4u ) ) ^ h ) * 277803737u;
+    h          = ( h >> 22u ) ^ h;
+    return ( h >> 8 ) * ( 1.0f / 16777216.0f );
+}
+
+float3 GeometricNormal( const BvhTriangle& triangle )
+{
+    const float3 n = cross( triangle.v1 - triangle.v0, triangle.v2 - triangle.v0 );
+    return dot( n, n ) > 0.0f ? normalize( n ) : float3( 0.0f, 1.0f, 0.0f );
+}
+
+// Any two axes perpendicular to n.
+void Basis( float3 n, float3& tangent, float3& bitangent )
+{
+    const float3 up = std::abs( n.y ) < 0.999f ? float3( 0.0f, 1.0f, 0.0f ) : float3( 1.0f, 0.0f, 0.0f );
+    tangent         = normalize( cross( up, n ) );
+    bitangent       = cross( n, tangent );
+}
+
+// Trace rays in batches on pool, returns seconds.
+double Trace( ThreadPool& pool, const WideBvh& bvh, const RaySet& set, std::vector<RayHit>& hits,
+              std::vector<uint8_t>& occluded )
+{
+    const uint32_t count   = static_cast<uint32_t>( set.rays.size() );
+    const uint32_t batches = ( count + BATCH_SIZE - 1 ) / BATCH_SIZE;
+    hits.resize( set.anyHit ? 0 : count );
+    occluded.resize( set.anyHit ? count : 0 );
+
+    const auto start = std::chrono::steady_clock::now();
+    pool.ParallelFor( batches, [&]( uint32_t batch ) {
+        const uint32_t end = std::min( ( batch + 1 ) * BATCH_SIZE, count );
+        for ( uint32_t i = batch * BATCH_SIZE; i < end; ++i )
+        {
+            if ( set.anyHit )
+            {
+                occluded[i] = bvh.Occluded( set.rays[i] ) ? 1 : 0;
+            }
+            else
+            {
+                bvh.Intersect( set.rays[i], hits[i] );
+            }
+        }
+    } );
+    return Seconds( start );
+}
+
+// Möller-Trumbore against every triangle, the closest t or -1 for a miss, or as soon as anything is hit.
+float BruteForce( const Bvh& bvh, const RayDesc& ray, bool anyHit )
+{
+    float closest = -1.0f;
+    for ( const BvhTriangle& triangle: bvh.GetTriangles() )
+    {
+        const float3 e1  = triangle.v1 - triangle.v0;
+        const float3 e2  = triangle.v2 - triangle.v0;
+        const float3 p   = cross( ray.direction, e2 );
+        const float  det = dot( e1, p );
+        if ( det == 0.0f )
+        {
+            continue;
+        }
+
+        const float  invDet = 1.0f / det;
+        const float3 s      = ray.origin - triangle.v0;
+        const float3 q      = cross( s, e1 );
+        const float  u      = dot( s, p ) * invDet;
+        const float  v      = dot( ray.direction, q ) * invDet;
+        const float  t      = dot( e2, q ) * invDet;
+
+        if ( u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= ray.tMin && t <= ray.tMax &&
+             ( closest < 0.0f || t < closest ) )
+        {
+            closest = t;
+            if ( anyHit )
+            {
+                break;
+            }
+        }
+    }
+    return closest;
+}
+
+}  // namespace
+
+int main( int argc, char* argv[] )
+{
+    uint32_t threadCount = 0;
+    uint32_t width       = 1280;
+    uint32_t height      = 720;
+    uint32_t verifyCount = 256;
+
+    std::vector<const char*> files;
+    for ( int i = 1; i < argc; ++i )
+    {
+        const bool hasValue = i + 1 < argc;
+        if ( std::strcmp( argv[i], "-threads" ) == 0 && hasValue )
+        {
+            threadCount = static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) );
+        }
+        else if ( std::strcmp( argv[i], "-width" ) == 0 && hasValue )
+        {
+            width = std::max( static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) ), 1u );
+        }
+        else if ( std::strcmp( argv[i], "-height" ) == 0 && hasValue )
+        {
+            height = std::max( static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) ), 1u );
+        }
+        else if ( std::strcmp( argv[i], "-verify" ) == 0 && hasValue )
+        {
+            verifyCount = static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) );
+        }
+        else if ( argv[i][0] == '-' )
+        {
+            files.clear();
+            break;
+        }
+        else
+        {
+            files.push_back( argv[i] );
+        }
+    }
+
+    if ( files.empty() )
+    {
+        std::printf( "usage: RayBenchmark [-threads <count>] [-width <pixels>] [-height <pixels>] [-verify <rays>] "
+                     "<file.cooked>...\n" );
+        return 1;
+    }
+
+    ThreadPool single( 1 );
+    ThreadPool pool( threadCount );
+
+    int failures = 0;
+    for ( const char* fileName: files )
+    {
+        CookedScene scene;
+        std::string error;
+        if ( !scene.Open( fileName, &error ) )
+        {
+            std::printf( "%s: FAILED, %s\n", fileName, error.c_str() );
+            ++failures;
+            continue;
+        }
+
+        const bool packed = scene.GetHeader().vertexStride == sizeof( PackedVertex );
+
+        std::vector<MeshGeometry> meshes( scene.GetMeshCount() );
+        for ( uint32_t m = 0; m < scene.GetMeshCount(); ++m )
+        {
+            const CookedMesh& mesh = scene.GetMesh( m );
+
+            meshes[m].vertices    = scene.GetVertices( mesh );
+            meshes[m].vertexCount = mesh.vertexCount;
+            meshes[m].packed      = packed;
+            meshes[m].indices     = scene.GetIndices( mesh );
+            meshes[m].indexCount  = mesh.indexCount;
+            meshes[m].indexSize   = mesh.indexSize;
+        }
+
+        Bvh                 bvh;
+        const BvhBuildStats buildStats = bvh.Build( pool, meshes );
+        if ( bvh.GetNodes().empty() )
+        {
+            std::printf( "%s: FAILED, no triangles\n", fileName );
+            ++failures;
+            continue;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        WideBvh    wide;
+        wide.Build( bvh );
+        const double collapseSeconds = Seconds( start );
+
+        const BvhNode& root   = bvh.GetNodes()[0];
+        const float3   center = ( root.lower + root.upper ) * 0.5f;
+        const float3   extent = root.upper - root.lower;
+        const float    size   = std::max( std::max( extent.x, extent.y ), extent.z );
+        // Off surfaces along their normal, as the shaders offset their secondary rays.
+        const float offset = size * 1e-5f;
+
+        std::printf( "%s: %u meshes, %u triangles\n", fileName, scene.GetMeshCount(), buildStats.triangles );
+        std::printf( "    BVH %.1f ms, wide %.1f ms, %zu wide nodes, %zu packs, depth %u, %.1f MB\n",
+                     buildStats.seconds * 1000.0, collapseSeconds * 1000.0, wide.GetNodes().size(),
+                     wide.GetPacks().size(), wide.GetDepth(), wide.GetMemoryBytes() / ( 1024.0 * 1024.0 ) );
+
+        // Primary rays, 60 degrees vertical field of view.
+        const float3 forward = extent.x >= extent.z ? float3( 1.0f, 0.0f, 0.0f ) : float3( 0.0f, 0.0f, 1.0f );
+        const float3 right   = normalize( cross( float3( 0.0f, 1.0f, 0.0f ), forward ) );
+        const float3 up      = cross( forward, right );
+        const float  tanHalf = std::tan( PI / 6.0f );
+        const float  aspect  = static_cast<float>( width ) / height;
+
+        RaySet primary = { "primary", false, std::vector<RayDesc>( static_cast<size_t>( width ) * height ) };
+        for ( uint32_t y = 0; y < height; ++y )
+        {
+            for ( uint32_t x = 0; x < width; ++x )
+            {
+                const float sx = ( 2.0f * ( x + 0.5f ) / width - 1.0f ) * tanHalf * aspect;
+                const float sy = ( 1.0f - 2.0f * ( y + 0.5f ) / height ) * tanHalf;
+
+                RayDesc& ray  = primary.rays[static_cast<size_t>( y ) * width + x];
+                ray.origin    = center;
+                ray.direction = normalize( forward + right * sx + up * sy );
+            }
+        }
+
+        std::vector<RayHit>  primaryHits;
+        std::vector<uint8_t> unused;
+        Trace( pool, wide, primary, primaryHits, unused );
+
+        // Shadow and diffuse rays from every primary hit.
+        const float3 light   = center + float3( 0.0f, extent.y * 0.45f, 0.0f );
+        RaySet       shadow  = { "shadow", true, {} };
+        RaySet       diffuse = { "diffuse", false, {} };
+        for ( uint32_t i = 0; i < primaryHits.size(); ++i )
+        {
+            const RayHit& hit = primaryHits[i];
+            if ( !hit.IsHit() )
+            {
+                continue;
+            }
+
+            const RayDesc& ray = primary.rays[i];
+            float3         n   = GeometricNormal( wide.GetTriangle( hit.triangle ) );
+            n                  = dot( n, ray.direction ) > 0.0f ? -n : n;
+            const float3 p     = ray.origin + ray.direction * hit.t + n * offset;
+
+            RayDesc toLight;
+            toLight.origin    = p;
+            toLight.direction = light - p;
+            toLight.tMax      = 1.0f;
+            shadow.rays.push_back( toLight );
+
+            float3 tangent, bitangent;
+            Basis( n, tangent, bitangent );
+            const float r   = std::sqrt( Random( i, 0 ) );
+            const float phi = PI2 * Random( i, 1 );
+
+            RayDesc bounce;
+            bounce.origin    = p;
+            bounce.direction = tangent * ( r * std::cos( phi ) ) + bitangent * ( r * std::sin( phi ) ) +
+                               n * std::sqrt( std::max( 1.0f - r * r, 0.0f ) );
+            diffuse.rays.push_back( bounce );
+        }
+
+        const std::string threads = std::to_string( pool.GetThreadCount() ) + " threads";
+        std::printf( "    %-8s %10s %15s %15s %8s %8s\n", "rays", "count", "1 thread", threads.c_str(), "speedup",
+                     "hit" );
+
+        uint32_t mismatches = 0;
+        uint32_t verified   = 0;
+        for ( RaySet* set: { &primary, &shadow, &diffuse } )
+        {
+            std::vector<RayHit>  hits;
+            std::vector<uint8_t> occluded;
+            const double         singleSeconds   = Trace( single, wide, *set, hits, occluded );
+            const double         parallelSeconds = Trace( pool, wide, *set, hits, occluded );
+
+            const uint32_t count   = static_cast<uint32_t>( set->rays.size() );
+            uint32_t       hitRays = 0;
+            for ( uint32_t i = 0; i < count; ++i )
+            {
+                hitRays += set->anyHit ? occluded[i] : ( hits[i].IsHit() ? 1 : 0 );
+            }
+
+            std::printf( "    %-8s %10u %8.2f Mray/s %8.2f Mray/s %7.1fx %7.1f%%\n", set->name, count,
+                         count / std::max( singleSeconds, 1e-9 ) * 1e-6,
+                         count / std::max( parallelSeconds, 1e-9 ) * 1e-6,
+                         singleSeconds / std::max( parallelSeconds, 1e-9 ), 100.0 * hitRays / std::max( count, 1u ) );
+
+            // A hit on the edge between two triangles can go either way, the distance has to agree.
+            for ( uint32_t k = 0; k < std::min( verifyCount, count ); ++k )
+            {
+                const uint32_t i     = static_cast<uint32_t>( static_cast<uint64_t>( k ) * count / verifyCount );
+                const float    brute = BruteForce( bvh, set->rays[i], set->anyHit );
+                const bool     ok    = set->anyHit
+                                           ? ( brute >= 0.0f ) == ( occluded[i] != 0 )
+                                           : ( brute < 0.0f && !hits[i].IsHit() ) ||
+                                              ( brute >= 0.0f && hits[i].IsHit() &&
+                                                std::abs( brute - hits[i].t ) <= 1e-4f * std::max( brute, 1.0f ) );
+                mismatches += ok ? 0 : 1;
+                ++verified;
+            }
+        }
+
+        if ( verified > 0 )
+        {
+            std::printf( "    %u of %u rays differ from testing every triangle\n", mismatches, verified );
+        }
+
+        // Rays grazing an edge or a vertex may go either way, more than that is a bug.
+        if ( mismatches * 1000 > verified )
+        {
+            std::printf( "%s: FAILED, the BVH misses hits\n", fileName );
+            ++failures;
+        }
+    }
+
+    return failures;
+}
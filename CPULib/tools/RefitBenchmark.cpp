@@ -0,0 +1,469 @@
+/*
+ *  Animates synthetic meshes and keeps a CPU BVH over them up to date three
+ *  ways, to weigh what an update costs against what it costs to trace:
+ *
+ *      refit       Bvh::Update without rebuilds, the bounds follow the
+ *                  triangles and the tree degrades
+ *      partial     Bvh::Update rebuilding the subtrees that degraded past
+ *                  -threshold, or everything past -fraction of the triangles
+ *      rebuild     Bvh::Build every frame
+ *
+ *  RefitBenchmark [-triangles <count>] [-frames <count>] [-threads <count>] [-width <pixels>] [-height <pixels>]
+ *                 [-threshold <factor>] [-fraction <fraction>]
+ *
+ *  The meshes are a cloth with a growing wave, a ribbon twisting a full
+ *  turn, a sphere whose triangles fly apart and a crowd of spheres moved as
+ *  rigid instances through each other. Every frame each tree is collapsed
+ *  into a WideBvh and traced with the same primary rays, and the hits are
+ *  checked against those of the rebuilt tree. SAH is the cost of the tree
+ *  of the last frame, rebuilt the share of the triangles rebuilt per frame
+ *  and full the number of full rebuilds. About 200000 triangles, 30
+ *  frames and 640x360 rays by default, on all threads. The exit code is the
+ *  number of meshes that failed.
+ */
+
+#include <cpulib/Bvh.h>
+#include <cpulib/ThreadPool.h>
+#include <cpulib/WideBvh.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+// Rays per ParallelFor task.
+const uint32_t BATCH_SIZE = 4096;
+// Every this many rays is checked against the rebuilt tree.
+const uint32_t VERIFY_STRIDE = 61;
+
+enum Strategy
+{
+    STRATEGY_REFIT,
+    STRATEGY_PARTIAL,
+    STRATEGY_REBUILD,
+    STRATEGY_COUNT
+};
+
+const char* const STRATEGY_NAMES[STRATEGY_COUNT] = { "refit", "partial", "rebuild" };
+
+// Fills in the triangles at t from 0 to 1, always the same count in the same order.
+using AnimateFunction = std::function<void( float t, std::vector<BvhTriangle>& triangles )>;
+
+struct DeformingMesh
+{
+    const char*     name;
+    AnimateFunction animate;
+};
+
+struct StrategyTotals
+{
+    double   updateSeconds   = 0;
+    double   collapseSeconds = 0;
+    double   traceSeconds    = 0;
+    uint64_t rebuilt         = 0;
+    uint32_t fullRebuilds    = 0;
+    float    sahCost         = 0;
+};
+
+double Seconds( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// n x n quads over [-1, 1] in x and [-depth, depth] in z, two triangles each.
+std::vector<BvhTriangle> MakeGrid( uint32_t n, float depth )
+{
+    auto point = [&]( uint32_t i, uint32_t j ) {
+        return float3( 2.0f * i / n - 1.0f, 0.0f, depth * ( 2.0f * j / n - 1.0f ) );
+    };
+
+    std::vector<BvhTriangle> triangles;
+    triangles.reserve( 2 * n * n );
+    for ( uint32_t j = 0; j < n; ++j )
+    {
+        for ( uint32_t i = 0; i < n; ++i )
+        {
+            triangles.push_back( { point( i, j ), point( i + 1, j ), point( i + 1, j + 1 ) } );
+            triangles.push_back( { point( i, j ), point( i + 1, j + 1 ), point( i, j + 1 ) } );
+        }
+    }
+    return triangles;
+}
+
+// A unit sphere of rings x 2 rings quads, two triangles each.
+std::vector<BvhTriangle> MakeSphere( uint32_t rings )
+{
+    const uint32_t segments = 2 * rings;
+
+    auto point = [&]( uint32_t ring, uint32_t segment ) {
+        const float theta = PI * ring / rings;
+        const float phi   = PI2 * segment / segments;
+        return float3( std::sin( theta ) * std::cos( phi ), std::cos( theta ), std::sin( theta ) * std::sin( phi ) );
+    };
+
+    std::vector<BvhTriangle> triangles;
+    triangles.reserve( 2 * rings * segments );
+    for ( uint32_t ring = 0; ring < rings; ++ring )
+    {
+        for ( uint32_t segment = 0; segment < segments; ++segment )
+        {
+            const float3 a = point( ring, segment );
+            const float3 b = point( ring + 1, segment );
+            const float3 c = point( ring + 1, segment + 1 );
+            const float3 d = point( ring, segment + 1 );
+            triangles.push_back( { a, b, c } );
+            triangles.push_back( { a, c, d } );
+        }
+    }
+    return triangles;
+}
+
+std::vector<DeformingMesh> MakeMeshes( uint32_t triangleCount )
+{
+    std::vector<DeformingMesh> meshes;
+
+    // A travelling wave over a 2 x 2 cloth, growing to an amplitude of 0.3.
+    {
+        const uint32_t n    = std::max( static_cast<uint32_t>( std::sqrt( triangleCount / 2.0 ) ), 1u );
+        const auto     rest = MakeGrid( n, 1.0f );
+
+        auto move = []( float3 p, float t ) {
+            p.y = 0.3f * t * std::sin( 6.0f * p.x + 4.0f * p.z + PI2 * t );
+            return p;
+        };
+
+        meshes.push_back( { "wave", [rest, move]( float t, std::vector<BvhTriangle>& triangles ) {
+                               triangles.resize( rest.size() );
+                               for ( size_t i = 0; i < rest.size(); ++i )
+                               {
+                                   triangles[i] = { move( rest[i].v0, t ), move( rest[i].v1, t ),
+                                                    move( rest[i].v2, t ) };
+                               }
+                           } } );
+    }
+
+    // A ribbon along x, twisted about x by up to a full turn from end to end.
+    {
+        const uint32_t n    = std::max( static_cast<uint32_t>( std::sqrt( triangleCount / 2.0 ) ), 1u );
+        const auto     rest = MakeGrid( n, 0.25f );
+
+        auto move = []( float3 p, float t ) {
+            const float angle = PI * t * p.x;
+            const float c     = std::cos( angle );
+            const float s     = std::sin( angle );
+            return float3( p.x, p.y * c - p.z * s, p.y * s + p.z * c );
+        };
+
+        meshes.push_back( { "twist", [rest, move]( float t, std::vector<BvhTriangle>& triangles ) {
+                               triangles.resize( rest.size() );
+                               for ( size_t i = 0; i < rest.size(); ++i )
+                               {
+                                   triangles[i] = { move( rest[i].v0, t ), move( rest[i].v1, t ),
+                                                    move( rest[i].v2, t ) };
+                               }
+                           } } );
+    }
+
+    // Every triangle of a sphere flying off along its normal, at its own speed.
+    {
+        const uint32_t rings = std::max( static_cast<uint32_t>( std::sqrt( triangleCount / 4.0 ) ), 2u );
+        const auto     rest  = MakeSphere( rings );
+
+        std::mt19937                          random( 1 );
+        std::uniform_real_distribution<float> speed( 0.0f, 2.0f );
+
+        std::vector<float3> velocities( rest.size() );
+        for ( size_t i = 0; i < rest.size(); ++i )
+        {
+            const float3 n = cross( rest[i].v1 - rest[i].v0, rest[i].v2 - rest[i].v0 );
+            velocities[i]  = dot( n, n ) > 0.0f ? normalize( n ) * speed( random ) : float3( 0.0f );
+        }
+
+        meshes.push_back( { "explode", [rest, velocities]( float t, std::vector<BvhTriangle>& triangles ) {
+                               triangles.resize( rest.size() );
+                               for ( size_t i = 0; i < rest.size(); ++i )
+                               {
+                                   const float3 offset = velocities[i] * t;
+                                   triangles[i] = { rest[i].v0 + offset, rest[i].v1 + offset, rest[i].v2 + offset };
+                               }
+                           } } );
+    }
+
+    // 64 spheres, each a rigid instance spinning about y on a straight line through the others.
+    {
+        const uint32_t instanceCount = 64;
+        const uint32_t perInstance   = triangleCount / instanceCount;
+        const auto     sphere = MakeSphere( std::max( static_cast<uint32_t>( std::sqrt( perInstance / 4.0 ) ), 2u ) );
+
+        std::mt19937                          random( 2 );
+        std::uniform_real_distribution<float> unit( -1.0f, 1.0f );
+
+        std::vector<float3> starts( instanceCount );
+        std::vector<float3> ends( instanceCount );
+        std::vector<float>  spins( instanceCount );
+        for ( uint32_t i = 0; i < instanceCount; ++i )
+        {
+            starts[i] = float3( unit( random ), unit( random ), unit( random ) ) * 4.0f;
+            ends[i]   = float3( unit( random ), unit( random ), unit( random ) ) * 4.0f;
+            spins[i]  = PI2 * unit( random );
+        }
+
+        meshes.push_back( { "crowd", [sphere, starts, ends, spins]( float t, std::vector<BvhTriangle>& triangles ) {
+                               triangles.resize( sphere.size() * starts.size() );
+                               for ( size_t i = 0; i < starts.size(); ++i )
+                               {
+                                   const float  c = std::cos( spins[i] * t );
+                                   const float  s = std::sin( spins[i] * t );
+                                   const float3 p = starts[i] + ( ends[i] - starts[i] ) * t;
+
+                                   auto move = [&]( float3 v ) {
+                                       return float3( v.x * c + v.z * s, v.y, v.z * c - v.x * s ) * 0.5f + p;
+                                   };
+
+                                   for ( size_t k = 0; k < sphere.size(); ++k )
+                                   {
+                                       const BvhTriangle& r             = sphere[k];
+                                       triangles[i * sphere.size() + k] = { move( r.v0 ), move( r.v1 ),
+                                                                            move( r.v2 ) };
+                                   }
+                               }
+                           } } );
+    }
+
+    return meshes;
+}
+
+// Primary rays, 60 degrees vertical field of view, from in front of and above bounds towards its center.
+std::vector<RayDesc> MakeRays( const BvhNode& bounds, uint32_t width, uint32_t height )
+{
+    const float3 center = ( bounds.lower + bounds.upper ) * 0.5f;
+    const float  size   = length( bounds.upper - bounds.lower );
+    const float3 origin = center + float3( 0.3f, 0.5f, -1.0f ) * size;
+
+    const float3 forward = normalize( center - origin );
+    const float3 right   = normalize( cross( float3( 0.0f, 1.0f, 0.0f ), forward ) );
+    const float3 up      = cross( forward, right );
+    const float  tanHalf = std::tan( PI / 6.0f );
+    const float  aspect  = static_cast<float>( width ) / height;
+
+    std::vector<RayDesc> rays( static_cast<size_t>( width ) * height );
+    for ( uint32_t y = 0; y < height; ++y )
+    {
+        for ( uint32_t x = 0; x < width; ++x )
+        {
+            const float sx = ( 2.0f * ( x + 0.5f ) / width - 1.0f ) * tanHalf * aspect;
+            const float sy = ( 1.0f - 2.0f * ( y + 0.5f ) / height ) * tanHalf;
+
+            RayDesc& ray  = rays[static_cast<size_t>( y ) * width + x];
+            ray.origin    = origin;
+            ray.direction = normalize( forward + right * sx + up * sy );
+        }
+    }
+    return rays;
+}
+
+// Closest hits of rays on pool, returns seconds.
+double Trace( ThreadPool& pool, const WideBvh& bvh, const std::vector<RayDesc>& rays, std::vector<RayHit>& hits )
+{
+    const uint32_t count   = static_cast<uint32_t>( rays.size() );
+    const uint32_t batches = ( count + BATCH_SIZE - 1 ) / BATCH_SIZE;
+    hits.assign( count, RayHit() );
+
+    const auto start = std::chrono::steady_clock::now();
+    pool.ParallelFor( batches, [&]( uint32_t batch ) {
+        const uint32_t end = std::min( ( batch + 1 ) * BATCH_SIZE, count );
+        for ( uint32_t i = batch * BATCH_SIZE; i < end; ++i )
+        {
+            bvh.Intersect( rays[i], hits[i] );
+        }
+    } );
+    return Seconds( start );
+}
+
+}  // namespace
+
+int main( int argc, char* argv[] )
+{
+    uint32_t         triangleCount = 200000;
+    uint32_t         frameCount    = 30;
+    uint32_t         threadCount   = 0;
+    uint32_t         width         = 640;
+    uint32_t         height        = 360;
+    BvhUpdateOptions partialOptions;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        const bool hasValue = i + 1 < argc;
+        if ( std::strcmp( argv[i], "-triangles" ) == 0 && hasValue )
+        {
+            triangleCount = std::max( static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) ), 64u );
+        }
+        else if ( std::strcmp( argv[i], "-frames" ) == 0 && hasValue )
+        {
+            frameCount = std::max( static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) ), 2u );
+        }
+        else if ( std::strcmp( argv[i], "-threads" ) == 0 && hasValue )
+        {
+            threadCount = static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) );
+        }
+        else if ( std::strcmp( argv[i], "-width" ) == 0 && hasValue )
+        {
+            width = std::max( static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) ), 1u );
+        }
+        else if ( std::strcmp( argv[i], "-height" ) == 0 && hasValue )
+        {
+            height = std::max( static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) ), 1u );
+        }
+        else if ( std::strcmp( argv[i], "-threshold" ) == 0 && hasValue )
+        {
+            partialOptions.rebuildThreshold = std::strtof( argv[++i], nullptr );
+        }
+        else if ( std::strcmp( argv[i], "-fraction" ) == 0 && hasValue )
+        {
+            partialOptions.fullRebuildFraction = std::strtof( argv[++i], nullptr );
+        }
+        else
+        {
+            std::printf( "usage: %s [-triangles <count>] [-frames <count>] [-threads <count>] [-width <pixels>] "
+                         "[-height <pixels>] [-threshold <factor>] [-fraction <fraction>]\n",
+                         argv[0] );
+            return 1;
+        }
+    }
+
+    BvhUpdateOptions refitOptions;
+    refitOptions.rebuildThreshold = 0.0f;
+
+    ThreadPool pool( threadCount );
+
+    std::printf( "%u frames, %ux%u rays, %u threads, partial rebuilds past %.2fx the built SAH, full past %.0f%%, "
+                 "ms per frame\n\n",
+                 frameCount, width, height, pool.GetThreadCount(), partialOptions.rebuildThreshold,
+                 partialOptions.fullRebuildFraction * 100.0f );
+
+    int failures = 0;
+    for ( const DeformingMesh& mesh: MakeMeshes( triangleCount ) )
+    {
+        std::vector<BvhTriangle> triangles;
+        mesh.animate( 0.0f, triangles );
+
+        std::vector<BvhPrimitive> primitives( triangles.size() );
+        for ( uint32_t i = 0; i < primitives.size(); ++i )
+        {
+            primitives[i] = { 0, i };
+        }
+
+        Bvh trees[STRATEGY_COUNT];
+        for ( Bvh& tree: trees )
+        {
+            tree.Build( pool, triangles, primitives );
+        }
+
+        const std::vector<RayDesc> rays = MakeRays( trees[0].GetNodes()[0], width, height );
+
+        StrategyTotals      totals[STRATEGY_COUNT];
+        WideBvh             wide;
+        std::vector<RayHit> hits[STRATEGY_COUNT];
+        uint32_t            mismatches = 0;
+        uint32_t            verified   = 0;
+        std::string         error;
+        bool                valid = true;
+
+        for ( uint32_t frame = 1; frame < frameCount; ++frame )
+        {
+            mesh.animate( static_cast<float>( frame ) / ( frameCount - 1 ), triangles );
+
+            // Rebuild first, the others are checked against it.
+            for ( int s = STRATEGY_REBUILD; s >= 0; --s )
+            {
+                StrategyTotals& total = totals[s];
+                Bvh&            tree  = trees[s];
+
+                if ( s == STRATEGY_REBUILD )
+                {
+                    const BvhBuildStats stats = tree.Build( pool, triangles, primitives );
+                    total.updateSeconds += stats.seconds;
+                    total.rebuilt += stats.triangles;
+                    total.sahCost = stats.sahCost;
+                }
+                else
+                {
+                    const BvhUpdateStats stats =
+                        tree.Update( pool, triangles, s == STRATEGY_REFIT ? refitOptions : partialOptions );
+                    total.updateSeconds += stats.seconds;
+                    total.rebuilt += stats.rebuiltTriangles;
+                    total.fullRebuilds += stats.fullRebuild ? 1 : 0;
+                    total.sahCost = stats.sahCost;
+                }
+
+                const auto start = std::chrono::steady_clock::now();
+                wide.Build( tree );
+                total.collapseSeconds += Seconds( start );
+                total.traceSeconds += Trace( pool, wide, rays, hits[s] );
+
+                if ( valid && !tree.Validate( &error ) )
+                {
+                    error = std::string( STRATEGY_NAMES[s] ) + ", " + error;
+                    valid = false;
+                }
+
+                if ( s == STRATEGY_REBUILD )
+                {
+                    continue;
+                }
+
+                // The same triangles, the same t, whichever tree found them.
+                for ( uint32_t i = frame % VERIFY_STRIDE; i < rays.size(); i += VERIFY_STRIDE )
+                {
+                    const RayHit& a = hits[s][i];
+                    const RayHit& b = hits[STRATEGY_REBUILD][i];
+                    const bool    ok = a.IsHit() == b.IsHit() &&
+                                        ( !a.IsHit() || std::abs( a.t - b.t ) <= 1e-5f * std::max( b.t, 1.0f ) );
+                    mismatches += ok ? 0 : 1;
+                    ++verified;
+                }
+            }
+        }
+
+        const uint32_t updates = frameCount - 1;
+        std::printf( "%s: %zu triangles\n", mesh.name, triangles.size() );
+        std::printf( "    %-8s %9s %9s %9s %9s %9s %11s %8s %8s\n", "tree", "update", "collapse", "trace", "total",
+                     "SAH", "vs rebuild", "rebuilt", "full" );
+        for ( int s = 0; s < STRATEGY_COUNT; ++s )
+        {
+            const StrategyTotals& total = totals[s];
+            std::printf( "    %-8s %9.3f %9.3f %9.3f %9.3f %9.2f %10.2fx %7.1f%% %8u\n", STRATEGY_NAMES[s],
+                         total.updateSeconds * 1000.0 / updates, total.collapseSeconds * 1000.0 / updates,
+                         total.traceSeconds * 1000.0 / updates,
+                         ( total.updateSeconds + total.collapseSeconds + total.traceSeconds ) * 1000.0 / updates,
+                         total.sahCost, total.sahCost / std::max( totals[STRATEGY_REBUILD].sahCost, 1e-30f ),
+                         100.0 * total.rebuilt / ( static_cast<double>( triangles.size() ) * updates ),
+                         s == STRATEGY_REBUILD ? updates : total.fullRebuilds );
+        }
+        std::printf( "    %u of %u rays differ from the rebuilt tree\n\n", mismatches, verified );
+
+        if ( !valid )
+        {
+            std::printf( "%s: FAILED, %s\n\n", mesh.name, error.c_str() );
+            ++failures;
+        }
+        else if ( mismatches * 1000 > verified )
+        {
+            std::printf( "%s: FAILED, the updated trees miss hits\n\n", mesh.name );
+            ++failures;
+        }
+    }
+
+    return failures;
+}
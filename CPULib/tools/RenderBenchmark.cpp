@@ -0,0 +1,355 @@
+/*
+ *  Renders a cooked scene along a recorded camera path with the CPU path
+ *  tracer, headless, and prints the timings and ray counts of every frame as
+ *  CSV, the way the Playground renders a benchmark run without the
+ *  #define SPONZA edits and the example.txt dump.
+ *
+ *  RenderBenchmark [options] <scene.cooked> <camera.csv>
+ *
+ *      -backend cpu|adaptive   every pixel traced, or the adaptive sampler
+ *                              of the Playground with -grid, cpu by default
+ *      -width, -height         resolution, 640x360 by default
+ *      -frames <count>         evenly over the length of the path, by
+ *                              default one frame per recorded pose
+ *      -threads <count>        all of them by default
+ *      -spp <exponent>         exponentSamplesPerPixel, 0 by default
+ *      -bounces <count>        nbrBouncesPerPath, 1 by default
+ *      -grid <size>            gridSize of the adaptive backend, 3 by default
+ *      -denoise                run SVGF on every frame
+ *      -light x,y,z,w          a light in model space and its weight, up
+ *                              to 10, a light at the first camera position
+ *                              by default. A single light is read from
+ *                              lightPositions[1], as the shader does, and
+ *                              is written to slots 0 and 1
+ *      -scale <factor>         the scene_scale of the Playground, which
+ *                              places the scene and the lights, 1 by default
+ *      -atmosphere r,g,b,i     the colour of a miss, 0,0,0,1 by default
+ *      -ambient <factor>       ambientFactor, 0 by default
+ *      -out <directory>        write the ray buffer of every frame there,
+ *                              the directory is created if need be
+ *
+ *  The camera path is the camera.csv the Playground writes while recording
+ *  (H), see CameraPath.h. One line per frame goes to stdout, the scene and a
+ *  summary to stderr, so the output redirects straight into a CSV file. With
+ *  -out every frame is written as <directory>/frame_<n>_colour.rgba and the
+ *  three other G-buffer slots (see WriteRayBuffer), plus
+ *  <directory>/frame_<n>_denoised.rgba with -denoise. The frame seed is the
+ *  frame number, so two runs render the same images.
+ */
+
+#include <cpulib/AdaptiveSampler.h>
+#include <cpulib/CameraPath.h>
+#include <cpulib/CookedScene.h>
+#include <cpulib/PathTracer.h>
+#include <cpulib/RayBuffer.h>
+#include <cpulib/SvgfDenoiser.h>
+#include <cpulib/ThreadPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+double Seconds( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// Parse count comma separated floats, false if there are fewer.
+bool ParseFloats( const char* text, float* values, int count )
+{
+    for ( int i = 0; i < count; ++i )
+    {
+        char* end = nullptr;
+        values[i] = std::strtof( text, &end );
+        if ( end == text || ( i + 1 < count && *end != ',' ) )
+        {
+            return false;
+        }
+        text = end + 1;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main( int argc, char* argv[] )
+{
+    bool                     adaptive    = false;
+    bool                     denoise     = false;
+    uint32_t                 width       = 640;
+    uint32_t                 height      = 360;
+    uint32_t                 frameCount  = 0;
+    uint32_t                 threadCount = 0;
+    int                      gridSize    = 3;
+    float                    sceneScale  = 1.0f;
+    const char*              outDir      = nullptr;
+    PathTracerFrame          frame;
+    PathTracerConstants      constants;
+    std::vector<const char*> files;
+
+    frame.atmosphere = float4( 0.0f, 0.0f, 0.0f, 1.0f );
+
+    bool ok = true;
+    for ( int i = 1; i < argc && ok; ++i )
+    {
+        const bool hasValue = i + 1 < argc;
+        if ( std::strcmp( argv[i], "-backend" ) == 0 && hasValue )
+        {
+            ++i;
+            adaptive = std::strcmp( argv[i], "adaptive" ) == 0;
+            ok       = adaptive || std::strcmp( argv[i], "cpu" ) == 0;
+        }
+        else if ( std::strcmp( argv[i], "-width" ) == 0 && hasValue )
+        {
+            width = std::max( static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) ), 1u );
+        }
+        else if ( std::strcmp( argv[i], "-height" ) == 0 && hasValue )
+        {
+            height = std::max( static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) ), 1u );
+        }
+        else if ( std::strcmp( argv[i], "-frames" ) == 0 && hasValue )
+        {
+            frameCount = static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) );
+        }
+        else if ( std::strcmp( argv[i], "-threads" ) == 0 && hasValue )
+        {
+            threadCount = static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) );
+        }
+        else if ( std::strcmp( argv[i], "-spp" ) == 0 && hasValue )
+        {
+            frame.exponentSamplesPerPixel = static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) );
+        }
+        else if ( std::strcmp( argv[i], "-bounces" ) == 0 && hasValue )
+        {
+            frame.nbrBouncesPerPath = static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) );
+        }
+        else if ( std::strcmp( argv[i], "-grid" ) == 0 && hasValue )
+        {
+            gridSize = std::max( std::atoi( argv[++i] ), 0 );
+        }
+        else if ( std::strcmp( argv[i], "-denoise" ) == 0 )
+        {
+            denoise = true;
+        }
+        else if ( std::strcmp( argv[i], "-light" ) == 0 && hasValue )
+        {
+            float v[4];
+            ok = ParseFloats( argv[++i], v, 4 ) && constants.AddLight( float4( v[0], v[1], v[2], v[3] ) );
+        }
+        else if ( std::strcmp( argv[i], "-scale" ) == 0 && hasValue )
+        {
+            sceneScale = std::strtof( argv[++i], nullptr );
+            ok         = sceneScale > 0;
+        }
+        else if ( std::strcmp( argv[i], "-atmosphere" ) == 0 && hasValue )
+        {
+            float v[4];
+            ok               = ParseFloats( argv[++i], v, 4 );
+            frame.atmosphere = float4( v[0], v[1], v[2], v[3] );
+        }
+        else if ( std::strcmp( argv[i], "-ambient" ) == 0 && hasValue )
+        {
+            frame.ambientFactor = std::strtof( argv[++i], nullptr );
+        }
+        else if ( std::strcmp( argv[i], "-out" ) == 0 && hasValue )
+        {
+            outDir = argv[++i];
+        }
+        else if ( argv[i][0] == '-' )
+        {
+            ok = false;
+        }
+        else
+        {
+            files.push_back( argv[i] );
+        }
+    }
+
+    if ( !ok || files.size() != 2 )
+    {
+        std::printf( "usage: RenderBenchmark [-backend cpu|adaptive] [-width <pixels>] [-height <pixels>] "
+                     "[-frames <count>] [-threads <count>] [-spp <exponent>] [-bounces <count>] [-grid <size>] "
+                     "[-denoise] [-light x,y,z,w]... [-scale <factor>] [-atmosphere r,g,b,i] [-ambient <factor>] "
+                     "[-out <directory>] <scene.cooked> <camera.csv>\n" );
+        return 1;
+    }
+
+    const char* sceneName = files[0];
+    const char* pathName  = files[1];
+
+    std::vector<CameraPose> path;
+    if ( !ReadCameraPath( pathName, path ) || path.empty() )
+    {
+        std::fprintf( stderr, "%s: FAILED, not a camera path\n", pathName );
+        return 1;
+    }
+
+    CookedScene cooked;
+    std::string error;
+    if ( !cooked.Open( sceneName, &error ) )
+    {
+        std::fprintf( stderr, "%s: FAILED, %s\n", sceneName, error.c_str() );
+        return 1;
+    }
+
+    std::error_code createError;
+    if ( outDir && !std::filesystem::create_directories( outDir, createError ) && createError )
+    {
+        std::fprintf( stderr, "%s: FAILED, %s\n", outDir, createError.message().c_str() );
+        return 1;
+    }
+
+    ThreadPool pool( threadCount );
+
+    // Node 0 of the Playground's transforms, every instance and the lights go through it.
+    float3x4 sceneTransform = IdentityTransform();
+    for ( int axis = 0; axis < 3; ++axis )
+    {
+        sceneTransform.m[axis][axis] = sceneScale;
+    }
+    constants.SetSceneTransform( sceneTransform );
+
+    PathTracerScene scene;
+    LoadPathTracerScene( cooked, scene, sceneTransform );
+
+    PathTracer          tracer( pool );
+    const BvhBuildStats buildStats = tracer.SetScene( scene );
+    if ( tracer.GetBvh().GetNodes().empty() )
+    {
+        std::fprintf( stderr, "%s: FAILED, no triangles\n", sceneName );
+        return 1;
+    }
+
+    // The camera path is in world space, the lights in model space.
+    if ( constants.nbrActiveLights == 0 )
+    {
+        constants.AddLight( float4( path.front().position * ( 1.0f / sceneScale ), 1.0f ) );
+    }
+
+    // The recorded poses as they are, or resampled evenly over the recording.
+    std::vector<CameraPose> poses = path;
+    if ( frameCount > 0 )
+    {
+        const double start    = path.front().time;
+        const double duration = path.back().time - start;
+
+        poses.resize( frameCount );
+        for ( uint32_t f = 0; f < frameCount; ++f )
+        {
+            const double t = frameCount > 1 ? start + duration * f / ( frameCount - 1 ) : start;
+            poses[f]       = SampleCameraPath( path, t );
+        }
+    }
+
+    std::fprintf( stderr, "%s: %u meshes, %u triangles, BVH %.1f ms on %u threads\n", sceneName,
+                  cooked.GetMeshCount(), buildStats.triangles, buildStats.seconds * 1000.0, pool.GetThreadCount() );
+    std::fprintf( stderr, "%s: %zu poses over %.2f s, rendering %zu frames at %ux%u, %s backend\n", pathName,
+                  path.size(), path.back().time - path.front().time, poses.size(), width, height,
+                  adaptive ? "adaptive" : "cpu" );
+
+    AdaptiveSampler         sampler( pool );
+    AdaptiveSamplerSettings samplerSettings;
+    samplerSettings.gridSize = adaptive ? gridSize : 0;
+    sampler.SetSettings( samplerSettings );
+
+    SvgfDenoiser denoiser( pool );
+
+    RayBuffer buffer;
+    buffer.Resize( width, height );
+    ImageF4 denoised;
+
+    const float aspect = static_cast<float>( width ) / height;
+
+    std::printf( "frame,time,trace_ms,schedule_ms,denoise_ms,total_ms,traced_pixels,interpolated_pixels,primary_rays,"
+                 "bounce_rays,light_rays,mrays_per_s\n" );
+
+    PathTracerStats total;
+    double          totalSeconds = 0;
+    for ( uint32_t f = 0; f < poses.size(); ++f )
+    {
+        const CameraPose& pose = poses[f];
+
+        frame.cameraPixelToWorld = GetCameraPixelToWorld( pose );
+        frame.cpuGeneratedSeed   = f;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        PathTracerStats            stats;
+        const AdaptiveSamplerStats samplerStats = sampler.Run( buffer, [&]( RayBuffer& frameBuffer, int ) {
+            const PathTracerStats pass = tracer.Render( frameBuffer, frame, constants );
+
+            stats.pixels += pass.pixels;
+            stats.primaryRays += pass.primaryRays;
+            stats.bounceRays += pass.bounceRays;
+            stats.lightRays += pass.lightRays;
+            stats.seconds += pass.seconds;
+        } );
+
+        double denoiseMs = 0;
+        if ( denoise )
+        {
+            DenoiserCamera camera;
+            camera.oldCameraWorldToClip = GetCameraWorldToView( poses[f > 0 ? f - 1 : 0] );
+            camera.newCameraWorldToClip = GetCameraWorldToView( pose );
+            camera.cameraWindowSize     = float2( aspect, 1.0f );
+
+            denoiseMs = denoiser.Denoise( buffer, camera ).totalMs;
+        }
+
+        const double seconds    = Seconds( start );
+        const double traceMs    = stats.seconds * 1000.0;
+        const double scheduleMs = std::max( seconds * 1000.0 - traceMs - denoiseMs, 0.0 );
+
+        std::printf( "%u,%.6f,%.3f,%.3f,%.3f,%.3f,%llu,%llu,%llu,%llu,%llu,%.3f\n", f, pose.time, traceMs, scheduleMs,
+                     denoiseMs, seconds * 1000.0, static_cast<unsigned long long>( stats.pixels ),
+                     static_cast<unsigned long long>( samplerStats.totalInterpolated ),
+                     static_cast<unsigned long long>( stats.primaryRays ),
+                     static_cast<unsigned long long>( stats.bounceRays ),
+                     static_cast<unsigned long long>( stats.lightRays ),
+                     stats.GetRayCount() / std::max( stats.seconds, 1e-9 ) * 1e-6 );
+        std::fflush( stdout );
+
+        if ( outDir )
+        {
+            char prefix[32];
+            std::snprintf( prefix, sizeof( prefix ), "/frame_%04u", f );
+
+            bool written = WriteRayBuffer( outDir + std::string( prefix ), buffer );
+            if ( denoise )
+            {
+                denoiser.GetOutput( denoised );
+                written = written && WriteImage( outDir + std::string( prefix ) + "_denoised.rgba", denoised );
+            }
+
+            if ( !written )
+            {
+                std::fprintf( stderr, "%s: FAILED, could not write frame %u\n", outDir, f );
+                return 1;
+            }
+        }
+
+        total.pixels += stats.pixels;
+        total.primaryRays += stats.primaryRays;
+        total.bounceRays += stats.bounceRays;
+        total.lightRays += stats.lightRays;
+        total.seconds += stats.seconds;
+        totalSeconds += seconds;
+    }
+
+    std::fprintf( stderr, "%zu frames in %.3f s, %.2f ms per frame, %.2f Mray/s traced, %llu rays\n", poses.size(),
+                  totalSeconds, totalSeconds * 1000.0 / poses.size(),
+                  total.GetRayCount() / std::max( total.seconds, 1e-9 ) * 1e-6,
+                  static_cast<unsigned long long>( total.GetRayCount() ) );
+
+    return 0;
+}
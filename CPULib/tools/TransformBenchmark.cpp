@@ -0,0 +1,255 @@
+/*
+ *  Times the world, inverse and normal transforms of synthetic node
+ *  hierarchies: the flattened TransformHierarchy against walking the parents
+ *  and inverting on every query, as SceneNode did.
+ *
+ *  TransformBenchmark [-nodes <count>] [-frames <count>]
+ *
+ *  Every scene is updated with 100%, 10%, 1% and 0% of its local transforms
+ *  changed per frame, and the two are checked to agree. 100000 nodes and 20
+ *  frames by default. The exit code is 1 if they don't agree.
+ */
+
+#include <cpulib/TransformHierarchy.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace cpulib;
+
+namespace
+{
+
+// A node as SceneNode keeps it, every one allocated on its own.
+struct RecursiveNode
+{
+    const RecursiveNode* parent = nullptr;
+    float3x4             local;
+
+    float3x4 GetWorld() const
+    {
+        return parent ? MulTransforms( parent->GetWorld(), local ) : local;
+    }
+};
+
+// A rotation about a random axis, a scale close to 1 so deep chains stay in range, and a translation.
+float3x4 RandomTransform( std::mt19937& random )
+{
+    std::uniform_real_distribution<float> unit( -1.0f, 1.0f );
+
+    float3 axis = float3( unit( random ), unit( random ), unit( random ) );
+    axis        = dot( axis, axis ) > 1e-6f ? normalize( axis ) : float3( 0.0f, 1.0f, 0.0f );
+
+    const float angle = PI * unit( random );
+    const float scale = 1.0f + 0.01f * unit( random );
+    const float c     = std::cos( angle );
+    const float s     = std::sin( angle );
+
+    const float k[3][3] = {
+        { 0.0f, -axis.z, axis.y },
+        { axis.z, 0.0f, -axis.x },
+        { -axis.y, axis.x, 0.0f },
+    };
+
+    float3x4 transform;
+    for ( int i = 0; i < 3; ++i )
+    {
+        for ( int j = 0; j < 3; ++j )
+        {
+            const float identity = i == j ? 1.0f : 0.0f;
+            transform.m[i][j]    = scale * ( identity * c + s * k[i][j] + ( 1.0f - c ) * axis[i] * axis[j] );
+        }
+        transform.m[i][3] = 2.0f * unit( random );
+    }
+    return transform;
+}
+
+struct SyntheticScene
+{
+    const char*           name;
+    std::vector<uint32_t> parents;
+};
+
+SyntheticScene MakeWide( uint32_t nodeCount )
+{
+    SyntheticScene scene = { "wide", std::vector<uint32_t>( nodeCount, 0 ) };
+    scene.parents[0]     = TRANSFORM_NO_PARENT;
+    return scene;
+}
+
+// Chains of 100 nodes.
+SyntheticScene MakeDeep( uint32_t nodeCount )
+{
+    SyntheticScene scene = { "deep", std::vector<uint32_t>( nodeCount ) };
+    for ( uint32_t i = 0; i < nodeCount; ++i )
+    {
+        scene.parents[i] = i % 100 == 0 ? TRANSFORM_NO_PARENT : i - 1;
+    }
+    return scene;
+}
+
+// Every node under a random one before it.
+SyntheticScene MakeRandom( uint32_t nodeCount, std::mt19937& random )
+{
+    SyntheticScene scene = { "random", std::vector<uint32_t>( nodeCount ) };
+    scene.parents[0]     = TRANSFORM_NO_PARENT;
+    for ( uint32_t i = 1; i < nodeCount; ++i )
+    {
+        scene.parents[i] = std::uniform_int_distribution<uint32_t>( 0, i - 1 )( random );
+    }
+    return scene;
+}
+
+double Milliseconds( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+float MaxDifference( const float3x4& a, const float3x4& b )
+{
+    float difference = 0.0f;
+    for ( int i = 0; i < 3; ++i )
+    {
+        for ( int j = 0; j < 4; ++j )
+        {
+            difference = std::max( difference, std::abs( a.m[i][j] - b.m[i][j] ) );
+        }
+    }
+    return difference;
+}
+
+}  // namespace
+
+int main( int argc, char* argv[] )
+{
+    uint32_t nodeCount  = 100000;
+    uint32_t frameCount = 20;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( std::strcmp( argv[i], "-nodes" ) == 0 && i + 1 < argc )
+        {
+            nodeCount = std::max( static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) ), 1u );
+        }
+        else if ( std::strcmp( argv[i], "-frames" ) == 0 && i + 1 < argc )
+        {
+            frameCount = std::max( static_cast<uint32_t>( std::strtoul( argv[++i], nullptr, 10 ) ), 1u );
+        }
+        else
+        {
+            std::printf( "usage: %s [-nodes <count>] [-frames <count>]\n", argv[0] );
+            return 1;
+        }
+    }
+
+    std::mt19937 random( 1 );
+
+    const SyntheticScene scenes[] = { MakeWide( nodeCount ), MakeDeep( nodeCount ), MakeRandom( nodeCount, random ) };
+    const float          dirtyFractions[] = { 1.0f, 0.1f, 0.01f, 0.0f };
+
+    std::printf( "%u nodes, %u frames, ms per frame\n\n", nodeCount, frameCount );
+    std::printf( "%-8s %6s %12s %12s %10s %9s %12s\n", "scene", "dirty", "recursive", "flattened", "updated", "speedup",
+                 "difference" );
+
+    bool failed = false;
+
+    for ( const SyntheticScene& scene: scenes )
+    {
+        std::vector<std::unique_ptr<RecursiveNode>> recursive;
+        TransformHierarchy                          hierarchy;
+        hierarchy.Reserve( nodeCount );
+
+        for ( uint32_t i = 0; i < nodeCount; ++i )
+        {
+            const uint32_t parent = scene.parents[i];
+
+            auto node    = std::make_unique<RecursiveNode>();
+            node->parent = parent == TRANSFORM_NO_PARENT ? nullptr : recursive[parent].get();
+            node->local  = RandomTransform( random );
+
+            hierarchy.AddNode( parent, node->local );
+            recursive.push_back( std::move( node ) );
+        }
+        hierarchy.Update();
+
+        // What a frame reads of every node.
+        std::vector<float3x4> worlds( nodeCount );
+        std::vector<float3x4> inverses( nodeCount );
+        std::vector<float3x4> normals( nodeCount );
+
+        for ( float dirtyFraction: dirtyFractions )
+        {
+            const uint32_t dirtyCount = static_cast<uint32_t>( dirtyFraction * nodeCount );
+
+            double   recursiveMs = 0.0;
+            double   flattenedMs = 0.0;
+            uint64_t updated     = 0;
+
+            for ( uint32_t frame = 0; frame < frameCount; ++frame )
+            {
+                std::vector<std::pair<uint32_t, float3x4>> changes( dirtyCount );
+                for ( auto& change: changes )
+                {
+                    change.first  = std::uniform_int_distribution<uint32_t>( 0, nodeCount - 1 )( random );
+                    change.second = RandomTransform( random );
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                for ( const auto& change: changes )
+                {
+                    recursive[change.first]->local = change.second;
+                }
+                for ( uint32_t i = 0; i < nodeCount; ++i )
+                {
+                    worlds[i] = recursive[i]->GetWorld();
+                    InvertTransform( recursive[i]->GetWorld(), inverses[i], normals[i] );
+                }
+                recursiveMs += Milliseconds( start );
+
+                start = std::chrono::steady_clock::now();
+                for ( const auto& change: changes )
+                {
+                    hierarchy.SetLocal( change.first, change.second );
+                }
+                updated += hierarchy.Update();
+                flattenedMs += Milliseconds( start );
+            }
+
+            float difference = 0.0f;
+            for ( uint32_t i = 0; i < nodeCount; ++i )
+            {
+                // Relative to the size of the world transform, deep chains move far from the origin.
+                float magnitude = 1.0f;
+                for ( int r = 0; r < 3; ++r )
+                {
+                    magnitude = std::max( magnitude, std::abs( worlds[i].m[r][3] ) );
+                }
+
+                difference = std::max( difference, MaxDifference( worlds[i], hierarchy.GetWorld( i ) ) / magnitude );
+                difference = std::max( difference, MaxDifference( inverses[i], hierarchy.GetInverseWorld( i ) ) );
+                difference = std::max( difference, MaxDifference( normals[i], hierarchy.GetNormal( i ) ) );
+            }
+            failed |= !( difference < 1e-3f );
+
+            recursiveMs /= frameCount;
+            flattenedMs /= frameCount;
+
+            std::printf( "%-8s %5.0f%% %12.3f %12.3f %10llu %8.1fx %12.2e\n", scene.name, dirtyFraction * 100.0f,
+                         recursiveMs, flattenedMs, static_cast<unsigned long long>( updated / frameCount ),
+                         recursiveMs / std::max( flattenedMs, 1e-6 ), difference );
+        }
+    }
+
+    if ( failed )
+    {
+        std::printf( "\nFAILED, the flattened transforms don't match\n" );
+    }
+
+    return failed ? 1 : 0;
+}
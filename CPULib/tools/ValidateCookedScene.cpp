@@ -0,0 +1,76 @@
+/*
+ *  Checks cooked scene files and prints what is in them.
+ *
+ *  ValidateCookedScene [-quick] <file.cooked>...
+ *
+ *  -quick skips the index check, leaving what the loader checks itself.
+ *  The exit code is the number of files that failed.
+ */
+
+#include <cpulib/CookedScene.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+using namespace cpulib;
+
+int main( int argc, char* argv[] )
+{
+    bool checkIndices = true;
+    int  failures     = 0;
+    int  files        = 0;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( std::strcmp( argv[i], "-quick" ) == 0 )
+        {
+            checkIndices = false;
+            continue;
+        }
+
+        ++files;
+
+        MappedFile  file;
+        std::string error;
+        if ( !file.Open( argv[i], &error ) ||
+             !ValidateCookedScene( file.GetData(), file.GetSize(), checkIndices, &error ) )
+        {
+            std::printf( "%s: FAILED, %s\n", argv[i], error.c_str() );
+            ++failures;
+            continue;
+        }
+
+        const CookedSceneHeader& header = *reinterpret_cast<const CookedSceneHeader*>( file.GetData() );
+
+        uint64_t vertices   = 0;
+        uint64_t indices    = 0;
+        uint64_t indexBytes = 0;
+        uint32_t meshes16   = 0;
+        auto     meshes     = reinterpret_cast<const CookedMesh*>( file.GetData() + header.meshOffset );
+        for ( uint32_t m = 0; m < header.meshCount; ++m )
+        {
+            vertices += meshes[m].vertexCount;
+            indices += meshes[m].indexCount;
+            indexBytes += static_cast<uint64_t>( meshes[m].indexCount ) * meshes[m].indexSize;
+            meshes16 += meshes[m].indexSize == 2 ? 1 : 0;
+        }
+
+        std::printf( "%s: ok, version %u, %.1f MB\n", argv[i], header.version, header.fileSize / ( 1024.0 * 1024.0 ) );
+        std::printf( "    %u meshes, %llu vertices of %u bytes, %llu triangles\n", header.meshCount,
+                     static_cast<unsigned long long>( vertices ), header.vertexStride,
+                     static_cast<unsigned long long>( indices / 3 ) );
+        std::printf( "    %u meshes with 16 bit indices, %.1f MB of indices%s\n", meshes16,
+                     indexBytes / ( 1024.0 * 1024.0 ), header.flags & COOKED_SCENE_SPLIT_MESHES ? ", split" : "" );
+        std::printf( "    %u materials, %u nodes, %llu bytes of strings\n", header.materialCount, header.nodeCount,
+                     static_cast<unsigned long long>( header.stringSize ) );
+    }
+
+    if ( files == 0 )
+    {
+        std::printf( "usage: ValidateCookedScene [-quick] <file.cooked>...\n" );
+        return 1;
+    }
+
+    return failures;
+}
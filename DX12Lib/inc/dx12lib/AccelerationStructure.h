@@ -5,6 +5,7 @@
 
 #include "d3dx12.h"
 #include <memory>
+#include <vector>
 
 using namespace Microsoft::WRL;
 
@@ -17,6 +18,7 @@ class IndexBuffer;
 class Buffer;
 class MappableBuffer;
 class AccelerationBuffer;
+class Mesh;
 class Scene;
 
 struct AccelerationStructure
@@ -32,6 +34,14 @@ public:
     static void CreateBottomLevelAS( dx12lib::Device* pDevice, dx12lib::CommandList* pCommandList,
                                      dx12lib::Scene* pScene, AccelerationStructure* pDes );
 
+    // One geometry per mesh, in order: GeometryIndex() is the index into meshes.
+    static void CreateBottomLevelAS( dx12lib::Device* pDevice, dx12lib::CommandList* pCommandList,
+                                     const std::vector<std::shared_ptr<Mesh>>& meshes, AccelerationStructure* pDes );
+
+    // The most a BLAS over meshes can take, without building it.
+    static uint64_t GetBottomLevelASSize( dx12lib::Device* pDevice, const std::vector<std::shared_ptr<Mesh>>& meshes );
+
+    // Without update the TLAS is built from scratch, in the buffers of pDes if it has them and they are large enough.
     static void CreateTopLevelAS( dx12lib::Device* pDevice, dx12lib::CommandList* pCommandList,
                                 uint64_t* pTlasSize, AccelerationStructure* pDes, size_t numInstances,
                                   dx12lib::MappableBuffer* pInstanceDescBuffer, bool update = false );
@@ -33,16 +33,25 @@
  */
 #include "VertexTypes.h"
 
+#include <cpulib/ContentCache.h>
+
 #include <DirectXMath.h>
 #include <d3d12.h>
 #include <wrl.h>
 
+#include <filesystem>  // For std::filesystem::file_time_type
 #include <functional>  // For std::function
+#include <future>      // For std::shared_future
 #include <map>         // for std::map
 #include <memory>      // for std::unique_ptr
 #include <mutex>       // for std::mutex
 #include <vector>      // for std::vector
 
+namespace DirectX
+{
+class ScratchImage;
+}
+
 namespace dx12lib
 {
 
@@ -144,6 +153,13 @@ public:
      */
     void FlushResourceBarriers();
 
+    /**
+     * Discard the contents of a resource. A placed render target or UAV texture taking over memory after an
+     * aliasing barrier needs this (or a clear or a copy) before anything else uses it. The resource has to be in
+     * the render target or unordered access state already.
+     */
+    void DiscardResource( const std::shared_ptr<Resource>& resource );
+
     /**
      * Copy resources.
      */
@@ -220,19 +236,56 @@ public:
 
     /**
      * Load a texture by a filename.
+     * The file is decoded without holding the texture cache lock, only the
+     * creation and upload of the texture are serialized. A decode started by
+     * PrefetchTextureFromFile is picked up instead of decoding again.
      */
     std::shared_ptr<Texture> LoadTextureFromFile( const std::wstring& fileName, bool sRGB = false , bool generateMips = true);
 
+    /**
+     * Decode a texture file on the calling thread, without touching any cache.
+     * Safe to call from any thread, throws if the file can't be decoded.
+     */
+    static std::shared_ptr<const DirectX::ScratchImage> DecodeTextureFromFile( const std::wstring& fileName );
+
+    /**
+     * Decode a texture file ahead of LoadTextureFromFile, from any thread.
+     * Every file gets its own future: concurrent requests for the same file
+     * wait for one decode, requests for different files don't wait at all.
+     * Errors are kept and rethrown by LoadTextureFromFile.
+     */
+    static void PrefetchTextureFromFile( const std::wstring& fileName );
+
+    /**
+     * Textures loaded from files are shared by content: files with the same
+     * bytes, loaded the same way, are one resource whatever their paths. A
+     * texture nothing uses anymore stays cached for the next load until the
+     * cache is over its budget, 1 GB by default.
+     */
+    static void                      SetTextureCacheBudget( uint64_t budget );
+    static cpulib::ContentCacheStats GetTextureCacheStats();
+
+    /**
+     * Release the cached textures nothing uses anymore, before the device goes.
+     */
+    static void ClearTextureCache();
+
     /**
      * Load a scene file.
      *
      * @param fileName The path to the scene file definition.
      * @param [loadingProgress] An optional callback function that can be used to report loading progress.
+     * @param [vertexFormat] The vertex layout to import the meshes to.
+     * @param [splitLargeMeshes] Split the meshes too large for 16 bit indices.
+     * @param [instanceMeshes] Import the copies of a mesh as instances of one, see Scene::GetMeshInstances.
      */
     std::shared_ptr<Scene>
         LoadSceneFromFile( const std::wstring&                 fileName,
                            const float scale = 1.0, 
-                           const std::function<bool( float )>& loadingProgres = std::function<bool( float )>());
+                           const std::function<bool( float )>& loadingProgres = std::function<bool( float )>(),
+                           VertexFormat                        vertexFormat   = VertexFormat::Full,
+                           bool                                splitLargeMeshes = false,
+                           bool                                instanceMeshes   = false );
 
     /**
      * Load a scene from a string.
@@ -603,6 +656,16 @@ public:
      */
     void DispatchRays( D3D12_DISPATCH_RAYS_DESC* pRaytraceDesc );
 
+    /**
+     * Execute a single indirect command, with the arguments a shader wrote to argumentBuffer.
+     *
+     * @param commandSignature The layout of the arguments, e.g. one D3D12_DISPATCH_RAYS_DESC.
+     * @param argumentBuffer Transitioned to D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT.
+     * @param argumentOffset Byte offset of the arguments in argumentBuffer.
+     */
+    void ExecuteIndirect( ID3D12CommandSignature* commandSignature, const std::shared_ptr<Resource>& argumentBuffer,
+                          uint64_t argumentOffset = 0 );
+
 protected:
     friend class CommandQueue;
     friend class DynamicDescriptorHeap;
@@ -732,9 +795,34 @@ private:
     // reset.
     TrackedObjects m_TrackedObjects;
 
-    // Keep track of loaded textures to avoid loading the same texture multiple times.
-    static std::map<std::wstring, ID3D12Resource*> ms_TextureCache;
-    static std::mutex                              ms_TextureCacheMutex;
+    using DecodedTexture = std::shared_future<std::shared_ptr<const DirectX::ScratchImage>>;
+
+    // The content hash of a texture file, hashed again only once the file is written to.
+    static uint64_t GetTextureContentHash( const std::wstring& fileName );
+
+    // The decode of the file with that content, started by the first caller and shared by the rest.
+    static DecodedTexture AcquireDecodedTexture( uint64_t contentHash, const std::wstring& fileName );
+
+    // The uploaded textures by content, defined in CommandList.cpp. The textures handed out share it, each releases
+    // its entry when its last owner lets go.
+    struct TextureCache;
+    static std::shared_ptr<TextureCache> ms_TextureCache;
+
+    // A texture on the cached resource of key, releasing it once the last owner lets go.
+    static std::shared_ptr<Texture> ShareCachedTexture( std::shared_ptr<Texture> texture, uint64_t key );
+
+    struct TextureHash
+    {
+        std::filesystem::file_time_type lastWriteTime;
+        uint64_t                        contentHash;
+    };
+    static std::map<std::wstring, TextureHash> ms_TextureHashes;
+    static std::mutex                          ms_TextureHashesMutex;
+
+    // Decodes in flight or waiting for their upload, by content hash. The entry is dropped once the texture is in
+    // ms_TextureCache, or as soon as the decode fails.
+    static std::map<uint64_t, DecodedTexture> ms_DecodedTextures;
+    static std::mutex                         ms_DecodedTexturesMutex;
 };
 
 // Definition for inline functions.
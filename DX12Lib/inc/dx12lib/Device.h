@@ -142,9 +142,10 @@ public:
                                                               size_t numElements, size_t elementSize );
 
     /*
-     * Create a buffer that is mappable.
+     * Create a buffer that is mappable, on the upload heap or on the readback heap.
     */
-    std::shared_ptr<MappableBuffer> CreateMappableBuffer( size_t bufferSize );
+    std::shared_ptr<MappableBuffer> CreateMappableBuffer( size_t          bufferSize,
+                                                          D3D12_HEAP_TYPE heapType = D3D12_HEAP_TYPE_UPLOAD );
 
     /*
      * Create an Acceleration Structure Buffer.
@@ -167,6 +168,17 @@ public:
     std::shared_ptr<Texture> CreateTexture( Microsoft::WRL::ComPtr<ID3D12Resource> resource,
                                             const D3D12_CLEAR_VALUE*               clearValue = nullptr );
 
+    /**
+     * Create a Texture placed at heapOffset in heap, for textures that share memory. Resize does not keep it placed.
+     *
+     * Until an aliasing barrier makes it the active resource in its memory and it is cleared, copied to or
+     * discarded, its contents are undefined.
+     */
+    std::shared_ptr<Texture>
+        CreatePlacedTexture( ID3D12Heap* heap, uint64_t heapOffset, const D3D12_RESOURCE_DESC& resourceDesc,
+                             const D3D12_CLEAR_VALUE*    clearValue = nullptr,
+                             const D3D12_RESOURCE_STATES initState  = D3D12_RESOURCE_STATE_COMMON );
+
     std::shared_ptr<IndexBuffer> CreateIndexBuffer( size_t numIndicies, DXGI_FORMAT indexFormat );
     std::shared_ptr<IndexBuffer> CreateIndexBuffer( Microsoft::WRL::ComPtr<ID3D12Resource> resource, size_t numIndices,
                                                     DXGI_FORMAT indexFormat );
@@ -211,7 +223,8 @@ public:
     std::shared_ptr<ShaderTableResourceView> CreateShaderTableView( const uint32_t nbrTotalRenderTargets,
                                                                     const D3D12_SHADER_RESOURCE_VIEW_DESC*  raySrv,
                                                                     const D3D12_CONSTANT_BUFFER_VIEW_DESC*  pCbv,
-                                                                    dx12lib::Scene* pMeshes);
+                                                                    dx12lib::Scene* pMeshes,
+                                                                    const uint32_t nbrExtraUAVs = 0 );
 
 
     /**
@@ -16,9 +16,13 @@ public:
 
     HRESULT Map( void** pData );
     void    Unmap();
+    // Only the bytes from writtenBegin up to writtenEnd were written, none if they are equal.
+    void    Unmap( size_t writtenBegin, size_t writtenEnd );
 
 protected:
-    MappableBuffer( Device& device, const D3D12_RESOURCE_DESC& resDesc );
+    // An upload buffer, or with D3D12_HEAP_TYPE_READBACK one that copies are read back from.
+    MappableBuffer( Device& device, const D3D12_RESOURCE_DESC& resDesc,
+                    D3D12_HEAP_TYPE heapType = D3D12_HEAP_TYPE_UPLOAD );
     MappableBuffer( Device& device, Microsoft::WRL::ComPtr<ID3D12Resource> resource );
     virtual ~MappableBuffer() = default;
 
@@ -27,8 +31,9 @@ protected:
 class MakeMappableBuffer : public MappableBuffer
 {
 public:
-    MakeMappableBuffer( Device& device, const D3D12_RESOURCE_DESC& desc )
-    : MappableBuffer( device, desc )
+    MakeMappableBuffer( Device& device, const D3D12_RESOURCE_DESC& desc,
+                        D3D12_HEAP_TYPE heapType = D3D12_HEAP_TYPE_UPLOAD )
+    : MappableBuffer( device, desc, heapType )
     {}
 
     MakeMappableBuffer( Device& device, Microsoft::WRL::ComPtr<ID3D12Resource> resoruce )
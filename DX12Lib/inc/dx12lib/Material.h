@@ -45,6 +45,9 @@ class Texture;
 #define SPECULAR        1
 #define TRANSMISSIVE    2
 
+// RayMaterialProp::Flags, as in the shaders.
+#define MATERIAL_NORMAL_XY 1  // The normal map only stores X and Y (BC5 or two channels), Z is rebuilt.
+
 // clang-format off
 struct alignas( 16 ) MaterialProperties
 {
@@ -131,7 +134,8 @@ struct alignas( 16 ) RayMaterialProp
 
         , IndexOfRefraction( indexOfRefraction )
         , Roughness( 1.0f )
-        , _padding( 0, 0 )
+        , IndexSize( 4 )
+        , Flags( 0 )
 
         , DiffuseTextureIdx(-1)
         , NormalTextureIdx(-1)
@@ -156,10 +160,11 @@ struct alignas( 16 ) RayMaterialProp
 
     float IndexOfRefraction;
     float Roughness;
-    DirectX::XMFLOAT2 _padding;
+    unsigned int IndexSize;             // Of the geometry's index buffer, 2 or 4 bytes.
+    unsigned int Flags;                 // MATERIAL_NORMAL_XY.
     // ------------------------------------ ( 16 bytes )
 
-    // Total:                              ( 16 * 4 = 48 bytes )
+    // Total:                              ( 16 * 4 = 64 bytes )
 };
 
 // clang-format on
@@ -14,7 +14,9 @@ using namespace Microsoft::WRL;
 class ShaderHelper
 {
 public:
-    static ComPtr<IDxcBlob> CompileLibrary( const WCHAR* filename, const WCHAR* targetString );
+    // Includes resolve next to the file and in CPULib/inc, for the headers shared with CPULib.
+    static ComPtr<IDxcBlob> CompileLibrary( const WCHAR* filename, const WCHAR* targetString,
+                                            const DxcDefine* defines = nullptr, uint32_t defineCount = 0 );
 };
 
 struct DxilLibrary
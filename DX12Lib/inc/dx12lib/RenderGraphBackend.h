@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ *  Records the schedule of a cpulib::RenderGraph into a command list.
+ *
+ *  The graph handles are indices into the resources set with SetResource.
+ *  Transitions only pass on the state after, the ResourceStateTracker of the
+ *  command list knows the actual state before, so a resource that was used
+ *  outside the graph cannot get a wrong transition.
+ *
+ *  A resource taking over aliased memory gets its aliasing barrier, and is
+ *  discarded once the barriers are flushed and it is in the state of its
+ *  pass. A copy or a clear in that pass initialises it as well.
+ */
+
+#include <cpulib/RenderGraph.h>
+
+#include <d3d12.h>  // For D3D12_RESOURCE_STATES
+#include <memory>   // For std::shared_ptr
+#include <vector>   // For std::vector
+
+namespace dx12lib
+{
+
+class CommandList;
+class Resource;
+
+class CommandListGraphBackend : public cpulib::RenderGraphBackend
+{
+public:
+    explicit CommandListGraphBackend( CommandList& commandList )
+    : m_CommandList( commandList )
+    {}
+
+    void SetResource( uint32_t handle, const std::shared_ptr<Resource>& resource );
+
+    void Barrier( const cpulib::GraphBarrier& barrier ) override;
+    void FlushBarriers() override;
+    void BeginPass( uint32_t pass, const std::string& name ) override;
+    void Copy( uint32_t dst, uint32_t src ) override;
+
+    static D3D12_RESOURCE_STATES GetD3D12State( cpulib::GraphResourceState state );
+
+private:
+    CommandList&                           m_CommandList;
+    std::vector<std::shared_ptr<Resource>> m_Resources;
+    // Handles of the resources brought in by the barriers since the last flush.
+    std::vector<uint32_t> m_Discards;
+};
+
+}  // namespace dx12lib
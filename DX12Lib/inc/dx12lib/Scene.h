@@ -30,6 +30,13 @@
  *  @brief Scene file for storing scene data.
  */
 
+#include "VertexTypes.h"
+
+#include <cpulib/Bvh.h>
+#include <cpulib/MeshDedup.h>
+#include <cpulib/MeshOptimizer.h>
+#include <cpulib/TransformHierarchy.h>
+
 #include <DirectXCollision.h> // For DirectX::BoundingBox
 
 #include <filesystem>
@@ -38,12 +45,18 @@
 #include <set>
 #include <memory>
 #include <string>
+#include <vector>
 
 class aiMaterial;
 class aiMesh;
 class aiNode;
 class aiScene;
 
+namespace cpulib
+{
+class CookedSceneWriter;
+}
+
 namespace dx12lib
 {
 class CommandList;
@@ -54,18 +67,88 @@ class Material;
 class Visitor;
 class AccelerationStructure;
 class Texture;
+class TextureCooker;
+struct TextureCookOptions;
+struct TextureCookStats;
+
+/**
+ * Timings of the CPU side of a scene import, see Scene::BenchmarkImport.
+ */
+struct SceneImportStats
+{
+    uint32_t threads      = 0;
+    uint32_t meshes       = 0;
+    uint32_t textures     = 0;
+    uint64_t vertices     = 0;
+    uint64_t triangles    = 0;
+    uint64_t textureBytes = 0;
+
+    // The index buffers as imported, and how many meshes have 16 bit indices.
+    uint64_t indexBytes = 0;
+    uint32_t meshes16   = 0;
+
+    // Assimp reading (and preprocessing) the file.
+    double readSeconds = 0;
+    // Vertex and index conversion of all meshes, with the vertex cache optimization.
+    double meshSeconds = 0;
+    // Decoding all texture files.
+    double textureSeconds = 0;
+    // Meshes and textures on the same pool, as ImportScene runs them.
+    double combinedSeconds = 0;
+    // Mapping the cooked scene and copying its vertices and indices out, 0 if it isn't cooked yet.
+    double cookedSeconds = 0;
+    // Finding the copies among the meshes, as an import with instanceMeshes does.
+    double dedupSeconds = 0;
+
+    // The meshes after any split, and what instancing them would share.
+    cpulib::MeshDedupStats dedupStats;
+
+    // A binned SAH BVH over every triangle of the meshes, built on the pool.
+    cpulib::BvhBuildStats bvhStats;
+
+    // Vertex cache efficiency of every mesh before and after the import reordered it.
+    std::vector<cpulib::MeshOptimizeStats> meshOptimizeStats;
+};
 
 class Scene
 {
 public:
-    Scene( float scale = 1.0f )
+    /**
+     * @param splitLargeMeshes Import the meshes too large for 16 bit indices
+     * as several meshes that each fit.
+     * @param instanceMeshes Import the copies of a mesh as one mesh, placed
+     * by the scene nodes, see GetMeshInstances.
+     */
+    Scene( float scale = 1.0f, VertexFormat vertexFormat = VertexFormat::Full, bool splitLargeMeshes = false,
+           bool instanceMeshes = false )
     : _sceneScale( scale )
+    , m_VertexFormat( vertexFormat )
+    , m_SplitLargeMeshes( splitLargeMeshes )
+    , m_InstanceMeshes( instanceMeshes )
     { }
     ~Scene() = default;
 
     void BuildBottomLevelAccelerationStructure( dx12lib::Device* pDevice, 
         dx12lib::CommandList* pCommandList, AccelerationStructure* pDes );
 
+    /**
+     * One BLAS per GetMeshInstances().blases, in that order.
+     */
+    void BuildBottomLevelAccelerationStructures( dx12lib::Device* pDevice, dx12lib::CommandList* pCommandList,
+                                                 std::vector<AccelerationStructure>& blases );
+
+    /**
+     * The most a single BLAS over every mesh would take: what the scene
+     * needs without sharing the copies of its meshes.
+     */
+    uint64_t GetBottomLevelASSize( dx12lib::Device* pDevice ) const;
+
+    /**
+     * The bounds of the meshes of GetMeshInstances().blases[blas], where the
+     * BLAS has them: before the offset of any instance.
+     */
+    DirectX::BoundingBox GetBottomLevelAABB( size_t blas ) const;
+
     void SetRootNode( std::shared_ptr<SceneNode> node )
     {
         m_RootNode = node;
@@ -111,6 +194,65 @@ public:
         return _sceneScale;
     }
 
+    /**
+     * The layout of every vertex buffer of the scene, the hit shader has to
+     * be compiled for the same one.
+     */
+    VertexFormat GetVertexFormat() const
+    {
+        return m_VertexFormat;
+    }
+
+    bool GetSplitLargeMeshes() const
+    {
+        return m_SplitLargeMeshes;
+    }
+
+    bool GetInstanceMeshes() const
+    {
+        return m_InstanceMeshes;
+    }
+
+    /**
+     * How the meshes share their vertices: the BLASes to build over them and
+     * the instances of those to put in the TLAS. Every copy of a mesh is its
+     * own mesh, with its own material, but with the vertices and indices of
+     * the one it copies and a translation by its offset on its scene node.
+     * Without instanceMeshes, or without copies, one BLAS holds every mesh.
+     */
+    const cpulib::MeshInstancePlan& GetMeshInstances() const
+    {
+        return m_MeshInstances;
+    }
+
+    /**
+     * The transforms of every scene node, flattened parents first, see
+     * SceneNode::FlattenTransforms. Null before a scene is loaded.
+     */
+    const std::shared_ptr<cpulib::TransformHierarchy>& GetTransforms() const
+    {
+        return m_Transforms;
+    }
+
+    /**
+     * Recompute the world transforms of the scene nodes moved by
+     * SetLocalTransform since the last call, once a frame after moving them
+     * and before anything reads SceneNode::GetWorldTransform.
+     *
+     * @returns the number of scene nodes recomputed.
+     */
+    uint32_t UpdateTransforms();
+
+    /**
+     * How the import reordered every mesh for the vertex cache, one per
+     * mesh of the file, before any split. Empty for a scene loaded from its
+     * cooked file, which stores the meshes already reordered.
+     */
+    const std::vector<cpulib::MeshOptimizeStats>& GetMeshOptimizeStats() const
+    {
+        return m_MeshOptimizeStats;
+    }
+
     bool HasSkybox() const 
     {
         return skyboxIntensity.get() && skyboxDiffuse.get();
@@ -133,6 +275,26 @@ public:
 
     void MergeScene( std::shared_ptr<Scene> other );
 
+    /**
+     * Time the CPU stages of loading a scene file without a device: the
+     * Assimp read, the mesh conversion and the texture decodes, on a pool of
+     * numThreads threads (0 for all cores), and loading the cooked scene if
+     * there is one. Nothing is uploaded or cached.
+     *
+     * @returns false if the file can't be read.
+     */
+    static bool BenchmarkImport( const std::wstring& fileName, uint32_t numThreads, SceneImportStats& stats );
+
+    /**
+     * Cook the textures of a scene file ahead of time, see TextureCooker.
+     * Every texture ImportMaterial would load is converted once, to the
+     * format of what it is used for.
+     *
+     * @returns false if the file can't be read or a texture failed to cook.
+     */
+    static bool CookTextures( const std::wstring& fileName, const TextureCookOptions& options,
+                              TextureCookStats& stats );
+
 protected:
     friend class CommandList;
     friend class AccelerationBuffer;
@@ -140,6 +302,8 @@ protected:
 
     /**
      * Load a scene from a file on disc.
+     * The scene is cooked to a .cooked file next to it the first time, later
+     * loads map that instead of going through Assimp until the file changes.
      */
     bool LoadSceneFromFile( CommandList& commandList, const std::wstring& fileName,
                             const std::function<bool( float )>& loadingProgress );
@@ -155,11 +319,31 @@ protected:
     bool LoadSceneFromString( CommandList& commandList, const std::string& sceneStr, const std::string& format );
 
 private:
-    void ImportScene( CommandList& commandList, const aiScene& scene, std::filesystem::path parentPath );
+    // With cook, everything imported is also added to the cooked scene.
+    void ImportScene( CommandList& commandList, const aiScene& scene, std::filesystem::path parentPath,
+                      cpulib::CookedSceneWriter* cook = nullptr );
+    // false if the file is missing, invalid, or cooked from another version of the scene, vertex layout or split.
+    bool LoadCookedScene( CommandList& commandList, const std::filesystem::path& cookedPath,
+                          const std::filesystem::path& parentPath, uint64_t sourceStamp );
+    // Fill the texture sets from the materials.
+    void CollectTextures();
     void ImportMaterial( CommandList& commandList, const aiMaterial& material, std::filesystem::path parentPath );
-    void ImportMesh( CommandList& commandList, const aiMesh& mesh );
+    // Vertex and index data of one mesh, converted off the main thread.
+    struct MeshData;
+
+    static void ConvertMesh( const aiMesh& mesh, VertexFormat vertexFormat, bool splitLargeMeshes, MeshData& data );
+    void        ImportMesh( CommandList& commandList, uint32_t material, const MeshData& data );
+    // A copy of the mesh in slot source, with the vertices and indices of that one.
+    void ImportMeshCopy( uint32_t material, uint32_t source );
+    // Plan the slots of the meshes, see GetMeshInstances, or keep them in order without m_InstanceMeshes.
+    void PlanMeshInstances( const std::vector<cpulib::MeshGeometry>& meshes );
+    // Flatten the transforms of the scene nodes once the tree is built.
+    void FlattenTransforms();
+    // Add the mesh in the slot of mesh to node, through a child translated by its offset if it is a copy.
+    void AddSceneMesh( const std::shared_ptr<SceneNode>& node, uint32_t mesh );
+    // The meshes of Assimp mesh i are meshRanges[i] up to meshRanges[i + 1], in the order before PlanMeshInstances.
     std::shared_ptr<SceneNode> ImportSceneNode( CommandList& commandList, std::shared_ptr<SceneNode> parent,
-                                                const aiNode* aiNode );
+                                                const aiNode* aiNode, const std::vector<uint32_t>& meshRanges );
 
     using MaterialMap  = std::map<std::string, std::shared_ptr<Material>>;
     using MaterialList = std::vector<std::shared_ptr<Material>>;
@@ -183,5 +367,15 @@ private:
     
     float _sceneScale = 1.0;
 
+    VertexFormat m_VertexFormat = VertexFormat::Full;
+
+    bool m_SplitLargeMeshes = false;
+    bool m_InstanceMeshes   = false;
+
+    cpulib::MeshInstancePlan m_MeshInstances;
+
+    std::shared_ptr<cpulib::TransformHierarchy> m_Transforms;
+
+    std::vector<cpulib::MeshOptimizeStats> m_MeshOptimizeStats;
 };
 }  // namespace dx12lib
\ No newline at end of file
@@ -30,6 +30,8 @@
  *  @brief A node in a scene graph.
  */
 
+#include <cpulib/TransformHierarchy.h>
+
 #include <map>
 #include <memory>
 #include <string>
@@ -69,16 +71,41 @@ public:
 
     /**
      * Get the scene node's world transform (concatenated with its parents
-     * world transform).
+     * world transform). Once flattened only a read, the owner of the scene
+     * calls Scene::UpdateTransforms after a SetLocalTransform first.
      */
     DirectX::XMMATRIX GetWorldTransform() const;
 
     /**
      * Get the inverse of the world transform (concatenated with its parent's
-     * world transform).
+     * world transform). Read like GetWorldTransform.
      */
     DirectX::XMMATRIX GetInverseWorldTransform() const;
 
+    /**
+     * Add this node and everything below it to transforms, parents first.
+     * Until the tree changes again the world transforms are read from there,
+     * updated once for all nodes by Scene::UpdateTransforms, instead of
+     * walking the parents on every query.
+     */
+    void FlattenTransforms( const std::shared_ptr<cpulib::TransformHierarchy>& transforms,
+                            uint32_t parentIndex = cpulib::TRANSFORM_NO_PARENT );
+
+    /**
+     * Go back to walking the parents, for this node and everything below it.
+     * AddChild and SetParent( nullptr ) do this for the node they move.
+     */
+    void DetachTransforms();
+
+    /**
+     * The node of this scene node in the transforms it was flattened into,
+     * TRANSFORM_NO_PARENT if it isn't.
+     */
+    uint32_t GetTransformIndex() const
+    {
+        return m_Transforms ? m_TransformIndex : cpulib::TRANSFORM_NO_PARENT;
+    }
+
     /**
      * Add a child node to this scene node.
      * NOTE: Circular references are not checked.
@@ -115,6 +142,8 @@ public:
 
 protected:
     DirectX::XMMATRIX GetParentWorldTransform() const;
+    // Update the transforms this node is flattened into, if any.
+    void UpdateTransforms();
 
 private:
     using NodePtr     = std::shared_ptr<SceneNode>;
@@ -138,6 +167,10 @@ private:
     NodeNameMap              m_ChildrenByName;
     MeshList                 m_Meshes;
 
+    // Set by FlattenTransforms, the world transforms are cached in there.
+    std::shared_ptr<cpulib::TransformHierarchy> m_Transforms;
+    uint32_t                                    m_TransformIndex = 0;
+
     // The AABB for this scene node. 
     // Created by merging the AABB of the meshes.
     DirectX::BoundingBox m_AABB;
@@ -4,9 +4,11 @@
 #include <dx12lib/DescriptorAllocation.h>
 
 #include <dx12lib/DescriptorAllocatorPage.h>
+#include <dx12lib/Material.h>
 
 #include <d3d12.h>  // For D3D12_UNORDERED_ACCESS_VIEW_DESC and D3D12_CPU_DESCRIPTOR_HANDLE
 #include <memory>   // For std::shared_ptr
+#include <vector>
 
 
 namespace dx12lib
@@ -19,6 +21,7 @@ class VertexBuffer;
 class Scene;
 class MappableBuffer;
 class RenderTarget;
+class Texture;
 
 class ShaderTableResourceView
 {
@@ -29,18 +32,37 @@ public:
         return m_SrvUavHeap->GetGPUDescriptorHandleForHeapStart();
     }
 
+    D3D12_GPU_DESCRIPTOR_HANDLE GetGpuDescriptorHandle( const UINT offset ) const;
+
     ID3D12DescriptorHeap* GetTableHeap() const {
         return m_SrvUavHeap.Get();
     }
 
     void UpdateShaderTableUAV( const UINT offset, const uint32_t nbrRenderTargets, const RenderTarget* pRenderTargets );
+    void UpdateShaderTableUAV( const UINT offset, const uint32_t nbrTextures, const std::shared_ptr<Texture>* pTextures );
+    // A buffer view, such as the structured and raw buffers of the ray compaction.
+    void UpdateShaderTableUAV( const UINT offset, const std::shared_ptr<Resource>& buffer,
+                               const D3D12_UNORDERED_ACCESS_VIEW_DESC& uavDesc );
+
+    // Offset of the nbrExtraUAVs descriptors at the end of the heap.
+    UINT GetExtraUAVOffset() const
+    {
+        return m_ExtraUAVOffset;
+    }
+
+    // The GeometryMaterialMap as uploaded, one per mesh. Same layout as cpulib::RayMaterialProp.
+    const std::vector<RayMaterialProp>& GetMaterialProps() const
+    {
+        return m_MaterialProps;
+    }
 
 protected:
     ShaderTableResourceView( Device& device, 
                              const uint32_t nbrTotalRenderTargets, 
                              const D3D12_SHADER_RESOURCE_VIEW_DESC*  pRayTlasSrv,
                              const D3D12_CONSTANT_BUFFER_VIEW_DESC*  pCbv ,
-                             Scene* pMeshes);
+                             Scene* pMeshes,
+                             const uint32_t nbrExtraUAVs );
     virtual ~ShaderTableResourceView() = default;
 
 private:
@@ -49,6 +71,8 @@ private:
     Device&                                         m_Device;
     Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>    m_SrvUavHeap;
     std::shared_ptr<MappableBuffer>                 m_MaterialBuffer;
+    std::vector<RayMaterialProp>                    m_MaterialProps;
+    UINT                                            m_ExtraUAVOffset;
 };
 
 
@@ -58,8 +82,8 @@ public:
     MakeShaderTableView( Device& device, 
                          const uint32_t nbrTotalRenderTargets,
                          const D3D12_SHADER_RESOURCE_VIEW_DESC*  pRayTlasSrv,
-                         const D3D12_CONSTANT_BUFFER_VIEW_DESC* pCbv, Scene* pMeshes )
-    : ShaderTableResourceView( device, nbrTotalRenderTargets, pRayTlasSrv, pCbv, pMeshes )
+                         const D3D12_CONSTANT_BUFFER_VIEW_DESC* pCbv, Scene* pMeshes, const uint32_t nbrExtraUAVs )
+    : ShaderTableResourceView( device, nbrTotalRenderTargets, pRayTlasSrv, pCbv, pMeshes, nbrExtraUAVs )
     {}
 
 
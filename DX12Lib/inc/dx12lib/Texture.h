@@ -108,6 +108,8 @@ public:
     static bool IsSRGBFormat( DXGI_FORMAT format );
     static bool IsBGRFormat( DXGI_FORMAT format );
     static bool IsDepthFormat( DXGI_FORMAT format );
+    // Only a red and a green channel, as BC5, R8G8 or R16G16.
+    static bool IsTwoChannelFormat( DXGI_FORMAT format );
 
     // Return a typeless format from the given format.
     static DXGI_FORMAT GetTypelessFormat( DXGI_FORMAT format );
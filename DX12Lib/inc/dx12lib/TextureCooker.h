@@ -0,0 +1,124 @@
+#pragma once
+
+/*
+ *  Offline conversion of a scene's textures to block compressed DDS files
+ *  with their full mip chain, so loading them is a file read and an upload:
+ *  no image decode and no GenerateMips on the GPU.
+ *
+ *  The cooked files live in one cache directory, named after the content
+ *  hash of their source (cpulib::HashFile) mixed with TEXTURE_COOKER_VERSION.
+ *  The same image under two paths is cooked once, and editing a source
+ *  simply misses the cache. AcquireDecodedTexture looks every texture up in
+ *  the cache before decoding it.
+ *
+ *  The format follows how the shaders sample the texture:
+ *
+ *      Color    BC7, RGB and alpha
+ *      Normal   BC5, X and Y, the hit shader rebuilds Z
+ *      Channel  BC4, only the red channel is read (specular, masks, bumps)
+ *
+ *  Images whose size isn't a multiple of the 4x4 block stay RGBA8, still
+ *  with mips. The mips are filtered on the CPU, in linear space for sRGB
+ *  textures, and the compression is spread over a thread pool in strips of
+ *  blocks, across all textures of a batch at once.
+ */
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace dx12lib
+{
+
+// Part of the cache key, bump it when the cooked output changes.
+static const uint64_t TEXTURE_COOKER_VERSION = 1;
+
+/**
+ * What a texture is sampled for. Ordered: a texture used for several takes
+ * the format of the one that needs the most channels.
+ */
+enum class TextureUsage
+{
+    Channel,
+    // A height map, or a normal map in its place: Normal if it has 24 bits or
+    // more per pixel, Channel otherwise.
+    Bump,
+    Normal,
+    Color,
+};
+
+struct TextureCookOptions
+{
+    // 0 for all cores.
+    uint32_t numThreads = 0;
+    // Cook even what is in the cache already.
+    bool force = false;
+    // BC7 with only the fastest modes, about 20 times quicker at a small loss.
+    bool quick = true;
+};
+
+struct TextureCookStats
+{
+    uint32_t textures     = 0;
+    uint32_t cooked       = 0;
+    uint32_t cached       = 0;
+    // Cooked, but left uncompressed because the size isn't a multiple of 4.
+    uint32_t uncompressed = 0;
+
+    uint64_t sourceBytes = 0;
+    uint64_t cookedBytes = 0;
+    double   seconds     = 0;
+
+    // One line per texture that couldn't be cooked.
+    std::vector<std::wstring> failures;
+};
+
+class TextureCooker
+{
+public:
+    /**
+     * Where the cooked textures are written and looked up, relative to the
+     * working directory unless absolute. "Cache/Textures" by default.
+     */
+    static void                         SetCacheDirectory( const std::filesystem::path& directory );
+    static const std::filesystem::path& GetCacheDirectory();
+
+    /**
+     * The cooked file of source, whether it exists or not. Empty if source
+     * can't be read.
+     */
+    static std::filesystem::path GetCookedPath( const std::filesystem::path& source );
+    static std::filesystem::path GetCookedPath( uint64_t contentHash );
+
+    /**
+     * The cooked file of source, or of the source with that content hash, if
+     * the cache has it. Empty otherwise.
+     */
+    static std::filesystem::path FindCookedTexture( const std::filesystem::path& source );
+    static std::filesystem::path FindCookedTexture( uint64_t contentHash );
+
+    /**
+     * Queue a texture, a file added twice is cooked once for both usages.
+     */
+    void AddTexture( const std::filesystem::path& source, TextureUsage usage, bool sRGB );
+
+    /**
+     * Cook everything added that the cache doesn't have yet.
+     *
+     * @returns false if any texture failed, see stats.failures.
+     */
+    bool Cook( const TextureCookOptions& options, TextureCookStats& stats );
+
+private:
+    struct Entry
+    {
+        std::filesystem::path source;
+        TextureUsage          usage;
+        bool                  sRGB;
+    };
+
+    std::vector<Entry> m_Entries;
+};
+
+}  // namespace dx12lib
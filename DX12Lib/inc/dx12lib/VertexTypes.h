@@ -34,9 +34,22 @@
 
 #include <d3d12.h>
 
+#include <cstdint>
+
 namespace dx12lib
 {
 
+/**
+ * The vertex layout a Scene imports its meshes to.
+ */
+enum class VertexFormat
+{
+    // VertexPositionNormalTangentBitangentTexture, 60 bytes.
+    Full,
+    // VertexPositionPackedNormalTangentTexture, 24 bytes, see cpulib/VertexEncoding.h.
+    Packed,
+};
+
 struct VertexPosition
 {
     VertexPosition() = default;
@@ -97,4 +110,22 @@ private:
     static const int                      InputElementCount = 5;
     static const D3D12_INPUT_ELEMENT_DESC InputElements[InputElementCount];
 };
+
+/**
+ * Position as is for the BLAS, octahedral normal and tangent with the
+ * bitangent sign, half texture coordinates. Packed and unpacked by
+ * cpulib/VertexCodec.h and the functions of cpulib/VertexEncoding.h.
+ */
+struct VertexPositionPackedNormalTangentTexture
+{
+    DirectX::XMFLOAT3 Position;
+    uint32_t          Normal;
+    uint32_t          Tangent;
+    uint32_t          TexCoord;
+
+    static const D3D12_INPUT_LAYOUT_DESC InputLayout;
+private:
+    static const int                      InputElementCount = 4;
+    static const D3D12_INPUT_ELEMENT_DESC InputElements[InputElementCount];
+};
 }  // namespace dx12lib
@@ -14,17 +14,14 @@
 using namespace dx12lib;
 
 
-void AccelerationBuffer::CreateBottomLevelAS(Device* pDevice,
-    CommandList* pCommandList, Scene* pScene, AccelerationStructure* pDes) 
+static std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> GetGeometryDescs( const std::vector<std::shared_ptr<Mesh>>& meshes )
 {
-    int idx           = 0;
-    int geometryCount = pScene->m_Meshes.size();
+    int idx = 0;
 
-    // Get prebuild infos
     std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDesc;
-    geomDesc.resize( geometryCount );
+    geomDesc.resize( meshes.size() );
 
-    for (std::shared_ptr<Mesh> m : pScene->m_Meshes) {
+    for (std::shared_ptr<Mesh> m : meshes) {
         geomDesc[idx].Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
         // NOTE: As a vertex can contain more than just the XYZ position it thus has stride defined seperatly.
         
@@ -46,14 +43,46 @@ void AccelerationBuffer::CreateBottomLevelAS(Device* pDevice,
         ++idx;
     }
 
-    // Get the size requirements for the scratch and AS buffers
+    return geomDesc;
+}
+
+static D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS GetBottomLevelInputs(
+    const std::vector<D3D12_RAYTRACING_GEOMETRY_DESC>& geomDesc )
+{
     D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
     inputs.DescsLayout                                          = D3D12_ELEMENTS_LAYOUT_ARRAY;
     inputs.Flags          = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
-    inputs.NumDescs       = geometryCount;
+    inputs.NumDescs       = static_cast<UINT>( geomDesc.size() );
     inputs.pGeometryDescs = geomDesc.data();
     inputs.Type           = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+    return inputs;
+}
 
+void AccelerationBuffer::CreateBottomLevelAS(Device* pDevice,
+    CommandList* pCommandList, Scene* pScene, AccelerationStructure* pDes) 
+{
+    CreateBottomLevelAS( pDevice, pCommandList, pScene->m_Meshes, pDes );
+}
+
+uint64_t AccelerationBuffer::GetBottomLevelASSize( Device* pDevice, const std::vector<std::shared_ptr<Mesh>>& meshes )
+{
+    std::vector<D3D12_RAYTRACING_GEOMETRY_DESC>          geomDesc = GetGeometryDescs( meshes );
+    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs   = GetBottomLevelInputs( geomDesc );
+
+    D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
+    pDevice->GetRaytracingAccelerationStructurePrebuildInfo( &inputs, &info );
+    return info.ResultDataMaxSizeInBytes;
+}
+
+void AccelerationBuffer::CreateBottomLevelAS( Device* pDevice, CommandList* pCommandList,
+                                              const std::vector<std::shared_ptr<Mesh>>& meshes,
+                                              AccelerationStructure*                    pDes )
+{
+    // Get prebuild infos
+    std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDesc = GetGeometryDescs( meshes );
+
+    // Get the size requirements for the scratch and AS buffers
+    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = GetBottomLevelInputs( geomDesc );
 
     D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
     pDevice->GetRaytracingAccelerationStructurePrebuildInfo( &inputs, &info );
@@ -104,7 +133,12 @@ void AccelerationBuffer::CreateTopLevelAS(
     pDevice->GetRaytracingAccelerationStructurePrebuildInfo( &inputs, &info );
 
 
-    if (update) {
+    // A rebuild into buffers that are large enough keeps them, so the TLAS keeps its address.
+    const bool reuse = pDes->pResult && pDes->pScratch &&
+                       pDes->pResult->GetD3D12ResourceDesc().Width >= info.ResultDataMaxSizeInBytes &&
+                       pDes->pScratch->GetD3D12ResourceDesc().Width >= info.ScratchDataSizeInBytes;
+
+    if ( update || reuse ) {
         pCommandList->UAVBarrier( pDes->pResult );
     } else {
         pDes->pScratch = pDevice->CreateAccelerationBuffer( info.ScratchDataSizeInBytes, 
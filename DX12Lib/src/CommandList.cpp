@@ -24,12 +24,15 @@
 #include <dx12lib/ShaderResourceView.h>
 #include <dx12lib/StructuredBuffer.h>
 #include <dx12lib/Texture.h>
+#include <dx12lib/TextureCooker.h>
 #include <dx12lib/UnorderedAccessView.h>
 #include <dx12lib/UploadBuffer.h>
 #include <dx12lib/VertexBuffer.h>
 #include <dx12lib/AccelerationStructure.h>
 #include <dx12lib/ShaderTable.h>
 
+#include <cpulib/ContentHash.h>
+
 using namespace dx12lib;
 
 // Adapter for std::make_unique
@@ -43,8 +46,39 @@ public:
     virtual ~MakeUploadBuffer() {}
 };
 
-std::map<std::wstring, ID3D12Resource*> CommandList::ms_TextureCache;
-std::mutex                              CommandList::ms_TextureCacheMutex;
+// COM for the lifetime of a thread, WIC needs it on the decoding thread. Initialising it once per thread keeps it out
+// of every decode. A thread that already has COM in another mode keeps it, WIC works with either.
+class ComThreadGuard
+{
+public:
+    ComThreadGuard()
+    : m_Result( CoInitializeEx( nullptr, COINIT_MULTITHREADED ) )
+    {}
+
+    ~ComThreadGuard()
+    {
+        if ( SUCCEEDED( m_Result ) )
+        {
+            CoUninitialize();
+        }
+    }
+
+private:
+    HRESULT m_Result;
+};
+
+struct CommandList::TextureCache
+{
+    // The resources nothing uses anymore are kept up to 1 GB in all.
+    cpulib::ContentCache<Microsoft::WRL::ComPtr<ID3D12Resource>> textures { 1ull << 30 };
+    std::mutex                                                   mutex;
+};
+
+std::shared_ptr<CommandList::TextureCache>       CommandList::ms_TextureCache = std::make_shared<TextureCache>();
+std::map<std::wstring, CommandList::TextureHash> CommandList::ms_TextureHashes;
+std::mutex                                       CommandList::ms_TextureHashesMutex;
+std::map<uint64_t, CommandList::DecodedTexture>  CommandList::ms_DecodedTextures;
+std::mutex                                       CommandList::ms_DecodedTexturesMutex;
 
 CommandList::CommandList( Device& device, D3D12_COMMAND_LIST_TYPE type )
 : m_Device( device )
@@ -145,6 +179,17 @@ void CommandList::FlushResourceBarriers()
     m_ResourceStateTracker->FlushResourceBarriers( shared_from_this() );
 }
 
+void CommandList::DiscardResource( const std::shared_ptr<Resource>& resource )
+{
+    assert( resource );
+
+    FlushResourceBarriers();
+
+    m_d3d12CommandList->DiscardResource( resource->GetD3D12Resource().Get(), nullptr );
+
+    TrackResource( resource );
+}
+
 void CommandList::CopyResource( Microsoft::WRL::ComPtr<ID3D12Resource> dstRes,
                                 Microsoft::WRL::ComPtr<ID3D12Resource> srcRes )
 {
@@ -249,8 +294,20 @@ std::shared_ptr<IndexBuffer> CommandList::CopyIndexBuffer( size_t numIndicies, D
                                                            const void* indexBufferData )
 {
     size_t elementSize = indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4;
+    size_t bufferSize  = numIndicies * elementSize;
+    // The hit shaders read the indices through a raw view, which covers whole 32 bit words. An odd number of 16 bit
+    // indices is padded to the next one.
+    size_t alignedSize = Math::AlignUp( bufferSize, 4 );
 
-    auto d3d12Resource = CopyBuffer( numIndicies * elementSize, indexBufferData );
+    std::vector<uint8_t> padded;
+    if ( alignedSize != bufferSize && indexBufferData != nullptr )
+    {
+        padded.resize( alignedSize, 0 );
+        std::memcpy( padded.data(), indexBufferData, bufferSize );
+        indexBufferData = padded.data();
+    }
+
+    auto d3d12Resource = CopyBuffer( alignedSize, indexBufferData );
 
     std::shared_ptr<IndexBuffer> indexBuffer = m_Device.CreateIndexBuffer( d3d12Resource, numIndicies, indexFormat );
 
@@ -292,42 +349,202 @@ void CommandList::SetPrimitiveTopology( D3D_PRIMITIVE_TOPOLOGY primitiveTopology
     m_d3d12CommandList->IASetPrimitiveTopology( primitiveTopology );
 }
 
-std::shared_ptr<Texture> CommandList::LoadTextureFromFile( const std::wstring& fileName, bool sRGB, bool generateMips )
+std::shared_ptr<const ScratchImage> CommandList::DecodeTextureFromFile( const std::wstring& fileName )
 {
-    std::shared_ptr<Texture> texture;
-    fs::path                 filePath( fileName );
+    fs::path filePath( fileName );
     if ( !fs::exists( filePath ) )
     {
         throw std::exception( "File not found." );
     }
 
-    std::lock_guard<std::mutex> lock( ms_TextureCacheMutex );
-    auto                        iter = ms_TextureCache.find( fileName );
-    if ( iter != ms_TextureCache.end() )
+    // The import runs this on worker threads, COM is initialised on the first decode of each one.
+    thread_local ComThreadGuard comGuard;
+
+    auto        scratchImage = std::make_shared<ScratchImage>();
+    TexMetadata metadata;
+    HRESULT     hr;
+
+    if ( filePath.extension() == ".dds" )
+    {
+        hr = LoadFromDDSFile( fileName.c_str(), DDS_FLAGS_FORCE_RGB, &metadata, *scratchImage );
+    }
+    else if ( filePath.extension() == ".hdr" )
+    {
+        hr = LoadFromHDRFile( fileName.c_str(), &metadata, *scratchImage );
+    }
+    else if ( filePath.extension() == ".tga" )
     {
-        texture = m_Device.CreateTexture( iter->second );
+        hr = LoadFromTGAFile( fileName.c_str(), &metadata, *scratchImage );
     }
     else
     {
-        TexMetadata  metadata;
-        ScratchImage scratchImage;
+        hr = LoadFromWICFile( fileName.c_str(), WIC_FLAGS_FORCE_RGB, &metadata, *scratchImage );
+    }
 
-        if ( filePath.extension() == ".dds" )
+    ThrowIfFailed( hr );
+
+    return scratchImage;
+}
+
+uint64_t CommandList::GetTextureContentHash( const std::wstring& fileName )
+{
+    const fs::file_time_type lastWriteTime = fs::last_write_time( fileName );
+    {
+        std::lock_guard<std::mutex> lock( ms_TextureHashesMutex );
+        auto                        iter = ms_TextureHashes.find( fileName );
+        if ( iter != ms_TextureHashes.end() && iter->second.lastWriteTime == lastWriteTime )
         {
-            ThrowIfFailed( LoadFromDDSFile( fileName.c_str(), DDS_FLAGS_FORCE_RGB, &metadata, scratchImage ) );
+            return iter->second.contentHash;
         }
-        else if ( filePath.extension() == ".hdr" )
+    }
+
+    // Hash outside of the lock, two threads hashing the same file agree anyway.
+    uint64_t    contentHash;
+    std::string error;
+    if ( !cpulib::HashFile( fileName, contentHash, 0, &error ) )
+    {
+        throw std::exception( error.c_str() );
+    }
+
+    std::lock_guard<std::mutex> lock( ms_TextureHashesMutex );
+    ms_TextureHashes[fileName] = { lastWriteTime, contentHash };
+    return contentHash;
+}
+
+// The cache key of a texture: the same content loaded as sRGB or without mips is another resource.
+static uint64_t GetTextureKey( uint64_t contentHash, bool sRGB, bool generateMips )
+{
+    const uint64_t loadFlags = ( sRGB ? 1 : 0 ) | ( generateMips ? 2 : 0 );
+    return cpulib::HashBytes( &contentHash, sizeof( contentHash ), loadFlags );
+}
+
+CommandList::DecodedTexture CommandList::AcquireDecodedTexture( uint64_t contentHash, const std::wstring& fileName )
+{
+    std::promise<std::shared_ptr<const ScratchImage>> promise;
+    DecodedTexture                                     decoded;
+
+    {
+        std::lock_guard<std::mutex> lock( ms_DecodedTexturesMutex );
+        auto                        iter = ms_DecodedTextures.find( contentHash );
+        if ( iter != ms_DecodedTextures.end() )
         {
-            ThrowIfFailed( LoadFromHDRFile( fileName.c_str(), &metadata, scratchImage ) );
+            return iter->second;
         }
-        else if ( filePath.extension() == ".tga" )
+
+        decoded = promise.get_future().share();
+        ms_DecodedTextures.emplace( contentHash, decoded );
+    }
+
+    // First one to ask, decode outside of the lock. A cooked copy has its mips and is block compressed already.
+    try
+    {
+        fs::path cookedPath = TextureCooker::FindCookedTexture( contentHash );
+        promise.set_value( DecodeTextureFromFile( cookedPath.empty() ? fileName : cookedPath.wstring() ) );
+    }
+    catch ( ... )
+    {
+        promise.set_exception( std::current_exception() );
+
+        // Those waiting on it get the error, the next one to ask tries again (the file may be fixed by then).
+        std::lock_guard<std::mutex> lock( ms_DecodedTexturesMutex );
+        ms_DecodedTextures.erase( contentHash );
+    }
+
+    return decoded;
+}
+
+void CommandList::PrefetchTextureFromFile( const std::wstring& fileName )
+{
+    // A file that can't be read is reported by LoadTextureFromFile.
+    uint64_t contentHash;
+    try
+    {
+        contentHash = GetTextureContentHash( fileName );
+    }
+    catch ( const std::exception& )
+    {
+        return;
+    }
+
+    {
+        // Nothing to decode if the content is uploaded already, however it was loaded.
+        std::lock_guard<std::mutex> lock( ms_TextureCache->mutex );
+        for ( int loadFlags = 0; loadFlags < 4; ++loadFlags )
         {
-            ThrowIfFailed( LoadFromTGAFile( fileName.c_str(), &metadata, scratchImage ) );
+            const uint64_t key = GetTextureKey( contentHash, ( loadFlags & 1 ) != 0, ( loadFlags & 2 ) != 0 );
+            if ( ms_TextureCache->textures.Contains( key ) )
+            {
+                return;
+            }
         }
-        else
+    }
+
+    AcquireDecodedTexture( contentHash, fileName );
+}
+
+void CommandList::SetTextureCacheBudget( uint64_t budget )
+{
+    std::lock_guard<std::mutex> lock( ms_TextureCache->mutex );
+    ms_TextureCache->textures.SetBudget( budget );
+}
+
+cpulib::ContentCacheStats CommandList::GetTextureCacheStats()
+{
+    std::lock_guard<std::mutex> lock( ms_TextureCache->mutex );
+    return ms_TextureCache->textures.GetStats();
+}
+
+void CommandList::ClearTextureCache()
+{
+    std::lock_guard<std::mutex> lock( ms_TextureCache->mutex );
+    ms_TextureCache->textures.EvictUnreferenced();
+}
+
+std::shared_ptr<Texture> CommandList::ShareCachedTexture( std::shared_ptr<Texture> texture, uint64_t key )
+{
+    // The deleter keeps the cache alive, a texture may outlive the statics.
+    std::shared_ptr<TextureCache> cache    = ms_TextureCache;
+    Texture*                      pTexture = texture.get();
+    return std::shared_ptr<Texture>( pTexture, [texture, cache, key]( Texture* ) {
+        std::lock_guard<std::mutex> lock( cache->mutex );
+        cache->textures.Release( key );
+    } );
+}
+
+std::shared_ptr<Texture> CommandList::LoadTextureFromFile( const std::wstring& fileName, bool sRGB, bool generateMips )
+{
+    fs::path filePath( fileName );
+    if ( !fs::exists( filePath ) )
+    {
+        throw std::exception( "File not found." );
+    }
+
+    const uint64_t                         contentHash = GetTextureContentHash( fileName );
+    const uint64_t                         key         = GetTextureKey( contentHash, sRGB, generateMips );
+    Microsoft::WRL::ComPtr<ID3D12Resource> textureResource;
+
+    {
+        std::lock_guard<std::mutex> lock( ms_TextureCache->mutex );
+        if ( ms_TextureCache->textures.Acquire( key, textureResource ) )
         {
-            ThrowIfFailed( LoadFromWICFile( fileName.c_str(), WIC_FLAGS_FORCE_RGB, &metadata, scratchImage ) );
+            return ShareCachedTexture( m_Device.CreateTexture( textureResource ), key );
         }
+    }
+
+    // Rethrows the decode error, if any.
+    std::shared_ptr<const ScratchImage> scratchImage = AcquireDecodedTexture( contentHash, fileName ).get();
+
+    std::lock_guard<std::mutex> lock( ms_TextureCache->mutex );
+
+    // Someone else may have uploaded it while this thread was decoding.
+    std::shared_ptr<Texture> texture;
+    if ( ms_TextureCache->textures.Acquire( key, textureResource ) )
+    {
+        texture = m_Device.CreateTexture( textureResource );
+    }
+    else
+    {
+        TexMetadata metadata = scratchImage->GetMetadata();
 
         // Force the texture format to be sRGB to convert to linear when sampling the texture in a shader.
         if ( sRGB )
@@ -335,6 +552,10 @@ std::shared_ptr<Texture> CommandList::LoadTextureFromFile( const std::wstring& f
             metadata.format = MakeSRGB( metadata.format );
         }
 
+        // A cooked texture brings its own mips, 0 lets the resource have the whole chain for GenerateMips.
+        const UINT16 mipLevels =
+            metadata.mipLevels > 1 ? static_cast<UINT16>( metadata.mipLevels ) : ( generateMips ? 0 : 1 );
+
         D3D12_RESOURCE_DESC textureDesc = {};
         switch ( metadata.dimension )
         {
@@ -345,7 +566,7 @@ std::shared_ptr<Texture> CommandList::LoadTextureFromFile( const std::wstring& f
         case TEX_DIMENSION_TEXTURE2D:
             textureDesc = CD3DX12_RESOURCE_DESC::Tex2D( metadata.format, static_cast<UINT64>( metadata.width ),
                                                         static_cast<UINT>( metadata.height ),
-                                                        static_cast<UINT16>( metadata.arraySize ), generateMips ? 0 : 1 );
+                                                        static_cast<UINT16>( metadata.arraySize ), mipLevels );
             break;
         case TEX_DIMENSION_TEXTURE3D:
             textureDesc = CD3DX12_RESOURCE_DESC::Tex3D( metadata.format, static_cast<UINT64>( metadata.width ),
@@ -357,8 +578,7 @@ std::shared_ptr<Texture> CommandList::LoadTextureFromFile( const std::wstring& f
             break;
         }
 
-        auto                                   d3d12Device = m_Device.GetD3D12Device();
-        Microsoft::WRL::ComPtr<ID3D12Resource> textureResource;
+        auto d3d12Device = m_Device.GetD3D12Device();
 
         ThrowIfFailed( d3d12Device->CreateCommittedResource(
             &CD3DX12_HEAP_PROPERTIES( D3D12_HEAP_TYPE_DEFAULT ), D3D12_HEAP_FLAG_NONE, &textureDesc,
@@ -370,9 +590,9 @@ std::shared_ptr<Texture> CommandList::LoadTextureFromFile( const std::wstring& f
         // Update the global state tracker.
         ResourceStateTracker::AddGlobalResourceState( textureResource.Get(), D3D12_RESOURCE_STATE_COMMON );
 
-        std::vector<D3D12_SUBRESOURCE_DATA> subresources( scratchImage.GetImageCount() );
-        const Image*                        pImages = scratchImage.GetImages();
-        for ( int i = 0; i < scratchImage.GetImageCount(); ++i )
+        std::vector<D3D12_SUBRESOURCE_DATA> subresources( scratchImage->GetImageCount() );
+        const Image*                        pImages = scratchImage->GetImages();
+        for ( int i = 0; i < scratchImage->GetImageCount(); ++i )
         {
             auto& subresource      = subresources[i];
             subresource.RowPitch   = pImages[i].rowPitch;
@@ -387,11 +607,19 @@ std::shared_ptr<Texture> CommandList::LoadTextureFromFile( const std::wstring& f
             GenerateMips( texture );
         }
 
-        // Add the texture resource to the texture cache.
-        ms_TextureCache[fileName] = textureResource.Get();
+        // Add the texture resource to the texture cache, charged what it takes on the GPU.
+        const D3D12_RESOURCE_DESC resourceDesc = textureResource->GetDesc();
+        ms_TextureCache->textures.Insert( key, textureResource,
+                                          d3d12Device->GetResourceAllocationInfo( 0, 1, &resourceDesc ).SizeInBytes );
     }
 
-    return texture;
+    // The pixels are on the GPU now (or on their way), the decoded copy is no longer needed.
+    {
+        std::lock_guard<std::mutex> decodedLock( ms_DecodedTexturesMutex );
+        ms_DecodedTextures.erase( contentHash );
+    }
+
+    return ShareCachedTexture( texture, key );
 }
 
 void CommandList::GenerateMips( const std::shared_ptr<Texture>& texture )
@@ -721,9 +949,12 @@ void CommandList::PanoToCubemap( const std::shared_ptr<Texture>& cubemapTexture,
 
 std::shared_ptr<Scene> CommandList::LoadSceneFromFile( const std::wstring&                 fileName,
                                                        const float                         scale,
-                                                       const std::function<bool( float )>& loadingProgress )
+                                                       const std::function<bool( float )>& loadingProgress,
+                                                       VertexFormat                        vertexFormat,
+                                                       bool                                splitLargeMeshes,
+                                                       bool                                instanceMeshes )
 {
-    auto scene = std::make_shared<Scene>( scale );
+    auto scene = std::make_shared<Scene>( scale, vertexFormat, splitLargeMeshes, instanceMeshes );
 
     if ( scene->LoadSceneFromFile( *this, fileName, loadingProgress ) )
     {
@@ -768,6 +999,7 @@ std::shared_ptr<Scene> CommandList::CreateScene( const VertexCollection& vertice
     scene->SetRootNode( node );
     scene->m_Meshes.clear();
     scene->m_Meshes.push_back( mesh );
+    scene->m_MeshInstances = cpulib::PlanSingleBlas( 1 );
 
     scene->m_Materials.clear();
     scene->m_Materials.push_back( material );
@@ -1781,6 +2013,20 @@ void CommandList::DispatchRays(D3D12_DISPATCH_RAYS_DESC* pRaytraceDesc)
     m_d3d12CommandList->DispatchRays( pRaytraceDesc );
 }
 
+void CommandList::ExecuteIndirect( ID3D12CommandSignature* commandSignature,
+                                   const std::shared_ptr<Resource>& argumentBuffer, uint64_t argumentOffset )
+{
+    assert( commandSignature && argumentBuffer );
+
+    TransitionBarrier( argumentBuffer, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+                       true );
+
+    m_d3d12CommandList->ExecuteIndirect( commandSignature, 1, argumentBuffer->GetD3D12Resource().Get(),
+                                         argumentOffset, nullptr, 0 );
+
+    TrackResource( argumentBuffer );
+}
+
 bool CommandList::Close( const std::shared_ptr<CommandList>& pendingCommandList )
 {
     // Flush any remaining barriers.
@@ -442,12 +442,12 @@ std::shared_ptr<StructuredBuffer> Device::CreateStructuredBuffer( ComPtr<ID3D12R
     return structuredBuffer;
 }
 
-std::shared_ptr<MappableBuffer> dx12lib::Device::CreateMappableBuffer( size_t bufferSize)
+std::shared_ptr<MappableBuffer> dx12lib::Device::CreateMappableBuffer( size_t bufferSize, D3D12_HEAP_TYPE heapType )
 {
     bufferSize = Math::AlignUp( bufferSize, 4 );
 
     std::shared_ptr<MappableBuffer> buffer = std::make_shared<MakeMappableBuffer>(
-        *this, CD3DX12_RESOURCE_DESC::Buffer( bufferSize, D3D12_RESOURCE_FLAG_NONE ) );
+        *this, CD3DX12_RESOURCE_DESC::Buffer( bufferSize, D3D12_RESOURCE_FLAG_NONE ), heapType );
 
     return buffer;
 }
@@ -517,6 +517,22 @@ std::shared_ptr<Texture> Device::CreateTexture( Microsoft::WRL::ComPtr<ID3D12Res
     return texture;
 }
 
+std::shared_ptr<Texture> Device::CreatePlacedTexture( ID3D12Heap* heap, uint64_t heapOffset,
+                                                      const D3D12_RESOURCE_DESC&  resourceDesc,
+                                                      const D3D12_CLEAR_VALUE*    clearValue,
+                                                      const D3D12_RESOURCE_STATES initState )
+{
+    assert( heap );
+
+    ComPtr<ID3D12Resource> resource;
+    ThrowIfFailed( m_d3d12Device->CreatePlacedResource( heap, heapOffset, &resourceDesc, initState, clearValue,
+                                                        IID_PPV_ARGS( &resource ) ) );
+
+    ResourceStateTracker::AddGlobalResourceState( resource.Get(), initState );
+
+    return CreateTexture( resource, clearValue );
+}
+
 std::shared_ptr<dx12lib::RootSignature>
     dx12lib::Device::CreateRootSignature( const D3D12_ROOT_SIGNATURE_DESC1& rootSignatureDesc )
 {
@@ -581,10 +597,11 @@ std::shared_ptr<UnorderedAccessView>
 std::shared_ptr<ShaderTableResourceView> Device::CreateShaderTableView( const uint32_t      nbrTotalRenderTargets,
                                                                         const D3D12_SHADER_RESOURCE_VIEW_DESC*  raySrv,
                                                                         const D3D12_CONSTANT_BUFFER_VIEW_DESC*  pCbv,
-                                                                        Scene* pMeshes)
+                                                                        Scene* pMeshes,
+                                                                        const uint32_t nbrExtraUAVs )
 {
     std::shared_ptr<ShaderTableResourceView> unorderedAccessView =
-        std::make_shared<MakeShaderTableView>( *this, nbrTotalRenderTargets, raySrv, pCbv, pMeshes );
+        std::make_shared<MakeShaderTableView>( *this, nbrTotalRenderTargets, raySrv, pCbv, pMeshes, nbrExtraUAVs );
 
     return unorderedAccessView;
 }
@@ -23,7 +23,7 @@ IndexBuffer::IndexBuffer( Device& device, Microsoft::WRL::ComPtr<ID3D12Resource>
 , m_IndexFormat( indexFormat )
 , m_IndexBufferView {}
 {
-    assert(  indexFormat == DXGI_FORMAT_R32_UINT );
+    assert( indexFormat == DXGI_FORMAT_R16_UINT || indexFormat == DXGI_FORMAT_R32_UINT );
     CreateIndexBufferView();
 }
 
@@ -5,8 +5,10 @@
 
 using namespace dx12lib;
 
-MappableBuffer::MappableBuffer( Device& device, const D3D12_RESOURCE_DESC& resDesc )
-: Resource( device, resDesc, nullptr, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_HEAP_TYPE_UPLOAD )
+MappableBuffer::MappableBuffer( Device& device, const D3D12_RESOURCE_DESC& resDesc, D3D12_HEAP_TYPE heapType )
+: Resource( device, resDesc, nullptr,
+            heapType == D3D12_HEAP_TYPE_READBACK ? D3D12_RESOURCE_STATE_COPY_DEST : D3D12_RESOURCE_STATE_GENERIC_READ,
+            heapType )
 { }
 
 MappableBuffer::MappableBuffer( Device& device, ComPtr<ID3D12Resource> resource )
@@ -22,3 +24,9 @@ void MappableBuffer::Unmap()
 {
     return this->GetD3D12Resource()->Unmap( 0, nullptr );
 }
+
+void MappableBuffer::Unmap( size_t writtenBegin, size_t writtenEnd )
+{
+    const D3D12_RANGE written = { writtenBegin, writtenEnd };
+    return this->GetD3D12Resource()->Unmap( 0, &written );
+}
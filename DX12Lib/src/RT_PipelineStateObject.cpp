@@ -12,7 +12,8 @@
 using namespace dx12lib;
 using namespace Microsoft::WRL;
 
-ComPtr<IDxcBlob> ShaderHelper::CompileLibrary( const WCHAR* filename, const WCHAR* targetString )
+ComPtr<IDxcBlob> ShaderHelper::CompileLibrary( const WCHAR* filename, const WCHAR* targetString,
+                                               const DxcDefine* defines, uint32_t defineCount )
 {
     // Initialize the helper
     ComPtr<IDxcLibrary> pLibrary;
@@ -25,8 +26,15 @@ ComPtr<IDxcBlob> ShaderHelper::CompileLibrary( const WCHAR* filename, const WCHA
     ComPtr<IDxcBlobEncoding> sourceBlob;
     ThrowIfFailed( pLibrary->CreateBlobFromFile( filename, &codePage, &sourceBlob ) );
 
+    ComPtr<IDxcIncludeHandler> pIncludeHandler;
+    ThrowIfFailed( pLibrary->CreateIncludeHandler( &pIncludeHandler ) );
+
+    // Paths are relative to the working directory, the root of the repository.
+    const WCHAR* arguments[] = { L"-I", L"CPULib/inc" };
+
     ComPtr<IDxcOperationResult> pResult;
-    ThrowIfFailed( pCompiler->Compile( sourceBlob.Get(), filename, L"", targetString, nullptr, 0, nullptr, 0, nullptr,
+    ThrowIfFailed( pCompiler->Compile( sourceBlob.Get(), filename, L"", targetString, arguments,
+                                       _countof( arguments ), defines, defineCount, pIncludeHandler.Get(),
                                        &pResult ) );
 
     // Verify the result
@@ -0,0 +1,82 @@
+#include "DX12LibPCH.h"
+
+#include <dx12lib/RenderGraphBackend.h>
+
+#include <dx12lib/CommandList.h>
+#include <dx12lib/Resource.h>
+
+using namespace dx12lib;
+
+void CommandListGraphBackend::SetResource( uint32_t handle, const std::shared_ptr<Resource>& resource )
+{
+    if ( handle >= m_Resources.size() )
+        m_Resources.resize( handle + 1 );
+
+    m_Resources[handle] = resource;
+}
+
+D3D12_RESOURCE_STATES CommandListGraphBackend::GetD3D12State( cpulib::GraphResourceState state )
+{
+    switch ( state )
+    {
+    case cpulib::GraphResourceState::UnorderedAccess:
+        return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    case cpulib::GraphResourceState::RenderTarget:
+        return D3D12_RESOURCE_STATE_RENDER_TARGET;
+    case cpulib::GraphResourceState::CopySource:
+        return D3D12_RESOURCE_STATE_COPY_SOURCE;
+    case cpulib::GraphResourceState::CopyDest:
+        return D3D12_RESOURCE_STATE_COPY_DEST;
+    case cpulib::GraphResourceState::Common:
+    default:
+        return D3D12_RESOURCE_STATE_COMMON;
+    }
+}
+
+void CommandListGraphBackend::Barrier( const cpulib::GraphBarrier& barrier )
+{
+    if ( barrier.resource == cpulib::GraphBarrier::ALL_RESOURCES )
+    {
+        m_CommandList.UAVBarrier();
+        return;
+    }
+
+    assert( barrier.resource < m_Resources.size() && m_Resources[barrier.resource] );
+
+    const auto& resource = m_Resources[barrier.resource];
+    if ( barrier.type == cpulib::GraphBarrier::Type::Aliasing )
+    {
+        // Any resource in the heap may have had the memory.
+        m_CommandList.AliasingBarrier( nullptr, resource, false );
+
+        // A render target or UAV texture must be initialised before its first use, the copy into a copy
+        // destination does that on its own.
+        if ( barrier.after == cpulib::GraphResourceState::UnorderedAccess ||
+             barrier.after == cpulib::GraphResourceState::RenderTarget )
+            m_Discards.push_back( barrier.resource );
+    }
+    else if ( barrier.type == cpulib::GraphBarrier::Type::UAV )
+        m_CommandList.UAVBarrier( resource, false );
+    else
+        m_CommandList.TransitionBarrier( resource, GetD3D12State( barrier.after ),
+                                         D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, false );
+}
+
+void CommandListGraphBackend::FlushBarriers()
+{
+    m_CommandList.FlushResourceBarriers();
+
+    for ( uint32_t handle: m_Discards )
+        m_CommandList.DiscardResource( m_Resources[handle] );
+    m_Discards.clear();
+}
+
+void CommandListGraphBackend::BeginPass( uint32_t, const std::string& ) {}
+
+void CommandListGraphBackend::Copy( uint32_t dst, uint32_t src )
+{
+    assert( dst < m_Resources.size() && src < m_Resources.size() );
+
+    // The graph already moved both into the copy states, CopyResource finds nothing left to transition.
+    m_CommandList.CopyResource( m_Resources[dst], m_Resources[src] );
+}
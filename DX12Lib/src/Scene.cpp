@@ -8,10 +8,17 @@
 #include <dx12lib/Mesh.h>
 #include <dx12lib/SceneNode.h>
 #include <dx12lib/Texture.h>
+#include <dx12lib/TextureCooker.h>
 #include <dx12lib/VertexTypes.h>
 #include <dx12lib/Visitor.h>
 #include <dx12lib/AccelerationStructure.h>
 
+#include <cpulib/Bvh.h>
+#include <cpulib/CookedScene.h>
+#include <cpulib/MeshOptimizer.h>
+#include <cpulib/MeshSplit.h>
+#include <cpulib/ThreadPool.h>
+#include <cpulib/VertexCodec.h>
 
 using namespace dx12lib;
 
@@ -52,12 +59,394 @@ inline DirectX::BoundingBox CreateBoundingBox( const aiAABB& aabb )
     return bb;
 }
 
+static_assert( sizeof( VertexPositionNormalTangentBitangentTexture ) == sizeof( cpulib::FullVertex ),
+               "The vertex packing reads the imported vertices as cpulib::FullVertex" );
+static_assert( sizeof( VertexPositionPackedNormalTangentTexture ) == sizeof( cpulib::PackedVertex ),
+               "The vertex packing writes cpulib::PackedVertex" );
+
+static uint32_t GetVertexStride( VertexFormat vertexFormat )
+{
+    return vertexFormat == VertexFormat::Packed ? sizeof( VertexPositionPackedNormalTangentTexture )
+                                                : sizeof( VertexPositionNormalTangentBitangentTexture );
+}
+
+static DXGI_FORMAT GetIndexFormat( uint32_t indexSize )
+{
+    return indexSize == sizeof( uint16_t ) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+}
+
+struct Scene::MeshData
+{
+    std::vector<VertexPositionNormalTangentBitangentTexture> vertices;
+    // Instead of vertices for VertexFormat::Packed.
+    std::vector<VertexPositionPackedNormalTangentTexture> packedVertices;
+    std::vector<unsigned int>                             indices;
+    // Instead of indices when 16 bits address every vertex.
+    std::vector<uint16_t> indices16;
+
+    // A mesh too large for 16 bit indices, split: the parts to upload, the mesh itself keeps no vertices.
+    std::vector<MeshData> parts;
+
+    aiAABB aabb;
+
+    cpulib::MeshOptimizeStats optimizeStats;
+
+    const void* GetVertexData( VertexFormat vertexFormat ) const
+    {
+        return vertexFormat == VertexFormat::Packed ? static_cast<const void*>( packedVertices.data() )
+                                                    : static_cast<const void*>( vertices.data() );
+    }
+
+    uint32_t GetVertexCount( VertexFormat vertexFormat ) const
+    {
+        return static_cast<uint32_t>( vertexFormat == VertexFormat::Packed ? packedVertices.size() : vertices.size() );
+    }
+
+    const void* GetIndexData() const
+    {
+        return indices16.empty() ? static_cast<const void*>( indices.data() )
+                                 : static_cast<const void*>( indices16.data() );
+    }
+
+    uint32_t GetIndexCount() const
+    {
+        return static_cast<uint32_t>( indices16.empty() ? indices.size() : indices16.size() );
+    }
+
+    uint32_t GetIndexSize() const
+    {
+        return indices16.empty() ? sizeof( uint32_t ) : sizeof( uint16_t );
+    }
+
+    cpulib::MeshGeometry GetGeometry( VertexFormat vertexFormat ) const
+    {
+        cpulib::MeshGeometry geometry;
+        geometry.vertices    = GetVertexData( vertexFormat );
+        geometry.vertexCount = GetVertexCount( vertexFormat );
+        geometry.packed      = vertexFormat == VertexFormat::Packed;
+        geometry.indices     = GetIndexData();
+        geometry.indexCount  = GetIndexCount();
+        geometry.indexSize   = GetIndexSize();
+        return geometry;
+    }
+};
+
+// The bounds of a part of a split mesh, the vertex types all start with the position.
+template<typename Vertex>
+static aiAABB ComputeAABB( const std::vector<Vertex>& vertices )
+{
+    aiAABB aabb( aiVector3D( std::numeric_limits<float>::max() ), aiVector3D( -std::numeric_limits<float>::max() ) );
+    for ( const Vertex& v: vertices )
+    {
+        aabb.mMin.x = std::min( aabb.mMin.x, v.Position.x );
+        aabb.mMin.y = std::min( aabb.mMin.y, v.Position.y );
+        aabb.mMin.z = std::min( aabb.mMin.z, v.Position.z );
+        aabb.mMax.x = std::max( aabb.mMax.x, v.Position.x );
+        aabb.mMax.y = std::max( aabb.mMax.y, v.Position.y );
+        aabb.mMax.z = std::max( aabb.mMax.z, v.Position.z );
+    }
+    return aabb;
+}
+
+void Scene::ConvertMesh( const aiMesh& aiMesh, VertexFormat vertexFormat, bool splitLargeMeshes, MeshData& data )
+{
+    data.aabb = aiMesh.mAABB;
+
+    auto& vertexData = data.vertices;
+    vertexData.resize( aiMesh.mNumVertices );
+
+    unsigned int i;
+    if ( aiMesh.HasPositions() )
+    {
+        for ( i = 0; i < aiMesh.mNumVertices; ++i )
+        {
+            vertexData[i].Position = { aiMesh.mVertices[i].x, aiMesh.mVertices[i].y, aiMesh.mVertices[i].z };
+        }
+    }
+
+    if ( aiMesh.HasNormals() )
+    {
+        for ( i = 0; i < aiMesh.mNumVertices; ++i )
+        {
+            vertexData[i].Normal = { aiMesh.mNormals[i].x, aiMesh.mNormals[i].y, aiMesh.mNormals[i].z };
+        }
+    }
+
+    if ( aiMesh.HasTangentsAndBitangents() )
+    {
+        for ( i = 0; i < aiMesh.mNumVertices; ++i )
+        {
+            vertexData[i].Tangent   = { aiMesh.mTangents[i].x, aiMesh.mTangents[i].y, aiMesh.mTangents[i].z };
+            vertexData[i].Bitangent = { aiMesh.mBitangents[i].x, aiMesh.mBitangents[i].y, aiMesh.mBitangents[i].z };
+        }
+    }
+
+    if ( aiMesh.HasTextureCoords( 0 ) )
+    {
+        for ( i = 0; i < aiMesh.mNumVertices; ++i )
+        {
+            vertexData[i].TexCoord = { aiMesh.mTextureCoords[0][i].x, aiMesh.mTextureCoords[0][i].y,
+                                       aiMesh.mTextureCoords[0][i].z };
+        }
+    }
+
+    // Extract the index buffer.
+    if ( aiMesh.HasFaces() )
+    {
+        auto& indices = data.indices;
+        indices.reserve( aiMesh.mNumFaces * 3 );
+        for ( i = 0; i < aiMesh.mNumFaces; ++i )
+        {
+            const aiFace& face = aiMesh.mFaces[i];
+
+            // Only extract triangular faces
+            if ( face.mNumIndices == 3 )
+            {
+                indices.push_back( face.mIndices[0] );
+                indices.push_back( face.mIndices[1] );
+                indices.push_back( face.mIndices[2] );
+            }
+        }
+    }
+
+    // Triangles in vertex cache order, then the vertices in the order the triangles use them.
+    data.optimizeStats = cpulib::OptimizeMesh( vertexData, data.indices );
+
+    if ( vertexFormat == VertexFormat::Packed )
+    {
+        data.packedVertices.resize( vertexData.size() );
+        cpulib::PackVertices( reinterpret_cast<const cpulib::FullVertex*>( vertexData.data() ),
+                              static_cast<uint32_t>( vertexData.size() ),
+                              reinterpret_cast<cpulib::PackedVertex*>( data.packedVertices.data() ) );
+        vertexData = {};
+    }
+
+    // Half the index memory for every mesh 16 bits can address, the hit shader reads either size.
+    if ( cpulib::FitsIndex16( aiMesh.mNumVertices ) )
+    {
+        data.indices16.resize( data.indices.size() );
+        cpulib::NarrowIndices( data.indices16.data(), data.indices.data(), data.indices.size() );
+        data.indices = {};
+    }
+    else if ( splitLargeMeshes && !data.indices.empty() )
+    {
+        std::vector<uint16_t> localIndices;
+        const auto            clusters =
+            cpulib::SplitMesh( data.indices.data(), data.indices.size(), aiMesh.mNumVertices, localIndices );
+
+        // Every cluster becomes a mesh of its own, with a copy of the vertices it uses.
+        data.parts.resize( clusters.size() );
+        for ( size_t c = 0; c < clusters.size(); ++c )
+        {
+            const cpulib::MeshCluster& cluster = clusters[c];
+            MeshData&                  part    = data.parts[c];
+
+            part.indices16.assign( localIndices.begin() + cluster.firstIndex,
+                                   localIndices.begin() + cluster.firstIndex + cluster.indexCount );
+
+            if ( vertexFormat == VertexFormat::Packed )
+            {
+                part.packedVertices.resize( cluster.vertices.size() );
+                cpulib::GatherVertices( part.packedVertices.data(), data.packedVertices.data(), cluster );
+                part.aabb = ComputeAABB( part.packedVertices );
+            }
+            else
+            {
+                part.vertices.resize( cluster.vertices.size() );
+                cpulib::GatherVertices( part.vertices.data(), data.vertices.data(), cluster );
+                part.aabb = ComputeAABB( part.vertices );
+            }
+        }
+
+        data.vertices       = {};
+        data.packedVertices = {};
+        data.indices        = {};
+    }
+}
+
+// The texture files ImportMaterial loads for this material.
+static void GetTexturePaths( const aiMaterial& material, const fs::path& parentPath, std::set<std::wstring>& paths )
+{
+    static const aiTextureType types[] = { aiTextureType_AMBIENT,  aiTextureType_EMISSIVE, aiTextureType_OPACITY,
+                                           aiTextureType_DIFFUSE,  aiTextureType_SPECULAR, aiTextureType_SHININESS,
+                                           aiTextureType_NORMALS, aiTextureType_HEIGHT };
+
+    aiString aiTexturePath;
+    for ( aiTextureType type: types )
+    {
+        // The bump map is only loaded without a normal map.
+        if ( type == aiTextureType_HEIGHT && material.GetTextureCount( aiTextureType_NORMALS ) > 0 )
+            continue;
+
+        if ( material.GetTextureCount( type ) > 0 &&
+             material.GetTexture( type, 0, &aiTexturePath ) == aiReturn_SUCCESS )
+        {
+            fs::path texturePath = parentPath / fs::path( aiTexturePath.C_Str() );
+            if ( fs::exists( texturePath ) )
+            {
+                paths.insert( texturePath.wstring() );
+            }
+        }
+    }
+}
+
+// Queue the textures of a material with the TextureCooker, for the slots GetTexturePaths lists.
+static void AddMaterialTextures( const aiMaterial& material, const fs::path& parentPath, TextureCooker& cooker )
+{
+    struct Slot
+    {
+        aiTextureType type;
+        TextureUsage  usage;
+        bool          sRGB;
+    };
+    // Loaded the way ImportMaterial loads them.
+    static const Slot slots[] = {
+        { aiTextureType_AMBIENT, TextureUsage::Color, true },
+        { aiTextureType_EMISSIVE, TextureUsage::Color, true },
+        { aiTextureType_OPACITY, TextureUsage::Channel, true },
+        { aiTextureType_DIFFUSE, TextureUsage::Color, true },
+        { aiTextureType_SPECULAR, TextureUsage::Channel, true },
+        { aiTextureType_SHININESS, TextureUsage::Channel, false },
+        { aiTextureType_NORMALS, TextureUsage::Normal, false },
+        { aiTextureType_HEIGHT, TextureUsage::Bump, false },
+    };
+
+    aiString aiTexturePath;
+    for ( const Slot& slot: slots )
+    {
+        // The bump map is only loaded without a normal map.
+        if ( slot.type == aiTextureType_HEIGHT && material.GetTextureCount( aiTextureType_NORMALS ) > 0 )
+            continue;
+
+        if ( material.GetTextureCount( slot.type ) > 0 &&
+             material.GetTexture( slot.type, 0, &aiTexturePath ) == aiReturn_SUCCESS )
+        {
+            fs::path texturePath = parentPath / fs::path( aiTexturePath.C_Str() );
+            if ( fs::exists( texturePath ) )
+            {
+                cooker.AddTexture( texturePath, slot.usage, slot.sRGB );
+            }
+        }
+    }
+}
+
+// Read and preprocess a scene file.
+static const aiScene* ReadSceneFile( Assimp::Importer& importer, const fs::path& filePath )
+{
+    importer.SetPropertyFloat( AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, 80.0f );
+    importer.SetPropertyInteger( AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE );
+
+    unsigned int preprocessFlags = aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_OptimizeGraph |
+                                   aiProcess_ConvertToLeftHanded | aiProcess_GenBoundingBoxes;
+    return importer.ReadFile( filePath.string(), preprocessFlags );
+}
+
+// The cooked file of a scene is only used while this matches, the last write time of the source.
+static uint64_t GetSourceStamp( const fs::path& filePath )
+{
+    return static_cast<uint64_t>( fs::last_write_time( filePath ).time_since_epoch().count() );
+}
+
+// The texture slots of a Material and the Assimp texture each one is loaded from by ImportMaterial. A height map
+// ends up in the normal slot when it holds a normal map.
+static aiTextureType GetSlotTextureType( const aiMaterial& material, Material::TextureType slot )
+{
+    switch ( slot )
+    {
+    case Material::TextureType::Ambient:
+        return aiTextureType_AMBIENT;
+    case Material::TextureType::Emissive:
+        return aiTextureType_EMISSIVE;
+    case Material::TextureType::Diffuse:
+        return aiTextureType_DIFFUSE;
+    case Material::TextureType::Specular:
+        return aiTextureType_SPECULAR;
+    case Material::TextureType::SpecularPower:
+        return aiTextureType_SHININESS;
+    case Material::TextureType::Normal:
+        return material.GetTextureCount( aiTextureType_NORMALS ) > 0 ? aiTextureType_NORMALS : aiTextureType_HEIGHT;
+    case Material::TextureType::Bump:
+        return aiTextureType_HEIGHT;
+    case Material::TextureType::Opacity:
+        return aiTextureType_OPACITY;
+    default:
+        return aiTextureType_NONE;
+    }
+}
+
+// Whether ImportMaterial loads the texture of a slot as sRGB.
+static bool IsSlotSRGB( Material::TextureType slot )
+{
+    return slot != Material::TextureType::SpecularPower && slot != Material::TextureType::Normal &&
+           slot != Material::TextureType::Bump;
+}
+
+static void CookMaterial( cpulib::CookedSceneWriter& cook, const aiMaterial& aiMaterial, const Material& material )
+{
+    static_assert( static_cast<uint32_t>( Material::TextureType::NumTypes ) == cpulib::COOKED_TEXTURE_SLOTS,
+                   "A cooked material has a texture per Material::TextureType" );
+
+    const XMFLOAT4& ambient  = material.GetAmbientColor();
+    const XMFLOAT4& emissive = material.GetEmissiveColor();
+    const XMFLOAT3& diffuse  = material.GetDiffuseColor();
+    const XMFLOAT4& specular = material.GetSpecularColor();
+
+    cpulib::CookedMaterial cooked = {
+        { ambient.x, ambient.y, ambient.z, ambient.w },
+        { emissive.x, emissive.y, emissive.z, emissive.w },
+        { diffuse.x, diffuse.y, diffuse.z },
+        material.GetMaterialType(),
+        { specular.x, specular.y, specular.z, specular.w },
+        material.GetSpecularPower(),
+        material.GetOpacity(),
+        material.GetIndexOfRefraction(),
+        material.GetBumpIntensity(),
+    };
+
+    aiString aiTexturePath;
+    for ( uint32_t i = 0; i < cpulib::COOKED_TEXTURE_SLOTS; ++i )
+    {
+        auto slot          = static_cast<Material::TextureType>( i );
+        cooked.textures[i] = cpulib::COOKED_NO_STRING;
+
+        if ( material.GetTexture( slot ) &&
+             aiMaterial.GetTexture( GetSlotTextureType( aiMaterial, slot ), 0, &aiTexturePath ) == aiReturn_SUCCESS )
+        {
+            cooked.textures[i] = cook.AddString( aiTexturePath.C_Str() );
+        }
+    }
+
+    cook.AddMaterial( cooked );
+}
+
+// Parents before children, as ImportSceneNode walks them. The meshes of Assimp mesh i are meshRanges[i] up to
+// meshRanges[i + 1], more than one for a split mesh.
+static void CookSceneNode( cpulib::CookedSceneWriter& cook, uint32_t parent, const aiNode* aiNode,
+                           const std::vector<uint32_t>& meshRanges )
+{
+    std::vector<uint32_t> meshes;
+    for ( unsigned int i = 0; i < aiNode->mNumMeshes; ++i )
+    {
+        for ( uint32_t m = meshRanges[aiNode->mMeshes[i]]; m < meshRanges[aiNode->mMeshes[i] + 1]; ++m )
+        {
+            meshes.push_back( m );
+        }
+    }
+
+    const uint32_t node = cook.AddNode( parent, aiNode->mName.C_Str(), &aiNode->mTransformation.a1, meshes.data(),
+                                        static_cast<uint32_t>( meshes.size() ) );
+
+    for ( unsigned int i = 0; i < aiNode->mNumChildren; ++i )
+    {
+        CookSceneNode( cook, node, aiNode->mChildren[i], meshRanges );
+    }
+}
+
 bool Scene::LoadSceneFromFile( CommandList& commandList, const std::wstring& fileName,
                                const std::function<bool( float )>& loadingProgress )
 {
 
-    fs::path filePath   = fileName;
-    fs::path exportPath = fs::path( filePath ).replace_extension( "assbin" );
+    fs::path filePath = fileName;
 
     fs::path parentPath;
     if ( filePath.has_parent_path() )
@@ -69,40 +458,32 @@ bool Scene::LoadSceneFromFile( CommandList& commandList, const std::wstring& fil
         parentPath = fs::current_path();
     }
 
-    Assimp::Importer importer;
-    const aiScene*   scene;
-
-    importer.SetProgressHandler( new ProgressHandler( *this, loadingProgress ) );
+    // Load the cooked scene if it was cooked from this version of the file.
+    fs::path cookedPath  = fs::path( filePath ).replace_extension( "cooked" );
+    uint64_t sourceStamp = GetSourceStamp( filePath );
 
-    // Check if a preprocessed file exists.
-    if ( fs::exists( exportPath ) && fs::is_regular_file( exportPath ) )
+    if ( fs::exists( cookedPath ) && LoadCookedScene( commandList, cookedPath, parentPath, sourceStamp ) )
     {
-        scene = importer.ReadFile( exportPath.string(), aiProcess_GenBoundingBoxes );
+        return true;
     }
-    else
-    {
-        // File has not been preprocessed yet. Import and processes the file.
-        importer.SetPropertyFloat( AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, 80.0f );
-        importer.SetPropertyInteger( AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE );
 
-        unsigned int preprocessFlags = aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_OptimizeGraph |
-                                       aiProcess_ConvertToLeftHanded | aiProcess_GenBoundingBoxes;
-        scene = importer.ReadFile( filePath.string(), preprocessFlags );
-
-        if ( scene )
-        {
-            // Export the preprocessed scene file for faster loading next time.
-            Assimp::Exporter exporter;
-            exporter.Export( scene, "assbin", exportPath.string(), 0 );
-        }
-    }
+    Assimp::Importer importer;
+    importer.SetProgressHandler( new ProgressHandler( *this, loadingProgress ) );
 
+    const aiScene* scene = ReadSceneFile( importer, filePath );
     if ( !scene )
     {
         return false;
     }
 
-    ImportScene( commandList, *scene, parentPath );
+    cpulib::CookedSceneWriter cook( GetVertexStride( m_VertexFormat ) );
+    cook.SetSourceStamp( sourceStamp );
+    cook.SetFlags( m_SplitLargeMeshes ? cpulib::COOKED_SCENE_SPLIT_MESHES : 0 );
+
+    ImportScene( commandList, *scene, parentPath, &cook );
+
+    // Cook the scene for faster loading next time. A scene that can't be cooked still loads.
+    cook.Write( cookedPath );
 
     return true;
 }
@@ -130,7 +511,8 @@ bool Scene::LoadSceneFromString( CommandList& commandList, const std::string& sc
     return true;
 }
 
-void Scene::ImportScene( CommandList& commandList, const aiScene& scene, std::filesystem::path parentPath )
+void Scene::ImportScene( CommandList& commandList, const aiScene& scene, std::filesystem::path parentPath,
+                         cpulib::CookedSceneWriter* cook )
 {
 
     if ( m_RootNode )
@@ -141,18 +523,110 @@ void Scene::ImportScene( CommandList& commandList, const aiScene& scene, std::fi
     m_MaterialMap.clear();
     m_Materials.clear();
     m_Meshes.clear();
+    m_MeshOptimizeStats.clear();
+    m_MeshInstances = cpulib::MeshInstancePlan();
+
+    // The CPU work runs on the thread pool: texture decodes, each file once, and the vertex and index conversion of
+    // every mesh. The textures go first, they take the longest.
+    std::set<std::wstring> textureSet;
+    for ( unsigned int i = 0; i < scene.mNumMaterials; ++i )
+    {
+        GetTexturePaths( *( scene.mMaterials[i] ), parentPath, textureSet );
+    }
+    std::vector<std::wstring> textures( textureSet.begin(), textureSet.end() );
+    std::vector<MeshData>     meshData( scene.mNumMeshes );
+
+    const uint32_t numTextures = static_cast<uint32_t>( textures.size() );
+    cpulib::ThreadPool::Get().ParallelFor( numTextures + scene.mNumMeshes, [&]( uint32_t task ) {
+        if ( task < numTextures )
+        {
+            // Errors are kept with the decode and thrown by LoadTextureFromFile below.
+            CommandList::PrefetchTextureFromFile( textures[task] );
+        }
+        else
+        {
+            ConvertMesh( *( scene.mMeshes[task - numTextures] ), m_VertexFormat, m_SplitLargeMeshes,
+                         meshData[task - numTextures] );
+        }
+    } );
 
-    // Import scene materials.
+    // Only the uploads are left, they go through the command list one at a time.
     for ( unsigned int i = 0; i < scene.mNumMaterials; ++i )
     {
         ImportMaterial( commandList, *( scene.mMaterials[i] ), parentPath );
+
+        if ( cook )
+        {
+            CookMaterial( *cook, *( scene.mMaterials[i] ), *m_Materials.back() );
+        }
     }
-    // Import meshes
+    // A split mesh imports as one mesh per part, the meshes of Assimp mesh i are meshRanges[i] up to meshRanges[i + 1].
+    std::vector<uint32_t>             meshRanges( scene.mNumMeshes + 1, 0 );
+    std::vector<const MeshData*>      meshes;
+    std::vector<uint32_t>             meshMaterials;
+    std::vector<cpulib::MeshGeometry> meshGeometry;
     for ( unsigned int i = 0; i < scene.mNumMeshes; ++i )
     {
-        ImportMesh( commandList, *( scene.mMeshes[i] ) );
+        const aiMesh& aiMesh = *( scene.mMeshes[i] );
+
+        // The cooked scene keeps the meshes in this order, PlanInstances reorders them again on every load.
+        auto addMesh = [&]( const MeshData& data ) {
+            meshes.push_back( &data );
+            meshMaterials.push_back( aiMesh.mMaterialIndex );
+            meshGeometry.push_back( data.GetGeometry( m_VertexFormat ) );
+
+            if ( cook )
+            {
+                cook->AddMesh( data.GetVertexData( m_VertexFormat ), data.GetVertexCount( m_VertexFormat ),
+                               data.GetIndexData(), data.GetIndexCount(), data.GetIndexSize(), aiMesh.mMaterialIndex,
+                               &data.aabb.mMin.x, &data.aabb.mMax.x );
+            }
+        };
+
+        if ( meshData[i].parts.empty() )
+        {
+            addMesh( meshData[i] );
+        }
+        for ( const MeshData& part: meshData[i].parts )
+        {
+            addMesh( part );
+        }
+
+        m_MeshOptimizeStats.push_back( meshData[i].optimizeStats );
+        meshRanges[i + 1] = static_cast<uint32_t>( meshes.size() );
+    }
+
+    // The uploads go in the order of the slots, a copy only takes the buffers of the mesh before it.
+    PlanInstances( meshGeometry );
+    for ( uint32_t slot = 0; slot < meshes.size(); ++slot )
+    {
+        const uint32_t mesh = m_MeshInstances.order[slot];
+        if ( m_MeshInstances.sources[slot] == slot )
+        {
+            ImportMesh( commandList, meshMaterials[mesh], *meshes[mesh] );
+        }
+        else
+        {
+            ImportMeshCopy( meshMaterials[mesh], m_MeshInstances.sources[slot] );
+        }
+    }
+    meshData.clear();
+
+    if ( cook && scene.mRootNode )
+    {
+        CookSceneNode( *cook, cpulib::COOKED_NO_PARENT, scene.mRootNode, meshRanges );
     }
 
+    CollectTextures();
+
+    // Import the root node.
+    m_RootNode = ImportSceneNode( commandList, nullptr, scene.mRootNode, meshRanges );
+
+    FlattenTransforms();
+}
+
+void Scene::CollectTextures()
+{
     _diffuse.clear();
     _normal.clear();
     _specular.clear();
@@ -176,10 +650,167 @@ void Scene::ImportScene( CommandList& commandList, const aiScene& scene, std::fi
         if ( tex )
             _opacity.insert( tex.get() );
     }
+}
 
-    // Import the root node.
-    m_RootNode = ImportSceneNode( commandList, nullptr, scene.mRootNode );
+bool Scene::LoadCookedScene( CommandList& commandList, const std::filesystem::path& cookedPath,
+                             const std::filesystem::path& parentPath, uint64_t sourceStamp )
+{
+    cpulib::CookedScene cooked;
+    if ( !cooked.Open( cookedPath ) )
+    {
+        return false;
+    }
+
+    const cpulib::CookedSceneHeader& header = cooked.GetHeader();
+    const uint32_t flags = m_SplitLargeMeshes ? cpulib::COOKED_SCENE_SPLIT_MESHES : 0;
+    if ( header.sourceStamp != sourceStamp ||
+         header.vertexStride != GetVertexStride( m_VertexFormat ) ||
+         header.flags != flags )
+    {
+        return false;
+    }
+
+    m_RootNode.reset();
+    m_MaterialMap.clear();
+    m_Materials.clear();
+    m_Meshes.clear();
+    m_MeshOptimizeStats.clear();
+    m_MeshInstances = cpulib::MeshInstancePlan();
 
+    auto texturePath = [&]( uint32_t string ) { return parentPath / fs::u8path( cooked.GetString( string ) ); };
+
+    // Decode the textures on the thread pool, as ImportScene does.
+    std::set<std::wstring> textureSet;
+    for ( uint32_t i = 0; i < cooked.GetMaterialCount(); ++i )
+    {
+        for ( uint32_t texture: cooked.GetMaterial( i ).textures )
+        {
+            if ( texture != cpulib::COOKED_NO_STRING && fs::exists( texturePath( texture ) ) )
+            {
+                textureSet.insert( texturePath( texture ).wstring() );
+            }
+        }
+    }
+    std::vector<std::wstring> textures( textureSet.begin(), textureSet.end() );
+
+    cpulib::ThreadPool::Get().ParallelFor( static_cast<uint32_t>( textures.size() ), [&]( uint32_t i ) {
+        CommandList::PrefetchTextureFromFile( textures[i] );
+    } );
+
+    for ( uint32_t i = 0; i < cooked.GetMaterialCount(); ++i )
+    {
+        const cpulib::CookedMaterial& cookedMaterial = cooked.GetMaterial( i );
+
+        auto pMaterial = std::make_shared<Material>();
+        pMaterial->SetAmbientColor( XMFLOAT4( cookedMaterial.ambient ) );
+        pMaterial->SetEmissiveColor( XMFLOAT4( cookedMaterial.emissive ) );
+        pMaterial->SetDiffuseColor( XMFLOAT3( cookedMaterial.diffuse ) );
+        pMaterial->SetSpecularColor( XMFLOAT4( cookedMaterial.specular ) );
+        pMaterial->SetSpecularPower( cookedMaterial.specularPower );
+        pMaterial->SetOpacity( cookedMaterial.opacity );
+        pMaterial->SetIndexOfRefraction( cookedMaterial.indexOfRefraction );
+        pMaterial->SetBumpIntensity( cookedMaterial.bumpIntensity );
+        pMaterial->SetMaterialType( cookedMaterial.type );
+
+        // A texture missing on disk leaves its slot empty, it was not prefetched either.
+        for ( uint32_t slot = 0; slot < cpulib::COOKED_TEXTURE_SLOTS; ++slot )
+        {
+            if ( cookedMaterial.textures[slot] != cpulib::COOKED_NO_STRING &&
+                 fs::exists( texturePath( cookedMaterial.textures[slot] ) ) )
+            {
+                auto type    = static_cast<Material::TextureType>( slot );
+                auto texture = commandList.LoadTextureFromFile( texturePath( cookedMaterial.textures[slot] ),
+                                                                IsSlotSRGB( type ) );
+                pMaterial->SetTexture( type, texture );
+            }
+        }
+
+        m_Materials.push_back( pMaterial );
+    }
+
+    std::vector<cpulib::MeshGeometry> meshGeometry( cooked.GetMeshCount() );
+    for ( uint32_t i = 0; i < cooked.GetMeshCount(); ++i )
+    {
+        const cpulib::CookedMesh& cookedMesh = cooked.GetMesh( i );
+
+        meshGeometry[i].vertices    = cooked.GetVertices( cookedMesh );
+        meshGeometry[i].vertexCount = cookedMesh.vertexCount;
+        meshGeometry[i].packed      = m_VertexFormat == VertexFormat::Packed;
+        meshGeometry[i].indices     = cooked.GetIndices( cookedMesh );
+        meshGeometry[i].indexCount  = cookedMesh.indexCount;
+        meshGeometry[i].indexSize   = cookedMesh.indexSize;
+    }
+    PlanInstances( meshGeometry );
+
+    // The blobs go from the mapping straight into the upload buffers, in the order of the slots.
+    for ( uint32_t slot = 0; slot < cooked.GetMeshCount(); ++slot )
+    {
+        const cpulib::CookedMesh& cookedMesh = cooked.GetMesh( m_MeshInstances.order[slot] );
+        if ( m_MeshInstances.sources[slot] != slot )
+        {
+            ImportMeshCopy( cookedMesh.material, m_MeshInstances.sources[slot] );
+            continue;
+        }
+
+        auto mesh = std::make_shared<Mesh>();
+        mesh->SetMaterial( m_Materials[cookedMesh.material] );
+
+        auto vertexBuffer = commandList.CopyVertexBuffer( cookedMesh.vertexCount, header.vertexStride,
+                                                          cooked.GetVertices( cookedMesh ) );
+        mesh->SetVertexBuffer( 0, vertexBuffer );
+
+        if ( cookedMesh.indexCount > 0 )
+        {
+            auto indexBuffer = commandList.CopyIndexBuffer(
+                cookedMesh.indexCount, GetIndexFormat( cookedMesh.indexSize ), cooked.GetIndices( cookedMesh ) );
+            mesh->SetIndexBuffer( indexBuffer );
+        }
+
+        mesh->SetAABB( CreateBoundingBox( aiAABB( aiVector3D( cookedMesh.aabbMin[0], cookedMesh.aabbMin[1],
+                                                               cookedMesh.aabbMin[2] ),
+                                                  aiVector3D( cookedMesh.aabbMax[0], cookedMesh.aabbMax[1],
+                                                              cookedMesh.aabbMax[2] ) ) ) );
+
+        m_Meshes.push_back( mesh );
+    }
+
+    // Parents come first, so every node finds its parent already created.
+    std::vector<std::shared_ptr<SceneNode>> nodes( cooked.GetNodeCount() );
+    for ( uint32_t i = 0; i < cooked.GetNodeCount(); ++i )
+    {
+        const cpulib::CookedNode& cookedNode = cooked.GetNode( i );
+
+        auto node = std::make_shared<SceneNode>( XMMATRIX( cookedNode.transform ) );
+        if ( cookedNode.name != cpulib::COOKED_NO_STRING )
+        {
+            node->SetName( cooked.GetString( cookedNode.name ) );
+        }
+
+        const uint32_t* meshes = cooked.GetNodeMeshes( cookedNode );
+        for ( uint32_t m = 0; m < cookedNode.meshCount; ++m )
+        {
+            AddSceneMesh( node, meshes[m] );
+        }
+
+        if ( cookedNode.parent != cpulib::COOKED_NO_PARENT )
+        {
+            node->SetParent( nodes[cookedNode.parent] );
+            nodes[cookedNode.parent]->AddChild( node );
+        }
+
+        nodes[i] = node;
+    }
+
+    CollectTextures();
+
+    if ( !nodes.empty() )
+    {
+        m_RootNode = nodes[0];
+    }
+
+    FlattenTransforms();
+
+    return true;
 }
 
 void Scene::ImportMaterial( CommandList& commandList, const aiMaterial& material, std::filesystem::path parentPath )
@@ -326,9 +957,12 @@ void Scene::ImportMaterial( CommandList& commandList, const aiMaterial& material
         // Some materials actually store normal maps in the bump map slot. Assimp can't tell the difference between
         // these two texture types, so we try to make an assumption about whether the texture is a normal map or a bump
         // map based on its pixel depth. Bump maps are usually 8 BPP (grayscale) and normal maps are usually 24 BPP or
-        // higher.
+        // higher. The texture cooker made that same choice already for a block compressed one: BC4 for a bump map.
+        const DXGI_FORMAT     format = texture->GetD3D12ResourceDesc().Format;
         Material::TextureType textureType =
-            ( texture->BitsPerPixel() >= 24 ) ? Material::TextureType::Normal : Material::TextureType::Bump;
+            ( IsCompressed( format ) ? format != DXGI_FORMAT_BC4_UNORM : texture->BitsPerPixel() >= 24 )
+                ? Material::TextureType::Normal
+                : Material::TextureType::Bump;
 
         pMaterial->SetTexture( textureType, texture );
     }
@@ -373,85 +1007,91 @@ void Scene::ImportMaterial( CommandList& commandList, const aiMaterial& material
     m_Materials.push_back( pMaterial );
 }
 
-void Scene::ImportMesh( CommandList& commandList, const aiMesh& aiMesh )
+void Scene::ImportMesh( CommandList& commandList, uint32_t material, const MeshData& data )
 {
     auto mesh = std::make_shared<Mesh>();
 
-    std::vector<VertexPositionNormalTangentBitangentTexture> vertexData( aiMesh.mNumVertices );
+    assert( material < m_Materials.size() );
+    mesh->SetMaterial( m_Materials[material] );
 
-    assert( aiMesh.mMaterialIndex < m_Materials.size() );
-    mesh->SetMaterial( m_Materials[aiMesh.mMaterialIndex] );
+    auto vertexBuffer = commandList.CopyVertexBuffer( data.GetVertexCount( m_VertexFormat ),
+                                                      GetVertexStride( m_VertexFormat ),
+                                                      data.GetVertexData( m_VertexFormat ) );
+    mesh->SetVertexBuffer( 0, vertexBuffer );
 
-    unsigned int i;
-    if ( aiMesh.HasPositions() )
+    if ( data.GetIndexCount() > 0 )
     {
-        for ( i = 0; i < aiMesh.mNumVertices; ++i )
-        {
-            vertexData[i].Position = { aiMesh.mVertices[i].x, aiMesh.mVertices[i].y, aiMesh.mVertices[i].z };
-        }
+        auto indexBuffer = commandList.CopyIndexBuffer( data.GetIndexCount(), GetIndexFormat( data.GetIndexSize() ),
+                                                        data.GetIndexData() );
+        mesh->SetIndexBuffer( indexBuffer );
     }
 
-    if ( aiMesh.HasNormals() )
-    {
-        for ( i = 0; i < aiMesh.mNumVertices; ++i )
-        {
-            vertexData[i].Normal = { aiMesh.mNormals[i].x, aiMesh.mNormals[i].y, aiMesh.mNormals[i].z };
-        }
-    }
+    // The AI Mesh's AABB, or that of the part of a split mesh.
+    mesh->SetAABB( CreateBoundingBox( data.aabb ) );
 
-    if ( aiMesh.HasTangentsAndBitangents() )
-    {
-        for ( i = 0; i < aiMesh.mNumVertices; ++i )
-        {
-            vertexData[i].Tangent   = { aiMesh.mTangents[i].x, aiMesh.mTangents[i].y, aiMesh.mTangents[i].z };
-            vertexData[i].Bitangent = { aiMesh.mBitangents[i].x, aiMesh.mBitangents[i].y, aiMesh.mBitangents[i].z };
-        }
-    }
+    m_Meshes.push_back( mesh );
+}
 
-    if ( aiMesh.HasTextureCoords( 0 ) )
-    {
-        for ( i = 0; i < aiMesh.mNumVertices; ++i )
-        {
-            vertexData[i].TexCoord = { aiMesh.mTextureCoords[0][i].x, aiMesh.mTextureCoords[0][i].y,
-                                       aiMesh.mTextureCoords[0][i].z };
-        }
-    }
+void Scene::ImportMeshCopy( uint32_t material, uint32_t source )
+{
+    const std::shared_ptr<Mesh>& original = m_Meshes[source];
 
-    auto vertexBuffer = commandList.CopyVertexBuffer( vertexData );
-    mesh->SetVertexBuffer( 0, vertexBuffer );
+    auto mesh = std::make_shared<Mesh>();
 
-    // Extract the index buffer.
-    if ( aiMesh.HasFaces() )
+    assert( material < m_Materials.size() );
+    mesh->SetMaterial( m_Materials[material] );
+
+    mesh->SetVertexBuffer( 0, original->GetVertexBuffer( 0 ) );
+    mesh->SetIndexBuffer( original->GetIndexBuffer() );
+
+    // Around the vertices it shares, AddSceneMesh moves it back to where it was.
+    mesh->SetAABB( original->GetAABB() );
+
+    m_Meshes.push_back( mesh );
+}
+
+void Scene::PlanInstances( const std::vector<cpulib::MeshGeometry>& meshes )
+{
+    m_MeshInstances = m_InstanceMeshes ? cpulib::PlanMeshInstances( meshes )
+                                       : cpulib::PlanSingleBlas( static_cast<uint32_t>( meshes.size() ) );
+}
+
+void Scene::FlattenTransforms()
+{
+    m_Transforms = std::make_shared<cpulib::TransformHierarchy>();
+
+    if ( m_RootNode )
     {
-        std::vector<unsigned int> indices;
-        for ( i = 0; i < aiMesh.mNumFaces; ++i )
-        {
-            const aiFace& face = aiMesh.mFaces[i];
+        m_RootNode->FlattenTransforms( m_Transforms );
+        m_Transforms->Update();
+    }
+}
 
-            // Only extract triangular faces
-            if ( face.mNumIndices == 3 )
-            {
-                indices.push_back( face.mIndices[0] );
-                indices.push_back( face.mIndices[1] );
-                indices.push_back( face.mIndices[2] );
-            }
-        }
+uint32_t Scene::UpdateTransforms()
+{
+    return m_Transforms ? m_Transforms->Update() : 0;
+}
 
-        if ( indices.size() > 0 )
-        {
-            auto indexBuffer = commandList.CopyIndexBuffer( indices );
-            mesh->SetIndexBuffer( indexBuffer );
-        }
+void Scene::AddSceneMesh( const std::shared_ptr<SceneNode>& node, uint32_t mesh )
+{
+    const uint32_t slot = m_MeshInstances.slots[mesh];
+    if ( m_MeshInstances.sources[slot] == slot )
+    {
+        node->AddMesh( m_Meshes[slot] );
+        return;
     }
 
-    // Set the AABB from the AI Mesh's AABB.
-    mesh->SetAABB( CreateBoundingBox( aiMesh.mAABB ) );
+    const cpulib::float3& offset = m_MeshInstances.offsets[slot];
 
-    m_Meshes.push_back( mesh );
+    auto copy = std::make_shared<SceneNode>( XMMatrixTranslation( offset.x, offset.y, offset.z ) );
+    copy->SetName( node->GetName() );
+    copy->SetParent( node );
+    copy->AddMesh( m_Meshes[slot] );
+    node->AddChild( copy );
 }
 
 std::shared_ptr<SceneNode> Scene::ImportSceneNode( CommandList& commandList, std::shared_ptr<SceneNode> parent,
-                                                   const aiNode* aiNode )
+                                                   const aiNode* aiNode, const std::vector<uint32_t>& meshRanges )
 {
     if ( !aiNode )
     {
@@ -468,16 +1108,19 @@ std::shared_ptr<SceneNode> Scene::ImportSceneNode( CommandList& commandList, std
     // Add meshes to scene node
     for ( unsigned int i = 0; i < aiNode->mNumMeshes; ++i )
     {
-        assert( aiNode->mMeshes[i] < m_Meshes.size() );
+        assert( aiNode->mMeshes[i] + 1 < meshRanges.size() );
 
-        std::shared_ptr<Mesh> pMesh = m_Meshes[aiNode->mMeshes[i]];
-        node->AddMesh( pMesh );
+        // All parts of a split mesh.
+        for ( uint32_t m = meshRanges[aiNode->mMeshes[i]]; m < meshRanges[aiNode->mMeshes[i] + 1]; ++m )
+        {
+            AddSceneMesh( node, m );
+        }
     }
 
     // Recursively Import children
     for ( unsigned int i = 0; i < aiNode->mNumChildren; ++i )
     {
-        auto child = ImportSceneNode( commandList, node, aiNode->mChildren[i] );
+        auto child = ImportSceneNode( commandList, node, aiNode->mChildren[i], meshRanges );
         node->AddChild( child );
     }
 
@@ -512,9 +1155,47 @@ void Scene::BuildBottomLevelAccelerationStructure( dx12lib::Device* pDevice,
     AccelerationBuffer::CreateBottomLevelAS( pDevice, pCommandList, this, pDes );
 }
 
+void Scene::BuildBottomLevelAccelerationStructures( dx12lib::Device* pDevice, dx12lib::CommandList* pCommandList,
+                                                    std::vector<AccelerationStructure>& blases )
+{
+    blases.clear();
+    blases.resize( m_MeshInstances.blases.size() );
+
+    for ( size_t i = 0; i < blases.size(); ++i )
+    {
+        const cpulib::MeshBlas& blas = m_MeshInstances.blases[i];
+
+        MeshList meshes( m_Meshes.begin() + blas.firstMesh, m_Meshes.begin() + blas.firstMesh + blas.meshCount );
+        AccelerationBuffer::CreateBottomLevelAS( pDevice, pCommandList, meshes, &blases[i] );
+    }
+}
+
+uint64_t Scene::GetBottomLevelASSize( dx12lib::Device* pDevice ) const
+{
+    return AccelerationBuffer::GetBottomLevelASSize( pDevice, m_Meshes );
+}
+
+DirectX::BoundingBox Scene::GetBottomLevelAABB( size_t blas ) const
+{
+    const cpulib::MeshBlas& meshes = m_MeshInstances.blases[blas];
+
+    BoundingBox aabb = m_Meshes[meshes.firstMesh]->GetAABB();
+    for ( uint32_t m = meshes.firstMesh + 1; m < meshes.firstMesh + meshes.meshCount; ++m )
+    {
+        BoundingBox::CreateMerged( aabb, aabb, m_Meshes[m]->GetAABB() );
+    }
+    return aabb;
+}
+
 
 void dx12lib::Scene::MergeScene( std::shared_ptr<Scene> other )
 {
+    // The hit shader reads every vertex buffer with the same layout.
+    assert( other->m_VertexFormat == m_VertexFormat );
+
+    // The meshes of other keep their BLASes, after these.
+    cpulib::AppendMeshInstances( m_MeshInstances, other->m_MeshInstances );
+
     for ( std::shared_ptr<Mesh> m: other->m_Meshes )
     {
         m_Meshes.push_back( m );
@@ -552,4 +1233,156 @@ void dx12lib::Scene::SetSkybox( std::shared_ptr<dx12lib::Texture> skyboxIntensit
 {
     this->skyboxDiffuse = skyboxDiffuse;
     this->skyboxIntensity = skyboxIntensity;
-}
\ No newline at end of file
+}
+
+bool Scene::BenchmarkImport( const std::wstring& fileName, uint32_t numThreads, SceneImportStats& stats )
+{
+    using Clock = std::chrono::high_resolution_clock;
+    auto seconds = []( Clock::time_point begin ) {
+        return std::chrono::duration<double>( Clock::now() - begin ).count();
+    };
+
+    fs::path filePath   = fileName;
+    fs::path parentPath = filePath.has_parent_path() ? filePath.parent_path() : fs::current_path();
+
+    stats = SceneImportStats();
+
+    Assimp::Importer importer;
+
+    auto           begin = Clock::now();
+    const aiScene* scene = ReadSceneFile( importer, filePath );
+    stats.readSeconds    = seconds( begin );
+
+    if ( !scene )
+    {
+        return false;
+    }
+
+    std::set<std::wstring> textureSet;
+    for ( unsigned int i = 0; i < scene->mNumMaterials; ++i )
+    {
+        GetTexturePaths( *( scene->mMaterials[i] ), parentPath, textureSet );
+    }
+    std::vector<std::wstring> textures( textureSet.begin(), textureSet.end() );
+
+    stats.meshes   = scene->mNumMeshes;
+    stats.textures = static_cast<uint32_t>( textures.size() );
+
+    cpulib::ThreadPool    pool( numThreads );
+    std::vector<MeshData> meshData( scene->mNumMeshes );
+    stats.threads = pool.GetThreadCount();
+
+    // Every stage on its own, then meshes and textures together the way ImportScene runs them. The decodes skip the
+    // texture caches so every run decodes every file.
+    begin = Clock::now();
+    pool.ParallelFor( scene->mNumMeshes, [&]( uint32_t i ) {
+        ConvertMesh( *( scene->mMeshes[i] ), VertexFormat::Full, false, meshData[i] );
+    } );
+    stats.meshSeconds = seconds( begin );
+
+    for ( const MeshData& data: meshData )
+    {
+        stats.vertices += data.vertices.size();
+        stats.triangles += data.GetIndexCount() / 3;
+        stats.indexBytes += static_cast<uint64_t>( data.GetIndexCount() ) * data.GetIndexSize();
+        stats.meshes16 += data.GetIndexSize() == sizeof( uint16_t ) ? 1 : 0;
+        stats.meshOptimizeStats.push_back( data.optimizeStats );
+    }
+
+    std::vector<cpulib::MeshGeometry> meshGeometry;
+    for ( const MeshData& data: meshData )
+    {
+        meshGeometry.push_back( data.GetGeometry( VertexFormat::Full ) );
+    }
+
+    begin              = Clock::now();
+    stats.dedupStats   = cpulib::PlanMeshInstances( meshGeometry ).stats;
+    stats.dedupSeconds = seconds( begin );
+
+    cpulib::Bvh bvh;
+    stats.bvhStats = bvh.Build( pool, meshGeometry );
+
+    std::vector<uint64_t> textureBytes( textures.size(), 0 );
+
+    auto decode = [&]( uint32_t i ) {
+        try
+        {
+            textureBytes[i] = CommandList::DecodeTextureFromFile( textures[i] )->GetPixelsSize();
+        }
+        catch ( ... )
+        {
+            // Counted as zero bytes, LoadTextureFromFile would throw here.
+        }
+    };
+
+    begin = Clock::now();
+    pool.ParallelFor( stats.textures, decode );
+    stats.textureSeconds = seconds( begin );
+
+    for ( uint64_t bytes: textureBytes )
+    {
+        stats.textureBytes += bytes;
+    }
+
+    begin = Clock::now();
+    pool.ParallelFor( stats.textures + scene->mNumMeshes, [&]( uint32_t task ) {
+        if ( task < stats.textures )
+        {
+            decode( task );
+        }
+        else
+        {
+            ConvertMesh( *( scene->mMeshes[task - stats.textures] ), VertexFormat::Full, false,
+                         meshData[task - stats.textures] );
+        }
+    } );
+    stats.combinedSeconds = seconds( begin );
+
+    // What LoadSceneFromFile does instead when the scene is cooked: map the file and copy the blobs out, as the
+    // uploads would. Skipped when there is no cooked file for this version of the scene.
+    cpulib::CookedScene cooked;
+    fs::path            cookedPath = fs::path( filePath ).replace_extension( "cooked" );
+
+    begin = Clock::now();
+    if ( fs::exists( cookedPath ) && cooked.Open( cookedPath ) &&
+         cooked.GetHeader().sourceStamp == GetSourceStamp( filePath ) )
+    {
+        const cpulib::CookedSceneHeader& header = cooked.GetHeader();
+
+        std::vector<uint8_t> upload;
+        for ( uint32_t i = 0; i < cooked.GetMeshCount(); ++i )
+        {
+            const cpulib::CookedMesh& mesh        = cooked.GetMesh( i );
+            const size_t              vertexBytes = static_cast<size_t>( mesh.vertexCount ) * header.vertexStride;
+            const size_t              indexBytes  = static_cast<size_t>( mesh.indexCount ) * mesh.indexSize;
+
+            upload.resize( std::max( upload.size(), vertexBytes + indexBytes ) );
+            std::memcpy( upload.data(), cooked.GetVertices( mesh ), vertexBytes );
+            std::memcpy( upload.data() + vertexBytes, cooked.GetIndices( mesh ), indexBytes );
+        }
+        stats.cookedSeconds = seconds( begin );
+    }
+
+    return true;
+}
+
+bool Scene::CookTextures( const std::wstring& fileName, const TextureCookOptions& options, TextureCookStats& stats )
+{
+    fs::path filePath   = fileName;
+    fs::path parentPath = filePath.has_parent_path() ? filePath.parent_path() : fs::current_path();
+
+    Assimp::Importer importer;
+    const aiScene*   scene = ReadSceneFile( importer, filePath );
+    if ( !scene )
+    {
+        return false;
+    }
+
+    TextureCooker cooker;
+    for ( unsigned int i = 0; i < scene->mNumMaterials; ++i )
+    {
+        AddMaterialTextures( *( scene->mMaterials[i] ), parentPath, cooker );
+    }
+
+    return cooker.Cook( options, stats );
+}
@@ -9,6 +9,28 @@
 using namespace dx12lib;
 using namespace DirectX;
 
+namespace
+{
+
+// XMStoreFloat3x4 transposes, XMFLOAT3X4 holds the transform for column vectors as float3x4 does.
+cpulib::float3x4 ToFloat3x4( const XMMATRIX& m )
+{
+    XMFLOAT3X4       stored;
+    cpulib::float3x4 transform;
+    XMStoreFloat3x4( &stored, m );
+    std::memcpy( &transform, &stored, sizeof( transform ) );
+    return transform;
+}
+
+XMMATRIX ToMatrix( const cpulib::float3x4& transform )
+{
+    XMFLOAT3X4 stored;
+    std::memcpy( &stored, &transform, sizeof( stored ) );
+    return XMLoadFloat3x4( &stored );
+}
+
+}  // namespace
+
 SceneNode::SceneNode( const DirectX::XMMATRIX& localTransform )
 : m_Name( "SceneNode" )
 , m_AABB( { 0, 0, 0 }, {0, 0, 0} )
@@ -42,6 +64,11 @@ void SceneNode::SetLocalTransform( const DirectX::XMMATRIX& localTransform )
 {
     m_AlignedData->m_LocalTransform   = localTransform;
     m_AlignedData->m_InverseTransform = XMMatrixInverse( nullptr, localTransform );
+
+    if ( m_Transforms )
+    {
+        m_Transforms->SetLocal( m_TransformIndex, ToFloat3x4( localTransform ) );
+    }
 }
 
 DirectX::XMMATRIX SceneNode::GetInverseLocalTransform() const
@@ -51,14 +78,60 @@ DirectX::XMMATRIX SceneNode::GetInverseLocalTransform() const
 
 DirectX::XMMATRIX SceneNode::GetWorldTransform() const
 {
+    if ( m_Transforms )
+    {
+        assert( !m_Transforms->IsDirty() && "Scene::UpdateTransforms after SetLocalTransform" );
+        return ToMatrix( m_Transforms->GetWorld( m_TransformIndex ) );
+    }
+
     return m_AlignedData->m_LocalTransform * GetParentWorldTransform();
 }
 
 DirectX::XMMATRIX SceneNode::GetInverseWorldTransform() const
 {
+    if ( m_Transforms )
+    {
+        assert( !m_Transforms->IsDirty() && "Scene::UpdateTransforms after SetLocalTransform" );
+        return ToMatrix( m_Transforms->GetInverseWorld( m_TransformIndex ) );
+    }
+
     return XMMatrixInverse( nullptr, GetWorldTransform() );
 }
 
+void SceneNode::FlattenTransforms( const std::shared_ptr<cpulib::TransformHierarchy>& transforms, uint32_t parentIndex )
+{
+    m_Transforms     = transforms;
+    m_TransformIndex = transforms->AddNode( parentIndex, ToFloat3x4( m_AlignedData->m_LocalTransform ) );
+
+    for ( auto& child: m_Children )
+    {
+        child->FlattenTransforms( transforms, m_TransformIndex );
+    }
+}
+
+void SceneNode::UpdateTransforms()
+{
+    if ( m_Transforms )
+    {
+        m_Transforms->Update();
+    }
+}
+
+void SceneNode::DetachTransforms()
+{
+    if ( !m_Transforms )
+    {
+        return;
+    }
+
+    m_Transforms.reset();
+
+    for ( auto& child: m_Children )
+    {
+        child->DetachTransforms();
+    }
+}
+
 DirectX::XMMATRIX SceneNode::GetParentWorldTransform() const
 {
     XMMATRIX parentTransform = XMMatrixIdentity();
@@ -77,7 +150,13 @@ void SceneNode::AddChild( std::shared_ptr<SceneNode> childNode )
         NodeList::iterator iter = std::find( m_Children.begin(), m_Children.end(), childNode );
         if ( iter == m_Children.end() )
         {
+            // Moving a node is rare enough to bring the transforms it reads up to date here.
+            childNode->UpdateTransforms();
+            UpdateTransforms();
+
             XMMATRIX worldTransform = childNode->GetWorldTransform();
+            // Its node in the transforms would come before its new parent's.
+            childNode->DetachTransforms();
             childNode->m_ParentNode = shared_from_this();
             XMMATRIX localTransform = worldTransform * GetInverseWorldTransform();
             childNode->SetLocalTransform( localTransform );
@@ -134,7 +213,9 @@ void SceneNode::SetParent( std::shared_ptr<SceneNode> parentNode )
     else if ( auto parent = m_ParentNode.lock() )
     {
         // Setting parent to NULL.. remove from current parent and reset parent node.
+        UpdateTransforms();
         auto worldTransform = GetWorldTransform();
+        DetachTransforms();
         parent->RemoveChild( me );
         m_ParentNode.reset();
         SetLocalTransform( worldTransform );
@@ -43,10 +43,53 @@ void ShaderTableResourceView::UpdateShaderTableUAV( const UINT offset,
     }
 }
 
+void ShaderTableResourceView::UpdateShaderTableUAV( const UINT offset, const uint32_t nbrTextures,
+                                                    const std::shared_ptr<Texture>* pTextures )
+{
+    D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+    uavDesc.ViewDimension                    = D3D12_UAV_DIMENSION_TEXTURE2D;
+
+    D3D12_CPU_DESCRIPTOR_HANDLE heapHandle = m_SrvUavHeap->GetCPUDescriptorHandleForHeapStart();
+
+    auto device = m_Device.GetD3D12Device();
+
+    heapHandle.ptr += offset * device->GetDescriptorHandleIncrementSize( D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV );
+
+    for ( uint32_t i = 0; i < nbrTextures; ++i )
+    {
+        device->CreateUnorderedAccessView( pTextures[i]->GetD3D12Resource().Get(), nullptr, &uavDesc, heapHandle );
+
+        heapHandle.ptr += device->GetDescriptorHandleIncrementSize( D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV );
+    }
+}
+
+void ShaderTableResourceView::UpdateShaderTableUAV( const UINT offset, const std::shared_ptr<Resource>& buffer,
+                                                    const D3D12_UNORDERED_ACCESS_VIEW_DESC& uavDesc )
+{
+    D3D12_CPU_DESCRIPTOR_HANDLE heapHandle = m_SrvUavHeap->GetCPUDescriptorHandleForHeapStart();
+
+    auto device = m_Device.GetD3D12Device();
+
+    heapHandle.ptr += offset * device->GetDescriptorHandleIncrementSize( D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV );
+
+    device->CreateUnorderedAccessView( buffer->GetD3D12Resource().Get(), nullptr, &uavDesc, heapHandle );
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE ShaderTableResourceView::GetGpuDescriptorHandle( const UINT offset ) const
+{
+    D3D12_GPU_DESCRIPTOR_HANDLE handle = m_SrvUavHeap->GetGPUDescriptorHandleForHeapStart();
+
+    handle.ptr += offset * m_Device.GetD3D12Device()->GetDescriptorHandleIncrementSize(
+                               D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV );
+
+    return handle;
+}
+
 ShaderTableResourceView::ShaderTableResourceView( Device& device, 
                                                   const uint32_t nbrTotalRenderTargets,
                                                   const D3D12_SHADER_RESOURCE_VIEW_DESC*  pRayTlasSrv,
-                                                  const D3D12_CONSTANT_BUFFER_VIEW_DESC* pCbv, Scene* pMeshes )
+                                                  const D3D12_CONSTANT_BUFFER_VIEW_DESC* pCbv, Scene* pMeshes,
+                                                  const uint32_t nbrExtraUAVs )
 : m_Device( device )
 {
     assert( pRayTlasSrv || pCbv || pMeshes );
@@ -66,8 +109,9 @@ ShaderTableResourceView::ShaderTableResourceView( Device& device,
     D3D12_DESCRIPTOR_HEAP_DESC desc = {};
     // per frame buffer, globals buffer, denoiser, TLAS, Radiance and Diffuse skybox
     size_t                     uniques = 6;
-    // UAV targets, PER FRAME CBV, SRV TLAS, SRV per idxBuff & vertBuff, MaterialList, SRV textures
-    desc.NumDescriptors = nbrTotalRenderTargets + uniques + 2 * nbrMeshes + 1 + nbrTextures;
+    // UAV targets, PER FRAME CBV, SRV TLAS, SRV per idxBuff & vertBuff, MaterialList, SRV textures, extra UAVs
+    desc.NumDescriptors = nbrTotalRenderTargets + uniques + 2 * nbrMeshes + 1 + nbrTextures + nbrExtraUAVs;
+    m_ExtraUAVOffset    = desc.NumDescriptors - nbrExtraUAVs;
     desc.Type           = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
     desc.Flags          = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
 
@@ -157,8 +201,9 @@ ShaderTableResourceView::ShaderTableResourceView( Device& device,
         {
             srvIdxDesc[i] = copy;
             srvIdxDesc[i].Buffer.NumElements =
-                // Frome byte size to Nbr R32 size
-                pMeshes->m_Meshes[i]->GetIndexBuffer()->GetIndexBufferView().SizeInBytes / sizeof( float );
+                // Frome byte size to Nbr R32 size, 16 bit index buffers are padded to a whole one
+                ( pMeshes->m_Meshes[i]->GetIndexBuffer()->GetIndexBufferView().SizeInBytes + sizeof( float ) - 1 ) /
+                sizeof( float );
 
             srvVertDesc[i] = copy;
             srvVertDesc[i].Buffer.NumElements =
@@ -243,6 +288,9 @@ ShaderTableResourceView::ShaderTableResourceView( Device& device,
                 std::vector<dx12lib::Texture*>::iterator itr =
                     std::find( _normalTextureList.begin(), _normalTextureList.end(), tex.get() );
                 matPropList[i].NormalTextureIdx = std::distance( _normalTextureList.begin(), itr );
+
+                if ( Texture::IsTwoChannelFormat( tex->GetD3D12ResourceDesc().Format ) )
+                    matPropList[i].Flags |= MATERIAL_NORMAL_XY;
             }
 
             tex = mat->GetTexture( Material::TextureType::Specular );
@@ -271,6 +319,10 @@ ShaderTableResourceView::ShaderTableResourceView( Device& device,
                 ( 1 / 3.0f ) * ( mat->GetSpecularColor().x + mat->GetSpecularColor().y + mat->GetSpecularColor().z );
             matPropList[i].IndexOfRefraction = mat->GetIndexOfRefraction();
             matPropList[i].Roughness         = mat->GetRoughness();
+
+            // The hit shader reads the indices of every geometry at its own size.
+            matPropList[i].IndexSize =
+                pMeshes->m_Meshes[i]->GetIndexBuffer()->GetIndexFormat() == DXGI_FORMAT_R16_UINT ? 2 : 4;
         }
 
         
@@ -283,6 +335,9 @@ ShaderTableResourceView::ShaderTableResourceView( Device& device,
         }
         m_MaterialBuffer->Unmap();
 
+        // Kept for the CPU path tracer, which reads the same table.
+        m_MaterialProps = std::move( matPropList );
+
         // create view
         D3D12_SHADER_RESOURCE_VIEW_DESC copy = {};
         copy.Format                          = DXGI_FORMAT_R32_TYPELESS;
@@ -0,0 +1,374 @@
+#include "DX12LibPCH.h"
+
+#include <dx12lib/TextureCooker.h>
+
+#include <dx12lib/CommandList.h>
+
+#include <cpulib/ContentHash.h>
+#include <cpulib/ThreadPool.h>
+
+using namespace dx12lib;
+
+// Rows of pixels one compression task takes, a multiple of the block height.
+static const uint32_t STRIP_ROWS = 64;
+
+static fs::path& CacheDirectory()
+{
+    static fs::path directory = "Cache/Textures";
+    return directory;
+}
+
+void TextureCooker::SetCacheDirectory( const fs::path& directory )
+{
+    CacheDirectory() = directory;
+}
+
+const fs::path& TextureCooker::GetCacheDirectory()
+{
+    return CacheDirectory();
+}
+
+fs::path TextureCooker::GetCookedPath( const fs::path& source )
+{
+    uint64_t contentHash;
+    if ( !cpulib::HashFile( source, contentHash ) )
+    {
+        return {};
+    }
+    return GetCookedPath( contentHash );
+}
+
+fs::path TextureCooker::GetCookedPath( uint64_t contentHash )
+{
+    const uint64_t hash = cpulib::HashBytes( &contentHash, sizeof( contentHash ), TEXTURE_COOKER_VERSION );
+    return GetCacheDirectory() / ( cpulib::FormatHash( hash ) + ".dds" );
+}
+
+fs::path TextureCooker::FindCookedTexture( const fs::path& source )
+{
+    // Nothing was ever cooked, don't pay for hashing.
+    if ( !fs::exists( GetCacheDirectory() ) )
+    {
+        return {};
+    }
+
+    fs::path cookedPath = GetCookedPath( source );
+    return !cookedPath.empty() && fs::exists( cookedPath ) ? cookedPath : fs::path();
+}
+
+fs::path TextureCooker::FindCookedTexture( uint64_t contentHash )
+{
+    fs::path cookedPath = GetCookedPath( contentHash );
+    return fs::exists( cookedPath ) ? cookedPath : fs::path();
+}
+
+void TextureCooker::AddTexture( const fs::path& source, TextureUsage usage, bool sRGB )
+{
+    for ( Entry& entry: m_Entries )
+    {
+        if ( entry.source == source )
+        {
+            entry.usage = std::max( entry.usage, usage );
+            entry.sRGB  = entry.sRGB || sRGB;
+            return;
+        }
+    }
+    m_Entries.push_back( { source, usage, sRGB } );
+}
+
+static DXGI_FORMAT GetCookedFormat( TextureUsage usage )
+{
+    switch ( usage )
+    {
+    case TextureUsage::Channel:
+        return DXGI_FORMAT_BC4_UNORM;
+    case TextureUsage::Normal:
+        return DXGI_FORMAT_BC5_UNORM;
+    default:
+        return DXGI_FORMAT_BC7_UNORM;
+    }
+}
+
+namespace
+{
+struct CookJob
+{
+    fs::path    cookedPath;
+    DXGI_FORMAT format   = DXGI_FORMAT_UNKNOWN;
+    bool        compress = false;
+    bool        cached   = false;
+
+    // The filtered mip chain, and the same compressed into format.
+    ScratchImage mips;
+    ScratchImage compressed;
+
+    uint64_t     sourceBytes = 0;
+    uint64_t     cookedBytes = 0;
+    std::wstring failure;
+};
+
+struct StripTask
+{
+    CookJob* job;
+    size_t   mip;
+    size_t   y0, y1;
+};
+}  // namespace
+
+// Whether the cache has source cooked for usage, without decoding it.
+static bool IsCooked( const fs::path& cookedPath, TextureUsage usage )
+{
+    TexMetadata metadata;
+    if ( !fs::exists( cookedPath ) ||
+         FAILED( GetMetadataFromDDSFile( cookedPath.c_str(), DDS_FLAGS_NONE, metadata ) ) )
+    {
+        return false;
+    }
+
+    // Only sizes that don't fit the blocks are left uncompressed.
+    if ( metadata.format == DXGI_FORMAT_R8G8B8A8_UNORM )
+    {
+        return metadata.width % 4 != 0 || metadata.height % 4 != 0;
+    }
+    if ( usage == TextureUsage::Bump )
+    {
+        return metadata.format == DXGI_FORMAT_BC4_UNORM || metadata.format == DXGI_FORMAT_BC5_UNORM;
+    }
+    return metadata.format == GetCookedFormat( usage );
+}
+
+// Decode the source and filter its mips, unless the cache has it.
+static void PrepareJob( const fs::path& source, TextureUsage usage, bool sRGB, bool force, CookJob& job )
+{
+    job.cookedPath = TextureCooker::GetCookedPath( source );
+    if ( job.cookedPath.empty() )
+    {
+        throw std::exception( "The file can't be read." );
+    }
+    job.sourceBytes = fs::file_size( source );
+
+    if ( !force && IsCooked( job.cookedPath, usage ) )
+    {
+        job.cached = true;
+        return;
+    }
+
+    std::shared_ptr<const ScratchImage> decoded = CommandList::DecodeTextureFromFile( source.wstring() );
+    const Image*                        image   = decoded->GetImage( 0, 0, 0 );
+
+    // A height map holds a normal map when it has the bits for one, as ImportMaterial decides.
+    if ( usage == TextureUsage::Bump )
+    {
+        usage = BitsPerPixel( image->format ) >= 24 ? TextureUsage::Normal : TextureUsage::Channel;
+    }
+
+    job.compress = image->width % 4 == 0 && image->height % 4 == 0;
+    job.format   = job.compress ? GetCookedFormat( usage ) : DXGI_FORMAT_R8G8B8A8_UNORM;
+
+    // BC4 and BC5 have no sRGB form, an sRGB texture cooked to them is stored linear, in 16 bits until it is
+    // compressed so the dark values keep their precision.
+    const bool linearize = sRGB && job.compress && MakeSRGB( job.format ) == job.format;
+
+    // Everything else is filtered and compressed from RGBA8.
+    ScratchImage rgba;
+    if ( IsCompressed( image->format ) )
+    {
+        ThrowIfFailed( Decompress( *image, DXGI_FORMAT_R8G8B8A8_UNORM, rgba ) );
+        image = rgba.GetImage( 0, 0, 0 );
+    }
+    else if ( image->format != DXGI_FORMAT_R8G8B8A8_UNORM && !linearize )
+    {
+        ThrowIfFailed( Convert( *image, DXGI_FORMAT_R8G8B8A8_UNORM, TEX_FILTER_DEFAULT, TEX_THRESHOLD_DEFAULT, rgba ) );
+        image = rgba.GetImage( 0, 0, 0 );
+    }
+
+    ScratchImage linear;
+    if ( linearize )
+    {
+        ThrowIfFailed( Convert( *image, DXGI_FORMAT_R16G16B16A16_UNORM, TEX_FILTER_DEFAULT | TEX_FILTER_SRGB_IN,
+                                TEX_THRESHOLD_DEFAULT, linear ) );
+        image = linear.GetImage( 0, 0, 0 );
+    }
+
+    if ( image->width == 1 && image->height == 1 )
+    {
+        ThrowIfFailed( job.mips.InitializeFromImage( *image ) );
+    }
+    else
+    {
+        // Not through WIC, this runs on the pool's threads.
+        DWORD filter = TEX_FILTER_DEFAULT | TEX_FILTER_FORCE_NON_WIC;
+        if ( sRGB && !linearize )
+        {
+            filter |= TEX_FILTER_SRGB;
+        }
+        ThrowIfFailed( GenerateMipMaps( *image, filter, 0, job.mips ) );
+    }
+
+    if ( job.compress )
+    {
+        const TexMetadata& metadata = job.mips.GetMetadata();
+        ThrowIfFailed( job.compressed.Initialize2D( job.format, metadata.width, metadata.height, 1,
+                                                    metadata.mipLevels ) );
+    }
+}
+
+// Compress rows y0 to y1 of a mip into the same blocks of the compressed image.
+static void CompressStrip( const StripTask& task, DWORD flags )
+{
+    const Image& source      = *task.job->mips.GetImage( task.mip, 0, 0 );
+    const Image& destination = *task.job->compressed.GetImage( task.mip, 0, 0 );
+
+    Image strip      = source;
+    strip.height     = task.y1 - task.y0;
+    strip.pixels     = source.pixels + task.y0 * source.rowPitch;
+    strip.slicePitch = strip.height * source.rowPitch;
+
+    ScratchImage blocks;
+    ThrowIfFailed( Compress( strip, destination.format, flags, TEX_THRESHOLD_DEFAULT, blocks ) );
+
+    const Image& compressed = *blocks.GetImage( 0, 0, 0 );
+    const size_t blockRows  = ( strip.height + 3 ) / 4;
+    for ( size_t row = 0; row < blockRows; ++row )
+    {
+        std::memcpy( destination.pixels + ( task.y0 / 4 + row ) * destination.rowPitch,
+                     compressed.pixels + row * compressed.rowPitch,
+                     std::min( destination.rowPitch, compressed.rowPitch ) );
+    }
+}
+
+static std::wstring ToFailure( const std::exception& e )
+{
+    const char* what = e.what();
+    return std::wstring( what, what + strlen( what ) );
+}
+
+// Write through a temporary, so a reader never finds half a file in the cache.
+static void SaveJob( CookJob& job )
+{
+    const ScratchImage& images  = job.compress ? job.compressed : job.mips;
+    fs::path            tmpPath = job.cookedPath;
+    tmpPath += ".tmp";
+
+    ThrowIfFailed( SaveToDDSFile( images.GetImages(), images.GetImageCount(), images.GetMetadata(), DDS_FLAGS_NONE,
+                                  tmpPath.c_str() ) );
+    fs::rename( tmpPath, job.cookedPath );
+
+    job.cookedBytes = fs::file_size( job.cookedPath );
+}
+
+bool TextureCooker::Cook( const TextureCookOptions& options, TextureCookStats& stats )
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+
+    stats = TextureCookStats();
+    stats.textures = static_cast<uint32_t>( m_Entries.size() );
+
+    fs::create_directories( GetCacheDirectory() );
+
+    cpulib::ThreadPool pool( options.numThreads );
+    const DWORD        bc7Flags = options.quick ? TEX_COMPRESS_BC7_QUICK : TEX_COMPRESS_DEFAULT;
+
+    // A batch of textures at a time bounds the memory the mip chains take.
+    const size_t batchSize = pool.GetThreadCount() * 2;
+    for ( size_t first = 0; first < m_Entries.size(); first += batchSize )
+    {
+        const size_t         count = std::min( batchSize, m_Entries.size() - first );
+        std::vector<CookJob> jobs( count );
+
+        auto guard = [&]( CookJob& job, const std::function<void()>& work ) {
+            if ( !job.failure.empty() )
+            {
+                return;
+            }
+            try
+            {
+                work();
+            }
+            catch ( const std::exception& e )
+            {
+                job.failure = ToFailure( e );
+            }
+        };
+
+        pool.ParallelFor( static_cast<uint32_t>( count ), [&]( uint32_t i ) {
+            const Entry& entry = m_Entries[first + i];
+            guard( jobs[i], [&] { PrepareJob( entry.source, entry.usage, entry.sRGB, options.force, jobs[i] ); } );
+        } );
+
+        // The strips of every mip of every texture in the batch go out together, so one large texture doesn't
+        // leave the other threads idle.
+        std::vector<StripTask> strips;
+        for ( CookJob& job: jobs )
+        {
+            if ( !job.failure.empty() || job.cached || !job.compress )
+            {
+                continue;
+            }
+            for ( size_t mip = 0; mip < job.mips.GetMetadata().mipLevels; ++mip )
+            {
+                const size_t height = job.mips.GetImage( mip, 0, 0 )->height;
+                for ( size_t y = 0; y < height; y += STRIP_ROWS )
+                {
+                    strips.push_back( { &job, mip, y, std::min<size_t>( y + STRIP_ROWS, height ) } );
+                }
+            }
+        }
+
+        // Strips of one texture run on several threads, each keeps its own failure until they are done.
+        std::vector<std::wstring> stripFailures( strips.size() );
+        pool.ParallelFor( static_cast<uint32_t>( strips.size() ), [&]( uint32_t i ) {
+            const DWORD flags = strips[i].job->format == DXGI_FORMAT_BC7_UNORM ? bc7Flags : TEX_COMPRESS_DEFAULT;
+            try
+            {
+                CompressStrip( strips[i], flags );
+            }
+            catch ( const std::exception& e )
+            {
+                stripFailures[i] = ToFailure( e );
+            }
+        } );
+        for ( size_t i = 0; i < strips.size(); ++i )
+        {
+            if ( !stripFailures[i].empty() && strips[i].job->failure.empty() )
+            {
+                strips[i].job->failure = stripFailures[i];
+            }
+        }
+
+        pool.ParallelFor( static_cast<uint32_t>( count ), [&]( uint32_t i ) {
+            if ( !jobs[i].cached )
+            {
+                guard( jobs[i], [&] { SaveJob( jobs[i] ); } );
+            }
+        } );
+
+        for ( size_t i = 0; i < count; ++i )
+        {
+            const CookJob& job = jobs[i];
+            if ( !job.failure.empty() )
+            {
+                stats.failures.push_back( m_Entries[first + i].source.wstring() + L": " + job.failure );
+                continue;
+            }
+
+            stats.sourceBytes += job.sourceBytes;
+            if ( job.cached )
+            {
+                ++stats.cached;
+                stats.cookedBytes += fs::file_size( job.cookedPath );
+            }
+            else
+            {
+                ++stats.cooked;
+                stats.uncompressed += job.compress ? 0 : 1;
+                stats.cookedBytes += job.cookedBytes;
+            }
+        }
+    }
+
+    stats.seconds =
+        std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - begin ).count();
+
+    return stats.failures.empty();
+}
@@ -26,4 +26,16 @@ const D3D12_INPUT_LAYOUT_DESC VertexPositionNormalTangentBitangentTexture::Input
     VertexPositionNormalTangentBitangentTexture::InputElements,
     VertexPositionNormalTangentBitangentTexture::InputElementCount
 };
+
+const D3D12_INPUT_ELEMENT_DESC VertexPositionPackedNormalTangentTexture::InputElements[] = {
+    { "POSITION",  0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    { "NORMAL",    0, DXGI_FORMAT_R32_UINT,        0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    { "TANGENT",   0, DXGI_FORMAT_R32_UINT,        0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    { "TEXCOORD",  0, DXGI_FORMAT_R16G16_FLOAT,    0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+};
+
+const D3D12_INPUT_LAYOUT_DESC VertexPositionPackedNormalTangentTexture::InputLayout = {
+    VertexPositionPackedNormalTangentTexture::InputElements,
+    VertexPositionPackedNormalTangentTexture::InputElementCount
+};
 // clang-format on
\ No newline at end of file
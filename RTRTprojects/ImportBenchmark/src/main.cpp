@@ -0,0 +1,148 @@
+/*
+ *  Times the CPU stages of loading the Playground scenes: Assimp, the mesh
+ *  conversion and the texture decodes, on one thread and on all of them.
+ *  Reports the vertex cache efficiency of the meshes before and after the
+ *  import reorders them, per mesh with -meshes, and what instancing the
+ *  copies of the meshes would share, and builds a CPU BVH over the triangles.
+ *
+ *  ImportBenchmark [-wd <dir>] [-threads <n>] [-meshes] [scene files...]
+ */
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <dx12lib/Scene.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace dx12lib;
+
+static void Print( const std::wstring& fileName, const SceneImportStats& stats )
+{
+    wprintf( L"%ls: %u threads, %u meshes, %llu triangles, %u textures (%.1f MB)\n", fileName.c_str(), stats.threads,
+             stats.meshes, static_cast<unsigned long long>( stats.triangles ), stats.textures,
+             stats.textureBytes / ( 1024.0 * 1024.0 ) );
+    wprintf( L"    indices %.1f MB, %u of %u meshes with 16 bit indices\n", stats.indexBytes / ( 1024.0 * 1024.0 ),
+             stats.meshes16, stats.meshes );
+    wprintf( L"    read %.3f s, meshes %.3f s, textures %.3f s, meshes + textures %.3f s\n", stats.readSeconds,
+             stats.meshSeconds, stats.textureSeconds, stats.combinedSeconds );
+
+    const cpulib::MeshDedupStats& dedup = stats.dedupStats;
+    wprintf( L"    instancing: %u of %u meshes unique, %u instanced, %.3f s\n", dedup.uniqueMeshes, dedup.meshes,
+             dedup.instancedMeshes, stats.dedupSeconds );
+    wprintf( L"    shared vertices %.1f of %.1f MB, indices %.1f of %.1f MB, triangles %llu of %llu\n",
+             dedup.sharedVertexBytes / ( 1024.0 * 1024.0 ), dedup.vertexBytes / ( 1024.0 * 1024.0 ),
+             dedup.sharedIndexBytes / ( 1024.0 * 1024.0 ), dedup.indexBytes / ( 1024.0 * 1024.0 ),
+             static_cast<unsigned long long>( dedup.sharedTriangles ),
+             static_cast<unsigned long long>( dedup.triangles ) );
+
+    const cpulib::BvhBuildStats& bvh = stats.bvhStats;
+    wprintf( L"    BVH: %.3f s (%.3f s top levels, %u tasks), %u nodes, %u leaves, depth %u, SAH cost %.2f, %.1f MB\n",
+             bvh.seconds, bvh.topSeconds, bvh.tasks, bvh.nodes, bvh.leaves, bvh.maxDepth, bvh.sahCost,
+             bvh.memoryBytes / ( 1024.0 * 1024.0 ) );
+
+    // Only once the scene has been loaded by the renderer, that is when it gets cooked.
+    if ( stats.cookedSeconds > 0 )
+    {
+        wprintf( L"    cooked %.3f s\n", stats.cookedSeconds );
+    }
+}
+
+static void PrintVertexCache( const SceneImportStats& stats, bool perMesh )
+{
+    // ACMR over all triangles, ATVR over all vertices.
+    double triangles = 0, vertices = 0;
+    double acmrBefore = 0, acmrAfter = 0, atvrBefore = 0, atvrAfter = 0;
+
+    for ( size_t i = 0; i < stats.meshOptimizeStats.size(); ++i )
+    {
+        const cpulib::MeshOptimizeStats& mesh = stats.meshOptimizeStats[i];
+        if ( perMesh )
+        {
+            wprintf( L"    mesh %zu: %u vertices, %u triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", i,
+                     mesh.vertices, mesh.triangles, mesh.before.acmr, mesh.after.acmr, mesh.before.atvr,
+                     mesh.after.atvr );
+        }
+
+        triangles += mesh.triangles;
+        vertices += mesh.vertices;
+        acmrBefore += double( mesh.before.acmr ) * mesh.triangles;
+        acmrAfter += double( mesh.after.acmr ) * mesh.triangles;
+        atvrBefore += double( mesh.before.atvr ) * mesh.vertices;
+        atvrAfter += double( mesh.after.atvr ) * mesh.vertices;
+    }
+
+    triangles = std::max( triangles, 1.0 );
+    vertices  = std::max( vertices, 1.0 );
+    wprintf( L"    vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", acmrBefore / triangles,
+             acmrAfter / triangles, atvrBefore / vertices, atvrAfter / vertices );
+}
+
+int wmain( int argc, wchar_t* argv[] )
+{
+    uint32_t                  numThreads = 0;
+    bool                      perMesh    = false;
+    std::vector<std::wstring> files;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        // -wd Specify the Working Directory.
+        if ( wcscmp( argv[i], L"-wd" ) == 0 && i + 1 < argc )
+        {
+            SetCurrentDirectoryW( argv[++i] );
+        }
+        else if ( wcscmp( argv[i], L"-threads" ) == 0 && i + 1 < argc )
+        {
+            numThreads = static_cast<uint32_t>( _wtoi( argv[++i] ) );
+        }
+        else if ( wcscmp( argv[i], L"-meshes" ) == 0 )
+        {
+            perMesh = true;
+        }
+        else
+        {
+            files.push_back( argv[i] );
+        }
+    }
+
+    // The OBJ scenes DummyGame loads.
+    if ( files.empty() )
+    {
+        files = { L"Assets/Models/CornellBox/CornellBox-Original.obj",
+                  L"Assets/Models/crytek-sponza/sponza_nobanner.obj",
+                  L"Assets/Models/SunTemple/sunTemple.obj",
+                  L"Assets/Models/AmazonLumberyard/interior.obj",
+                  L"Assets/Models/San_Miguel/san-miguel-low-poly.obj" };
+    }
+
+    int retCode = 0;
+    for ( const std::wstring& fileName: files )
+    {
+        // The first run warms up the file cache, only the later runs are timed.
+        SceneImportStats stats;
+        if ( !Scene::BenchmarkImport( fileName, 1, stats ) )
+        {
+            wprintf( L"%ls: can't be read\n", fileName.c_str() );
+            retCode = 1;
+            continue;
+        }
+
+        Scene::BenchmarkImport( fileName, 1, stats );
+        Print( fileName, stats );
+        PrintVertexCache( stats, perMesh );
+
+        SceneImportStats parallel;
+        Scene::BenchmarkImport( fileName, numThreads, parallel );
+        Print( fileName, parallel );
+
+        wprintf( L"    speedup meshes %.2fx, textures %.2fx, meshes + textures %.2fx, BVH %.2fx\n",
+                 stats.meshSeconds / std::max( parallel.meshSeconds, 1e-9 ),
+                 stats.textureSeconds / std::max( parallel.textureSeconds, 1e-9 ),
+                 stats.combinedSeconds / std::max( parallel.combinedSeconds, 1e-9 ),
+                 stats.bvhStats.seconds / std::max( parallel.bvhStats.seconds, 1e-9 ) );
+    }
+
+    return retCode;
+}
@@ -8,6 +8,14 @@
 #include <dx12lib/AccelerationStructure.h>
 
 #include <DirectXMath.h>
+#include <wrl/client.h>
+
+#include <cpulib/CameraPath.h>
+#include <cpulib/RayBudgetController.h>
+#include <cpulib/RenderGraph.h>
+#include <cpulib/SvgfRotation.h>
+#include <cpulib/TlasInstanceTracker.h>
+#include <cpulib/TransformHierarchy.h>
 
 #include <string>
 
@@ -29,6 +37,8 @@ class SwapChain;
 class Texture;
 class AccelerationBuffer;
 class AccelerationStructure;
+class ByteAddressBuffer;
+class StructuredBuffer;
 class MappableBuffer;
 class ShaderTableResourceView;
 } 
@@ -40,6 +50,9 @@ class Window;  // From GameFramework.
 
 #define UPDATE_TRANSFORMS 1
 
+// Import the copies of a mesh as instances of one BLAS, see Scene::GetMeshInstances.
+#define INSTANCE_MESHES 1
+
 struct FrameData
 {
     void UpdateCamera(DirectX::XMFLOAT3 cameraPos, DirectX::XMFLOAT3 cameraLookAt ) { 
@@ -193,6 +206,13 @@ struct InstanceTransforms
         CalculateNormalInverse();
     }
 
+    // The world and normal matrices of node, both as float3x4 in the same layout, after the last Update.
+    void SetFromTransforms( const cpulib::TransformHierarchy& transforms, uint32_t node )
+    {
+        memcpy( &matrix, &transforms.GetWorld( node ), sizeof( DirectX::XMFLOAT3X4 ) );
+        memcpy( &normal_matrix, &transforms.GetNormal( node ), sizeof( DirectX::XMFLOAT3X4 ) );
+    }
+
     DirectX::XMFLOAT3X4 matrix;
     DirectX::XMFLOAT3X4 normal_matrix;
 
@@ -251,6 +271,16 @@ struct DenoiserFilterData
     float m_AS_DepthDiffLimit = 1;
     float m_AS_ColourLimit       = 0.1;
 
+    // Variance guided scheduling from the moment history, see cpulib::AdaptiveSamplerSettings.
+    int   m_AS_VarianceGuided      = 0;
+    float m_AS_VarianceLimit       = 0.1;
+    int   m_AS_MinHistoryLength    = 4;
+    float m_AS_ConvergedLimitScale = 2;
+
+    // Quadtree scheduler, refines in m_AS_QuadtreePasses passes whatever the grid size.
+    int m_AS_Quadtree       = 0;
+    int m_AS_QuadtreePasses = 3;
+
     void BuildOldAndNewDenoiser( FrameData* pOld, FrameData* pNew, 
         DirectX::XMFLOAT2 cameraWinSize, int width, int height )
     {
@@ -365,15 +395,10 @@ private:
     alignas( 16 ) GlobalConstantData m_Globals;
 
 
-    std::shared_ptr<dx12lib::AccelerationBuffer> m_BLAS;
+    // One per Scene::GetMeshInstances().blases.
+    std::vector<std::shared_ptr<dx12lib::AccelerationBuffer>> m_BLAS;
 
     // mesh count and instance count
-    std::vector<size_t>  m_GeometryCountPerInstance;
-    std::vector<size_t>  m_DiffuseTexCountPerInstance;
-    std::vector<size_t>  m_NormalTexCountPerInstance;
-    std::vector<size_t>  m_SpecularTexCountPerInstance;
-    std::vector<size_t>  m_MaskTexCountPerInstance;
-
     size_t   m_Instances;
 
     size_t   m_TotalGeometryCount;
@@ -430,8 +455,29 @@ private:
     dx12lib::AttachmentPoint m_ObjectMask  = dx12lib::AttachmentPoint::Color3;
     dx12lib::AttachmentPoint m_MomentHistory  = dx12lib::AttachmentPoint::Color4;
 
+    // The SVGF passes hand their output on by switching descriptor tables instead of copying, see cpulib/SvgfRotation.h.
+    static const int                                m_nbrAtrousIterations = 5;
+    cpulib::ResourceRotation                        m_SvgfRotation;
+    cpulib::SvgfStages                              m_SvgfStages;
+    // Rotation buffer index to texture, these are the textures of the ray, history and filter render targets.
+    std::vector<std::shared_ptr<dx12lib::Texture>>  m_SvgfBuffers;
+    // The buffers are placed in it, the ones that are never alive at the same time share memory.
+    Microsoft::WRL::ComPtr<ID3D12Heap>              m_SvgfHeap;
+    DXGI_FORMAT                                     m_SvgfFormat = DXGI_FORMAT_R32G32B32A32_FLOAT;
+    uint64_t                                        m_SvgfFrame = 0;
+
+    // Places the barriers of the ray tracing and SVGF passes, the handles are the m_SvgfBuffers indices.
+    cpulib::RenderGraph                             m_RenderGraph;
+    uint32_t                                        m_BackBufferHandle = 0;
+
     std::shared_ptr<dx12lib::ShaderTableResourceView>   m_RayShaderHeap;
     std::vector<InstanceTransforms>                   m_InstanceTransforms;
+    // Node 0 is the scene transform of m_InstanceTransforms, node 1 + i the offset of TLAS instance i under it.
+    cpulib::TransformHierarchy                        m_Transforms;
+    // Which instance descs moved, and whether the TLAS needs a refit or a rebuild for it.
+    cpulib::TlasInstanceTracker                       m_TlasTracker;
+    // The bounds of the BLAS of every TLAS instance, before its transform.
+    std::vector<cpulib::TlasBounds>                   m_InstanceBounds;
 
     /*
         Create the ray tracing pipeline with settings as local root signatures, 
@@ -449,6 +495,51 @@ private:
     */
     void CreateRaySchedularPipeline();
 
+    /*
+        Create the compaction root signature, pipeline stage and the DispatchRays command signature.
+    */
+    void CreateRayCompactionPipeline();
+
+    /*
+        Create the pixel list for the window size and its descriptors, after the heap is created
+            and after a resize.
+    */
+    void CreateRayCompactionResources();
+
+    /*
+        Create the SVGF buffers for the window size, placed in one heap as cpulib::AliasingPlanner
+            lays them out, attach them to the render targets and tell m_RenderGraph which share memory.
+    */
+    void PlaceSvgfBuffers();
+
+    /*
+        Write every SVGF binding set to the end of the shader heap and restart the rotation,
+            after the heap is created and after a resize.
+    */
+    void UpdateSvgfBindingSets();
+
+    /*
+        Point the ray, history and filter descriptors at the start of the heap, which the
+            ray tracing and scheduler passes use, at this frame's buffers.
+    */
+    void UpdateSvgfFrameBindings();
+
+    /*
+        GPU handle of the descriptor table the given SVGF stage uses this frame.
+    */
+    D3D12_GPU_DESCRIPTOR_HANDLE GetSvgfBindingSet( uint32_t stage ) const;
+
+    /*
+        Texture bound to the given slot of an SVGF stage this frame.
+    */
+    std::shared_ptr<dx12lib::Texture> GetSvgfTexture( uint32_t stage, uint32_t slot ) const;
+
+    /*
+        Declare the accesses of an SVGF stage to a render graph pass, on this frame's buffers.
+            With accumulate the writes also read, for passes that run more than once.
+    */
+    void DeclareSvgfAccesses( uint32_t pass, uint32_t stage, bool accumulate );
+
     /*
         Upload shader programs and point at relative resources needed per function
     */
@@ -464,6 +555,12 @@ private:
     */
     void CreateAccelerationStructure();
 
+    /*
+        The TLAS transform of every instance from m_Transforms: the scene transform after the instance offset.
+        Only the ranges of m_TlasTracker's dirty instances are written.
+    */
+    void WriteInstanceTransforms();
+
     /*
         Create the constant buffer we use for sphere colouring
     */
@@ -488,6 +585,36 @@ private:
     
     std::shared_ptr<dx12lib::RootSignature>       m_RayScheduleRootSig;
     std::shared_ptr<dx12lib::PipelineStateObject> m_RaySchedulePipelineState;
+    std::shared_ptr<dx12lib::PipelineStateObject> m_QuadtreeSchedulePipelineState;
+
+    // The pixels the scheduler marked, as a list the ray launch runs over, see RayCompaction.hlsl.
+    std::shared_ptr<dx12lib::RootSignature>        m_RayCompactionRootSig;
+    std::shared_ptr<dx12lib::PipelineStateObject>  m_RayCompactionPipelineState;
+    Microsoft::WRL::ComPtr<ID3D12CommandSignature> m_DispatchRaysSignature;
+    std::shared_ptr<dx12lib::StructuredBuffer>     m_CompactedPixels;
+    // [0] := rays in m_CompactedPixels, [1] := compaction groups finished.
+    std::shared_ptr<dx12lib::ByteAddressBuffer>    m_CompactionCounters;
+    // The D3D12_DISPATCH_RAYS_DESC of the trace passes, the compaction writes its launch size.
+    std::shared_ptr<dx12lib::ByteAddressBuffer>    m_DispatchRaysArgs;
+    // m_RaytraceDesc followed by zeroed counters, copied over both before every compaction.
+    std::shared_ptr<dx12lib::MappableBuffer>       m_CompactionUpload;
+    // Heap offset of the pixel list, counter and argument UAVs, after the SVGF binding sets.
+    UINT                                           m_CompactionDescriptors = 0;
+    // The ray count of every trace pass, copied from m_CompactionCounters for the rays budget.
+    static constexpr uint32_t                      m_MaxRayCountPasses = 8;
+    std::shared_ptr<dx12lib::MappableBuffer>       m_RayCountReadback;
+    uint32_t                                       m_RayCountPasses = 0;
+    // Rays cast by the last rendered frame.
+    uint64_t                                       m_LastCastRays = 0;
+
+    // Steers gridSize and the m_AS_* limits towards a frame time budget.
+    cpulib::RayBudgetController m_RayBudget;
+    bool                        m_UseRayBudget = false;
+
+    /*
+        Feed last frame's time to the budget controller and apply its limits.
+    */
+    void UpdateRayBudget( double deltaTime );
 
 #endif
 
@@ -552,6 +679,9 @@ private:
 
     std::vector<std::pair<double, double>> timeStampDeltaTime;
 
+    // The camera of every recorded frame, replayed by CPULib/tools/RenderBenchmark.
+    std::vector<cpulib::CameraPose> m_CameraPath;
+
     // Scale the HDR render target to a fraction of the window size.
     float m_RenderScale;
 
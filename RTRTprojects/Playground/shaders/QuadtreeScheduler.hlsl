@@ -0,0 +1,251 @@
+#define EPSILON 0.00001
+
+
+struct ComputeShaderInput
+{
+    uint3 GroupID : SV_GroupID; // 3D index of the thread group in the dispatch.
+    uint3 GroupThreadID : SV_GroupThreadID; // 3D index of local thread ID in a thread group.
+    uint3 DispatchThreadID : SV_DispatchThreadID; // 3D index of global thread ID in the dispatch.
+    uint GroupIndex : SV_GroupIndex; // Flattened local index of the thread within a thread group.
+};
+
+
+struct DenoiserFilterData
+{
+    row_major matrix<float, 3, 4> oldCameraWorldToClip;
+    row_major matrix<float, 3, 4> newCameraWorldToClip;
+
+    float2 cameraWindowSize;
+    float2 windowResolution;
+
+    float alpha;
+    float reprojectErrorLimit;
+
+    float sigmaDepth;
+    float sigmaNormal;
+
+    float sigmaLuminance;
+
+    int gridSize;
+
+    float as_posDiffLimit;
+    float as_normalDotLimit;
+    float as_depthDiffLimit;
+    float as_colourLimit;
+
+    int as_varianceGuided;
+    float as_varianceLimit;
+    int as_minHistoryLength;
+    float as_convergedLimitScale;
+
+    int as_quadtree;
+    int as_quadtreePasses;
+};
+
+struct perFrame
+{
+    int iteration;
+};
+
+ConstantBuffer<DenoiserFilterData> filterData : register(b0);
+
+ConstantBuffer<perFrame> data : register(b1);
+/*
+    colour,
+    normal,
+    posDepth,
+    objectMask,
+*/
+RWTexture2D<float4> rayBuffer[] : register(u0, space0);
+
+/*
+    oldIntegratedColour,
+    prevNormal,
+    prevPosDepth,
+    prevObject,
+    momentHistory,
+*/
+RWTexture2D<float4> historyBuffer[] : register(u0, space1);
+
+
+
+#define SLOT_COLOUR 0
+#define SLOT_NORMALS 1
+#define SLOT_POS_DEPTH 2
+#define SLOT_OBJECT_ID_MASK 3
+#define SLOT_MOMENT_HISTORY 4
+
+#define AS_EMPTY 0
+#define AS_CAST 1
+#define AS_CASTED 2
+#define AS_INTERPOLATED 3
+
+/*
+    SUMMARY:= Quadtree version of RayScheduler.hlsl, CPU reference in CPULib/AdaptiveSampler.
+        The first pass seeds a ray lattice every 2^gridSize pixels. Every later pass
+        interpolates a pixel from the four corners of its cell in the lattice traced
+        by the previous pass, or, if the cell is not smooth, casts the next finer
+        lattice. The last pass casts whatever is left. The number of passes is
+        as_quadtreePasses for any gridSize, so are the barriers between them.
+*/
+
+int calcPassCount()
+{
+    return clamp(filterData.as_quadtreePasses, 2, filterData.gridSize + 1);
+}
+
+// The refinement levels are spread evenly over the passes.
+int calcLatticeSpacing(int pass)
+{
+    int passCount = calcPassCount();
+    if (filterData.gridSize <= 0 || pass >= passCount - 1)
+        return 1;
+
+    int level = filterData.gridSize - (pass * filterData.gridSize + (passCount - 1) / 2) / (passCount - 1);
+    return 1 << level;
+}
+
+// Scale the angle tolerance of a dot product limit, exact for scale 1.
+float widenDotLimit(float limit, float scale)
+{
+    return scale == 1 ? limit : 1 - (1 - limit) * scale;
+}
+
+/*
+    Variance guidance from the SVGF moment history of the previous frame.
+    returns 1 for an unconverged pixel, -1 for a converged one, 0 without guidance.
+*/
+int getConvergence(int2 p)
+{
+    if (!filterData.as_varianceGuided)
+        return 0;
+
+    float4 moments = historyBuffer[SLOT_MOMENT_HISTORY][p];
+    if (moments.z < filterData.as_minHistoryLength)
+        return 1;
+
+    float variance = max(0, moments.y - moments.x * moments.x);
+    float mean = max(moments.x, EPSILON);
+
+    return sqrt(variance) > filterData.as_varianceLimit * mean ? 1 : -1;
+}
+
+bool tryInterpolateFromCell(int2 pos, int2 upperLeft, int2 lowerRight, float limitScale)
+{
+    float colourLimit = filterData.as_colourLimit * limitScale;
+    float normalDotLimit = widenDotLimit(filterData.as_normalDotLimit, limitScale);
+    float posDiffLimit = filterData.as_posDiffLimit * limitScale;
+
+    int2 c00 = upperLeft;
+    int2 c10 = int2(lowerRight.x, upperLeft.y);
+    int2 c01 = int2(upperLeft.x, lowerRight.y);
+    int2 c11 = lowerRight;
+
+    float4 one = rayBuffer[SLOT_COLOUR][c00];
+    float4 two = rayBuffer[SLOT_COLOUR][c10];
+    float4 three = rayBuffer[SLOT_COLOUR][c01];
+    float4 four = rayBuffer[SLOT_COLOUR][c11];
+
+    if (one.w <= AS_CAST || two.w <= AS_CAST || three.w <= AS_CAST || four.w <= AS_CAST)
+        return false;
+
+    // Bilinear weights, a cell squashed against the image border has zero width.
+    float tx = lowerRight.x > upperLeft.x ? float(pos.x - upperLeft.x) / float(lowerRight.x - upperLeft.x) : 0;
+    float ty = lowerRight.y > upperLeft.y ? float(pos.y - upperLeft.y) / float(lowerRight.y - upperLeft.y) : 0;
+    float4 bary = float4((1 - tx) * (1 - ty), tx * (1 - ty), (1 - tx) * ty, tx * ty);
+
+    float4 intColour = one * bary.x + two * bary.y + three * bary.z + four * bary.w;
+
+    // check if colour is ok
+    if (!(length(intColour.xyz - one.xyz) < colourLimit &&
+          length(intColour.xyz - two.xyz) < colourLimit &&
+          length(intColour.xyz - three.xyz) < colourLimit &&
+          length(intColour.xyz - four.xyz) < colourLimit))
+        return false;
+
+    // check if same object (with mask)
+    one = rayBuffer[SLOT_OBJECT_ID_MASK][c00];
+    two = rayBuffer[SLOT_OBJECT_ID_MASK][c10];
+    three = rayBuffer[SLOT_OBJECT_ID_MASK][c01];
+    four = rayBuffer[SLOT_OBJECT_ID_MASK][c11];
+
+    if (!(length(one - two) == 0 && length(one - three) == 0 && length(one - four) == 0))
+        return false;
+
+    float4 intObj = one;
+
+    one.xyz = normalize(rayBuffer[SLOT_NORMALS][c00].xyz * 2 - 1);
+    two.xyz = normalize(rayBuffer[SLOT_NORMALS][c10].xyz * 2 - 1);
+    three.xyz = normalize(rayBuffer[SLOT_NORMALS][c01].xyz * 2 - 1);
+    four.xyz = normalize(rayBuffer[SLOT_NORMALS][c11].xyz * 2 - 1);
+
+    // check normals pointing in somewhat same direction
+    if (!(dot(one.xyz, two.xyz) > normalDotLimit &&
+          dot(one.xyz, three.xyz) > normalDotLimit &&
+          dot(one.xyz, four.xyz) > normalDotLimit))
+        return false;
+
+    float3 intNorm = normalize(one.xyz * bary.x + two.xyz * bary.y + three.xyz * bary.z + four.xyz * bary.w);
+
+    one = rayBuffer[SLOT_POS_DEPTH][c00];
+    two = rayBuffer[SLOT_POS_DEPTH][c10];
+    three = rayBuffer[SLOT_POS_DEPTH][c01];
+    four = rayBuffer[SLOT_POS_DEPTH][c11];
+
+    // check world position is within limit, scaled by the pixel distance of the corners
+    if (!(length(one.xyz - two.xyz) < max(1, length(float2(c10 - c00))) * posDiffLimit &&
+          length(one.xyz - three.xyz) < max(1, length(float2(c01 - c00))) * posDiffLimit &&
+          length(one.xyz - four.xyz) < max(1, length(float2(c11 - c00))) * posDiffLimit))
+        return false;
+
+    float4 intPosition = one * bary.x + two * bary.y + three * bary.z + four * bary.w;
+
+    // Write interpolated value
+    rayBuffer[SLOT_COLOUR][pos] = float4(intColour.xyz, AS_INTERPOLATED);
+    rayBuffer[SLOT_NORMALS][pos] = float4(intNorm * 0.5 + 0.5, 1); // [-1,1] to [0,1]
+    rayBuffer[SLOT_POS_DEPTH][pos] = intPosition;
+    rayBuffer[SLOT_OBJECT_ID_MASK][pos] = intObj;
+
+    return true;
+}
+
+#define BLOCK_SIZE 16
+[numthreads(BLOCK_SIZE, BLOCK_SIZE, 1)]
+void main(ComputeShaderInput IN)
+{
+    // cleans out those outside of the image
+    if (IN.DispatchThreadID.x >= filterData.windowResolution.x || IN.DispatchThreadID.y >= filterData.windowResolution.y)
+        return;
+
+    int2 launchIndex = IN.DispatchThreadID.xy;
+
+    // cleans out those that have already been traced.
+    if (rayBuffer[SLOT_COLOUR][launchIndex].w != AS_EMPTY)
+        return;
+
+    int itr = data.iteration;
+    int2 lastPixel = int2(filterData.windowResolution) - 1;
+
+    if (itr > 0)
+    {
+        // All four corners of the enclosing cell are resolved by now.
+        int cellSize = calcLatticeSpacing(itr - 1);
+        int2 upperLeft = (launchIndex / cellSize) * cellSize;
+        int2 lowerRight = min(upperLeft + cellSize, lastPixel);
+
+        // Unconverged pixels were all cast in the first pass.
+        float limitScale = getConvergence(launchIndex) < 0 ? filterData.as_convergedLimitScale : 1;
+
+        if (tryInterpolateFromCell(launchIndex, upperLeft, lowerRight, limitScale))
+            return;
+    }
+
+    // The image border is part of every lattice.
+    int spacing = calcLatticeSpacing(itr);
+    bool onLattice = itr >= calcPassCount() - 1 ||
+        ((launchIndex.x % spacing == 0 || launchIndex.x == lastPixel.x) &&
+         (launchIndex.y % spacing == 0 || launchIndex.y == lastPixel.y));
+
+    if (onLattice || (itr == 0 && getConvergence(launchIndex) > 0))
+        rayBuffer[SLOT_COLOUR][launchIndex].w = AS_CAST;
+}
@@ -0,0 +1,113 @@
+struct ComputeShaderInput
+{
+    uint3 GroupID : SV_GroupID; // 3D index of the thread group in the dispatch.
+    uint3 GroupThreadID : SV_GroupThreadID; // 3D index of local thread ID in a thread group.
+    uint3 DispatchThreadID : SV_DispatchThreadID; // 3D index of global thread ID in the dispatch.
+    uint GroupIndex : SV_GroupIndex; // Flattened local index of the thread within a thread group.
+};
+
+struct CompactionData
+{
+    uint2 windowResolution;
+
+    // Thread groups in this dispatch, the last one to finish writes the launch size.
+    uint groupCount;
+
+    // Byte offset of Width/Height/Depth in the D3D12_DISPATCH_RAYS_DESC argument buffer.
+    uint dispatchArgsOffset;
+};
+
+ConstantBuffer<CompactionData> data : register(b0);
+
+/*
+    colour,
+    normal,
+    posDepth,
+    objectMask,
+*/
+RWTexture2D<float4> rayBuffer[] : register(u0, space0);
+
+// Packed (y << 16 | x) pixel of every ray to cast, see CPULib/RayCompaction.h.
+RWStructuredBuffer<uint> pixelList : register(u0, space1);
+
+// [0] := rays written, [4] := groups finished. Cleared to zero before the dispatch.
+RWByteAddressBuffer counters : register(u1, space1);
+
+// Indirect DispatchRays arguments, shader table addresses are filled by the CPU.
+RWByteAddressBuffer dispatchArgs : register(u2, space1);
+
+#define SLOT_COLOUR 0
+
+#define AS_CAST 1
+
+#define MAX_DISPATCH_WIDTH 1024
+
+/*
+    SUMMARY:= Stream compaction of the pixels the scheduler marked AS_CAST.
+        Every group counts its rays in group shared memory, reserves a range of
+        the list with a single global atomic and scatters into it. The order
+        within the list is not stable, only the set of pixels is.
+*/
+
+groupshared uint gs_Count;
+groupshared uint gs_Base;
+groupshared bool gs_LastGroup;
+
+#define BLOCK_SIZE 16
+[numthreads(BLOCK_SIZE, BLOCK_SIZE, 1)]
+void main(ComputeShaderInput IN)
+{
+    if (IN.GroupIndex == 0)
+        gs_Count = 0;
+
+    GroupMemoryBarrierWithGroupSync();
+
+    uint2 launchIndex = IN.DispatchThreadID.xy;
+
+    bool cast = launchIndex.x < data.windowResolution.x && launchIndex.y < data.windowResolution.y &&
+        rayBuffer[SLOT_COLOUR][launchIndex].w == AS_CAST;
+
+    // local exclusive offset of this ray in the group.
+    uint local = 0;
+    if (cast)
+        InterlockedAdd(gs_Count, 1, local);
+
+    GroupMemoryBarrierWithGroupSync();
+
+    if (IN.GroupIndex == 0)
+    {
+        uint base = 0;
+        if (gs_Count > 0)
+            counters.InterlockedAdd(0, gs_Count, base);
+        gs_Base = base;
+    }
+
+    GroupMemoryBarrierWithGroupSync();
+
+    if (cast)
+        pixelList[gs_Base + local] = (launchIndex.y << 16) | (launchIndex.x & 0xFFFF);
+
+    // Every ray of the group is in the list, visible to the other groups, before the group counts as finished.
+    DeviceMemoryBarrierWithGroupSync();
+
+    // The last group to finish turns the final count into the launch size.
+    if (IN.GroupIndex == 0)
+    {
+        uint finished;
+        counters.InterlockedAdd(4, 1, finished);
+        gs_LastGroup = finished == data.groupCount - 1;
+    }
+
+    GroupMemoryBarrierWithGroupSync();
+
+    if (IN.GroupIndex == 0 && gs_LastGroup)
+    {
+        uint rayCount;
+        counters.InterlockedAdd(0, 0, rayCount);
+
+        uint width = min(rayCount, MAX_DISPATCH_WIDTH);
+        uint height = width > 0 ? (rayCount + width - 1) / width : 0;
+
+        dispatchArgs.Store3(data.dispatchArgsOffset, uint3(width, height, width > 0 ? 1 : 0));
+    }
+}
@@ -42,6 +42,11 @@ struct DenoiserFilterData
     float as_normalDotLimit;
     float as_depthDiffLimit;
     float as_colourLimit;
+    
+    int as_varianceGuided;
+    float as_varianceLimit;
+    int as_minHistoryLength;
+    float as_convergedLimitScale;
 };
 
 struct perFrame
@@ -60,12 +65,22 @@ ConstantBuffer<perFrame> data : register(b1);
 */
 RWTexture2D<float4> rayBuffer[] : register(u0, space0);
 
+/*
+    oldIntegratedColour,
+    prevNormal,
+    prevPosDepth,
+    prevObject,
+    momentHistory,
+*/
+RWTexture2D<float4> historyBuffer[] : register(u0, space1);
+
 
 
 #define SLOT_COLOUR 0
 #define SLOT_NORMALS 1
 #define SLOT_POS_DEPTH 2
 #define SLOT_OBJECT_ID_MASK 3
+#define SLOT_MOMENT_HISTORY 4
 
 #define RAW_SAMPLES 0
 
@@ -194,8 +209,37 @@ Triangle buildTriangle(int2 pos, int side)
     return result;
 }
 
-bool tryInterpolateFromSquare(int2 pos, Square quad)
+// Scale the angle tolerance of a dot product limit, exact for scale 1.
+float widenDotLimit(float limit, float scale)
+{
+    return scale == 1 ? limit : 1 - (1 - limit) * scale;
+}
+
+/*
+    Variance guidance from the SVGF moment history of the previous frame.
+    returns 1 for an unconverged pixel, -1 for a converged one, 0 without guidance.
+*/
+int getConvergence(int2 p)
+{
+    if (!filterData.as_varianceGuided)
+        return 0;
+    
+    float4 moments = historyBuffer[SLOT_MOMENT_HISTORY][p];
+    if (moments.z < filterData.as_minHistoryLength)
+        return 1;
+    
+    float variance = max(0, moments.y - moments.x * moments.x);
+    float mean = max(moments.x, EPSILON);
+    
+    return sqrt(variance) > filterData.as_varianceLimit * mean ? 1 : -1;
+}
+
+bool tryInterpolateFromSquare(int2 pos, Square quad, float limitScale)
 {
+    float colourLimit = filterData.as_colourLimit * limitScale;
+    float normalDotLimit = widenDotLimit(filterData.as_normalDotLimit, limitScale);
+    float posDiffLimit = filterData.as_posDiffLimit * limitScale;
+    
     int2 pUp = quad.one;
     int2 pDown = quad.two;
     int2 pLeft = quad.three;
@@ -212,10 +256,10 @@ bool tryInterpolateFromSquare(int2 pos, Square quad)
         float4 intColour = up * quad.barycentrics.x + down * quad.barycentrics.y 
             + left * quad.barycentrics.z + right * quad.barycentrics.w;
         // check if colour is ok
-        if (length(intColour.xyz - up.xyz) < filterData.as_colourLimit &&
-            length(intColour.xyz - down.xyz) < filterData.as_colourLimit &&
-            length(intColour.xyz - left.xyz) < filterData.as_colourLimit &&
-            length(intColour.xyz - right.xyz) < filterData.as_colourLimit)
+        if (length(intColour.xyz - up.xyz) < colourLimit &&
+            length(intColour.xyz - down.xyz) < colourLimit &&
+            length(intColour.xyz - left.xyz) < colourLimit &&
+            length(intColour.xyz - right.xyz) < colourLimit)
         {
             // check if same object (with mask)
             up = rayBuffer[SLOT_OBJECT_ID_MASK][pUp];
@@ -235,9 +279,9 @@ bool tryInterpolateFromSquare(int2 pos, Square quad)
                 right.xyz = normalize(rayBuffer[SLOT_NORMALS][pRight].xyz * 2 - 1);
             
                 // check normals pointing in somewhat same direction
-                if (dot(up.xyz, down.xyz) > filterData.as_normalDotLimit &&
-                    dot(left.xyz, right.xyz) > filterData.as_normalDotLimit &&
-                    dot(up.xyz, left.xyz) > filterData.as_normalDotLimit)
+                if (dot(up.xyz, down.xyz) > normalDotLimit &&
+                    dot(left.xyz, right.xyz) > normalDotLimit &&
+                    dot(up.xyz, left.xyz) > normalDotLimit)
                 {
                     float3 intNorm = normalize(up.xyz * quad.barycentrics.x + down.xyz * quad.barycentrics.y 
                                         + left.xyz * quad.barycentrics.z + right.xyz * quad.barycentrics.w);
@@ -247,9 +291,9 @@ bool tryInterpolateFromSquare(int2 pos, Square quad)
                     right = rayBuffer[SLOT_POS_DEPTH][pRight];
                     
                     // check world position is within limit
-                    if (length(up.xyz - down.xyz) < 2 * filterData.as_posDiffLimit &&
-                        length(left.xyz - right.xyz) < 2 * filterData.as_posDiffLimit &&
-                        length(up.xyz - left.xyz) < 2 * filterData.as_posDiffLimit)
+                    if (length(up.xyz - down.xyz) < 2 * posDiffLimit &&
+                        length(left.xyz - right.xyz) < 2 * posDiffLimit &&
+                        length(up.xyz - left.xyz) < 2 * posDiffLimit)
                     {
                         float4 intPosition = up * quad.barycentrics.x + down * quad.barycentrics.y 
                                     + left * quad.barycentrics.z + right * quad.barycentrics.w;
@@ -272,8 +316,12 @@ bool tryInterpolateFromSquare(int2 pos, Square quad)
     return false;
 }
 
-bool tryInterpolateFromTriangle(int2 pos, in Triangle tri)
+bool tryInterpolateFromTriangle(int2 pos, in Triangle tri, float limitScale)
 {
+    float colourLimit = filterData.as_colourLimit * limitScale;
+    float normalDotLimit = widenDotLimit(filterData.as_normalDotLimit, limitScale);
+    float posDiffLimit = filterData.as_posDiffLimit * limitScale;
+    
     float4 one = rayBuffer[SLOT_COLOUR][tri.one];
     float4 two = rayBuffer[SLOT_COLOUR][tri.two];
     float4 three = rayBuffer[SLOT_COLOUR][tri.three];
@@ -283,9 +331,9 @@ bool tryInterpolateFromTriangle(int2 pos, in Triangle tri)
         float4 inteColour = one * tri.barycentrics.x + two * tri.barycentrics.y + three * tri.barycentrics.z;
         
         // check if colour is ok
-        if (length(inteColour.xyz - one.xyz) < filterData.as_colourLimit &&
-            length(inteColour.xyz - two.xyz) < filterData.as_colourLimit &&
-            length(inteColour.xyz - three.xyz) < filterData.as_colourLimit )
+        if (length(inteColour.xyz - one.xyz) < colourLimit &&
+            length(inteColour.xyz - two.xyz) < colourLimit &&
+            length(inteColour.xyz - three.xyz) < colourLimit )
         {
             // check if same object (with mask)
             one = rayBuffer[SLOT_OBJECT_ID_MASK][tri.one];
@@ -303,9 +351,9 @@ bool tryInterpolateFromTriangle(int2 pos, in Triangle tri)
                 three.xyz = normalize(rayBuffer[SLOT_NORMALS][tri.three].xyz * 2 - 1);
                 
                 // check normals pointing in somewhat same direction
-                if (dot(one.xyz, two.xyz) > filterData.as_normalDotLimit &&
-                    dot(one.xyz, three.xyz) > filterData.as_normalDotLimit &&
-                    dot(one.xyz, two.xyz) > filterData.as_normalDotLimit)
+                if (dot(one.xyz, two.xyz) > normalDotLimit &&
+                    dot(one.xyz, three.xyz) > normalDotLimit &&
+                    dot(one.xyz, two.xyz) > normalDotLimit)
                 {
                     float3 intNorm = normalize(one.xyz * tri.barycentrics.x + two.xyz * tri.barycentrics.y + three.xyz * tri.barycentrics.z);
                     
@@ -315,9 +363,9 @@ bool tryInterpolateFromTriangle(int2 pos, in Triangle tri)
                     three = rayBuffer[SLOT_POS_DEPTH][tri.three];
                     
                     // check world position is within limit
-                    if (length(one.xyz - two.xyz) < length(tri.one - pos) * filterData.as_posDiffLimit &&
-                        length(one.xyz - three.xyz) < length(tri.two - pos) * filterData.as_posDiffLimit &&
-                        length(two.xyz - three.xyz) < length(tri.three - pos) * filterData.as_posDiffLimit)
+                    if (length(one.xyz - two.xyz) < length(tri.one - pos) * posDiffLimit &&
+                        length(one.xyz - three.xyz) < length(tri.two - pos) * posDiffLimit &&
+                        length(two.xyz - three.xyz) < length(tri.three - pos) * posDiffLimit)
                     {
                         float4 intPosition = one * tri.barycentrics.x + two * tri.barycentrics.y + three * tri.barycentrics.z;
                         
@@ -360,6 +408,9 @@ void main(ComputeShaderInput IN)
     
     int itr = data.iteration;
     
+    int convergence = getConvergence(launchIndex.xy);
+    float limitScale = convergence < 0 ? filterData.as_convergedLimitScale : 1;
+    
     // initial step
     if (itr == 0)
     {
@@ -374,6 +425,10 @@ void main(ComputeShaderInput IN)
         else if (shootNextRay(launchIndex.xy, tileSize)) {
             rayBuffer[SLOT_COLOUR][launchIndex.xy].w = AS_CAST;
         }
+        // if still noisy or without history
+        else if (convergence > 0) {
+            rayBuffer[SLOT_COLOUR][launchIndex.xy].w = AS_CAST;
+        }
             
     }
     else if (itr == maxStep) // final step.
@@ -386,7 +441,7 @@ void main(ComputeShaderInput IN)
         neighbour.three = launchIndex.xy + int2(1, 0);
         neighbour.four = launchIndex.xy + int2(-1, 0);
         
-        if (!tryInterpolateFromSquare(launchIndex.xy, neighbour))
+        if (!tryInterpolateFromSquare(launchIndex.xy, neighbour, limitScale))
             rayBuffer[SLOT_COLOUR][launchIndex.xy].w = AS_CAST;
     }
     else if (true) // smart cast between pixels. 
@@ -397,7 +452,7 @@ void main(ComputeShaderInput IN)
         Triangle tri = buildTriangle(launchIndex.xy, adjustedGridSize);
         
         // see if we can interpolate the value.
-        if (tryInterpolateFromTriangle(launchIndex.xy, tri))
+        if (tryInterpolateFromTriangle(launchIndex.xy, tri, limitScale))
             return;
         
         // if we cant interpolate, check if we should send the next one.
@@ -15,11 +15,19 @@
 #define SPECULAR        1
 #define TRANSMISSIVE    2
 
+// RayMaterialProp.Flags
+#define MATERIAL_NORMAL_XY 1
+
 #define RAY_PRIMARY 0
 #define RAY_SECONDARY 1
 
 #define RAY_LIGHT 2
 
+// Defined by the application when the scene is imported with VertexFormat::Packed.
+#ifdef PACKED_VERTICES
+#include "cpulib/VertexEncoding.h"
+#endif
+
 // PAYLOADS AND STRUCTS
 struct RayPayload
 {
@@ -74,7 +82,8 @@ struct RayMaterialProp
     
     float IndexOfRefraction;
     float Roughness;
-    float2 _padding;
+    uint IndexSize;
+    uint Flags;
 };
 
 
@@ -149,6 +158,11 @@ Texture2D<float4> maskTex[]     : register(t2, space6);
 // UAV
 RWTexture2D<float4> gOutput[] : register(u0);
 
+// Packed (y << 16 | x) pixel of every ray to cast, see RayCompaction.hlsl.
+RWStructuredBuffer<uint> compactedPixels : register(u0, space1);
+// [0] := rays in compactedPixels.
+RWByteAddressBuffer compactionCounters : register(u1, space1);
+
 // CBV
 ConstantBuffer<PerFrameData> frame : register(b0);
 ConstantBuffer<ConstantData> globals : register(b1);
@@ -171,6 +185,12 @@ float3 modelToWorldPosition(float3 pos)
     return mul(instTrans.modelToWorld, float4(pos, 1)).xyz;
 }
 
+// modelToWorldPosition of the instance hit, after the offset of a mesh copy. Hit shaders only.
+float3 instanceToWorldPosition(float3 pos)
+{
+    return mul(ObjectToWorld3x4(), float4(pos, 1)).xyz;
+}
+
 
 MaterialInfoBDRF MaterialInfo(in float3 view, in float3 normal, in float3 pos, in uint matType,
         in float3 colour, in float reflectivity, in float roughness, in float ior, in uint depth)
@@ -417,8 +437,22 @@ float3 SampleLightDirection(in float3 position, in float3 normal, inout uint see
 // INTERPOLATION helper functions
 uint3 _getIndices(uint geometryIdx, uint triangleIndex)
 {
-    uint indexByteStartAddress = triangleIndex * 3 * 4;
-    return indices[geometryIdx].Load3(indexByteStartAddress);
+    // The geometry's IndexSize in its RayMaterialProp, see GetMaterialProp.
+    uint indexSize = GeometryMaterialMap.Load(geometryIdx * sizeof(RayMaterialProp) + 14 * 4);
+    if (indexSize == 4)
+    {
+        uint indexByteStartAddress = triangleIndex * 3 * 4;
+        return indices[geometryIdx].Load3(indexByteStartAddress);
+    }
+
+    // Loads are 4 byte aligned: the three 16 bit indices are the first or the last three halves of the two words.
+    uint indexByteStartAddress = triangleIndex * 3 * 2;
+    uint2 words = indices[geometryIdx].Load2(indexByteStartAddress & ~3);
+    if (indexByteStartAddress & 2)
+    {
+        return uint3(words.x >> 16, words.y & 0xffff, words.y >> 16);
+    }
+    return uint3(words.x & 0xffff, words.x >> 16, words.y & 0xffff);
 }
 
 VertexAttributes GetVertexAttributes(uint geometryIndex, uint primitiveIndex, float3 barycentrics, out float3 faceNormal)
@@ -439,25 +473,42 @@ VertexAttributes GetVertexAttributes(uint geometryIndex, uint primitiveIndex, fl
     
     for (i = 0; i < 3; ++i)
     {
+#ifdef PACKED_VERTICES
+        triangleVertexIndex = triangleIndices[i] * PACKED_VERTEX_STRIDE;
+
+        vertPos[i] = asfloat(vertices[geometryIndex].Load3(triangleVertexIndex));
+        v.position += vertPos[i] * barycentrics[i];
+
+        // normal, tangent and texture coordinate
+        uint3 packed = vertices[geometryIndex].Load3(triangleVertexIndex + PACKED_VERTEX_NORMAL_OFFSET);
+        float3 normal = VertexDecodeNormal(packed.x);
+        float3 tangent = VertexDecodeTangent(packed.y);
+        v.normal += normal * barycentrics[i];
+        v.tangent += tangent * barycentrics[i];
+        v.bitangent += VertexDecodeBitangent(normal, tangent, packed.y) * barycentrics[i];
+        texels[i] = float3(VertexDecodeTexCoord(packed.z), 0);
+        v.texCoord += texels[i] * barycentrics[i];
+#else
         // get byte address 
         triangleVertexIndex = triangleIndices[i] * sizeof(VertexAttributes);
         
         // position
-        vertPos[i] = asfloat(vertices[GeometryIndex()].Load3(triangleVertexIndex));
+        vertPos[i] = asfloat(vertices[geometryIndex].Load3(triangleVertexIndex));
         v.position += vertPos[i] * barycentrics[i];
         triangleVertexIndex += 3 * 4; // check the next float 3
         // normal
-        v.normal += normalize(asfloat(vertices[GeometryIndex()].Load3(triangleVertexIndex))) * barycentrics[i];
+        v.normal += normalize(asfloat(vertices[geometryIndex].Load3(triangleVertexIndex))) * barycentrics[i];
         triangleVertexIndex += 3 * 4; // check the next float 3
         // tangent
-        v.tangent += normalize(asfloat(vertices[GeometryIndex()].Load3(triangleVertexIndex))) * barycentrics[i];
+        v.tangent += normalize(asfloat(vertices[geometryIndex].Load3(triangleVertexIndex))) * barycentrics[i];
         triangleVertexIndex += 3 * 4; // check the next float 3
         // bitangent
-        v.bitangent += normalize(asfloat(vertices[GeometryIndex()].Load3(triangleVertexIndex))) * barycentrics[i];
+        v.bitangent += normalize(asfloat(vertices[geometryIndex].Load3(triangleVertexIndex))) * barycentrics[i];
         triangleVertexIndex += 3 * 4; // check the next float 3
         // tex coordinate
-        texels[i] = asfloat(vertices[GeometryIndex()].Load3(triangleVertexIndex));
+        texels[i] = asfloat(vertices[geometryIndex].Load3(triangleVertexIndex));
         v.texCoord += texels[i] * barycentrics[i];
+#endif
     }
     
     // DEPTH CALCULATION BASED ON:
@@ -469,11 +520,11 @@ VertexAttributes GetVertexAttributes(uint geometryIndex, uint primitiveIndex, fl
         );
     
     
-    v.position = modelToWorldPosition(v.position);
+    v.position = instanceToWorldPosition(v.position);
     
     for (i = 0; i < 3; ++i)
     {
-        vertPos[i] = modelToWorldPosition(vertPos[i]);
+        vertPos[i] = instanceToWorldPosition(vertPos[i]);
     }
     
     
@@ -530,6 +581,10 @@ RayMaterialProp GetMaterialProp(uint geometryIndex)
     indexByteStartAddress += 4; // add one float
     result.Roughness = asfloat(GeometryMaterialMap.Load(indexByteStartAddress));
     indexByteStartAddress += 4; // add one float
+    result.IndexSize = GeometryMaterialMap.Load(indexByteStartAddress);
+    indexByteStartAddress += 4; // add one uint
+    result.Flags = GeometryMaterialMap.Load(indexByteStartAddress);
+    indexByteStartAddress += 4; // add one uint
     
     return result;
 }
@@ -974,14 +1029,16 @@ void sampleBRDF(out float3 reflectDir, out float3 lightDir,
 [shader("raygeneration")]
 void rayGen()
 {
-    uint3 launchIndex = DispatchRaysIndex();
-    uint3 launchDim = DispatchRaysDimensions();
-
-    float val = gOutput[SLOT_COLOUR][launchIndex.xy].w;
-    
-    // ignore those that are unselected
-    if (val != AS_CAST)
+    // The launch runs over the compacted list, its last row is only partly used.
+    uint rayIndex = DispatchRaysIndex().y * DispatchRaysDimensions().x + DispatchRaysIndex().x;
+    if (rayIndex >= compactionCounters.Load(0))
         return;
+
+    uint packedPixel = compactedPixels[rayIndex];
+    uint3 launchIndex = uint3(packedPixel & 0xFFFF, packedPixel >> 16, 0);
+
+    uint3 launchDim = uint3(0, 0, 1);
+    gOutput[SLOT_COLOUR].GetDimensions(launchDim.x, launchDim.y);
         
     uint bufferOffset = launchDim.x * launchIndex.y + launchIndex.x;
     uint seed = getNewSeed(bufferOffset, frame.cpuGeneratedSeed, 8);
@@ -1058,9 +1115,12 @@ void standardChs(inout RayPayload payload, in BuiltInTriangleIntersectionAttribu
     // (w,u,v)
     float3 barycentrics = float3(1.0 - attribs.barycentrics.x - attribs.barycentrics.y, attribs.barycentrics.x, attribs.barycentrics.y);
     
+    // The meshes of an instance are the scene's from its InstanceID() on, see Scene::GetMeshInstances.
+    uint mesh = InstanceID() + GeometryIndex();
+
     float3 faceNormal;
-    RayMaterialProp mat = GetMaterialProp(GeometryIndex());
-    VertexAttributes v = GetVertexAttributes(GeometryIndex(), PrimitiveIndex(), barycentrics, faceNormal);
+    RayMaterialProp mat = GetMaterialProp(mesh);
+    VertexAttributes v = GetVertexAttributes(mesh, PrimitiveIndex(), barycentrics, faceNormal);
     
     // Alpha can be set by either mask or diffuse texture
     float4 tex_rgba = float4(mat.Diffuse, 1);
@@ -1120,6 +1180,10 @@ void standardChs(inout RayPayload payload, in BuiltInTriangleIntersectionAttribu
         {
             // from [0,1] to [-1, 1]
             normalMap = TriSampleTex(normalsTex, mat.NormalTextureIdx, v.texCoord).rgb * 2 - 1;
+            
+            // Cooked normal maps (BC5) only store X and Y, Z is rebuilt from those
+            if (mat.Flags & MATERIAL_NORMAL_XY)
+                normalMap.z = sqrt(saturate(1 - dot(normalMap.xy, normalMap.xy)));
             float3x3 TBN = float3x3(v.tangent, v.bitangent, v.normal);
             normalMap = mul(normalMap, TBN);
         }
@@ -1142,7 +1206,7 @@ void standardChs(inout RayPayload payload, in BuiltInTriangleIntersectionAttribu
             payload.lightDir = 0;
             
             payload.normal = dot(faceNormal, V) < 0 ? -faceNormal : faceNormal;
-            payload.object = GeometryIndex();
+            payload.object = mesh;
             payload.mask = mat.Type;
             payload.rayMode = RAY_SECONDARY;
             return;
@@ -1181,7 +1245,7 @@ void standardChs(inout RayPayload payload, in BuiltInTriangleIntersectionAttribu
         if (payload.rayMode == RAY_PRIMARY)
         {
             payload.normal = normalMap;
-            payload.object = GeometryIndex();
+            payload.object = mesh;
             payload.mask = mat.Type;
             payload.rayMode = RAY_SECONDARY;
         }
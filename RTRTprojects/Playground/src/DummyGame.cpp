@@ -3,6 +3,7 @@
 
 #include <DirectXMath.h>
 
+#include <dx12lib/ByteAddressBuffer.h>
 #include <dx12lib/CommandList.h>
 #include <dx12lib/CommandQueue.h>
 #include <dx12lib/Device.h>
@@ -10,9 +11,11 @@
 #include <dx12lib/Helpers.h>
 #include <dx12lib/Mesh.h>
 #include <dx12lib/PipelineStateObject.h>
+#include <dx12lib/RenderGraphBackend.h>
 #include <dx12lib/RootSignature.h>
 #include <dx12lib/Scene.h>
 #include <dx12lib/SceneNode.h>
+#include <dx12lib/StructuredBuffer.h>
 #include <dx12lib/SwapChain.h>
 #include <dx12lib/Texture.h>
 #include <dx12lib/Visitor.h>
@@ -29,6 +32,7 @@
 
 #include <dx12lib/IndexBuffer.h>
 #include <dx12lib/VertexBuffer.h>
+#include <cpulib/AliasingPlanner.h>
 
 #include <dxcapi.h>
 
@@ -49,8 +53,26 @@ using namespace DirectX;
 
 #include <math.h>
 #include <algorithm>  // For std::min, std::max, and std::clamp.
+#include <cassert>
+#include <cstddef>  // For offsetof.
 #include <random>
 
+// The root constants of RayCompaction.hlsl.
+struct RayCompactionData
+{
+    uint32_t windowResolution[2];
+    uint32_t groupCount;
+    uint32_t dispatchArgsOffset;
+};
+
+// XMStoreFloat3x4 transposes, XMFLOAT3X4 holds the transform for column vectors as float3x4 does.
+static cpulib::float3x4 ToTransform( DirectX::FXMMATRIX m )
+{
+    cpulib::float3x4 transform;
+    DirectX::XMStoreFloat3x4( reinterpret_cast<DirectX::XMFLOAT3X4*>( &transform ), m );
+    return transform;
+}
+
 
 DummyGame::DummyGame( const std::wstring& name, int width, int height, bool vSync )
 : m_ScissorRect( CD3DX12_RECT( 0, 0, LONG_MAX, LONG_MAX ) )
@@ -89,6 +111,39 @@ DummyGame::DummyGame( const std::wstring& name, int width, int height, bool vSyn
     UpdateCamera( ( m_Left - m_Right ) * cam_speed , ( m_Up - m_Down ) * cam_speed ,
                   ( m_Forward - m_Backward ) * cam_speed , 0);
 
+    cpulib::RayBudgetSettings budget;
+    budget.mode   = cpulib::BudgetMode::Milliseconds;
+    budget.target = 1000.0f / 60.0f;
+    m_RayBudget.SetSettings( budget );
+
+    m_SvgfStages = cpulib::BuildSvgfRotation( m_SvgfRotation, m_nbrAtrousIterations );
+
+    std::string rotationError;
+    if ( !m_SvgfRotation.Plan( &rotationError ) || !m_SvgfRotation.Validate( &rotationError ) )
+        m_Logger->error( "SVGF buffer rotation: {}", rotationError );
+    assert( m_SvgfRotation.GetBindingSetCount() > 0 );
+
+    // What the SVGF buffers take at the common resolutions, PlaceSvgfBuffers logs the heap for the window.
+    const uint32_t resolutions[][2] = { { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+    for ( const auto& resolution: resolutions )
+    {
+        const cpulib::SvgfMemory memory = cpulib::PlanSvgfMemory( m_SvgfRotation, resolution[0], resolution[1] );
+        m_Logger->info( "SVGF buffers at {}x{}: {:.1f} MB committed, {:.1f} MB aliased", resolution[0], resolution[1],
+                        memory.committedBytes / ( 1024.0 * 1024.0 ), memory.aliasedBytes / ( 1024.0 * 1024.0 ) );
+    }
+
+    for ( uint32_t resource = 0; resource < m_SvgfRotation.GetResourceCount(); ++resource )
+    {
+        const uint32_t firstBuffer = m_SvgfRotation.GetFirstBuffer( resource );
+        const uint32_t endBuffer   = resource + 1 < m_SvgfRotation.GetResourceCount()
+                                         ? m_SvgfRotation.GetFirstBuffer( resource + 1 )
+                                         : m_SvgfRotation.GetBufferCount();
+
+        for ( uint32_t buffer = firstBuffer; buffer < endBuffer; ++buffer )
+            m_RenderGraph.ImportResource( m_SvgfRotation.GetResourceName( resource ) + "#" +
+                                          std::to_string( buffer - firstBuffer ) );
+    }
+    m_BackBufferHandle = m_RenderGraph.ImportResource( "back buffer" );
 }
 
 DummyGame::~DummyGame()
@@ -114,6 +169,8 @@ void DummyGame::printToFile()
         myfile << "Unable to open file";
 
     myfile.close();
+
+    cpulib::WriteCameraPath( "camera.csv", m_CameraPath );
 }
 
 uint32_t DummyGame::Run()
@@ -123,6 +180,7 @@ uint32_t DummyGame::Run()
     m_Window->Show();
 
     timeStampDeltaTime.clear();
+    m_CameraPath.clear();
 
     uint32_t retCode = GameFramework::Get().Run();
 
@@ -196,14 +254,19 @@ void DummyGame::CreateRayTracingPipeline() {
         offset += 1;
 
 
-        CD3DX12_ROOT_PARAMETER1 rayRootParams[1] = {};
+        // The compacted pixel list and ray count, after the SVGF binding sets.
+        CD3DX12_DESCRIPTOR_RANGE1 compactionRange;
+        compactionRange.Init( D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 2, 0, 1, D3D12_DESCRIPTOR_RANGE_FLAG_NONE, 0 );
+
+        CD3DX12_ROOT_PARAMETER1 rayRootParams[2] = {};
 
         rayRootParams[0].InitAsDescriptorTable( rangeIdx, ranges );
+        rayRootParams[1].InitAsDescriptorTable( 1, &compactionRange );
 
         D3D12_ROOT_SIGNATURE_FLAGS rootSignatureFlags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
 
         CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDescription;
-        rootSignatureDescription.Init_1_1( 1, rayRootParams, 0, nullptr, rootSignatureFlags );
+        rootSignatureDescription.Init_1_1( 2, rayRootParams, 0, nullptr, rootSignatureFlags );
 
         m_RayGenRootSig = m_Device->CreateRootSignature( rootSignatureDescription.Desc_1_1 );
 
@@ -428,7 +491,8 @@ void DummyGame::CreateDenoisingPipeline()
     ComPtr<ID3DBlob> svgf_moments;
     ThrowIfFailed( D3DReadFileToBlob( L"data/shaders/Playground/SVGF_moments.cso", &svgf_moments ) );
 
-    CD3DX12_DESCRIPTOR_RANGE1 ranges[4];
+    // The UAVs are a table of their own, every pass binds the binding set it got from m_SvgfRotation.
+    CD3DX12_DESCRIPTOR_RANGE1 ranges[3];
 
     UINT offset = 0;
     ranges[0].Init( D3D12_DESCRIPTOR_RANGE_TYPE_UAV, m_nbrRayRenderTargets, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE, 0 );
@@ -438,20 +502,19 @@ void DummyGame::CreateDenoisingPipeline()
     offset += m_nbrHistoryRenderTargets;
     ranges[2].Init( D3D12_DESCRIPTOR_RANGE_TYPE_UAV, m_nbrFilterRenderTargets, 0, 2, D3D12_DESCRIPTOR_RANGE_FLAG_NONE,
                     offset );
-    offset += m_nbrFilterRenderTargets;
 
-    // Add for per frame, globals CB
-    offset += 2;
+    // Filter data CB, bound after the per frame and globals CB.
+    CD3DX12_DESCRIPTOR_RANGE1 cbRange;
+    cbRange.Init( D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE, 0 );
 
-    ranges[3].Init( D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE, offset );
-
-    CD3DX12_ROOT_PARAMETER1 rayRootParams[1] = {};
-    rayRootParams[0].InitAsDescriptorTable( 4, ranges );
+    CD3DX12_ROOT_PARAMETER1 rayRootParams[2] = {};
+    rayRootParams[0].InitAsDescriptorTable( 3, ranges );
+    rayRootParams[1].InitAsDescriptorTable( 1, &cbRange );
 
     D3D12_ROOT_SIGNATURE_FLAGS rootSignatureFlags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
 
     CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDescription;
-    rootSignatureDescription.Init_1_1( 1, rayRootParams, 0, nullptr, rootSignatureFlags );
+    rootSignatureDescription.Init_1_1( 2, rayRootParams, 0, nullptr, rootSignatureFlags );
 
     m_DenoiserRootSig = m_Device->CreateRootSignature( rootSignatureDescription.Desc_1_1 );
 
@@ -487,22 +550,29 @@ void DummyGame::CreateRaySchedularPipeline()
     ComPtr<ID3DBlob> raySchedular;
     ThrowIfFailed( D3DReadFileToBlob( L"data/shaders/Playground/RayScheduler.cso", &raySchedular ) );
 
-    CD3DX12_DESCRIPTOR_RANGE1 ranges[2];
+    ComPtr<ID3DBlob> quadtreeSchedular;
+    ThrowIfFailed( D3DReadFileToBlob( L"data/shaders/Playground/QuadtreeScheduler.cso", &quadtreeSchedular ) );
+
+    CD3DX12_DESCRIPTOR_RANGE1 ranges[3];
 
     UINT offset = 0;
     ranges[0].Init( D3D12_DESCRIPTOR_RANGE_TYPE_UAV, m_nbrRayRenderTargets, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE, 0 );
     offset += m_nbrRayRenderTargets;
 
-    // add for history and filter render targets
+    // history render targets, the moment history guides the sampling
+    ranges[1].Init( D3D12_DESCRIPTOR_RANGE_TYPE_UAV, m_nbrHistoryRenderTargets, 0, 1, D3D12_DESCRIPTOR_RANGE_FLAG_NONE,
+                    offset );
     offset += m_nbrHistoryRenderTargets;
+
+    // add for filter render targets
     offset += m_nbrFilterRenderTargets;
 
     // Add for per frame, globals CB
     offset += 2;
-    ranges[1].Init( D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE, offset );
+    ranges[2].Init( D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE, offset );
 
     CD3DX12_ROOT_PARAMETER1 rayRootParams[2] = {};
-    rayRootParams[0].InitAsDescriptorTable( 2, ranges );
+    rayRootParams[0].InitAsDescriptorTable( 3, ranges );
     //rayRootParams[1].InitAsConstantBufferView( 1, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_ALL );
     rayRootParams[1].InitAsConstants( 1, 1, 0, D3D12_SHADER_VISIBILITY_ALL );
 
@@ -526,81 +596,69 @@ void DummyGame::CreateRaySchedularPipeline()
     schedularPipelineStream.CS                           = CD3DX12_SHADER_BYTECODE( raySchedular.Get() );
     m_RaySchedulePipelineState = m_Device->CreatePipelineStateObject( schedularPipelineStream );
 
+    // Quadtree scheduler, same bindings
+    struct ComputePipelineState quadtreePipelineStream = {};
+    quadtreePipelineStream.pRootSignature              = m_RayScheduleRootSig->GetD3D12RootSignature().Get();
+    quadtreePipelineStream.CS                          = CD3DX12_SHADER_BYTECODE( quadtreeSchedular.Get() );
+    m_QuadtreeSchedulePipelineState = m_Device->CreatePipelineStateObject( quadtreePipelineStream );
+
 }
 
-void DummyGame::CreateShaderResource( DXGI_FORMAT backBufferFormat )
+void DummyGame::CreateRayCompactionPipeline()
 {
-    D3D12_RESOURCE_DESC renderDesc = CD3DX12_RESOURCE_DESC::Tex2D( backBufferFormat, m_Width, m_Height, 1, 1, 1, 0 );
-    renderDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS | D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET; 
+    ComPtr<ID3DBlob> rayCompaction;
+    ThrowIfFailed( D3DReadFileToBlob( L"data/shaders/Playground/RayCompaction.cso", &rayCompaction ) );
 
-    auto rayImage = m_Device->CreateTexture( renderDesc, nullptr );
-    rayImage->SetName( L"RayGen diffuse output texture" );
+    // The ray targets at the start of the heap, for the AS_CAST marks.
+    CD3DX12_DESCRIPTOR_RANGE1 rayRange;
+    rayRange.Init( D3D12_DESCRIPTOR_RANGE_TYPE_UAV, m_nbrRayRenderTargets, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_NONE, 0 );
 
-    auto rayAlbedo = m_Device->CreateTexture( renderDesc, nullptr );
-    rayAlbedo->SetName( L"RayGen albedo output texture" );
-
-    auto rayNormals = m_Device->CreateTexture( renderDesc, nullptr );
-    rayNormals->SetName( L"RayGen normal output texture" );
-
-    auto rayPosDepth = m_Device->CreateTexture( renderDesc, nullptr );
-    rayPosDepth->SetName( L"RayGen position/depth output texture" );
-
-    auto rayObjID = m_Device->CreateTexture( renderDesc, nullptr );
-    rayObjID->SetName( L"RayGen object ID/mask output texture" );
-
-    
-    m_RayRenderTarget.AttachTexture( m_ColourSlot, rayImage );
-    m_RayRenderTarget.AttachTexture( m_NormalsSlot, rayNormals );
-    m_RayRenderTarget.AttachTexture( m_PosDepth, rayPosDepth );
-    m_RayRenderTarget.AttachTexture( m_ObjectMask, rayObjID );
+    // Pixel list, counters and dispatch arguments.
+    CD3DX12_DESCRIPTOR_RANGE1 compactionRange;
+    compactionRange.Init( D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 3, 0, 1, D3D12_DESCRIPTOR_RANGE_FLAG_NONE, 0 );
 
-    auto oldIntegratedColour = m_Device->CreateTexture( renderDesc, nullptr );
-    oldIntegratedColour->SetName( L"History integrated colour output texture" );
+    CD3DX12_ROOT_PARAMETER1 rootParams[3] = {};
+    rootParams[0].InitAsDescriptorTable( 1, &rayRange );
+    rootParams[1].InitAsDescriptorTable( 1, &compactionRange );
+    rootParams[2].InitAsConstants( sizeof( RayCompactionData ) / sizeof( uint32_t ), 0 );
 
-    auto oldNormals = m_Device->CreateTexture( renderDesc, nullptr );
-    oldNormals->SetName( L"RayGen normal output texture" );
-
-    auto oldPosDepth = m_Device->CreateTexture( renderDesc, nullptr );
-    oldPosDepth->SetName( L"History position/depth output texture" );
-
-    auto oldObjID = m_Device->CreateTexture( renderDesc, nullptr );
-    oldObjID->SetName( L"History object ID output texture" );
-
-    auto oldMomentHist = m_Device->CreateTexture( renderDesc, nullptr );
-    oldMomentHist->SetName( L"History moment output texture" );
+    D3D12_ROOT_SIGNATURE_FLAGS rootSignatureFlags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
 
-    m_HistoryRenderTarget.AttachTexture( m_ColourSlot, oldIntegratedColour );
-    m_HistoryRenderTarget.AttachTexture( m_NormalsSlot, oldNormals );
-    m_HistoryRenderTarget.AttachTexture( m_PosDepth, oldPosDepth );
-    m_HistoryRenderTarget.AttachTexture( m_ObjectMask, oldObjID );
-    m_HistoryRenderTarget.AttachTexture( m_MomentHistory, oldMomentHist );
+    CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDescription;
+    rootSignatureDescription.Init_1_1( 3, rootParams, 0, nullptr, rootSignatureFlags );
 
-    D3D12_RESOURCE_DESC renderDescSDR =
-        CD3DX12_RESOURCE_DESC::Tex2D( DXGI_FORMAT_R8G8B8A8_UNORM, m_Width, m_Height, 1, 1 );
-    renderDescSDR.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS | D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+    m_RayCompactionRootSig = m_Device->CreateRootSignature( rootSignatureDescription.Desc_1_1 );
 
-    auto integratedColourSource = m_Device->CreateTexture( renderDesc, nullptr );
-    integratedColourSource->SetName( L"integrated colour source texture" );
+    struct ComputePipelineState
+    {
+        CD3DX12_PIPELINE_STATE_STREAM_ROOT_SIGNATURE pRootSignature;
+        CD3DX12_PIPELINE_STATE_STREAM_CS             CS;
+    };
 
-    auto momentSource = m_Device->CreateTexture( renderDesc, nullptr );
-    momentSource->SetName( L"moment source texture" );
+    struct ComputePipelineState compactionPipelineStream = {};
+    compactionPipelineStream.pRootSignature              = m_RayCompactionRootSig->GetD3D12RootSignature().Get();
+    compactionPipelineStream.CS                          = CD3DX12_SHADER_BYTECODE( rayCompaction.Get() );
+    m_RayCompactionPipelineState = m_Device->CreatePipelineStateObject( compactionPipelineStream );
 
-    auto integratedColourTarget = m_Device->CreateTexture( renderDesc, nullptr );
-    integratedColourTarget->SetName( L"integrated colour target texture" );
+    // The trace passes launch the rays with the D3D12_DISPATCH_RAYS_DESC the compaction completed.
+    D3D12_INDIRECT_ARGUMENT_DESC dispatchRaysArgument = {};
+    dispatchRaysArgument.Type                         = D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH_RAYS;
 
-    auto momentTarget = m_Device->CreateTexture( renderDesc, nullptr );
-    momentTarget->SetName( L"moment target texture" );
+    D3D12_COMMAND_SIGNATURE_DESC signatureDesc = {};
+    signatureDesc.ByteStride                   = sizeof( D3D12_DISPATCH_RAYS_DESC );
+    signatureDesc.NumArgumentDescs             = 1;
+    signatureDesc.pArgumentDescs               = &dispatchRaysArgument;
 
-    auto filteredOutput = m_Device->CreateTexture( renderDescSDR, nullptr );
-    filteredOutput->SetName( L"Denoiser SDR filtered image" );
+    ThrowIfFailed( m_Device->GetD3D12Device()->CreateCommandSignature( &signatureDesc, nullptr,
+                                                                      IID_PPV_ARGS( &m_DispatchRaysSignature ) ) );
+    m_DispatchRaysSignature->SetName( L"DispatchRays Command Signature" );
+}
 
+void DummyGame::CreateShaderResource( DXGI_FORMAT backBufferFormat )
+{
+    m_SvgfFormat = backBufferFormat;
+    PlaceSvgfBuffers();
 
-    m_FilterRenderTarget.AttachTexture( m_ColourSlot, integratedColourSource );
-    m_FilterRenderTarget.AttachTexture( m_FilterMomentSource, momentSource );
-    m_FilterRenderTarget.AttachTexture( m_FilterOutputSDR, filteredOutput );
-    m_FilterRenderTarget.AttachTexture( m_FilterColourTarget, integratedColourTarget );
-    m_FilterRenderTarget.AttachTexture( m_FilterMomentTarget, momentTarget );
-   
     auto totalNbrRenderTargets = m_nbrRayRenderTargets + m_nbrHistoryRenderTargets + m_nbrFilterRenderTargets;
 
     // Create SRV for TLAS after the UAV above. 
@@ -620,16 +678,216 @@ void DummyGame::CreateShaderResource( DXGI_FORMAT backBufferFormat )
     cbvDesc[2].SizeInBytes    = align_to( 256, sizeof( DenoiserFilterData ) );
     cbvDesc[2].BufferLocation = m_FilterCB->GetD3D12Resource()->GetGPUVirtualAddress();
 
-    m_RayShaderHeap =
-        m_Device->CreateShaderTableView( totalNbrRenderTargets, &srvTlasDesc, cbvDesc, m_RaySceneMesh.get() );
-    UINT offset = 0;
-    m_RayShaderHeap->UpdateShaderTableUAV( offset, m_nbrRayRenderTargets, &m_RayRenderTarget );
-    offset += m_nbrRayRenderTargets;
-    m_RayShaderHeap->UpdateShaderTableUAV( offset, m_nbrHistoryRenderTargets, &m_HistoryRenderTarget );
-    offset += m_nbrHistoryRenderTargets;
-    m_RayShaderHeap->UpdateShaderTableUAV( offset, m_nbrFilterRenderTargets, &m_FilterRenderTarget );
-    offset += m_nbrFilterRenderTargets;
+    // The SVGF binding sets go after everything else, followed by the three ray compaction buffers.
+    uint32_t nbrBindingSetDescriptors = m_SvgfRotation.GetBindingSetCount() * cpulib::SVGF_SLOT_COUNT;
 
+    m_RayShaderHeap = m_Device->CreateShaderTableView( totalNbrRenderTargets, &srvTlasDesc, cbvDesc,
+                                                       m_RaySceneMesh.get(), nbrBindingSetDescriptors + 3 );
+    m_CompactionDescriptors = m_RayShaderHeap->GetExtraUAVOffset() + nbrBindingSetDescriptors;
+
+    UpdateSvgfBindingSets();
+    CreateRayCompactionResources();
+}
+
+void DummyGame::PlaceSvgfBuffers()
+{
+    auto d3d12Device = m_Device->GetD3D12Device();
+
+    D3D12_RESOURCE_DESC renderDesc = CD3DX12_RESOURCE_DESC::Tex2D( m_SvgfFormat, m_Width, m_Height, 1, 1, 1, 0 );
+    renderDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS | D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+
+    D3D12_RESOURCE_DESC renderDescSDR =
+        CD3DX12_RESOURCE_DESC::Tex2D( DXGI_FORMAT_R8G8B8A8_UNORM, m_Width, m_Height, 1, 1 );
+    renderDescSDR.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS | D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+
+    // Every buffer is planned at the size of a float texture, the SDR target is the only smaller one.
+    const D3D12_RESOURCE_ALLOCATION_INFO allocation = d3d12Device->GetResourceAllocationInfo( 0, 1, &renderDesc );
+
+    cpulib::AliasingPlanner planner;
+    cpulib::AddRotationLifetimes( planner, m_SvgfRotation, allocation.SizeInBytes, allocation.Alignment );
+    planner.Plan();
+    assert( planner.Validate() );
+
+    // Only render target textures, a resource heap tier 1 device takes nothing else with them.
+    D3D12_HEAP_DESC heapDesc = {};
+    heapDesc.SizeInBytes     = planner.GetHeapSize();
+    heapDesc.Properties      = CD3DX12_HEAP_PROPERTIES( D3D12_HEAP_TYPE_DEFAULT );
+    heapDesc.Alignment       = allocation.Alignment;
+    heapDesc.Flags           = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+
+    // The old heap is released last, after the buffers placed in it.
+    Microsoft::WRL::ComPtr<ID3D12Heap> heap;
+    ThrowIfFailed( d3d12Device->CreateHeap( &heapDesc, IID_PPV_ARGS( &heap ) ) );
+    heap->SetName( L"SVGF buffer heap" );
+
+    uint32_t buffer = 0;
+    auto     place  = [&]( const D3D12_RESOURCE_DESC& desc, const wchar_t* name ) {
+        auto texture = m_Device->CreatePlacedTexture( heap.Get(), planner.GetOffset( buffer++ ), desc );
+        texture->SetName( name );
+        return texture;
+    };
+
+    // In the order of the cpulib::SvgfResource pools, the first buffer of a pool holds the history of the first frame.
+    auto rayImage               = place( renderDesc, L"RayGen diffuse output texture" );
+    auto rayNormals             = place( renderDesc, L"RayGen normal output texture" );
+    auto oldNormals             = place( renderDesc, L"History normal output texture" );
+    auto rayPosDepth            = place( renderDesc, L"RayGen position/depth output texture" );
+    auto oldPosDepth            = place( renderDesc, L"History position/depth output texture" );
+    auto rayObjID               = place( renderDesc, L"RayGen object ID/mask output texture" );
+    auto oldObjID               = place( renderDesc, L"History object ID output texture" );
+    auto integratedColourSource = place( renderDesc, L"integrated colour source texture" );
+    auto integratedColourTarget = place( renderDesc, L"integrated colour target texture" );
+    auto oldIntegratedColour    = place( renderDesc, L"History integrated colour output texture" );
+    auto momentSource           = place( renderDesc, L"moment source texture" );
+    auto momentTarget           = place( renderDesc, L"moment target texture" );
+    auto oldMomentHist          = place( renderDesc, L"History moment output texture" );
+    auto filteredOutput         = place( renderDescSDR, L"Denoiser SDR filtered image" );
+
+    m_RayRenderTarget.AttachTexture( m_ColourSlot, rayImage );
+    m_RayRenderTarget.AttachTexture( m_NormalsSlot, rayNormals );
+    m_RayRenderTarget.AttachTexture( m_PosDepth, rayPosDepth );
+    m_RayRenderTarget.AttachTexture( m_ObjectMask, rayObjID );
+
+    m_HistoryRenderTarget.AttachTexture( m_ColourSlot, oldIntegratedColour );
+    m_HistoryRenderTarget.AttachTexture( m_NormalsSlot, oldNormals );
+    m_HistoryRenderTarget.AttachTexture( m_PosDepth, oldPosDepth );
+    m_HistoryRenderTarget.AttachTexture( m_ObjectMask, oldObjID );
+    m_HistoryRenderTarget.AttachTexture( m_MomentHistory, oldMomentHist );
+
+    m_FilterRenderTarget.AttachTexture( m_ColourSlot, integratedColourSource );
+    m_FilterRenderTarget.AttachTexture( m_FilterMomentSource, momentSource );
+    m_FilterRenderTarget.AttachTexture( m_FilterOutputSDR, filteredOutput );
+    m_FilterRenderTarget.AttachTexture( m_FilterColourTarget, integratedColourTarget );
+    m_FilterRenderTarget.AttachTexture( m_FilterMomentTarget, momentTarget );
+
+    m_SvgfBuffers = {
+        rayImage,
+        rayNormals, oldNormals,
+        rayPosDepth, oldPosDepth,
+        rayObjID, oldObjID,
+        integratedColourSource, integratedColourTarget, oldIntegratedColour,
+        momentSource, momentTarget, oldMomentHist,
+        filteredOutput,
+    };
+    assert( m_SvgfBuffers.size() == m_SvgfRotation.GetBufferCount() && buffer == m_SvgfBuffers.size() );
+
+    m_SvgfHeap = heap;
+
+    // The graph places an aliasing barrier and a discard before a buffer takes over memory, new ones included.
+    m_RenderGraph.ClearAliases();
+    for ( uint32_t a = 0; a < m_SvgfBuffers.size(); ++a )
+    {
+        for ( uint32_t b = a + 1; b < m_SvgfBuffers.size(); ++b )
+        {
+            if ( planner.SharesMemory( a, b ) )
+                m_RenderGraph.AddAlias( a, b );
+        }
+        m_RenderGraph.SetResident( a, false );
+    }
+
+    m_Logger->info( "SVGF buffers at {}x{}: {:.1f} MB heap, {:.1f} MB as committed resources", m_Width, m_Height,
+                    planner.GetHeapSize() / ( 1024.0 * 1024.0 ), planner.GetCommittedSize() / ( 1024.0 * 1024.0 ) );
+}
+
+void DummyGame::UpdateSvgfBindingSets()
+{
+    std::shared_ptr<dx12lib::Texture> textures[cpulib::SVGF_SLOT_COUNT];
+
+    for ( uint32_t set = 0; set < m_SvgfRotation.GetBindingSetCount(); ++set )
+    {
+        const std::vector<uint32_t>& buffers = m_SvgfRotation.GetBindingSet( set );
+        for ( uint32_t slot = 0; slot < cpulib::SVGF_SLOT_COUNT; ++slot )
+            textures[slot] = m_SvgfBuffers[buffers[slot]];
+
+        m_RayShaderHeap->UpdateShaderTableUAV( m_RayShaderHeap->GetExtraUAVOffset() + set * cpulib::SVGF_SLOT_COUNT,
+                                               cpulib::SVGF_SLOT_COUNT, textures );
+    }
+
+    // Start over from the first frame, a resize drops the contents of the history.
+    m_SvgfFrame = 0;
+
+    // Placed again, the textures are new resources.
+    for ( uint32_t buffer = 0; buffer < m_SvgfBuffers.size(); ++buffer )
+        m_RenderGraph.SetState( buffer, cpulib::GraphResourceState::Common );
+    UpdateSvgfFrameBindings();
+}
+
+std::shared_ptr<dx12lib::Texture> DummyGame::GetSvgfTexture( uint32_t stage, uint32_t slot ) const
+{
+    return m_SvgfBuffers[m_SvgfRotation.GetBuffer( m_SvgfFrame, stage, slot )];
+}
+
+void DummyGame::UpdateSvgfFrameBindings()
+{
+    // The descriptors at the start of the heap are rewritten while no command list uses them, OnRender waits for
+    // the GPU at the end of every frame. The ray tracing shader table points at them, it does not change.
+    const std::vector<uint32_t>& buffers =
+        m_SvgfRotation.GetBindingSet( m_SvgfRotation.GetBindingSet( m_SvgfFrame, m_SvgfStages.trace ) );
+
+    std::shared_ptr<dx12lib::Texture> textures[cpulib::SVGF_SLOT_COUNT];
+    for ( uint32_t slot = 0; slot < cpulib::SVGF_SLOT_COUNT; ++slot )
+        textures[slot] = m_SvgfBuffers[buffers[slot]];
+
+    m_RayShaderHeap->UpdateShaderTableUAV( 0, cpulib::SVGF_SLOT_COUNT, textures );
+}
+
+void DummyGame::DeclareSvgfAccesses( uint32_t pass, uint32_t stage, bool accumulate )
+{
+    cpulib::DeclareSvgfAccesses( m_RenderGraph, pass, m_SvgfRotation, m_SvgfFrame, stage, accumulate );
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE DummyGame::GetSvgfBindingSet( uint32_t stage ) const
+{
+    uint32_t set = m_SvgfRotation.GetBindingSet( m_SvgfFrame, stage );
+
+    return m_RayShaderHeap->GetGpuDescriptorHandle( m_RayShaderHeap->GetExtraUAVOffset() +
+                                                    set * cpulib::SVGF_SLOT_COUNT );
+}
+
+void DummyGame::CreateRayCompactionResources()
+{
+    // At most one ray per pixel.
+    m_CompactedPixels = m_Device->CreateStructuredBuffer( static_cast<size_t>( m_Width ) * m_Height,
+                                                          sizeof( uint32_t ) );
+    m_CompactedPixels->SetName( L"Ray compaction pixel list" );
+
+    if ( !m_CompactionCounters )
+    {
+        m_CompactionCounters = m_Device->CreateByteAddressBuffer( 2 * sizeof( uint32_t ) );
+        m_CompactionCounters->SetName( L"Ray compaction counters" );
+
+        m_DispatchRaysArgs = m_Device->CreateByteAddressBuffer( sizeof( D3D12_DISPATCH_RAYS_DESC ) );
+        m_DispatchRaysArgs->SetName( L"Ray compaction DispatchRays arguments" );
+
+        m_CompactionUpload =
+            m_Device->CreateMappableBuffer( sizeof( D3D12_DISPATCH_RAYS_DESC ) + 2 * sizeof( uint32_t ) );
+        m_CompactionUpload->SetName( L"Ray compaction upload" );
+
+        m_RayCountReadback =
+            m_Device->CreateMappableBuffer( m_MaxRayCountPasses * sizeof( uint32_t ), D3D12_HEAP_TYPE_READBACK );
+        m_RayCountReadback->SetName( L"Ray count readback" );
+    }
+
+    D3D12_UNORDERED_ACCESS_VIEW_DESC pixelsDesc = {};
+    pixelsDesc.ViewDimension                    = D3D12_UAV_DIMENSION_BUFFER;
+    pixelsDesc.Format                           = DXGI_FORMAT_UNKNOWN;
+    pixelsDesc.Buffer.NumElements               = static_cast<UINT>( m_CompactedPixels->GetNumElements() );
+    pixelsDesc.Buffer.StructureByteStride       = sizeof( uint32_t );
+
+    D3D12_UNORDERED_ACCESS_VIEW_DESC rawDesc = {};
+    rawDesc.ViewDimension                    = D3D12_UAV_DIMENSION_BUFFER;
+    rawDesc.Format                           = DXGI_FORMAT_R32_TYPELESS;
+    rawDesc.Buffer.Flags                     = D3D12_BUFFER_UAV_FLAG_RAW;
+
+    D3D12_UNORDERED_ACCESS_VIEW_DESC countersDesc = rawDesc;
+    countersDesc.Buffer.NumElements               = 2;
+
+    D3D12_UNORDERED_ACCESS_VIEW_DESC argsDesc = rawDesc;
+    argsDesc.Buffer.NumElements               = sizeof( D3D12_DISPATCH_RAYS_DESC ) / sizeof( uint32_t );
+
+    m_RayShaderHeap->UpdateShaderTableUAV( m_CompactionDescriptors + 0, m_CompactedPixels, pixelsDesc );
+    m_RayShaderHeap->UpdateShaderTableUAV( m_CompactionDescriptors + 1, m_CompactionCounters, countersDesc );
+    m_RayShaderHeap->UpdateShaderTableUAV( m_CompactionDescriptors + 2, m_DispatchRaysArgs, argsDesc );
 }
 
 void DummyGame::CreateAccelerationStructure() 
@@ -638,47 +896,81 @@ void DummyGame::CreateAccelerationStructure()
     auto& commandQueueDirect = m_Device->GetCommandQueue( D3D12_COMMAND_LIST_TYPE_DIRECT );
     auto  commandList        = commandQueueDirect.GetCommandList();
 
-    AccelerationStructure blasBuffers = {};
-    m_RaySceneMesh->BuildBottomLevelAccelerationStructure( m_Device.get(), commandList.get(), &blasBuffers );
+    // The meshes without copies in one BLAS, and one per mesh with copies.
+    const cpulib::MeshInstancePlan& meshInstances = m_RaySceneMesh->GetMeshInstances();
+
+    std::vector<AccelerationStructure> blasBuffers;
+    m_RaySceneMesh->BuildBottomLevelAccelerationStructures( m_Device.get(), commandList.get(), blasBuffers );
 
     // Init based on acceleration structure
     {
-        m_Instances = 1;
-
-        m_InstanceTransforms.resize( m_Instances );
+        m_Instances = meshInstances.instances.size();
 
-        m_GeometryCountPerInstance.resize( m_Instances );
-        m_DiffuseTexCountPerInstance.resize( m_Instances );
-        m_NormalTexCountPerInstance.resize( m_Instances );
-        m_SpecularTexCountPerInstance.resize( m_Instances );
-        m_MaskTexCountPerInstance.resize( m_Instances );
+        m_TotalGeometryCount    = m_RaySceneMesh->GetGeometryCount();
+        m_TotalDiffuseTexCount  = m_RaySceneMesh->GetDiffuseTextureCount();
+        m_TotalNormalTexCount   = m_RaySceneMesh->GetNormalTextureCount();
+        m_TotalSpecularTexCount = m_RaySceneMesh->GetSpecularTextureCount();
+        m_TotalMaskTexCount     = m_RaySceneMesh->GetMaskTextureCount();
 
-        m_GeometryCountPerInstance[0] = m_RaySceneMesh->GetGeometryCount();
-        m_DiffuseTexCountPerInstance[0] = m_RaySceneMesh->GetDiffuseTextureCount();
-        m_NormalTexCountPerInstance[0]  = m_RaySceneMesh->GetNormalTextureCount();
-        m_SpecularTexCountPerInstance[0] = m_RaySceneMesh->GetSpecularTextureCount();
-        m_MaskTexCountPerInstance[0]     = m_RaySceneMesh->GetMaskTextureCount();
+        // The scene transform, the shaders' instTrans. Every TLAS instance is placed by it.
+        float scale = m_RaySceneMesh->GetSceneScale();
 
-        m_TotalGeometryCount = 0;
-        m_TotalDiffuseTexCount = 0;
-        m_TotalNormalTexCount  = 0;
-        m_TotalSpecularTexCount = 0;
-        m_TotalMaskTexCount     = 0;
+        m_Transforms.Clear();
+        m_Transforms.Reserve( static_cast<uint32_t>( m_Instances ) + 1 );
+        m_Transforms.AddNode( cpulib::TRANSFORM_NO_PARENT, ToTransform( XMMatrixScaling( scale, scale, scale ) ) );
+        for ( const cpulib::MeshInstance& instance: meshInstances.instances )
+        {
+            const cpulib::float3& offset = instance.offset;
+            m_Transforms.AddNode( 0, ToTransform( XMMatrixTranslation( offset.x, offset.y, offset.z ) ) );
+        }
+        m_Transforms.Update();
 
-        for ( int i = 0; i < m_Instances; ++i )
+        // Where every instance is, for the tracker to tell how far they moved since the TLAS was built.
+        std::vector<cpulib::TlasBounds> blasBounds( meshInstances.blases.size() );
+        for ( size_t i = 0; i < blasBounds.size(); ++i )
         {
-            m_TotalGeometryCount += m_GeometryCountPerInstance[i];
-            m_TotalDiffuseTexCount += m_DiffuseTexCountPerInstance[i];
-            m_TotalNormalTexCount += m_NormalTexCountPerInstance[i];
-            m_TotalSpecularTexCount += m_SpecularTexCountPerInstance[i];
-            m_TotalMaskTexCount += m_MaskTexCountPerInstance[i];
+            const BoundingBox    aabb = m_RaySceneMesh->GetBottomLevelAABB( i );
+            const cpulib::float3 center( aabb.Center.x, aabb.Center.y, aabb.Center.z );
+            const cpulib::float3 extents( aabb.Extents.x, aabb.Extents.y, aabb.Extents.z );
 
-            float scale             = m_RaySceneMesh->GetSceneScale();
+            blasBounds[i].lower = center - extents;
+            blasBounds[i].upper = center + extents;
+        }
+
+        std::vector<cpulib::TlasBounds> worldBounds( m_Instances );
+        m_InstanceBounds.resize( m_Instances );
+        for ( size_t i = 0; i < m_Instances; ++i )
+        {
+            const uint32_t node = static_cast<uint32_t>( i ) + 1;
 
-            m_InstanceTransforms[i] = InstanceTransforms( XMFLOAT3( scale, scale, scale ) );
-            m_InstanceTransforms[i].lodScaler = static_cast<float>(1 << lodScaleExp);
+            m_InstanceBounds[i] = blasBounds[meshInstances.instances[i].blas];
+            worldBounds[i]      = cpulib::TransformBounds( m_Transforms.GetWorld( node ), m_InstanceBounds[i] );
         }
+        m_TlasTracker.Reset( worldBounds );
 
+        m_InstanceTransforms.resize( 1 );
+        m_InstanceTransforms[0].SetFromTransforms( m_Transforms, 0 );
+        m_InstanceTransforms[0].lodScaler = static_cast<float>( 1 << lodScaleExp );
+    }
+
+    // What sharing the copies saved: the BLAS against all meshes in one, from the prebuild sizes.
+    {
+        const cpulib::MeshDedupStats& stats = meshInstances.stats;
+
+        uint64_t blasBytes = 0;
+        for ( const AccelerationStructure& blas: blasBuffers )
+        {
+            blasBytes += blas.pResult->GetD3D12ResourceDesc().Width;
+        }
+        const uint64_t singleBlasBytes = m_RaySceneMesh->GetBottomLevelASSize( m_Device.get() );
+
+        const double mb = 1024.0 * 1024.0;
+        m_Logger->info( "Meshes: {} with {} unique, {} instances of {} BLASes", stats.meshes, stats.uniqueMeshes,
+                        m_Instances, blasBuffers.size() );
+        m_Logger->info( "Vertices {:.1f} MB of {:.1f} MB shared, indices {:.1f} MB of {:.1f} MB shared",
+                        stats.sharedVertexBytes / mb, stats.vertexBytes / mb, stats.sharedIndexBytes / mb,
+                        stats.indexBytes / mb );
+        m_Logger->info( "BLAS {:.1f} MB instead of {:.1f} MB in one", blasBytes / mb, singleBlasBytes / mb );
     }
 
     // Create instances
@@ -690,29 +982,61 @@ void DummyGame::CreateAccelerationStructure()
         // Map INSTANCES, their TRANSFORMS, and respective BLAS.
         ThrowIfFailed( m_InstanceDescBuffer->Map( (void**)&pInstDesc ) ); 
         {
-            // instance 0 - sphere AND plane
-            pInstDesc[0].InstanceID                              = 0;
-            pInstDesc[0].InstanceContributionToHitGroupIndex     = 0;
-            pInstDesc[0].Flags                                   = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-
-            memcpy( &pInstDesc[0].Transform, &m_InstanceTransforms[0].matrix, sizeof( XMFLOAT3X4 ) );
-
-            // select the BLAS we build on.
-            pInstDesc[0].AccelerationStructure = blasBuffers.pResult->GetD3D12Resource()->GetGPUVirtualAddress();
-            pInstDesc[0].InstanceMask          = 0xFF;
+            for ( size_t i = 0; i < m_Instances; ++i )
+            {
+                const cpulib::MeshInstance& instance = meshInstances.instances[i];
+
+                // The meshes of the instance are the slots from firstMesh on, so are their hit groups: the hit
+                // shader finds its mesh at InstanceID() + GeometryIndex().
+                pInstDesc[i].InstanceID                          = instance.firstMesh;
+                pInstDesc[i].InstanceContributionToHitGroupIndex = instance.firstMesh;
+                pInstDesc[i].Flags                               = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
+
+                // select the BLAS we build on.
+                pInstDesc[i].AccelerationStructure =
+                    blasBuffers[instance.blas].pResult->GetD3D12Resource()->GetGPUVirtualAddress();
+                pInstDesc[i].InstanceMask = 0xFF;
+            }
         }
         m_InstanceDescBuffer->Unmap();
 
+        // Every instance is dirty after the reset.
+        WriteInstanceTransforms();
     }
 
     AccelerationBuffer::CreateTopLevelAS( m_Device.get(), commandList.get(), 
         &mTlasSize, &m_TlasBuffers, m_Instances, m_InstanceDescBuffer.get() 
     );
+    m_TlasTracker.Commit( cpulib::TlasUpdate::Rebuild );
 
     commandQueueDirect.ExecuteCommandList( commandList );
     commandQueueDirect.Flush();
 
-    m_BLAS = blasBuffers.pResult;
+    m_BLAS.clear();
+    for ( const AccelerationStructure& blas: blasBuffers )
+    {
+        m_BLAS.push_back( blas.pResult );
+    }
+}
+
+void DummyGame::WriteInstanceTransforms()
+{
+    const std::vector<cpulib::TlasInstanceRange> ranges = m_TlasTracker.GetDirtyRanges();
+    if ( ranges.empty() )
+        return;
+
+    const size_t descSize = sizeof( D3D12_RAYTRACING_INSTANCE_DESC );
+
+    D3D12_RAYTRACING_INSTANCE_DESC* pInstDesc;
+    ThrowIfFailed( m_InstanceDescBuffer->Map( (void**)&pInstDesc ) );
+    {
+        for ( const cpulib::TlasInstanceRange& range: ranges )
+        {
+            m_Transforms.WriteWorlds( range.first + 1, range.count, pInstDesc[range.first].Transform, descSize );
+        }
+    }
+    m_InstanceDescBuffer->Unmap( ranges.front().first * descSize,
+                                 ( ranges.back().first + ranges.back().count ) * descSize );
 }
 
 
@@ -731,12 +1055,7 @@ void DummyGame::UpdateConstantBuffer()
     }
     m_FrameDataCB->Unmap();
 
-    D3D12_RAYTRACING_INSTANCE_DESC* pInstDesc;
-    ThrowIfFailed( m_InstanceDescBuffer->Map( (void**)&pInstDesc ) );
-    {
-        memcpy( pInstDesc[0].Transform, &m_InstanceTransforms[0].matrix, sizeof( XMFLOAT3X4 ) );
-    }
-    m_InstanceDescBuffer->Unmap();
+    WriteInstanceTransforms();
 
     ThrowIfFailed( m_FilterCB->Map( &pData ) );
     {
@@ -814,6 +1133,10 @@ void DummyGame::CreateShaderTable()
 
         // Entry 0.1 Parameter Heap pointer
         memcpy( pData + shaderIdSize, &descriptorHeapStart, sizeof( UINT64 ) );
+
+        // Entry 0.2 Compacted pixel list
+        UINT64 compactionTableStart = m_RayShaderHeap->GetGpuDescriptorHandle( m_CompactionDescriptors ).ptr;
+        memcpy( pData + shaderIdSize + sizeof( UINT64 ), &compactionTableStart, sizeof( UINT64 ) );
     }
     m_RaygenShaderTable->Unmap();  // Unmap
 
@@ -872,6 +1195,16 @@ void DummyGame::UpdateDispatchRaysDesc()
     m_RaytraceDesc.HitGroupTable.StrideInBytes = m_ShaderTableEntrySize;
     m_RaytraceDesc.HitGroupTable.SizeInBytes =
         m_TotalGeometryCount * m_ShadersEntriesPerGeometry * m_ShaderTableEntrySize;
+
+    // The arguments of the indirect launch, the compaction replaces the size with that of its pixel list.
+    uint8_t* pData;
+    ThrowIfFailed( m_CompactionUpload->Map( (void**)&pData ) );
+    {
+        const uint32_t zeroCounters[2] = {};
+        memcpy( pData, &m_RaytraceDesc, sizeof( D3D12_DISPATCH_RAYS_DESC ) );
+        memcpy( pData + sizeof( D3D12_DISPATCH_RAYS_DESC ), zeroCounters, sizeof( zeroCounters ) );
+    }
+    m_CompactionUpload->Unmap();
 }
 
 #endif
@@ -935,20 +1268,25 @@ bool DummyGame::LoadContent()
     // Convert the 2D panorama to a 3D cubemap.
     commandList->PanoToCubemap( cubeMapDiffuseBackground, panoramaSkyboxDiffuse );
 
+    auto loadScene = [&]( const std::wstring& fileName ) {
+        return commandList->LoadSceneFromFile( fileName, 1.0f, std::function<bool( float )>(), VertexFormat::Full,
+                                               false, INSTANCE_MESHES != 0 );
+    };
+
     // DISPLAY MESHES IN RAY TRACING
 #if AMAZON_INTERIOR
-    m_RaySceneMesh = commandList->LoadSceneFromFile( L"Assets/Models/AmazonLumberyard/interior.obj" );
+    m_RaySceneMesh = loadScene( L"Assets/Models/AmazonLumberyard/interior.obj" );
     scene_scale    = 1;
     lodScaleExp    = 16;
     m_RaySceneMesh->SetSkybox( cubeMapIntensityBackground, cubeMapDiffuseBackground );
 #elif AMAZON_EXTERIOR
-    m_RaySceneMesh = commandList->LoadSceneFromFile( L"Assets/Models/AmazonLumberyard/exterior.obj" );
+    m_RaySceneMesh = loadScene( L"Assets/Models/AmazonLumberyard/exterior.obj" );
     scene_scale    = 1;
     lodScaleExp    = 16;
     m_RaySceneMesh->SetSkybox( cubeMapIntensityBackground, cubeMapDiffuseBackground );
 #elif SAM_MIGUEL
-    // m_RaySceneMesh = commandList->LoadSceneFromFile( L"Assets/Models/San_Miguel/san-miguel.obj" ); scene_scale = 1;
-    m_RaySceneMesh = commandList->LoadSceneFromFile( L"Assets/Models/San_Miguel/san-miguel-low-poly.obj" );
+    // m_RaySceneMesh = loadScene( L"Assets/Models/San_Miguel/san-miguel.obj" ); scene_scale = 1;
+    m_RaySceneMesh = loadScene( L"Assets/Models/San_Miguel/san-miguel-low-poly.obj" );
     scene_scale    = 1;
     lodScaleExp    = 16;
     m_RaySceneMesh->SetSkybox( cubeMapIntensityBackground, cubeMapDiffuseBackground );
@@ -986,7 +1324,7 @@ bool DummyGame::LoadContent()
     }
 
 #elif CORNELL_BOX
-    m_RaySceneMesh = commandList->LoadSceneFromFile( L"Assets/Models/CornellBox/CornellBox-Original.obj" );
+    m_RaySceneMesh = loadScene( L"Assets/Models/CornellBox/CornellBox-Original.obj" );
     scene_scale    = 10;
 
     m_Globals.nbrActiveLights   = 1;
@@ -1011,7 +1349,7 @@ bool DummyGame::LoadContent()
     m_FilterData.sigmaLuminance = 10;
 
 #elif CORNELL_BOX_LONG
-    m_RaySceneMesh = commandList->LoadSceneFromFile( L"Assets/Models/CornellBox/CornellBox-OriginalAllSides.obj" );
+    m_RaySceneMesh = loadScene( L"Assets/Models/CornellBox/CornellBox-OriginalAllSides.obj" );
     scene_scale    = 10;
 
     m_Globals.nbrActiveLights   = 1;
@@ -1036,7 +1374,7 @@ bool DummyGame::LoadContent()
     m_FilterData.sigmaLuminance = 10;
 
 #elif CORNELL_MIRROR
-    m_RaySceneMesh = commandList->LoadSceneFromFile( L"Assets/Models/CornellBox/CornellBox-Mirror.obj" );
+    m_RaySceneMesh = loadScene( L"Assets/Models/CornellBox/CornellBox-Mirror.obj" );
     scene_scale    = 10;
 
     m_Globals.nbrActiveLights   = 1;
@@ -1061,7 +1399,7 @@ bool DummyGame::LoadContent()
     m_FilterData.sigmaLuminance = 10;
 
 #elif CORNELL_SPHERES
-    m_RaySceneMesh = commandList->LoadSceneFromFile( L"Assets/Models/CornellBox/CornellBox-Sphere.obj" );
+    m_RaySceneMesh = loadScene( L"Assets/Models/CornellBox/CornellBox-Sphere.obj" );
     scene_scale    = 10;
 
     m_Globals.nbrActiveLights   = 1;
@@ -1087,7 +1425,7 @@ bool DummyGame::LoadContent()
 
 
 #elif CORNELL_WATER
-    m_RaySceneMesh = commandList->LoadSceneFromFile( L"Assets/Models/CornellBox/CornellBox-Water.obj" );
+    m_RaySceneMesh = loadScene( L"Assets/Models/CornellBox/CornellBox-Water.obj" );
     scene_scale    = 10;
 
     m_Globals.nbrActiveLights   = 1;
@@ -1100,7 +1438,7 @@ bool DummyGame::LoadContent()
     m_CamRotations = { DirectX::XMFLOAT2( 32, -3 ), DirectX::XMFLOAT2( -27, 1.4 ) };
 
 #elif SUN_TEMPLE
-    m_RaySceneMesh = commandList->LoadSceneFromFile( L"Assets/Models/SunTemple/sunTemple.obj" );
+    m_RaySceneMesh = loadScene( L"Assets/Models/SunTemple/sunTemple.obj" );
     m_RaySceneMesh->SetSkybox( cubeMapIntensityBackground, cubeMapDiffuseBackground );
 
     #if 1 
@@ -1136,7 +1474,7 @@ bool DummyGame::LoadContent()
     m_FilterData.sigmaDepth     = 27;
 
 #elif SPONZA
-    m_RaySceneMesh = commandList->LoadSceneFromFile( L"Assets/Models/crytek-sponza/sponza_nobanner.obj" );
+    m_RaySceneMesh = loadScene( L"Assets/Models/crytek-sponza/sponza_nobanner.obj" );
     // merge scenes
     lodScaleExp            = 9;
     //m_frameData.atmosphere = DirectX::XMFLOAT4( .529, .808, .922, 1 );
@@ -1362,6 +1700,8 @@ bool DummyGame::LoadContent()
 
     CreateRaySchedularPipeline();
 
+    CreateRayCompactionPipeline();
+
 #endif
 
     m_IsLoading = false;
@@ -1379,21 +1719,15 @@ void DummyGame::OnResize( ResizeEventArgs& e )
 
     m_Viewport = CD3DX12_VIEWPORT( 0.0f, 0.0f, static_cast<float>( m_Width ), static_cast<float>( m_Height ) );
 
-    m_RayRenderTarget.Resize( m_Width, m_Height );
-    m_HistoryRenderTarget.Resize( m_Width, m_Height );
-    m_FilterRenderTarget.Resize( m_Width, m_Height );
+    // Resize would make the SVGF buffers committed resources, they are placed again instead.
+    PlaceSvgfBuffers();
 
     m_CamWindow = DirectX::XMFLOAT2( aspectRatio, 1 );
 
     m_SwapChain->Resize( m_Width, m_Height );
 
-    UINT offset = 0;
-    m_RayShaderHeap->UpdateShaderTableUAV( offset, m_nbrRayRenderTargets, &m_RayRenderTarget );
-    offset += m_nbrRayRenderTargets;
-    m_RayShaderHeap->UpdateShaderTableUAV( offset, m_nbrHistoryRenderTargets, &m_HistoryRenderTarget );
-    offset += m_nbrHistoryRenderTargets;
-    m_RayShaderHeap->UpdateShaderTableUAV( offset, m_nbrFilterRenderTargets, &m_FilterRenderTarget );
-    offset += m_nbrFilterRenderTargets;
+    UpdateSvgfBindingSets();
+    CreateRayCompactionResources();
 
     UpdateDispatchRaysDesc();
     m_FilterData.BuildOldAndNewDenoiser( nullptr, nullptr, m_CamWindow, m_Width, m_Height );
@@ -1412,7 +1746,7 @@ void DummyGame::UnloadContent()
     // ray tracing 
 #if RAY_TRACER
 
-    m_BLAS.reset();
+    m_BLAS.clear();
     m_TlasBuffers.pScratch.reset();
     m_TlasBuffers.pResult.reset();
     m_TlasBuffers.pInstanceDesc.reset();
@@ -1433,6 +1767,15 @@ void DummyGame::UnloadContent()
     m_MissShaderTable.reset();
     m_HitShaderTable.reset();
 
+    m_RayCompactionRootSig.reset();
+    m_RayCompactionPipelineState.reset();
+    m_DispatchRaysSignature.Reset();
+    m_CompactedPixels.reset();
+    m_CompactionCounters.reset();
+    m_DispatchRaysArgs.reset();
+    m_CompactionUpload.reset();
+    m_RayCountReadback.reset();
+
     m_RayShaderHeap.reset();
     m_RayRenderTarget.Reset();
     m_FilterRenderTarget.Reset();
@@ -1442,6 +1785,9 @@ void DummyGame::UnloadContent()
 
     m_GUI.reset();
     m_SwapChain.reset();
+
+    // The scene is gone, so are the last users of the cached textures.
+    CommandList::ClearTextureCache();
     m_Device.reset();
 }
 
@@ -1590,8 +1936,19 @@ void DummyGame::OnUpdate( UpdateEventArgs& e )
 
     if (m_Record) {
         timeStampDeltaTime.push_back( std::make_pair( total_time, e.DeltaTime ) );
+
+        const XMFLOAT3 camDir = CalculateDirectionVector( m_Yaw, m_Pitch );
+
+        cpulib::CameraPose pose;
+        pose.time     = total_time;
+        pose.position = cpulib::float3( m_CamPos.x, m_CamPos.y, m_CamPos.z );
+        pose.lookAt   = cpulib::float3( m_CamPos.x + camDir.x, m_CamPos.y + camDir.y, m_CamPos.z + camDir.z );
+        m_CameraPath.push_back( pose );
     }
 
+    if ( m_UseRayBudget )
+        UpdateRayBudget( e.DeltaTime );
+
     // Defacto update
     {
         bool isAccumelatingFrames = true;
@@ -1604,8 +1961,22 @@ void DummyGame::OnUpdate( UpdateEventArgs& e )
         auto R  = DirectX::XMMatrixRotationY( accumalatedRotation + Math::Radians( scene_rot_offset ) );
         auto RS = DirectX::XMMatrixMultiply( R, S );
 
-        DirectX::XMStoreFloat3x4( &m_InstanceTransforms[0].matrix, RS );
-        m_InstanceTransforms[0].CalculateNormalInverse();
+        // The instances below it follow in the same sweep, nothing is dirty while the scene stands still.
+        const cpulib::float3x4 sceneTransform = ToTransform( RS );
+        if ( memcmp( &sceneTransform, &m_Transforms.GetLocal( 0 ), sizeof( cpulib::float3x4 ) ) != 0 )
+            m_Transforms.SetLocal( 0, sceneTransform );
+
+        if ( m_Transforms.Update() > 0 )
+        {
+            for ( uint32_t i = 0; i < m_Instances; ++i )
+            {
+                if ( m_Transforms.IsUpdated( i + 1 ) )
+                    m_TlasTracker.SetBounds( i, cpulib::TransformBounds( m_Transforms.GetWorld( i + 1 ),
+                                                                         m_InstanceBounds[i] ) );
+            }
+        }
+
+        m_InstanceTransforms[0].SetFromTransforms( m_Transforms, 0 );
         m_InstanceTransforms[0].lodScaler = static_cast<float>( 1 << lodScaleExp );
 
         isAccumelatingFrames &= m_InstanceTransforms[0].Equal( &oldTransforms );
@@ -1681,6 +2052,14 @@ void DummyGame::OnGUI( const std::shared_ptr<dx12lib::CommandList>& commandList,
 
             ImGui::SliderFloat( "Ambient Light", &m_frameData.ambientLight, 0, 0.1 );
 
+            const cpulib::ContentCacheStats textureStats = CommandList::GetTextureCacheStats();
+            ImGui::Text( "Textures: %u cached (%.1f MB), %llu hits saved %.1f MB, %llu misses, %llu evicted",
+                         textureStats.entries, textureStats.residentBytes / ( 1024.0 * 1024.0 ),
+                         static_cast<unsigned long long>( textureStats.hits ),
+                         textureStats.bytesSaved / ( 1024.0 * 1024.0 ),
+                         static_cast<unsigned long long>( textureStats.misses ),
+                         static_cast<unsigned long long>( textureStats.evictions ) );
+
             ImGui::End();
         }
 
@@ -1722,6 +2101,10 @@ void DummyGame::OnGUI( const std::shared_ptr<dx12lib::CommandList>& commandList,
             ImGui::SliderFloat( "Sigma N ", &m_FilterData.sigmaNormal, 1, 200 );
             ImGui::SliderFloat( "Sigma L", &m_FilterData.sigmaLuminance, 0.005, 50 );
 
+            const cpulib::RenderGraphStats& graphStats = m_RenderGraph.GetStats();
+            ImGui::Text( "Barriers: %u UAV, %u transitions for %u accesses", graphStats.uavBarriers,
+                         graphStats.transitions, graphStats.accesses );
+
             ImGui::End();
         }
 
@@ -1735,6 +2118,61 @@ void DummyGame::OnGUI( const std::shared_ptr<dx12lib::CommandList>& commandList,
 
             ImGui::SliderFloat( "Normal Dot Diff", &m_FilterData.m_AS_NormalDotLimit, 0.00, 1 );
 
+            ImGui::SliderInt( "Grid Size", &m_FilterData.gridSize, 0, 4 );
+
+            bool quadtree = m_FilterData.m_AS_Quadtree != 0;
+            ImGui::Checkbox( "Quadtree Scheduler", &quadtree );
+            m_FilterData.m_AS_Quadtree = quadtree ? 1 : 0;
+
+            ImGui::SliderInt( "Quadtree Passes", &m_FilterData.m_AS_QuadtreePasses, 2, 5 );
+
+            bool varianceGuided = m_FilterData.m_AS_VarianceGuided != 0;
+            ImGui::Checkbox( "Variance Guided", &varianceGuided );
+            m_FilterData.m_AS_VarianceGuided = varianceGuided ? 1 : 0;
+
+            ImGui::SliderFloat( "Variance Limit", &m_FilterData.m_AS_VarianceLimit, 0.001, 1.0 );
+            ImGui::SliderInt( "Min History", &m_FilterData.m_AS_MinHistoryLength, 0, 32 );
+            ImGui::SliderFloat( "Converged Scale", &m_FilterData.m_AS_ConvergedLimitScale, 1, 8 );
+
+            if ( ImGui::Checkbox( "Frame Budget", &m_UseRayBudget ) && m_UseRayBudget )
+            {
+                cpulib::AdaptiveSamplerSettings current;
+                current.gridSize = m_FilterData.gridSize;
+                m_RayBudget.Reset( current );
+            }
+
+            cpulib::RayBudgetSettings budget = m_RayBudget.GetSettings();
+
+            int  budgetMode    = budget.mode == cpulib::BudgetMode::Rays ? 1 : 0;
+            bool budgetChanged = ImGui::Combo( "Budget Mode", &budgetMode, "Milliseconds\0Rays\0" );
+            if ( budgetChanged )
+            {
+                budget.mode   = budgetMode ? cpulib::BudgetMode::Rays : cpulib::BudgetMode::Milliseconds;
+                budget.target = budgetMode ? 0.25f * m_Width * m_Height : 1000.0f / 60.0f;
+            }
+
+            if ( budget.mode == cpulib::BudgetMode::Milliseconds )
+            {
+                budgetChanged |= ImGui::SliderFloat( "Budget (ms)", &budget.target, 1, 100 );
+            }
+            else
+            {
+                // Rays counted by the compaction passes, see m_RayCountReadback.
+                float megaRays = budget.target / 1000000.0f;
+                if ( ImGui::SliderFloat( "Budget (Mrays)", &megaRays, 0.01f, 10.0f ) )
+                {
+                    budget.target = megaRays * 1000000.0f;
+                    budgetChanged = true;
+                }
+            }
+
+            if ( budgetChanged )
+                m_RayBudget.SetSettings( budget );
+
+            ImGui::Text( "Rays cast %.2f M", m_LastCastRays / 1000000.0 );
+            if ( m_UseRayBudget )
+                ImGui::Text( "Load %.2f, looseness %.2f", m_RayBudget.GetLoad(), m_RayBudget.GetLooseness() );
+
             ImGui::End();
         }
     }
@@ -1744,6 +2182,23 @@ void DummyGame::OnGUI( const std::shared_ptr<dx12lib::CommandList>& commandList,
 }
 
 
+void DummyGame::UpdateRayBudget( double deltaTime )
+{
+    // The interpolated pixels are not read back from the GPU, the rays and the frame time are.
+    cpulib::FrameCounters counters;
+    counters.castRays   = m_LastCastRays;
+    counters.pixelCount = static_cast<uint64_t>( m_Width ) * m_Height;
+    counters.frameMs    = static_cast<float>( deltaTime * 1000.0 );
+
+    const cpulib::AdaptiveSamplerSettings& settings = m_RayBudget.Update( counters );
+
+    m_FilterData.gridSize            = settings.gridSize;
+    m_FilterData.m_AS_PosDiffLimit   = settings.posDiffLimit * scene_scale;
+    m_FilterData.m_AS_NormalDotLimit = settings.normalDotLimit;
+    m_FilterData.m_AS_DepthDiffLimit = settings.depthDiffLimit;
+    m_FilterData.m_AS_ColourLimit    = settings.colourLimit;
+}
+
 void DummyGame::OnRender()
 {
     // This is done here to prevent the window switching to fullscreen while rendering the GUI.
@@ -1763,11 +2218,14 @@ void DummyGame::OnRender()
 
         auto renderImage = m_RayRenderTarget.GetTexture( AttachmentPoint::Color0 );
 
-        // Render to textures
+        // Render to textures. The ray colour is placed in the SVGF heap, the clear initialises it.
+        commandList->AliasingBarrier( nullptr, renderImage );
         commandList->ClearTexture( renderImage, clearColor );
 
 
         commandList->CopyResource( swapChainBackBuffer, renderImage );
+        m_RenderGraph.SetState( m_SvgfRotation.GetFirstBuffer( cpulib::SVGF_RESOURCE_RAY_COLOUR ),
+                                cpulib::GraphResourceState::CopySource );
     }
     else
     {
@@ -1776,61 +2234,133 @@ void DummyGame::OnRender()
 
 
         auto d3d12Command = commandList->GetD3D12CommandList();
-#if RAY_TRACER /* Ray tracing calling. */
-        {
 
-#if UPDATE_TRANSFORMS
-            AccelerationBuffer::CreateTopLevelAS(m_Device.get(), commandList.get(), &mTlasSize, &m_TlasBuffers,
-                m_Instances, m_InstanceDescBuffer.get(), true);
-#endif
-            // clear image
-            auto colourRayOutput = m_RayRenderTarget.GetTexture( m_ColourSlot );
-            commandList->ClearTexture( colourRayOutput, clearColor );
-            commandList->UAVBarrier( colourRayOutput, true );
+        // This frame's ray buffers and last frame's history for the passes that use the start of the heap.
+        UpdateSvgfFrameBindings();
 
-            auto normalsRayOutput = m_RayRenderTarget.GetTexture( m_ColourSlot );
-            //commandList->ClearTexture( normalsRayOutput, clearColorAlphaOne );
-            commandList->UAVBarrier( normalsRayOutput, true );
-            
-            // Set global root signature
-            commandList->SetComputeRootSignature( m_RayScheduleRootSig );
-            // Set pipeline and heaps for shader table
-            commandList->SetPipelineState1( m_RayPipelineState, m_RayShaderHeap );
-            d3d12Command->SetComputeRootDescriptorTable( 0, m_RayShaderHeap->GetGpuDescriptorHandle() );
+        // The passes only declare the buffers they touch, m_RenderGraph places the barriers between them.
+        m_RenderGraph.Reset();
 
-            for (uint32_t i = 0; i <= m_FilterData.gridSize; ++i)
-            {
-                commandList->SetPipelineState( m_RaySchedulePipelineState, true, m_RayShaderHeap );
-                commandList->SetCompute32BitConstants( 1, 1, &i );
+        auto& swapChainRT         = m_SwapChain->GetRenderTarget();
+        auto  swapChainBackBuffer = swapChainRT.GetTexture( AttachmentPoint::Color0 );
 
-                // Set pipeline for schedule shader and dispatch
-                commandList->Dispatch( static_cast<unsigned int>( std::ceil( m_Width / BLOCK_SIZE ) ),
-                                       static_cast<unsigned int>( std::ceil( m_Height / BLOCK_SIZE ) ), 1, true );
+        dx12lib::CommandListGraphBackend graphBackend( *commandList );
+        for ( uint32_t buffer = 0; buffer < m_SvgfBuffers.size(); ++buffer )
+            graphBackend.SetResource( buffer, m_SvgfBuffers[buffer] );
+        graphBackend.SetResource( m_BackBufferHandle, swapChainBackBuffer );
 
-                for ( uint32_t i = 0; i < m_nbrRayRenderTargets; ++i )
-                {
-                    auto resource = m_RayRenderTarget.GetTexture( static_cast<AttachmentPoint>( i ) );
+        // Present left this frame's back buffer in D3D12_RESOURCE_STATE_PRESENT.
+        m_RenderGraph.SetState( m_BackBufferHandle, cpulib::GraphResourceState::Common );
 
-                    commandList->UAVBarrier( resource, true );
-                }
+        const unsigned int groupsX = static_cast<unsigned int>( std::ceil( m_Width / BLOCK_SIZE ) );
+        const unsigned int groupsY = static_cast<unsigned int>( std::ceil( m_Height / BLOCK_SIZE ) );
+
+#if RAY_TRACER /* Ray tracing calling. */
+#if UPDATE_TRANSFORMS
+        // Only when an instance moved, and from scratch once refitting has worn the TLAS down.
+        const cpulib::TlasUpdate tlasUpdate = m_TlasTracker.GetUpdate();
+        if ( tlasUpdate != cpulib::TlasUpdate::None )
+        {
+            AccelerationBuffer::CreateTopLevelAS( m_Device.get(), commandList.get(), &mTlasSize, &m_TlasBuffers,
+                                                  m_Instances, m_InstanceDescBuffer.get(),
+                                                  tlasUpdate == cpulib::TlasUpdate::Refit );
+            m_TlasTracker.Commit( tlasUpdate );
+        }
+#endif
+        // clear image
+        auto colourRayOutput = GetSvgfTexture( m_SvgfStages.trace, cpulib::SVGF_SLOT_RAY_COLOUR );
+        auto clearPass       = m_RenderGraph.AddPass( "clear", [&, colourRayOutput]() {
+            commandList->ClearTexture( colourRayOutput, clearColor );
+        } );
+        m_RenderGraph.Write( clearPass,
+                             m_SvgfRotation.GetBuffer( m_SvgfFrame, m_SvgfStages.trace, cpulib::SVGF_SLOT_RAY_COLOUR ),
+                             cpulib::GraphResourceState::RenderTarget );
+
+        // The quadtree scheduler needs the same number of passes for any grid size.
+        uint32_t passCount = m_FilterData.gridSize + 1;
+        if ( m_FilterData.m_AS_Quadtree && m_FilterData.gridSize > 0 )
+            passCount = std::clamp( m_FilterData.m_AS_QuadtreePasses, 2, m_FilterData.gridSize + 1 );
 
+        auto schedulePipelineState =
+            m_FilterData.m_AS_Quadtree ? m_QuadtreeSchedulePipelineState : m_RaySchedulePipelineState;
 
+        m_RayCountPasses = std::min( passCount, m_MaxRayCountPasses );
 
+        // Every pass adds to the ray buffers, so they read them as well.
+        for ( uint32_t i = 0; i < passCount; ++i )
+        {
+            auto schedulePass = m_RenderGraph.AddPass( "schedule", [&, i, schedulePipelineState]() {
+                // Set global root signature
+                commandList->SetComputeRootSignature( m_RayScheduleRootSig );
+                // Set pipeline and heaps for shader table
+                commandList->SetPipelineState( schedulePipelineState, true, m_RayShaderHeap );
+                d3d12Command->SetComputeRootDescriptorTable( 0, m_RayShaderHeap->GetGpuDescriptorHandle() );
+                commandList->SetCompute32BitConstants( 1, 1, &i );
+
+                commandList->Dispatch( groupsX, groupsY, 1, true );
+            } );
+            DeclareSvgfAccesses( schedulePass, m_SvgfStages.trace, true );
+
+            // The pixels this pass marked AS_CAST into a list, and the launch size for it into m_DispatchRaysArgs.
+            auto compactPass = m_RenderGraph.AddPass( "compact", [&]() {
+                auto dispatchArgs = m_DispatchRaysArgs->GetD3D12Resource();
+                auto counters     = m_CompactionCounters->GetD3D12Resource();
+                auto upload       = m_CompactionUpload->GetD3D12Resource();
+
+                // The previous trace pass is done with the arguments and the list.
+                commandList->TransitionBarrier( m_DispatchRaysArgs, D3D12_RESOURCE_STATE_COPY_DEST );
+                commandList->TransitionBarrier( m_CompactionCounters, D3D12_RESOURCE_STATE_COPY_DEST,
+                                                D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, true );
+                d3d12Command->CopyBufferRegion( dispatchArgs.Get(), 0, upload.Get(), 0,
+                                                sizeof( D3D12_DISPATCH_RAYS_DESC ) );
+                d3d12Command->CopyBufferRegion( counters.Get(), 0, upload.Get(), sizeof( D3D12_DISPATCH_RAYS_DESC ),
+                                                2 * sizeof( uint32_t ) );
+
+                commandList->TransitionBarrier( m_DispatchRaysArgs, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+                commandList->TransitionBarrier( m_CompactionCounters, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+                commandList->TransitionBarrier( m_CompactedPixels, D3D12_RESOURCE_STATE_UNORDERED_ACCESS );
+                commandList->UAVBarrier( m_CompactedPixels, true );
+
+                RayCompactionData compactionData;
+                compactionData.windowResolution[0] = m_Width;
+                compactionData.windowResolution[1] = m_Height;
+                compactionData.groupCount          = groupsX * groupsY;
+                compactionData.dispatchArgsOffset  = offsetof( D3D12_DISPATCH_RAYS_DESC, Width );
+
+                commandList->SetComputeRootSignature( m_RayCompactionRootSig );
+                commandList->SetPipelineState( m_RayCompactionPipelineState, true, m_RayShaderHeap );
+                d3d12Command->SetComputeRootDescriptorTable( 0, m_RayShaderHeap->GetGpuDescriptorHandle() );
+                d3d12Command->SetComputeRootDescriptorTable(
+                    1, m_RayShaderHeap->GetGpuDescriptorHandle( m_CompactionDescriptors ) );
+                commandList->SetCompute32BitConstants( 2, compactionData );
+
+                commandList->Dispatch( groupsX, groupsY, 1, true );
+
+                // The trace pass reads the list and the ray count.
+                commandList->UAVBarrier( m_CompactedPixels );
+                commandList->UAVBarrier( m_CompactionCounters, true );
+            } );
+            m_RenderGraph.Read( compactPass, m_SvgfRotation.GetBuffer( m_SvgfFrame, m_SvgfStages.trace,
+                                                                       cpulib::SVGF_SLOT_RAY_COLOUR ) );
+
+            auto tracePass = m_RenderGraph.AddPass( "trace", [&, i]() {
                 // Set pipeline and heaps for shader table
                 commandList->SetPipelineState1( m_RayPipelineState, m_RayShaderHeap );
-                // Dispatch Rays
-                commandList->DispatchRays( &m_RaytraceDesc );
+                // Only the listed pixels, the argument buffer holds the launch size the compaction wrote.
+                commandList->ExecuteIndirect( m_DispatchRaysSignature.Get(), m_DispatchRaysArgs );
 
-                for ( uint32_t i = 0; i < m_nbrRayRenderTargets; ++i )
+                // The ray count of this pass for the rays budget, summed once the frame is done.
+                if ( i < m_MaxRayCountPasses )
                 {
-                    auto resource = m_RayRenderTarget.GetTexture( static_cast<AttachmentPoint>( i ) );
-
-                    commandList->UAVBarrier( resource, true );
+                    commandList->TransitionBarrier( m_CompactionCounters, D3D12_RESOURCE_STATE_COPY_SOURCE,
+                                                    D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, true );
+                    d3d12Command->CopyBufferRegion( m_RayCountReadback->GetD3D12Resource().Get(),
+                                                    i * sizeof( uint32_t ),
+                                                    m_CompactionCounters->GetD3D12Resource().Get(), 0,
+                                                    sizeof( uint32_t ) );
                 }
-            } 
-
-
-
+            } );
+            DeclareSvgfAccesses( tracePass, m_SvgfStages.trace, true );
         }
 #endif
 
@@ -1841,122 +2371,47 @@ void DummyGame::OnRender()
         3. objectMask
         */
 
-        // Set global root signature for denoise shaders
-        commandList->SetComputeRootSignature(m_DenoiserRootSig);
-        // Get commandlist and set heap for denoise shaders
-        d3d12Command->SetComputeRootDescriptorTable(0, m_RayShaderHeap->GetGpuDescriptorHandle());
-
-            // Set pipeline for REPROJECTION shader and dispatch
-            commandList->SetPipelineState(m_SVGF_ReprojectionPipelineState, false, m_RayShaderHeap);
-            commandList->Dispatch( static_cast<unsigned int>( std::ceil(m_Width / BLOCK_SIZE)),
-                                   static_cast<unsigned int>( std::ceil( m_Height / BLOCK_SIZE ) ), 1, true );
-
-            // Wait for dispatch to finish writing.
-            for (uint32_t i = 0; i < m_nbrFilterRenderTargets; ++i) {
-                auto resource = m_FilterRenderTarget.GetTexture(static_cast<AttachmentPoint>(i));
-                commandList->UAVBarrier(resource, true);
-            }
-
-            // Copy MOMENT target to source - this is used in MOMENTS
-            auto srcMomentTarget  = m_FilterRenderTarget.GetTexture( m_FilterMomentTarget );
-            auto dstMomentSource = m_FilterRenderTarget.GetTexture( m_FilterMomentSource );
-            commandList->CopyResource( dstMomentSource, srcMomentTarget );
-            commandList->UAVBarrier( dstMomentSource, true );
-
-            // Copy COLOUR target to source - this is used in MOMENTS
-            auto srcColourTarget = m_FilterRenderTarget.GetTexture( m_FilterColourTarget );
-            auto dstColourSource = m_FilterRenderTarget.GetTexture( m_ColourSlot );
-            commandList->CopyResource( dstColourSource, srcColourTarget );
-            commandList->UAVBarrier( dstColourSource, true );
-
-        // Set pipeline for MOMENTS shader and dispatch
-        commandList->SetPipelineState(m_SVGF_MomentsPipelineState, false, m_RayShaderHeap);
-        commandList->Dispatch( static_cast<unsigned int>( std::ceil( m_Width / BLOCK_SIZE ) ),
-                            static_cast<unsigned int>( std::ceil( m_Height / BLOCK_SIZE ) ), 1, true );
-
-        // Wait for dispatch to finish writing.
-        for (uint32_t i = 0; i < m_nbrFilterRenderTargets; ++i) {
-            auto resource = m_FilterRenderTarget.GetTexture(static_cast<AttachmentPoint>(i));
-            commandList->UAVBarrier(resource, true);
-        }
-
-        // Copy MOMENT target to source - this is used in ATROUS
-        commandList->CopyResource( dstMomentSource, srcMomentTarget );
-        commandList->UAVBarrier( dstMomentSource, true );
-
-        // Copy COLOUR  target to source - this is used in ATROUS
-        commandList->CopyResource( dstColourSource, srcColourTarget );
-        commandList->UAVBarrier( dstColourSource, true );
-
-            // Copy MOMENT target to HISTORY once we have finished MOMENT SVGF filter.
-            auto dstMomentHistory = m_HistoryRenderTarget.GetTexture( m_MomentHistory );
-            commandList->CopyResource( dstMomentHistory, srcMomentTarget );
-            commandList->UAVBarrier( dstMomentHistory, true );
-            
-                
-        // A TROUS WAVELET FILTER
-        for (int i = 1; i <= 5; ++i) {
-
-            // Set pipeline for MOMENTS shader and dispatch
-            commandList->SetPipelineState( m_SVGF_AtrousPipelineState, false, m_RayShaderHeap );
-            commandList->Dispatch( static_cast<unsigned int>(std::ceil(m_Width / BLOCK_SIZE)),
-                               static_cast<unsigned int>( std::ceil(m_Height / BLOCK_SIZE)), 1, true );
-
-            // Wait for dispatch to finish writing.
-            for ( uint32_t i = 0; i < m_nbrFilterRenderTargets; ++i ) {
-                auto resource = m_FilterRenderTarget.GetTexture( static_cast<AttachmentPoint>( i ) );
-                commandList->UAVBarrier( resource, true );
-            }
-
-            // Copy COLOUR target to source - this is used in ATROUS
-            commandList->CopyResource( dstColourSource, srcColourTarget );
-            commandList->UAVBarrier( dstColourSource, true );
-
-            // Copy MOMENT target to source - this is used in ATROUS
-            commandList->CopyResource( dstMomentSource, srcMomentTarget );
-            commandList->UAVBarrier( dstMomentSource, true );
-
-            if (i == 1) {
-                // Copy COLOUR target to HISTORY once we have finished MOMENT SVGF filter.
-                auto dstIntegradedColour = m_HistoryRenderTarget.GetTexture( m_ColourSlot );
-                commandList->CopyResource( dstIntegradedColour, srcColourTarget );
-                commandList->UAVBarrier( dstIntegradedColour, true );
-            
-            }
-        }
-        
-        // Get output image and swaptchain image, then copy over
-        auto  outputImage         = m_FilterRenderTarget.GetTexture( m_FilterOutputSDR );
-        auto& swapChainRT         = m_SwapChain->GetRenderTarget();
-        auto  swapChainBackBuffer = swapChainRT.GetTexture( AttachmentPoint::Color0 );
-        commandList->CopyResource( swapChainBackBuffer, outputImage );
-
-        // Copy flatout to history buffer without processing. LAST STEP 
-        auto dstNormal = m_HistoryRenderTarget.GetTexture( m_NormalsSlot );
-        auto srcNormal = m_RayRenderTarget.GetTexture( m_NormalsSlot );
-        commandList->CopyResource( dstNormal, srcNormal );
-        commandList->UAVBarrier( dstNormal, true );
-
-        auto dstWorldDepth = m_HistoryRenderTarget.GetTexture( m_PosDepth );
-        auto srcWorldDepth = m_RayRenderTarget.GetTexture( m_PosDepth );
-        commandList->CopyResource( dstWorldDepth, srcWorldDepth );
-        commandList->UAVBarrier( dstWorldDepth, true );
-        
-        auto dstObject = m_HistoryRenderTarget.GetTexture( m_ObjectMask );
-        auto srcObject = m_RayRenderTarget.GetTexture( m_ObjectMask );
-        commandList->CopyResource( dstObject, srcObject );
-        commandList->UAVBarrier( dstObject, true );
-
-
-        
-        for ( uint32_t i = 0; i < m_nbrFilterRenderTargets; ++i )
-        {
-            auto resource = m_FilterRenderTarget.GetTexture( static_cast<AttachmentPoint>( i ) );
-
-            commandList->ClearTexture( resource, clearColor );
-
-            commandList->UAVBarrier( resource, true );
-        }
+        // Every pass binds the table m_SvgfRotation picked for it, the sources are the buffers the previous pass
+        // wrote to, so nothing is copied between the passes.
+        auto addSvgfPass = [&]( uint32_t stage, const std::shared_ptr<PipelineStateObject>& pipelineState ) {
+            auto pass = m_RenderGraph.AddPass( m_SvgfRotation.GetStageName( stage ), [&, stage, pipelineState]() {
+                // Set global root signature for denoise shaders
+                commandList->SetComputeRootSignature( m_DenoiserRootSig );
+                commandList->SetPipelineState( pipelineState, false, m_RayShaderHeap );
+                d3d12Command->SetComputeRootDescriptorTable( 0, GetSvgfBindingSet( stage ) );
+                d3d12Command->SetComputeRootDescriptorTable(
+                    1, m_RayShaderHeap->GetGpuDescriptorHandle( m_nbrRayRenderTargets + m_nbrHistoryRenderTargets +
+                                                                m_nbrFilterRenderTargets + 2 ) );
+
+                commandList->Dispatch( groupsX, groupsY, 1, true );
+            } );
+            DeclareSvgfAccesses( pass, stage, false );
+        };
+
+        addSvgfPass( m_SvgfStages.reprojection, m_SVGF_ReprojectionPipelineState );
+
+        // Its moment target is the next frame's moment history.
+        addSvgfPass( m_SvgfStages.moments, m_SVGF_MomentsPipelineState );
+
+        // A TROUS WAVELET FILTER, the first colour target is the next frame's colour history.
+        for ( int i = 0; i < m_nbrAtrousIterations; ++i )
+            addSvgfPass( m_SvgfStages.atrous + i, m_SVGF_AtrousPipelineState );
+
+        // Copy the output image to the swapchain image
+        m_RenderGraph.AddCopyPass(
+            "present", m_BackBufferHandle,
+            m_SvgfRotation.GetBuffer( m_SvgfFrame, m_SvgfStages.present, cpulib::SVGF_SLOT_SDR_TARGET ) );
+
+        // Besides the back buffer, the history the next frame reads has to be written.
+        m_RenderGraph.MarkOutput( m_BackBufferHandle );
+        for ( uint32_t buffer: m_SvgfRotation.GetHistoryBuffers( m_SvgfFrame ) )
+            m_RenderGraph.MarkOutput( buffer );
+
+        m_RenderGraph.Compile();
+        m_RenderGraph.Execute( graphBackend );
+
+        // The ray normals, position/depth and object IDs of this frame are the next frame's history as they are.
+        ++m_SvgfFrame;
     }
     
     // Render GUI.
@@ -1965,6 +2420,22 @@ void DummyGame::OnRender()
     auto fence = commandQueue.ExecuteCommandList( commandList );
     commandQueue.WaitForFenceValue( fence );
 
+#if RAY_TRACER
+    // The GPU is done with the frame, so are the copies of the ray counts.
+    if ( m_RayCountPasses > 0 )
+    {
+        uint32_t* pRayCounts;
+        ThrowIfFailed( m_RayCountReadback->Map( (void**)&pRayCounts ) );
+
+        m_LastCastRays = 0;
+        for ( uint32_t pass = 0; pass < m_RayCountPasses; ++pass )
+            m_LastCastRays += pRayCounts[pass];
+
+        m_RayCountReadback->Unmap( 0, 0 );
+        m_RayCountPasses = 0;
+    }
+#endif
+
     // Present
     m_SwapChain->Present();
 }
@@ -0,0 +1,98 @@
+/*
+ *  Cooks the textures of the Playground scenes to block compressed DDS files
+ *  with their mips, into the cache LoadTextureFromFile looks in. Run it from
+ *  the directory the game runs from; textures already in the cache are
+ *  skipped unless -force.
+ *
+ *  TextureCooker [-wd <dir>] [-threads <n>] [-force] [-slow] [-cache <dir>] [scene files...]
+ */
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <dx12lib/Scene.h>
+#include <dx12lib/TextureCooker.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace dx12lib;
+
+static void Print( const std::wstring& fileName, const TextureCookStats& stats )
+{
+    wprintf( L"%ls: %u textures, %u cooked, %u cached, %u left uncompressed\n", fileName.c_str(), stats.textures,
+             stats.cooked, stats.cached, stats.uncompressed );
+    wprintf( L"    %.1f MB of sources, %.1f MB cooked, %.3f s\n", stats.sourceBytes / ( 1024.0 * 1024.0 ),
+             stats.cookedBytes / ( 1024.0 * 1024.0 ), stats.seconds );
+
+    for ( const std::wstring& failure: stats.failures )
+    {
+        wprintf( L"    %ls\n", failure.c_str() );
+    }
+}
+
+int wmain( int argc, wchar_t* argv[] )
+{
+    TextureCookOptions        options;
+    std::vector<std::wstring> files;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        // -wd Specify the Working Directory.
+        if ( wcscmp( argv[i], L"-wd" ) == 0 && i + 1 < argc )
+        {
+            SetCurrentDirectoryW( argv[++i] );
+        }
+        else if ( wcscmp( argv[i], L"-threads" ) == 0 && i + 1 < argc )
+        {
+            options.numThreads = static_cast<uint32_t>( _wtoi( argv[++i] ) );
+        }
+        else if ( wcscmp( argv[i], L"-force" ) == 0 )
+        {
+            options.force = true;
+        }
+        // Every BC7 mode, for the final assets.
+        else if ( wcscmp( argv[i], L"-slow" ) == 0 )
+        {
+            options.quick = false;
+        }
+        else if ( wcscmp( argv[i], L"-cache" ) == 0 && i + 1 < argc )
+        {
+            TextureCooker::SetCacheDirectory( argv[++i] );
+        }
+        else
+        {
+            files.push_back( argv[i] );
+        }
+    }
+
+    // The OBJ scenes DummyGame loads.
+    if ( files.empty() )
+    {
+        files = { L"Assets/Models/CornellBox/CornellBox-Original.obj",
+                  L"Assets/Models/crytek-sponza/sponza_nobanner.obj",
+                  L"Assets/Models/SunTemple/sunTemple.obj",
+                  L"Assets/Models/AmazonLumberyard/interior.obj",
+                  L"Assets/Models/San_Miguel/san-miguel-low-poly.obj" };
+    }
+
+    int retCode = 0;
+    for ( const std::wstring& fileName: files )
+    {
+        TextureCookStats stats;
+        if ( !Scene::CookTextures( fileName, options, stats ) )
+        {
+            retCode = 1;
+            if ( stats.textures == 0 )
+            {
+                wprintf( L"%ls: can't be read\n", fileName.c_str() );
+                continue;
+            }
+        }
+
+        Print( fileName, stats );
+    }
+
+    return retCode;
+}
@@ -188,6 +188,7 @@ bool Tutorial5::LoadScene( const std::wstring& sceneFile )
         s.Radius *= scale;
 
         scene->GetRootNode()->SetLocalTransform( XMMatrixScaling( scale, scale, scale ) );
+        scene->UpdateTransforms();
 
         // Position the camera so that it is looking at the loaded scene.
         auto cameraRotation   = m_Camera.get_Rotation();
@@ -323,6 +324,7 @@ void Tutorial5::OnUpdate( UpdateEventArgs& e )
     XMMATRIX translationMatrix = XMMatrixTranslationFromVector( cameraPoint );
     XMMATRIX scaleMatrix = XMMatrixScaling( 0.01f, 0.01f, 0.01f );
     m_Axis->GetRootNode()->SetLocalTransform( scaleMatrix * translationMatrix );
+    m_Axis->UpdateTransforms();
 
     XMMATRIX viewMatrix = m_Camera.get_ViewMatrix();
 
@@ -433,6 +435,7 @@ void Tutorial5::OnRender()
             auto worldMatrix       = XMMatrixTranslationFromVector( lightPos );
 
             m_Sphere->GetRootNode()->SetLocalTransform( worldMatrix );
+            m_Sphere->UpdateTransforms();
             m_Sphere->GetRootNode()->GetMesh()->GetMaterial()->SetMaterialProperties( lightMaterial );
             m_Sphere->Accept( unlitPass );
         }
@@ -449,6 +452,7 @@ void Tutorial5::OnRender()
             auto worldMatrix    = rotationMatrix * LookAtMatrix( lightPos, lightDir, up );
 
             m_Cone->GetRootNode()->SetLocalTransform( worldMatrix );
+            m_Cone->UpdateTransforms();
             m_Cone->GetRootNode()->GetMesh()->GetMaterial()->SetMaterialProperties( lightMaterial );
             m_Cone->Accept( unlitPass );
         }